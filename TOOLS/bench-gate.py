@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Run the benchmark suite (meson benchmark() targets in the "bench" suite),
+store the results as a baseline for a machine profile, or compare against a
+stored baseline and fail if a metric regressed by more than a threshold.
+
+    bench-gate.py record  -C build [--profile NAME]
+    bench-gate.py compare -C build [--profile NAME] [--threshold 10]
+
+Results are parsed from the output of the benchmarks: JSON lines (one object
+per result, with a "bench" name and numeric fields; lower is better), and text
+lines ending in a throughput unit such as "Mpixels/s" or "MB/s" (higher is
+better). Counts like "frames" or "runs" are not metrics.
+
+With --trace-dir, every benchmark with a regression is run once more with
+MPV_STATS_TRACE set, which writes a trace of the stats profiler sections in
+the Chrome trace event format (chrome://tracing, https://ui.perfetto.dev).
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+
+COUNT_KEYS = {"bench", "frames", "runs", "ops", "url"}
+THROUGHPUT_RE = re.compile(r"^(.*?)\s+([0-9]+(?:\.[0-9]+)?)\s+([A-Za-z]+/s)\s*$")
+LOGBASE = "bench-gate"
+
+
+def default_profile():
+    name = "%s-%s-%s" % (platform.system(), platform.machine(), platform.node())
+    return re.sub(r"[^A-Za-z0-9._-]", "_", name.lower())
+
+
+def parse_output(test, stdout):
+    metrics = {}
+    for line in stdout.splitlines():
+        line = line.strip()
+        if line.startswith("{"):
+            try:
+                obj = json.loads(line)
+            except ValueError:
+                continue
+            if not isinstance(obj, dict) or "bench" not in obj:
+                continue
+            for key, val in obj.items():
+                if key in COUNT_KEYS or isinstance(val, bool):
+                    continue
+                if isinstance(val, (int, float)):
+                    name = "%s/%s/%s" % (test, obj["bench"], key)
+                    metrics[name] = (float(val), False)
+            continue
+        m = THROUGHPUT_RE.match(line)
+        if m:
+            label = " ".join(m.group(1).split())
+            name = "%s/%s %s" % (test, label, m.group(3))
+            metrics[name] = (float(m.group(2)), True)
+    return metrics
+
+
+def read_log(path):
+    tests = []
+    with open(path) as f:
+        for line in f:
+            if line.strip():
+                tests.append(json.loads(line))
+    return tests
+
+
+def test_name(entry):
+    return entry["name"].split(":")[-1].strip()
+
+
+def run_suite(args):
+    cmd = ["meson", "test", "-C", args.build_dir, "--benchmark",
+           "--suite", args.suite, "--logbase", LOGBASE] + args.benchmarks
+    print("Running: " + " ".join(cmd), file=sys.stderr)
+    # Failing benchmarks are reported below, with their metrics missing.
+    subprocess.call(cmd, stdout=sys.stderr)
+    return read_log(os.path.join(args.build_dir, "meson-logs", LOGBASE + ".json"))
+
+
+def collect(args):
+    """Returns ({metric: (value, higher_is_better)}, {metric: test entry})."""
+    runs = {}
+    entries = {}
+    for n in range(args.repeat):
+        log = read_log(args.from_log) if args.from_log else run_suite(args)
+        for entry in log:
+            if entry.get("result") not in (None, "OK", "EXPECTEDFAIL"):
+                print("Benchmark %s failed: %s" % (test_name(entry),
+                      entry.get("result")), file=sys.stderr)
+            for name, val in parse_output(test_name(entry),
+                                          entry.get("stdout") or "").items():
+                runs.setdefault(name, []).append(val)
+                entries[name] = entry
+        if args.from_log:
+            break
+    # The median over repeated runs is less sensitive to outliers.
+    metrics = {name: (statistics.median(v for v, _ in vals), vals[0][1])
+               for name, vals in runs.items()}
+    return metrics, entries
+
+
+def baseline_path(args):
+    return os.path.join(args.baseline_dir, args.profile + ".json")
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"],
+                                       stderr=subprocess.DEVNULL,
+                                       cwd=os.path.dirname(os.path.abspath(__file__)),
+                                       text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def cmd_record(args):
+    metrics, _ = collect(args)
+    if not metrics:
+        sys.exit("No benchmark results found.")
+    os.makedirs(args.baseline_dir, exist_ok=True)
+    data = {
+        "profile": args.profile,
+        "machine": {
+            "system": platform.system(),
+            "machine": platform.machine(),
+            "processor": platform.processor(),
+            "cpus": os.cpu_count(),
+        },
+        "revision": git_revision(),
+        "metrics": {name: {"value": val, "higher_is_better": hib}
+                    for name, (val, hib) in sorted(metrics.items())},
+    }
+    path = baseline_path(args)
+    with open(path, "w") as f:
+        json.dump(data, f, indent=2)
+        f.write("\n")
+    print("Wrote %d metrics to %s" % (len(metrics), path))
+
+
+def write_traces(args, entries, failed):
+    os.makedirs(args.trace_dir, exist_ok=True)
+    done = set()
+    for name in sorted(failed):
+        entry = entries[name]
+        test = test_name(entry)
+        if test in done or not entry.get("command"):
+            continue
+        done.add(test)
+        trace = os.path.abspath(os.path.join(args.trace_dir,
+                                             re.sub(r"[^A-Za-z0-9._-]", "_", test)
+                                             + ".json"))
+        env = dict(os.environ)
+        env.update(entry.get("env") or {})
+        env["MPV_STATS_TRACE"] = trace
+        print("Tracing %s to %s" % (test, trace), file=sys.stderr)
+        subprocess.call(entry["command"], env=env, cwd=args.build_dir,
+                        stdout=subprocess.DEVNULL)
+
+
+def cmd_compare(args):
+    path = baseline_path(args)
+    try:
+        with open(path) as f:
+            baseline = json.load(f)["metrics"]
+    except FileNotFoundError:
+        sys.exit("No baseline for profile '%s' (%s). Use 'record' first."
+                 % (args.profile, path))
+
+    metrics, entries = collect(args)
+    threshold = args.threshold / 100
+    failed = []
+    missing = []
+    for name, base in sorted(baseline.items()):
+        if name not in metrics:
+            missing.append(name)
+            continue
+        val, hib = metrics[name]
+        ref = base["value"]
+        if not ref:
+            continue
+        change = (val - ref) / abs(ref)
+        if base.get("higher_is_better", hib):
+            change = -change
+        mark = ""
+        if change > threshold:
+            failed.append(name)
+            mark = "  REGRESSION"
+        if mark or args.verbose:
+            print("%-70s %12.3f -> %12.3f %+7.1f%%%s" % (name, ref, val,
+                  change * 100, mark))
+
+    for name in missing:
+        print("%-70s missing" % name)
+    new = sorted(set(metrics) - set(baseline))
+    if new:
+        print("%d metrics not in the baseline (re-record to include them)."
+              % len(new))
+
+    if failed and args.trace_dir:
+        write_traces(args, entries, failed)
+
+    print("%d of %d metrics regressed by more than %g%%." % (len(failed),
+          len(baseline), args.threshold))
+    if failed or (missing and not args.allow_missing):
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("command", choices=["record", "compare"])
+    parser.add_argument("benchmarks", nargs="*",
+                        help="only run these benchmarks (default: all)")
+    parser.add_argument("-C", dest="build_dir", default=".",
+                        help="meson build directory")
+    parser.add_argument("--suite", default="bench")
+    parser.add_argument("--profile", default=default_profile(),
+                        help="machine profile name (default: %(default)s)")
+    parser.add_argument("--baseline-dir", default="bench-baselines",
+                        help="where baselines are stored (default: %(default)s)")
+    parser.add_argument("--from-log",
+                        help="use an existing meson benchmark log instead of "
+                             "running the benchmarks")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="run the suite this many times and use the median")
+    parser.add_argument("--threshold", type=float, default=10,
+                        help="allowed regression in percent (default: %(default)s)")
+    parser.add_argument("--trace-dir",
+                        help="write stats traces of regressed benchmarks here")
+    parser.add_argument("--allow-missing", action="store_true",
+                        help="don't fail if baseline metrics are missing")
+    parser.add_argument("-v", "--verbose", action="store_true",
+                        help="print all compared metrics")
+    args = parser.parse_args()
+    args.repeat = max(args.repeat, 1)
+
+    if args.command == "record":
+        cmd_record(args)
+    else:
+        cmd_compare(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -53,6 +54,14 @@ struct priv {
     AVRational codec_timebase;
     struct lavc_state state;
 
+    // --ad-lavc-coalesce
+    double coalesce;
+    struct mp_aframe_pool *batch_pool;
+    struct mp_aframe *batch;    // pending output frame, or NULL
+    int batch_samples;          // samples used in batch
+    int batch_alloc;            // allocated samples (0 if not from batch_pool)
+    bool batch_ready;           // batch must be output before decoding more
+
     struct mp_decoder public;
 };
 
@@ -61,6 +70,7 @@ struct ad_lavc_params {
     float ac3drc;
     bool downmix;
     int threads;
+    double coalesce;
     char **avopts;
 };
 
@@ -69,6 +79,7 @@ const struct m_sub_options ad_lavc_conf = {
         {"ac3drc", OPT_FLOAT(ac3drc), M_RANGE(0, 6)},
         {"downmix", OPT_BOOL(downmix)},
         {"threads", OPT_INT(threads), M_RANGE(0, 16)},
+        {"coalesce", OPT_DOUBLE(coalesce), M_RANGE(0, 1)},
         {"o", OPT_KEYVALUELIST(avopts)},
         {0}
     },
@@ -91,6 +102,10 @@ static bool init(struct mp_filter *da, struct mp_codec_params *codec,
 
     ctx->codec_timebase = mp_get_codec_timebase(codec);
 
+    ctx->coalesce = opts->coalesce;
+    if (ctx->coalesce > 0)
+        ctx->batch_pool = mp_aframe_pool_create(ctx);
+
     if (codec->force_channels)
         ctx->force_channel_map = codec->channels;
 
@@ -158,6 +173,7 @@ static void ad_lavc_destroy(struct mp_filter *da)
     avcodec_free_context(&ctx->avctx);
     av_frame_free(&ctx->avframe);
     mp_free_av_packet(&ctx->avpkt);
+    talloc_free(ctx->batch);
 }
 
 static void ad_lavc_reset(struct mp_filter *da)
@@ -170,6 +186,9 @@ static void ad_lavc_reset(struct mp_filter *da)
     ctx->preroll_done = false;
     ctx->next_pts = MP_NOPTS_VALUE;
     ctx->state = (struct lavc_state){0};
+    TA_FREEP(&ctx->batch);
+    ctx->batch_samples = ctx->batch_alloc = 0;
+    ctx->batch_ready = false;
 }
 
 static int send_packet(struct mp_filter *da, struct demux_packet *mpkt)
@@ -191,13 +210,106 @@ static int send_packet(struct mp_filter *da, struct demux_packet *mpkt)
     return ret;
 }
 
+static struct mp_aframe *batch_take(struct priv *priv)
+{
+    struct mp_aframe *f = priv->batch;
+    if (f && priv->batch_alloc)
+        mp_aframe_set_size(f, priv->batch_samples);
+    priv->batch = NULL;
+    priv->batch_samples = priv->batch_alloc = 0;
+    priv->batch_ready = false;
+    return f;
+}
+
+// Whether f can be appended to the batch without changing the output.
+static bool batch_fits(struct priv *priv, struct mp_aframe *f)
+{
+    struct mp_aframe *b = priv->batch;
+    if (!priv->batch_alloc || !mp_aframe_config_equals(b, f))
+        return false;
+    if (priv->batch_samples + mp_aframe_get_size(f) > priv->batch_alloc)
+        return false;
+    double pts = mp_aframe_get_pts(b), next = mp_aframe_get_pts(f);
+    if (pts == MP_NOPTS_VALUE || next == MP_NOPTS_VALUE)
+        return false;
+    double end = pts + priv->batch_samples / (double)mp_aframe_get_rate(b);
+    return fabs(end - next) < 0.001;
+}
+
+// Start a new batch with f. Takes ownership of f.
+static void batch_start(struct priv *priv, struct mp_aframe *f, int target)
+{
+    int samples = mp_aframe_get_size(f);
+    priv->batch = f;
+    priv->batch_samples = samples;
+    priv->batch_alloc = 0;
+    if (samples >= target)
+        return;
+
+    // Leave room for one more frame of up to the target size, so anything
+    // that doesn't complete the batch yet still fits.
+    struct mp_aframe *b = mp_aframe_create();
+    mp_aframe_config_copy(b, f);
+    if (mp_aframe_pool_allocate(priv->batch_pool, b, target * 2) < 0 ||
+        !mp_aframe_copy_samples(b, 0, f, 0, samples))
+    {
+        talloc_free(b);
+        return; // just pass f through on its own
+    }
+    talloc_free(f);
+    priv->batch = b;
+    priv->batch_alloc = target * 2;
+}
+
+// Add f to the pending batch (takes ownership of it), and return a frame
+// that is complete and ready for output, or NULL.
+static struct mp_aframe *coalesce_frame(struct priv *priv, struct mp_aframe *f)
+{
+    int target = MPMAX(lrint(priv->coalesce * mp_aframe_get_rate(f)), 1);
+    struct mp_aframe *out = NULL;
+
+    if (priv->batch && !batch_fits(priv, f))
+        out = batch_take(priv);
+
+    if (priv->batch) {
+        int samples = mp_aframe_get_size(f);
+        mp_aframe_copy_samples(priv->batch, priv->batch_samples, f, 0, samples);
+        priv->batch_samples += samples;
+        talloc_free(f);
+    } else {
+        batch_start(priv, f, target);
+    }
+
+    if (priv->batch_samples >= target || !priv->batch_alloc) {
+        if (out) {
+            priv->batch_ready = true;
+        } else {
+            out = batch_take(priv);
+        }
+    }
+
+    return out;
+}
+
 static int receive_frame(struct mp_filter *da, struct mp_frame *out)
 {
     struct priv *priv = da->priv;
     AVCodecContext *avctx = priv->avctx;
 
+    if (priv->batch_ready) {
+        *out = MAKE_FRAME(MP_FRAME_AUDIO, batch_take(priv));
+        return 0;
+    }
+
     int ret = avcodec_receive_frame(avctx, priv->avframe);
 
+    if (ret == AVERROR_EOF && priv->batch) {
+        // Output the rest first; the decoder returns EOF again on the next
+        // call.
+        *out = MAKE_FRAME(MP_FRAME_AUDIO, batch_take(priv));
+        return 0;
+    }
+
     if (ret == AVERROR_EOF) {
         // If flushing was initialized earlier and has ended now, make it start
         // over in case we get new packets at some point in the future.
@@ -263,7 +375,11 @@ static int receive_frame(struct mp_filter *da, struct mp_frame *out)
     // Strip possibly bogus float values like Infinity, NaN, denormalized
     mp_aframe_sanitize_float(mpframe);
 
-    if (mp_aframe_get_size(mpframe) > 0) {
+    if (mp_aframe_get_size(mpframe) > 0 && priv->batch_pool) {
+        struct mp_aframe *res = coalesce_frame(priv, mpframe);
+        if (res)
+            *out = MAKE_FRAME(MP_FRAME_AUDIO, res);
+    } else if (mp_aframe_get_size(mpframe) > 0) {
         *out = MAKE_FRAME(MP_FRAME_AUDIO, mpframe);
     } else {
         talloc_free(mpframe);
@@ -1,6 +1,8 @@
 #include <float.h>
 #include <math.h>
 
+#include <libavutil/cpu.h>
+
 #include "audio/chmap.h"
 #include "audio/filter/af_scaletempo2_internals.h"
 
@@ -59,35 +61,6 @@ static void zero_2d_partial(float **a, int x, int y)
     }
 }
 
-// Energies of sliding windows of channels are interleaved.
-// The number windows is |input_frames| - (|frames_per_window| - 1), hence,
-// the method assumes |energy| must be, at least, of size
-// (|input_frames| - (|frames_per_window| - 1)) * |channels|.
-static void multi_channel_moving_block_energies(
-    float **input, int input_frames, int channels,
-    int frames_per_block, float *energy)
-{
-    int num_blocks = input_frames - (frames_per_block - 1);
-
-    for (int k = 0; k < channels; ++k) {
-        const float* input_channel = input[k];
-
-        energy[k] = 0;
-
-        // First block of channel |k|.
-        for (int m = 0; m < frames_per_block; ++m) {
-            energy[k] += input_channel[m] * input_channel[m];
-        }
-
-        const float* slide_out = input_channel;
-        const float* slide_in = input_channel + frames_per_block;
-        for (int n = 1; n < num_blocks; ++n, ++slide_in, ++slide_out) {
-            energy[k + n * channels] = energy[k + (n - 1) * channels]
-                - *slide_out * *slide_out + *slide_in * *slide_in;
-        }
-    }
-}
-
 static float multi_channel_similarity_measure(
     const float* dot_prod,
     const float* energy_target, const float* energy_candidate,
@@ -106,10 +79,18 @@ static float multi_channel_similarity_measure(
 
 typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_DOT_PRODUCT_AVX2 1
+#else
+#define HAVE_DOT_PRODUCT_AVX2 0
+#endif
+
 // Dot-product of channels of two AudioBus. For each AudioBus an offset is
 // given. |dot_product[k]| is the dot-product of channel |k|. The caller should
 // allocate sufficient space for |dot_product|.
-static void multi_channel_dot_product(
+// This is always inlined, so that the vector code is compiled for the target
+// of the caller.
+static inline __attribute__((always_inline)) void dot_product_vector(
     float **a, int frame_offset_a,
     float **b, int frame_offset_b,
     int channels,
@@ -168,8 +149,35 @@ rest:
     }
 }
 
+static void multi_channel_dot_product(
+    float **a, int frame_offset_a,
+    float **b, int frame_offset_b,
+    int channels,
+    int num_frames, float *dot_product)
+{
+    dot_product_vector(a, frame_offset_a, b, frame_offset_b, channels,
+                       num_frames, dot_product);
+}
+
+#if HAVE_DOT_PRODUCT_AVX2
+// Without -mavx, v8sf is split into two SSE registers. Compiled for AVX2, each
+// v8sf operation is a single instruction, and multiply-add is fused.
+__attribute__((target("avx2,fma")))
+static void multi_channel_dot_product_avx2(
+    float **a, int frame_offset_a,
+    float **b, int frame_offset_b,
+    int channels,
+    int num_frames, float *dot_product)
+{
+    dot_product_vector(a, frame_offset_a, b, frame_offset_b, channels,
+                       num_frames, dot_product);
+}
+#endif
+
 #else // !HAVE_VECTOR
 
+#define HAVE_DOT_PRODUCT_AVX2 0
+
 static void multi_channel_dot_product(
     float **a, int frame_offset_a,
     float **b, int frame_offset_b,
@@ -191,6 +199,34 @@ static void multi_channel_dot_product(
 
 #endif // HAVE_VECTOR
 
+// Energies of sliding windows of channels are interleaved.
+// The number windows is |input_frames| - (|frames_per_window| - 1), hence,
+// the method assumes |energy| must be, at least, of size
+// (|input_frames| - (|frames_per_window| - 1)) * |channels|.
+static void multi_channel_moving_block_energies(
+    dot_product_fn dot_product,
+    float **input, int input_frames, int channels,
+    int frames_per_block, float *energy)
+{
+    int num_blocks = input_frames - (frames_per_block - 1);
+
+    // First block of each channel.
+    dot_product(input, 0, input, 0, channels, frames_per_block, energy);
+
+    // Each energy depends on the previous one of the same channel. Updating
+    // all channels per step keeps these dependency chains interleaved.
+    for (int n = 1; n < num_blocks; ++n) {
+        float *energy_prev = energy + (n - 1) * channels;
+        float *energy_cur = energy + n * channels;
+        for (int k = 0; k < channels; ++k) {
+            float slide_out = input[k][n - 1];
+            float slide_in = input[k][n - 1 + frames_per_block];
+            energy_cur[k] = energy_prev[k]
+                - slide_out * slide_out + slide_in * slide_in;
+        }
+    }
+}
+
 // Fit the curve f(x) = a * x^2 + b * x + c such that
 //   f(-1) = y[0]
 //   f(0) = y[1]
@@ -218,6 +254,7 @@ static void quadratic_interpolation(
 // 1 / |decimation|. A cubic interpolation is used to have a better estimate of
 // the best match.
 static int decimated_search(
+    dot_product_fn dot_product,
     int decimation, struct interval exclude_interval,
     float **target_block, int target_block_frames,
     float **search_segment, int search_segment_frames,
@@ -229,7 +266,7 @@ static int decimated_search(
     float similarity[3];  // Three elements for cubic interpolation.
 
     int n = 0;
-    multi_channel_dot_product(
+    dot_product(
         target_block, 0,
         search_segment, n,
         channels,
@@ -247,7 +284,7 @@ static int decimated_search(
         return 0;
     }
 
-    multi_channel_dot_product(
+    dot_product(
         target_block, 0,
         search_segment, n,
         channels,
@@ -264,7 +301,7 @@ static int decimated_search(
     }
 
     for (; n < num_candidate_blocks; n += decimation) {
-        multi_channel_dot_product(
+        dot_product(
             target_block, 0,
             search_segment, n,
             channels,
@@ -310,6 +347,7 @@ static int decimated_search(
 // |target_block|. |energy_candidate_blocks| is the energy of all blocks within
 // |search_block|.
 static int full_search(
+    dot_product_fn dot_product,
     int low_limit, int high_limit,
     struct interval exclude_interval,
     float **target_block, int target_block_frames,
@@ -328,7 +366,7 @@ static int full_search(
         if (in_interval(n, exclude_interval)) {
             continue;
         }
-        multi_channel_dot_product(target_block, 0, search_block, n, channels,
+        dot_product(target_block, 0, search_block, n, channels,
             target_block_frames, dot_prod);
 
         float similarity = multi_channel_similarity_measure(
@@ -348,6 +386,7 @@ static int full_search(
 // to |target_block|. Obviously, the returned index is w.r.t. |search_block|.
 // |exclude_interval| is an interval that is excluded from the search.
 static int compute_optimal_index(
+    dot_product_fn dot_product,
     float **search_block, int search_block_frames,
     float **target_block, int target_block_frames,
     float *energy_candidate_blocks,
@@ -370,21 +409,21 @@ static int compute_optimal_index(
 
     // Energy of all candid frames.
     multi_channel_moving_block_energies(
-        search_block,
+        dot_product, search_block,
         search_block_frames,
         channels,
         target_block_frames,
         energy_candidate_blocks);
 
     // Energy of target frame.
-    multi_channel_dot_product(
+    dot_product(
         target_block, 0,
         target_block, 0,
         channels,
         target_block_frames, energy_target_block);
 
     int optimal_index = decimated_search(
-        search_decimation, exclude_interval,
+        dot_product, search_decimation, exclude_interval,
         target_block, target_block_frames,
         search_block, search_block_frames,
         channels,
@@ -395,7 +434,7 @@ static int compute_optimal_index(
     int lim_high = MPMIN(num_candidate_blocks - 1,
                             optimal_index + search_decimation);
     return full_search(
-        lim_low, lim_high, exclude_interval,
+        dot_product, lim_low, lim_high, exclude_interval,
         target_block, target_block_frames,
         search_block, search_block_frames,
         channels,
@@ -575,7 +614,7 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
         // |optimal_index| is in frames and it is relative to the beginning of the
         // |search_block|.
         optimal_index = compute_optimal_index(
-            p->search_block, p->search_block_size,
+            p->dot_product, p->search_block, p->search_block_size,
             p->target_block, p->ola_window_size,
             p->energy_candidate_blocks,
             p->channels,
@@ -789,6 +828,13 @@ void mp_scaletempo2_init(struct mp_scaletempo2 *p, int channels, int rate)
     p->wsola_output_started = false;
     p->channels = channels;
 
+    p->dot_product = multi_channel_dot_product;
+#if HAVE_DOT_PRODUCT_AVX2
+    int flags = AV_CPU_FLAG_AVX2 | AV_CPU_FLAG_FMA3;
+    if ((av_get_cpu_flags() & flags) == flags)
+        p->dot_product = multi_channel_dot_product_avx2;
+#endif
+
     p->samples_per_second = rate;
     p->num_candidate_blocks = (int)(p->opts->wsola_search_interval_ms
         * p->samples_per_second / 1000);
@@ -45,6 +45,11 @@ struct mp_scaletempo2_opts {
     float wsola_search_interval_ms;
 };
 
+typedef void (*dot_product_fn)(float **a, int frame_offset_a,
+                               float **b, int frame_offset_b,
+                               int channels, int num_frames,
+                               float *dot_product);
+
 struct mp_scaletempo2 {
     struct mp_scaletempo2_opts *opts;
     // Number of channels in audio stream.
@@ -119,6 +124,8 @@ struct mp_scaletempo2 {
     // for padding after the final packet.
     int input_buffer_added_silence;
     float *energy_candidate_blocks;
+    // Implementation of the WSOLA search dot product, selected for the CPU.
+    dot_product_fn dot_product;
 };
 
 void mp_scaletempo2_destroy(struct mp_scaletempo2 *p);
@@ -26,11 +26,11 @@
 #include "config.h"
 #include "ao.h"
 #include "internal.h"
+#include "pcm_kernels.h"
 #include "audio/format.h"
 
 #include "options/options.h"
 #include "options/m_config_frontend.h"
-#include "osdep/endian.h"
 #include "common/msg.h"
 #include "common/common.h"
 #include "common/global.h"
@@ -151,6 +151,8 @@ const struct m_sub_options ao_conf = {
             .flags = UPDATE_AUDIO, M_RANGE(0, 10)},
         {"audio-set-media-role", OPT_BOOL(audio_set_media_role),
             .flags = UPDATE_AUDIO},
+        {"audio-device-latency", OPT_KEYVALUELIST(audio_device_latency),
+            .flags = UPDATE_AUDIO},
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
@@ -199,6 +201,34 @@ error:
     return NULL;
 }
 
+// Find the --audio-device-latency entry for the AO. An entry for the device
+// ("driver/device") takes precedence over one for the driver.
+static double get_latency_offset(struct ao *ao)
+{
+    struct ao_opts *opts = mp_get_config_group(NULL, ao->global, &ao_conf);
+    char **list = opts->audio_device_latency;
+    char *dev_name = talloc_asprintf(opts, "%s/%s", ao->driver->name,
+                                     ao->device ? ao->device : "");
+    double res = 0;
+    bool found_dev = false;
+    for (int n = 0; list && list[n * 2]; n++) {
+        char *key = list[n * 2], *val = list[n * 2 + 1];
+        bool is_dev = ao->device && strcmp(key, dev_name) == 0;
+        if (!is_dev && (found_dev || strcmp(key, ao->driver->name) != 0))
+            continue;
+        bstr rest;
+        double v = bstrtod(bstr0(val), &rest);
+        if (rest.len || !isfinite(v)) {
+            MP_WARN(ao, "Invalid latency '%s' for '%s'.\n", val, key);
+            continue;
+        }
+        res = v;
+        found_dev = is_dev;
+    }
+    talloc_free(opts);
+    return res;
+}
+
 static struct ao *ao_init(bool probing, struct mpv_global *global,
                           void (*wakeup_cb)(void *ctx), void *wakeup_ctx,
                           struct encode_lavc_context *encode_lavc_ctx, int flags,
@@ -263,6 +293,10 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
     ao->buffer = (ao->buffer + align - 1) / align * align;
     MP_VERBOSE(ao, "using soft-buffer of %d samples.\n", ao->buffer);
 
+    ao->latency_offset = get_latency_offset(ao);
+    if (ao->latency_offset)
+        MP_VERBOSE(ao, "device latency correction: %f s\n", ao->latency_offset);
+
     if (!init_buffer_post(ao))
         goto fail;
     return ao;
@@ -615,6 +649,11 @@ void ao_set_gain(struct ao *ao, float gain)
     atomic_store(&ao->gain, gain);
 }
 
+void ao_set_clip(struct ao *ao, bool clip)
+{
+    atomic_store(&ao->clip, clip);
+}
+
 #define MUL_GAIN_i(d, num_samples, gain, low, center, high)                     \
     for (int n = 0; n < (num_samples); n++)                                     \
         (d)[n] = MPCLAMP(                                                       \
@@ -628,24 +667,36 @@ void ao_set_gain(struct ao *ao, float gain)
 static void process_plane(struct ao *ao, void *data, int num_samples)
 {
     float gain = atomic_load_explicit(&ao->gain, memory_order_relaxed);
+    bool clip = atomic_load_explicit(&ao->clip, memory_order_relaxed);
+    int format = af_fmt_from_planar(ao->format);
     int gi = lrint(256.0 * gain);
-    if (gi == 256)
+    // Integer formats are always clamped.
+    if (gi == 256 && !(clip && af_fmt_is_float(format)))
         return;
-    switch (af_fmt_from_planar(ao->format)) {
+    switch (format) {
     case AF_FORMAT_U8:
         MUL_GAIN_i((uint8_t *)data, num_samples, gi, 0, 128, 255);
         break;
     case AF_FORMAT_S16:
-        MUL_GAIN_i((int16_t *)data, num_samples, gi, INT16_MIN, 0, INT16_MAX);
+        mp_pcm_gain_s16(data, num_samples, gi);
         break;
     case AF_FORMAT_S32:
         MUL_GAIN_i((int32_t *)data, num_samples, gi, INT32_MIN, 0, INT32_MAX);
         break;
     case AF_FORMAT_FLOAT:
-        MUL_GAIN_f((float *)data, num_samples, gain);
+        if (clip) {
+            mp_pcm_gain_float_clip(data, num_samples, gain);
+        } else {
+            mp_pcm_gain_float(data, num_samples, gain);
+        }
         break;
     case AF_FORMAT_DOUBLE:
         MUL_GAIN_f((double *)data, num_samples, gain);
+        if (clip) {
+            double *d = data;
+            for (int n = 0; n < num_samples; n++)
+                d[n] = MPMIN(MPMAX(d[n], -1.0), 1.0);
+        }
         break;
     default:;
         // all other sample formats are simply not supported
@@ -685,32 +736,17 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
     return get_conv_type(fmt) != 0;
 }
 
-// The LSB is always ignored.
-#if BYTE_ORDER == BIG_ENDIAN
-#define SHIFT24(x) ((3-(x))*8)
-#else
-#define SHIFT24(x) (((x)+1)*8)
-#endif
-
 static void convert_plane(int type, void *data, int num_samples)
 {
     switch (type) {
     case 0:
         break;
-    case 1: /* fall through */
-    case 2: {
-        int bytes = type == 1 ? 3 : 4;
-        for (int s = 0; s < num_samples; s++) {
-            uint32_t val = *((uint32_t *)data + s);
-            uint8_t *ptr = (uint8_t *)data + s * bytes;
-            ptr[0] = val >> SHIFT24(0);
-            ptr[1] = val >> SHIFT24(1);
-            ptr[2] = val >> SHIFT24(2);
-            if (type == 2)
-                ptr[3] = 0;
-        }
+    case 1:
+        mp_pcm_s32_to_s24(data, num_samples);
+        break;
+    case 2:
+        mp_pcm_s32_to_s24_pad(data, num_samples);
         break;
-    }
     default:
         MP_ASSERT_UNREACHABLE();
     }
@@ -80,6 +80,7 @@ struct ao_opts {
     char *audio_client_name;
     double audio_buffer;
     bool audio_set_media_role;
+    char **audio_device_latency;
 };
 
 struct ao *ao_init_best(struct mpv_global *global,
@@ -95,6 +96,7 @@ const char *ao_get_description(struct ao *ao);
 bool ao_untimed(struct ao *ao);
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg);
 void ao_set_gain(struct ao *ao, float gain);
+void ao_set_clip(struct ao *ao, bool clip);
 double ao_get_delay(struct ao *ao);
 void ao_reset(struct ao *ao);
 void ao_start(struct ao *ao);
@@ -247,7 +247,7 @@ static aaudio_data_callback_result_t data_callback(AAudioStream *stream, void *c
     end_time += MP_TIME_S_TO_NS(nframes) / ao->samplerate;
     end_time += MP_TIME_S_TO_NS(written - (presented + p->discarded)) / ao->samplerate;
 
-    ao_read_data(ao, &data, nframes, end_time, NULL, true, true);
+    ao_read_data(ao, &data, nframes, end_time, NULL, true);
 
     return AAUDIO_CALLBACK_RESULT_CONTINUE;
 }
@@ -32,6 +32,7 @@
 #include "options/m_option.h"
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "audio/format.h"
 #include "ao.h"
 #include "internal.h"
@@ -58,8 +59,32 @@ struct priv {
 
     struct m_channels channel_layouts;
     int format;
+
+    // Lowest and highest buffer fill while playing, in samples (reset with
+    // the AO); reported as stats.
+    struct stats_ctx *stats;
+    float fill_min, fill_max;
 };
 
+static void reset_fill(struct priv *priv)
+{
+    priv->fill_min = INFINITY;
+    priv->fill_max = 0;
+}
+
+static void update_fill(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+
+    if (!priv->playing || priv->paused || !priv->stats)
+        return;
+
+    priv->fill_min = MPMIN(priv->fill_min, priv->buffered);
+    priv->fill_max = MPMAX(priv->fill_max, priv->buffered);
+    stats_value(priv->stats, "fill-min", priv->fill_min / ao->samplerate);
+    stats_value(priv->stats, "fill-max", priv->fill_max / ao->samplerate);
+}
+
 static void drain(struct ao *ao)
 {
     struct priv *priv = ao->priv;
@@ -108,6 +133,9 @@ static int init(struct ao *ao)
 
     priv->last_time = mp_time_sec();
 
+    priv->stats = stats_ctx_create(ao, ao->global, "ao-null");
+    reset_fill(priv);
+
     return 0;
 }
 
@@ -123,6 +151,7 @@ static void reset(struct ao *ao)
     priv->paused = false;
     priv->buffered = 0;
     priv->playing = false;
+    reset_fill(priv);
 }
 
 static void start(struct ao *ao)
@@ -164,6 +193,7 @@ static bool audio_write(struct ao *ao, void **data, int samples)
         priv->buffered = priv->latency; // emulate fixed latency
 
     priv->buffered += samples;
+    update_fill(ao);
     return true;
 }
 
@@ -172,6 +202,7 @@ static void get_state(struct ao *ao, struct mp_pcm_state *state)
     struct priv *priv = ao->priv;
 
     drain(ao);
+    update_fill(ao);
 
     state->free_samples = ao->device_buffer - priv->latency - priv->buffered;
     state->free_samples = state->free_samples / priv->outburst * priv->outburst;
@@ -199,7 +199,7 @@ static void on_process(void *userdata)
     end_time += MP_TIME_S_TO_NS(time.buffered) / ao->samplerate;
     end_time -= pw_stream_get_nsec(p->stream) - time.now;
 
-    int samples = ao_read_data(ao, data, nframes, end_time, NULL, false, false);
+    int samples = ao_read_data(ao, data, nframes, end_time, NULL, false);
     b->size = samples;
 
     for (int i = 0; i < buf->n_datas; i++) {
@@ -593,7 +593,12 @@ static int init(struct ao *ao)
     if (pipewire_init_boilerplate(ao) < 0)
         goto error_props;
 
-    if (p->options.buffer_msec) {
+    if (p->options.buffer_msec < 0) {
+        // Half of --audio-buffer, so that the next quantum is always ready.
+        ao->device_buffer = MPMAX(ao->def_buffer * ao->samplerate / 2, 1);
+
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%d/%d", ao->device_buffer, ao->samplerate);
+    } else if (p->options.buffer_msec) {
         ao->device_buffer = p->options.buffer_msec * ao->samplerate / 1000;
 
         pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%d/%d", ao->device_buffer, ao->samplerate);
@@ -920,7 +925,7 @@ const struct ao_driver audio_out_pipewire = {
     },
     .options_prefix = "pipewire",
     .options = (const struct m_option[]) {
-        {"buffer", OPT_CHOICE(options.buffer_msec, {"native", 0}),
+        {"buffer", OPT_CHOICE(options.buffer_msec, {"native", 0}, {"auto", -1}),
             M_RANGE(1, 2000)},
         {"remote", OPT_STRING(options.remote) },
         {"volume-mode", OPT_CHOICE(options.volume_mode,
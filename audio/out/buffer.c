@@ -20,6 +20,7 @@
 #include <math.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "ao.h"
 #include "internal.h"
@@ -28,6 +29,7 @@
 
 #include "common/msg.h"
 #include "common/common.h"
+#include "common/stats.h"
 
 #include "filters/f_async_queue.h"
 #include "filters/filter_internal.h"
@@ -35,6 +37,23 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 
+// Wait-free single-producer/single-consumer PCM ring for pull AOs. The
+// producer is whoever holds buffer_state.lock (normally the "ao" thread);
+// the consumer is the AO's audio callback in ao_read_data(), which never
+// takes a lock, so the player can't make it miss its deadline. Positions are
+// counted in samples since init, and only grow.
+struct pcm_ring {
+    uint8_t *data[MP_NUM_CHANNELS];
+    int size;                           // capacity in samples
+    atomic_uint_least64_t rpos;         // written by the consumer only
+    atomic_uint_least64_t wpos;         // all others by the producer only
+    atomic_uint_least64_t flush_pos;    // data before this was discarded
+    atomic_uint reading;                // odd while the consumer is reading
+    atomic_uint_least64_t eof_pos;      // EOF at this position, or UINT64_MAX
+    atomic_bool active;                 // playing && !paused
+    atomic_bool underrun;               // consumer ran out of data
+};
+
 struct buffer_state {
     // Buffer and AO
     mp_mutex lock;
@@ -61,20 +80,27 @@ struct buffer_state {
     bool paused;                // logically paused
     bool hw_paused;             // driver->set_pause() was used successfully
 
-    int64_t end_time_ns;        // absolute output time of last played sample
+    // absolute output time of last played sample (written by the audio
+    // callback of pull AOs, without lock)
+    atomic_int_least64_t end_time_ns;
     int64_t queued_time_ns;     // duration of samples that have been queued to
                                 // the device but have not been played.
                                 // This field is only set in ao_set_paused(),
                                 // and is considered as a temporary solution;
                                 // DO NOT USE IT IN OTHER PLACES.
 
+    mp_thread thread;           // thread shoveling data to AO (or ring)
+    bool thread_valid;          // thread is running
+    struct stats_ctx *stats;    // for the thread
+
     // "Push" AOs only (AOs with driver->write).
     bool recover_pause;         // non-hw_paused: needs to recover delay
     struct mp_pcm_state prepause_state;
-    mp_thread thread;           // thread shoveling data to AO
-    bool thread_valid;          // thread is running
     struct mp_aframe *temp_buf;
 
+    // "Pull" AOs only.
+    struct pcm_ring ring;
+
     // --- protected by pt_lock
     bool need_wakeup;
     bool terminate;             // exit thread
@@ -175,25 +201,111 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof,
     return pos;
 }
 
-static int ao_read_data_locked(struct ao *ao, void **data, int samples,
-                               int64_t out_time_ns, bool *eof, bool pad_silence)
+// called locked
+static void update_active(struct buffer_state *p)
 {
-    struct buffer_state *p = ao->buffer_state;
-    mp_assert(!ao->driver->write);
+    atomic_store(&p->ring.active, p->playing && !p->paused);
+}
 
-    int pos = read_buffer(ao, data, samples, eof, pad_silence);
+// Oldest position in the ring which still holds valid data.
+static uint64_t ring_read_pos(struct pcm_ring *r)
+{
+    uint64_t rpos = atomic_load(&r->rpos);
+    uint64_t flush = atomic_load(&r->flush_pos);
+    return MPMAX(rpos, flush);
+}
 
-    if (pos > 0)
-        p->end_time_ns = out_time_ns;
+// Oldest position the producer must not overwrite. After a flush, a consumer
+// that was already reading may still copy the discarded data, so its slots can
+// be reused only once it has published a position after the flush, or if it
+// is not reading (then its next read sees the flush). This depends on all
+// accesses to rpos, flush_pos and reading being sequentially consistent.
+static uint64_t ring_write_limit(struct pcm_ring *r)
+{
+    uint64_t rpos = atomic_load(&r->rpos);
+    uint64_t flush = atomic_load(&r->flush_pos);
+    if (rpos < flush && (atomic_load(&r->reading) & 1))
+        return rpos;
+    return MPMAX(rpos, flush);
+}
+
+// Number of samples from rpos to the write position.
+static int ring_avail(struct pcm_ring *r, uint64_t rpos)
+{
+    uint64_t wpos = atomic_load_explicit(&r->wpos, memory_order_acquire);
+    return wpos > rpos ? MPMIN(wpos - rpos, r->size) : 0;
+}
+
+// Return pointers to the ring memory at pos in planes, and the number of
+// samples until the ring wraps around.
+static int ring_segment(struct ao *ao, uint64_t pos, void **planes)
+{
+    struct pcm_ring *r = &ao->buffer_state->ring;
+    int offset = pos % r->size;
+    for (int n = 0; n < ao->num_planes; n++)
+        planes[n] = r->data[n] + offset * ao->sstride;
+    return r->size - offset;
+}
 
-    if (pos < samples && p->playing && !p->paused) {
+// Discard all data in the ring. The consumer skips it on its next read, and
+// the producer overwrites it once the consumer is done with it (see
+// ring_write_limit()). called locked
+static void ring_flush(struct buffer_state *p)
+{
+    struct pcm_ring *r = &p->ring;
+    if (!r->size)
+        return;
+    atomic_store(&r->eof_pos, UINT64_MAX);
+    atomic_store(&r->flush_pos, atomic_load(&r->wpos));
+    atomic_store(&r->underrun, false);
+}
+
+// Move as much data as possible from the queue to the ring, and process
+// underruns reported by the consumer. called locked
+static void ring_fill(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+    struct pcm_ring *r = &p->ring;
+
+    uint64_t wpos = atomic_load(&r->wpos);
+    int space = r->size - ring_avail(r, ring_write_limit(r));
+    while (space > 0) {
+        void *planes[MP_NUM_CHANNELS];
+        int samples = MPMIN(ring_segment(ao, wpos, planes), space);
+        bool eof;
+        int got = read_buffer(ao, planes, samples, &eof, false);
+        wpos += got;
+        space -= got;
+        if (eof)
+            atomic_store(&r->eof_pos, wpos);
+        atomic_store_explicit(&r->wpos, wpos, memory_order_release);
+        if (got < samples)
+            break;
+    }
+
+    // Only stop if the queue is still empty; the data might have arrived in
+    // the meantime.
+    if (atomic_exchange(&r->underrun, false) && p->playing && !p->paused &&
+        !ring_avail(r, ring_read_pos(r)))
+    {
         p->playing = false;
+        update_active(p);
         ao->wakeup_cb(ao->wakeup_ctx);
         // For ao_drain().
         mp_cond_broadcast(&p->wakeup);
     }
+}
 
-    return pos;
+// Wake up the ao thread from the audio callback.
+static void ring_wakeup_producer(struct buffer_state *p)
+{
+    // Never block. If the lock is taken, the thread is awake anyway, or wakes
+    // up on its timeout, which is short enough to refill the ring in time.
+    if (mp_mutex_trylock(&p->pt_lock))
+        return;
+    p->need_wakeup = true;
+    mp_cond_broadcast(&p->pt_wakeup);
+    mp_mutex_unlock(&p->pt_lock);
 }
 
 // Read the given amount of samples in the user-provided data buffer. Returns
@@ -204,25 +316,62 @@ static int ao_read_data_locked(struct ao *ao, void **data, int samples,
 // If this is called in paused mode, it will always return 0.
 // The caller should set out_time_ns to the expected delay until the last sample
 // reaches the speakers, in nanoseconds, using mp_time_ns() as reference.
-int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_ns, bool *eof, bool pad_silence, bool blocking)
+// This never blocks, and is safe to call from realtime threads.
+int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_ns,
+                 bool *eof, bool pad_silence)
 {
     struct buffer_state *p = ao->buffer_state;
-
-    if (blocking) {
-        mp_mutex_lock(&p->lock);
-    } else if (mp_mutex_trylock(&p->lock)) {
-        return 0;
-    }
+    struct pcm_ring *r = &p->ring;
+    mp_assert(!ao->driver->write);
 
     bool eof_buf;
     if (eof == NULL) {
         // This is a public API. We want to reduce the cognitive burden of the caller.
         eof = &eof_buf;
     }
+    *eof = false;
+
+    // Tell ring_write_limit() that we might use positions before a flush.
+    atomic_fetch_add(&r->reading, 1);
+    uint64_t rpos = ring_read_pos(r);
+    int pos = 0;
+    if (atomic_load(&r->active)) {
+        while (pos < samples) {
+            void *planes[MP_NUM_CHANNELS];
+            int copy = MPMIN(ring_segment(ao, rpos, planes),
+                             ring_avail(r, rpos));
+            copy = MPMIN(copy, samples - pos);
+            if (!copy)
+                break;
+            for (int n = 0; n < ao->num_planes; n++) {
+                memcpy((char *)data[n] + pos * ao->sstride, planes[n],
+                       copy * ao->sstride);
+            }
+            rpos += copy;
+            pos += copy;
+        }
+        *eof = !ring_avail(r, rpos) && rpos == atomic_load(&r->eof_pos);
+    }
+    atomic_store(&r->rpos, rpos);
+    atomic_fetch_add(&r->reading, 1);
 
-    int pos = ao_read_data_locked(ao, data, samples, out_time_ns, eof, pad_silence);
+    if (pos > 0)
+        atomic_store(&p->end_time_ns, out_time_ns);
 
-    mp_mutex_unlock(&p->lock);
+    if (atomic_load(&r->active)) {
+        if (pos < samples)
+            atomic_store(&r->underrun, true);
+        if (pos < samples || ring_avail(r, rpos) < r->size / 2)
+            ring_wakeup_producer(p);
+    }
+
+    // pad with silence (underflow/paused/eof)
+    if (pad_silence) {
+        for (int n = 0; n < ao->num_planes; n++) {
+            af_fill_silence((char *)data[n] + pos * ao->sstride,
+                            (samples - pos) * ao->sstride, ao->format);
+        }
+    }
 
     return pos;
 }
@@ -236,7 +385,7 @@ int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
     void *ndata[MP_NUM_CHANNELS] = {0};
 
     if (!ao_need_conversion(fmt))
-        return ao_read_data(ao, data, samples, out_time_ns, NULL, true, true);
+        return ao_read_data(ao, data, samples, out_time_ns, NULL, true);
 
     mp_assert(ao->format == fmt->src_fmt);
     mp_assert(ao->channels.num == fmt->channels);
@@ -256,7 +405,7 @@ int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
     for (int n = 0; n < planes; n++)
         ndata[n] = p->convert_buffer + n * src_plane_size;
 
-    int res = ao_read_data(ao, ndata, samples, out_time_ns, NULL, true, true);
+    int res = ao_read_data(ao, ndata, samples, out_time_ns, NULL, true);
 
     ao_convert_inplace(fmt, ndata, samples);
     for (int n = 0; n < planes; n++)
@@ -304,7 +453,7 @@ double ao_get_delay(struct ao *ao)
         get_dev_state(ao, &state);
         driver_delay = state.delay;
     } else {
-        int64_t end = p->end_time_ns;
+        int64_t end = atomic_load(&p->end_time_ns);
         int64_t now = mp_time_ns();
         driver_delay = MPMAX(0, MP_TIME_NS_TO_S(end - now));
     }
@@ -312,8 +461,11 @@ double ao_get_delay(struct ao *ao)
     int64_t pending = mp_async_queue_get_samples(p->queue);
     if (p->pending)
         pending += mp_aframe_get_size(p->pending);
+    if (p->ring.size)
+        pending += ring_avail(&p->ring, ring_read_pos(&p->ring));
 
     mp_mutex_unlock(&p->lock);
+    driver_delay = MPMAX(0, driver_delay + ao->latency_offset);
     return driver_delay + pending / (double)ao->samplerate;
 }
 
@@ -330,6 +482,7 @@ void ao_reset(struct ao *ao)
     mp_async_queue_reset(p->queue);
     mp_filter_reset(p->filter_root);
     mp_async_queue_resume_reading(p->queue);
+    ring_flush(p);
 
     if (!ao->stream_silence && ao->driver->reset) {
         if (ao->driver->write) {
@@ -345,7 +498,8 @@ void ao_reset(struct ao *ao)
     p->playing = false;
     p->recover_pause = false;
     p->hw_paused = false;
-    p->end_time_ns = 0;
+    atomic_store(&p->end_time_ns, 0);
+    update_active(p);
 
     mp_mutex_unlock(&p->lock);
 
@@ -368,10 +522,15 @@ void ao_start(struct ao *ao)
     mp_mutex_lock(&p->lock);
 
     p->playing = true;
+    update_active(p);
 
-    if (!ao->driver->write && !p->paused && !p->streaming) {
-        p->streaming = true;
-        do_start = true;
+    if (!ao->driver->write) {
+        // Make sure the first callback gets data.
+        ring_fill(ao);
+        if (!p->paused && !p->streaming) {
+            p->streaming = true;
+            do_start = true;
+        }
     }
 
     mp_mutex_unlock(&p->lock);
@@ -432,6 +591,7 @@ void ao_set_paused(struct ao *ao, bool paused, bool eof)
         wakeup = true;
     }
     p->paused = paused;
+    update_active(p);
 
     mp_mutex_unlock(&p->lock);
 
@@ -439,9 +599,9 @@ void ao_set_paused(struct ao *ao, bool paused, bool eof)
         if (is_hw_paused) {
             if (paused) {
                 ao->driver->set_pause(ao, true);
-                p->queued_time_ns = p->end_time_ns - mp_time_ns();
+                p->queued_time_ns = atomic_load(&p->end_time_ns) - mp_time_ns();
             } else {
-                p->end_time_ns = p->queued_time_ns + mp_time_ns();
+                atomic_store(&p->end_time_ns, p->queued_time_ns + mp_time_ns());
                 ao->driver->set_pause(ao, false);
             }
         } else {
@@ -576,19 +736,30 @@ bool init_buffer_post(struct ao *ao)
     };
     mp_async_queue_set_config(p->queue, cfg);
 
-    if (ao->driver->write) {
-        mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+    if (!ao->driver->write) {
+        // Big enough for a few device callbacks, and for the thread to refill
+        // it, even if device_buffer is unknown or tiny.
+        struct pcm_ring *r = &p->ring;
+        r->size = MPMAX(ao->device_buffer * 2, ao->samplerate / 20);
+        r->size = MPMAX(r->size, 1);
+        for (int n = 0; n < ao->num_planes; n++)
+            r->data[n] = talloc_size(p, r->size * ao->sstride);
+        atomic_init(&r->eof_pos, UINT64_MAX);
+    }
 
-        p->thread_valid = true;
-        if (mp_thread_create(&p->thread, ao_thread, ao)) {
-            p->thread_valid = false;
-            return false;
-        }
-    } else {
-        if (ao->stream_silence) {
-            ao->driver->start(ao);
-            p->streaming = true;
-        }
+    mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+
+    p->stats = stats_ctx_create(p, ao->global, "ao");
+
+    p->thread_valid = true;
+    if (mp_thread_create(&p->thread, ao_thread, ao)) {
+        p->thread_valid = false;
+        return false;
+    }
+
+    if (!ao->driver->write && ao->stream_silence) {
+        ao->driver->start(ao);
+        p->streaming = true;
     }
 
     if (ao->stream_silence) {
@@ -708,19 +879,31 @@ static MP_THREAD_VOID ao_thread(void *arg)
     struct ao *ao = arg;
     struct buffer_state *p = ao->buffer_state;
     mp_thread_set_name("ao");
+    stats_register_thread_cputime(p->stats, "thread");
     while (1) {
+        stats_event(p->stats, "wakeup");
         mp_mutex_lock(&p->lock);
 
-        bool retry = ao_play_data(ao);
-
-        // Wait until the device wants us to write more data to it.
-        // Fallback to guessing.
+        bool retry = false;
         int64_t timeout = INT64_MAX;
-        if (p->streaming && !retry && (!p->paused || ao->stream_silence)) {
-            // Wake up again if half of the audio buffer has been played.
-            // Since audio could play at a faster or slower pace, wake up twice
-            // as often as ideally needed.
-            timeout = MP_TIME_S_TO_NS(ao->device_buffer / (double)ao->samplerate * 0.25);
+        if (ao->driver->write) {
+            retry = ao_play_data(ao);
+
+            // Wait until the device wants us to write more data to it.
+            // Fallback to guessing.
+            if (p->streaming && !retry && (!p->paused || ao->stream_silence)) {
+                // Wake up again if half of the audio buffer has been played.
+                // Since audio could play at a faster or slower pace, wake up
+                // twice as often as ideally needed.
+                timeout = MP_TIME_S_TO_NS(ao->device_buffer / (double)ao->samplerate * 0.25);
+            }
+        } else {
+            ring_fill(ao);
+
+            // The audio callback wakes us up when the ring is half empty, but
+            // it can't always do so (see ring_wakeup_producer()).
+            if (p->playing && !p->paused)
+                timeout = MP_TIME_S_TO_NS(p->ring.size / (double)ao->samplerate * 0.25);
         }
 
         mp_mutex_unlock(&p->lock);
@@ -738,5 +921,6 @@ static MP_THREAD_VOID ao_thread(void *arg)
         p->need_wakeup = false;
         mp_mutex_unlock(&p->pt_lock);
     }
+    stats_unregister_thread(p->stats, "thread");
     MP_THREAD_RETURN();
 }
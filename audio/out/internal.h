@@ -66,9 +66,14 @@ struct ao {
 
     // Float gain multiplicator
     _Atomic float gain;
+    // Clamp float samples to [-1, 1] when applying the gain
+    atomic_bool clip;
 
     int buffer;
     double def_buffer;
+    // Correction added to the delay reported by the device, in seconds
+    // (--audio-device-latency).
+    double latency_offset;
     struct buffer_state *buffer_state;
 };
 
@@ -200,7 +205,8 @@ struct ao_driver {
 
 // These functions can be called by AOs.
 
-int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_ns, bool *eof, bool pad_silence, bool blocking);
+int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_ns,
+                 bool *eof, bool pad_silence);
 
 bool ao_chmap_sel_adjust(struct ao *ao, const struct mp_chmap_sel *s,
                          struct mp_chmap *map);
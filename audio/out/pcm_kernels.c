@@ -0,0 +1,337 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "osdep/endian.h"
+#include "pcm_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && BYTE_ORDER == LITTLE_ENDIAN
+#define HAVE_NEON_SIMD 1
+#include <arm_neon.h>
+#else
+#define HAVE_NEON_SIMD 0
+#endif
+
+// The SIMD functions process a prefix of the data, and return the number of
+// samples they handled. The rest is done by the C code.
+
+#if HAVE_X86_SIMD
+__attribute__((target("avx")))
+static int gain_float_avx(float *data, int num, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int n = 0;
+    for (; n + 8 <= num; n += 8)
+        _mm256_storeu_ps(data + n, _mm256_mul_ps(_mm256_loadu_ps(data + n), g));
+    return n;
+}
+
+__attribute__((target("sse")))
+static int gain_float_sse(float *data, int num, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int n = 0;
+    for (; n + 4 <= num; n += 4)
+        _mm_storeu_ps(data + n, _mm_mul_ps(_mm_loadu_ps(data + n), g));
+    return n;
+}
+
+// max and min return the second operand if one is NaN, like MPMAX/MPMIN.
+__attribute__((target("avx")))
+static int gain_float_clip_avx(float *data, int num, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+    int n = 0;
+    for (; n + 8 <= num; n += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(data + n), g);
+        _mm256_storeu_ps(data + n, _mm256_min_ps(_mm256_max_ps(x, lo), hi));
+    }
+    return n;
+}
+
+__attribute__((target("sse")))
+static int gain_float_clip_sse(float *data, int num, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    int n = 0;
+    for (; n + 4 <= num; n += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(data + n), g);
+        _mm_storeu_ps(data + n, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+    return n;
+}
+
+// The 16x16->32 bit products are exact as long as gi fits into int16_t, and the
+// saturating pack does the clamping.
+__attribute__((target("avx2")))
+static int gain_s16_avx2(int16_t *data, int num, int gi)
+{
+    __m256i g = _mm256_set1_epi16(gi);
+    __m256i round = _mm256_set1_epi32(128);
+    int n = 0;
+    for (; n + 16 <= num; n += 16) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(data + n));
+        __m256i lo = _mm256_mullo_epi16(x, g);
+        __m256i hi = _mm256_mulhi_epi16(x, g);
+        // unpack and pack both work within 128 bit lanes, so the order of
+        // the samples is restored.
+        __m256i a = _mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round);
+        __m256i b = _mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round);
+        a = _mm256_srai_epi32(a, 8);
+        b = _mm256_srai_epi32(b, 8);
+        _mm256_storeu_si256((__m256i *)(data + n), _mm256_packs_epi32(a, b));
+    }
+    return n;
+}
+
+__attribute__((target("sse2")))
+static int gain_s16_sse2(int16_t *data, int num, int gi)
+{
+    __m128i g = _mm_set1_epi16(gi);
+    __m128i round = _mm_set1_epi32(128);
+    int n = 0;
+    for (; n + 8 <= num; n += 8) {
+        __m128i x = _mm_loadu_si128((__m128i *)(data + n));
+        __m128i lo = _mm_mullo_epi16(x, g);
+        __m128i hi = _mm_mulhi_epi16(x, g);
+        __m128i a = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round);
+        __m128i b = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round);
+        a = _mm_srai_epi32(a, 8);
+        b = _mm_srai_epi32(b, 8);
+        _mm_storeu_si128((__m128i *)(data + n), _mm_packs_epi32(a, b));
+    }
+    return n;
+}
+
+__attribute__((target("ssse3")))
+static int s32_to_s24_ssse3(uint8_t *data, int num)
+{
+    __m128i shuf = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15,
+                                 -1, -1, -1, -1);
+    int s = 0;
+    // Each store writes 4 zero bytes after the 12 output bytes, over the
+    // output of the next sample. Stop early so that the C code rewrites them.
+    // The stores never reach input which hasn't been read yet.
+    for (; s + 4 < num; s += 4) {
+        __m128i x = _mm_loadu_si128((__m128i *)(data + s * 4));
+        _mm_storeu_si128((__m128i *)(data + s * 3), _mm_shuffle_epi8(x, shuf));
+    }
+    return s;
+}
+
+__attribute__((target("avx2")))
+static int s32_to_s24_pad_avx2(uint32_t *data, int num)
+{
+    int s = 0;
+    for (; s + 8 <= num; s += 8) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(data + s));
+        _mm256_storeu_si256((__m256i *)(data + s), _mm256_srli_epi32(x, 8));
+    }
+    return s;
+}
+
+__attribute__((target("sse2")))
+static int s32_to_s24_pad_sse2(uint32_t *data, int num)
+{
+    int s = 0;
+    for (; s + 4 <= num; s += 4) {
+        __m128i x = _mm_loadu_si128((__m128i *)(data + s));
+        _mm_storeu_si128((__m128i *)(data + s), _mm_srli_epi32(x, 8));
+    }
+    return s;
+}
+#endif
+
+#if HAVE_NEON_SIMD
+static int gain_float_neon(float *data, int num, float gain)
+{
+    int n = 0;
+    for (; n + 4 <= num; n += 4)
+        vst1q_f32(data + n, vmulq_n_f32(vld1q_f32(data + n), gain));
+    return n;
+}
+
+// The "nm" variants return the number if one operand is NaN.
+static int gain_float_clip_neon(float *data, int num, float gain)
+{
+    float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+    int n = 0;
+    for (; n + 4 <= num; n += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(data + n), gain);
+        vst1q_f32(data + n, vminnmq_f32(vmaxnmq_f32(x, lo), hi));
+    }
+    return n;
+}
+
+static int gain_s16_neon(int16_t *data, int num, int gi)
+{
+    int16x4_t g = vdup_n_s16(gi);
+    int n = 0;
+    for (; n + 8 <= num; n += 8) {
+        int16x8_t x = vld1q_s16(data + n);
+        // vqrshrn rounds by adding 1 << (shift - 1) before shifting, like the
+        // C code.
+        int32x4_t a = vmull_s16(vget_low_s16(x), g);
+        int32x4_t b = vmull_s16(vget_high_s16(x), g);
+        vst1q_s16(data + n, vcombine_s16(vqrshrn_n_s32(a, 8),
+                                         vqrshrn_n_s32(b, 8)));
+    }
+    return n;
+}
+
+static int s32_to_s24_neon(uint8_t *data, int num)
+{
+    int s = 0;
+    for (; s + 16 <= num; s += 16) {
+        uint8x16x4_t x = vld4q_u8(data + s * 4);
+        uint8x16x3_t y = {{x.val[1], x.val[2], x.val[3]}};
+        vst3q_u8(data + s * 3, y);
+    }
+    return s;
+}
+
+static int s32_to_s24_pad_neon(uint32_t *data, int num)
+{
+    int s = 0;
+    for (; s + 4 <= num; s += 4)
+        vst1q_u32(data + s, vshrq_n_u32(vld1q_u32(data + s), 8));
+    return s;
+}
+#endif
+
+void mp_pcm_gain_float(float *data, int num, float gain)
+{
+    int n = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX) {
+        n = gain_float_avx(data, num, gain);
+    } else if (flags & AV_CPU_FLAG_SSE) {
+        n = gain_float_sse(data, num, gain);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        n = gain_float_neon(data, num, gain);
+#endif
+    for (; n < num; n++)
+        data[n] = data[n] * gain;
+}
+
+void mp_pcm_gain_float_clip(float *data, int num, float gain)
+{
+    int n = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX) {
+        n = gain_float_clip_avx(data, num, gain);
+    } else if (flags & AV_CPU_FLAG_SSE) {
+        n = gain_float_clip_sse(data, num, gain);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        n = gain_float_clip_neon(data, num, gain);
+#endif
+    for (; n < num; n++) {
+        float v = data[n] * gain;
+        v = MPMAX(v, -1.0f);
+        data[n] = MPMIN(v, 1.0f);
+    }
+}
+
+void mp_pcm_gain_s16(int16_t *data, int num, int gi)
+{
+    int n = 0;
+    if (gi >= 0 && gi <= INT16_MAX) {
+#if HAVE_X86_SIMD
+        int flags = av_get_cpu_flags();
+        if (flags & AV_CPU_FLAG_AVX2) {
+            n = gain_s16_avx2(data, num, gi);
+        } else if (flags & AV_CPU_FLAG_SSE2) {
+            n = gain_s16_sse2(data, num, gi);
+        }
+#elif HAVE_NEON_SIMD
+        if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+            n = gain_s16_neon(data, num, gi);
+#endif
+    }
+    for (; n < num; n++)
+        data[n] = MPCLAMP((data[n] * (int64_t)gi + 128) >> 8, INT16_MIN, INT16_MAX);
+}
+
+// The LSB is always ignored.
+#if BYTE_ORDER == BIG_ENDIAN
+#define SHIFT24(x) ((3-(x))*8)
+#else
+#define SHIFT24(x) (((x)+1)*8)
+#endif
+
+void mp_pcm_s32_to_s24(void *data, int num)
+{
+    uint8_t *bytes = data;
+    int s = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3)
+        s = s32_to_s24_ssse3(bytes, num);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        s = s32_to_s24_neon(bytes, num);
+#endif
+    for (; s < num; s++) {
+        uint32_t val = *((uint32_t *)data + s);
+        uint8_t *ptr = bytes + s * 3;
+        ptr[0] = val >> SHIFT24(0);
+        ptr[1] = val >> SHIFT24(1);
+        ptr[2] = val >> SHIFT24(2);
+    }
+}
+
+void mp_pcm_s32_to_s24_pad(void *data, int num)
+{
+    int s = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        s = s32_to_s24_pad_avx2(data, num);
+    } else if (flags & AV_CPU_FLAG_SSE2) {
+        s = s32_to_s24_pad_sse2(data, num);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        s = s32_to_s24_pad_neon(data, num);
+#endif
+    for (; s < num; s++) {
+        uint32_t val = *((uint32_t *)data + s);
+        uint8_t *ptr = (uint8_t *)data + s * 4;
+        ptr[0] = val >> SHIFT24(0);
+        ptr[1] = val >> SHIFT24(1);
+        ptr[2] = val >> SHIFT24(2);
+        ptr[3] = 0;
+    }
+}
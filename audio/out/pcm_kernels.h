@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+// Inner loops of ao_post_process_data() and ao_convert_inplace(). These use
+// SIMD where the CPU supports it (checked with av_get_cpu_flags() on every
+// call, so av_force_cpu_flags() can be used to select the C versions), and
+// produce bit-identical results on all code paths.
+
+// data[n] = data[n] * gain
+void mp_pcm_gain_float(float *data, int num, float gain);
+
+// Like mp_pcm_gain_float(), but clamp the result to [-1, 1]. NaN becomes -1.
+void mp_pcm_gain_float_clip(float *data, int num, float gain);
+
+// Apply the 8.8 fixed point gain gi to S16 samples, rounding to nearest and
+// clamping, i.e. data[n] = clamp((data[n] * gi + 128) >> 8).
+void mp_pcm_gain_s16(int16_t *data, int num, int gi);
+
+// Convert S32 samples to packed 24 bit samples (the LSB is dropped). The
+// output occupies the first num * 3 bytes of data.
+void mp_pcm_s32_to_s24(void *data, int num);
+
+// Like mp_pcm_s32_to_s24(), but the 24 bit samples are padded with a zero MSB
+// to 32 bit, so the output has the same size as the input.
+void mp_pcm_s32_to_s24_pad(void *data, int num);
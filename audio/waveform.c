@@ -0,0 +1,310 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "aframe.h"
+#include "chmap.h"
+#include "format.h"
+#include "waveform.h"
+
+// Keeps memory usage bounded with tiny intervals and very long files.
+#define MAX_BINS (1 << 22)
+
+struct biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct mp_waveform_priv {
+    // Current input format.
+    int format, rate, channels;
+    struct mp_chmap chmap;
+    double weight[MP_NUM_CHANNELS];     // BS.1770 channel weights
+    struct biquad shelf, highpass;      // K-weighting filter
+    double state[MP_NUM_CHANNELS][4];
+
+    double next_pts;                    // end of the last frame
+
+    // Bin being accumulated, or -1.
+    int bin;
+    bool bin_valid;                     // false: started in the middle
+    int bin_samples;
+    float bin_peak;
+    double bin_sq;
+    double bin_k[MP_NUM_CHANNELS];
+
+    float *tmp;
+};
+
+struct mp_waveform *mp_waveform_create(void *ta_parent, double interval)
+{
+    struct mp_waveform *w = talloc_zero(ta_parent, struct mp_waveform);
+    w->interval = interval;
+    w->priv = talloc_zero(w, struct mp_waveform_priv);
+    w->priv->next_pts = MP_NOPTS_VALUE;
+    w->priv->bin = -1;
+    return w;
+}
+
+// Filter coefficients for any sample rate, as derived in libebur128.
+static void init_k_weighting(struct mp_waveform_priv *p)
+{
+    double f0 = 1681.974450955533;
+    double g = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / p->rate);
+    double vh = pow(10.0, g / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    p->shelf = (struct biquad){
+        .b0 = (vh + vb * k / q + k * k) / a0,
+        .b1 = 2.0 * (k * k - vh) / a0,
+        .b2 = (vh - vb * k / q + k * k) / a0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / p->rate);
+    a0 = 1.0 + k / q + k * k;
+    p->highpass = (struct biquad){
+        .b0 = 1.0,
+        .b1 = -2.0,
+        .b2 = 1.0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+
+    for (int c = 0; c < p->channels; c++) {
+        int sp = p->chmap.speaker[c];
+        if (sp == MP_SPEAKER_ID_LFE || sp == MP_SPEAKER_ID_LFE2) {
+            p->weight[c] = 0;
+        } else if (sp == MP_SPEAKER_ID_SL || sp == MP_SPEAKER_ID_SR ||
+                   sp == MP_SPEAKER_ID_BL || sp == MP_SPEAKER_ID_BR) {
+            p->weight[c] = 1.41;
+        } else {
+            p->weight[c] = 1.0;
+        }
+    }
+}
+
+static inline double biquad(const struct biquad *f, double *s, double x)
+{
+    // Transposed direct form II.
+    double y = f->b0 * x + s[0];
+    s[0] = f->b1 * x - f->a1 * y + s[1];
+    s[1] = f->b2 * x - f->a2 * y;
+    return y;
+}
+
+void mp_waveform_reset(struct mp_waveform *w)
+{
+    struct mp_waveform_priv *p = w->priv;
+    p->next_pts = MP_NOPTS_VALUE;
+    p->bin = -1;
+    memset(p->state, 0, sizeof(p->state));
+}
+
+static void ensure_bins(struct mp_waveform *w, int num)
+{
+    if (num <= w->num_bins)
+        return;
+    w->peak = talloc_realloc(w, w->peak, float, num);
+    w->rms = talloc_realloc(w, w->rms, float, num);
+    w->loudness = talloc_realloc(w, w->loudness, float, num);
+    for (int n = w->num_bins; n < num; n++)
+        w->peak[n] = w->rms[n] = w->loudness[n] = NAN;
+    w->num_bins = num;
+}
+
+// Returns true if a new bin was filled.
+static bool finish_bin(struct mp_waveform *w)
+{
+    struct mp_waveform_priv *p = w->priv;
+    int bin = p->bin;
+    p->bin = -1;
+    if (bin < 0 || !p->bin_valid || !p->bin_samples)
+        return false;
+
+    ensure_bins(w, bin + 1);
+    if (!isnan(w->peak[bin]))
+        return false;
+
+    double k = 0;
+    for (int c = 0; c < p->channels; c++)
+        k += p->weight[c] * p->bin_k[c];
+    k /= p->bin_samples;
+    float loudness = k > 0 ? -0.691 + 10 * log10(k) : MP_WAVEFORM_MIN_LOUDNESS;
+
+    w->peak[bin] = p->bin_peak;
+    w->rms[bin] = sqrt(p->bin_sq / ((double)p->bin_samples * p->channels));
+    w->loudness[bin] = MPMAX(loudness, MP_WAVEFORM_MIN_LOUDNESS);
+    w->num_filled += 1;
+    return true;
+}
+
+bool mp_waveform_finish(struct mp_waveform *w)
+{
+    bool filled = finish_bin(w);
+    mp_waveform_reset(w);
+    return filled;
+}
+
+static void start_bin(struct mp_waveform_priv *p, int bin, bool valid)
+{
+    p->bin = bin;
+    p->bin_valid = valid;
+    p->bin_samples = 0;
+    p->bin_peak = 0;
+    p->bin_sq = 0;
+    for (int c = 0; c < p->channels; c++)
+        p->bin_k[c] = 0;
+}
+
+// Read num samples of format fmt (non-planar), each stride samples apart.
+static void read_samples(float *dst, uint8_t *src, int fmt, int stride, int num)
+{
+    switch (fmt) {
+    case AF_FORMAT_U8:
+        for (int n = 0; n < num; n++)
+            dst[n] = (src[n * stride] - 128) / 128.0f;
+        break;
+    case AF_FORMAT_S16:
+        for (int n = 0; n < num; n++)
+            dst[n] = ((int16_t *)src)[n * stride] / 32768.0f;
+        break;
+    case AF_FORMAT_S32:
+        for (int n = 0; n < num; n++)
+            dst[n] = ((int32_t *)src)[n * stride] / 2147483648.0f;
+        break;
+    case AF_FORMAT_S64:
+        for (int n = 0; n < num; n++)
+            dst[n] = ((int64_t *)src)[n * stride] / 9223372036854775808.0f;
+        break;
+    case AF_FORMAT_FLOAT:
+        for (int n = 0; n < num; n++)
+            dst[n] = ((float *)src)[n * stride];
+        break;
+    case AF_FORMAT_DOUBLE:
+        for (int n = 0; n < num; n++)
+            dst[n] = ((double *)src)[n * stride];
+        break;
+    default:
+        MP_ASSERT_UNREACHABLE();
+    }
+}
+
+// Accumulate samples [start, start + num) of the frame into the current bin.
+static void add_samples(struct mp_waveform_priv *p, struct mp_aframe *frame,
+                        int start, int num)
+{
+    uint8_t **planes = mp_aframe_get_data_ro(frame);
+    bool planar = mp_aframe_get_planes(frame) > 1;
+    int sstride = af_fmt_to_bytes(p->format);
+
+    MP_TARRAY_GROW(p, p->tmp, num);
+    for (int c = 0; c < p->channels; c++) {
+        uint8_t *src = planar ? planes[c] + start * sstride
+                              : planes[0] + (start * p->channels + c) * sstride;
+        read_samples(p->tmp, src, p->format, planar ? 1 : p->channels, num);
+
+        float peak = p->bin_peak;
+        double sq = 0, k = 0;
+        double *s = p->state[c];
+        for (int n = 0; n < num; n++) {
+            float x = p->tmp[n];
+            if (!isfinite(x))
+                x = 0;
+            peak = MPMAX(peak, fabsf(x));
+            sq += x * x;
+            double y = biquad(&p->highpass, s + 2, biquad(&p->shelf, s, x));
+            k += y * y;
+        }
+        p->bin_peak = peak;
+        p->bin_sq += sq;
+        p->bin_k[c] += k;
+    }
+    p->bin_samples += num;
+}
+
+bool mp_waveform_add(struct mp_waveform *w, struct mp_aframe *frame)
+{
+    struct mp_waveform_priv *p = w->priv;
+    bool filled = false;
+
+    int format = af_fmt_from_planar(mp_aframe_get_format(frame));
+    int rate = mp_aframe_get_rate(frame);
+    struct mp_chmap chmap = {0};
+    mp_aframe_get_chmap(frame, &chmap);
+    if (af_fmt_is_spdif(format) || !format || rate < 1)
+        return false;
+
+    if (format != p->format || rate != p->rate ||
+        !mp_chmap_equals(&chmap, &p->chmap))
+    {
+        filled |= finish_bin(w);
+        mp_waveform_reset(w);
+        p->format = format;
+        p->rate = rate;
+        p->chmap = chmap;
+        p->channels = chmap.num;
+        init_k_weighting(p);
+    }
+
+    double pts = mp_aframe_get_pts(frame);
+    if (pts == MP_NOPTS_VALUE)
+        pts = p->next_pts;
+    if (pts == MP_NOPTS_VALUE)
+        return filled;
+
+    // Treat timestamp jumps by more than a sample as discontinuity.
+    if (p->next_pts == MP_NOPTS_VALUE || fabs(pts - p->next_pts) > 1.0 / rate) {
+        filled |= finish_bin(w);
+        mp_waveform_reset(w);
+    }
+    p->next_pts = mp_aframe_end_pts(frame);
+
+    int size = mp_aframe_get_size(frame);
+    int pos = 0;
+    if (pts < 0)
+        pos = MPMIN(ceil(-pts * rate), size);
+    while (pos < size) {
+        double t = pts + pos / (double)rate;
+        int bin = floor(t / w->interval);
+        if (bin >= MAX_BINS) {
+            p->bin = -1;
+            break;
+        }
+        if (bin != p->bin) {
+            filled |= finish_bin(w);
+            // Valid only if the first sample is at the start of the bin (with
+            // some tolerance for rounding errors at bin boundaries).
+            start_bin(p, bin, t - bin * w->interval < 1.5 / rate);
+        }
+        double end = (bin + 1) * w->interval;
+        int num = MPCLAMP(ceil((end - pts) * rate) - pos, 1, size - pos);
+        add_samples(p, frame, pos, num);
+        pos += num;
+    }
+
+    return filled;
+}
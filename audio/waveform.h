@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+
+struct mp_aframe;
+
+// Decimated summary of an audio stream, for drawing waveforms. The stream is
+// divided into bins of a fixed duration, starting at timestamp 0, and for each
+// bin the peak, RMS and loudness are computed:
+//  - peak: maximum absolute sample value over all channels
+//  - rms: root mean square over all samples of all channels
+//  - loudness: ITU-R BS.1770 loudness of the bin in LUFS (K-weighted, channel
+//    weighted, LFE ignored), clamped to MP_WAVEFORM_MIN_LOUDNESS
+// Bins that haven't been computed yet are NaN in all three arrays.
+struct mp_waveform {
+    double interval;        // bin duration in seconds
+    int num_bins;           // size of the arrays (last computed bin + 1)
+    int num_filled;         // number of bins that have been computed
+    float *peak;
+    float *rms;
+    float *loudness;
+
+    struct mp_waveform_priv *priv;
+};
+
+#define MP_WAVEFORM_MIN_LOUDNESS -70.0f
+
+struct mp_waveform *mp_waveform_create(void *ta_parent, double interval);
+
+// Analyze the samples in frame. Samples before timestamp 0 are ignored, and
+// bins which were already computed are not overwritten. Frames without
+// timestamp are assumed to follow the previous frame. Returns true if at least
+// one bin was completed.
+bool mp_waveform_add(struct mp_waveform *w, struct mp_aframe *frame);
+
+// Signal a discontinuity (e.g. seeking). The partially accumulated bin is
+// discarded, because it would be incomplete.
+void mp_waveform_reset(struct mp_waveform *w);
+
+// End of stream: store the partially accumulated bin, and reset. Returns true
+// if this completed a bin.
+bool mp_waveform_finish(struct mp_waveform *w);
@@ -42,11 +42,13 @@ struct encode_opts {
     bool copy_metadata;
     char **set_metadata;
     char **remove_metadata;
+    int segments;
 };
 
 // interface for player core
 struct encode_lavc_context *encode_lavc_init(struct mpv_global *global);
 bool encode_lavc_free(struct encode_lavc_context *ctx);
+void encode_lavc_discard(struct encode_lavc_context *ctx);
 void encode_lavc_discontinuity(struct encode_lavc_context *ctx);
 bool encode_lavc_showhelp(struct mp_log *log, struct encode_opts *options);
 int encode_lavc_getstatus(struct encode_lavc_context *ctx, char *buf, int bufsize, float relative_position);
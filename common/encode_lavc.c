@@ -53,6 +53,18 @@ struct encode_priv {
     struct mux_stream **streams;
     int num_streams;
 
+    // Packets are written by a separate thread, so that the encoders don't
+    // wait for each other (or for file I/O) while a packet is muxed. The
+    // thread is started once the header was written.
+    mp_thread mux_thread;
+    bool mux_thread_valid;
+    bool mux_terminate;
+    mp_cond mux_wakeup;     // queue changed, or mux_terminate was set
+    AVPacket **queue;       // packets to write, in submission order
+    int num_queue;
+    int64_t queue_bytes;
+    int64_t file_size;      // output position after the last write
+
     // Statistics
     double t0;
 
@@ -72,6 +84,11 @@ struct mux_stream {
     AVStream *st;
 };
 
+// Encoders block if the mux thread falls behind by more than this.
+#define MAX_QUEUE_BYTES (64 * 1024 * 1024)
+
+static MP_THREAD_VOID mux_thread(void *arg);
+
 #define OPT_BASE_STRUCT struct encode_opts
 const struct m_sub_options encode_config = {
     .opts = (const m_option_t[]) {
@@ -86,11 +103,13 @@ const struct m_sub_options encode_config = {
         {"ocopy-metadata", OPT_BOOL(copy_metadata)},
         {"oset-metadata", OPT_KEYVALUELIST(set_metadata)},
         {"oremove-metadata", OPT_STRINGLIST(remove_metadata)},
+        {"osegments", OPT_INT(segments), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct encode_opts),
     .defaults = &(const struct encode_opts){
         .copy_metadata = true,
+        .segments = 1,
     },
 };
 
@@ -107,6 +126,7 @@ struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
 
     struct encode_priv *p = ctx->priv;
     p->log = ctx->log;
+    mp_cond_init(&p->mux_wakeup);
 
     const char *filename = ctx->options->file;
 
@@ -190,6 +210,15 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     struct encode_priv *p = ctx->priv;
 
+    if (p->mux_thread_valid) {
+        // The thread writes all remaining packets before exiting.
+        mp_mutex_lock(&ctx->lock);
+        p->mux_terminate = true;
+        mp_cond_broadcast(&p->mux_wakeup);
+        mp_mutex_unlock(&ctx->lock);
+        mp_thread_join(p->mux_thread);
+    }
+
     if (!p->failed && !p->header_written) {
         MP_FATAL(p, "no data written to target file\n");
         p->failed = true;
@@ -215,12 +244,24 @@ bool encode_lavc_free(struct encode_lavc_context *ctx)
 
     res = !p->failed;
 
+    mp_cond_destroy(&p->mux_wakeup);
     mp_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 
     return res;
 }
 
+// Free a context that was never used, without treating it as an error. The
+// output file is not created.
+void encode_lavc_discard(struct encode_lavc_context *ctx)
+{
+    if (!ctx)
+        return;
+
+    ctx->priv->failed = true;
+    encode_lavc_free(ctx);
+}
+
 // called locked
 static void maybe_init_muxer(struct encode_lavc_context *ctx)
 {
@@ -275,6 +316,12 @@ static void maybe_init_muxer(struct encode_lavc_context *ctx)
 
     p->header_written = true;
 
+    p->mux_thread_valid = true;
+    if (mp_thread_create(&p->mux_thread, mux_thread, ctx)) {
+        MP_WARN(p, "Could not create mux thread, muxing synchronously.\n");
+        p->mux_thread_valid = false;
+    }
+
     return;
 
 failed:
@@ -374,6 +421,48 @@ done:
     mp_mutex_unlock(&ctx->lock);
 }
 
+// Write pkt to the muxer. Called locked, or unlocked by the mux thread (which
+// is the only writer while it runs).
+static bool write_packet(struct encode_priv *p, AVPacket *pkt, int64_t *size)
+{
+    int ret = av_interleaved_write_frame(p->muxer, pkt);
+    *size = p->muxer->pb ? MPMAX(avio_tell(p->muxer->pb), 0) : 0;
+    if (ret < 0)
+        MP_ERR(p, "Writing packet failed.\n");
+    return ret >= 0;
+}
+
+static MP_THREAD_VOID mux_thread(void *arg)
+{
+    struct encode_lavc_context *ctx = arg;
+    struct encode_priv *p = ctx->priv;
+    mp_thread_set_name("mux");
+
+    mp_mutex_lock(&ctx->lock);
+    while (p->num_queue || !p->mux_terminate) {
+        if (!p->num_queue) {
+            mp_cond_wait(&p->mux_wakeup, &ctx->lock);
+            continue;
+        }
+        AVPacket *pkt = p->queue[0];
+        MP_TARRAY_REMOVE_AT(p->queue, p->num_queue, 0);
+        p->queue_bytes -= pkt->size;
+        mp_cond_broadcast(&p->mux_wakeup);
+        if (!p->failed) {
+            mp_mutex_unlock(&ctx->lock);
+            int64_t size;
+            bool ok = write_packet(p, pkt, &size);
+            mp_mutex_lock(&ctx->lock);
+            p->failed |= !ok;
+            p->file_size = size;
+        }
+        av_packet_free(&pkt);
+    }
+    mp_mutex_unlock(&ctx->lock);
+
+    MP_THREAD_RETURN();
+}
+
 // Write a packet. This will take over ownership of `pkt`
 static void encode_lavc_add_packet(struct mux_stream *dst, AVPacket *pkt)
 {
@@ -411,9 +500,17 @@ static void encode_lavc_add_packet(struct mux_stream *dst, AVPacket *pkt)
         break;
     }
 
-    if (av_interleaved_write_frame(p->muxer, pkt) < 0) {
-        MP_ERR(p, "Writing packet failed.\n");
-        p->failed = true;
+    if (p->mux_thread_valid) {
+        while (p->queue_bytes > MAX_QUEUE_BYTES && !p->failed)
+            mp_cond_wait(&p->mux_wakeup, &ctx->lock);
+        AVPacket *copy = av_packet_alloc();
+        MP_HANDLE_OOM(copy);
+        av_packet_move_ref(copy, pkt);
+        MP_TARRAY_APPEND(p, p->queue, p->num_queue, copy);
+        p->queue_bytes += copy->size;
+        mp_cond_broadcast(&p->mux_wakeup);
+    } else {
+        p->failed |= !write_packet(p, pkt, &p->file_size);
     }
 
     pkt = NULL;
@@ -665,7 +762,7 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
     }
 
     minutes = (now - p->t0) / 60.0 * (1 - f) / f;
-    megabytes = p->muxer->pb ? (avio_size(p->muxer->pb) / 1048576.0 / f) : 0;
+    megabytes = p->file_size / 1048576.0 / f;
     fps = p->frames / (now - p->t0);
     x = p->audioseconds / (now - p->t0);
     if (p->frames) {
@@ -834,6 +931,10 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p)
         ? p->options->vopts
         : p->options->aopts;
 
+    // Let libavcodec pick the number of threads (its default is 1), unless
+    // the user sets "threads" in the codec options.
+    p->encoder->thread_count = 0;
+
     // Set these now, so the code below can read back parsed settings from it.
     mp_set_avopts(p->log, p->encoder, copts);
 
@@ -52,9 +52,13 @@
 // overwritten, then the first (virtual) log line indicates how many were lost.
 #define EARLY_FILE_BUF 5000
 
+// messages up to this size are formatted on the stack
+#define MSG_STACK_BUF 1024
+
 struct mp_log_root {
     struct mpv_global *global;
     mp_mutex lock;
+    mp_mutex buffers_lock;  // if both are held, lock comes first
     mp_mutex log_file_lock;
     mp_cond log_file_wakeup;
     // --- protected by lock
@@ -69,8 +73,6 @@ struct mp_log_root {
     int verbose;
     bool really_quiet;
     bool force_stderr;
-    struct mp_log_buffer **buffers;
-    int num_buffers;
     struct mp_log_buffer *early_buffer;
     struct mp_log_buffer *early_filebuffer;
     FILE *stats_file;
@@ -80,6 +82,10 @@ struct mp_log_root {
     bstr status_line;
     struct mp_log *status_log;
     bstr term_status_msg;
+    // --- protected by buffers_lock (and lock for writing)
+    // Messages which don't go to the terminal only need buffers_lock.
+    struct mp_log_buffer **buffers;
+    int num_buffers;
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
@@ -105,7 +111,7 @@ struct mp_log {
     int level;                  // minimum log level for any outputs
     int terminal_level;         // minimum log level for terminal output
     atomic_ulong reload_counter;
-    bstr partial[MSGL_MAX + 1];
+    bstr partial[MSGL_MAX + 1]; // protected by root->buffers_lock
 };
 
 struct mp_log_buffer {
@@ -439,55 +445,75 @@ static struct mp_log_buffer_entry *log_buffer_read(struct mp_log_buffer *buffer)
     return res;
 }
 
+// Allocate the entry, prefix and text as a single block.
+static struct mp_log_buffer_entry *new_log_buffer_entry(struct mp_log *log,
+                                                        int lev, bstr text)
+{
+    size_t prefix_len = strlen(log->verbose_prefix);
+    struct mp_log_buffer_entry *entry =
+        talloc_size(NULL, sizeof(*entry) + prefix_len + 1 + text.len + 1);
+    char *prefix = (char *)(entry + 1);
+    char *entry_text = prefix + prefix_len + 1;
+    memcpy(prefix, log->verbose_prefix, prefix_len + 1);
+    if (text.len)
+        memcpy(entry_text, text.start, text.len);
+    entry_text[text.len] = '\0';
+    *entry = (struct mp_log_buffer_entry) {
+        .prefix = prefix,
+        .level = lev,
+        .text = entry_text,
+    };
+    return entry;
+}
+
+// Called with root->buffers_lock held.
 static void write_msg_to_buffers(struct mp_log *log, int lev, bstr text)
 {
     struct mp_log_root *root = log->root;
+    if (lev == MSGL_STATUS)
+        return;
     for (int n = 0; n < root->num_buffers; n++) {
         struct mp_log_buffer *buffer = root->buffers[n];
-        bool wakeup = false;
-        mp_mutex_lock(&buffer->lock);
+        // buffer->level is immutable, so reject the message without locking.
         int buffer_level = buffer->level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_TERM)
             buffer_level = log->terminal_level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_LOGFILE)
             buffer_level = MPMAX(log->terminal_level, MSGL_DEBUG);
-        if (lev <= buffer_level && lev != MSGL_STATUS) {
-            if (buffer->level == MP_LOG_BUFFER_MSGL_LOGFILE) {
-                // If the buffer is full, block until we can write again,
-                // unless there's no write thread (died, or early filebuffer)
-                bool dead = false;
-                while (buffer->num_entries == buffer->capacity && !dead) {
-                    // Temporary unlock is OK; buffer->level is immutable, and
-                    // buffer can't go away because the global log lock is held.
-                    mp_mutex_unlock(&buffer->lock);
-                    mp_mutex_lock(&root->log_file_lock);
-                    if (root->log_file_thread_active) {
-                        mp_cond_wait(&root->log_file_wakeup,
-                                          &root->log_file_lock);
-                    } else {
-                        dead = true;
-                    }
-                    mp_mutex_unlock(&root->log_file_lock);
-                    mp_mutex_lock(&buffer->lock);
+        if (lev > buffer_level)
+            continue;
+        struct mp_log_buffer_entry *entry = new_log_buffer_entry(log, lev, text);
+        bool wakeup = false;
+        mp_mutex_lock(&buffer->lock);
+        if (buffer->level == MP_LOG_BUFFER_MSGL_LOGFILE) {
+            // If the buffer is full, block until we can write again,
+            // unless there's no write thread (died, or early filebuffer)
+            bool dead = false;
+            while (buffer->num_entries == buffer->capacity && !dead) {
+                // Temporary unlock is OK; buffer->level is immutable, and
+                // buffer can't go away because buffers_lock is held.
+                mp_mutex_unlock(&buffer->lock);
+                mp_mutex_lock(&root->log_file_lock);
+                if (root->log_file_thread_active) {
+                    mp_cond_wait(&root->log_file_wakeup,
+                                      &root->log_file_lock);
+                } else {
+                    dead = true;
                 }
+                mp_mutex_unlock(&root->log_file_lock);
+                mp_mutex_lock(&buffer->lock);
             }
-            if (buffer->num_entries == buffer->capacity) {
-                struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
-                talloc_free(skip);
-                buffer->dropped += 1;
-            }
-            struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
-            *entry = (struct mp_log_buffer_entry) {
-                .prefix = talloc_strdup(entry, log->verbose_prefix),
-                .level = lev,
-                .text = bstrdup0(entry, text),
-            };
-            int pos = (buffer->entry0 + buffer->num_entries) % buffer->capacity;
-            buffer->entries[pos] = entry;
-            buffer->num_entries += 1;
-            if (buffer->wakeup_cb && !buffer->silent)
-                wakeup = true;
         }
+        if (buffer->num_entries == buffer->capacity) {
+            struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
+            talloc_free(skip);
+            buffer->dropped += 1;
+        }
+        int pos = (buffer->entry0 + buffer->num_entries) % buffer->capacity;
+        buffer->entries[pos] = entry;
+        buffer->num_entries += 1;
+        if (buffer->wakeup_cb && !buffer->silent)
+            wakeup = true;
         mp_mutex_unlock(&buffer->lock);
         if (wakeup)
             buffer->wakeup_cb(buffer->wakeup_cb_ctx);
@@ -593,6 +619,56 @@ static void sanitize(bstr *text)
     }
 }
 
+// Format the message into buf, or into a new allocation returned in *tmp if
+// it doesn't fit.
+static bstr format_msg(char *buf, size_t buf_size, void **tmp,
+                       const char *format, va_list va)
+{
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(buf, buf_size, format, copy);
+    va_end(copy);
+    if (len < 0) {
+        *tmp = talloc_asprintf(NULL, "format error: %s", format);
+        return bstr0(*tmp);
+    }
+    if (len >= buf_size) {
+        *tmp = talloc_size(NULL, len + 1);
+        vsnprintf(*tmp, len + 1, format, va);
+        buf = *tmp;
+    }
+    return (bstr){(unsigned char *)buf, len};
+}
+
+// Write the complete lines of the message to the log buffers, and keep the
+// rest for the next message. Called with root->buffers_lock held.
+static void write_buffer_msg(struct mp_log *log, int lev, bstr text)
+{
+    bstr *partial = &log->partial[lev];
+    if (partial->len) {
+        bstr_xappend(NULL, partial, text);
+        text = *partial;
+    }
+
+    bstr str = text;
+    while (str.len) {
+        bstr line = bstr_getline(str, &str);
+        if (line.start[line.len - 1] != '\n') {
+            str = line;
+            break;
+        }
+        bstr_eatstart0(&line, TERM_MSG_0);
+        write_msg_to_buffers(log, lev, line);
+    }
+
+    if (text.start == partial->start) {
+        memmove(partial->start, str.start, str.len);
+        partial->len = str.len;
+    } else if (str.len) {
+        bstr_xappend(NULL, partial, str);
+    }
+}
+
 void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 {
     if (!mp_msg_test(log, lev))
@@ -600,7 +676,26 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 
     struct mp_log_root *root = log->root;
 
+    // Format outside of the locks.
+    char buf[MSG_STACK_BUF];
+    void *tmp = NULL;
+    bstr text = format_msg(buf, sizeof(buf), &tmp, format, va);
+    sanitize(&text);
+
+    // Messages which can't reach the terminal (e.g. debug messages for log
+    // files and clients) don't need the terminal state and root->lock. Like
+    // mp_msg_test(), the check can race with option changes, which at worst
+    // makes a concurrently logged message skip the terminal.
+    if (lev != MSGL_STATUS && lev != MSGL_STATS && !test_terminal_level(log, lev)) {
+        mp_mutex_lock(&root->buffers_lock);
+        write_buffer_msg(log, lev, text);
+        mp_mutex_unlock(&root->buffers_lock);
+        talloc_free(tmp);
+        return;
+    }
+
     mp_mutex_lock(&root->lock);
+    mp_mutex_lock(&root->buffers_lock);
 
     root->buffer.len = 0;
 
@@ -608,12 +703,8 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
         bstr_xappend(root, &root->buffer, log->partial[lev]);
     log->partial[lev].len = 0;
 
-    if (bstr_xappend_vasprintf(root, &root->buffer, format, va) < 0) {
-        bstr_xappend(root, &root->buffer, bstr0("format error: "));
-        bstr_xappend(root, &root->buffer, bstr0(format));
-    }
-
-    sanitize(&root->buffer);
+    bstr_xappend(root, &root->buffer, text);
+    talloc_free(tmp);
 
     // Remember last status message and restore it to ensure that it is
     // always displayed
@@ -626,21 +717,26 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
     }
 
     if (lev == MSGL_STATS) {
+        mp_mutex_unlock(&root->buffers_lock);
         dump_stats(log, lev, root->buffer);
     } else if (lev == MSGL_STATUS && !test_terminal_level(log, lev)) {
-        /* discard */
+        mp_mutex_unlock(&root->buffers_lock);
     } else {
         write_term_msg(log, lev, root->buffer, &root->term_msg);
 
+        root->term_status_msg.len = 0;
+        if (root->term_msg.len && lev != MSGL_STATUS && root->status_line.len &&
+            root->status_log && is_status_output(root, lev) &&
+            test_terminal_level(root->status_log, MSGL_STATUS))
+        {
+            write_term_msg(root->status_log, MSGL_STATUS, root->status_line,
+                           &root->term_status_msg);
+        }
+        // Terminal output doesn't block messages going only to the buffers.
+        mp_mutex_unlock(&root->buffers_lock);
+
         FILE *stream = term_msg_fp(root, lev);
         if (root->term_msg.len) {
-            root->term_status_msg.len = 0;
-            if (lev != MSGL_STATUS && root->status_line.len && root->status_log &&
-                is_status_output(root, lev) && test_terminal_level(root->status_log, MSGL_STATUS))
-            {
-                write_term_msg(root->status_log, MSGL_STATUS, root->status_line,
-                               &root->term_status_msg);
-            }
             fwrite(root->term_msg.start, root->term_msg.len, 1, stream);
             if (root->term_status_msg.len)
                 fwrite(root->term_status_msg.start, root->term_status_msg.len, 1, stream);
@@ -715,6 +811,7 @@ void mp_msg_init(struct mpv_global *global)
     };
 
     mp_mutex_init(&root->lock);
+    mp_mutex_init(&root->buffers_lock);
     mp_mutex_init(&root->log_file_lock);
     mp_cond_init(&root->log_file_wakeup);
 
@@ -940,6 +1037,7 @@ void mp_msg_uninit(struct mpv_global *global)
     talloc_free(root->log_path);
     m_option_type_msglevels.free(&root->msg_levels);
     mp_mutex_destroy(&root->lock);
+    mp_mutex_destroy(&root->buffers_lock);
     mp_mutex_destroy(&root->log_file_lock);
     mp_cond_destroy(&root->log_file_wakeup);
     talloc_free(root);
@@ -1042,7 +1140,9 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
 
     mp_mutex_init(&buffer->lock);
 
+    mp_mutex_lock(&root->buffers_lock);
     MP_TARRAY_APPEND(root, root->buffers, root->num_buffers, buffer);
+    mp_mutex_unlock(&root->buffers_lock);
 
     atomic_fetch_add(&root->reload_counter, 1);
     mp_mutex_unlock(&root->lock);
@@ -1099,6 +1199,7 @@ void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
     struct mp_log_root *root = buffer->root;
 
     mp_mutex_lock(&root->lock);
+    mp_mutex_lock(&root->buffers_lock);
 
     for (int n = 0; n < root->num_buffers; n++) {
         if (root->buffers[n] == buffer) {
@@ -1110,6 +1211,7 @@ void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
     MP_ASSERT_UNREACHABLE();
 
 found:
+    mp_mutex_unlock(&root->buffers_lock);
 
     while (buffer->num_entries)
         talloc_free(log_buffer_read(buffer));
@@ -15,10 +15,15 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <math.h>
+#include <unistd.h>
 
 #include <libavformat/avformat.h>
 
+#include "osdep/io.h"
+
 #include "common/av_common.h"
 #include "common/common.h"
 #include "common/global.h"
@@ -27,6 +32,9 @@
 #include "demux/packet.h"
 #include "demux/packet_pool.h"
 #include "demux/stheader.h"
+#include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "osdep/threads.h"
 
 #include "recorder.h"
 
@@ -38,6 +46,11 @@
 // codec delay and frame reordering, and potentially lack of DTS).
 // Keyframe flags can trigger this earlier.
 #define QUEUE_MIN_PACKETS 16
+// The demuxer blocks if the mux thread falls behind by more than this.
+#define MAX_QUEUE_BYTES (64 * 1024 * 1024)
+// Output buffer size for local files. The muxer does many small writes; this
+// turns them into few large ones.
+#define IO_BUFFER_SIZE (1024 * 1024)
 
 struct mp_recorder {
     struct mpv_global *global;
@@ -60,6 +73,20 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+    int fd;                 // output file if mux->pb is our own AVIOContext
+
+    // Packets are written by mux_thread. Everything else is accessed by the
+    // feeding thread only.
+    mp_mutex lock;
+    mp_cond wakeup;         // queue changed, or mux_terminate was set
+    mp_thread mux_thread;
+    bool mux_thread_valid;
+    // Guarded by lock.
+    bool mux_terminate;
+    bool write_failed;
+    AVPacket **queue;       // packets to write, in submission order
+    int num_queue;
+    int64_t queue_bytes;
 };
 
 struct mp_recorder_sink {
@@ -128,6 +155,149 @@ done:
     return ret;
 }
 
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+static int write_fd(void *p, uint8_t *buf, int buf_size)
+#else
+static int write_fd(void *p, const uint8_t *buf, int buf_size)
+#endif
+{
+    struct mp_recorder *priv = p;
+    int done = 0;
+    while (done < buf_size) {
+        ssize_t r = write(priv->fd, buf + done, buf_size - done);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        done += r;
+    }
+    return done;
+}
+
+static int64_t seek_fd(void *p, int64_t offset, int whence)
+{
+    struct mp_recorder *priv = p;
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+        off_t pos = lseek(priv->fd, 0, SEEK_CUR);
+        off_t size = lseek(priv->fd, 0, SEEK_END);
+        if (pos < 0 || size < 0 || lseek(priv->fd, pos, SEEK_SET) < 0)
+            return AVERROR(errno);
+        return size;
+    }
+    off_t r = lseek(priv->fd, offset, whence);
+    return r < 0 ? AVERROR(errno) : r;
+}
+
+// Local files are written through a large buffer; anything else (pipe:,
+// protocols) goes through libavformat's default I/O.
+static bool open_output(struct mp_recorder *priv, const char *target_file)
+{
+    if (mp_is_url(bstr0(target_file)))
+        return avio_open2(&priv->mux->pb, target_file, AVIO_FLAG_WRITE,
+                          NULL, NULL) >= 0;
+
+    priv->fd = open(target_file, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY |
+                    O_CLOEXEC, 0666);
+    if (priv->fd < 0)
+        return false;
+    void *buffer = av_malloc(IO_BUFFER_SIZE);
+    MP_HANDLE_OOM(buffer);
+    priv->mux->pb = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, priv, NULL,
+                                       write_fd, seek_fd);
+    if (!priv->mux->pb) {
+        av_free(buffer);
+        return false;
+    }
+    return true;
+}
+
+static bool close_output(struct mp_recorder *priv)
+{
+    AVIOContext *pb = priv->mux->pb;
+    if (priv->fd < 0)
+        return avio_closep(&priv->mux->pb) >= 0;
+
+    bool ok = true;
+    if (pb) {
+        avio_flush(pb);
+        ok = !pb->error;
+        av_freep(&pb->buffer);
+        avio_context_free(&priv->mux->pb);
+    }
+    if (close(priv->fd) < 0)
+        ok = false;
+    priv->fd = -1;
+    return ok;
+}
+
+static MP_THREAD_VOID mux_thread(void *arg)
+{
+    struct mp_recorder *priv = arg;
+    mp_thread_set_name("recorder");
+
+    AVPacket **batch = NULL;
+    int num_batch = 0;
+
+    mp_mutex_lock(&priv->lock);
+    while (priv->num_queue || !priv->mux_terminate) {
+        if (!priv->num_queue) {
+            mp_cond_wait(&priv->wakeup, &priv->lock);
+            continue;
+        }
+        // Take everything queued so far, so the feeding thread is never
+        // blocked by the lock while writing.
+        MPSWAP(AVPacket **, batch, priv->queue);
+        MPSWAP(int, num_batch, priv->num_queue);
+        bool failed = priv->write_failed;
+        mp_mutex_unlock(&priv->lock);
+
+        int64_t bytes = 0;
+        for (int n = 0; n < num_batch; n++) {
+            bytes += batch[n]->size;
+            if (!failed && av_interleaved_write_frame(priv->mux, batch[n]) < 0) {
+                MP_ERR(priv, "Failed writing packet.\n");
+                failed = true;
+            }
+            av_packet_free(&batch[n]);
+        }
+        num_batch = 0;
+
+        mp_mutex_lock(&priv->lock);
+        priv->queue_bytes -= bytes;
+        priv->write_failed = failed;
+        mp_cond_broadcast(&priv->wakeup);
+    }
+    mp_mutex_unlock(&priv->lock);
+
+    talloc_free(batch);
+    MP_THREAD_RETURN();
+}
+
+// Queue a packet for writing. Takes over ownership of pkt.
+static void write_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    if (!priv->mux_thread_valid) {
+        if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+            MP_ERR(priv, "Failed writing packet.\n");
+        av_packet_free(&pkt);
+        return;
+    }
+
+    mp_mutex_lock(&priv->lock);
+    while (priv->queue_bytes > MAX_QUEUE_BYTES && !priv->write_failed)
+        mp_cond_wait(&priv->wakeup, &priv->lock);
+    if (priv->write_failed) {
+        av_packet_free(&pkt);
+    } else {
+        MP_TARRAY_APPEND(priv, priv->queue, priv->num_queue, pkt);
+        priv->queue_bytes += pkt->size;
+        mp_cond_broadcast(&priv->wakeup);
+    }
+    mp_mutex_unlock(&priv->lock);
+}
+
 struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        const char *target_file,
                                        struct sh_stream **streams,
@@ -140,6 +310,9 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
     priv->packet_pool = demux_packet_pool_get(global);
+    priv->fd = -1;
+    mp_mutex_init(&priv->lock);
+    mp_cond_init(&priv->wakeup);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -156,7 +329,7 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
         goto error;
     }
 
-    if (avio_open2(&priv->mux->pb, target_file, AVIO_FLAG_WRITE, NULL, NULL) < 0) {
+    if (!open_output(priv, target_file)) {
         MP_ERR(priv, "Failed opening output file.\n");
         goto error;
     }
@@ -213,6 +386,12 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->opened = true;
     priv->muxing_from_start = true;
 
+    priv->mux_thread_valid = true;
+    if (mp_thread_create(&priv->mux_thread, mux_thread, priv)) {
+        MP_WARN(priv, "Could not create mux thread, muxing synchronously.\n");
+        priv->mux_thread_valid = false;
+    }
+
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
@@ -256,16 +435,15 @@ static void mux_packet(struct mp_recorder_sink *rst,
     if (rst->avpkt->duration < 0 && rst->sh->type != STREAM_SUB)
         rst->avpkt->duration = 0;
 
+    // This references the payload if it is refcounted (which it is for
+    // packets from the demuxers), so only the packet struct is allocated.
     AVPacket *new_packet = av_packet_clone(rst->avpkt);
     if (!new_packet) {
         MP_ERR(priv, "Failed to allocate packet.\n");
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
-
-    av_packet_free(&new_packet);
+    write_packet(priv, new_packet);
 }
 
 // Write all packets available in the stream queue
@@ -335,18 +513,29 @@ void mp_recorder_destroy(struct mp_recorder *priv)
             mp_free_av_packet(&rst->avpkt);
         }
 
+        if (priv->mux_thread_valid) {
+            // The thread writes all remaining packets before exiting.
+            mp_mutex_lock(&priv->lock);
+            priv->mux_terminate = true;
+            mp_cond_broadcast(&priv->wakeup);
+            mp_mutex_unlock(&priv->lock);
+            mp_thread_join(priv->mux_thread);
+        }
+
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
     }
 
     if (priv->mux) {
-        if (avio_closep(&priv->mux->pb) < 0)
+        if (!close_output(priv))
             MP_ERR(priv, "Closing file failed\n");
 
         avformat_free_context(priv->mux);
     }
 
     flush_packets(priv);
+    mp_cond_destroy(&priv->wakeup);
+    mp_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdatomic.h>
 #include <time.h>
 
@@ -9,17 +10,47 @@
 #include "misc/node.h"
 #include "msg.h"
 #include "options/m_option.h"
+#include "osdep/io.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "stats.h"
 
+// Log2 buckets of nanoseconds for the interval histograms of handles.
+#define HIST_BUCKETS 40
+
+// Maximum number of intervals recorded by a trace.
+#define TRACE_MAX_EVENTS (1 << 16)
+
+struct trace_event {
+    int64_t start_ns, dur_ns;
+    int name_id;
+    int tid;
+    atomic_bool valid;
+};
+
+struct stats_trace {
+    atomic_int num_events; // can be larger than TRACE_MAX_EVENTS (dropped)
+    int64_t start_ns;
+    struct trace_event events[TRACE_MAX_EVENTS];
+};
+
 struct stats_base {
     struct mpv_global *global;
 
     atomic_bool active;
+    atomic_bool tracing;
 
     mp_mutex lock;
 
+    // Full names of all entries, indexed by stat_entry.name_id. Never removed,
+    // so recorded trace events outlive their stats_ctx.
+    char **names;
+    int num_names;
+
+    // Allocated with the first trace, and then reused. Written without lock
+    // while tracing is set.
+    struct stats_trace *trace;
+
     struct {
         struct stats_ctx *head, *tail;
     } list;
@@ -49,6 +80,7 @@ enum val_type {
     VAL_INC,
     VAL_TIME,
     VAL_THREAD_CPU_TIME,
+    VAL_HANDLE,
 };
 
 struct stat_entry {
@@ -62,11 +94,33 @@ struct stat_entry {
     int64_t time_start_ns;
     int64_t cpu_start_ns;
     mp_thread_id thread_id;
+    int name_id;
+
+    // --- VAL_HANDLE only. Accumulated without lock by the owner thread, and
+    //     merged with all other handles of the same name on query.
+    struct stats_base *base;
+    atomic_int_fast64_t h_events;
+    atomic_int_fast64_t h_intervals;
+    atomic_int_fast64_t h_rt, h_th, h_max;
+    atomic_int_fast64_t h_hist[HIST_BUCKETS];
+    int64_t h_start_ns, h_cpu_start_ns; // owner thread only
+};
+
+// Sum of handles of the same name, filled by read_handle().
+struct handle_sum {
+    int64_t events, intervals, rt, th, max;
+    int64_t hist[HIST_BUCKETS];
 };
 
 #define IS_ACTIVE(ctx) \
     (atomic_load_explicit(&(ctx)->base->active, memory_order_relaxed))
 
+#define IS_TRACING(base) \
+    (atomic_load_explicit(&(base)->tracing, memory_order_acquire))
+
+static thread_local int trace_tid;
+static atomic_int trace_next_tid;
+
 static void stats_destroy(void *p)
 {
     struct stats_base *stats = p;
@@ -107,6 +161,56 @@ static int cmp_entry(const void *p1, const void *p2)
     return strcmp((*e1)->full_name, (*e2)->full_name);
 }
 
+// Add the values accumulated by the handle to sum, and reset them.
+static void read_handle(struct stat_entry *e, struct handle_sum *sum)
+{
+    sum->events += atomic_exchange(&e->h_events, 0);
+    sum->intervals += atomic_exchange(&e->h_intervals, 0);
+    sum->rt += atomic_exchange(&e->h_rt, 0);
+    sum->th += atomic_exchange(&e->h_th, 0);
+    sum->max = MPMAX(sum->max, atomic_exchange(&e->h_max, 0));
+    for (int n = 0; n < HIST_BUCKETS; n++)
+        sum->hist[n] += atomic_exchange(&e->h_hist[n], 0);
+}
+
+// Upper bound of the bucket containing the given fraction of intervals.
+static double hist_percentile_ms(struct handle_sum *sum, double fraction)
+{
+    int64_t target = ceil(sum->intervals * fraction), count = 0;
+    for (int n = 0; n < HIST_BUCKETS; n++) {
+        count += sum->hist[n];
+        if (count >= target)
+            return MP_TIME_NS_TO_MS(MPMIN((int64_t)2 << n, sum->max));
+    }
+    return MP_TIME_NS_TO_MS(sum->max);
+}
+
+static void add_handle_stats(struct mpv_node *list, struct stat_entry *e,
+                             struct handle_sum *sum, double t_ms)
+{
+#define FMT_MS(v) mp_tprintf(80, "%.3f ms", (v))
+    if (sum->events)
+        add_stat(list, e, NULL, sum->events, NULL);
+    double t_cpu = MP_TIME_NS_TO_MS(sum->th);
+    double t_rt = MP_TIME_NS_TO_MS(sum->rt);
+    add_stat(list, e, "cpu", t_cpu, t_ms > 0
+        ? mp_tprintf(80, "%.3f ms (%.2f%%)", t_cpu, t_cpu / t_ms * 100)
+        : FMT_MS(t_cpu));
+    add_stat(list, e, "time", t_rt, t_ms > 0
+        ? mp_tprintf(80, "%.3f ms (%.2f%%)", t_rt, t_rt / t_ms * 100)
+        : FMT_MS(t_rt));
+    if (sum->intervals) {
+        double p50 = hist_percentile_ms(sum, 0.5);
+        double p99 = hist_percentile_ms(sum, 0.99);
+        double max = MP_TIME_NS_TO_MS(sum->max);
+        add_stat(list, e, "count", sum->intervals, NULL);
+        add_stat(list, e, "p50", p50, FMT_MS(p50));
+        add_stat(list, e, "p99", p99, FMT_MS(p99));
+        add_stat(list, e, "max", max, FMT_MS(max));
+    }
+#undef FMT_MS
+}
+
 void stats_global_query(struct mpv_global *global, struct mpv_node *out)
 {
     struct stats_base *stats = global->stats;
@@ -150,6 +254,10 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
             for (int n = 0; n < stats->num_entries; n++) {
                 struct stat_entry *e = stats->entries[n];
 
+                if (e->type == VAL_HANDLE) {
+                    read_handle(e, &(struct handle_sum){0});
+                    continue;
+                }
                 e->cpu_start_ns = e->time_start_ns = 0;
                 e->val_rt = e->val_th = 0;
                 if (e->type != VAL_THREAD_CPU_TIME)
@@ -202,6 +310,18 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
             e->cpu_start_ns = t;
             break;
         }
+        case VAL_HANDLE: {
+            // Merge all handles with the same name (e.g. one per thread),
+            // which are adjacent after sorting.
+            struct handle_sum sum = {0};
+            read_handle(e, &sum);
+            while (n + 1 < stats->num_entries &&
+                   stats->entries[n + 1]->type == VAL_HANDLE &&
+                   strcmp(stats->entries[n + 1]->full_name, e->full_name) == 0)
+                read_handle(stats->entries[++n], &sum);
+            add_handle_stats(out, e, &sum, t_ms);
+            break;
+        }
         default: ;
         }
     }
@@ -241,18 +361,26 @@ struct stats_ctx *stats_ctx_create(void *ta_parent, struct mpv_global *global,
     return ctx;
 }
 
-static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
+// Called with base->lock held.
+static int intern_name(struct stats_base *base, const char *name)
 {
-    for (int n = 0; n < ctx->num_entries; n++) {
-        if (strcmp(ctx->entries[n]->name, name) == 0)
-            return ctx->entries[n];
+    for (int n = 0; n < base->num_names; n++) {
+        if (strcmp(base->names[n], name) == 0)
+            return n;
     }
+    MP_TARRAY_APPEND(base, base->names, base->num_names,
+                     talloc_strdup(base, name));
+    return base->num_names - 1;
+}
 
+static struct stat_entry *new_entry(struct stats_ctx *ctx, const char *name)
+{
     struct stat_entry *e = talloc_zero(ctx, struct stat_entry);
     snprintf(e->name, sizeof(e->name), "%s", name);
     mp_assert(strcmp(e->name, name) == 0); // make e->name larger and don't complain
 
     e->full_name = talloc_asprintf(e, "%s/%s", ctx->prefix, e->name);
+    e->name_id = intern_name(ctx->base, e->full_name);
 
     MP_TARRAY_APPEND(ctx, ctx->entries, ctx->num_entries, e);
     ctx->base->num_entries = 0; // invalidate
@@ -260,6 +388,35 @@ static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
     return e;
 }
 
+static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
+{
+    for (int n = 0; n < ctx->num_entries; n++) {
+        if (ctx->entries[n]->type != VAL_HANDLE &&
+            strcmp(ctx->entries[n]->name, name) == 0)
+            return ctx->entries[n];
+    }
+
+    return new_entry(ctx, name);
+}
+
+static void trace_interval(struct stats_base *base, int name_id,
+                           int64_t start_ns, int64_t dur_ns)
+{
+    struct stats_trace *trace = base->trace;
+    int idx = atomic_fetch_add_explicit(&trace->num_events, 1,
+                                        memory_order_relaxed);
+    if (idx >= TRACE_MAX_EVENTS)
+        return;
+    if (!trace_tid)
+        trace_tid = atomic_fetch_add(&trace_next_tid, 1) + 1;
+    struct trace_event *ev = &trace->events[idx];
+    ev->start_ns = start_ns;
+    ev->dur_ns = dur_ns;
+    ev->name_id = name_id;
+    ev->tid = trace_tid;
+    atomic_store_explicit(&ev->valid, true, memory_order_release);
+}
+
 static void static_value(struct stats_ctx *ctx, const char *name, double val,
                          enum val_type type)
 {
@@ -285,7 +442,7 @@ void stats_size_value(struct stats_ctx *ctx, const char *name, double val)
 void stats_time_start(struct stats_ctx *ctx, const char *name)
 {
     MP_STATS(ctx->base->global, "start %s", name);
-    if (!IS_ACTIVE(ctx))
+    if (!IS_ACTIVE(ctx) && !IS_TRACING(ctx->base))
         return;
     mp_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
@@ -299,13 +456,17 @@ void stats_time_start(struct stats_ctx *ctx, const char *name)
 void stats_time_end(struct stats_ctx *ctx, const char *name)
 {
     MP_STATS(ctx->base->global, "end %s", name);
-    if (!IS_ACTIVE(ctx))
+    if (!IS_ACTIVE(ctx) && !IS_TRACING(ctx->base))
         return;
     mp_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
     if (e->type == VAL_TIME && e->time_start_ns) {
+        int64_t now = mp_time_ns();
         e->val_th += mp_thread_cpu_time_ns(e->thread_id) - e->cpu_start_ns;
-        e->val_rt += mp_time_ns() - e->time_start_ns;
+        e->val_rt += now - e->time_start_ns;
+        if (IS_TRACING(ctx->base))
+            trace_interval(ctx->base, e->name_id, e->time_start_ns,
+                           now - e->time_start_ns);
         e->time_start_ns = 0;
     }
     mp_mutex_unlock(&ctx->base->lock);
@@ -343,3 +504,126 @@ void stats_unregister_thread(struct stats_ctx *ctx, const char *name)
 {
     register_thread(ctx, name, 0);
 }
+
+struct stats_handle *stats_handle_create(struct stats_ctx *ctx, const char *name)
+{
+    if (!ctx)
+        return NULL;
+    mp_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = new_entry(ctx, name);
+    e->type = VAL_HANDLE;
+    e->base = ctx->base;
+    mp_mutex_unlock(&ctx->base->lock);
+    return (struct stats_handle *)e;
+}
+
+void stats_handle_event(struct stats_handle *h)
+{
+    struct stat_entry *e = (struct stat_entry *)h;
+    if (!e || !atomic_load_explicit(&e->base->active, memory_order_relaxed))
+        return;
+    atomic_fetch_add_explicit(&e->h_events, 1, memory_order_relaxed);
+}
+
+void stats_handle_time_start(struct stats_handle *h)
+{
+    struct stat_entry *e = (struct stat_entry *)h;
+    if (!e)
+        return;
+    MP_STATS(e->base->global, "start %s", e->name);
+    if (!atomic_load_explicit(&e->base->active, memory_order_relaxed) &&
+        !IS_TRACING(e->base))
+    {
+        e->h_start_ns = 0;
+        return;
+    }
+    e->h_cpu_start_ns = mp_thread_cpu_time_ns(mp_thread_current_id());
+    e->h_start_ns = mp_time_ns();
+}
+
+void stats_handle_time_end(struct stats_handle *h)
+{
+    struct stat_entry *e = (struct stat_entry *)h;
+    if (!e)
+        return;
+    MP_STATS(e->base->global, "end %s", e->name);
+    if (!e->h_start_ns)
+        return;
+    int64_t now = mp_time_ns();
+    int64_t dur = now - e->h_start_ns;
+    int64_t cpu = mp_thread_cpu_time_ns(mp_thread_current_id()) - e->h_cpu_start_ns;
+    atomic_fetch_add_explicit(&e->h_intervals, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->h_rt, dur, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->h_th, cpu, memory_order_relaxed);
+    int64_t max = atomic_load_explicit(&e->h_max, memory_order_relaxed);
+    while (dur > max && !atomic_compare_exchange_weak(&e->h_max, &max, dur)) {}
+    int bucket = dur >> 32 ? 32 + mp_log2(dur >> 32) : mp_log2(MPMAX(dur, 1));
+    bucket = MPMIN(bucket, HIST_BUCKETS - 1);
+    atomic_fetch_add_explicit(&e->h_hist[bucket], 1, memory_order_relaxed);
+    if (IS_TRACING(e->base))
+        trace_interval(e->base, e->name_id, e->h_start_ns, dur);
+    e->h_start_ns = 0;
+}
+
+void stats_global_trace_start(struct mpv_global *global)
+{
+    struct stats_base *stats = global->stats;
+    mp_mutex_lock(&stats->lock);
+    if (!stats->trace)
+        stats->trace = talloc_zero(stats, struct stats_trace);
+    struct stats_trace *trace = stats->trace;
+    int num = MPMIN(atomic_load(&trace->num_events), TRACE_MAX_EVENTS);
+    for (int n = 0; n < num; n++)
+        atomic_store(&trace->events[n].valid, false);
+    atomic_store(&trace->num_events, 0);
+    trace->start_ns = mp_time_ns();
+    atomic_store_explicit(&stats->tracing, true, memory_order_release);
+    mp_mutex_unlock(&stats->lock);
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c < 0x20 || c == '"' || c == '\\') {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+int stats_global_trace_stop(struct mpv_global *global, const char *path)
+{
+    struct stats_base *stats = global->stats;
+    mp_mutex_lock(&stats->lock);
+    atomic_store(&stats->tracing, false);
+    struct stats_trace *trace = stats->trace;
+    int res = -1;
+    FILE *f = trace && path ? fopen(path, "wb") : NULL;
+    if (f) {
+        // Chrome trace event format, as read by chrome://tracing and Perfetto.
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        int num = MPMIN(atomic_load(&trace->num_events), TRACE_MAX_EVENTS);
+        res = 0;
+        for (int n = 0; n < num; n++) {
+            struct trace_event *ev = &trace->events[n];
+            // Skip events which were still being written when stopping.
+            if (!atomic_load_explicit(&ev->valid, memory_order_acquire))
+                continue;
+            fprintf(f, "%s\n{\"name\":", res ? "," : "");
+            write_json_string(f, stats->names[ev->name_id]);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}", ev->tid,
+                    (ev->start_ns - trace->start_ns) / 1e3, ev->dur_ns / 1e3);
+            res++;
+        }
+        fprintf(f, "\n]}\n");
+        if (fclose(f))
+            res = -1;
+    }
+    mp_mutex_unlock(&stats->lock);
+    return res;
+}
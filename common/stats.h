@@ -3,10 +3,20 @@
 struct mpv_global;
 struct mpv_node;
 struct stats_ctx;
+struct stats_handle;
 
 void stats_global_init(struct mpv_global *global);
 void stats_global_query(struct mpv_global *global, struct mpv_node *out);
 
+// Start recording the intervals of stats_time_start/end() and the handle
+// variants. Restarts the recording if it's already running.
+void stats_global_trace_start(struct mpv_global *global);
+
+// Stop recording, and write the recorded intervals to path as Chrome trace
+// event JSON (for chrome://tracing or Perfetto). Returns the number of written
+// intervals, or -1 on error.
+int stats_global_trace_stop(struct mpv_global *global, const char *path);
+
 // stats_ctx can be free'd with ta_free(), or by using the ta_parent.
 struct stats_ctx *stats_ctx_create(void *ta_parent, struct mpv_global *global,
                                    const char *prefix);
@@ -32,3 +42,18 @@ void stats_register_thread_cputime(struct stats_ctx *ctx, const char *name);
 
 // Remove reference to the current thread.
 void stats_unregister_thread(struct stats_ctx *ctx, const char *name);
+
+// Return a pre-registered entry, for hot paths (no lookup by name, no locks).
+// Each handle must be used by one thread at a time; create one handle per
+// thread to time the same thing on several threads. Handles with the same
+// name are merged on query. Freed with the stats_ctx. NULL ctx returns NULL,
+// and the stats_handle_*() functions ignore NULL handles.
+struct stats_handle *stats_handle_create(struct stats_ctx *ctx, const char *name);
+
+// Like stats_event().
+void stats_handle_event(struct stats_handle *h);
+
+// Like stats_time_start/end(). Additionally reports the number of intervals,
+// and the approximate median, 99th percentile and maximum interval.
+void stats_handle_time_start(struct stats_handle *h);
+void stats_handle_time_end(struct stats_handle *h);
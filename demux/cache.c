@@ -18,9 +18,19 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#include <libavutil/buffer.h>
+#include <libavutil/md5.h>
+
 #include "cache.h"
 #include "common/msg.h"
 #include "common/av_common.h"
@@ -31,10 +41,13 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 struct demux_cache_opts {
     char *cache_dir;
     int unlink_files;
+    bool use_mmap;
+    bool persist;
 };
 
 #define OPT_BASE_STRUCT struct demux_cache_opts
@@ -45,6 +58,8 @@ const struct m_sub_options demux_cache_conf = {
         {"demuxer-cache-unlink-files", OPT_CHOICE(unlink_files,
             {"immediate", 2}, {"whendone", 1}, {"no", 0}),
         },
+        {"demuxer-cache-mmap", OPT_BOOL(use_mmap)},
+        {"demuxer-cache-persist", OPT_BOOL(persist)},
         {0}
     },
     .size = sizeof(struct demux_cache_opts),
@@ -54,6 +69,23 @@ const struct m_sub_options demux_cache_conf = {
     .change_flags = UPDATE_DEMUXER,
 };
 
+// Serialized packets are collected in a buffer of this size, which is written
+// to the file in one go by the writer thread.
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+
+// With --demuxer-cache-mmap, the file is mapped in pieces of this size. Must
+// be a multiple of the page size.
+#define MAP_CHUNK_SIZE (16 * 1024 * 1024)
+
+// In sequential read mode, reads from the file are done in pieces of this size.
+#define READ_AHEAD_SIZE (4 * 1024 * 1024)
+
+struct write_buffer {
+    uint8_t *data;
+    size_t len, size;
+    uint64_t pos;               // file position of data[0]
+};
+
 struct demux_cache {
     struct mp_log *log;
     struct demux_packet_pool *packet_pool;
@@ -61,9 +93,43 @@ struct demux_cache {
 
     char *filename;
     bool need_unlink;
+    bool persistent;            // --demuxer-cache-persist file for a key
+    char *key;
+    bstr index;                 // index loaded from a persistent file
     int fd;
+    uint64_t file_size;         // including data not written yet
+    bool failed;                // a write failed; don't accept new packets
+
+    // --demuxer-cache-mmap: maps[n] is the mapping of the file range
+    // [n * MAP_CHUNK_SIZE, (n + 1) * MAP_CHUNK_SIZE) (or NULL if not yet
+    // mapped). Packets read from it reference it directly. Packet payloads
+    // are followed by zeroed input padding in the file in this mode (padded).
+    bool use_mmap;
+    bool padded;
+    AVBufferRef **maps;
+    int num_maps;
+
+    // demux_cache_set_sequential(): file data following the last read, or
+    // NULL if not in sequential mode.
+    struct write_buffer *read_ahead;
+
+    // Protects fd and file_pos (shared between writer thread and readers).
+    mp_mutex io_lock;
     int64_t file_pos;
-    uint64_t file_size;
+
+    // Buffer being filled by demux_cache_write(). Not accessed by the writer.
+    struct write_buffer *fill;
+
+    // Write-behind state, protected by lock.
+    mp_mutex lock;
+    mp_cond wakeup;
+    mp_thread thread;
+    bool thread_running;
+    bool thread_exit;
+    struct write_buffer *flush; // buffer queued for/being written, or NULL
+    struct write_buffer *spare; // written buffer that can be reused
+    bool write_failed;
+    uint64_t written_size;      // file data that was actually written
 };
 
 struct pkt_header {
@@ -77,10 +143,39 @@ struct sd_header {
     uint32_t len;
 };
 
+// Persistent cache files end with the index data (opaque to this file), the
+// key, and this footer.
+struct index_footer {
+    uint64_t index_len;
+    uint64_t key_len;
+    uint32_t padded;
+    uint32_t version;
+    char magic[8];
+};
+
+#define INDEX_MAGIC "mpvcidx\0"
+#define INDEX_VERSION 1
+
 static void cache_destroy(void *p)
 {
     struct demux_cache *cache = p;
 
+    if (cache->thread_running) {
+        mp_mutex_lock(&cache->lock);
+        cache->thread_exit = true;
+        mp_cond_broadcast(&cache->wakeup);
+        mp_mutex_unlock(&cache->lock);
+        mp_thread_join(cache->thread);
+    }
+
+    // (Packets may still reference the mappings.)
+    for (int n = 0; n < cache->num_maps; n++)
+        av_buffer_unref(&cache->maps[n]);
+
+    mp_cond_destroy(&cache->wakeup);
+    mp_mutex_destroy(&cache->lock);
+    mp_mutex_destroy(&cache->io_lock);
+
     if (cache->fd >= 0)
         close(cache->fd);
 
@@ -90,13 +185,98 @@ static void cache_destroy(void *p)
     }
 }
 
+static bool write_buffer_to_file(struct demux_cache *cache,
+                                 struct write_buffer *buf);
+
+// Write queued buffers in the background, so that slow storage doesn't block
+// the demuxer thread.
+static MP_THREAD_VOID write_thread(void *p)
+{
+    struct demux_cache *cache = p;
+    mp_thread_set_name("demux-cache");
+
+    mp_mutex_lock(&cache->lock);
+    while (1) {
+        if (cache->flush) {
+            struct write_buffer *buf = cache->flush;
+            mp_mutex_unlock(&cache->lock);
+            bool ok = write_buffer_to_file(cache, buf);
+            mp_mutex_lock(&cache->lock);
+            cache->write_failed |= !ok;
+            if (ok)
+                cache->written_size = buf->pos + buf->len;
+            cache->flush = NULL;
+            cache->spare = buf;
+            mp_cond_broadcast(&cache->wakeup);
+            continue;
+        }
+        if (cache->thread_exit)
+            break;
+        mp_cond_wait(&cache->wakeup, &cache->lock);
+    }
+    mp_mutex_unlock(&cache->lock);
+
+    MP_THREAD_RETURN();
+}
+
+// Read the index of a persistent cache file, and truncate the file to the
+// packet data. If there is no valid index for cache->key, all data is dropped.
+static void load_index(struct demux_cache *cache)
+{
+    int64_t size = lseek(cache->fd, 0, SEEK_END);
+    struct index_footer ft;
+    size_t key_len = strlen(cache->key);
+
+    if (size < (int64_t)sizeof(ft) ||
+        lseek(cache->fd, size - sizeof(ft), SEEK_SET) == (off_t)-1 ||
+        read(cache->fd, &ft, sizeof(ft)) != sizeof(ft) ||
+        memcmp(ft.magic, INDEX_MAGIC, sizeof(ft.magic)) != 0 ||
+        ft.version != INDEX_VERSION || ft.padded != cache->padded ||
+        ft.key_len != key_len || key_len > size - sizeof(ft) ||
+        ft.index_len > size - sizeof(ft) - key_len)
+        goto invalid;
+
+    uint64_t index_pos = size - sizeof(ft) - key_len - ft.index_len;
+    char *data = talloc_size(cache, ft.index_len + key_len + 1);
+    if (lseek(cache->fd, index_pos, SEEK_SET) == (off_t)-1 ||
+        read(cache->fd, data, ft.index_len + key_len) !=
+            (ssize_t)(ft.index_len + key_len) ||
+        memcmp(data + ft.index_len, cache->key, key_len) != 0)
+    {
+        talloc_free(data);
+        goto invalid;
+    }
+
+    cache->index = (bstr){data, ft.index_len};
+    cache->file_size = index_pos;
+    MP_VERBOSE(cache, "Reusing cache file %s.\n", cache->filename);
+    goto done;
+
+invalid:
+    if (size > 0)
+        MP_VERBOSE(cache, "Cache file %s can't be reused.\n", cache->filename);
+    cache->file_size = 0;
+done:
+    // Drop the index (and anything invalid); it's rewritten at the end.
+    if (ftruncate(cache->fd, cache->file_size))
+        MP_WARN(cache, "Failed to truncate cache file.\n");
+    cache->written_size = cache->file_size;
+    cache->file_pos = -1;
+}
+
 // Create a cache. This also initializes the cache file from the options. The
 // log parameter must stay valid until demux_cache is destroyed.
+// If key is not NULL and --demuxer-cache-persist is set, a persistent cache
+// file for it is used, whose index can be retrieved with
+// demux_cache_get_index(), and must be written by demux_cache_write_index().
 // Free with talloc_free().
 struct demux_cache *demux_cache_create(struct mpv_global *global,
-                                       struct mp_log *log)
+                                       struct mp_log *log, const char *key)
 {
     struct demux_cache *cache = talloc_zero(NULL, struct demux_cache);
+    mp_mutex_init(&cache->io_lock);
+    mp_mutex_init(&cache->lock);
+    mp_cond_init(&cache->wakeup);
     talloc_set_destructor(cache, cache_destroy);
     cache->opts = mp_get_config_group(cache, global, &demux_cache_conf);
     cache->log = log;
@@ -114,6 +294,32 @@ struct demux_cache *demux_cache_create(struct mpv_global *global,
         goto fail;
 
     mp_mkdirp(cache_dir);
+
+    cache->use_mmap = cache->padded = HAVE_POSIX && cache->opts->use_mmap;
+
+    if (key && cache->opts->persist) {
+        uint8_t md5[16];
+        av_md5_sum(md5, key, strlen(key));
+        char *name = talloc_strdup(NULL, "mpv-cache-");
+        for (int i = 0; i < 16; i++)
+            name = talloc_asprintf_append(name, "%02X", md5[i]);
+        name = talloc_strdup_append(name, ".dat");
+        cache->filename = mp_path_join(cache, cache_dir, name);
+        talloc_free(name);
+        talloc_free(cache_dir);
+
+        cache->fd = open(cache->filename, O_RDWR | O_CREAT | O_BINARY | O_CLOEXEC,
+                         0600);
+        if (cache->fd < 0) {
+            MP_ERR(cache, "Failed to open cache file %s.\n", cache->filename);
+            goto fail;
+        }
+        cache->persistent = true;
+        cache->key = talloc_strdup(cache, key);
+        load_index(cache);
+        goto done;
+    }
+
     cache->filename = mp_path_join(cache, cache_dir, "mpv-cache-XXXXXX.dat");
     cache->fd = mp_mkostemps(cache->filename, 4, O_CLOEXEC);
     talloc_free(cache_dir);
@@ -130,6 +336,15 @@ struct demux_cache *demux_cache_create(struct mpv_global *global,
         }
     }
 
+done:
+    cache->fill = talloc_zero(cache, struct write_buffer);
+    cache->fill->pos = cache->file_size;
+    if (mp_thread_create(&cache->thread, write_thread, cache)) {
+        MP_WARN(cache, "Failed to create cache writer thread.\n");
+    } else {
+        cache->thread_running = true;
+    }
+
     return cache;
 fail:
     talloc_free(cache);
@@ -141,6 +356,14 @@ uint64_t demux_cache_get_size(struct demux_cache *cache)
     return cache->file_size;
 }
 
+// Return the index data that was passed to demux_cache_write_index() in a
+// previous session with the same key. Empty if none, or not persistent. The
+// data is owned by the cache.
+bstr demux_cache_get_index(struct demux_cache *cache)
+{
+    return cache->index;
+}
+
 static bool do_seek(struct demux_cache *cache, uint64_t pos)
 {
     if (cache->file_pos == pos)
@@ -168,7 +391,6 @@ static bool write_raw(struct demux_cache *cache, void *ptr, size_t len)
     }
 
     cache->file_pos += res;
-    cache->file_size = MPMAX(cache->file_size, cache->file_pos);
 
     // Should never happen, unless the disk is full, or someone succeeded to
     // trick us to write into a pipe or a socket.
@@ -201,6 +423,192 @@ static bool read_raw(struct demux_cache *cache, void *ptr, size_t len)
     return true;
 }
 
+// Write the buffer contents to their position in the file. The buffer can be
+// reused afterwards.
+static bool write_buffer_to_file(struct demux_cache *cache,
+                                 struct write_buffer *buf)
+{
+    mp_mutex_lock(&cache->io_lock);
+    bool ok = do_seek(cache, buf->pos) && write_raw(cache, buf->data, buf->len);
+    mp_mutex_unlock(&cache->io_lock);
+    return ok;
+}
+
+// Hand the fill buffer to the writer thread (or write it directly if there is
+// none), and start a new one at the current end of the file. This blocks only
+// if the previous buffer is still being written.
+static bool flush_fill_buffer(struct demux_cache *cache)
+{
+    struct write_buffer *buf = cache->fill;
+    if (!buf->len)
+        return true;
+
+    if (!cache->thread_running) {
+        bool ok = write_buffer_to_file(cache, buf);
+        if (ok)
+            cache->written_size = buf->pos + buf->len;
+        buf->len = 0;
+        buf->pos = cache->file_size;
+        return ok;
+    }
+
+    mp_mutex_lock(&cache->lock);
+    while (cache->flush)
+        mp_cond_wait(&cache->wakeup, &cache->lock);
+    bool ok = !cache->write_failed;
+    cache->flush = buf;
+    struct write_buffer *next = cache->spare;
+    cache->spare = NULL;
+    mp_cond_broadcast(&cache->wakeup);
+    mp_mutex_unlock(&cache->lock);
+
+    if (!next)
+        next = talloc_zero(cache, struct write_buffer);
+    next->len = 0;
+    next->pos = cache->file_size;
+    cache->fill = next;
+    return ok;
+}
+
+static void append_raw(struct write_buffer *buf, void *ptr, size_t len)
+{
+    mp_assert(buf->len + len <= buf->size);
+    memcpy(buf->data + buf->len, ptr, len);
+    buf->len += len;
+}
+
+// Whether [pos, pos + len) is fully in buf.
+static bool buffer_contains(struct write_buffer *buf, uint64_t pos, size_t len)
+{
+    return buf && buf->len && pos >= buf->pos &&
+           pos - buf->pos <= buf->len && len <= buf->len - (pos - buf->pos);
+}
+
+#if HAVE_POSIX
+static void unmap_chunk(void *opaque, uint8_t *data)
+{
+    munmap(data, MAP_CHUNK_SIZE);
+}
+#endif
+
+// Return the mapping that contains [pos, pos + len), or NULL if the range is
+// not fully within a chunk that was completely written to the file.
+static AVBufferRef *get_map(struct demux_cache *cache, uint64_t pos, size_t len)
+{
+#if HAVE_POSIX
+    if (!cache->use_mmap)
+        return NULL;
+
+    uint64_t index = pos / MAP_CHUNK_SIZE;
+    if (len > MAP_CHUNK_SIZE - pos % MAP_CHUNK_SIZE || index > INT_MAX)
+        return NULL;
+
+    if (index < cache->num_maps && cache->maps[index])
+        return cache->maps[index];
+
+    mp_mutex_lock(&cache->lock);
+    bool written = cache->written_size >= (index + 1) * MAP_CHUNK_SIZE;
+    mp_mutex_unlock(&cache->lock);
+    if (!written)
+        return NULL;
+
+    // Writable private mapping, because packet data is not always treated
+    // as read-only by the code that receives it.
+    void *ptr = mmap(NULL, MAP_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     cache->fd, index * MAP_CHUNK_SIZE);
+    if (ptr == MAP_FAILED) {
+        MP_WARN(cache, "Failed to map cache file: %s\n", mp_strerror(errno));
+        cache->use_mmap = false;
+        return NULL;
+    }
+    AVBufferRef *map = av_buffer_create(ptr, MAP_CHUNK_SIZE, unmap_chunk, NULL, 0);
+    if (!map) {
+        munmap(ptr, MAP_CHUNK_SIZE);
+        return NULL;
+    }
+
+    while (cache->num_maps <= index)
+        MP_TARRAY_APPEND(cache, cache->maps, cache->num_maps, NULL);
+    cache->maps[index] = map;
+    return map;
+#else
+    return NULL;
+#endif
+}
+
+// Refill the read-ahead buffer with file data starting at pos (only data that
+// was already written to the file).
+static bool fill_read_ahead(struct demux_cache *cache, uint64_t pos)
+{
+    struct write_buffer *ra = cache->read_ahead;
+
+    mp_mutex_lock(&cache->lock);
+    uint64_t written = cache->written_size;
+    mp_mutex_unlock(&cache->lock);
+
+    ra->len = 0;
+    ra->pos = pos;
+    if (written <= pos)
+        return false;
+    size_t len = MPMIN(written - pos, ra->size);
+
+    mp_mutex_lock(&cache->io_lock);
+    bool ok = do_seek(cache, pos) && read_raw(cache, ra->data, len);
+    mp_mutex_unlock(&cache->io_lock);
+    if (ok)
+        ra->len = len;
+    return ok;
+}
+
+// Read data that may not have been written to the file yet.
+static bool read_at(struct demux_cache *cache, uint64_t *pos, void *ptr,
+                    size_t len)
+{
+    struct write_buffer *buf = NULL;
+    if (buffer_contains(cache->fill, *pos, len)) {
+        buf = cache->fill;
+    } else {
+        // (The writer thread only reads the buffer contents, and doesn't
+        // change the pointers, so they're stable without a lock while the
+        // caller is here.)
+        mp_mutex_lock(&cache->lock);
+        if (buffer_contains(cache->flush, *pos, len))
+            buf = cache->flush;
+        mp_mutex_unlock(&cache->lock);
+    }
+
+    if (buf) {
+        memcpy(ptr, buf->data + (*pos - buf->pos), len);
+        *pos += len;
+        return true;
+    }
+
+    AVBufferRef *map = get_map(cache, *pos, len);
+    if (map) {
+        memcpy(ptr, map->data + *pos % MAP_CHUNK_SIZE, len);
+        *pos += len;
+        return true;
+    }
+
+    struct write_buffer *ra = cache->read_ahead;
+    if (ra && len <= ra->size) {
+        if (!buffer_contains(ra, *pos, len))
+            fill_read_ahead(cache, *pos);
+        if (buffer_contains(ra, *pos, len)) {
+            memcpy(ptr, ra->data + (*pos - ra->pos), len);
+            *pos += len;
+            return true;
+        }
+    }
+
+    mp_mutex_lock(&cache->io_lock);
+    bool ok = do_seek(cache, *pos) && read_raw(cache, ptr, len);
+    mp_mutex_unlock(&cache->io_lock);
+    if (ok)
+        *pos += len;
+    return ok;
+}
+
 // Serialize a packet to the cache file. Returns the packet position, which can
 // be passed to demux_cache_read() to read the packet again.
 // Returns a negative value on errors, i.e. writing the file failed.
@@ -223,10 +631,29 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
     mp_assert(dp->avpacket->side_data_elems >= 0 &&
            dp->avpacket->side_data_elems <= INT32_MAX);
 
-    if (!do_seek(cache, cache->file_size))
+    if (cache->failed)
         return -1;
 
-    uint64_t pos = cache->file_pos;
+    size_t padding = cache->padded ? AV_INPUT_BUFFER_PADDING_SIZE : 0;
+    size_t size = sizeof(struct pkt_header) + dp->len + padding;
+    for (int n = 0; n < dp->avpacket->side_data_elems; n++)
+        size += sizeof(struct sd_header) + dp->avpacket->side_data[n].size;
+
+    struct write_buffer *buf = cache->fill;
+    if (buf->len + size > MPMAX(buf->size, WRITE_BUFFER_SIZE)) {
+        if (!flush_fill_buffer(cache)) {
+            cache->failed = true;
+            return -1;
+        }
+        buf = cache->fill;
+    }
+    if (buf->len + size > buf->size) {
+        buf->size = MPMAX(buf->len + size, WRITE_BUFFER_SIZE);
+        buf->data = talloc_realloc_size(buf, buf->data, buf->size);
+    }
+
+    uint64_t pos = cache->file_size;
+    mp_assert(pos == buf->pos + buf->len);
 
     struct pkt_header hd = {
         .data_len  = dp->len,
@@ -234,11 +661,10 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
         .num_sd = dp->avpacket->side_data_elems,
     };
 
-    if (!write_raw(cache, &hd, sizeof(hd)))
-        goto fail;
-
-    if (!write_raw(cache, dp->buffer, dp->len))
-        goto fail;
+    append_raw(buf, &hd, sizeof(hd));
+    append_raw(buf, dp->buffer, dp->len);
+    memset(buf->data + buf->len, 0, padding);
+    buf->len += padding;
 
     // The handling of FFmpeg side data requires an extra long comment to
     // explain why this code is fragile and insane.
@@ -272,44 +698,110 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
             .len = sd->size,
         };
 
-        if (!write_raw(cache, &sd_hd, sizeof(sd_hd)))
-            goto fail;
-        if (!write_raw(cache, sd->data, sd->size))
-            goto fail;
+        append_raw(buf, &sd_hd, sizeof(sd_hd));
+        append_raw(buf, sd->data, sd->size);
     }
 
+    cache->file_size += size;
+
+    if (buf->len >= WRITE_BUFFER_SIZE && !flush_fill_buffer(cache))
+        cache->failed = true;
+
     return pos;
+}
 
-fail:
-    // Reset file_size (try not to append crap forever).
-    do_seek(cache, pos);
-    cache->file_size = cache->file_pos;
-    return -1;
+// Write all pending data, and then the index for restoring the cache in a
+// later session (see demux_cache_create()). The index is appended after the
+// packet data, and must be written last. Does nothing and returns false if
+// the cache is not persistent.
+bool demux_cache_write_index(struct demux_cache *cache, void *data, size_t len)
+{
+    if (!cache->persistent || cache->failed)
+        return false;
+
+    if (!flush_fill_buffer(cache))
+        return false;
+
+    mp_mutex_lock(&cache->lock);
+    while (cache->flush)
+        mp_cond_wait(&cache->wakeup, &cache->lock);
+    bool ok = !cache->write_failed;
+    mp_mutex_unlock(&cache->lock);
+    if (!ok)
+        return false;
+
+    struct index_footer ft = {
+        .index_len = len,
+        .key_len = strlen(cache->key),
+        .padded = cache->padded,
+        .version = INDEX_VERSION,
+    };
+    memcpy(ft.magic, INDEX_MAGIC, sizeof(ft.magic));
+
+    mp_mutex_lock(&cache->io_lock);
+    ok = do_seek(cache, cache->file_size) &&
+         write_raw(cache, data, len) &&
+         write_raw(cache, cache->key, ft.key_len) &&
+         write_raw(cache, &ft, sizeof(ft));
+    mp_mutex_unlock(&cache->io_lock);
+
+    return ok;
 }
 
-struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
+// Enable or disable sequential read mode. In this mode, the file is read in
+// large pieces, which makes reading many packets in file order (like for
+// dumping the cache) much faster than reading each packet on its own.
+void demux_cache_set_sequential(struct demux_cache *cache, bool sequential)
 {
-    if (!do_seek(cache, pos))
-        return NULL;
+    if (!sequential) {
+        TA_FREEP(&cache->read_ahead);
+    } else if (!cache->read_ahead) {
+        cache->read_ahead = talloc_zero(cache, struct write_buffer);
+        cache->read_ahead->size = READ_AHEAD_SIZE;
+        cache->read_ahead->data = talloc_size(cache->read_ahead,
+                                              READ_AHEAD_SIZE);
+    }
+}
 
+struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
+{
     struct pkt_header hd;
 
-    if (!read_raw(cache, &hd, sizeof(hd)))
+    if (!read_at(cache, &pos, &hd, sizeof(hd)))
         return NULL;
 
-    struct demux_packet *dp = new_demux_packet(cache->packet_pool, hd.data_len);
-    if (!dp)
-        goto fail;
+    struct demux_packet *dp = NULL;
+    size_t padding = cache->padded ? AV_INPUT_BUFFER_PADDING_SIZE : 0;
+
+    AVBufferRef *map = get_map(cache, pos, hd.data_len + padding);
+    if (map) {
+        // Reference the payload in the mapping directly (padding included).
+        AVBufferRef *ref = av_buffer_ref(map);
+        if (ref) {
+            ref->data += pos % MAP_CHUNK_SIZE;
+            ref->size = hd.data_len;
+            dp = new_demux_packet_from_buf(cache->packet_pool, ref);
+            av_buffer_unref(&ref);
+        }
+        if (!dp)
+            goto fail;
+        pos += hd.data_len;
+    } else {
+        dp = new_demux_packet(cache->packet_pool, hd.data_len);
+        if (!dp)
+            goto fail;
 
-    if (!read_raw(cache, dp->buffer, dp->len))
-        goto fail;
+        if (!read_at(cache, &pos, dp->buffer, dp->len))
+            goto fail;
+    }
+    pos += padding;
 
     dp->avpacket->flags = hd.av_flags;
 
     for (uint32_t n = 0; n < hd.num_sd; n++) {
         struct sd_header sd_hd;
 
-        if (!read_raw(cache, &sd_hd, sizeof(sd_hd)))
+        if (!read_at(cache, &pos, &sd_hd, sizeof(sd_hd)))
             goto fail;
 
         if (sd_hd.len > INT_MAX)
@@ -320,7 +812,7 @@ struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
         if (!sd)
             goto fail;
 
-        if (!read_raw(cache, sd, sd_hd.len))
+        if (!read_at(cache, &pos, sd, sd_hd.len))
             goto fail;
     }
 
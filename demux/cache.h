@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "misc/bstr.h"
+
 struct demux_packet;
 struct mp_log;
 struct mpv_global;
@@ -9,8 +13,11 @@ struct mpv_global;
 struct demux_cache;
 
 struct demux_cache *demux_cache_create(struct mpv_global *global,
-                                       struct mp_log *log);
+                                       struct mp_log *log, const char *key);
 
 int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *pkt);
 struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos);
+void demux_cache_set_sequential(struct demux_cache *cache, bool sequential);
 uint64_t demux_cache_get_size(struct demux_cache *cache);
+bstr demux_cache_get_index(struct demux_cache *cache);
+bool demux_cache_write_index(struct demux_cache *cache, void *data, size_t len);
@@ -27,6 +27,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <libavutil/buffer.h>
+
 #include "cache.h"
 #include "config.h"
 #include "options/m_config.h"
@@ -45,6 +47,7 @@
 #include "stream/stream.h"
 #include "demux.h"
 #include "packet_pool.h"
+#include "probe_cache.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
@@ -68,6 +71,7 @@ extern const demuxer_desc_t demuxer_desc_sbr;
 #endif
 extern const demuxer_desc_t demuxer_desc_null;
 extern const demuxer_desc_t demuxer_desc_timeline;
+extern const demuxer_desc_t demuxer_desc_fanout;
 
 static const demuxer_desc_t *const demuxer_list[] = {
     &demuxer_desc_directory,
@@ -107,6 +111,21 @@ const struct m_sub_options demux_conf = {
         {"demuxer-max-back-bytes", OPT_BYTE_SIZE(max_bytes_bw),
             M_RANGE(0, M_MAX_MEM_BYTES)},
         {"demuxer-donate-buffer", OPT_BOOL(donate_fw)},
+        {"demuxer-min-back-bytes-video", OPT_BYTE_SIZE(min_back_bytes[STREAM_VIDEO]),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"demuxer-min-back-bytes-audio", OPT_BYTE_SIZE(min_back_bytes[STREAM_AUDIO]),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"demuxer-min-back-bytes-sub", OPT_BYTE_SIZE(min_back_bytes[STREAM_SUB]),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"demuxer-packet-arena", OPT_BOOL(packet_arena)},
+        {"demuxer-cache-compress", OPT_BOOL(cache_compress)},
+        {"demuxer-cache-unselected", OPT_CHOICE(cache_unselected,
+            {"no", 0}, {"audio", 1 << STREAM_AUDIO}, {"sub", 1 << STREAM_SUB},
+            {"all", (1 << STREAM_AUDIO) | (1 << STREAM_SUB)})},
+        {"demuxer-cache-unselected-bytes", OPT_BYTE_SIZE(cache_unselected_bytes),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"demuxer-segment-prefetch", OPT_INT(segment_prefetch), M_RANGE(0, 16)},
+        {"demuxer-seek-prefetch", OPT_DOUBLE(seek_prefetch), M_RANGE(0, DBL_MAX)},
         {"force-seekable", OPT_BOOL(force_seekable)},
         {"cache-secs", OPT_DOUBLE(min_secs_cache), M_RANGE(0, DBL_MAX)},
         {"access-references", OPT_BOOL(access_references)},
@@ -115,6 +134,7 @@ const struct m_sub_options demux_conf = {
         {"index", OPT_CHOICE(index_mode, {"default", 1}, {"recreate", 0})},
         {"mf-fps", OPT_DOUBLE(mf_fps)},
         {"mf-type", OPT_STRING(mf_type)},
+        {"mf-readahead", OPT_INT(mf_readahead), M_RANGE(0, 64)},
         {"sub-create-cc-track", OPT_BOOL(create_ccs)},
         {"stream-record", OPT_STRING(record_file)},
         {"video-backward-overlap", OPT_CHOICE(video_back_preroll, {"auto", -1}),
@@ -128,6 +148,7 @@ const struct m_sub_options demux_conf = {
         {"demuxer-backward-playback-step", OPT_DOUBLE(back_seek_size),
             M_RANGE(0, DBL_MAX)},
         {"metadata-codepage", OPT_STRING(meta_cp)},
+        {"demuxer-probe-cache", OPT_BOOL(probe_cache)},
         {"autocreate-playlist", OPT_CHOICE(autocreate_playlist,
             {"no", 0}, {"filter", 1}, {"same", 2})},
         {0}
@@ -147,6 +168,7 @@ const struct m_sub_options demux_conf = {
         .video_back_preroll = -1,
         .audio_back_preroll = -1,
         .back_seek_size = 60,
+        .cache_unselected_bytes = 8 * 1024 * 1024,
         .back_batch = {
             [STREAM_VIDEO] = 1,
             [STREAM_AUDIO] = 10,
@@ -156,11 +178,15 @@ const struct m_sub_options demux_conf = {
     .get_sub_options = get_demux_sub_opts,
 };
 
+// Number of queued demux_add_seek_hint() targets; older ones are dropped.
+#define MAX_SEEK_HINTS 16
+
 struct demux_internal {
     struct mp_log *log;
     struct mpv_global *global;
     struct demux_packet_pool *packet_pool;
     struct stats_ctx *stats;
+    struct stats_handle *stats_read;
 
     bool can_cache;             // not a slave demuxer; caching makes sense
     bool can_record;            // stream recording is allowed
@@ -184,6 +210,15 @@ struct demux_internal {
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
 
+    // One-shot callback, see demux_set_buffer_notify().
+    void (*buffer_notify_cb)(void *ctx);
+    void *buffer_notify_ctx;
+    uint64_t buffer_notify_bytes;
+
+    // See demux_set_prefetch_keyframes().
+    int prefetch_keyframes;
+    bool prefetch_limited;
+
     struct sh_stream **streams;
     int num_streams;
 
@@ -256,18 +291,40 @@ struct demux_internal {
     // This is can be NULL during initialization or deinitialization.
     struct demux_cached_range *current_range;
 
+    // Range being filled by prefetch_seek_hint() (NULL if none). It's not
+    // read from, and packets are appended to it instead of current_range.
+    struct demux_cached_range *prefetch_range;
+    // Likely future seek targets (demux_add_seek_hint()), most recent last.
+    double seek_hints[MAX_SEEK_HINTS];
+    int num_seek_hints;
+
+    // The persistent cache file has an index that wasn't restored yet (see
+    // restore_cache_index()).
+    bool cache_index_pending;
+
     double highest_av_pts;      // highest non-subtitle PTS seen - for duration
 
     bool blocked;
+    atomic_bool blocked_nolock; // copy of blocked for the lock-free read path
+    _Atomic double ts_offset_nolock; // copy of ts_offset for the same
 
     // Transient state.
     double duration;
+    // Attachments set with demux_attachments_changed() (owned by d_thread).
+    struct demux_attachment *attachments;
+    int num_attachments;
     // Cached state.
     int64_t stream_size;
     int64_t last_speed_query;
     double speed_query_prev_sample;
     uint64_t bytes_per_second;
     int64_t next_cache_update;
+    // Seek ranges as last returned by demux_get_reader_state(), and a counter
+    // that is incremented whenever they differ from the previous call.
+    struct demux_seek_range last_seek_ranges[MAX_SEEK_RANGES];
+    int num_last_seek_ranges;
+    bool last_bof_cached, last_eof_cached;
+    uint64_t seek_ranges_gen;
 
     // demux user state (user thread, somewhat similar to reader/decoder state)
     double last_playback_pts;   // last playback_pts from demux_update()
@@ -286,6 +343,7 @@ struct demux_internal {
     int64_t hack_unbuffered_read_bytes;  // for demux_get_bytes_read_hack()
     int64_t cache_unbuffered_read_bytes; // for demux_reader_state.bytes_per_second
     int64_t byte_level_seeks;            // for demux_reader_state.byte_level_seeks
+    int stream_buffer_size;              // for demux_reader_state.stream_buffer_size
 };
 
 struct timed_metadata {
@@ -310,8 +368,15 @@ struct demux_cached_range {
 
     struct timed_metadata **metadata;
     int num_metadata;
+
+    // Shared payload storage for small packets (--demuxer-packet-arena).
+    struct AVBufferRef *slab;
+    size_t slab_used;
 };
 
+// Size of a single payload slab for --demuxer-packet-arena.
+#define PACKET_SLAB_SIZE (4 * 1024 * 1024)
+
 #define QUEUE_INDEX_SIZE_MASK(queue) ((queue)->index_size - 1)
 
 // Access the idx-th entry in the given demux_queue.
@@ -320,8 +385,11 @@ struct demux_cached_range {
     ((queue)->index[((queue)->index0 + (idx)) & QUEUE_INDEX_SIZE_MASK(queue)])
 
 // Don't index packets whose timestamps that are within the last index entry by
-// this amount of time (it's better to seek them manually).
-#define INDEX_STEP_SIZE 1.0
+// this amount of time (it's better to seek them manually). This is small enough
+// that practically every video keyframe is indexed, so a cache seek is a binary
+// search plus a scan of a single GOP, while streams where every packet is a
+// keyframe (like audio) still get an index of bounded density.
+#define INDEX_STEP_SIZE 0.25
 
 struct index_entry {
     double pts;
@@ -363,8 +431,22 @@ struct demux_queue {
     size_t index_size;          // size of index[] (0 or a power of 2)
     size_t index0;              // first index entry
     size_t num_index;           // number of index entries (wraps on index_size)
+
+    // --demuxer-cache-compress
+    struct demux_packet *pack_last; // last packet considered (NULL: none)
+    uint64_t packed_saved;      // sum of demux_packet_compressed_saving()
 };
 
+// Compress at most this many bytes per pass over the cache, so the lock isn't
+// held for too long.
+#define PACK_BYTES_PER_PASS (64 * 1024)
+// Give up compressing a stream after this many packets failed to compress.
+#define PACK_MAX_FAILURES 32
+
+// Number of dequeued packets that can be handed to a reader without locking.
+// Must be a power of 2.
+#define PACKET_RING_SIZE 16
+
 struct demux_stream {
     struct demux_internal *in;
     struct sh_stream *sh;   // ds->sh->ds == ds
@@ -401,6 +483,26 @@ struct demux_stream {
     bool attached_picture_added;
     bool need_wakeup;       // call wakeup_cb on next reader_head state change
     double force_read_until;// eager=false streams (subs): force read-ahead
+    bool ring_active;       // reader is using the ring below
+
+    // Packets demuxed while the stream is unselected, kept for instant track
+    // switches (--demuxer-cache-unselected). Not part of the seekable cache.
+    bool passive;           // keep packets while unselected
+    struct demux_packet *passive_head, *passive_tail;
+    size_t passive_bytes;
+    double passive_start_ts;// no packets are missing after this ts
+
+    // Packets already dequeued by the reader (with in->lock held), which it
+    // can take later without locking. Pushed by the reader with the lock held,
+    // popped by the reader without it; other threads holding the lock only
+    // invalidate the ring. Packets pushed with a ring_gen other than the
+    // current one are stale and discarded by the reader.
+    // These fields are not protected by in->lock; see ring_push()/ring_pop().
+    struct demux_packet *ring[PACKET_RING_SIZE];
+    unsigned ring_pkt_gen[PACKET_RING_SIZE];
+    double ring_pkt_offset[PACKET_RING_SIZE]; // ts_offset applied to the packet
+    atomic_uint ring_wpos, ring_rpos;
+    atomic_uint ring_gen;
 
     // For demux_internal.dumper. Currently, this is used only temporarily
     // during blocking dumping.
@@ -421,6 +523,8 @@ struct demux_stream {
     bool back_restarting;   // searching keyframe before restart pos
     // Current PTS lower bound for back demuxing.
     double back_seek_pos;
+    // Amount to decrease back_seek_pos by on the next low level backstep.
+    double back_seek_step;
     // pos/dts of the packet to resume demuxing from when another stream caused
     // a seek backward to get more packets. reader_head will be reset to this
     // packet as soon as it's encountered again.
@@ -439,6 +543,7 @@ struct demux_stream {
     // for closed captions (demuxer_feed_caption)
     struct sh_stream *cc;
     bool ignore_eof;        // ignore stream in underrun detection
+    int pack_failures;      // consecutive packets that didn't compress
 };
 
 static void switch_to_fresh_cache_range(struct demux_internal *in);
@@ -447,6 +552,7 @@ static MP_THREAD_VOID demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
 static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp);
 static struct demux_packet *advance_reader_head(struct demux_stream *ds);
+static struct demux_packet *ring_pop(struct demux_stream *ds);
 static bool queue_seek(struct demux_internal *in, double seek_pts, int flags,
                        bool clear_back_state);
 static struct demux_packet *compute_keyframe_times(struct demux_packet *pkt,
@@ -457,6 +563,8 @@ static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags);
 static void prune_old_packets(struct demux_internal *in);
 static void dumper_close(struct demux_internal *in);
+static void write_cache_index(struct demux_internal *in);
+static void restore_cache_index(struct demux_internal *in);
 static void demux_convert_tags_charset(struct demuxer *demuxer);
 
 static uint64_t get_forward_buffered_bytes(struct demux_stream *ds)
@@ -700,7 +808,11 @@ static void remove_head_packet(struct demux_queue *queue)
     queue->is_bof = false;
 
     uint64_t end_pos = dp->next ? dp->next->cum_pos : queue->tail_cum_pos;
-    queue->ds->in->total_bytes -= end_pos - dp->cum_pos;
+    size_t saved = demux_packet_compressed_saving(dp);
+    queue->ds->in->total_bytes -= end_pos - dp->cum_pos - saved;
+    queue->packed_saved -= saved;
+    if (queue->pack_last == dp)
+        queue->pack_last = NULL;
 
     if (queue->num_index && queue->index[queue->index0].pkt == dp) {
         queue->index0 = (queue->index0 + 1) & QUEUE_INDEX_SIZE_MASK(queue);
@@ -731,8 +843,12 @@ static void clear_queue(struct demux_queue *queue)
     struct demux_stream *ds = queue->ds;
     struct demux_internal *in = ds->in;
 
-    if (queue->head)
-        in->total_bytes -= queue->tail_cum_pos - queue->head->cum_pos;
+    if (queue->head) {
+        in->total_bytes -= queue->tail_cum_pos - queue->head->cum_pos -
+                           queue->packed_saved;
+    }
+    queue->packed_saved = 0;
+    queue->pack_last = NULL;
 
     free_index(queue);
 
@@ -761,6 +877,10 @@ static void clear_cached_range(struct demux_internal *in,
         talloc_free(range->metadata[n]);
     range->num_metadata = 0;
 
+    // Packets still referenced by readers keep the slab alive.
+    av_buffer_unref(&range->slab);
+    range->slab_used = 0;
+
     update_seek_ranges(range);
 }
 
@@ -782,6 +902,8 @@ static void free_empty_cached_ranges(struct demux_internal *in)
 
         for (int n = end; n >= 0; n--) {
             struct demux_cached_range *range = in->ranges[n];
+            if (range == in->prefetch_range)
+                continue;
             if (range->seek_start == MP_NOPTS_VALUE || !in->seekable_cache) {
                 clear_cached_range(in, range);
                 MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, n);
@@ -807,6 +929,15 @@ static void ds_clear_reader_queue_state(struct demux_stream *ds)
     ds->reader_head = NULL;
     ds->eof = false;
     ds->need_wakeup = true;
+    // Invalidate packets the reader hasn't taken from the ring yet.
+    atomic_fetch_add(&ds->ring_gen, 1);
+    ds->ring_active = false;
+}
+
+static void set_blocked(struct demux_internal *in, bool block)
+{
+    in->blocked = block;
+    atomic_store(&in->blocked_nolock, block);
 }
 
 static void ds_clear_reader_state(struct demux_stream *ds,
@@ -830,6 +961,7 @@ static void ds_clear_reader_state(struct demux_stream *ds,
         ds->back_restart_next = ds->in->back_demuxing;
         ds->back_restarting = ds->in->back_demuxing && ds->eager;
         ds->back_seek_pos = MP_NOPTS_VALUE;
+        ds->back_seek_step = ds->in->d_user->opts->back_seek_size;
         ds->back_resume_pos = -1;
         ds->back_resume_dts = MP_NOPTS_VALUE;
         ds->back_resuming = false;
@@ -839,6 +971,67 @@ static void ds_clear_reader_state(struct demux_stream *ds,
     }
 }
 
+static void clear_passive_packets(struct demux_stream *ds)
+{
+    demux_packet_pool_prepend(ds->in->packet_pool, ds->passive_head,
+                              ds->passive_tail);
+    ds->passive_head = ds->passive_tail = NULL;
+    ds->passive_bytes = 0;
+    ds->passive_start_ts = MP_NOPTS_VALUE;
+}
+
+// Append a packet of an unselected stream, dropping the oldest packets if the
+// --demuxer-cache-unselected-bytes budget is exceeded.
+static void add_passive_packet(struct demux_stream *ds, struct demux_packet *dp)
+{
+    struct demux_internal *in = ds->in;
+
+    if (ds->passive_tail) {
+        ds->passive_tail->next = dp;
+    } else {
+        ds->passive_head = dp;
+        ds->passive_start_ts = MP_PTS_OR_DEF(dp->dts, dp->pts);
+    }
+    ds->passive_tail = dp;
+    ds->passive_bytes += demux_packet_estimate_total_size(dp);
+
+    size_t max_bytes = in->d_user->opts->cache_unselected_bytes;
+    while (ds->passive_head && ds->passive_bytes > max_bytes) {
+        struct demux_packet *old = ds->passive_head;
+        ds->passive_head = old->next;
+        if (!ds->passive_head)
+            ds->passive_tail = NULL;
+        old->next = NULL;
+        ds->passive_bytes -= demux_packet_estimate_total_size(old);
+        demux_packet_pool_push(in->packet_pool, old);
+
+        struct demux_packet *head = ds->passive_head;
+        ds->passive_start_ts =
+            head ? MP_PTS_OR_DEF(head->dts, head->pts) : MP_NOPTS_VALUE;
+    }
+}
+
+// Decide which unselected streams keep packets. The demuxer implementation
+// has to be told if this changes, because it must not discard these streams.
+static void update_passive_streams(struct demux_internal *in)
+{
+    int types = in->d_user->opts->cache_unselected;
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+
+        bool passive = !ds->selected && !ds->sh->attached_picture &&
+                       in->can_cache && (types & (1 << ds->type));
+        if (passive != ds->passive)
+            in->tracks_switched = true;
+        ds->passive = passive;
+
+        // (Packets of a newly selected stream are used by refresh_track().)
+        if (!passive && !ds->selected)
+            clear_passive_packets(ds);
+    }
+}
+
 // called locked, from user thread only
 static void clear_reader_state(struct demux_internal *in,
                                bool clear_back_state)
@@ -847,7 +1040,7 @@ static void clear_reader_state(struct demux_internal *in,
         ds_clear_reader_state(in->streams[n]->ds, clear_back_state);
     in->warned_queue_overflow = false;
     in->d_user->filepos = -1; // implicitly synchronized
-    in->blocked = false;
+    set_blocked(in, false);
     in->need_back_seek = false;
 }
 
@@ -900,8 +1093,10 @@ static void update_stream_selection_state(struct demux_internal *in,
         }
     }
 
+    update_passive_streams(in);
+
     if (!any_streams)
-        in->blocked = false;
+        set_blocked(in, false);
 
     ds_clear_reader_state(ds, true);
 
@@ -909,6 +1104,9 @@ static void update_stream_selection_state(struct demux_internal *in,
     // ranges, and also get rid of data that is not needed anymore (or
     // rather, which can't be kept consistent). This has to happen after we've
     // updated all the subtle state (like s->eager).
+    if (ds->selected && in->cache_index_pending)
+        restore_cache_index(in);
+
     for (int n = 0; n < in->num_ranges; n++) {
         struct demux_cached_range *range = in->ranges[n];
 
@@ -928,6 +1126,7 @@ void demux_set_ts_offset(struct demuxer *demuxer, double offset)
     struct demux_internal *in = demuxer->in;
     mp_mutex_lock(&in->lock);
     in->ts_offset = offset;
+    atomic_store(&in->ts_offset_nolock, offset);
     mp_mutex_unlock(&in->lock);
 }
 
@@ -986,6 +1185,7 @@ static void demux_add_sh_stream_locked(struct demux_internal *in,
         .index = sh->index,
         .global_correct_dts = true,
         .global_correct_pos = true,
+        .passive_start_ts = MP_NOPTS_VALUE,
     };
 
     struct demux_stream *ds = sh->ds;
@@ -1088,6 +1288,8 @@ static void demux_shutdown(struct demux_internal *in)
     demuxer->priv = NULL;
     in->d_thread->priv = NULL;
 
+    write_cache_index(in);
+
     demux_flush(demuxer);
     mp_assert(in->total_bytes == 0);
 
@@ -1104,8 +1306,12 @@ static void demux_shutdown(struct demux_internal *in)
 
 static void demux_dealloc(struct demux_internal *in)
 {
-    for (int n = 0; n < in->num_streams; n++)
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_packet *pkt;
+        while ((pkt = ring_pop(in->streams[n]->ds)))
+            talloc_free(pkt);
         talloc_free(in->streams[n]);
+    }
     mp_mutex_destroy(&in->lock);
     mp_cond_destroy(&in->wakeup);
     talloc_free(in->d_user);
@@ -1250,6 +1456,64 @@ void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *c
     mp_mutex_unlock(&in->lock);
 }
 
+static void buffer_notify(struct demux_internal *in)
+{
+    if (in->buffer_notify_cb) {
+        in->buffer_notify_cb(in->buffer_notify_ctx);
+        in->buffer_notify_cb = NULL;
+    }
+}
+
+// Call cb(ctx) once from the demuxer thread, as soon as the forward buffered
+// bytes reach at least fw_bytes, EOF is reached, the prefetch limit set with
+// demux_set_prefetch_keyframes() is reached, or prefetching stops because the
+// buffer is full. cb==NULL disarms it. The
+// callback is invoked with internal locks held, so it must only do something
+// like waking up the caller's thread, which then can check the state with
+// demux_get_reader_state(). Note that if the condition is already true when
+// this is called, cb will be called only on the next read attempt.
+void demux_set_buffer_notify(struct demuxer *demuxer, int64_t fw_bytes,
+                             void (*cb)(void *ctx), void *ctx)
+{
+    struct demux_internal *in = demuxer->in;
+    mp_mutex_lock(&in->lock);
+    in->buffer_notify_cb = cb;
+    in->buffer_notify_ctx = ctx;
+    in->buffer_notify_bytes = MPMAX(fw_bytes, 0);
+    if (cb && in->eof)
+        buffer_notify(in);
+    mp_mutex_unlock(&in->lock);
+}
+
+// Limit prefetching to the first num GOPs after the current reader position
+// (i.e. stop once the keyframe following them was read), or disable the limit
+// with num==0. This is independent from the byte and time limits. Reaching the
+// limit also triggers the demux_set_buffer_notify() callback, and is reported
+// as demux_reader_state.prefetch_limited.
+void demux_set_prefetch_keyframes(struct demuxer *demuxer, int num)
+{
+    struct demux_internal *in = demuxer->in;
+    mp_assert(demuxer == in->d_user);
+
+    mp_mutex_lock(&in->lock);
+    in->prefetch_keyframes = MPMAX(num, 0);
+    in->prefetch_limited = false;
+    in->reading = true;
+    mp_cond_signal(&in->wakeup);
+    mp_mutex_unlock(&in->lock);
+}
+
+// Make the demuxer thread pick up changed options (from the mpv_global it was
+// created with) now, instead of on the next time it happens to wake up.
+// Reducing the cache size prunes the cached data accordingly.
+void demux_update_opts(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    mp_mutex_lock(&in->lock);
+    mp_cond_signal(&in->wakeup);
+    mp_mutex_unlock(&in->lock);
+}
+
 void demux_start_prefetch(struct demuxer *demuxer)
 {
     struct demux_internal *in = demuxer->in;
@@ -1524,6 +1788,7 @@ static void find_backward_restart_pos(struct demux_stream *ds)
     compute_keyframe_times(target, &seek_pts, NULL);
     if (seek_pts != MP_NOPTS_VALUE)
         ds->back_seek_pos = seek_pts;
+    ds->back_seek_step = in->d_user->opts->back_seek_size;
 
     // For next backward adjust action.
     struct demux_packet *restart_pkt = NULL;
@@ -1582,7 +1847,12 @@ resume_earlier:
             in->back_any_need_recheck = true;
             mp_cond_signal(&in->wakeup);
         } else {
-            ds->back_seek_pos -= in->d_user->opts->back_seek_size;
+            // If this happens again before a target was found, the previous
+            // step didn't go back far enough (e.g. GOPs longer than the step).
+            // Grow the step, so the same packets aren't demuxed over and over
+            // in many small steps.
+            ds->back_seek_pos -= ds->back_seek_step;
+            ds->back_seek_step = MPMAX(ds->back_seek_step * 2, 1.0);
             in->need_back_seek = true;
         }
     }
@@ -1800,6 +2070,10 @@ static void attempt_range_joining(struct demux_internal *in)
         q2->keyframe_first = NULL;
         q2->keyframe_latest = NULL;
 
+        q1->packed_saved += q2->packed_saved;
+        q2->packed_saved = 0;
+        q2->pack_last = NULL;
+
         if (ds->selected && !ds->reader_head)
             ds->reader_head = join_point;
         ds->skip_to_keyframe = false;
@@ -1891,10 +2165,9 @@ static struct demux_packet *compute_keyframe_times(struct demux_packet *pkt,
 // starting output at non-keyframes.
 // Can join seek ranges, which messes with in->current_range and all.
 static void adjust_seek_range_on_packet(struct demux_stream *ds,
+                                        struct demux_queue *queue,
                                         struct demux_packet *dp)
 {
-    struct demux_queue *queue = ds->queue;
-
     if (!ds->in->seekable_cache)
         return;
 
@@ -1941,7 +2214,8 @@ static void adjust_seek_range_on_packet(struct demux_stream *ds,
     // Adding a sparse packet never changes the seek range.
     if (update_ranges && ds->eager) {
         update_seek_ranges(queue->range);
-        attempt_range_joining(ds->in);
+        if (queue->range == ds->in->current_range)
+            attempt_range_joining(ds->in);
     }
 }
 
@@ -2016,6 +2290,321 @@ static void record_packet(struct demux_internal *in, struct demux_packet *dp)
         write_dump_packet(in, dp);
 }
 
+// Move the packet data to the disk cache or the range's arena, if enabled.
+static void store_packet_data(struct demux_internal *in,
+                              struct demux_queue *queue,
+                              struct demux_packet *dp)
+{
+    if (in->cache && in->d_user->opts->disk_cache && !dp->is_wrapped_avframe) {
+        int64_t pos = demux_cache_write(in->cache, dp);
+        if (pos >= 0) {
+            demux_packet_unref_contents(dp);
+            dp->is_cached = true;
+            dp->cached_data.pos = pos;
+        }
+    }
+
+    if (!dp->is_cached && in->d_user->opts->packet_arena) {
+        demux_packet_pack(dp, &queue->range->slab, &queue->range->slab_used,
+                          PACKET_SLAB_SIZE);
+    }
+}
+
+// Link dp to the end of a queue that is not being read from.
+static void append_queue_packet(struct demux_internal *in,
+                                struct demux_queue *queue,
+                                struct demux_packet *dp)
+{
+    queue->correct_pos &= dp->pos >= 0 && dp->pos > queue->last_pos;
+    queue->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > queue->last_dts;
+    queue->last_pos = dp->pos;
+    queue->last_dts = dp->dts;
+
+    size_t bytes = demux_packet_estimate_total_size(dp);
+    in->total_bytes += bytes;
+    dp->cum_pos = queue->tail_cum_pos;
+    queue->tail_cum_pos += bytes;
+
+    if (queue->tail) {
+        queue->tail->next = dp;
+        queue->tail = dp;
+    } else {
+        queue->head = queue->tail = dp;
+    }
+}
+
+// Append a packet read by prefetch_seek_hint() to in->prefetch_range. This
+// is a reduced add_packet_locked(): the range is not read from, so no reader
+// state is touched.
+static void add_prefetch_packet(struct demux_stream *ds, struct demux_packet *dp)
+{
+    struct demux_internal *in = ds->in;
+    struct demux_queue *queue = in->prefetch_range->streams[ds->index];
+
+    if (!ds->selected || in->seeking || ds->sh->attached_picture) {
+        demux_packet_pool_push(in->packet_pool, dp);
+        return;
+    }
+
+    if ((dp->pos < 0 || dp->pos == queue->last_pos_fixup) &&
+        !dp->keyframe && queue->last_pos_fixup >= 0)
+        dp->pos = queue->last_pos_fixup + 1;
+    queue->last_pos_fixup = dp->pos;
+
+    store_packet_data(in, queue, dp);
+    append_queue_packet(in, queue, dp);
+
+    if (ds->type != STREAM_VIDEO && dp->pts == MP_NOPTS_VALUE)
+        dp->pts = dp->dts;
+
+    double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+    if (ts != MP_NOPTS_VALUE)
+        in->demux_ts = ts;
+    if (ts != MP_NOPTS_VALUE && (ts > queue->last_ts || ts + 10 < queue->last_ts))
+        queue->last_ts = ts;
+
+    adjust_seek_range_on_packet(ds, queue, dp);
+
+    prune_old_packets(in);
+}
+
+// Index of the cached ranges, stored in a persistent disk cache file (see
+// demux_cache_write_index()). This is a plain memory dump of these structs:
+//  - cache_index_header
+//  - for each stream: cache_index_stream, followed by the codec name
+//  - for each range: cache_index_range, and for each stream a uint64_t packet
+//    count followed by the cache_index_packet entries
+struct cache_index_header {
+    uint32_t num_streams;
+    uint32_t num_ranges;
+};
+
+struct cache_index_stream {
+    uint32_t type;
+    uint32_t codec_len;
+};
+
+struct cache_index_range {
+    uint32_t is_bof;
+    uint32_t is_eof;
+};
+
+struct cache_index_packet {
+    double pts, dts, duration;
+    int64_t pos;
+    uint64_t cache_pos;
+    uint32_t keyframe;
+    uint32_t pad;
+};
+
+static void index_append(void *ta_ctx, bstr *buf, void *data, size_t len)
+{
+    bstr_xappend(ta_ctx, buf, (bstr){data, len});
+}
+
+static bool index_read(bstr *buf, void *data, size_t len)
+{
+    if (buf->len < len)
+        return false;
+    memcpy(data, buf->start, len);
+    *buf = bstr_cut(*buf, len);
+    return true;
+}
+
+// Only ranges whose packets are all in the cache file can be restored.
+static bool range_is_persistable(struct demux_cached_range *range)
+{
+    if (range->seek_start == MP_NOPTS_VALUE)
+        return false;
+
+    for (int n = 0; n < range->num_streams; n++) {
+        for (struct demux_packet *dp = range->streams[n]->head; dp; dp = dp->next)
+        {
+            if (!dp->is_cached || dp->segmented)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Write the index for restoring the cached ranges with the next instance of
+// this demuxer (--demuxer-cache-persist).
+static void write_cache_index(struct demux_internal *in)
+{
+    if (!in->cache || !in->seekable_cache)
+        return;
+
+    void *ta_ctx = talloc_new(NULL);
+    bstr buf = {0};
+
+    int num_ranges = 0;
+    for (int n = 0; n < in->num_ranges; n++)
+        num_ranges += range_is_persistable(in->ranges[n]);
+
+    struct cache_index_header hdr = {
+        .num_streams = in->num_streams,
+        .num_ranges = num_ranges,
+    };
+    index_append(ta_ctx, &buf, &hdr, sizeof(hdr));
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct sh_stream *sh = in->streams[n];
+        const char *codec = sh->codec->codec ? sh->codec->codec : "";
+        struct cache_index_stream st = {
+            .type = sh->type,
+            .codec_len = strlen(codec),
+        };
+        index_append(ta_ctx, &buf, &st, sizeof(st));
+        index_append(ta_ctx, &buf, (void *)codec, st.codec_len);
+    }
+
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (!range_is_persistable(range))
+            continue;
+
+        struct cache_index_range r = {
+            .is_bof = range->is_bof,
+            .is_eof = range->is_eof,
+        };
+        index_append(ta_ctx, &buf, &r, sizeof(r));
+
+        for (int i = 0; i < in->num_streams; i++) {
+            struct demux_queue *queue =
+                i < range->num_streams ? range->streams[i] : NULL;
+            uint64_t count = 0;
+            for (struct demux_packet *dp = queue ? queue->head : NULL; dp;
+                 dp = dp->next)
+                count++;
+            index_append(ta_ctx, &buf, &count, sizeof(count));
+
+            for (struct demux_packet *dp = queue ? queue->head : NULL; dp;
+                 dp = dp->next)
+            {
+                struct cache_index_packet ip = {
+                    .pts = dp->pts,
+                    .dts = dp->dts,
+                    .duration = dp->duration,
+                    .pos = dp->pos,
+                    .cache_pos = dp->cached_data.pos,
+                    .keyframe = dp->keyframe,
+                };
+                index_append(ta_ctx, &buf, &ip, sizeof(ip));
+            }
+        }
+    }
+
+    if (demux_cache_write_index(in->cache, buf.start, buf.len)) {
+        MP_VERBOSE(in, "Wrote cache index with %d ranges.\n", num_ranges);
+    } else {
+        MP_WARN(in, "Failed to write cache index.\n");
+    }
+
+    talloc_free(ta_ctx);
+}
+
+static bool restore_cached_range(struct demux_internal *in, bstr *buf)
+{
+    struct cache_index_range r;
+    if (!index_read(buf, &r, sizeof(r)))
+        return false;
+
+    struct demux_cached_range *range = talloc_ptrtype(NULL, range);
+    *range = (struct demux_cached_range){
+        .seek_start = MP_NOPTS_VALUE,
+        .seek_end = MP_NOPTS_VALUE,
+    };
+    // (current_range must stay the last entry)
+    MP_TARRAY_INSERT_AT(in, in->ranges, in->num_ranges, in->num_ranges - 1,
+                        range);
+    add_missing_streams(in, range);
+
+    uint64_t cache_size = demux_cache_get_size(in->cache);
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        struct demux_queue *queue = range->streams[n];
+
+        uint64_t count;
+        if (!index_read(buf, &count, sizeof(count)))
+            return false;
+
+        queue->is_bof = r.is_bof;
+
+        for (uint64_t i = 0; i < count; i++) {
+            struct cache_index_packet ip;
+            if (!index_read(buf, &ip, sizeof(ip)) || ip.cache_pos >= cache_size)
+                return false;
+
+            struct demux_packet *dp = new_demux_packet(in->packet_pool, 0);
+            if (!dp)
+                return false;
+            demux_packet_unref_contents(dp);
+            dp->is_cached = true;
+            dp->cached_data.pos = ip.cache_pos;
+            dp->pts = ip.pts;
+            dp->dts = ip.dts;
+            dp->duration = ip.duration;
+            dp->pos = ip.pos;
+            dp->keyframe = ip.keyframe;
+            dp->stream = ds->index;
+
+            append_queue_packet(in, queue, dp);
+            adjust_seek_range_on_packet(ds, queue, dp);
+        }
+
+        // Incomplete keyframe ranges at the end stay excluded, as they were
+        // when the index was written.
+        if (r.is_eof)
+            adjust_seek_range_on_packet(ds, queue, NULL);
+    }
+
+    return true;
+}
+
+// Add the cached ranges from the index of a persistent cache file. This is
+// deferred until a stream is selected, because seek ranges are computed from
+// selected streams only, and the ranges would be freed as empty before that.
+static void restore_cache_index(struct demux_internal *in)
+{
+    in->cache_index_pending = false;
+
+    bstr buf = demux_cache_get_index(in->cache);
+
+    struct cache_index_header hdr;
+    if (!index_read(&buf, &hdr, sizeof(hdr)) ||
+        hdr.num_streams != (uint32_t)in->num_streams)
+        goto mismatch;
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct sh_stream *sh = in->streams[n];
+        const char *codec = sh->codec->codec ? sh->codec->codec : "";
+        struct cache_index_stream st;
+        if (!index_read(&buf, &st, sizeof(st)) || st.type != sh->type ||
+            st.codec_len > buf.len ||
+            !bstr_equals0(bstr_splice(buf, 0, st.codec_len), codec))
+            goto mismatch;
+        buf = bstr_cut(buf, st.codec_len);
+    }
+
+    int num_restored = 0;
+    for (uint32_t n = 0; n < hdr.num_ranges; n++) {
+        if (!restore_cached_range(in, &buf)) {
+            MP_WARN(in, "Cache index is broken.\n");
+            break;
+        }
+        num_restored++;
+    }
+
+    MP_VERBOSE(in, "Restored %d cached ranges from cache file.\n",
+               num_restored);
+    return;
+
+mismatch:
+    MP_VERBOSE(in, "Cache index doesn't match the streams; not using it.\n");
+}
+
 static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 {
     struct demux_stream *ds = stream ? stream->ds : NULL;
@@ -2030,6 +2619,11 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 
     struct demux_internal *in = ds->in;
 
+    if (in->prefetch_range) {
+        add_prefetch_packet(ds, dp);
+        return;
+    }
+
     in->after_seek = false;
     in->after_seek_to_start = false;
 
@@ -2069,20 +2663,17 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
     }
 
     if (drop) {
-        demux_packet_pool_push(in->packet_pool, dp);
+        if (ds->passive && !ds->selected && !in->seeking) {
+            add_passive_packet(ds, dp);
+        } else {
+            demux_packet_pool_push(in->packet_pool, dp);
+        }
         return;
     }
 
     record_packet(in, dp);
 
-    if (in->cache && in->d_user->opts->disk_cache && !dp->is_wrapped_avframe) {
-        int64_t pos = demux_cache_write(in->cache, dp);
-        if (pos >= 0) {
-            demux_packet_unref_contents(dp);
-            dp->is_cached = true;
-            dp->cached_data.pos = pos;
-        }
-    }
+    store_packet_data(in, queue, dp);
 
     queue->correct_pos &= dp->pos >= 0 && dp->pos > queue->last_pos;
     queue->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > queue->last_dts;
@@ -2134,7 +2725,7 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
              "[num=%s size=%zd]\n", stream_type_name(stream->type),
              dp->len, dp->pts, dp->dts, dp->pos, num_pkts, (size_t)fw_bytes);
 
-    adjust_seek_range_on_packet(ds, dp);
+    adjust_seek_range_on_packet(ds, queue, dp);
 
     // May need to reduce backward cache.
     prune_old_packets(in);
@@ -2169,7 +2760,7 @@ static void mark_stream_eof(struct demux_stream *ds)
 {
     if (!ds->eof) {
         ds->eof = true;
-        adjust_seek_range_on_packet(ds, NULL);
+        adjust_seek_range_on_packet(ds, ds->queue, NULL);
         back_demux_see_packets(ds);
         wakeup_ds(ds);
     }
@@ -2186,6 +2777,19 @@ static bool lazy_stream_needs_wait(struct demux_stream *ds)
             in->demux_ts <= ds->force_read_until);
 }
 
+// Whether ds has at least num complete GOPs buffered, or no more will come.
+static bool has_fw_gops(struct demux_stream *ds, int num)
+{
+    if (ds->eof)
+        return true;
+    int keyframes = 0;
+    for (struct demux_packet *dp = ds->reader_head; dp; dp = dp->next) {
+        if (dp->keyframe && ++keyframes > num)
+            return true;
+    }
+    return false;
+}
+
 // Returns true if there was "progress" (lock was released temporarily).
 static bool read_packet(struct demux_internal *in)
 {
@@ -2199,6 +2803,7 @@ static bool read_packet(struct demux_internal *in)
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
     bool read_more = false, prefetch_more = false, refresh_more = false;
+    bool gops_done = in->prefetch_keyframes > 0;
     uint64_t total_fw_bytes = 0;
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
@@ -2224,15 +2829,26 @@ static bool read_packet(struct demux_internal *in)
             if (!in->hyst_active)
                 prefetch_more |= ds->queue->last_ts - ds->base_ts < in->min_secs;
         }
+        if (gops_done && ds->eager)
+            gops_done = has_fw_gops(ds, in->prefetch_keyframes);
         total_fw_bytes += get_forward_buffered_bytes(ds);
     }
 
+    in->prefetch_limited = gops_done;
+    if (gops_done) {
+        prefetch_more = false;
+        buffer_notify(in);
+    }
+
     MP_TRACE(in, "bytes=%zd, read_more=%d prefetch_more=%d, refresh_more=%d\n",
              (size_t)total_fw_bytes, read_more, prefetch_more, refresh_more);
+    if (total_fw_bytes >= in->buffer_notify_bytes)
+        buffer_notify(in);
     if (total_fw_bytes >= in->max_bytes) {
         // if we hit the limit just by prefetching, simply stop prefetching
         if (!read_more) {
             in->hyst_active = !!in->hyst_secs;
+            buffer_notify(in);
             return false;
         }
         if (!in->warned_queue_overflow) {
@@ -2266,6 +2882,7 @@ static bool read_packet(struct demux_internal *in)
 
     if (!read_more && !prefetch_more && !refresh_more) {
         in->hyst_active = !!in->hyst_secs;
+        buffer_notify(in);
         return false;
     }
 
@@ -2288,8 +2905,11 @@ static bool read_packet(struct demux_internal *in)
     struct demux_packet *pkt = NULL;
 
     bool eof = true;
-    if (demux->desc->read_packet && !demux_cancel_test(demux))
+    if (demux->desc->read_packet && !demux_cancel_test(demux)) {
+        stats_handle_time_start(in->stats_read);
         eof = !demux->desc->read_packet(demux, &pkt);
+        stats_handle_time_end(in->stats_read);
+    }
 
     mp_mutex_lock(&in->lock);
     update_cache(in);
@@ -2307,6 +2927,7 @@ static bool read_packet(struct demux_internal *in)
             if (!in->eof) {
                 if (in->wakeup_cb)
                     in->wakeup_cb(in->wakeup_cb_ctx);
+                buffer_notify(in);
                 mp_cond_signal(&in->wakeup);
                 MP_VERBOSE(in, "EOF reached.\n");
             }
@@ -2317,6 +2938,27 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Whether the back buffer of ds is within its --demuxer-min-back-bytes-*
+// reservation, which other streams can't take away.
+static bool back_buffer_reserved(struct demux_internal *in,
+                                 struct demux_stream *ds)
+{
+    uint64_t min_bytes = in->d_user->opts->min_back_bytes[ds->type];
+    if (!min_bytes)
+        return false;
+
+    uint64_t bytes = 0;
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_queue *queue = in->ranges[n]->streams[ds->index];
+        if (queue->head) {
+            bytes += queue->tail_cum_pos - queue->head->cum_pos -
+                     queue->packed_saved;
+        }
+    }
+    bytes -= MPMIN(bytes, get_forward_buffered_bytes(ds));
+    return bytes <= min_bytes;
+}
+
 static void prune_old_packets(struct demux_internal *in)
 {
     mp_assert(in->current_range == in->ranges[in->num_ranges - 1]);
@@ -2335,31 +2977,42 @@ static void prune_old_packets(struct demux_internal *in)
         // Still leave 1 byte free, so the read_packet logic doesn't get stuck.
         if (max_avail && in->max_bytes > (fw_bytes + 1) && in->d_user->opts->donate_fw)
             max_avail += in->max_bytes - (fw_bytes + 1);
-        if (in->total_bytes - fw_bytes <= max_avail)
+        // (Compressed packets make total_bytes smaller than the sum of the
+        // packet sizes, which fw_bytes is based on.)
+        if (in->total_bytes <= fw_bytes + max_avail)
             break;
 
         // (Start from least recently used range.)
         struct demux_cached_range *range = in->ranges[0];
+        if (range == in->prefetch_range)
+            range = in->ranges[1];
         double earliest_ts = MP_NOPTS_VALUE;
         struct demux_stream *earliest_stream = NULL;
 
-        for (int n = 0; n < range->num_streams; n++) {
-            struct demux_queue *queue = range->streams[n];
-            struct demux_stream *ds = queue->ds;
-
-            if (queue->head && queue->head != ds->reader_head) {
-                struct demux_packet *dp = queue->head;
-                double ts = queue->seek_start;
-                // If the ts is NOPTS, the queue has no retainable packets, so
-                // delete them all. This code is not run when there's enough
-                // free space, so normally the queue gets the chance to build up.
-                bool prune_always =
-                    !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
-                if (prune_always || !earliest_stream || ts < earliest_ts) {
-                    earliest_ts = ts;
-                    earliest_stream = ds;
-                    if (prune_always)
-                        break;
+        // Streams within their reserved back buffer are pruned only if there
+        // is nothing else (second pass).
+        for (int pass = 0; pass < 2 && !earliest_stream; pass++) {
+            for (int n = 0; n < range->num_streams; n++) {
+                struct demux_queue *queue = range->streams[n];
+                struct demux_stream *ds = queue->ds;
+
+                if (queue->head && queue->head != ds->reader_head) {
+                    struct demux_packet *dp = queue->head;
+                    double ts = queue->seek_start;
+                    // If the ts is NOPTS, the queue has no retainable packets,
+                    // so delete them all. This code is not run when there's
+                    // enough free space, so normally the queue gets the chance
+                    // to build up.
+                    bool prune_always =
+                        !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
+                    if (!prune_always && pass == 0 && back_buffer_reserved(in, ds))
+                        continue;
+                    if (prune_always || !earliest_stream || ts < earliest_ts) {
+                        earliest_ts = ts;
+                        earliest_stream = ds;
+                        if (prune_always)
+                            break;
+                    }
                 }
             }
         }
@@ -2458,8 +3111,12 @@ static void execute_seek(struct demux_internal *in)
         !(flags & (SEEK_FORWARD | SEEK_FACTOR)) &&
         pts <= in->d_thread->start_time;
 
-    for (int n = 0; n < in->num_streams; n++)
-        in->streams[n]->ds->queue->last_pos_fixup = -1;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        ds->queue->last_pos_fixup = -1;
+        // The kept packets must be contiguous up to the demuxer position.
+        clear_passive_packets(ds);
+    }
 
     if (in->recorder)
         mp_recorder_mark_discontinuity(in->recorder);
@@ -2514,9 +3171,12 @@ static void update_opts(struct demuxer *demuxer)
     }
 
     if (in->seekable_cache && opts->disk_cache && !in->cache) {
-        in->cache = demux_cache_create(in->global, in->log);
+        in->cache = demux_cache_create(in->global, in->log,
+                                       in->d_user->filename);
         if (!in->cache)
             MP_ERR(in, "Failed to create file cache.\n");
+        in->cache_index_pending =
+            in->cache && demux_cache_get_index(in->cache).len;
     }
 
     // The filename option really decides whether recording should be active.
@@ -2537,6 +3197,8 @@ static void update_opts(struct demuxer *demuxer)
         in->enable_recording = in->can_record;
     }
 
+    update_passive_streams(in);
+
     // In case the cache was reduced in size.
     prune_old_packets(in);
 
@@ -2544,6 +3206,182 @@ static void update_opts(struct demuxer *demuxer)
     free_empty_cached_ranges(in);
 }
 
+// Compress some packets that won't be read soon (--demuxer-cache-compress):
+// those behind the reader in the current range, and all packets in the other
+// ranges. They're decompressed when they're read again after a seek. Streams
+// that don't compress well are skipped after a while. Returns whether there
+// was any progress.
+static bool compress_back_buffer(struct demux_internal *in)
+{
+    if (!HAVE_ZLIB || !in->d_user->opts->cache_compress || !in->seekable_cache ||
+        !in->threading || in->back_demuxing)
+        return false;
+
+    size_t budget = PACK_BYTES_PER_PASS;
+    bool progress = false;
+
+    for (int r = 0; r < in->num_ranges; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+            struct demux_stream *ds = queue->ds;
+            // The forward buffer of the current range is going to be read.
+            struct demux_packet *end = ds->queue == queue ? ds->reader_head : NULL;
+
+            while (ds->pack_failures < PACK_MAX_FAILURES) {
+                struct demux_packet *dp =
+                    queue->pack_last ? queue->pack_last->next : queue->head;
+                if (!dp || dp == end)
+                    break;
+                if (!budget)
+                    return true;
+
+                queue->pack_last = dp;
+                progress = true;
+
+                if (!dp->avpacket || dp->is_compressed || dp->len < 256)
+                    continue;
+
+                budget -= MPMIN(budget, dp->len);
+                if (demux_packet_compress(dp)) {
+                    size_t saved = demux_packet_compressed_saving(dp);
+                    in->total_bytes -= saved;
+                    queue->packed_saved += saved;
+                    ds->pack_failures = 0;
+                } else {
+                    ds->pack_failures += 1;
+                }
+            }
+        }
+    }
+
+    return progress;
+}
+
+// Whether pts is in a cached range, or will be cached soon by normal reading.
+static bool seek_hint_is_cached(struct demux_internal *in, double pts)
+{
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *r = in->ranges[n];
+        if (r->seek_start == MP_NOPTS_VALUE)
+            continue;
+        double end = r->seek_end;
+        if (r == in->current_range)
+            end += in->min_secs;
+        if ((pts >= r->seek_start || r->is_bof) && (pts <= end || r->is_eof))
+            return true;
+    }
+    return false;
+}
+
+// Read --demuxer-seek-prefetch seconds of data at the most recent seek hint
+// into a new cached range, then resume the low level demuxer at the end of the
+// current range (the same way as execute_cache_seek() does). This is only done
+// while the forward buffer is full, and stops as soon as a reader runs out of
+// packets or the user seeks. Returns whether anything was done.
+static bool prefetch_seek_hint(struct demux_internal *in)
+{
+    double secs = in->d_user->opts->seek_prefetch;
+    struct demux_cached_range *cur = in->current_range;
+
+    if (!secs || !in->num_seek_hints || !in->threading || !in->seekable_cache ||
+        !in->d_thread->seekable || in->back_demuxing || in->blocked ||
+        !in->max_bytes_bw || cur->seek_end == MP_NOPTS_VALUE)
+        return false;
+
+    // Resuming requires the current range to be joinable again.
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected && !(ds->global_correct_dts || ds->global_correct_pos))
+            return false;
+        if (ds->eager && !ds->reader_head && !ds->eof)
+            return false;
+    }
+
+    double pts = in->seek_hints[--in->num_seek_hints];
+    if (seek_hint_is_cached(in, pts))
+        return true;
+
+    MP_VERBOSE(in, "prefetching seek hint %f\n", pts);
+
+    struct demux_cached_range *range = talloc_ptrtype(NULL, range);
+    *range = (struct demux_cached_range){
+        .seek_start = MP_NOPTS_VALUE,
+        .seek_end = MP_NOPTS_VALUE,
+    };
+    // (current_range must stay the last entry)
+    MP_TARRAY_INSERT_AT(in, in->ranges, in->num_ranges, in->num_ranges - 1,
+                        range);
+    add_missing_streams(in, range);
+    in->prefetch_range = range;
+
+    size_t start_bytes = in->total_bytes;
+    in->low_level_seeks += 1;
+    in->demux_ts = MP_NOPTS_VALUE;
+
+    mp_mutex_unlock(&in->lock);
+    if (in->d_thread->desc->seek)
+        in->d_thread->desc->seek(in->d_thread, pts, 0);
+    mp_mutex_lock(&in->lock);
+
+    while (!in->seeking && !in->blocked && !in->tracks_switched &&
+           !demux_cancel_test(in->d_thread))
+    {
+        if (range->seek_start != MP_NOPTS_VALUE &&
+            range->seek_end - range->seek_start >= secs)
+            break;
+        if (in->total_bytes - MPMIN(in->total_bytes, start_bytes) >=
+            in->max_bytes_bw / 2)
+            break;
+        // (In case the selected streams have no usable keyframes.)
+        if (in->demux_ts != MP_NOPTS_VALUE && in->demux_ts > pts + secs * 2)
+            break;
+        bool starving = false;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            starving |= ds->eager && !ds->reader_head && !ds->eof;
+        }
+        if (starving)
+            break;
+
+        mp_mutex_unlock(&in->lock);
+        struct demuxer *demux = in->d_thread;
+        struct demux_packet *pkt = NULL;
+        bool eof = !demux->desc->read_packet || !demux->desc->read_packet(demux, &pkt);
+        mp_mutex_lock(&in->lock);
+
+        if (pkt) {
+            mp_assert(pkt->stream >= 0 && pkt->stream < in->num_streams);
+            add_packet_locked(in->streams[pkt->stream], pkt);
+        }
+        if (eof) {
+            for (int n = 0; n < range->num_streams; n++)
+                adjust_seek_range_on_packet(range->streams[n]->ds,
+                                            range->streams[n], NULL);
+            break;
+        }
+    }
+
+    in->prefetch_range = NULL;
+
+    MP_VERBOSE(in, "prefetched %f <-> %f\n", range->seek_start, range->seek_end);
+
+    // A user seek replaces the resume seek.
+    if (!in->seeking && in->current_range == cur) {
+        in->seeking = true;
+        in->seek_flags = SEEK_HR;
+        in->seek_pts = cur->seek_end - 1.0;
+        in->reading = true;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            ds->refreshing = ds->selected;
+        }
+    }
+
+    free_empty_cached_ranges(in);
+    return true;
+}
+
 // Make demuxing progress. Return whether progress was made.
 static bool thread_work(struct demux_internal *in)
 {
@@ -2577,6 +3415,10 @@ static bool thread_work(struct demux_internal *in)
         update_cache(in);
         return true;
     }
+    if (compress_back_buffer(in))
+        return true;
+    if (prefetch_seek_hint(in))
+        return true;
     return false;
 }
 
@@ -2625,6 +3467,60 @@ static struct demux_packet *advance_reader_head(struct demux_stream *ds)
     return pkt;
 }
 
+// Hand a dequeued packet to the reader (in->lock held). Returns false if the
+// ring is full.
+static bool ring_push(struct demux_stream *ds, struct demux_packet *pkt)
+{
+    unsigned w = atomic_load_explicit(&ds->ring_wpos, memory_order_relaxed);
+    unsigned r = atomic_load_explicit(&ds->ring_rpos, memory_order_acquire);
+    if (w - r >= PACKET_RING_SIZE)
+        return false;
+    ds->ring[w & (PACKET_RING_SIZE - 1)] = pkt;
+    ds->ring_pkt_gen[w & (PACKET_RING_SIZE - 1)] = atomic_load(&ds->ring_gen);
+    ds->ring_pkt_offset[w & (PACKET_RING_SIZE - 1)] = ds->in->ts_offset;
+    atomic_store_explicit(&ds->ring_wpos, w + 1, memory_order_release);
+    return true;
+}
+
+static bool ring_full(struct demux_stream *ds)
+{
+    unsigned w = atomic_load_explicit(&ds->ring_wpos, memory_order_relaxed);
+    unsigned r = atomic_load_explicit(&ds->ring_rpos, memory_order_acquire);
+    return w - r >= PACKET_RING_SIZE;
+}
+
+// Take the next packet from the ring (reader only, no lock needed). Stale
+// packets are freed and skipped. Returns NULL if there are none.
+static struct demux_packet *ring_pop(struct demux_stream *ds)
+{
+    while (1) {
+        unsigned r = atomic_load_explicit(&ds->ring_rpos, memory_order_relaxed);
+        unsigned w = atomic_load_explicit(&ds->ring_wpos, memory_order_acquire);
+        if (r == w)
+            return NULL;
+        struct demux_packet *pkt = ds->ring[r & (PACKET_RING_SIZE - 1)];
+        bool stale = ds->ring_pkt_gen[r & (PACKET_RING_SIZE - 1)] !=
+                     atomic_load(&ds->ring_gen);
+        double offset = ds->ring_pkt_offset[r & (PACKET_RING_SIZE - 1)];
+        atomic_store_explicit(&ds->ring_rpos, r + 1, memory_order_release);
+        if (stale) {
+            talloc_free(pkt);
+            continue;
+        }
+        // Apply ts_offset changes since the packet was dequeued.
+        double diff = atomic_load(&ds->in->ts_offset_nolock) - offset;
+        if (diff) {
+            pkt->pts = MP_ADD_PTS(pkt->pts, diff);
+            pkt->dts = MP_ADD_PTS(pkt->dts, diff);
+            if (pkt->segmented) {
+                pkt->start = MP_ADD_PTS(pkt->start, diff);
+                pkt->end = MP_ADD_PTS(pkt->end, diff);
+            }
+        }
+        return pkt;
+    }
+}
+
 // Return a newly allocated new packet. The pkt parameter may be either a
 // in-memory packet (then a new reference is made), or a reference to
 // packet in the disk cache (then the packet is read from disk).
@@ -2645,7 +3541,13 @@ static struct demux_packet *read_packet_from_cache(struct demux_internal *in,
         }
     } else {
         // The returned packet is mutated etc. and will be owned by the user.
-        pkt = demux_copy_packet(in->packet_pool, pkt);
+        if (pkt->is_compressed) {
+            pkt = demux_packet_decompress(in->packet_pool, pkt);
+            if (!pkt)
+                MP_ERR(in, "Failed to decompress cached packet.\n");
+        } else {
+            pkt = demux_copy_packet(in->packet_pool, pkt);
+        }
     }
 
     return pkt;
@@ -2790,6 +3692,30 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
     return 1;
 }
 
+// Dequeue packets in advance for a reader that uses the ring, so that it can
+// get them without taking in->lock. Must be called by the reader only, because
+// dequeue_packet() updates the user thread's demuxer fields. This is done only
+// for plain forward playback. The last queued packet is always left in the queue, so the
+// readahead and underrun logic (which look at reader_head) see no difference.
+static void fill_reader_ring(struct demux_stream *ds)
+{
+    struct demux_internal *in = ds->in;
+
+    if (!ds->ring_active || !ds->eager || !ds->selected || in->blocked ||
+        in->back_demuxing || ds->sh->attached_picture)
+        return;
+
+    bool need_wakeup = ds->need_wakeup;
+    while (ds->reader_head && ds->reader_head->next && !ring_full(ds)) {
+        struct demux_packet *pkt = NULL;
+        if (dequeue_packet(ds, MP_NOPTS_VALUE, &pkt) <= 0)
+            break;
+        ring_push(ds, pkt);
+    }
+    // Dequeuing on the reader's behalf doesn't change whether it's waiting.
+    ds->need_wakeup = need_wakeup;
+}
+
 // Poll the demuxer queue, and if there's a packet, return it. Otherwise, just
 // make the demuxer thread read packets for this stream, and if there's at
 // least one packet, call the wakeup callback.
@@ -2819,15 +3745,32 @@ int demux_read_packet_async_until(struct sh_stream *sh, double min_pts,
         return -1;
     struct demux_internal *in = ds->in;
 
+    // Fast path: packets the demux thread already dequeued for us.
+    if (!atomic_load(&in->blocked_nolock)) {
+        *out_pkt = ring_pop(ds);
+        if (*out_pkt)
+            return 1;
+    }
+
     mp_mutex_lock(&in->lock);
     int r = -1;
     while (1) {
+        // (Packets in the ring come before reader_head.)
+        *out_pkt = in->blocked ? NULL : ring_pop(ds);
+        if (*out_pkt) {
+            r = 1;
+            break;
+        }
         r = dequeue_packet(ds, min_pts, out_pkt);
         if (in->threading || in->blocked || r != 0)
             break;
         // Needs to actually read packets until we got a packet or EOF.
         thread_work(in);
     }
+    if (in->threading && r > 0) {
+        ds->ring_active = true;
+        fill_reader_ring(ds);
+    }
     mp_mutex_unlock(&in->lock);
     return r;
 }
@@ -3102,6 +4045,22 @@ void demux_metadata_changed(demuxer_t *demuxer)
     mp_mutex_unlock(&in->lock);
 }
 
+// This is called by demuxer implementations if demuxer->attachments was set
+// after initialization. The attachments must not be changed anymore afterwards.
+void demux_attachments_changed(demuxer_t *demuxer)
+{
+    mp_assert(demuxer == demuxer->in->d_thread); // call from demuxer impl. only
+    struct demux_internal *in = demuxer->in;
+
+    mp_mutex_lock(&in->lock);
+    in->attachments = demuxer->attachments;
+    in->num_attachments = demuxer->num_attachments;
+    in->events |= DEMUX_EVENT_ATTACHMENTS;
+    if (in->wakeup_cb)
+        in->wakeup_cb(in->wakeup_cb_ctx);
+    mp_mutex_unlock(&in->lock);
+}
+
 // Called locked, with user demuxer.
 static void update_final_metadata(demuxer_t *demuxer, struct timed_metadata *tm)
 {
@@ -3203,6 +4162,10 @@ void demux_update(demuxer_t *demuxer, double pts)
         demux_update_replaygain(demuxer);
     if (demuxer->events & DEMUX_EVENT_DURATION)
         demuxer->duration = in->duration;
+    if ((demuxer->events & DEMUX_EVENT_ATTACHMENTS) && in->attachments) {
+        demuxer->attachments = in->attachments;
+        demuxer->num_attachments = in->num_attachments;
+    }
 
     mp_mutex_unlock(&in->lock);
 }
@@ -3308,6 +4271,8 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     }
 
     struct demuxer *demuxer = talloc_ptrtype(NULL, demuxer);
+    struct demux_packet_pool *packet_pool =
+        demux_packet_pool_create_local(demuxer, demux_packet_pool_get(global));
     struct m_config_cache *opts_cache =
         m_config_cache_alloc(demuxer, global, &demux_conf);
     struct demux_opts *opts = opts_cache->opts;
@@ -3319,7 +4284,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .filepos = -1,
         .global = global,
         .log = mp_log_new(demuxer, log, desc->name),
-        .packet_pool = demux_packet_pool_get(global),
+        .packet_pool = packet_pool,
         .glog = log,
         .filename = talloc_strdup(demuxer, sinfo->filename),
         .is_network = sinfo->is_network,
@@ -3337,7 +4302,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     *in = (struct demux_internal){
         .global = global,
         .log = demuxer->log,
-        .packet_pool = demux_packet_pool_get(global),
+        .packet_pool = packet_pool,
         .stats = stats_ctx_create(in, global, "demuxer"),
         .can_cache = params && params->is_top_level,
         .can_record = params && params->stream_record,
@@ -3350,6 +4315,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .demux_ts = MP_NOPTS_VALUE,
         .owns_stream = !params->external_stream,
     };
+    in->stats_read = stats_handle_create(in->stats, "read-packet");
     mp_mutex_init(&in->lock);
     mp_cond_init(&in->wakeup);
 
@@ -3470,6 +4436,37 @@ static struct demuxer *demux_open(struct stream *stream,
         }
     }
 
+    struct demux_opts *opts = mp_get_config_group(NULL, global, &demux_conf);
+    bool probe_cache = opts->probe_cache && !check_desc && !stream->is_directory;
+    talloc_free(opts);
+
+    struct demux_probe_result probe;
+    if (probe_cache && demux_probe_cache_get(sinfo.filename, global, log,
+                                             stream, &probe))
+    {
+        for (int n = 0; demuxer_list[n]; n++) {
+            const struct demuxer_desc *desc = demuxer_list[n];
+            if (strcmp(desc->name, probe.demuxer) != 0)
+                continue;
+            mp_verbose(log, "Using cached probe result: %s (%s).\n",
+                       desc->name, probe.lavf_format ? probe.lavf_format : "-");
+            char *lavf_type = stream->lavf_type;
+            if (!lavf_type)
+                stream->lavf_type = probe.lavf_format;
+            demuxer = open_given_type(global, log, desc, stream, &sinfo,
+                                      params, probe.check);
+            stream->lavf_type = lavf_type;
+            if (demuxer) {
+                talloc_steal(demuxer, log);
+                log = NULL;
+                goto done;
+            }
+            break;
+        }
+        mp_verbose(log, "Cached probe result did not work.\n");
+        demux_probe_cache_drop(global, stream);
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
@@ -3480,6 +4477,17 @@ static struct demuxer *demux_open(struct stream *stream,
                 demuxer = open_given_type(global, log, desc, stream, &sinfo,
                                           params, level);
                 if (demuxer) {
+                    // Timeline demuxers are opened from the file each time.
+                    if (probe_cache && demuxer->desc == desc) {
+                        bool lavf = desc == &demuxer_desc_lavf;
+                        probe = (struct demux_probe_result){
+                            .demuxer = (char *)desc->name,
+                            .check = level,
+                            .lavf_format = lavf ? (char *)demuxer->filetype
+                                                : NULL,
+                        };
+                        demux_probe_cache_put(global, log, stream, &probe);
+                    }
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -3528,8 +4536,19 @@ struct demuxer *demux_open_url(const char *url,
         mp_cancel_set_parent(priv_cancel, cancel);
     struct stream *s = params->external_stream;
     if (!s) {
-        s = stream_create(url, STREAM_READ | params->stream_flags,
-                          priv_cancel, global);
+        if (params->head_cache_dir) {
+            s = stream_headcache_open(url, STREAM_READ | STREAM_SHARED_CACHE |
+                                          STREAM_READAHEAD | params->stream_flags,
+                                      priv_cancel, global,
+                                      params->head_cache_dir,
+                                      params->head_cache_bytes);
+        } else {
+            s = stream_create(url, STREAM_READ | STREAM_SHARED_CACHE |
+                                  STREAM_READAHEAD | params->stream_flags,
+                              priv_cancel, global);
+        }
+        if (s)
+            params->stream_opened_ns = mp_time_ns();
         if (s && params->init_fragment.len) {
             s = create_webshit_concat_stream(global, priv_cancel,
                                              params->init_fragment, s);
@@ -3552,6 +4571,36 @@ struct demuxer *demux_open_url(const char *url,
     return d;
 }
 
+// Open a reader of params->fanout (see demux_fanout.c). On success,
+// params->fanout is cleared, and its reference belongs to the demuxer.
+struct demuxer *demux_open_fanout_reader(const char *url,
+                                         struct demuxer_params *params,
+                                         struct mp_cancel *cancel,
+                                         struct mpv_global *global)
+{
+    struct mp_cancel *priv_cancel = mp_cancel_new(NULL);
+    if (cancel)
+        mp_cancel_set_parent(priv_cancel, cancel);
+    struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
+    struct parent_stream_info sinfo = {
+        .is_network = true,
+        .is_streaming = true,
+        .cancel = priv_cancel,
+        .filename = (char *)url,
+    };
+    struct demuxer *d = open_given_type(global, log, &demuxer_desc_fanout,
+                                        NULL, &sinfo, params, DEMUX_CHECK_FORCE);
+    if (d) {
+        talloc_steal(d->in, priv_cancel);
+        talloc_steal(d, log);
+    } else {
+        params->demuxer_failed = true;
+        talloc_free(priv_cancel);
+        talloc_free(log);
+    }
+    return d;
+}
+
 // clear the packet queues
 void demux_flush(demuxer_t *demuxer)
 {
@@ -3567,12 +4616,38 @@ void demux_flush(demuxer_t *demuxer)
         struct demux_stream *ds = in->streams[n]->ds;
         ds->refreshing = false;
         ds->eof = false;
+        clear_passive_packets(ds);
     }
     in->eof = false;
     in->seeking = false;
     mp_mutex_unlock(&in->lock);
 }
 
+// Release memory that isn't needed for playback right now: the free packets
+// of the demuxer's packet pool, and if back_buffer is set, all cached packets
+// behind the reader (including other cached ranges) and the packets cached for
+// unselected tracks. Everything is refilled as needed by normal demuxing.
+void demux_trim_memory(struct demuxer *demuxer, bool back_buffer)
+{
+    struct demux_internal *in = demuxer->in;
+    mp_assert(demuxer == in->d_user);
+
+    mp_mutex_lock(&in->lock);
+    if (back_buffer) {
+        // With no back buffer budget, this prunes until only the forward
+        // buffered packets are left.
+        size_t max_bytes_bw = in->max_bytes_bw;
+        in->max_bytes_bw = 0;
+        prune_old_packets(in);
+        in->max_bytes_bw = max_bytes_bw;
+        for (int n = 0; n < in->num_streams; n++)
+            clear_passive_packets(in->streams[n]->ds);
+    }
+    mp_mutex_unlock(&in->lock);
+
+    demux_packet_pool_clear(in->packet_pool);
+}
+
 // Reset the demuxer state for reuse (e.g. preloading) without clearing the cache.
 void demux_reset_state(demuxer_t *demuxer)
 {
@@ -3817,6 +4892,8 @@ static void execute_cache_seek(struct demux_internal *in,
         struct demux_packet *target = find_seek_target(queue, pts, flags);
         ds->reader_head = target;
         ds->skip_to_keyframe = !target;
+        // Don't compress what is now the forward buffer.
+        queue->pack_last = NULL;
         if (ds->reader_head)
             ds->base_ts = MP_PTS_OR_DEF(ds->reader_head->pts, ds->reader_head->dts);
 
@@ -3929,7 +5006,7 @@ static bool queue_seek(struct demux_internal *in, double seek_pts, int flags,
 
     clear_reader_state(in, clear_back_state);
 
-    in->blocked = block;
+    set_blocked(in, block);
 
     if (cache_target) {
         execute_cache_seek(in, cache_target, seek_pts, flags);
@@ -4052,6 +5129,73 @@ static void initiate_refresh_seek(struct demux_internal *in,
     in->seek_pts = start_ts;
 }
 
+// Let a newly selected stream continue with the packets kept while it was
+// unselected, which avoids the refresh seek. This works only if nothing is
+// missing between ref_pts and the current demuxer position. Called locked.
+static bool take_passive_packets(struct demux_internal *in,
+                                 struct demux_stream *ds, double ref_pts)
+{
+    if (!ds->passive_head || ref_pts == MP_NOPTS_VALUE || in->seeking ||
+        in->prefetch_range || in->back_demuxing ||
+        ds->passive_start_ts == MP_NOPTS_VALUE ||
+        ds->passive_start_ts > ref_pts)
+        return false;
+
+    // Start at the last keyframe before ref_pts, or for subtitles, at the
+    // first event that is still visible at ref_pts.
+    struct demux_packet *start = NULL;
+    for (struct demux_packet *dp = ds->passive_head; dp; dp = dp->next) {
+        double ts = MP_PTS_OR_DEF(dp->dts, dp->pts);
+        if (ds->type == STREAM_SUB) {
+            if (ts == MP_NOPTS_VALUE || dp->duration < 0 ||
+                ts + dp->duration > ref_pts)
+            {
+                start = dp;
+                break;
+            }
+        } else {
+            if (ts != MP_NOPTS_VALUE && ts > ref_pts)
+                break;
+            if (dp->keyframe)
+                start = dp;
+        }
+    }
+    if (!start && ds->type != STREAM_SUB)
+        return false;
+
+    // Adding the packets must not look like demuxer progress.
+    double demux_ts = in->demux_ts;
+    bool after_seek = in->after_seek;
+    bool after_seek_to_start = in->after_seek_to_start;
+
+    struct demux_packet *dp = ds->passive_head;
+    ds->passive_head = ds->passive_tail = NULL;
+    clear_passive_packets(ds);
+
+    int num_packets = 0;
+    bool add = false;
+    while (dp) {
+        struct demux_packet *next = dp->next;
+        dp->next = NULL;
+        add |= dp == start;
+        if (add) {
+            add_packet_locked(ds->sh, dp);
+            num_packets++;
+        } else {
+            demux_packet_pool_push(in->packet_pool, dp);
+        }
+        dp = next;
+    }
+
+    in->demux_ts = demux_ts;
+    in->after_seek = after_seek;
+    in->after_seek_to_start = after_seek_to_start;
+
+    MP_VERBOSE(in, "track %d: using %d cached unselected packets\n",
+               ds->index, num_packets);
+    return true;
+}
+
 // Called locked.
 static void refresh_track(struct demux_internal *in, struct sh_stream *stream,
                           double ref_pts)
@@ -4080,10 +5224,13 @@ static void refresh_track(struct demux_internal *in, struct sh_stream *stream,
     //   is sought to the end of cache after cache joining. Switching track immediately
     //   after this also causes the same problem.
     if (!in->after_seek || (ds->type != STREAM_VIDEO && !avoid_refresh)) {
-        MP_VERBOSE(in, "refresh track %d (%s)\n", stream->index,
-                   stream_type_name(ds->type));
-        initiate_refresh_seek(in, ds, ref_pts);
+        if (!take_passive_packets(in, ds, ref_pts)) {
+            MP_VERBOSE(in, "refresh track %d (%s)\n", stream->index,
+                       stream_type_name(ds->type));
+            initiate_refresh_seek(in, ds, ref_pts);
+        }
     }
+    clear_passive_packets(ds);
 }
 
 // Set whether the given stream should return packets.
@@ -4130,16 +5277,15 @@ void demuxer_refresh_track(struct demuxer *demuxer, struct sh_stream *stream,
 }
 
 // This is for demuxer implementations only. demuxer_select_track() sets the
-// logical state, while this function returns the actual state (in case the
-// demuxer attempts to cache even unselected packets for track switching - this
-// will potentially be done in the future).
+// logical state, while this function returns the actual state (unselected
+// streams are still read with --demuxer-cache-unselected).
 bool demux_stream_is_selected(struct sh_stream *stream)
 {
     if (!stream)
         return false;
     bool r = false;
     mp_mutex_lock(&stream->ds->in->lock);
-    r = stream->ds->selected;
+    r = stream->ds->selected || stream->ds->passive;
     mp_mutex_unlock(&stream->ds->in->lock);
     return r;
 }
@@ -4205,6 +5351,29 @@ int demuxer_add_chapter(demuxer_t *demuxer, char *name,
     return demuxer->num_chapters - 1;
 }
 
+// Tell the demuxer that the user is likely to seek to pts soon. With
+// --demuxer-seek-prefetch, the demuxer thread reads a bit of data at this
+// position into the cache while it's idle. Only the most recent hints are
+// kept, and the most recent one is prefetched first.
+void demux_add_seek_hint(struct demuxer *demuxer, double pts)
+{
+    struct demux_internal *in = demuxer->in;
+    mp_assert(demuxer == in->d_user);
+
+    if (pts == MP_NOPTS_VALUE)
+        return;
+
+    mp_mutex_lock(&in->lock);
+    if (in->num_seek_hints == MAX_SEEK_HINTS) {
+        memmove(&in->seek_hints[0], &in->seek_hints[1],
+                (MAX_SEEK_HINTS - 1) * sizeof(in->seek_hints[0]));
+        in->num_seek_hints -= 1;
+    }
+    in->seek_hints[in->num_seek_hints++] = MP_ADD_PTS(pts, -in->ts_offset);
+    mp_cond_signal(&in->wakeup);
+    mp_mutex_unlock(&in->lock);
+}
+
 // Disallow reading any packets and make readers think there is no new data
 // yet, until a seek is issued.
 void demux_block_reading(struct demuxer *demuxer, bool block)
@@ -4213,7 +5382,7 @@ void demux_block_reading(struct demuxer *demuxer, bool block)
     mp_assert(demuxer == in->d_user);
 
     mp_mutex_lock(&in->lock);
-    in->blocked = block;
+    set_blocked(in, block);
     for (int n = 0; n < in->num_streams; n++) {
         in->streams[n]->ds->need_wakeup = true;
         wakeup_ds(in->streams[n]->ds);
@@ -4237,6 +5406,7 @@ static void update_bytes_read(struct demux_internal *in)
         stream->total_unbuffered_read_bytes = 0;
         new_seeks += stream->total_stream_seeks;
         stream->total_stream_seeks = 0;
+        in->stream_buffer_size = stream->requested_buffer_size;
     }
 
     in->cache_unbuffered_read_bytes += new;
@@ -4324,6 +5494,10 @@ static void dump_cache(struct demux_internal *in, double start, double end)
         ranges[num_ranges++] = in->ranges[n];
     qsort(ranges, num_ranges, sizeof(ranges[0]), range_time_compare);
 
+    // Packets of a range are mostly in file order in the disk cache.
+    if (in->cache)
+        demux_cache_set_sequential(in->cache, true);
+
     for (int n = 0; n < num_ranges; n++) {
         struct demux_cached_range *r = ranges[n];
         if (r->seek_start == MP_NOPTS_VALUE)
@@ -4402,6 +5576,9 @@ static void dump_cache(struct demux_internal *in, double start, double end)
             break;
     }
 
+    if (in->cache)
+        demux_cache_set_sequential(in->cache, false);
+
     // (strictly speaking unnecessary; for clarity)
     for (int n = 0; n < in->num_streams; n++)
         in->streams[n]->ds->dump_pos = NULL;
@@ -4611,7 +5788,9 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
         .ts_last = in->demux_ts,
         .bytes_per_second = in->bytes_per_second,
         .byte_level_seeks = in->byte_level_seeks,
+        .stream_buffer_size = in->stream_buffer_size,
         .file_cache_bytes = in->cache ? demux_cache_get_size(in->cache) : -1,
+        .prefetch_limited = in->prefetch_limited,
     };
     bool any_packets = false;
     for (int n = 0; n < STREAM_TYPE_COUNT; n++) {
@@ -4676,6 +5855,21 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
         }
     }
 
+    if (r->num_seek_ranges != in->num_last_seek_ranges ||
+        r->bof_cached != in->last_bof_cached ||
+        r->eof_cached != in->last_eof_cached ||
+        memcmp(r->seek_ranges, in->last_seek_ranges,
+               r->num_seek_ranges * sizeof(r->seek_ranges[0])))
+    {
+        memcpy(in->last_seek_ranges, r->seek_ranges,
+               r->num_seek_ranges * sizeof(r->seek_ranges[0]));
+        in->num_last_seek_ranges = r->num_seek_ranges;
+        in->last_bof_cached = r->bof_cached;
+        in->last_eof_cached = r->eof_cached;
+        in->seek_ranges_gen++;
+    }
+    r->seek_ranges_gen = in->seek_ranges_gen;
+
     mp_mutex_unlock(&in->lock);
 }
 
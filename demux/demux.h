@@ -45,6 +45,7 @@ struct demux_ctrl_ts_info {
 struct demux_reader_state {
     bool eof, underrun, idle;
     bool bof_cached, eof_cached;
+    bool prefetch_limited; // demux_set_prefetch_keyframes() limit reached
     struct demux_ctrl_ts_info ts_info;
     struct demux_ctrl_ts_info ts_per_stream[STREAM_TYPE_COUNT];
     int64_t total_bytes;
@@ -55,10 +56,13 @@ struct demux_reader_state {
     uint64_t byte_level_seeks; // number of byte stream level seeks
     double ts_last; // approx. timestamp of demuxer position
     uint64_t bytes_per_second; // low level statistics
+    int stream_buffer_size; // current stream buffer size (0 if unknown)
     // Positions that can be seeked to without incurring the latency of a low
     // level seek.
     int num_seek_ranges;
     struct demux_seek_range seek_ranges[MAX_SEEK_RANGES];
+    // Incremented each time the seek ranges (or bof/eof_cached) change.
+    uint64_t seek_ranges_gen;
 };
 
 extern const struct m_sub_options demux_conf;
@@ -69,6 +73,13 @@ struct demux_opts {
     int64_t max_bytes;
     int64_t max_bytes_bw;
     bool donate_fw;
+    int64_t min_back_bytes[STREAM_TYPE_COUNT];
+    bool packet_arena;
+    bool cache_compress;
+    int cache_unselected;
+    int64_t cache_unselected_bytes;
+    int segment_prefetch;
+    double seek_prefetch;
     double min_secs;
     double hyst_secs;
     bool force_seekable;
@@ -78,6 +89,7 @@ struct demux_opts {
     int index_mode;
     double mf_fps;
     char *mf_type;
+    int mf_readahead;
     bool create_ccs;
     char *record_file;
     int video_back_preroll;
@@ -87,6 +99,7 @@ struct demux_opts {
     char *meta_cp;
     bool force_retry_eof;
     int autocreate_playlist;
+    bool probe_cache;
 };
 
 #define SEEK_FACTOR   (1 << 1)      // argument is in range [0,1]
@@ -119,11 +132,13 @@ enum demux_event {
     DEMUX_EVENT_STREAMS = 1 << 1,   // a stream was added
     DEMUX_EVENT_METADATA = 1 << 2,  // metadata or stream_metadata changed
     DEMUX_EVENT_DURATION = 1 << 3,  // duration updated
+    DEMUX_EVENT_ATTACHMENTS = 1 << 4, // attachments were added after init
     DEMUX_EVENT_ALL = 0xFFFF,
 };
 
 struct demuxer;
 struct timeline;
+struct demux_fanout;
 
 /**
  * Demuxer description structure
@@ -207,6 +222,7 @@ struct demuxer_params {
     struct matroska_segment_uid *matroska_wanted_uids;
     int matroska_wanted_segment;
     bool *matroska_was_valid;
+    unsigned char *matroska_seen_uid; // if set, receives the segment UID
     struct timeline *timeline;
     bool disable_timeline;
     bstr init_fragment;
@@ -214,9 +230,13 @@ struct demuxer_params {
     bool stream_record; // if true, enable stream recording if option is set
     int stream_flags;
     struct stream *external_stream; // if set, use this, don't open or close streams
+    char *head_cache_dir;   // if set, use stream_headcache_open() with these
+    int64_t head_cache_bytes;
     bool allow_playlist_create;
+    struct demux_fanout *fanout; // for demux_open_fanout_reader()
     // result
     bool demuxer_failed;
+    int64_t stream_opened_ns; // mp_time_ns() when the stream was opened
 };
 
 typedef struct demuxer {
@@ -312,15 +332,24 @@ struct demuxer *demux_open_url(const char *url,
                                struct demuxer_params *params,
                                struct mp_cancel *cancel,
                                struct mpv_global *global);
+struct demuxer *demux_open_fanout_reader(const char *url,
+                                         struct demuxer_params *params,
+                                         struct mp_cancel *cancel,
+                                         struct mpv_global *global);
 
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
+void demux_set_buffer_notify(struct demuxer *demuxer, int64_t fw_bytes,
+                             void (*cb)(void *ctx), void *ctx);
 void demux_start_prefetch(struct demuxer *demuxer);
+void demux_set_prefetch_keyframes(struct demuxer *demuxer, int num);
+void demux_update_opts(struct demuxer *demuxer);
 
 bool demux_cancel_test(struct demuxer *demuxer);
 
 void demux_flush(struct demuxer *demuxer);
+void demux_trim_memory(struct demuxer *demuxer, bool back_buffer);
 int demux_seek(struct demuxer *demuxer, double rel_seek_secs, int flags);
 void demux_set_ts_offset(struct demuxer *demuxer, double offset);
 
@@ -328,6 +357,7 @@ void demux_get_bitrate_stats(struct demuxer *demuxer, double *rates);
 void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *r);
 
 void demux_block_reading(struct demuxer *demuxer, bool block);
+void demux_add_seek_hint(struct demuxer *demuxer, double pts);
 
 void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
                           double ref_pts, bool selected);
@@ -345,6 +375,7 @@ void demux_stream_tags_changed(struct demuxer *demuxer, struct sh_stream *sh,
 void demux_close_stream(struct demuxer *demuxer);
 
 void demux_metadata_changed(demuxer_t *demuxer);
+void demux_attachments_changed(demuxer_t *demuxer);
 void demux_update(demuxer_t *demuxer, double playback_pts);
 
 bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
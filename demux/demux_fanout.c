@@ -0,0 +1,438 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Shared sources (see demux_fanout_open()): one source demuxer per URL, read
+// by a thread that hands references to each packet to any number of reader
+// demuxers. The readers are normal demuxers with their own cache, so each
+// player using one still has its own decoders, track selection and A/V sync.
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/tags.h"
+#include "misc/thread_tools.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
+#include "demux.h"
+#include "demux_fanout.h"
+#include "packet.h"
+#include "stheader.h"
+
+// If a reader has more than this queued (because its player doesn't read, e.g.
+// while paused with a full demuxer cache), its queue is dropped, and it's
+// restarted at the next keyframe.
+#define MAX_QUEUE_BYTES (64 * 1024 * 1024)
+
+struct fanout_reader {
+    struct demux_fanout *f;
+    struct mp_log *log;
+    struct demux_packet_pool *pool;
+    // Queued packets, linked with demux_packet.next.
+    struct demux_packet *head, *tail;
+    int64_t queued_bytes;
+    // Per stream: drop packets until the next keyframe.
+    bool *need_keyframe;
+    int num_streams;
+    int overflows;
+};
+
+struct demux_fanout {
+    char *url;
+    bool listed;            // in fanouts[] (under fanout_lock)
+    int refs;               // readers, and openers (under fanout_lock)
+
+    // Everything below is protected by lock.
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool opening;           // open_source() is running
+    bool failed;            // open_source() failed (not cancelled)
+    struct demuxer *source;
+    bool thread_running;
+    mp_thread thread;
+    bool terminate;
+    bool eof;
+    struct fanout_reader **readers;
+    int num_readers;
+};
+
+struct priv {
+    struct fanout_reader *reader;
+};
+
+// Protects fanouts[], and the listed and refs fields.
+static mp_static_mutex fanout_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct demux_fanout **fanouts;
+static int num_fanouts;
+
+static void unlist_locked(struct demux_fanout *f)
+{
+    if (!f->listed)
+        return;
+    for (int n = 0; n < num_fanouts; n++) {
+        if (fanouts[n] == f) {
+            MP_TARRAY_REMOVE_AT(fanouts, num_fanouts, n);
+            break;
+        }
+    }
+    f->listed = false;
+}
+
+static void destroy_fanout(struct demux_fanout *f)
+{
+    mp_mutex_lock(&f->lock);
+    f->terminate = true;
+    if (f->source && f->source->cancel)
+        mp_cancel_trigger(f->source->cancel);
+    mp_cond_broadcast(&f->wakeup);
+    mp_mutex_unlock(&f->lock);
+
+    if (f->thread_running)
+        mp_thread_join(f->thread);
+    mp_assert(!f->num_readers);
+    if (f->source)
+        demux_free(f->source);
+    mp_cond_destroy(&f->wakeup);
+    mp_mutex_destroy(&f->lock);
+    talloc_free(f);
+}
+
+static void unref_fanout(struct demux_fanout *f)
+{
+    mp_mutex_lock(&fanout_lock);
+    mp_assert(f->refs > 0);
+    bool last = --f->refs == 0;
+    if (last)
+        unlist_locked(f);
+    mp_mutex_unlock(&fanout_lock);
+
+    if (last)
+        destroy_fanout(f);
+}
+
+static void flush_reader_locked(struct fanout_reader *r)
+{
+    while (r->head) {
+        struct demux_packet *dp = r->head;
+        r->head = dp->next;
+        free_demux_packet(dp);
+    }
+    r->tail = NULL;
+    r->queued_bytes = 0;
+    for (int n = 0; n < r->num_streams; n++)
+        r->need_keyframe[n] = true;
+}
+
+static void distribute_locked(struct demux_fanout *f, struct demux_packet *pkt)
+{
+    for (int n = 0; n < f->num_readers; n++) {
+        struct fanout_reader *r = f->readers[n];
+        // (Streams added to the source after the reader was opened.)
+        if (pkt->stream < 0 || pkt->stream >= r->num_streams)
+            continue;
+        if (r->queued_bytes >= MAX_QUEUE_BYTES) {
+            r->overflows++;
+            MP_WARN(r, "Falling behind the shared source, skipping to the "
+                    "next keyframe.\n");
+            flush_reader_locked(r);
+        }
+        if (r->need_keyframe[pkt->stream]) {
+            if (!pkt->keyframe)
+                continue;
+            r->need_keyframe[pkt->stream] = false;
+        }
+        struct demux_packet *dp = demux_copy_packet(r->pool, pkt);
+        if (!dp)
+            continue;
+        dp->next = NULL;
+        if (r->tail) {
+            r->tail->next = dp;
+        } else {
+            r->head = dp;
+        }
+        r->tail = dp;
+        r->queued_bytes += demux_packet_estimate_total_size(dp);
+    }
+}
+
+// Whether any reader has room for more packets.
+static bool want_data_locked(struct demux_fanout *f)
+{
+    for (int n = 0; n < f->num_readers; n++) {
+        if (f->readers[n]->queued_bytes < MAX_QUEUE_BYTES)
+            return true;
+    }
+    return false;
+}
+
+static MP_THREAD_VOID fanout_thread(void *arg)
+{
+    struct demux_fanout *f = arg;
+    mp_thread_set_name("fanout");
+
+    mp_mutex_lock(&f->lock);
+    while (!f->terminate) {
+        if (!want_data_locked(f)) {
+            mp_cond_wait(&f->wakeup, &f->lock);
+            continue;
+        }
+        mp_mutex_unlock(&f->lock);
+        struct demux_packet *pkt = demux_read_any_packet(f->source);
+        mp_mutex_lock(&f->lock);
+        if (!pkt) {
+            f->eof = true;
+            mp_cond_broadcast(&f->wakeup);
+            break;
+        }
+        distribute_locked(f, pkt);
+        free_demux_packet(pkt);
+        mp_cond_broadcast(&f->wakeup);
+    }
+    mp_mutex_unlock(&f->lock);
+
+    // Readers opened from now on get a new source.
+    mp_mutex_lock(&fanout_lock);
+    unlist_locked(f);
+    mp_mutex_unlock(&fanout_lock);
+    MP_THREAD_RETURN();
+}
+
+// Get a reference to the (opened) source for url, opening it if needed.
+static struct demux_fanout *get_fanout(const char *url,
+                                       demux_fanout_open_fn open_source,
+                                       void *ctx, struct mp_cancel *cancel)
+{
+    while (!mp_cancel_test(cancel)) {
+        mp_mutex_lock(&fanout_lock);
+        struct demux_fanout *f = NULL;
+        for (int n = 0; n < num_fanouts; n++) {
+            if (strcmp(fanouts[n]->url, url) == 0) {
+                f = fanouts[n];
+                break;
+            }
+        }
+        bool opener = !f;
+        if (opener) {
+            f = talloc_zero(NULL, struct demux_fanout);
+            f->url = talloc_strdup(f, url);
+            f->opening = true;
+            mp_mutex_init(&f->lock);
+            mp_cond_init(&f->wakeup);
+            f->listed = true;
+            MP_TARRAY_APPEND(NULL, fanouts, num_fanouts, f);
+        }
+        f->refs++;
+        mp_mutex_unlock(&fanout_lock);
+
+        if (opener) {
+            struct demuxer *source = open_source(ctx, url, cancel);
+            if (source) {
+                int num_streams = demux_get_num_stream(source);
+                for (int n = 0; n < num_streams; n++) {
+                    demuxer_select_track(source, demux_get_stream(source, n),
+                                         MP_NOPTS_VALUE, true);
+                }
+            }
+            mp_mutex_lock(&f->lock);
+            f->source = source;
+            f->opening = false;
+            f->failed = !source && !mp_cancel_test(cancel);
+            if (source && !mp_thread_create(&f->thread, fanout_thread, f))
+                f->thread_running = true;
+            if (source && !f->thread_running)
+                f->failed = true;
+            mp_cond_broadcast(&f->wakeup);
+            mp_mutex_unlock(&f->lock);
+        }
+
+        mp_mutex_lock(&f->lock);
+        while (f->opening && !mp_cancel_test(cancel))
+            mp_cond_timedwait(&f->wakeup, &f->lock, MP_TIME_MS_TO_NS(100));
+        bool ok = !f->opening && f->thread_running && !f->eof;
+        bool opened = !f->opening;
+        bool failed = f->failed;
+        mp_mutex_unlock(&f->lock);
+
+        if (ok)
+            return f;
+
+        // Make sure nobody else uses a failed or ended source.
+        if (opened) {
+            mp_mutex_lock(&fanout_lock);
+            unlist_locked(f);
+            mp_mutex_unlock(&fanout_lock);
+        }
+        unref_fanout(f);
+        // If another reader's open was cancelled, or its source ended before
+        // this reader was added, try again with a new source.
+        if (failed || opener)
+            break;
+    }
+    return NULL;
+}
+
+struct demuxer *demux_fanout_open(const char *url,
+                                  demux_fanout_open_fn open_source, void *ctx,
+                                  struct demuxer_params *params,
+                                  struct mp_cancel *cancel,
+                                  struct mpv_global *global)
+{
+    struct demux_fanout *f = get_fanout(url, open_source, ctx, cancel);
+    if (!f)
+        return NULL;
+
+    // The reader takes over the reference if it's opened.
+    params->fanout = f;
+    struct demuxer *demuxer =
+        demux_open_fanout_reader(url, params, cancel, global);
+    if (params->fanout) {
+        params->fanout = NULL;
+        unref_fanout(f);
+    }
+    return demuxer;
+}
+
+static void copy_stream_info(struct sh_stream *dst, struct sh_stream *src)
+{
+    dst->demuxer_id = src->demuxer_id;
+    dst->ff_index = src->ff_index;
+    dst->title = talloc_strdup(dst, src->title);
+    dst->lang = talloc_strdup(dst, src->lang);
+    dst->default_track = src->default_track;
+    dst->forced_track = src->forced_track;
+    dst->dependent_track = src->dependent_track;
+    dst->visual_impaired_track = src->visual_impaired_track;
+    dst->hearing_impaired_track = src->hearing_impaired_track;
+    dst->image = src->image;
+    dst->still_image = src->still_image;
+    dst->hls_bitrate = src->hls_bitrate;
+    dst->program_id = src->program_id;
+    dst->missing_timestamps = src->missing_timestamps;
+    dst->seek_preroll = src->seek_preroll;
+    if (src->tags)
+        dst->tags = mp_tags_dup(dst, src->tags);
+}
+
+static int d_open(struct demuxer *demuxer, enum demux_check check)
+{
+    struct demux_fanout *f = demuxer->params ? demuxer->params->fanout : NULL;
+    if (!f || check != DEMUX_CHECK_FORCE)
+        return -1;
+    demuxer->params->fanout = NULL;
+
+    struct demuxer *source = f->source;
+    struct priv *p = demuxer->priv = talloc_zero(demuxer, struct priv);
+    struct fanout_reader *r = p->reader = talloc_zero(p, struct fanout_reader);
+    r->f = f;
+    r->log = demuxer->log;
+    r->pool = demuxer->packet_pool;
+
+    // The codec parameters are shared, and stay valid with the source.
+    int num_streams = demux_get_num_stream(source);
+    for (int n = 0; n < num_streams; n++) {
+        struct sh_stream *src = demux_get_stream(source, n);
+        struct sh_stream *sh = demux_alloc_sh_stream(src->type);
+        copy_stream_info(sh, src);
+        sh->codec = src->codec;
+        demux_add_sh_stream(demuxer, sh);
+    }
+    r->num_streams = num_streams;
+    r->need_keyframe = talloc_array(r, bool, num_streams);
+    for (int n = 0; n < num_streams; n++)
+        r->need_keyframe[n] = true;
+
+    demuxer->filetype = talloc_strdup(demuxer, source->filetype ?
+                                      source->filetype : source->desc->name);
+    demuxer->metadata = mp_tags_dup(demuxer, source->metadata);
+    demuxer->start_time = source->start_time;
+    demuxer->seekable = false;
+    demuxer->is_network = source->is_network;
+    demuxer->is_streaming = true;
+    demuxer->stream_origin = source->stream_origin;
+
+    mp_mutex_lock(&f->lock);
+    MP_TARRAY_APPEND(f, f->readers, f->num_readers, r);
+    int num_readers = f->num_readers;
+    mp_cond_broadcast(&f->wakeup);
+    mp_mutex_unlock(&f->lock);
+
+    MP_VERBOSE(demuxer, "Reading shared source (%d reader(s)).\n", num_readers);
+    return 0;
+}
+
+static bool d_read_packet(struct demuxer *demuxer, struct demux_packet **pkt)
+{
+    struct priv *p = demuxer->priv;
+    struct fanout_reader *r = p->reader;
+    struct demux_fanout *f = r->f;
+
+    mp_mutex_lock(&f->lock);
+    // Return without a packet now and then, so the demux thread can react
+    // to seeks and termination.
+    if (!r->head && !f->eof && !demux_cancel_test(demuxer))
+        mp_cond_timedwait(&f->wakeup, &f->lock, MP_TIME_MS_TO_NS(100));
+    bool eof = !r->head && f->eof;
+    struct demux_packet *dp = r->head;
+    if (dp) {
+        bool was_full = r->queued_bytes >= MAX_QUEUE_BYTES;
+        r->head = dp->next;
+        if (!r->head)
+            r->tail = NULL;
+        dp->next = NULL;
+        r->queued_bytes -= demux_packet_estimate_total_size(dp);
+        if (was_full)
+            mp_cond_broadcast(&f->wakeup);
+    }
+    mp_mutex_unlock(&f->lock);
+
+    *pkt = dp;
+    return !eof;
+}
+
+static void d_close(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+    if (!p || !p->reader)
+        return;
+    struct fanout_reader *r = p->reader;
+    struct demux_fanout *f = r->f;
+
+    mp_mutex_lock(&f->lock);
+    for (int n = 0; n < f->num_readers; n++) {
+        if (f->readers[n] == r) {
+            MP_TARRAY_REMOVE_AT(f->readers, f->num_readers, n);
+            break;
+        }
+    }
+    flush_reader_locked(r);
+    if (r->overflows)
+        MP_VERBOSE(demuxer, "Fell behind %d time(s).\n", r->overflows);
+    mp_cond_broadcast(&f->wakeup);
+    mp_mutex_unlock(&f->lock);
+
+    p->reader = NULL;
+    unref_fanout(f);
+}
+
+const demuxer_desc_t demuxer_desc_fanout = {
+    .name = "fanout",
+    .desc = "shared source reader",
+    .open = d_open,
+    .read_packet = d_read_packet,
+    .close = d_close,
+};
@@ -0,0 +1,51 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+struct demux_fanout;
+struct demuxer;
+struct demuxer_params;
+struct mp_cancel;
+struct mpv_global;
+
+/**
+ * Opens the source demuxer of a shared source. The demuxer must own its
+ * mpv_global (or share it with nothing that can go away before it), must not
+ * use the demux thread, and must not be a slave of cancel after returning.
+ * Returns NULL on failure.
+ */
+typedef struct demuxer *(*demux_fanout_open_fn)(void *ctx, const char *url,
+                                                struct mp_cancel *cancel);
+
+/**
+ * Opens a reader of the shared source for url. All readers of the same URL in
+ * the process share one source demuxer, which is opened with open_source() by
+ * the first reader, and freed when the last reader is freed. The source is
+ * read only once, at the pace of the fastest reader, and each reader gets
+ * references to the packets. A reader starts at the next keyframe of each
+ * stream, can't seek, and is restarted at the next keyframe if it falls too
+ * far behind. This is meant for live sources.
+ * The reader is a normal demuxer opened with params and global, and is freed
+ * with demux_free().
+ * Returns NULL on failure, or if cancel was triggered.
+ */
+struct demuxer *demux_fanout_open(const char *url,
+                                  demux_fanout_open_fn open_source, void *ctx,
+                                  struct demuxer_params *params,
+                                  struct mp_cancel *cancel,
+                                  struct mpv_global *global);
@@ -50,6 +50,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "hls_prefetch.h"
 #include "stheader.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -70,6 +71,7 @@ struct demux_lavf_opts {
     int probescore;
     float analyzeduration;
     int buffersize;
+    bool direct_io;
     bool allow_mimetype;
     char *format;
     char **avopts;
@@ -78,6 +80,7 @@ struct demux_lavf_opts {
     int rtsp_transport;
     int linearize_ts;
     bool propagate_opts;
+    int hls_prefetch;
 };
 
 const struct m_sub_options demux_lavf_conf = {
@@ -90,6 +93,7 @@ const struct m_sub_options demux_lavf_conf = {
          M_RANGE(0, 3600)},
         {"demuxer-lavf-buffersize", OPT_INT(buffersize),
          M_RANGE(1, 10 * 1024 * 1024), OPTDEF_INT(BIO_BUFFER_SIZE)},
+        {"demuxer-lavf-direct-io", OPT_BOOL(direct_io)},
         {"demuxer-lavf-allow-mimetype", OPT_BOOL(allow_mimetype)},
         {"demuxer-lavf-probescore", OPT_INT(probescore),
          M_RANGE(1, AVPROBE_SCORE_MAX)},
@@ -107,6 +111,7 @@ const struct m_sub_options demux_lavf_conf = {
         {"demuxer-lavf-linearize-timestamps", OPT_CHOICE(linearize_ts,
             {"no", 0}, {"auto", -1}, {"yes", 1})},
         {"demuxer-lavf-propagate-opts", OPT_BOOL(propagate_opts)},
+        {"demuxer-lavf-hls-prefetch", OPT_INT(hls_prefetch), M_RANGE(0, 16)},
         {0}
     },
     .size = sizeof(struct demux_lavf_opts),
@@ -256,6 +261,7 @@ typedef struct lavf_priv {
     int (*default_io_open)(struct AVFormatContext *s, AVIOContext **pb,
                            const char *url, int flags, AVDictionary **options);
     int (*default_io_close2)(struct AVFormatContext *s, AVIOContext *pb);
+    struct hls_prefetch *prefetch; // --demuxer-lavf-hls-prefetch
 } lavf_priv_t;
 
 static void update_read_stats(struct demuxer *demuxer)
@@ -270,6 +276,11 @@ static void update_read_stats(struct demuxer *demuxer)
         nest->last_bytes = cur;
         demux_report_unbuffered_read_bytes(demuxer, new);
     }
+
+    if (priv->prefetch) {
+        demux_report_unbuffered_read_bytes(demuxer,
+                                hls_prefetch_get_read_bytes(priv->prefetch));
+    }
 }
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -939,6 +950,24 @@ static int nested_io_open(struct AVFormatContext *s, AVIOContext **pb,
         }
     }
 
+    if (priv->prefetch && !(flags & AVIO_FLAG_WRITE)) {
+        // Prefetched segments are opened without libavformat's io_open, so
+        // the protocol restrictions have to be passed as options.
+        AVDictionary *opts = NULL;
+        if (options)
+            av_dict_copy(&opts, *options, 0);
+        if (s->protocol_whitelist)
+            av_dict_set(&opts, "protocol_whitelist", s->protocol_whitelist, 0);
+        if (s->protocol_blacklist)
+            av_dict_set(&opts, "protocol_blacklist", s->protocol_blacklist, 0);
+        AVIOContext *mem = hls_prefetch_open(priv->prefetch, url, opts);
+        av_dict_free(&opts);
+        if (mem) {
+            *pb = mem;
+            return 0;
+        }
+    }
+
     int r = priv->default_io_open(s, pb, url, flags, options);
     if (r >= 0) {
         if (options)
@@ -957,6 +986,9 @@ static int nested_io_close2(struct AVFormatContext *s, AVIOContext *pb)
     mp_require(demuxer);
     lavf_priv_t *priv = demuxer->priv;
 
+    if (priv->prefetch && hls_prefetch_close(priv->prefetch, pb))
+        return 0;
+
     for (int n = 0; n < priv->num_nested; n++) {
         if (priv->nested[n].id == pb) {
             MP_TARRAY_REMOVE_AT(priv->nested, priv->num_nested, n);
@@ -1037,6 +1069,12 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         }
         priv->pb->read_seek = mp_read_seek;
         priv->pb->seekable = demuxer->seekable ? AVIO_SEEKABLE_NORMAL : 0;
+        // Let avio_read() read packet data straight from the stream buffer
+        // (or for large reads, straight from the stream), skipping the copy
+        // into the AVIO buffer. avio_seek() then always calls mp_seek(), which
+        // is cheap as long as the target is within the stream buffer.
+        if (lavfdopts->direct_io && demuxer->seekable)
+            priv->pb->direct = 1;
         avfc->pb = priv->pb;
         if (stream_control(priv->stream, STREAM_CTRL_HAS_AVSEEK, NULL) > 0)
             demuxer->seekable = true;
@@ -1072,6 +1110,19 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         avfc->io_open = block_io_open;
     }
 
+    if (demuxer->access_references && lavfdopts->hls_prefetch > 0 &&
+        matches_avinputformat_name(priv, "hls"))
+    {
+        priv->prefetch = hls_prefetch_create(demuxer->log, demuxer->cancel,
+                                             priv->filename,
+                                             lavfdopts->hls_prefetch,
+                                             demuxer->opts->max_bytes / 2);
+        // Persistent connections reuse the AVIOContext of the previous
+        // segment for the next request, which can't work with prefetched
+        // segments.
+        av_dict_set(&dopts, "http_persistent", "0", 0);
+    }
+
     mp_set_avdict(&dopts, lavfdopts->avopts);
 
     if (av_dict_copy(&priv->av_opts, dopts, 0) < 0) {
@@ -1418,6 +1469,7 @@ static void demux_close_lavf(demuxer_t *demuxer)
         // This will be a dangling pointer; but see below.
         AVIOContext *leaking = priv->avfc ? priv->avfc->pb : NULL;
         avformat_close_input(&priv->avfc);
+        hls_prefetch_destroy(priv->prefetch);
         // The ffmpeg garbage breaks its own API yet again: hls.c will call
         // io_open on the main playlist, but never calls io_close. This happens
         // to work out for us (since we don't really use custom I/O), but it's
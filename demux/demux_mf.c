@@ -30,6 +30,8 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -46,8 +48,29 @@ typedef struct mf {
     char **names;
     // optional
     struct stream **streams;
+
+    // --mf-readahead
+    struct mp_thread_pool *pool;
+    int readahead;
+    mp_mutex lock;
+    mp_cond wakeup;
+    struct mf_job **jobs;
+    int num_jobs;
 } mf_t;
 
+// A file read by a worker thread.
+struct mf_job {
+    mf_t *mf;
+    int frame;
+    char *filename;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    int stream_origin;
+    // Protected by mf_t.lock.
+    bool done;
+    bstr data;
+};
+
 
 static void mf_add(mf_t *mf, const char *fname)
 {
@@ -237,6 +260,89 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
     mf->curr_frame = MPCLAMP((int)newpos, 0, mf->nr_of_files);
 }
 
+static void read_job(void *ptr)
+{
+    struct mf_job *job = ptr;
+
+    struct stream *stream = stream_create(job->filename,
+                                          job->stream_origin | STREAM_READ,
+                                          job->cancel, job->global);
+    bstr data = {0};
+    if (stream)
+        data = stream_read_complete(stream, job, MF_MAX_FILE_SIZE);
+    free_stream(stream);
+
+    mf_t *mf = job->mf;
+    mp_mutex_lock(&mf->lock);
+    job->data = data;
+    job->done = true;
+    mp_cond_broadcast(&mf->wakeup);
+    mp_mutex_unlock(&mf->lock);
+}
+
+// Drop finished jobs outside of the readahead range, and queue jobs for the
+// files in it. Jobs that are still running can't be stopped, and are kept
+// until they are done.
+static void update_readahead(struct demuxer *demuxer, mf_t *mf)
+{
+    int first = mf->curr_frame;
+    int last = MPMIN(first + mf->readahead, mf->nr_of_files);
+
+    mp_mutex_lock(&mf->lock);
+    for (int n = mf->num_jobs - 1; n >= 0; n--) {
+        struct mf_job *job = mf->jobs[n];
+        if (job->done && (job->frame < first || job->frame >= last)) {
+            talloc_free(job);
+            MP_TARRAY_REMOVE_AT(mf->jobs, mf->num_jobs, n);
+        }
+    }
+    mp_mutex_unlock(&mf->lock);
+
+    for (int frame = first; frame < last; frame++) {
+        if (mf->num_jobs >= mf->readahead * 2)
+            break;
+        bool queued = false;
+        for (int n = 0; n < mf->num_jobs; n++)
+            queued |= mf->jobs[n]->frame == frame;
+        if (queued || !mf->names[frame])
+            continue;
+        struct mf_job *job = talloc_zero(NULL, struct mf_job);
+        *job = (struct mf_job){
+            .mf = mf,
+            .frame = frame,
+            .filename = mf->names[frame],
+            .global = demuxer->global,
+            .cancel = demuxer->cancel,
+            .stream_origin = demuxer->stream_origin,
+        };
+        if (!mp_thread_pool_queue(mf->pool, read_job, job)) {
+            talloc_free(job);
+            break;
+        }
+        MP_TARRAY_APPEND(mf, mf->jobs, mf->num_jobs, job);
+    }
+}
+
+// Return the data of the current frame if it was queued for readahead.
+static bool get_readahead_data(mf_t *mf, bstr *out)
+{
+    for (int n = 0; n < mf->num_jobs; n++) {
+        struct mf_job *job = mf->jobs[n];
+        if (job->frame != mf->curr_frame)
+            continue;
+        mp_mutex_lock(&mf->lock);
+        while (!job->done)
+            mp_cond_wait(&mf->wakeup, &mf->lock);
+        mp_mutex_unlock(&mf->lock);
+        *out = job->data;
+        talloc_steal(NULL, job->data.start);
+        talloc_free(job);
+        MP_TARRAY_REMOVE_AT(mf->jobs, mf->num_jobs, n);
+        return true;
+    }
+    return false;
+}
+
 static bool demux_mf_read_packet(struct demuxer *demuxer,
                                  struct demux_packet **pkt)
 {
@@ -245,11 +351,18 @@ static bool demux_mf_read_packet(struct demuxer *demuxer,
         return false;
     bool ok = false;
 
+    bstr data = {0};
+    bool have_data = false;
+    if (mf->pool) {
+        update_readahead(demuxer, mf);
+        have_data = get_readahead_data(mf, &data);
+    }
+
     struct stream *entry_stream = NULL;
     if (mf->streams)
         entry_stream = mf->streams[mf->curr_frame];
     struct stream *stream = entry_stream;
-    if (!stream) {
+    if (!stream && !have_data) {
         char *filename = mf->names[mf->curr_frame];
         if (filename) {
             stream = stream_create(filename, demuxer->stream_origin | STREAM_READ,
@@ -259,20 +372,21 @@ static bool demux_mf_read_packet(struct demuxer *demuxer,
 
     if (stream) {
         stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(demuxer->packet_pool, data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                dp->stream = mf->sh->index;
-                *pkt = dp;
-                ok = true;
-            }
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+    }
+
+    if (data.len) {
+        demux_packet_t *dp = new_demux_packet(demuxer->packet_pool, data.len);
+        if (dp) {
+            memcpy(dp->buffer, data.start, data.len);
+            dp->pts = mf->curr_frame / mf->sh->codec->fps;
+            dp->keyframe = true;
+            dp->stream = mf->sh->index;
+            *pkt = dp;
+            ok = true;
         }
-        talloc_free(data.start);
     }
+    talloc_free(data.start);
 
     if (stream && stream != entry_stream)
         free_stream(stream);
@@ -414,6 +528,13 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demuxer->seekable = true;
     demuxer->duration = mf->nr_of_files / mf->sh->codec->fps;
 
+    mf->readahead = demuxer->opts->mf_readahead;
+    if (mf->readahead > 0 && !mf->streams && mf->nr_of_files > 1) {
+        mf->pool = mp_thread_pool_create(NULL, 0, 0, mf->readahead);
+        mp_mutex_init(&mf->lock);
+        mp_cond_init(&mf->wakeup);
+    }
+
     return 0;
 
 error:
@@ -422,6 +543,16 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (!mf || !mf->pool)
+        return;
+
+    // Waits until all jobs are done.
+    talloc_free(mf->pool);
+    for (int n = 0; n < mf->num_jobs; n++)
+        talloc_free(mf->jobs[n]);
+    mp_cond_destroy(&mf->wakeup);
+    mp_mutex_destroy(&mf->lock);
 }
 
 const demuxer_desc_t demuxer_desc_mf = {
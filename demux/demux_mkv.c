@@ -27,12 +27,15 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
 #include <libavutil/common.h>
 #include <libavutil/dovi_meta.h>
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/avstring.h>
+#include <libavutil/md5.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -51,6 +54,11 @@
 #include "options/m_option.h"
 #include "options/options.h"
 #include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "misc/thread_tools.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -201,6 +209,12 @@ typedef struct mkv_demuxer {
     mkv_index_t *indexes;
     size_t num_indexes;
     bool index_complete;
+    struct mkv_indexer *indexer; // --demuxer-mkv-background-index
+
+    // --demuxer-mkv-defer-attachments
+    bool defer_attachments;
+    int64_t attachments_pos; // position of the skipped Attachments, or 0
+    struct mkv_attachment_loader *attachment_loader;
 
     int edition_id;
 
@@ -240,6 +254,9 @@ struct demux_mkv_opts {
     int probe_duration;
     bool probe_start_time;
     bool crop_compat;
+    bool background_index;
+    bool index_cache;
+    bool defer_attachments;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -254,6 +271,9 @@ const struct m_sub_options demux_mkv_conf = {
             {"no", 0}, {"yes", 1}, {"full", 2})},
         {"probe-start-time", OPT_BOOL(probe_start_time)},
         {"crop-compat", OPT_BOOL(crop_compat)},
+        {"background-index", OPT_BOOL(background_index)},
+        {"index-cache", OPT_BOOL(index_cache)},
+        {"defer-attachments", OPT_BOOL(defer_attachments)},
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -280,6 +300,8 @@ static void probe_last_timestamp(struct demuxer *demuxer, int64_t start_pos);
 static void probe_first_timestamp(struct demuxer *demuxer);
 static int read_next_block_into_queue(demuxer_t *demuxer);
 static void free_block(struct block_info *block);
+static void start_indexer(struct demuxer *demuxer);
+static void stop_indexer(struct demuxer *demuxer);
 
 static void add_packet(struct demuxer *demuxer, struct sh_stream *stream,
                        struct demux_packet *pkt)
@@ -467,6 +489,9 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
         } else {
             memcpy(demuxer->matroska_data.uid.segment, info.segment_uid.start,
                    len);
+            if (demuxer->params && demuxer->params->matroska_seen_uid)
+                memcpy(demuxer->params->matroska_seen_uid,
+                       info.segment_uid.start, len);
             MP_DBG(demuxer, "| + segment uid");
             for (size_t i = 0; i < len; i++)
                 MP_DBG(demuxer, " %02x",
@@ -1347,20 +1372,11 @@ static void process_tags(demuxer_t *demuxer)
     }
 }
 
-static int demux_mkv_read_attachments(demuxer_t *demuxer)
+static void add_attachments(demuxer_t *demuxer,
+                            struct ebml_attachments *attachments)
 {
-    stream_t *s = demuxer->stream;
-
-    MP_DBG(demuxer, "Parsing attachments...\n");
-
-    struct ebml_attachments attachments = {0};
-    struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &attachments,
-                          &ebml_attachments_desc) < 0)
-        return -1;
-
-    for (int i = 0; i < attachments.n_attached_file; i++) {
-        struct ebml_attached_file *attachment = &attachments.attached_file[i];
+    for (int i = 0; i < attachments->n_attached_file; i++) {
+        struct ebml_attached_file *attachment = &attachments->attached_file[i];
         if (!attachment->file_name || !attachment->file_mime_type
             || !attachment->n_file_data) {
             MP_WARN(demuxer, "Malformed attachment\n");
@@ -1373,6 +1389,21 @@ static int demux_mkv_read_attachments(demuxer_t *demuxer)
         MP_DBG(demuxer, "Attachment: %s, %s, %zu bytes\n",
                name, mime, attachment->file_data.len);
     }
+}
+
+static int demux_mkv_read_attachments(demuxer_t *demuxer)
+{
+    stream_t *s = demuxer->stream;
+
+    MP_DBG(demuxer, "Parsing attachments...\n");
+
+    struct ebml_attachments attachments = {0};
+    struct ebml_parse_ctx parse_ctx = {demuxer->log};
+    if (ebml_read_element(s, &parse_ctx, &attachments,
+                          &ebml_attachments_desc) < 0)
+        return -1;
+
+    add_attachments(demuxer, &attachments);
 
     talloc_free(parse_ctx.talloc_ctx);
     return 0;
@@ -1450,6 +1481,8 @@ static int demux_mkv_read_seekhead(demuxer_t *demuxer)
 static int read_header_element(struct demuxer *demuxer, uint32_t id,
                                int64_t start_filepos)
 {
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+
     if (id == EBML_ID_INVALID)
         return 0;
 
@@ -1470,6 +1503,10 @@ static int read_header_element(struct demuxer *demuxer, uint32_t id,
     case MATROSKA_ID_CHAPTERS:
         return demux_mkv_read_chapters(demuxer);
     case MATROSKA_ID_ATTACHMENTS:
+        if (mkv_d->defer_attachments) {
+            mkv_d->attachments_pos = start_filepos;
+            break;
+        }
         return demux_mkv_read_attachments(demuxer);
     }
 skip:
@@ -1538,6 +1575,100 @@ static void add_coverart(struct demuxer *demuxer)
     }
 }
 
+// Reads a deferred Attachments element with its own stream.
+struct mkv_attachment_loader {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    mp_thread thread;
+    char *url;
+    int stream_origin;
+    int64_t pos;
+    atomic_bool done;
+    // Result, accessed only after done is set.
+    bool ok;
+    struct ebml_attachments attachments;
+    struct ebml_parse_ctx parse_ctx;
+};
+
+static MP_THREAD_VOID attachment_loader_thread(void *ptr)
+{
+    struct mkv_attachment_loader *ld = ptr;
+    mp_thread_set_name("mkv-attachments");
+
+    struct stream *s = stream_create(ld->url, STREAM_READ | STREAM_LOCAL_FS_ONLY |
+                                     STREAM_SILENT | ld->stream_origin,
+                                     ld->cancel, ld->global);
+    ld->parse_ctx = (struct ebml_parse_ctx){ld->log};
+    ld->ok = s && stream_seek(s, ld->pos) &&
+             ebml_read_id(s) == MATROSKA_ID_ATTACHMENTS &&
+             ebml_read_element(s, &ld->parse_ctx, &ld->attachments,
+                               &ebml_attachments_desc) >= 0;
+    free_stream(s);
+
+    atomic_store(&ld->done, true);
+    MP_THREAD_RETURN();
+}
+
+static void start_attachment_loader(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+
+    if (!mkv_d->attachments_pos)
+        return;
+
+    struct mkv_attachment_loader *ld =
+        talloc_zero(mkv_d, struct mkv_attachment_loader);
+    *ld = (struct mkv_attachment_loader){
+        .global = demuxer->global,
+        .log = demuxer->log,
+        .cancel = mp_cancel_new(ld),
+        .url = talloc_strdup(ld, demuxer->stream->url),
+        .stream_origin = demuxer->stream_origin,
+        .pos = mkv_d->attachments_pos,
+    };
+    mp_cancel_set_parent(ld->cancel, demuxer->cancel);
+
+    if (mp_thread_create(&ld->thread, attachment_loader_thread, ld)) {
+        mp_cancel_set_parent(ld->cancel, NULL);
+        talloc_free(ld);
+        return;
+    }
+    MP_VERBOSE(demuxer, "Deferring reading attachments.\n");
+    mkv_d->attachment_loader = ld;
+}
+
+// Wait for the loader to finish. If apply is true, add the attachments it has
+// read, and notify the user. Otherwise, the loader is cancelled.
+static void stop_attachment_loader(struct demuxer *demuxer, bool apply)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_attachment_loader *ld = mkv_d->attachment_loader;
+
+    if (!ld)
+        return;
+    if (!apply)
+        mp_cancel_trigger(ld->cancel);
+    mp_thread_join(ld->thread);
+    mp_cancel_set_parent(ld->cancel, NULL);
+
+    if (apply && ld->ok) {
+        add_attachments(demuxer, &ld->attachments);
+        MP_VERBOSE(demuxer, "Read %d deferred attachments.\n",
+                   demuxer->num_attachments);
+        if (demuxer->num_attachments) {
+            add_coverart(demuxer);
+            demux_attachments_changed(demuxer);
+        }
+    } else if (apply) {
+        MP_WARN(demuxer, "Failed to read deferred attachments.\n");
+    }
+
+    talloc_free(ld->parse_ctx.talloc_ctx);
+    talloc_free(ld);
+    mkv_d->attachment_loader = NULL;
+}
+
 static void init_track(demuxer_t *demuxer, mkv_track_t *track,
                        struct sh_stream *sh)
 {
@@ -2435,6 +2566,11 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 
     mkv_d->opts = mp_get_config_group(mkv_d, demuxer->global, &demux_mkv_conf);
 
+    // Only the player's own demuxer notifies the user about late attachments.
+    mkv_d->defer_attachments = mkv_d->opts->defer_attachments &&
+        s->seekable && s->is_local_fs &&
+        demuxer->params && demuxer->params->is_top_level;
+
     if (demuxer->params && demuxer->params->matroska_was_valid)
         *demuxer->params->matroska_was_valid = true;
 
@@ -2466,6 +2602,11 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
         struct header_elem *elem = &mkv_d->headers[n];
         if (elem->parsed)
             continue;
+        if (elem->id == MATROSKA_ID_ATTACHMENTS && mkv_d->defer_attachments) {
+            elem->parsed = true;
+            mkv_d->attachments_pos = elem->pos;
+            continue;
+        }
         // Warn against incomplete files and skip headers outside of range.
         if (elem->pos >= end || !s->seekable) {
             elem->parsed = true; // don't bother if file is incomplete
@@ -2509,6 +2650,18 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
         }
     }
 
+    // Ordered chapters are turned into a timeline on opening, which takes the
+    // attachments only once.
+    if (mkv_d->attachments_pos && demuxer->matroska_data.ordered_chapters) {
+        struct header_elem *elem = get_header_element(demuxer,
+                            MATROSKA_ID_ATTACHMENTS, mkv_d->attachments_pos);
+        mkv_d->defer_attachments = false;
+        mkv_d->attachments_pos = 0;
+        elem->parsed = false;
+        if (read_deferred_element(demuxer, elem) < 0)
+            return -1;
+    }
+
     if (!stream_seek(s, start_pos)) {
         MP_ERR(demuxer, "Couldn't seek back after reading headers?\n");
         return -1;
@@ -2525,6 +2678,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
         probe_last_timestamp(demuxer, start_pos);
     probe_x264_garbage(demuxer);
     probe_if_image(demuxer);
+    start_indexer(demuxer);
+    start_attachment_loader(demuxer);
 
     return 0;
 }
@@ -2596,26 +2751,39 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
         }
     }
 
+    uint64_t total = 0;
+    for (int i = 0; i < laces; i++)
+        total += lace_size[i];
+    if (stream_tell(s) + total != endpos || total > (1 << 30))
+        goto error;
+
+    // Read the data of all laces with one read into one buffer. Each lace
+    // references a slice of it, like libavformat does. Only the last lace is
+    // followed by zeroed padding, the others by the next lace's data.
+    int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
+    int len = total;
+    AVBufferRef *buf = av_buffer_alloc(len + pad);
+    if (!buf)
+        goto error;
+    if (stream_read(s, buf->data, len) != len) {
+        av_buffer_unref(&buf);
+        goto error;
+    }
+    memset(buf->data + len, 0, pad);
+
+    uint8_t *data = buf->data;
     for (int i = 0; i < laces; i++) {
-        uint32_t size = lace_size[i];
-        if (stream_tell(s) + size > endpos || size > (1 << 30))
-            goto error;
-        int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
-        if (!buf)
-            goto error;
-        buf->size = size;
-        if (stream_read(s, buf->data, buf->size) != buf->size) {
+        AVBufferRef *lace = i == laces - 1 ? buf : av_buffer_ref(buf);
+        if (!lace) {
             av_buffer_unref(&buf);
             goto error;
         }
-        memset(buf->data + buf->size, 0, pad);
-        block->laces[block->num_laces++] = buf;
+        lace->data = data;
+        lace->size = lace_size[i];
+        data += lace_size[i];
+        block->laces[block->num_laces++] = lace;
     }
 
-    if (stream_tell(s) != endpos)
-        goto error;
-
     return 0;
 
  error:
@@ -3320,6 +3488,9 @@ static bool demux_mkv_read_packet(struct demuxer *demuxer,
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
 
+    if (mkv_d->attachment_loader && atomic_load(&mkv_d->attachment_loader->done))
+        stop_attachment_loader(demuxer, true);
+
     for (;;) {
         if (mkv_d->num_packets) {
             *pkt = mkv_d->packets[0];
@@ -3330,8 +3501,11 @@ static bool demux_mkv_read_packet(struct demuxer *demuxer,
         int res;
         struct block_info block;
         res = read_next_block(demuxer, &block);
-        if (res < 0)
+        if (res < 0) {
+            // Don't leave the attachments missing at EOF.
+            stop_attachment_loader(demuxer, true);
             return false;
+        }
         if (res > 0) {
             handle_block(demuxer, &block);
             free_block(&block);
@@ -3356,6 +3530,443 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
     return index;
 }
 
+// Background indexing for files without Cues (--demuxer-mkv-background-index).
+// A thread reads the file with its own stream, parsing only cluster and block
+// headers and skipping the block data, and records the first keyframe of each
+// track in each cluster. Seeks use the entries found so far, and wait for the
+// thread if the target is beyond them. The complete index can be stored in the
+// cache directory (--demuxer-mkv-index-cache).
+
+#define INDEX_CACHE_MAGIC "mpvmkvi1"
+
+struct index_cache_header {
+    char magic[8];
+    int64_t file_size, file_mtime;
+    int64_t segment_start;
+    uint64_t num_entries;
+};
+
+struct index_cache_entry {
+    int64_t timecode, duration;
+    uint64_t filepos;
+    int32_t tnum, pad;
+};
+
+struct mkv_indexer {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    mp_thread thread;
+    char *url;
+    int stream_origin;
+    bool use_cache;
+    int64_t cluster_start, segment_start, segment_end;
+    int *tnums;
+    int num_tnums;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    // Protected by lock.
+    mkv_index_t *entries;
+    size_t num_entries;
+    int64_t done_timecode;  // clusters before this (in tc_scale units) done
+    bool complete, failed;
+};
+
+static char *index_cache_file(void *ta_ctx, struct mpv_global *global,
+                              const char *url)
+{
+    char *dir = mp_find_user_file(NULL, global, "cache", "mkv-index");
+    if (!dir || !dir[0]) {
+        talloc_free(dir);
+        return NULL;
+    }
+    mp_mkdirp(dir);
+
+    uint8_t md5[16];
+    av_md5_sum(md5, url, strlen(url));
+    char *name = talloc_strdup(NULL, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+    char *path = mp_path_join(ta_ctx, dir, name);
+    talloc_free(name);
+    talloc_free(dir);
+    return path;
+}
+
+static bool index_cache_init_header(struct index_cache_header *hdr,
+                                    const char *path, int64_t segment_start)
+{
+    struct stat st;
+    if (!path || stat(path, &st) != 0)
+        return false;
+    *hdr = (struct index_cache_header){
+        .magic = INDEX_CACHE_MAGIC,
+        .file_size = st.st_size,
+        .file_mtime = st.st_mtime,
+        .segment_start = segment_start,
+    };
+    return true;
+}
+
+// Load the index of the current file from the cache. Returns success.
+static bool load_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct stream *s = demuxer->stream;
+    struct index_cache_header ref, hdr;
+
+    if (!index_cache_init_header(&ref, s->path, mkv_d->segment_start))
+        return false;
+
+    char *path = index_cache_file(NULL, demuxer->global, s->url);
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    talloc_free(path);
+    if (!f)
+        return false;
+
+    bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+              memcmp(&hdr, &ref, offsetof(struct index_cache_header,
+                                          num_entries)) == 0 &&
+              hdr.num_entries > 0 && hdr.num_entries < (1 << 26);
+    for (uint64_t n = 0; ok && n < hdr.num_entries; n++) {
+        struct index_cache_entry e;
+        ok = fread(&e, sizeof(e), 1, f) == 1;
+        if (ok)
+            cue_index_add(demuxer, e.tnum, e.filepos, e.timecode, e.duration);
+    }
+    fclose(f);
+
+    if (!ok) {
+        mkv_d->num_indexes = 0;
+        return false;
+    }
+    MP_VERBOSE(demuxer, "Loaded %zu cached index entries.\n",
+               mkv_d->num_indexes);
+    mkv_d->index_has_durations = true;
+    mkv_d->index_complete = true;
+    return true;
+}
+
+static void write_index_cache(struct mkv_indexer *ix, const char *file)
+{
+    struct index_cache_header hdr;
+    if (!index_cache_init_header(&hdr, file, ix->segment_start))
+        return;
+    hdr.num_entries = ix->num_entries;
+
+    char *path = index_cache_file(NULL, ix->global, ix->url);
+    if (!path)
+        return;
+    char *tmp_path = talloc_asprintf(path, "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f)
+        goto done;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (size_t n = 0; ok && n < ix->num_entries; n++) {
+        mkv_index_t *cur = &ix->entries[n];
+        struct index_cache_entry e = {
+            .timecode = cur->timecode,
+            .duration = cur->duration,
+            .filepos = cur->filepos,
+            .tnum = cur->tnum,
+        };
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        mp_warn(ix->log, "Could not write index cache file %s.\n", path);
+        unlink(tmp_path);
+        goto done;
+    }
+    mp_verbose(ix->log, "Stored index in %s.\n", path);
+done:
+    talloc_free(path);
+}
+
+struct index_cluster {
+    int64_t *last_tc;   // per ix->tnums entry, last added timecode
+    bool *found;        // per ix->tnums entry, keyframe found in this cluster
+    mkv_index_t *entries;
+    int num_entries;
+};
+
+static void index_cluster_add(struct mkv_indexer *ix, struct index_cluster *c,
+                              uint64_t filepos, uint64_t tnum, int64_t tc,
+                              int64_t duration)
+{
+    for (int n = 0; n < ix->num_tnums; n++) {
+        if (ix->tnums[n] != (int64_t)tnum)
+            continue;
+        if (!c->found[n] && tc > c->last_tc[n]) {
+            c->found[n] = true;
+            c->last_tc[n] = tc;
+            MP_TARRAY_APPEND(ix, c->entries, c->num_entries, (mkv_index_t){
+                .tnum = tnum,
+                .timecode = tc,
+                .duration = duration,
+                .filepos = filepos,
+            });
+        }
+        break;
+    }
+}
+
+// Read the Block header at the current position (after the length field),
+// and skip to end.
+static bool index_read_block_header(struct stream *s, uint64_t end,
+                                    uint64_t *tnum, int16_t *time, int *flags)
+{
+    *tnum = ebml_read_length(s);
+    if (*tnum == EBML_UINT_INVALID || stream_tell(s) + 3 > end)
+        return false;
+    uint8_t c1 = stream_read_char(s);
+    uint8_t c2 = stream_read_char(s);
+    *time = c1 << 8 | c2;
+    *flags = stream_read_char(s);
+    return stream_seek(s, end);
+}
+
+// Index the cluster whose contents start at the current position. Returns
+// false on errors.
+static bool index_cluster(struct mkv_indexer *ix, struct stream *s,
+                          struct index_cluster *c, uint64_t cluster_pos,
+                          uint64_t end, int64_t *cluster_tc)
+{
+    memset(c->found, 0, ix->num_tnums * sizeof(c->found[0]));
+    c->num_entries = 0;
+    *cluster_tc = 0;
+
+    while (stream_tell(s) < end) {
+        uint32_t id = ebml_read_id(s);
+        if (id == EBML_ID_INVALID || id == MATROSKA_ID_CLUSTER)
+            return false;
+        if (id == MATROSKA_ID_TIMECODE) {
+            uint64_t num = ebml_read_uint(s);
+            if (num == EBML_UINT_INVALID)
+                return false;
+            *cluster_tc = num;
+        } else if (id == MATROSKA_ID_SIMPLEBLOCK) {
+            uint64_t len = ebml_read_length(s);
+            if (len == EBML_UINT_INVALID || stream_tell(s) + len > end)
+                return false;
+            uint64_t tnum;
+            int16_t time;
+            int flags;
+            if (!index_read_block_header(s, stream_tell(s) + len, &tnum,
+                                         &time, &flags))
+                return false;
+            if (flags & 0x80)
+                index_cluster_add(ix, c, cluster_pos, tnum, *cluster_tc + time, 0);
+        } else if (id == MATROSKA_ID_BLOCKGROUP) {
+            uint64_t len = ebml_read_length(s);
+            if (len == EBML_UINT_INVALID || stream_tell(s) + len > end)
+                return false;
+            uint64_t group_end = stream_tell(s) + len;
+            bool keyframe = true, have_block = false;
+            uint64_t tnum = 0, duration = 0;
+            int16_t time = 0;
+            while (stream_tell(s) < group_end) {
+                uint32_t gid = ebml_read_id(s);
+                if (gid == MATROSKA_ID_BLOCK) {
+                    uint64_t blen = ebml_read_length(s);
+                    int flags;
+                    if (blen == EBML_UINT_INVALID ||
+                        stream_tell(s) + blen > group_end ||
+                        !index_read_block_header(s, stream_tell(s) + blen,
+                                                 &tnum, &time, &flags))
+                        return false;
+                    have_block = true;
+                } else if (gid == MATROSKA_ID_REFERENCEBLOCK) {
+                    if (ebml_read_int(s) == EBML_INT_INVALID)
+                        return false;
+                    keyframe = false;
+                } else if (gid == MATROSKA_ID_BLOCKDURATION) {
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        return false;
+                } else if (gid == EBML_ID_INVALID ||
+                           ebml_read_skip(ix->log, group_end, s) != 0) {
+                    return false;
+                }
+            }
+            if (have_block && keyframe)
+                index_cluster_add(ix, c, cluster_pos, tnum, *cluster_tc + time,
+                                  duration);
+        } else if (ebml_read_skip(ix->log, end, s) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static MP_THREAD_VOID indexer_thread(void *ptr)
+{
+    struct mkv_indexer *ix = ptr;
+    mp_thread_set_name("mkv-index");
+
+    struct stream *s = stream_create(ix->url, STREAM_READ | STREAM_LOCAL_FS_ONLY |
+                                     STREAM_SILENT | ix->stream_origin,
+                                     ix->cancel, ix->global);
+    struct index_cluster c = {
+        .last_tc = talloc_zero_array(ix, int64_t, ix->num_tnums),
+        .found = talloc_zero_array(ix, bool, ix->num_tnums),
+    };
+    for (int n = 0; n < ix->num_tnums; n++)
+        c.last_tc[n] = INT64_MIN;
+    bool ok = s && stream_seek(s, ix->cluster_start);
+    bool complete = false;
+    int64_t start = mp_time_ns();
+
+    while (ok && !complete && !mp_cancel_test(ix->cancel)) {
+        uint64_t pos = stream_tell(s);
+        uint32_t id = ebml_read_id(s);
+        if (s->eof || pos >= ix->segment_end || id == EBML_ID_EBML) {
+            complete = true;
+        } else if (id == MATROSKA_ID_CLUSTER) {
+            uint64_t len = ebml_read_length(s);
+            int64_t tc;
+            // Clusters of unknown size would require full parsing.
+            ok = len != EBML_UINT_INVALID &&
+                 index_cluster(ix, s, &c, pos, stream_tell(s) + len, &tc);
+            if (ok) {
+                mp_mutex_lock(&ix->lock);
+                for (int n = 0; n < c.num_entries; n++)
+                    MP_TARRAY_APPEND(ix, ix->entries, ix->num_entries,
+                                     c.entries[n]);
+                ix->done_timecode = tc;
+                mp_cond_broadcast(&ix->wakeup);
+                mp_mutex_unlock(&ix->lock);
+            }
+        } else if (ebml_is_mkv_level1_id(id) || id == EBML_ID_VOID) {
+            ok = ebml_read_skip(ix->log, -1, s) == 0;
+        } else {
+            ok = false;
+        }
+    }
+
+    mp_mutex_lock(&ix->lock);
+    ix->complete = ok && complete;
+    ix->failed = !ix->complete;
+    mp_cond_broadcast(&ix->wakeup);
+    mp_mutex_unlock(&ix->lock);
+
+    if (ix->complete) {
+        mp_verbose(ix->log, "Index with %zu entries created in %.3f s.\n",
+                   ix->num_entries, MP_TIME_NS_TO_S(mp_time_ns() - start));
+        if (ix->use_cache && ix->num_entries)
+            write_index_cache(ix, s->path);
+    } else if (!mp_cancel_test(ix->cancel)) {
+        mp_verbose(ix->log, "Background indexing failed.\n");
+    }
+
+    free_stream(s);
+    MP_THREAD_RETURN();
+}
+
+static void start_indexer(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct stream *s = demuxer->stream;
+
+    if (!mkv_d->opts->background_index || demuxer->opts->index_mode != 1 ||
+        mkv_d->index_complete || !s->seekable || !s->is_local_fs ||
+        !mkv_d->num_tracks)
+        return;
+
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return;
+    }
+
+    if (mkv_d->opts->index_cache && load_index_cache(demuxer))
+        return;
+
+    struct mkv_indexer *ix = talloc_zero(mkv_d, struct mkv_indexer);
+    *ix = (struct mkv_indexer){
+        .global = demuxer->global,
+        .log = demuxer->log,
+        .cancel = mp_cancel_new(ix),
+        .url = talloc_strdup(ix, s->url),
+        .stream_origin = demuxer->stream_origin,
+        .use_cache = mkv_d->opts->index_cache,
+        .cluster_start = mkv_d->cluster_start,
+        .segment_start = mkv_d->segment_start,
+        .segment_end = mkv_d->segment_end,
+    };
+    for (int n = 0; n < mkv_d->num_tracks; n++)
+        MP_TARRAY_APPEND(ix, ix->tnums, ix->num_tnums, mkv_d->tracks[n]->tnum);
+    mp_mutex_init(&ix->lock);
+    mp_cond_init(&ix->wakeup);
+    mp_cancel_set_parent(ix->cancel, demuxer->cancel);
+
+    if (mp_thread_create(&ix->thread, indexer_thread, ix)) {
+        mp_cancel_set_parent(ix->cancel, NULL);
+        mp_cond_destroy(&ix->wakeup);
+        mp_mutex_destroy(&ix->lock);
+        talloc_free(ix);
+        return;
+    }
+    MP_VERBOSE(demuxer, "No Cues, creating index in background.\n");
+    mkv_d->indexer = ix;
+}
+
+static void stop_indexer(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_indexer *ix = mkv_d->indexer;
+
+    if (!ix)
+        return;
+    mp_cancel_trigger(ix->cancel);
+    mp_thread_join(ix->thread);
+    mp_cancel_set_parent(ix->cancel, NULL);
+    mp_cond_destroy(&ix->wakeup);
+    mp_mutex_destroy(&ix->lock);
+    talloc_free(ix);
+    mkv_d->indexer = NULL;
+}
+
+// Wait until the background indexer has reached timecode (in ns), and use its
+// entries as index. Returns false if the indexer can't be used.
+static bool use_indexer(struct demuxer *demuxer, int64_t timecode)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_indexer *ix = mkv_d->indexer;
+
+    mp_mutex_lock(&ix->lock);
+    while (!ix->complete && !ix->failed &&
+           ix->done_timecode * mkv_d->tc_scale < timecode &&
+           !demux_cancel_test(demuxer))
+        mp_cond_timedwait(&ix->wakeup, &ix->lock, MP_TIME_MS_TO_NS(100));
+    bool ok = !ix->failed || ix->complete;
+    if (ok && ix->num_entries) {
+        mkv_d->num_indexes = 0;
+        for (size_t n = 0; n < ix->num_entries; n++) {
+            mkv_index_t *e = &ix->entries[n];
+            cue_index_add(demuxer, e->tnum, e->filepos, e->timecode,
+                          e->duration);
+        }
+        mkv_d->index_has_durations = true;
+        mkv_d->index_complete = ix->complete;
+        // Let lazy indexing continue from the indexer's position.
+        for (int n = 0; n < mkv_d->num_tracks; n++) {
+            mkv_track_t *track = mkv_d->tracks[n];
+            track->last_index_entry = (size_t)-1;
+            for (size_t i = 0; i < mkv_d->num_indexes; i++) {
+                if (mkv_d->indexes[i].tnum == track->tnum)
+                    track->last_index_entry = i;
+            }
+        }
+    }
+    bool done = ix->complete || ix->failed;
+    mp_mutex_unlock(&ix->lock);
+
+    if (done)
+        stop_indexer(demuxer);
+    return ok && mkv_d->num_indexes;
+}
+
 static int create_index_until(struct demuxer *demuxer, int64_t timecode)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
@@ -3366,6 +3977,10 @@ static int create_index_until(struct demuxer *demuxer, int64_t timecode)
     if (mkv_d->index_complete)
         return 0;
 
+    if (mkv_d->indexer && use_indexer(demuxer, timecode) &&
+        mkv_d->index_complete)
+        return 0;
+
     mkv_index_t *index = get_highest_index_entry(demuxer);
 
     if (!index || index->timecode * mkv_d->tc_scale < timecode) {
@@ -3653,6 +4268,8 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    stop_indexer(demuxer);
+    stop_attachment_loader(demuxer, false);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
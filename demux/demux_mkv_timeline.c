@@ -37,6 +37,7 @@
 #include "options/path.h"
 #include "misc/bstr.h"
 #include "misc/thread_tools.h"
+#include "osdep/threads.h"
 #include "common/common.h"
 #include "common/playlist.h"
 #include "stream/stream.h"
@@ -62,6 +63,101 @@ struct tl_ctx {
     int num_chapters; // Total number of expected chapters.
 };
 
+// Process-wide cache of the segment UIDs of files checked as ordered chapter
+// sources. With a series of files with ordered chapters in a playlist, every
+// file would open all Matroska files in the directory again to find the
+// sources it references. With the cache, only files that have a wanted UID
+// (or that changed on disk) are opened.
+struct uid_cache_entry {
+    char *filename;
+    int segment;
+    int64_t size, mtime;
+    bool valid; // false if there's no such Matroska segment
+    unsigned char uid[16];
+};
+
+#define UID_CACHE_MAX 1000
+
+static mp_static_mutex uid_cache_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct uid_cache_entry **uid_cache;
+static int num_uid_cache;
+
+static bool stat_file(const char *filename, int64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+static struct uid_cache_entry *find_uid_cache(const char *filename, int segment)
+{
+    for (int n = 0; n < num_uid_cache; n++) {
+        struct uid_cache_entry *e = uid_cache[n];
+        if (e->segment == segment && strcmp(e->filename, filename) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// Return whether the cache has an up-to-date entry. If so, set *valid and uid.
+static bool lookup_uid_cache(const char *filename, int segment,
+                             bool *valid, unsigned char *uid)
+{
+    int64_t size, mtime;
+    if (!stat_file(filename, &size, &mtime))
+        return false;
+    bool found = false;
+    mp_mutex_lock(&uid_cache_lock);
+    struct uid_cache_entry *e = find_uid_cache(filename, segment);
+    if (e && e->size == size && e->mtime == mtime) {
+        *valid = e->valid;
+        memcpy(uid, e->uid, sizeof(e->uid));
+        found = true;
+    }
+    mp_mutex_unlock(&uid_cache_lock);
+    return found;
+}
+
+static void add_uid_cache(const char *filename, int segment, bool valid,
+                          unsigned char *uid)
+{
+    int64_t size, mtime;
+    if (!stat_file(filename, &size, &mtime))
+        return;
+    mp_mutex_lock(&uid_cache_lock);
+    struct uid_cache_entry *e = find_uid_cache(filename, segment);
+    if (!e) {
+        if (num_uid_cache >= UID_CACHE_MAX) {
+            talloc_free(uid_cache[0]);
+            MP_TARRAY_REMOVE_AT(uid_cache, num_uid_cache, 0);
+        }
+        e = talloc_zero(NULL, struct uid_cache_entry);
+        e->filename = talloc_strdup(e, filename);
+        e->segment = segment;
+        MP_TARRAY_APPEND(NULL, uid_cache, num_uid_cache, e);
+    }
+    e->size = size;
+    e->mtime = mtime;
+    e->valid = valid;
+    memcpy(e->uid, uid, sizeof(e->uid));
+    mp_mutex_unlock(&uid_cache_lock);
+}
+
+// Return 2 if the uid is a source that is still missing, 1 if it's otherwise
+// wanted (already found), 0 if it's not wanted at all.
+static int check_wanted_uid(struct tl_ctx *ctx, unsigned char *uid)
+{
+    int res = 0;
+    for (int i = 0; i < ctx->num_sources; i++) {
+        if (!memcmp(ctx->uids[i].segment, uid, 16))
+            res = MPMAX(res, i > 0 && !ctx->sources[i] ? 2 : 1);
+    }
+    return res;
+}
+
 struct find_entry {
     char *name;
     int matchlen;
@@ -162,12 +258,27 @@ static bool has_source_request(struct tl_ctx *ctx,
 static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
 {
     bool was_valid = false;
+    unsigned char seen_uid[16] = {0};
+    if (lookup_uid_cache(filename, segment, &was_valid, seen_uid)) {
+        // Same result as opening it, unless it's a missing source: invalid or
+        // unwanted files fail to open, others are skipped.
+        int wanted = was_valid ? check_wanted_uid(ctx, seen_uid) : 0;
+        if (wanted < 2) {
+            MP_DBG(ctx, "Skipping %s (segment %d), known to not match.\n",
+                   filename, segment);
+            return wanted == 1;
+        }
+    }
+    was_valid = false;
+    memset(seen_uid, 0, sizeof(seen_uid));
+
     struct demuxer_params params = {
         .force_format = "mkv",
         .matroska_num_wanted_uids = ctx->num_sources,
         .matroska_wanted_uids = ctx->uids,
         .matroska_wanted_segment = segment,
         .matroska_was_valid = &was_valid,
+        .matroska_seen_uid = seen_uid,
         .disable_timeline = true,
         .stream_flags = ctx->tl->stream_origin,
         .depth = ctx->demuxer->depth + 1,
@@ -177,6 +288,8 @@ static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
         return false;
 
     struct demuxer *d = demux_open_url(filename, &params, cancel, ctx->global);
+    if (!mp_cancel_test(cancel))
+        add_uid_cache(filename, segment, was_valid, seen_uid);
     if (!d)
         return false;
 
@@ -26,11 +26,13 @@
 #include "common/msg.h"
 #include "common/playlist.h"
 #include "misc/charset_conv.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "options/path.h"
 #include "player/core.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "misc/natural_sort.h"
 #include "demux.h"
 
@@ -57,6 +59,7 @@ enum autocreate_mode {
 struct demux_playlist_opts {
     int dir_mode;
     char **directory_filter;
+    int dir_scan_threads;
 };
 
 struct m_sub_options demux_playlist_conf = {
@@ -68,6 +71,8 @@ struct m_sub_options demux_playlist_conf = {
             {"ignore", DIR_IGNORE})},
         {"directory-filter-types",
             OPT_STRINGLIST(directory_filter)},
+        {"directory-scan-threads", OPT_INT(dir_scan_threads),
+            M_RANGE(0, 64)},
         {0}
     },
     .size = sizeof(struct demux_playlist_opts),
@@ -446,72 +451,203 @@ static bool test_path(struct pl_parser *p, char *path, int autocreate)
     return false;
 }
 
+struct dir_scan {
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    int dir_mode;
+    struct mp_thread_pool *pool; // NULL: scan in the calling thread
+    mp_mutex lock;
+    mp_cond wakeup;
+    int pending; // number of queued directories not scanned yet
+};
+
+struct dir_node {
+    struct dir_scan *scan;
+    char *path;
+    // Parent directories, for detecting loops.
+    struct stat *dir_stack;
+    int num_dir_stack;
+    bool readable;
+    struct pl_dir_entry *entries;
+    int num_entries;
+    // Same index as entries; set for subdirectories that are recursed into.
+    struct dir_node **children;
+};
+
 // Return true if this was a readable directory.
-static bool scan_dir(struct pl_parser *p, char *path,
-                     struct stat *dir_stack, int num_dir_stack, int autocreate)
+static bool read_dir(struct dir_node *node)
 {
-    if (strlen(path) >= 8192 || num_dir_stack == MAX_DIR_STACK)
+    struct dir_scan *scan = node->scan;
+    char *path = node->path;
+
+    if (strlen(path) >= 8192 || node->num_dir_stack == MAX_DIR_STACK)
         return false; // things like mount bind loops
 
     DIR *dp = opendir(path);
     if (!dp) {
-        MP_ERR(p, "Could not read directory.\n");
+        mp_err(scan->log, "Could not read directory.\n");
         return false;
     }
 
-    struct pl_dir_entry *dir_entries = NULL;
-    int num_dir_entries = 0;
     int path_len = strlen(path);
-    int dir_mode = p->opts->dir_mode;
+    int dir_mode = scan->dir_mode;
 
     struct dirent *ep;
     while ((ep = readdir(dp))) {
         if (ep->d_name[0] == '.')
             continue;
 
-        if (mp_cancel_test(p->s->cancel))
+        if (mp_cancel_test(scan->cancel))
             break;
 
-        char *file = mp_path_join(p, path, ep->d_name);
+        char *file = mp_path_join(node, path, ep->d_name);
 
-        struct stat st;
-        if (stat(file, &st) == 0 && S_ISDIR(st.st_mode)) {
+        struct stat st = {0};
+        bool is_dir;
+#ifdef DT_DIR
+        // stat() is slow on network filesystems, and st is needed only for
+        // directories that are recursed into.
+        if (ep->d_type == DT_REG ||
+            (ep->d_type == DT_DIR && dir_mode != DIR_RECURSIVE))
+        {
+            is_dir = ep->d_type == DT_DIR;
+        } else
+#endif
+        {
+            is_dir = stat(file, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if (is_dir) {
             if (dir_mode != DIR_IGNORE) {
-                for (int n = 0; n < num_dir_stack; n++) {
-                    if (same_st(&dir_stack[n], &st)) {
-                        MP_VERBOSE(p, "Skip recursive entry: %s\n", file);
+                for (int n = 0; n < node->num_dir_stack; n++) {
+                    if (same_st(&node->dir_stack[n], &st)) {
+                        mp_verbose(scan->log, "Skip recursive entry: %s\n", file);
                         goto skip;
                     }
                 }
 
                 struct pl_dir_entry d = {file, &file[path_len], st, true};
-                MP_TARRAY_APPEND(p, dir_entries, num_dir_entries, d);
+                MP_TARRAY_APPEND(node, node->entries, node->num_entries, d);
             }
         } else {
             struct pl_dir_entry f = {file, &file[path_len], .is_dir = false};
-            MP_TARRAY_APPEND(p, dir_entries, num_dir_entries, f);
+            MP_TARRAY_APPEND(node, node->entries, node->num_entries, f);
         }
 
         skip: ;
     }
     closedir(dp);
 
-    if (dir_entries)
-        qsort(dir_entries, num_dir_entries, sizeof(dir_entries[0]), cmp_dir_entry);
+    if (node->entries) {
+        qsort(node->entries, node->num_entries, sizeof(node->entries[0]),
+              cmp_dir_entry);
+    }
+
+    return true;
+}
+
+static void scan_node(void *ptr);
 
-    for (int n = 0; n < num_dir_entries; n++) {
-        char *file = dir_entries[n].path;
-        if (dir_mode == DIR_RECURSIVE && dir_entries[n].is_dir) {
-            dir_stack[num_dir_stack] = dir_entries[n].st;
-            scan_dir(p, file, dir_stack, num_dir_stack + 1, autocreate);
+static void queue_node(struct dir_scan *scan, struct dir_node *node)
+{
+    mp_mutex_lock(&scan->lock);
+    scan->pending++;
+    mp_mutex_unlock(&scan->lock);
+
+    if (!scan->pool || !mp_thread_pool_queue(scan->pool, scan_node, node))
+        scan_node(node);
+}
+
+static void scan_node(void *ptr)
+{
+    struct dir_node *node = ptr;
+    struct dir_scan *scan = node->scan;
+
+    node->readable = read_dir(node);
+
+    if (node->readable && scan->dir_mode == DIR_RECURSIVE &&
+        !mp_cancel_test(scan->cancel))
+    {
+        node->children = talloc_zero_array(node, struct dir_node *,
+                                           node->num_entries);
+        // Create all children before queuing any, so that no other thread
+        // allocates memory under node while this is done.
+        for (int n = 0; n < node->num_entries; n++) {
+            struct pl_dir_entry *e = &node->entries[n];
+            if (!e->is_dir)
+                continue;
+            struct dir_node *child = talloc_zero(node, struct dir_node);
+            child->scan = scan;
+            child->path = e->path;
+            child->num_dir_stack = node->num_dir_stack + 1;
+            child->dir_stack = talloc_array(child, struct stat,
+                                            child->num_dir_stack);
+            for (int i = 0; i < node->num_dir_stack; i++)
+                child->dir_stack[i] = node->dir_stack[i];
+            child->dir_stack[node->num_dir_stack] = e->st;
+            node->children[n] = child;
+        }
+        for (int n = 0; n < node->num_entries; n++) {
+            if (node->children[n])
+                queue_node(scan, node->children[n]);
+        }
+    }
+
+    mp_mutex_lock(&scan->lock);
+    scan->pending--;
+    mp_cond_broadcast(&scan->wakeup);
+    mp_mutex_unlock(&scan->lock);
+}
+
+static void add_node(struct pl_parser *p, struct dir_node *node, int autocreate)
+{
+    for (int n = 0; n < node->num_entries; n++) {
+        char *file = node->entries[n].path;
+        if (node->scan->dir_mode == DIR_RECURSIVE && node->entries[n].is_dir) {
+            struct dir_node *child = node->children ? node->children[n] : NULL;
+            if (child && child->readable)
+                add_node(p, child, autocreate);
         }
         else {
-            if (dir_entries[n].is_dir || test_path(p, file, autocreate))
-                playlist_append_file(p->pl, dir_entries[n].path);
+            if (node->entries[n].is_dir || test_path(p, file, autocreate))
+                playlist_append_file(p->pl, file);
         }
     }
+}
 
-    return true;
+// Add the contents of the directory to the playlist, sorted. Subdirectories
+// are scanned in parallel with --directory-scan-threads.
+static void scan_dir(struct pl_parser *p, char *path, int autocreate)
+{
+    struct dir_scan scan = {
+        .log = p->log,
+        .cancel = p->s->cancel,
+        .dir_mode = p->opts->dir_mode,
+    };
+    mp_mutex_init(&scan.lock);
+    mp_cond_init(&scan.wakeup);
+
+    int threads = p->opts->dir_scan_threads;
+    if (threads > 0 && scan.dir_mode == DIR_RECURSIVE)
+        scan.pool = mp_thread_pool_create(NULL, 0, 0, threads);
+
+    struct dir_node *root = talloc_zero(NULL, struct dir_node);
+    root->scan = &scan;
+    root->path = path;
+    queue_node(&scan, root);
+
+    mp_mutex_lock(&scan.lock);
+    while (scan.pending)
+        mp_cond_wait(&scan.wakeup, &scan.lock);
+    mp_mutex_unlock(&scan.lock);
+
+    talloc_free(scan.pool);
+    mp_cond_destroy(&scan.wakeup);
+    mp_mutex_destroy(&scan.lock);
+
+    if (root->readable)
+        add_node(p, root, autocreate);
+    talloc_free(root);
 }
 
 static enum autocreate_mode get_directory_filter(struct pl_parser *p)
@@ -583,15 +719,13 @@ static int parse_dir(struct pl_parser *p)
     if (autocreate == AUTO_NONE)
         goto done;
 
-    struct stat dir_stack[MAX_DIR_STACK];
-
     if (p->opts->dir_mode == DIR_AUTO) {
         struct MPOpts *opts = mp_get_config_group(NULL, p->global, &mp_opt_root);
         p->opts->dir_mode = opts->shuffle ? DIR_RECURSIVE : DIR_LAZY;
         talloc_free(opts);
     }
 
-    scan_dir(p, path, dir_stack, 0, autocreate);
+    scan_dir(p, path, autocreate);
 
     ret = p->pl->num_entries > 0 ? 0 : -1;
 
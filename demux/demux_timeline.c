@@ -20,6 +20,9 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "osdep/threads.h"
 
 #include "demux.h"
 #include "timeline.h"
@@ -40,6 +43,11 @@ struct segment {
     // Uses NULL for streams that do not appear in the virtual timeline.
     struct virtual_stream **stream_map;
     int num_stream_map;
+    // Background open of a lazy segment (--demuxer-segment-prefetch). The
+    // first two fields are protected by priv.prefetch_lock.
+    bool prefetching;           // job queued or running
+    struct demuxer *prefetched; // result of the job, not owned by seg->d yet
+    struct mp_cancel *prefetch_cancel;
 };
 
 // Information for each stream on the virtual timeline. (Mirrors streams
@@ -88,6 +96,17 @@ struct priv {
 
     struct virtual_source **sources;
     int num_sources;
+
+    // Created on first use if --demuxer-segment-prefetch is set.
+    struct mp_thread_pool *prefetch_pool;
+    mp_mutex prefetch_lock;
+    mp_cond prefetch_wakeup;
+};
+
+struct prefetch_job {
+    struct demuxer *demuxer;
+    struct segment *seg;
+    struct demuxer_params params;
 };
 
 static void update_slave_stats(struct demuxer *demuxer, struct demuxer *slave)
@@ -204,6 +223,107 @@ static void close_lazy_segments(struct demuxer *demuxer,
     }
 }
 
+static struct demuxer_params segment_params(struct demuxer *demuxer,
+                                            struct virtual_source *src)
+{
+    return (struct demuxer_params){
+        .init_fragment = src->tl->init_fragment,
+        .skip_lavf_probing = src->tl->dash,
+        .stream_flags = demuxer->stream_origin,
+        .depth = demuxer->depth + 1,
+    };
+}
+
+static void prefetch_segment_job(void *ptr)
+{
+    struct prefetch_job *job = ptr;
+    struct priv *p = job->demuxer->priv;
+
+    struct demuxer *d = demux_open_url(job->seg->url, &job->params,
+                                       job->seg->prefetch_cancel,
+                                       job->demuxer->global);
+
+    mp_mutex_lock(&p->prefetch_lock);
+    job->seg->prefetched = d;
+    job->seg->prefetching = false;
+    mp_cond_broadcast(&p->prefetch_wakeup);
+    mp_mutex_unlock(&p->prefetch_lock);
+
+    talloc_free(job);
+}
+
+// Start opening the lazy segments following the current one on worker
+// threads, so that switching to them doesn't stall on the network round
+// trips needed to open the stream and probe the file.
+static void prefetch_segments(struct demuxer *demuxer,
+                              struct virtual_source *src)
+{
+    struct priv *p = demuxer->priv;
+    int num = demuxer->opts->segment_prefetch;
+
+    if (!num || !src->current)
+        return;
+
+    if (!p->prefetch_pool) {
+        mp_mutex_init(&p->prefetch_lock);
+        mp_cond_init(&p->prefetch_wakeup);
+        p->prefetch_pool = mp_thread_pool_create(p, 0, 0, num);
+    }
+
+    int first = src->current->index + 1;
+    for (int n = first; n < MPMIN(first + num, src->num_segments); n++) {
+        struct segment *seg = src->segments[n];
+        if (!seg->lazy || seg->d)
+            continue;
+
+        mp_mutex_lock(&p->prefetch_lock);
+        bool start = !seg->prefetching && !seg->prefetched;
+        seg->prefetching |= start;
+        mp_mutex_unlock(&p->prefetch_lock);
+        if (!start)
+            continue;
+
+        if (!seg->prefetch_cancel) {
+            seg->prefetch_cancel = mp_cancel_new(NULL);
+            mp_cancel_set_parent(seg->prefetch_cancel, demuxer->cancel);
+        }
+
+        struct prefetch_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct prefetch_job){
+            .demuxer = demuxer,
+            .seg = seg,
+            .params = segment_params(demuxer, src),
+        };
+        MP_VERBOSE(demuxer, "prefetching segment %d\n", seg->index);
+        if (!mp_thread_pool_queue(p->prefetch_pool, prefetch_segment_job, job)) {
+            talloc_free(job);
+            mp_mutex_lock(&p->prefetch_lock);
+            seg->prefetching = false;
+            mp_mutex_unlock(&p->prefetch_lock);
+        }
+    }
+}
+
+// Take over the demuxer a prefetch job opened for seg (waiting for it to
+// finish if needed). Returns NULL if there was no job or it failed.
+static struct demuxer *get_prefetched_segment(struct demuxer *demuxer,
+                                              struct segment *seg)
+{
+    struct priv *p = demuxer->priv;
+
+    if (!p->prefetch_pool)
+        return NULL;
+
+    mp_mutex_lock(&p->prefetch_lock);
+    while (seg->prefetching)
+        mp_cond_wait(&p->prefetch_wakeup, &p->prefetch_lock);
+    struct demuxer *d = seg->prefetched;
+    seg->prefetched = NULL;
+    mp_mutex_unlock(&p->prefetch_lock);
+
+    return d;
+}
+
 static void reopen_lazy_segments(struct demuxer *demuxer,
                                  struct virtual_source *src)
 {
@@ -214,14 +334,15 @@ static void reopen_lazy_segments(struct demuxer *demuxer,
     // because demuxed packets have demux_packet.codec set to objects owned
     // by the segments. Closing them would create dangling pointers.
 
-    struct demuxer_params params = {
-        .init_fragment = src->tl->init_fragment,
-        .skip_lavf_probing = src->tl->dash,
-        .stream_flags = demuxer->stream_origin,
-        .depth = demuxer->depth + 1,
-    };
-    src->current->d = demux_open_url(src->current->url, &params,
-                                     demuxer->cancel, demuxer->global);
+    src->current->d = get_prefetched_segment(demuxer, src->current);
+    if (src->current->d) {
+        MP_VERBOSE(demuxer, "using prefetched segment %d\n",
+                   src->current->index);
+    } else if (!demux_cancel_test(demuxer)) {
+        struct demuxer_params params = segment_params(demuxer, src);
+        src->current->d = demux_open_url(src->current->url, &params,
+                                         demuxer->cancel, demuxer->global);
+    }
     if (!src->current->d && !demux_cancel_test(demuxer))
         MP_ERR(demuxer, "failed to load segment\n");
     if (src->current->d)
@@ -258,6 +379,8 @@ static void switch_segment(struct demuxer *demuxer, struct virtual_source *src,
 
     src->eof_reached = false;
     src->eos_packets = 0;
+
+    prefetch_segments(demuxer, src);
 }
 
 static void do_read_next_packet(struct demuxer *demuxer,
@@ -687,12 +810,36 @@ static void d_close(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
 
+    if (p->prefetch_pool) {
+        for (int x = 0; x < p->num_sources; x++) {
+            struct virtual_source *src = p->sources[x];
+            for (int n = 0; n < src->num_segments; n++) {
+                if (src->segments[n]->prefetch_cancel)
+                    mp_cancel_trigger(src->segments[n]->prefetch_cancel);
+            }
+        }
+        // Waits until all jobs are done.
+        TA_FREEP(&p->prefetch_pool);
+        mp_cond_destroy(&p->prefetch_wakeup);
+        mp_mutex_destroy(&p->prefetch_lock);
+    }
+
     for (int x = 0; x < p->num_sources; x++) {
         struct virtual_source *src = p->sources[x];
 
+        for (int n = 0; n < src->num_segments; n++) {
+            struct segment *seg = src->segments[n];
+            if (seg->prefetched)
+                demux_free(seg->prefetched);
+            seg->prefetched = NULL;
+        }
+
         src->current = NULL;
         TA_FREEP(&src->next);
         close_lazy_segments(demuxer, src);
+
+        for (int n = 0; n < src->num_segments; n++)
+            TA_FREEP(&src->segments[n]->prefetch_cancel);
     }
 
     if (p->owns_tl) {
@@ -0,0 +1,577 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Parallel segment downloads for libavformat's HLS demuxer
+// (--demuxer-lavf-hls-prefetch). The HLS demuxer opens each segment with
+// AVFormatContext.io_open only when it needs it, and reads it sequentially.
+// To know which segments come next, the media playlists it opens are fetched
+// a second time and parsed here. When a segment is opened, the following ones
+// are downloaded into memory by a thread pool, and a segment that has been
+// downloaded is returned to the HLS demuxer as memory AVIOContext.
+//
+// Segment URLs are resolved like libavformat does in the common cases only. If
+// a URL doesn't match, the segment is simply opened normally.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "osdep/threads.h"
+#include "hls_prefetch.h"
+
+#define MAX_PLAYLIST_SIZE (16 * 1024 * 1024)
+#define MAX_SEGMENT_SIZE (512 * 1024 * 1024)
+#define READ_CHUNK (64 * 1024)
+
+struct segment_list {
+    char *playlist_url; // as opened by the HLS demuxer
+    char **urls;
+    int num_urls;
+};
+
+struct entry {
+    struct hls_prefetch *p;
+    char *url;
+    char *playlist_url;
+    AVDictionary *opts;
+    // Protected by hls_prefetch.lock. An entry that was removed from the list
+    // is freed by its job if it's not done yet (abandoned).
+    bool started, done, failed, abandoned;
+    bstr data;
+};
+
+struct playlist_job {
+    struct hls_prefetch *p;
+    char *url;
+    AVDictionary *opts;
+};
+
+struct mem_io {
+    AVIOContext *pb;
+    bstr data;
+    int64_t pos;
+};
+
+struct hls_prefetch {
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    struct mp_thread_pool *pool;
+    char *main_url;
+    int num;
+    int64_t max_bytes;
+    atomic_bool closing;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    // All allocated without talloc parent, as jobs modify them.
+    struct segment_list **lists;
+    int num_lists;
+    struct entry **entries;
+    int num_entries;
+    char **pending_playlists;
+    int num_pending_playlists;
+    int64_t buffered_bytes; // data of done entries
+    int64_t read_bytes;     // downloaded, not reported yet
+
+    // Only accessed by the demuxer thread.
+    struct mem_io **mems;
+    int num_mems;
+};
+
+static int interrupt_cb(void *ctx)
+{
+    struct hls_prefetch *p = ctx;
+    return atomic_load(&p->closing) || mp_cancel_test(p->cancel);
+}
+
+// Read url completely. *opts is consumed. On success, *out is allocated under
+// ta_parent, and *location is set to the URL after redirections (if known).
+static bool fetch(struct hls_prefetch *p, const char *url, AVDictionary **opts,
+                  int64_t max, void *ta_parent, bstr *out, char **location)
+{
+    AVIOInterruptCB cb = {.callback = interrupt_cb, .opaque = p};
+    AVIOContext *pb = NULL;
+    int r = avio_open2(&pb, url, AVIO_FLAG_READ, &cb, opts);
+    av_dict_free(opts);
+    if (r < 0)
+        return false;
+
+    bstr data = {0};
+    size_t alloc = 0;
+    bool ok = false;
+    while (1) {
+        if (data.len + READ_CHUNK > alloc) {
+            alloc = MPMAX(alloc * 2, READ_CHUNK);
+            if (alloc > max + READ_CHUNK)
+                break;
+            data.start = talloc_realloc_size(ta_parent, data.start, alloc);
+        }
+        r = avio_read(pb, data.start + data.len, READ_CHUNK);
+        if (r == AVERROR_EOF) {
+            ok = true;
+            break;
+        }
+        if (r < 0)
+            break;
+        data.len += r;
+    }
+
+    if (ok && location) {
+        uint8_t *loc = NULL;
+        if (av_opt_get(pb, "location", AV_OPT_SEARCH_CHILDREN, &loc) >= 0 && loc)
+            *location = talloc_strdup(ta_parent, loc);
+        av_free(loc);
+    }
+    avio_closep(&pb);
+
+    mp_mutex_lock(&p->lock);
+    p->read_bytes += data.len;
+    mp_mutex_unlock(&p->lock);
+
+    if (!ok) {
+        talloc_free(data.start);
+        return false;
+    }
+    *out = data;
+    return true;
+}
+
+// Resolve a playlist entry against the playlist URL, like libavformat's
+// ff_make_absolute_url() in the common cases. Returns NULL for other cases.
+static char *resolve_url(void *ta_ctx, const char *base, bstr rel)
+{
+    if (bstr_find0(rel, "://") >= 0)
+        return bstrto0(ta_ctx, rel);
+
+    const char *scheme_end = strstr(base, "://");
+    if (!scheme_end || bstr_startswith0(rel, "?") || bstr_startswith0(rel, "#"))
+        return NULL;
+    if (bstr_startswith0(rel, "//")) {
+        return talloc_asprintf(ta_ctx, "%.*s:%.*s", (int)(scheme_end - base),
+                               base, BSTR_P(rel));
+    }
+
+    // Start of the path, or end of the URL if there is no path.
+    const char *host = scheme_end + 3;
+    size_t path_start = host - base + strcspn(host, "/?#");
+    if (bstr_startswith0(rel, "/")) {
+        return talloc_asprintf(ta_ctx, "%.*s%.*s", (int)path_start, base,
+                               BSTR_P(rel));
+    }
+
+    if (bstr_startswith0(rel, "./") || bstr_find0(rel, "../") >= 0)
+        return NULL; // would need path normalization
+
+    size_t end = path_start + strcspn(base + path_start, "?#");
+    size_t dir_end = path_start;
+    for (size_t n = path_start; n < end; n++) {
+        if (base[n] == '/')
+            dir_end = n + 1;
+    }
+    if (dir_end == path_start) {
+        return talloc_asprintf(ta_ctx, "%.*s/%.*s", (int)path_start, base,
+                               BSTR_P(rel));
+    }
+    return talloc_asprintf(ta_ctx, "%.*s%.*s", (int)dir_end, base, BSTR_P(rel));
+}
+
+// Return the segment list of a media playlist, or NULL if it's not one, or
+// uses features that make prefetching by URL impossible.
+static struct segment_list *parse_playlist(const char *playlist_url,
+                                           const char *base, bstr data)
+{
+    if (!bstr_startswith0(bstr_strip(bstr_getline(data, NULL)), "#EXTM3U"))
+        return NULL;
+
+    struct segment_list *list = talloc_zero(NULL, struct segment_list);
+    list->playlist_url = talloc_strdup(list, playlist_url);
+    bool media = false;
+    while (data.len) {
+        bstr line = bstr_strip(bstr_getline(data, &data));
+        if (!line.len)
+            continue;
+        if (bstr_startswith0(line, "#")) {
+            media |= bstr_startswith0(line, "#EXTINF");
+            // Byte ranges request parts of the same URL, and AES-128
+            // segments are opened with a "crypto+" URL.
+            if (bstr_startswith0(line, "#EXT-X-BYTERANGE") ||
+                (bstr_startswith0(line, "#EXT-X-KEY") &&
+                 bstr_find0(line, "METHOD=AES-128") >= 0))
+                goto fail;
+            continue;
+        }
+        char *url = resolve_url(list, base, line);
+        if (url)
+            MP_TARRAY_APPEND(list, list->urls, list->num_urls, url);
+    }
+    if (!media || !list->num_urls)
+        goto fail;
+    return list;
+
+fail:
+    talloc_free(list);
+    return NULL;
+}
+
+static void fetch_playlist(void *ptr)
+{
+    struct playlist_job *job = ptr;
+    struct hls_prefetch *p = job->p;
+
+    bstr data = {0};
+    char *location = NULL;
+    struct segment_list *list = NULL;
+    if (!atomic_load(&p->closing) &&
+        fetch(p, job->url, &job->opts, MAX_PLAYLIST_SIZE, job, &data, &location))
+        list = parse_playlist(job->url, location ? location : job->url, data);
+    av_dict_free(&job->opts);
+
+    mp_mutex_lock(&p->lock);
+    for (int n = 0; n < p->num_pending_playlists; n++) {
+        if (strcmp(p->pending_playlists[n], job->url) == 0) {
+            talloc_free(p->pending_playlists[n]);
+            MP_TARRAY_REMOVE_AT(p->pending_playlists, p->num_pending_playlists, n);
+            break;
+        }
+    }
+    if (list) {
+        int n = 0;
+        while (n < p->num_lists && strcmp(p->lists[n]->playlist_url, job->url))
+            n++;
+        if (n < p->num_lists) {
+            talloc_free(p->lists[n]);
+            p->lists[n] = list;
+        } else {
+            MP_TARRAY_APPEND(NULL, p->lists, p->num_lists, list);
+        }
+        mp_dbg(p->log, "%d segments in '%s'.\n", list->num_urls, job->url);
+    }
+    mp_mutex_unlock(&p->lock);
+
+    talloc_free(job);
+}
+
+static void free_entry(struct entry *e)
+{
+    av_dict_free(&e->opts);
+    talloc_free(e);
+}
+
+static void fetch_entry(void *ptr)
+{
+    struct entry *e = ptr;
+    struct hls_prefetch *p = e->p;
+
+    mp_mutex_lock(&p->lock);
+    bool skip = e->abandoned;
+    e->started = true;
+    mp_mutex_unlock(&p->lock);
+
+    bstr data = {0};
+    bool ok = !skip && fetch(p, e->url, &e->opts, MAX_SEGMENT_SIZE, e, &data, NULL);
+
+    mp_mutex_lock(&p->lock);
+    e->done = true;
+    e->failed = !ok;
+    e->data = data;
+    if (e->abandoned) {
+        free_entry(e);
+    } else {
+        p->buffered_bytes += data.len;
+    }
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+// Called locked.
+static int find_entry(struct hls_prefetch *p, const char *url)
+{
+    for (int n = 0; n < p->num_entries; n++) {
+        if (strcmp(p->entries[n]->url, url) == 0)
+            return n;
+    }
+    return -1;
+}
+
+// Called locked. Removes the entry from the list, and returns it if it can
+// be used by the caller (i.e. it's done).
+static struct entry *remove_entry(struct hls_prefetch *p, int index)
+{
+    struct entry *e = p->entries[index];
+    MP_TARRAY_REMOVE_AT(p->entries, p->num_entries, index);
+    if (!e->done) {
+        e->abandoned = true;
+        return NULL;
+    }
+    p->buffered_bytes -= e->data.len;
+    return e;
+}
+
+// Called locked. Queue the segments following url, and drop the ones of the
+// same playlist that are not needed anymore (e.g. after seeking).
+static void schedule(struct hls_prefetch *p, const char *url, AVDictionary *opts)
+{
+    struct segment_list *list = NULL;
+    int index = -1;
+    for (int n = 0; n < p->num_lists && !list; n++) {
+        for (int i = 0; i < p->lists[n]->num_urls; i++) {
+            if (strcmp(p->lists[n]->urls[i], url) == 0) {
+                list = p->lists[n];
+                index = i;
+                break;
+            }
+        }
+    }
+    if (!list)
+        return;
+
+    int end = MPMIN(index + 1 + p->num, list->num_urls);
+
+    for (int n = p->num_entries - 1; n >= 0; n--) {
+        struct entry *e = p->entries[n];
+        if (strcmp(e->playlist_url, list->playlist_url) || !strcmp(e->url, url))
+            continue;
+        bool needed = false;
+        for (int i = index + 1; i < end; i++)
+            needed |= !strcmp(list->urls[i], e->url);
+        if (!needed) {
+            struct entry *old = remove_entry(p, n);
+            if (old)
+                free_entry(old);
+        }
+    }
+
+    for (int i = index + 1; i < end; i++) {
+        if (p->buffered_bytes >= p->max_bytes)
+            break;
+        if (find_entry(p, list->urls[i]) >= 0)
+            continue;
+        struct entry *e = talloc_zero(NULL, struct entry);
+        e->p = p;
+        e->url = talloc_strdup(e, list->urls[i]);
+        e->playlist_url = talloc_strdup(e, list->playlist_url);
+        av_dict_copy(&e->opts, opts, 0);
+        if (!mp_thread_pool_queue(p->pool, fetch_entry, e)) {
+            free_entry(e);
+            break;
+        }
+        MP_TARRAY_APPEND(NULL, p->entries, p->num_entries, e);
+    }
+}
+
+static int mem_read(void *opaque, uint8_t *buf, int size)
+{
+    struct mem_io *m = opaque;
+    int64_t left = m->data.len - m->pos;
+    if (left <= 0)
+        return AVERROR_EOF;
+    size = MPMIN(size, left);
+    memcpy(buf, m->data.start + m->pos, size);
+    m->pos += size;
+    return size;
+}
+
+static int64_t mem_seek(void *opaque, int64_t pos, int whence)
+{
+    struct mem_io *m = opaque;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return m->data.len;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += m->pos;
+        break;
+    case SEEK_END:
+        pos += m->data.len;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > m->data.len)
+        return AVERROR(EINVAL);
+    m->pos = pos;
+    return pos;
+}
+
+// Takes ownership of e.
+static AVIOContext *open_mem(struct hls_prefetch *p, struct entry *e)
+{
+    struct mem_io *m = talloc_zero(NULL, struct mem_io);
+    m->data = e->data;
+    talloc_steal(m, e->data.start);
+    free_entry(e);
+
+    uint8_t *buf = av_malloc(READ_CHUNK);
+    if (buf)
+        m->pb = avio_alloc_context(buf, READ_CHUNK, 0, m, mem_read, NULL, mem_seek);
+    if (!m->pb) {
+        av_free(buf);
+        talloc_free(m);
+        return NULL;
+    }
+    MP_TARRAY_APPEND(NULL, p->mems, p->num_mems, m);
+    return m->pb;
+}
+
+static bool is_playlist_url(struct hls_prefetch *p, const char *url)
+{
+    if (strcmp(url, p->main_url) == 0)
+        return true;
+    bstr path = bstr_splitchar(bstr0(url), NULL, '?');
+    return bstr_endswith0(path, ".m3u8") || bstr_endswith0(path, ".m3u");
+}
+
+// Called by the HLS demuxer's io_open. Returns a memory AVIOContext if the URL
+// was prefetched, or NULL if it should be opened normally. opts is copied.
+AVIOContext *hls_prefetch_open(struct hls_prefetch *p, const char *url,
+                               AVDictionary *opts)
+{
+    if (av_dict_get(opts, "offset", NULL, 0) ||
+        av_dict_get(opts, "end_offset", NULL, 0))
+        return NULL;
+
+    struct entry *e = NULL;
+
+    mp_mutex_lock(&p->lock);
+    if (is_playlist_url(p, url)) {
+        // (Live playlists are reloaded often, don't queue them twice.)
+        bool pending = false;
+        for (int n = 0; n < p->num_pending_playlists; n++)
+            pending |= !strcmp(p->pending_playlists[n], url);
+        struct playlist_job *job = pending ? NULL :
+                                   talloc_zero(NULL, struct playlist_job);
+        if (job) {
+            job->p = p;
+            job->url = talloc_strdup(job, url);
+            av_dict_copy(&job->opts, opts, 0);
+            if (mp_thread_pool_queue(p->pool, fetch_playlist, job)) {
+                MP_TARRAY_APPEND(NULL, p->pending_playlists,
+                                 p->num_pending_playlists,
+                                 talloc_strdup(NULL, url));
+            } else {
+                av_dict_free(&job->opts);
+                talloc_free(job);
+            }
+        }
+    } else {
+        schedule(p, url, opts);
+        int index = find_entry(p, url);
+        if (index >= 0) {
+            // If it didn't start yet, opening it here is faster.
+            while (p->entries[index]->started && !p->entries[index]->done)
+                mp_cond_wait(&p->wakeup, &p->lock);
+            e = remove_entry(p, index);
+        }
+    }
+    mp_mutex_unlock(&p->lock);
+
+    if (!e)
+        return NULL;
+    if (e->failed) {
+        free_entry(e);
+        return NULL;
+    }
+    mp_verbose(p->log, "Using prefetched segment '%s'.\n", url);
+    return open_mem(p, e);
+}
+
+// Called by the HLS demuxer's io_close2. Returns true if pb was returned by
+// hls_prefetch_open(), and was closed.
+bool hls_prefetch_close(struct hls_prefetch *p, AVIOContext *pb)
+{
+    for (int n = 0; n < p->num_mems; n++) {
+        struct mem_io *m = p->mems[n];
+        if (m->pb == pb) {
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+            talloc_free(m);
+            MP_TARRAY_REMOVE_AT(p->mems, p->num_mems, n);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return the number of bytes downloaded since the last call.
+int64_t hls_prefetch_get_read_bytes(struct hls_prefetch *p)
+{
+    mp_mutex_lock(&p->lock);
+    int64_t r = p->read_bytes;
+    p->read_bytes = 0;
+    mp_mutex_unlock(&p->lock);
+    return r;
+}
+
+// num is the number of segments downloaded ahead. max_bytes limits the size
+// of downloaded segments that were not used yet.
+struct hls_prefetch *hls_prefetch_create(struct mp_log *log,
+                                         struct mp_cancel *cancel,
+                                         const char *main_url, int num,
+                                         int64_t max_bytes)
+{
+    struct hls_prefetch *p = talloc_zero(NULL, struct hls_prefetch);
+    p->log = log;
+    p->cancel = cancel;
+    p->main_url = talloc_strdup(p, main_url);
+    p->num = num;
+    p->max_bytes = max_bytes;
+    // One more thread for playlists.
+    p->pool = mp_thread_pool_create(p, 0, 0, num + 1);
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+    return p;
+}
+
+void hls_prefetch_destroy(struct hls_prefetch *p)
+{
+    if (!p)
+        return;
+
+    // Makes running downloads stop, and waits until all jobs are done.
+    atomic_store(&p->closing, true);
+    TA_FREEP(&p->pool);
+
+    for (int n = 0; n < p->num_entries; n++)
+        free_entry(p->entries[n]);
+    talloc_free(p->entries);
+    for (int n = 0; n < p->num_lists; n++)
+        talloc_free(p->lists[n]);
+    talloc_free(p->lists);
+    talloc_free(p->pending_playlists);
+    for (int n = 0; n < p->num_mems; n++) {
+        struct mem_io *m = p->mems[n];
+        av_freep(&m->pb->buffer);
+        avio_context_free(&m->pb);
+        talloc_free(m);
+    }
+    talloc_free(p->mems);
+
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+    talloc_free(p);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct AVDictionary;
+struct AVIOContext;
+struct mp_cancel;
+struct mp_log;
+
+struct hls_prefetch;
+
+struct hls_prefetch *hls_prefetch_create(struct mp_log *log,
+                                         struct mp_cancel *cancel,
+                                         const char *main_url, int num,
+                                         int64_t max_bytes);
+void hls_prefetch_destroy(struct hls_prefetch *p);
+struct AVIOContext *hls_prefetch_open(struct hls_prefetch *p, const char *url,
+                                      struct AVDictionary *opts);
+bool hls_prefetch_close(struct hls_prefetch *p, struct AVIOContext *pb);
+int64_t hls_prefetch_get_read_bytes(struct hls_prefetch *p);
@@ -25,6 +25,12 @@
 #include <libavutil/imgutils.h>
 #include <libavutil/intreadwrite.h>
 
+#include "config.h"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "common/av_common.h"
 #include "common/common.h"
 #include "demux.h"
@@ -196,6 +202,126 @@ struct demux_packet *demux_copy_packet(struct demux_packet_pool *pool, struct de
 
 #define ROUND_ALLOC(s) MP_ALIGN_UP((s), 16)
 
+// Move the payload of dp into the shared buffer *slab (at offset *slab_used).
+// The packet then references the slab instead of its own allocation, so the
+// payloads of many small packets share one allocation, which is freed when
+// the last packet referencing it is freed. If the payload doesn't fit, *slab
+// is replaced with a new slab of slab_size bytes. Packets larger than a
+// quarter of a slab are left alone. Returns whether the packet was moved.
+bool demux_packet_pack(struct demux_packet *dp, struct AVBufferRef **slab,
+                       size_t *slab_used, size_t slab_size)
+{
+    if (!dp->avpacket || dp->is_wrapped_avframe || !dp->avpacket->buf)
+        return false;
+
+    size_t need = ROUND_ALLOC(dp->len + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (need > slab_size / 4)
+        return false;
+
+    if (!*slab || (*slab)->size - *slab_used < need) {
+        av_buffer_unref(slab);
+        *slab_used = 0;
+        *slab = av_buffer_alloc(slab_size);
+        if (!*slab)
+            return false;
+    }
+
+    AVBufferRef *buf = av_buffer_ref(*slab);
+    if (!buf)
+        return false;
+
+    uint8_t *data = buf->data + *slab_used;
+    memcpy(data, dp->buffer, dp->len);
+    memset(data + dp->len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    *slab_used += need;
+
+    av_buffer_unref(&dp->avpacket->buf);
+    dp->avpacket->buf = buf;
+    dp->avpacket->data = dp->buffer = data;
+    return true;
+}
+
+#if HAVE_ZLIB
+
+// Replace the payload of dp with a compressed copy, if that saves at least
+// 1/8 of its size. The packet can't be passed to decoders anymore; use
+// demux_packet_decompress() to get a normal packet back. Returns whether dp
+// was compressed.
+bool demux_packet_compress(struct demux_packet *dp)
+{
+    if (!dp->avpacket || dp->is_wrapped_avframe || dp->is_compressed ||
+        dp->len > INT_MAX)
+        return false;
+
+    uLongf size = compressBound(dp->len);
+    AVBufferRef *buf = av_buffer_alloc(size);
+    if (!buf)
+        return false;
+    if (compress2(buf->data, &size, dp->buffer, dp->len, Z_BEST_SPEED) != Z_OK ||
+        size > dp->len - dp->len / 8)
+    {
+        av_buffer_unref(&buf);
+        return false;
+    }
+    // Don't keep the slack of the worst case allocation around.
+    if (av_buffer_realloc(&buf, size) < 0) {
+        av_buffer_unref(&buf);
+        return false;
+    }
+
+    av_buffer_unref(&dp->avpacket->buf);
+    dp->avpacket->buf = buf;
+    dp->avpacket->data = dp->buffer = buf->data;
+    dp->avpacket->size = size;
+    dp->is_compressed = true;
+    return true;
+}
+
+// Return a new, normal packet with the uncompressed contents of dp, which
+// must have been compressed with demux_packet_compress().
+struct demux_packet *demux_packet_decompress(struct demux_packet_pool *pool,
+                                             struct demux_packet *dp)
+{
+    mp_assert(dp->is_compressed);
+
+    struct demux_packet *new = new_demux_packet(pool, dp->len);
+    if (!new)
+        return NULL;
+    uLongf size = dp->len;
+    if (uncompress(new->buffer, &size, dp->buffer, dp->avpacket->size) != Z_OK ||
+        size != dp->len || av_packet_copy_props(new->avpacket, dp->avpacket) < 0)
+    {
+        talloc_free(new);
+        return NULL;
+    }
+    demux_packet_copy_attribs(new, dp);
+    return new;
+}
+
+#else
+
+bool demux_packet_compress(struct demux_packet *dp)
+{
+    return false;
+}
+
+struct demux_packet *demux_packet_decompress(struct demux_packet_pool *pool,
+                                             struct demux_packet *dp)
+{
+    return NULL;
+}
+
+#endif
+
+// How much less memory a packet compressed with demux_packet_compress() uses
+// than demux_packet_estimate_total_size() returns (which stays the same).
+size_t demux_packet_compressed_saving(struct demux_packet *dp)
+{
+    if (!dp->is_compressed)
+        return 0;
+    return ROUND_ALLOC(dp->len) - ROUND_ALLOC(dp->avpacket->size);
+}
+
 // Attempt to estimate the total memory consumption of the given packet.
 // This is important if we store thousands of packets and not to exceed
 // user-provided limits. Of course we can't know how much memory internal
@@ -56,6 +56,10 @@ typedef struct demux_packet {
     // If true, this is a wrapped AVFrame
     bool is_wrapped_avframe : 1;
 
+    // If true, buffer holds the compressed payload (avpacket->size bytes),
+    // while len is the uncompressed size. See demux_packet_compress().
+    bool is_compressed : 1;
+
     // segmentation (ordered chapters, EDL)
     bool segmented;
     struct mp_codec_params *codec;  // set to non-NULL iff segmented is set
@@ -87,6 +91,12 @@ void demux_packet_shorten(struct demux_packet *dp, size_t len);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet_pool *pool, struct demux_packet *dp);
 size_t demux_packet_estimate_total_size(struct demux_packet *dp);
+bool demux_packet_pack(struct demux_packet *dp, struct AVBufferRef **slab,
+                       size_t *slab_used, size_t slab_size);
+bool demux_packet_compress(struct demux_packet *dp);
+struct demux_packet *demux_packet_decompress(struct demux_packet_pool *pool,
+                                             struct demux_packet *dp);
+size_t demux_packet_compressed_saving(struct demux_packet *dp);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
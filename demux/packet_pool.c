@@ -28,14 +28,17 @@
 struct demux_packet_pool {
     mp_mutex lock;
     struct demux_packet *packets;
+
+    // Local pools only (demux_packet_pool_create_local()).
+    struct demux_packet_pool *parent;
+    int num_packets;
 };
 
-static void uninit(void *p)
-{
-    struct demux_packet_pool *pool = p;
-    demux_packet_pool_clear(pool);
-    mp_mutex_destroy(&pool->lock);
-}
+// A local pool returns packets to its parent once it has more than
+// LOCAL_POOL_MAX packets (keeping the most recently returned half), and takes
+// up to LOCAL_POOL_REFILL packets at once from it when it's empty.
+#define LOCAL_POOL_MAX 256
+#define LOCAL_POOL_REFILL 64
 
 static void free_demux_packets(struct demux_packet *dp)
 {
@@ -46,15 +49,41 @@ static void free_demux_packets(struct demux_packet *dp)
     }
 }
 
-void demux_packet_pool_init(struct mpv_global *global)
+static struct demux_packet *list_tail(struct demux_packet *dp)
 {
-    struct demux_packet_pool *pool = talloc(global, struct demux_packet_pool);
-    talloc_set_destructor(pool, uninit);
+    while (dp && dp->next)
+        dp = dp->next;
+    return dp;
+}
+
+static void uninit(void *p)
+{
+    struct demux_packet_pool *pool = p;
+    if (pool->parent) {
+        demux_packet_pool_prepend(pool->parent, pool->packets,
+                                  list_tail(pool->packets));
+    } else {
+        demux_packet_pool_clear(pool);
+    }
+    mp_mutex_destroy(&pool->lock);
+}
+
+static struct demux_packet_pool *pool_create(void *ta_parent,
+                                             struct demux_packet_pool *parent)
+{
+    struct demux_packet_pool *pool = talloc(ta_parent, struct demux_packet_pool);
+    *pool = (struct demux_packet_pool){
+        .parent = parent,
+    };
     mp_mutex_init(&pool->lock);
-    pool->packets = NULL;
+    talloc_set_destructor(pool, uninit);
+    return pool;
+}
 
+void demux_packet_pool_init(struct mpv_global *global)
+{
     mp_assert(!global->packet_pool);
-    global->packet_pool = pool;
+    global->packet_pool = pool_create(global, NULL);
 }
 
 struct demux_packet_pool *demux_packet_pool_get(struct mpv_global *global)
@@ -64,13 +93,26 @@ struct demux_packet_pool *demux_packet_pool_get(struct mpv_global *global)
     return global->packet_pool;
 }
 
+struct demux_packet_pool *demux_packet_pool_create_local(void *ta_parent,
+                                                         struct demux_packet_pool *parent)
+{
+#if HAVE_DISABLE_PACKET_POOL
+    return parent;
+#endif
+    return pool_create(ta_parent, parent);
+}
+
 void demux_packet_pool_clear(struct demux_packet_pool *pool)
 {
     mp_mutex_lock(&pool->lock);
     struct demux_packet *dp = pool->packets;
     pool->packets = NULL;
+    pool->num_packets = 0;
     mp_mutex_unlock(&pool->lock);
     free_demux_packets(dp);
+
+    if (pool->parent)
+        demux_packet_pool_clear(pool->parent);
 }
 
 void demux_packet_pool_push(struct demux_packet_pool *pool,
@@ -82,6 +124,36 @@ void demux_packet_pool_push(struct demux_packet_pool *pool,
     demux_packet_pool_prepend(pool, dp, dp);
 }
 
+// Keep single packets in the local pool, and pass lists (which are typically
+// large, e.g. from clearing a packet queue) directly to the parent.
+static void local_prepend(struct demux_packet_pool *pool,
+                          struct demux_packet *head, struct demux_packet *tail)
+{
+    if (head != tail) {
+        demux_packet_pool_prepend(pool->parent, head, tail);
+        return;
+    }
+
+    struct demux_packet *excess = NULL;
+
+    mp_mutex_lock(&pool->lock);
+    tail->next = pool->packets;
+    pool->packets = head;
+    pool->num_packets += 1;
+    if (pool->num_packets > LOCAL_POOL_MAX) {
+        struct demux_packet *keep = pool->packets;
+        for (int n = 1; n < LOCAL_POOL_MAX / 2; n++)
+            keep = keep->next;
+        excess = keep->next;
+        keep->next = NULL;
+        pool->num_packets = LOCAL_POOL_MAX / 2;
+    }
+    mp_mutex_unlock(&pool->lock);
+
+    if (excess)
+        demux_packet_pool_prepend(pool->parent, excess, list_tail(excess));
+}
+
 void demux_packet_pool_prepend(struct demux_packet_pool *pool,
                                struct demux_packet *head, struct demux_packet *tail)
 {
@@ -90,6 +162,11 @@ void demux_packet_pool_prepend(struct demux_packet_pool *pool,
     mp_assert(tail);
     mp_assert(head != tail ? !!head->next : !head->next);
 
+    if (pool->parent) {
+        local_prepend(pool, head, tail);
+        return;
+    }
+
     mp_mutex_lock(&pool->lock);
     tail->next = pool->packets;
     pool->packets = head;
@@ -107,9 +184,30 @@ void demux_packet_pool_prepend(struct demux_packet_pool *pool,
 struct demux_packet *demux_packet_pool_pop(struct demux_packet_pool *pool)
 {
     mp_mutex_lock(&pool->lock);
+    if (!pool->packets && pool->parent) {
+        // Refill with a batch, so that the parent's lock is taken only once
+        // for many packets.
+        struct demux_packet_pool *parent = pool->parent;
+        mp_mutex_lock(&parent->lock);
+        struct demux_packet *batch = parent->packets;
+        struct demux_packet *last = batch;
+        int num = batch ? 1 : 0;
+        while (last && last->next && num < LOCAL_POOL_REFILL) {
+            last = last->next;
+            num++;
+        }
+        if (last) {
+            parent->packets = last->next;
+            last->next = NULL;
+        }
+        mp_mutex_unlock(&parent->lock);
+        pool->packets = batch;
+        pool->num_packets = num;
+    }
     struct demux_packet *dp = pool->packets;
     if (dp) {
         pool->packets = dp->next;
+        pool->num_packets -= 1;
         dp->next = NULL;
     }
     mp_mutex_unlock(&pool->lock);
@@ -128,3 +226,15 @@ struct demux_packet *demux_packet_pool_pop(struct demux_packet_pool *pool)
 
     return dp;
 }
+
+void demux_packet_pool_get_usage(struct demux_packet_pool *pool, int64_t *num,
+                                 int64_t *bytes)
+{
+    *num = *bytes = 0;
+    mp_mutex_lock(&pool->lock);
+    for (struct demux_packet *dp = pool->packets; dp; dp = dp->next) {
+        *num += 1;
+        *bytes += demux_packet_estimate_total_size(dp);
+    }
+    mp_mutex_unlock(&pool->lock);
+}
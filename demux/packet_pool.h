@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 struct demux_packet_pool;
 struct demux_packet;
 struct mpv_global;
@@ -39,6 +41,23 @@ void demux_packet_pool_init(struct mpv_global *global);
  */
 struct demux_packet_pool *demux_packet_pool_get(struct mpv_global *global);
 
+/**
+ * Creates a local packet pool in front of another pool.
+ *
+ * A local pool caches a limited number of packets, and exchanges packets with
+ * the parent pool in batches, so the (shared) parent pool's lock is taken
+ * rarely. This is meant for a single user, like a demuxer or a decoder. When
+ * the local pool is freed, the cached packets are returned to the parent. The
+ * parent must outlive the local pool.
+ * This function is thread-safe.
+ *
+ * @param ta_parent talloc parent of the new pool.
+ * @param parent Pointer to the parent pool (usually demux_packet_pool_get()).
+ * @return Pointer to the new pool.
+ */
+struct demux_packet_pool *demux_packet_pool_create_local(void *ta_parent,
+                                                         struct demux_packet_pool *parent);
+
 /**
  * Clears the demux packet pool.
  *
@@ -86,3 +105,17 @@ void demux_packet_pool_prepend(struct demux_packet_pool *pool,
  * @return Pointer to the demux packet, or NULL if the pool is empty.
  */
 struct demux_packet *demux_packet_pool_pop(struct demux_packet_pool *pool);
+
+/**
+ * Returns the number of packets in the pool, and their estimated size in
+ * bytes (pooled packets keep their data until they are reused). Packets
+ * cached by local pools are not included.
+ * This walks all packets, so it's slow with large pools.
+ * This function is thread-safe.
+ *
+ * @param pool Pointer to the demux packet pool.
+ * @param num Set to the number of packets.
+ * @param bytes Set to the estimated size of the packets.
+ */
+void demux_packet_pool_get_usage(struct demux_packet_pool *pool, int64_t *num,
+                                 int64_t *bytes);
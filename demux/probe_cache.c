@@ -0,0 +1,176 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Remembers which demuxer (and libavformat format) opened a URL, so that the
+// next open of the same, unchanged file can skip trying all demuxers and
+// format probing. One small text file per URL is stored in the cache dir:
+//
+//      magic
+//      URL
+//      validator (size and mtime of local files, size of network streams)
+//      demuxer name
+//      check level
+//      lavf format name (may be empty)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libavutil/md5.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "stream/stream.h"
+
+#include "demux.h"
+#include "probe_cache.h"
+
+#define PROBE_CACHE_MAGIC "mpvprobe1"
+#define PROBE_CACHE_MAX_SIZE (64 * 1024)
+
+static char *cache_file_name(void *ta_ctx, struct mpv_global *global,
+                             const char *url)
+{
+    char *dir = mp_find_user_file(NULL, global, "cache", "probe");
+    if (!dir || !dir[0]) {
+        talloc_free(dir);
+        return NULL;
+    }
+    mp_mkdirp(dir);
+
+    uint8_t md5[16];
+    av_md5_sum(md5, url, strlen(url));
+    char *name = talloc_strdup(NULL, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+    char *path = mp_path_join(ta_ctx, dir, name);
+    talloc_free(name);
+    talloc_free(dir);
+    return path;
+}
+
+// Returns a string that changes if the data at the URL changes, or NULL if
+// there is no way to tell.
+static char *get_validator(void *ta_ctx, struct stream *stream)
+{
+    if (stream->is_directory || stream->demuxer)
+        return NULL;
+    if (stream->is_local_fs) {
+        struct stat st;
+        if (!stream->path || stat(stream->path, &st) != 0)
+            return NULL;
+        return talloc_asprintf(ta_ctx, "%lld %lld", (long long)st.st_size,
+                               (long long)st.st_mtime);
+    }
+    int64_t size = stream_get_size(stream);
+    if (!stream->is_network || size < 0)
+        return NULL;
+    return talloc_asprintf(ta_ctx, "%"PRId64, size);
+}
+
+bool demux_probe_cache_get(void *ta_ctx, struct mpv_global *global,
+                           struct mp_log *log, struct stream *stream,
+                           struct demux_probe_result *res)
+{
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    char *validator = get_validator(tmp, stream);
+    char *path = validator ? cache_file_name(tmp, global, stream->url) : NULL;
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (!f)
+        goto done;
+
+    char *buf = talloc_size(tmp, PROBE_CACHE_MAX_SIZE);
+    size_t len = fread(buf, 1, PROBE_CACHE_MAX_SIZE, f);
+    fclose(f);
+
+    bstr data = {buf, len};
+    bstr lines[6];
+    for (int n = 0; n < MP_ARRAY_SIZE(lines); n++)
+        lines[n] = bstr_strip_linebreaks(bstr_getline(data, &data));
+
+    if (!bstr_equals0(lines[0], PROBE_CACHE_MAGIC) ||
+        !bstr_equals0(lines[1], stream->url))
+        goto done;
+    if (!bstr_equals0(lines[2], validator)) {
+        mp_verbose(log, "Probe cache entry for %s is outdated.\n", stream->url);
+        goto done;
+    }
+
+    bstr rest;
+    long long check = bstrtoll(lines[4], &rest, 10);
+    if (!lines[3].len || rest.len || check < DEMUX_CHECK_FORCE ||
+        check > DEMUX_CHECK_NORMAL)
+        goto done;
+
+    *res = (struct demux_probe_result){
+        .demuxer = bstrto0(ta_ctx, lines[3]),
+        .check = check,
+        .lavf_format = lines[5].len ? bstrto0(ta_ctx, lines[5]) : NULL,
+    };
+    ok = true;
+
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
+void demux_probe_cache_put(struct mpv_global *global, struct mp_log *log,
+                           struct stream *stream,
+                           const struct demux_probe_result *res)
+{
+    void *tmp = talloc_new(NULL);
+
+    char *validator = get_validator(tmp, stream);
+    char *path = validator ? cache_file_name(tmp, global, stream->url) : NULL;
+    if (!path || strchr(stream->url, '\n'))
+        goto done;
+
+    char *tmp_path = talloc_asprintf(tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f)
+        goto done;
+    fprintf(f, "%s\n%s\n%s\n%s\n%d\n%s\n", PROBE_CACHE_MAGIC, stream->url,
+            validator, res->demuxer, res->check,
+            res->lavf_format ? res->lavf_format : "");
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        mp_warn(log, "Could not write probe cache file %s.\n", path);
+        unlink(tmp_path);
+        goto done;
+    }
+    mp_verbose(log, "Stored probe result in %s.\n", path);
+
+done:
+    talloc_free(tmp);
+}
+
+void demux_probe_cache_drop(struct mpv_global *global, struct stream *stream)
+{
+    char *path = cache_file_name(NULL, global, stream->url);
+    if (path)
+        unlink(path);
+    talloc_free(path);
+}
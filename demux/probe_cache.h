@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+
+struct mp_log;
+struct mpv_global;
+struct stream;
+
+// Result of probing a file, as remembered by --demuxer-probe-cache.
+struct demux_probe_result {
+    char *demuxer;      // demuxer_desc.name
+    int check;          // enum demux_check level that succeeded
+    char *lavf_format;  // AVInputFormat.name with demux_lavf, or NULL
+};
+
+bool demux_probe_cache_get(void *ta_ctx, struct mpv_global *global,
+                           struct mp_log *log, struct stream *stream,
+                           struct demux_probe_result *res);
+void demux_probe_cache_put(struct mpv_global *global, struct mp_log *log,
+                           struct stream *stream,
+                           const struct demux_probe_result *res);
+void demux_probe_cache_drop(struct mpv_global *global, struct stream *stream);
@@ -26,19 +26,72 @@ struct async_queue {
     bool reading; // data flow: reading => consumer has requested frames
     int64_t samples_size; // queue size in the cfg.sample_unit
     size_t byte_size; // queue size in bytes (using approx. frame sizes)
-    int num_frames;
+    // Ring buffer; frame_at(q, 0) is the oldest frame (read next).
     struct mp_frame *frames;
+    int frames_alloc;
+    int first;
+    int num_frames;
     int eof_count; // number of MP_FRAME_EOF in frames[], for draining
     struct mp_filter *conn[2]; // filters: in (0), out (1)
+    // The consumer found the queue empty, or the producer found it full, and
+    // needs a wakeup once that changes. Other changes wake up nobody.
+    bool reader_idle, writer_idle;
 };
 
+static struct mp_frame *frame_at(struct async_queue *q, int n)
+{
+    return &q->frames[(q->first + n) % q->frames_alloc];
+}
+
+static void grow_frames(struct async_queue *q)
+{
+    if (q->num_frames < q->frames_alloc)
+        return;
+    int alloc = MPMAX(q->frames_alloc * 2, 16);
+    struct mp_frame *frames = talloc_array(q, struct mp_frame, alloc);
+    for (int n = 0; n < q->num_frames; n++)
+        frames[n] = *frame_at(q, n);
+    talloc_free(q->frames);
+    q->frames = frames;
+    q->frames_alloc = alloc;
+    q->first = 0;
+}
+
+// Add a frame as newest frame.
+static void push_frame(struct async_queue *q, struct mp_frame frame)
+{
+    grow_frames(q);
+    q->num_frames += 1;
+    *frame_at(q, q->num_frames - 1) = frame;
+}
+
+// Add a frame as oldest frame.
+static void unread_frame(struct async_queue *q, struct mp_frame frame)
+{
+    grow_frames(q);
+    q->first = (q->first + q->frames_alloc - 1) % q->frames_alloc;
+    q->num_frames += 1;
+    *frame_at(q, 0) = frame;
+}
+
+static struct mp_frame pop_frame(struct async_queue *q)
+{
+    mp_assert(q->num_frames);
+    struct mp_frame frame = *frame_at(q, 0);
+    q->first = (q->first + 1) % q->frames_alloc;
+    q->num_frames -= 1;
+    return frame;
+}
+
 static void reset_queue(struct async_queue *q)
 {
     mp_mutex_lock(&q->lock);
     q->active = q->reading = false;
     for (int n = 0; n < q->num_frames; n++)
-        mp_frame_unref(&q->frames[n]);
+        mp_frame_unref(frame_at(q, n));
     q->num_frames = 0;
+    q->first = 0;
+    q->reader_idle = q->writer_idle = false;
     q->eof_count = 0;
     q->samples_size = 0;
     q->byte_size = 0;
@@ -98,8 +151,8 @@ static bool is_full(struct async_queue *q)
     if (q->samples_size >= q->cfg.max_samples || q->byte_size >= q->cfg.max_bytes)
         return true;
     if (q->num_frames >= 2 && q->cfg.max_duration > 0) {
-        double pts1 = mp_frame_get_pts(q->frames[q->num_frames - 1]);
-        double pts2 = mp_frame_get_pts(q->frames[0]);
+        double pts1 = mp_frame_get_pts(*frame_at(q, 0));
+        double pts2 = mp_frame_get_pts(*frame_at(q, q->num_frames - 1));
         if (pts1 != MP_NOPTS_VALUE && pts2 != MP_NOPTS_VALUE &&
             pts2 - pts1 >= q->cfg.max_duration)
             return true;
@@ -127,7 +180,7 @@ static void recompute_sizes(struct async_queue *q)
     q->samples_size = 0;
     q->byte_size = 0;
     for (int n = 0; n < q->num_frames; n++)
-        account_frame(q, q->frames[n], 1);
+        account_frame(q, *frame_at(q, n), 1);
 }
 
 void mp_async_queue_set_config(struct mp_async_queue *queue,
@@ -147,6 +200,11 @@ void mp_async_queue_set_config(struct mp_async_queue *queue,
     q->cfg = cfg;
     if (recompute)
         recompute_sizes(q);
+    // The queue may have become larger.
+    if (q->writer_idle && !is_full(q) && q->conn[0]) {
+        mp_filter_wakeup(q->conn[0]);
+        q->writer_idle = false;
+    }
     mp_mutex_unlock(&q->lock);
 }
 
@@ -222,6 +280,19 @@ int mp_async_queue_get_frames(struct mp_async_queue *queue)
     return res;
 }
 
+void mp_async_queue_unread(struct mp_async_queue *queue, struct mp_frame frame)
+{
+    struct async_queue *q = queue->q;
+
+    mp_mutex_lock(&q->lock);
+    account_frame(q, frame, 1);
+    unread_frame(q, frame);
+    q->reader_idle = false;
+    if (q->conn[1])
+        mp_filter_wakeup(q->conn[1]);
+    mp_mutex_unlock(&q->lock);
+}
+
 struct priv {
     struct async_queue *q;
     struct mp_filter *notify;
@@ -249,24 +320,32 @@ static void process_in(struct mp_filter *f)
     mp_assert(q->conn[0] == f);
 
     mp_mutex_lock(&q->lock);
+    mp_pin_set_batch_size(f->ppins[0], q->cfg.batch_frames);
     if (!q->reading) {
         // mp_async_queue_reset()/reset_queue() is usually called asynchronously,
         // so we might have requested a frame earlier, and now can't use it.
         // Discard it; the expectation is that this is a benign logical race
         // condition, and the filter graph will be reset anyway.
-        if (mp_pin_out_has_data(f->ppins[0])) {
+        while (mp_pin_out_has_data(f->ppins[0])) {
             struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
             mp_frame_unref(&frame);
             MP_DBG(f, "discarding frame due to async reset\n");
         }
-    } else if (!is_full(q) && mp_pin_out_request_data(f->ppins[0])) {
-        struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
-        account_frame(q, frame, 1);
-        MP_TARRAY_INSERT_AT(q, q->frames, q->num_frames, 0, frame);
-        // Notify reader that we have new frames.
-        if (q->conn[1])
+    } else if (is_full(q)) {
+        q->writer_idle = true;
+    } else if (mp_pin_out_request_data(f->ppins[0])) {
+        // Take all frames of a batch at once.
+        do {
+            struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+            account_frame(q, frame, 1);
+            push_frame(q, frame);
+        } while (!is_full(q) && mp_pin_out_has_data(f->ppins[0]));
+        // Notify reader that we have new frames, if it's waiting for them.
+        if (q->reader_idle && q->conn[1])
             mp_filter_wakeup(q->conn[1]);
+        q->reader_idle = false;
         bool full = is_full(q);
+        q->writer_idle = full;
         if (!full)
             mp_pin_out_request_data_next(f->ppins[0]);
         if (p->notify && full)
@@ -292,14 +371,19 @@ static void process_out(struct mp_filter *f)
         mp_filter_wakeup(q->conn[0]);
     }
     if (q->active && q->num_frames) {
-        struct mp_frame frame = q->frames[q->num_frames - 1];
-        q->num_frames -= 1;
+        struct mp_frame frame = pop_frame(q);
         account_frame(q, frame, -1);
         mp_assert(q->samples_size >= 0);
         mp_pin_in_write(f->ppins[0], frame);
-        // Notify writer that we need new frames.
-        if (q->conn[0])
-            mp_filter_wakeup(q->conn[0]);
+        // Notify writer that we need new frames, if it's waiting for space.
+        // Also when the queue runs empty, for mp_async_queue_set_notifier().
+        if ((q->writer_idle && !is_full(q)) || !q->num_frames) {
+            if (q->conn[0])
+                mp_filter_wakeup(q->conn[0]);
+            q->writer_idle = false;
+        }
+    } else if (q->active) {
+        q->reader_idle = true;
     }
     mp_mutex_unlock(&q->lock);
 }
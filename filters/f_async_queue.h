@@ -51,6 +51,13 @@ int64_t mp_async_queue_get_samples(struct mp_async_queue *queue);
 // buffered in the access filters are not included.
 int mp_async_queue_get_frames(struct mp_async_queue *queue);
 
+// Put a frame back into the queue, so that it's the next frame the consumer
+// reads. This is for returning a frame that was read from the queue by
+// someone else before the real consumer was connected. Ownership of frame is
+// transferred to the queue. (Like with any other queued frame, it's discarded
+// on mp_async_queue_reset().)
+void mp_async_queue_unread(struct mp_async_queue *queue, struct mp_frame frame);
+
 // Create a filter to access the queue, and connect it. It's not allowed to
 // connect an already connected end of the queue. The filter can be freed at
 // any time.
@@ -121,6 +128,11 @@ struct mp_async_queue_config {
     // at least 2 samples. Behavior is unclear on timestamp resets (even if EOF
     // frames are between them). A value of 0 disables this completely.
     double max_duration;
+
+    // Number of frames the input filter lets its producer write per transfer
+    // (see mp_pin_set_batch_size()). These are buffered on the pin, so they
+    // can exceed the limits above. 0 or 1 disable batching.
+    int batch_frames;
 };
 
 // Configure the queue size. By default, the queue size is 1 frame.
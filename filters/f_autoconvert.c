@@ -57,6 +57,44 @@ static const struct mp_filter_info convert_filter = {
     .name = "convert",
 };
 
+// Replaces the image parameters, for conversions that change metadata only.
+static void set_params_process(struct mp_filter *f)
+{
+    struct mp_image_params *par = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    if (frame.type == MP_FRAME_VIDEO) {
+        struct mp_image *img = frame.data;
+        img->params = *par;
+        mp_image_params_guess_csp(&img->params);
+    }
+    mp_pin_in_write(f->ppins[1], frame);
+}
+
+static const struct mp_filter_info set_params_filter = {
+    .name = "set_params",
+    .priv_size = sizeof(struct mp_image_params),
+    .process = set_params_process,
+};
+
+static struct mp_filter *set_params_create(struct mp_filter *parent,
+                                           struct mp_image_params *par)
+{
+    struct mp_filter *f = mp_filter_create(parent, &set_params_filter);
+    if (!f)
+        return NULL;
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+    mp_filter_set_thread_safe(f, true);
+
+    *(struct mp_image_params *)f->priv = *par;
+    return f;
+}
+
 void mp_autoconvert_clear(struct mp_autoconvert *c)
 {
     struct priv *p = c->f->priv;
@@ -297,6 +335,18 @@ static bool build_image_converter(struct mp_autoconvert *c, struct mp_log *log,
         need_sws = false;
     }
 
+    // If the target differs only in metadata (which neither libswscale nor
+    // zimg would convert), rewrite it instead of copying the image.
+    if (need_sws && force_sws_params &&
+        mp_image_params_pixels_equal(&imgpar, &p->imgparams))
+    {
+        filters[1] = set_params_create(conv, &p->imgparams);
+        if (!filters[1])
+            goto fail;
+        mp_verbose(log, "Setting image parameters without conversion\n");
+        need_sws = false;
+    }
+
     if (need_sws) {
         // Create a new conversion filter.
         struct mp_sws_filter *sws = mp_sws_filter_create(conv);
@@ -327,6 +377,10 @@ static bool build_image_converter(struct mp_autoconvert *c, struct mp_log *log,
         }
     }
 
+    // Each stage except a parameter rewrite copies the whole image.
+    int copies = !!filters[0] + (need_sws && filters[1]) + !!filters[2];
+    mp_verbose(log, "Conversion copies each frame %d time(s)\n", copies);
+
     mp_chain_filters(conv->ppins[0], conv->ppins[1], filters, 3);
 
     *f_out = conv;
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
@@ -57,6 +58,8 @@ struct dec_queue_opts {
     int64_t max_bytes;
     int64_t max_samples;
     double max_duration;
+    bool adaptive;
+    double min_duration;
 };
 
 #define OPT_BASE_STRUCT struct dec_queue_opts
@@ -66,6 +69,8 @@ static const struct m_option dec_queue_opts_list[] = {
     {"max-secs", OPT_DOUBLE(max_duration), M_RANGE(0, DBL_MAX)},
     {"max-bytes", OPT_BYTE_SIZE(max_bytes), M_RANGE(0, M_MAX_MEM_BYTES)},
     {"max-samples", OPT_INT64(max_samples), M_RANGE(0, DBL_MAX)},
+    {"adaptive", OPT_BOOL(adaptive)},
+    {"min-secs", OPT_DOUBLE(min_duration), M_RANGE(0, DBL_MAX)},
     {0}
 };
 
@@ -76,6 +81,7 @@ static const struct m_sub_options vdec_queue_conf = {
         .max_bytes = 512 * 1024 * 1024,
         .max_samples = 50,
         .max_duration = 2,
+        .min_duration = 0.25,
     },
 };
 
@@ -86,6 +92,7 @@ static const struct m_sub_options adec_queue_conf = {
         .max_bytes = 1 * 1024 * 1024,
         .max_samples = 48000,
         .max_duration = 1,
+        .min_duration = 0.1,
     },
 };
 
@@ -110,6 +117,14 @@ struct dec_wrapper_opts {
 static int decoder_list_help(struct mp_log *log, const m_option_t *opt,
                              struct bstr name);
 
+// --vd-queue-adaptive: frames between queue updates, also the length of the
+// moving average of decode times.
+#define ADAPT_INTERVAL 16
+// Number of consecutive slow frames the queue should be able to cover.
+#define ADAPT_FRAMES 8
+// Audio frames the decoder may output per transfer into the queue.
+#define AUDIO_QUEUE_BATCH 8
+
 const struct m_sub_options dec_wrapper_conf = {
     .opts = (const struct m_option[]){
         {"correct-pts", OPT_BOOL(correct_pts)},
@@ -213,6 +228,12 @@ struct priv {
 
     int play_dir;
 
+    // Per-frame decode time statistics for --vd-queue-adaptive.
+    int64_t frame_wait_start;   // output started waiting for a frame, or 0
+    bool skip_wait_sample;      // discard next sample (seek/reset latency)
+    double wait_avg, wait_var;  // moving average/variance of wait, in seconds
+    int num_wait_samples;
+
     // --- The following fields can be accessed only from the mp_decoder_wrapper
     //     user thread.
     struct mp_decoder_wrapper public;
@@ -224,6 +245,7 @@ struct priv {
     mp_thread dec_thread;
     bool dec_thread_valid;
     mp_mutex cache_lock;
+    bool warmup; // queue limited to 1 frame until reparented (detached only)
 
     // --- Protected by cache_lock.
     char *cur_hwdec;
@@ -232,6 +254,7 @@ struct priv {
     bool pts_reset;
     int attempt_framedrops; // try dropping this many frames
     int dropped_frames; // total frames _probably_ dropped
+    double queue_duration; // current max_duration of queue, or -1 if no queue
 };
 
 static int decoder_list_help(struct mp_log *log, const m_option_t *opt,
@@ -335,6 +358,9 @@ static void decf_reset(struct mp_filter *f)
 
     p->coverart_returned = 0;
 
+    p->frame_wait_start = 0;
+    p->skip_wait_sample = true;
+
     for (int n = 0; n < p->num_reverse_queue; n++)
         mp_frame_unref(&p->reverse_queue[n]);
     p->num_reverse_queue = 0;
@@ -493,6 +519,92 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
     return res;
 }
 
+static void update_queue_config(struct priv *p);
+
+extern const struct m_sub_options vd_lavc_conf;
+extern const struct m_sub_options ad_lavc_conf;
+extern const struct m_sub_options hwdec_conf;
+
+// Whether the options in conf (only the one named name, if not NULL) have the
+// same values in both globals. Sub-groups are not compared.
+static bool same_opts(struct mpv_global *a, struct mpv_global *b,
+                      const struct m_sub_options *conf, const char *name)
+{
+    void *tmp = talloc_new(NULL);
+    char *opts_a = m_config_cache_alloc(tmp, a, conf)->opts;
+    char *opts_b = m_config_cache_alloc(tmp, b, conf)->opts;
+    bool res = true;
+    for (const struct m_option *opt = conf->opts; opt->name; opt++) {
+        if (opt->type == &m_option_type_subconfig)
+            continue;
+        if (name && strcmp(opt->name, name) != 0)
+            continue;
+        if (!m_option_equal(opt, opts_a + opt->offset, opts_b + opt->offset)) {
+            res = false;
+            break;
+        }
+    }
+    talloc_free(tmp);
+    return res;
+}
+
+// Whether a decoder created with the options in a works like one created
+// with the options in b.
+static bool same_decoder_opts(struct priv *p, struct mpv_global *a,
+                              struct mpv_global *b)
+{
+    if (a == b)
+        return true;
+    if (!same_opts(a, b, &dec_wrapper_conf, NULL))
+        return false;
+    if (p->header->type == STREAM_VIDEO) {
+        return same_opts(a, b, &vd_lavc_conf, NULL) &&
+               same_opts(a, b, &hwdec_conf, NULL);
+    }
+    return same_opts(a, b, &ad_lavc_conf, NULL) &&
+           same_opts(a, b, &mp_opt_root, "audio-channels");
+}
+
+bool mp_decoder_wrapper_reparent(struct mp_decoder_wrapper *d,
+                                 struct mp_filter *parent,
+                                 struct mp_frame frame)
+{
+    struct priv *p = d->f->priv;
+
+    // Without decoder thread, the decoder filters are part of the user's
+    // filter graph, and would have to be moved along with unclear effects.
+    if (!p->queue)
+        return false;
+
+    // The decoder keeps reading the options it was created with, so it can be
+    // moved only if they are the same as the new owner's.
+    if (!same_decoder_opts(p, d->f->global, parent->global)) {
+        MP_VERBOSE(p, "Decoder options differ, not reusing decoder.\n");
+        return false;
+    }
+
+    // The decoder thread must not wakeup the queue filter while moving it.
+    thread_lock(p);
+    mp_filter_reparent(p->public.f, parent);
+    // The queue options are the wrapper's, so they can follow the new owner
+    // (a prewarmed decoder's global limits the queue to 1 frame).
+    if (d->f->global != parent->global) {
+        talloc_free(p->opt_cache);
+        p->opt_cache = m_config_cache_alloc(p, parent->global,
+                                            &dec_wrapper_conf);
+        p->opts = p->opt_cache->opts;
+        p->queue_opts = p->header->type == STREAM_VIDEO ?
+                        p->opts->vdec_queue_opts : p->opts->adec_queue_opts;
+    }
+    p->warmup = false;
+    update_queue_config(p);
+    thread_unlock(p);
+
+    if (frame.type)
+        mp_async_queue_unread(p->queue, frame);
+    return true;
+}
+
 void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num)
 {
     struct priv *p = d->f->priv;
@@ -510,6 +622,15 @@ int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
     return res;
 }
 
+double mp_decoder_wrapper_get_queue_duration(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    mp_mutex_lock(&p->cache_lock);
+    double res = p->queue_duration;
+    mp_mutex_unlock(&p->cache_lock);
+    return res;
+}
+
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -990,6 +1111,8 @@ static void enqueue_backward_frame(struct priv *p, struct mp_frame frame)
     p->reverse_queue_complete = eof;
 }
 
+static void add_wait_sample(struct priv *p);
+
 static void read_frame(struct priv *p)
 {
     struct mp_pin *pin = p->decf->ppins[0];
@@ -998,6 +1121,9 @@ static void read_frame(struct priv *p)
     if (!p->decoder || !mp_pin_in_needs_data(pin))
         return;
 
+    if (p->queue && p->queue_opts->adaptive && !p->frame_wait_start)
+        p->frame_wait_start = mp_time_ns();
+
     if (p->decoded_coverart.type) {
         if (p->coverart_returned == 0) {
             frame = mp_frame_ref(p->decoded_coverart);
@@ -1088,21 +1214,89 @@ static void read_frame(struct priv *p)
 
 output_frame:
     process_output_frame(p, frame);
+    if (frame.type != MP_FRAME_EOF)
+        add_wait_sample(p);
     mp_pin_in_write(pin, frame);
 }
 
+// Queue duration that should cover the observed decode time jitter, clamped
+// to the user's bounds. Before enough samples were seen, or with the adaptive
+// mode disabled, this is the user's maximum.
+static double get_queue_duration(struct priv *p)
+{
+    struct dec_queue_opts *opts = p->queue_opts;
+    if (!opts->adaptive || p->num_wait_samples < ADAPT_INTERVAL)
+        return opts->max_duration;
+
+    // Enough time to ride out a run of frames that each take as long as a
+    // bad (mean + 4 sigma) frame, such as a keyframe or a B-frame burst.
+    double worst = p->wait_avg + 4 * sqrt(p->wait_var);
+    double duration = MPMAX(worst * ADAPT_FRAMES, opts->min_duration);
+    if (opts->max_duration > 0)
+        duration = MPMIN(duration, opts->max_duration);
+    return duration;
+}
+
 static void update_queue_config(struct priv *p)
 {
     if (!p->queue)
         return;
 
+    double duration = get_queue_duration(p);
+
+    // A queue the user did not ask for (detached wrapper) holds only 1 frame,
+    // which is close to no queue.
+    bool limit = p->warmup || !p->queue_opts->use_queue;
+
     struct mp_async_queue_config cfg = {
         .max_bytes = p->queue_opts->max_bytes,
         .sample_unit = AQUEUE_UNIT_SAMPLES,
-        .max_samples = p->queue_opts->max_samples,
-        .max_duration = p->queue_opts->max_duration,
+        .max_samples = limit ? 1 : p->queue_opts->max_samples,
+        .max_duration = duration,
+        // Audio decoders tend to output many small frames.
+        .batch_frames = !limit && p->header->type == STREAM_AUDIO ?
+                        AUDIO_QUEUE_BATCH : 0,
     };
     mp_async_queue_set_config(p->queue, cfg);
+
+    mp_mutex_lock(&p->cache_lock);
+    if (p->queue_duration != duration)
+        MP_DBG(p, "Queue duration set to %f.\n", duration);
+    p->queue_duration = duration;
+    mp_mutex_unlock(&p->cache_lock);
+}
+
+// Called for each frame output by the decoder. Measures how long the queue had
+// to wait for it (for --vd-queue-adaptive).
+static void add_wait_sample(struct priv *p)
+{
+    if (!p->frame_wait_start)
+        return;
+
+    double t = MP_TIME_NS_TO_S(mp_time_ns() - p->frame_wait_start);
+    p->frame_wait_start = 0;
+
+    // The first frame after a seek includes demuxer seeking and preroll, and
+    // frames returned from the reversal queue were decoded earlier.
+    if (p->skip_wait_sample || p->play_dir < 0) {
+        p->skip_wait_sample = false;
+        return;
+    }
+
+    t = MPMIN(t, 1.0);
+    if (!p->num_wait_samples) {
+        p->wait_avg = t;
+        p->wait_var = 0;
+    } else {
+        double a = 1.0 / ADAPT_INTERVAL;
+        double delta = t - p->wait_avg;
+        p->wait_avg += a * delta;
+        p->wait_var = (1 - a) * (p->wait_var + a * delta * delta);
+    }
+    p->num_wait_samples += 1;
+
+    if (p->num_wait_samples % ADAPT_INTERVAL == 0)
+        update_queue_config(p);
 }
 
 static void decf_process(struct mp_filter *f)
@@ -1202,8 +1396,9 @@ static void onlock_dec_thread(void *ptr)
     mp_filter_graph_interrupt(p->dec_root_filter);
 }
 
-struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
-                                                     struct sh_stream *src)
+static struct mp_decoder_wrapper *create_wrapper(struct mp_filter *parent,
+                                                 struct sh_stream *src,
+                                                 bool detached)
 {
     struct mp_filter *public_f = mp_filter_create(parent, &decode_wrapper_filter);
     if (!public_f)
@@ -1213,6 +1408,7 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
     p->public.f = public_f;
 
     mp_mutex_init(&p->cache_lock);
+    p->queue_duration = -1;
     p->opt_cache = m_config_cache_alloc(p, public_f->global, &dec_wrapper_conf);
     p->opts = p->opt_cache->opts;
     p->header = src;
@@ -1241,7 +1437,8 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         goto error;
     }
 
-    if (p->queue_opts && p->queue_opts->use_queue) {
+    if (p->queue_opts && (p->queue_opts->use_queue || detached)) {
+        p->warmup = detached;
         p->queue = mp_async_queue_create();
         p->dec_dispatch = mp_dispatch_create(p);
         p->dec_root_filter = mp_filter_create_root(public_f->global);
@@ -1300,6 +1497,18 @@ error:
     return NULL;
 }
 
+struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
+                                                     struct sh_stream *src)
+{
+    return create_wrapper(parent, src, false);
+}
+
+struct mp_decoder_wrapper *mp_decoder_wrapper_create_detached(
+    struct mp_filter *parent, struct sh_stream *src)
+{
+    return create_wrapper(parent, src, true);
+}
+
 void lavc_process(struct mp_filter *f, struct lavc_state *state,
                   int (*send)(struct mp_filter *f, struct demux_packet *pkt),
                   int (*receive)(struct mp_filter *f, struct mp_frame *res))
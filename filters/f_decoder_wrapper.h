@@ -43,12 +43,36 @@ struct mp_decoder_wrapper {
 struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
                                                      struct sh_stream *src);
 
+// Like mp_decoder_wrapper_create(), but always use a decoder thread, so that
+// mp_decoder_wrapper_reparent() works. Until it's reparented, the queue holds
+// only 1 frame. If the user disabled the queue, it stays at 1 frame after that.
+struct mp_decoder_wrapper *mp_decoder_wrapper_create_detached(
+    struct mp_filter *parent, struct sh_stream *src);
+
+// Move the decoder wrapper to a new parent filter, which may be part of a
+// different filter graph (see mp_filter_reparent()). This works only if the
+// decoder uses its own thread (--vd-queue-enable/--ad-queue-enable), and
+// returns false otherwise. It also returns false if parent uses a different
+// mpv_global whose decoder options differ from the ones the decoder was
+// created with; the queue options are taken from parent's mpv_global on
+// success. If frame is not empty, it is returned as next decoded frame (for
+// frames that were read before moving the decoder), and ownership is
+// transferred on success. The mp_stream_info (hwdec devices, DR)
+// is not updated; it remains whatever it was on creation.
+bool mp_decoder_wrapper_reparent(struct mp_decoder_wrapper *d,
+                                 struct mp_filter *parent,
+                                 struct mp_frame frame);
+
 // Legacy decoder framedrop control.
 void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num);
 int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d);
 
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d);
 
+// Current duration limit of the decoded frame queue in seconds (changes with
+// --vd-queue-adaptive), or -1 if there is no queue.
+double mp_decoder_wrapper_get_queue_duration(struct mp_decoder_wrapper *d);
+
 // Whether to prefer spdif wrapper over real decoders on next reinit.
 void mp_decoder_wrapper_set_spdif_flag(struct mp_decoder_wrapper *d, bool spdif);
 
@@ -107,6 +131,9 @@ extern const struct mp_decoder_fns vd_lavc;
 extern const struct mp_decoder_fns ad_lavc;
 extern const struct mp_decoder_fns ad_spdif;
 
+// Whether --hwdec requests hardware decoding (i.e. is not "no").
+bool vd_lavc_hwdec_requested(struct mpv_global *global);
+
 // Convenience wrapper for lavc based decoders. Treat lavc_state as private;
 // init to all-0 on init and resets.
 struct lavc_state {
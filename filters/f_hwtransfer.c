@@ -642,7 +642,20 @@ static void hwdownload_process(struct mp_filter *f)
     if (!src->hwctx)
         goto passthrough;
 
-    struct mp_image *dst = mp_image_hw_download(src, d->pool);
+    // Mappable surfaces (dmabuf) can be read in place, which avoids copying
+    // every frame through the CPU on systems with little memory bandwidth.
+    struct mp_image *dst = NULL;
+    if (!d->map_failed) {
+        dst = mp_image_hw_map_sw(src);
+        if (!dst) {
+            d->map_failed = true;
+        } else if (!d->map_logged) {
+            MP_VERBOSE(f, "Mapping hardware frames instead of copying.\n");
+            d->map_logged = true;
+        }
+    }
+    if (!dst)
+        dst = mp_image_hw_download(src, d->pool);
     if (!dst) {
         MP_ERR(f, "Could not copy hardware frame to CPU memory.\n");
         goto passthrough;
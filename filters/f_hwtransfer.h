@@ -23,6 +23,10 @@ struct mp_hwdownload {
     struct mp_filter *f;
 
     struct mp_image_pool *pool;
+
+    // mp_image_hw_map_sw() failed once; copy all following frames.
+    bool map_failed;
+    bool map_logged;
 };
 
 struct mp_hwdownload *mp_hwdownload_create(struct mp_filter *parent);
@@ -40,6 +40,11 @@
 #include "common/av_common.h"
 #include "common/tags.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/threads.h"
 
 #include "audio/format.h"
 #include "audio/aframe.h"
@@ -55,6 +60,13 @@
 #include "filter_internal.h"
 #include "user_filters.h"
 
+// A parsed, but not yet linked or configured graph.
+struct parsed_graph {
+    AVFilterGraph *graph;
+    AVFilterInOut *in, *out;    // unlinked pads (if !direct_filter)
+    AVFilterContext *filter;    // the filter (if direct_filter)
+};
+
 struct lavfi {
     struct mp_log *log;
     struct mp_filter *f;
@@ -103,6 +115,14 @@ struct lavfi {
 
     // Identify a specific hwdec_interop to use
     char *hwdec_interop;
+
+    // --lavfi-spare-graph: the next graph is parsed ahead of time, so that
+    // recreating the graph on resets doesn't have to wait for filter init.
+    struct mp_thread_pool *spare_pool;
+    mp_mutex spare_lock;
+    mp_cond spare_wakeup;
+    bool spare_pending;         // job queued or running (protected by lock)
+    struct parsed_graph spare;  // result (protected by lock)
 };
 
 struct lavfi_pad {
@@ -253,21 +273,28 @@ static void add_pads_direct(struct lavfi *c, int dir, AVFilterContext *f,
         add_pad(c, dir, n, f, n, avfilter_pad_get_name(pads, n), first_init);
 }
 
-// Parse the user-provided filter graph, and populate the unlinked filter pads.
-static void precreate_graph(struct lavfi *c, bool first_init)
+static void free_parsed_graph(struct parsed_graph *pg)
 {
-    mp_assert(!c->graph);
-
-    c->failed = false;
+    avfilter_inout_free(&pg->in);
+    avfilter_inout_free(&pg->out);
+    avfilter_graph_free(&pg->graph);
+    pg->filter = NULL;
+}
 
-    c->graph = avfilter_graph_alloc();
-    MP_HANDLE_OOM(c->graph);
+// Parse the user-provided filter graph. This initializes the filters, which
+// is the expensive part for some of them (e.g. loading models). Accesses only
+// parameters of c that are never changed after creation, so this can run on
+// any thread.
+static bool parse_graph(struct lavfi *c, struct parsed_graph *pg)
+{
+    pg->graph = avfilter_graph_alloc();
+    MP_HANDLE_OOM(pg->graph);
 
-    if (mp_set_avopts(c->log, c->graph, c->graph_opts) < 0)
+    if (mp_set_avopts(c->log, pg->graph, c->graph_opts) < 0)
         goto error;
 
     if (c->direct_filter) {
-        AVFilterContext *filter = avfilter_graph_alloc_filter(c->graph,
+        AVFilterContext *filter = avfilter_graph_alloc_filter(pg->graph,
                             avfilter_get_by_name(c->graph_string), "filter");
         if (!filter) {
             MP_FATAL(c, "filter '%s' not found or failed to allocate\n",
@@ -284,21 +311,100 @@ static void precreate_graph(struct lavfi *c, bool first_init)
             goto error;
         }
 
+        pg->filter = filter;
+    } else {
+        if (avfilter_graph_parse2(pg->graph, c->graph_string, &pg->in,
+                                  &pg->out) < 0)
+        {
+            MP_FATAL(c, "parsing the filter graph failed\n");
+            goto error;
+        }
+    }
+
+    return true;
+
+error:
+    free_parsed_graph(pg);
+    return false;
+}
+
+static void spare_graph_fn(void *ptr)
+{
+    struct lavfi *c = ptr;
+
+    struct parsed_graph pg = {0};
+    parse_graph(c, &pg);
+
+    mp_mutex_lock(&c->spare_lock);
+    c->spare = pg;
+    c->spare_pending = false;
+    mp_cond_broadcast(&c->spare_wakeup);
+    mp_mutex_unlock(&c->spare_lock);
+}
+
+// Start parsing the next graph in the background, if enabled.
+static void prepare_spare_graph(struct lavfi *c)
+{
+    if (!c->spare_pool)
+        return;
+
+    mp_mutex_lock(&c->spare_lock);
+    bool start = !c->spare_pending && !c->spare.graph;
+    c->spare_pending |= start;
+    mp_mutex_unlock(&c->spare_lock);
+
+    if (start && !mp_thread_pool_queue(c->spare_pool, spare_graph_fn, c)) {
+        mp_mutex_lock(&c->spare_lock);
+        c->spare_pending = false;
+        mp_mutex_unlock(&c->spare_lock);
+    }
+}
+
+// Take the graph prepared by prepare_spare_graph(), waiting for it if it's
+// still being parsed. Returns false if there is none.
+static bool take_spare_graph(struct lavfi *c, struct parsed_graph *pg)
+{
+    if (!c->spare_pool)
+        return false;
+
+    mp_mutex_lock(&c->spare_lock);
+    while (c->spare_pending)
+        mp_cond_wait(&c->spare_wakeup, &c->spare_lock);
+    *pg = c->spare;
+    c->spare = (struct parsed_graph){0};
+    mp_mutex_unlock(&c->spare_lock);
+
+    return pg->graph;
+}
+
+// Parse the user-provided filter graph, and populate the unlinked filter pads.
+static void precreate_graph(struct lavfi *c, bool first_init)
+{
+    mp_assert(!c->graph);
+
+    c->failed = false;
+
+    struct parsed_graph pg = {0};
+    if (!take_spare_graph(c, &pg) && !parse_graph(c, &pg))
+        goto error;
+
+    c->graph = pg.graph;
+    pg.graph = NULL;
+
+    if (c->direct_filter) {
+        AVFilterContext *filter = pg.filter;
         add_pads_direct(c, MP_PIN_IN, filter, filter->input_pads,
                         filter->nb_inputs, first_init);
         add_pads_direct(c, MP_PIN_OUT, filter, filter->output_pads,
                         filter->nb_outputs, first_init);
     } else {
-        AVFilterInOut *in = NULL, *out = NULL;
-        if (avfilter_graph_parse2(c->graph, c->graph_string, &in, &out) < 0) {
-            MP_FATAL(c, "parsing the filter graph failed\n");
-            goto error;
-        }
-        add_pads(c, MP_PIN_IN, in, first_init);
-        add_pads(c, MP_PIN_OUT, out, first_init);
-        avfilter_inout_free(&in);
-        avfilter_inout_free(&out);
+        add_pads(c, MP_PIN_IN, pg.in, first_init);
+        add_pads(c, MP_PIN_OUT, pg.out, first_init);
     }
+    free_parsed_graph(&pg);
+
+    // The next reset or format change will need another one.
+    prepare_spare_graph(c);
 
     for (int n = 0; n < c->num_all_pads; n++)
         c->failed |= !c->all_pads[n]->filter;
@@ -342,7 +448,7 @@ static bool is_aformat_ok(struct mp_aframe *a, struct mp_aframe *b)
 static bool is_vformat_ok(struct mp_image *a, struct mp_image *b)
 {
     return a->imgfmt == b->imgfmt &&
-           a->w == b->w && a->h && b->h &&
+           a->w == b->w && a->h == b->h &&
            a->params.p_w == b->params.p_w && a->params.p_h == b->params.p_h &&
            a->nominal_fps == b->nominal_fps;
 }
@@ -805,6 +911,13 @@ static void lavfi_destroy(struct mp_filter *f)
 
     lavfi_reset(f);
     av_frame_free(&c->tmp_frame);
+
+    if (c->spare_pool) {
+        talloc_free(c->spare_pool); // waits for the job to finish
+        free_parsed_graph(&c->spare);
+        mp_cond_destroy(&c->spare_wakeup);
+        mp_mutex_destroy(&c->spare_lock);
+    }
 }
 
 static bool lavfi_command(struct mp_filter *f, struct mp_filter_command *cmd)
@@ -855,6 +968,15 @@ static struct lavfi *lavfi_alloc(struct mp_filter *parent)
     c->public.f = f;
     c->tmp_frame = av_frame_alloc();
     MP_HANDLE_OOM(c->tmp_frame);
+    mp_filter_set_thread_safe(f, true);
+
+    struct filter_opts *opts = mp_get_config_group(NULL, f->global, &filter_conf);
+    if (opts->lavfi_spare_graph) {
+        mp_mutex_init(&c->spare_lock);
+        mp_cond_init(&c->spare_wakeup);
+        c->spare_pool = mp_thread_pool_create(c, 0, 0, 1);
+    }
+    talloc_free(opts);
 
     return c;
 }
@@ -1224,3 +1346,56 @@ const struct mp_user_filter_entry vf_lavfi_bridge = {
     },
     .create = lavfi_create,
 };
+
+struct gpu_shader_opts {
+    char *shader;
+    char **avopts;
+    char *hwdec_interop;
+};
+
+// Run a user shader with libavfilter's libplacebo filter. With Vulkan hwdec,
+// this operates on the decoded frames directly, so they stay on the GPU.
+static struct mp_filter *gpu_shader_create(struct mp_filter *parent,
+                                           void *options)
+{
+    struct gpu_shader_opts *opts = options;
+    struct mp_lavfi *l = NULL;
+
+    if (!opts->shader || !opts->shader[0]) {
+        mp_err(parent->log, "gpu-shader: no shader file set\n");
+    } else if (!avfilter_get_by_name("libplacebo")) {
+        mp_err(parent->log, "gpu-shader: FFmpeg was built without the "
+               "libplacebo filter\n");
+    } else {
+        // libplacebo only accepts a Vulkan device.
+        char *hwdec_interop =
+            opts->hwdec_interop ? opts->hwdec_interop : "vulkan";
+        char *path = mp_get_user_path(opts, parent->global, opts->shader);
+        char *args[] = {"custom_shader_path", path, NULL};
+        l = mp_lavfi_create_filter(parent, MP_FRAME_VIDEO, true, hwdec_interop,
+                                   opts->avopts, "libplacebo", args);
+    }
+
+    talloc_free(opts);
+    return l ? l->f : NULL;
+}
+
+#undef OPT_BASE_STRUCT
+#define OPT_BASE_STRUCT struct gpu_shader_opts
+
+const struct mp_user_filter_entry vf_gpu_shader = {
+    .desc = {
+        .description = "run a user shader on the GPU (libplacebo)",
+        .name = "gpu-shader",
+        .priv_size = sizeof(OPT_BASE_STRUCT),
+        .options = (const m_option_t[]){
+            {"shader", OPT_STRING(shader), .flags = M_OPT_FILE},
+            {"o", OPT_KEYVALUELIST(avopts)},
+            {"hwdec_interop",
+             OPT_STRING_VALIDATE(hwdec_interop,
+                                 ra_hwdec_validate_drivers_only_opt)},
+            {0}
+        },
+    },
+    .create = gpu_shader_create,
+};
@@ -3,10 +3,12 @@
 #include "common/global.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "video/out/vo.h"
 
 #include "filter_internal.h"
 
+#include "f_async_queue.h"
 #include "f_autoconvert.h"
 #include "f_auto_filters.h"
 #include "f_lavfi.h"
@@ -14,10 +16,18 @@
 #include "f_utils.h"
 #include "user_filters.h"
 
+// Number of output frames used to measure the per-frame cost of a user filter.
+#define STAGE_PROFILE_FRAMES 10
+// Frames buffered between a filter that runs as separate stage and the next.
+#define STAGE_QUEUE_FRAMES 2
+
 struct chain {
     struct mp_filter *f;
     struct mp_log *log;
 
+    // --filter-stage-threshold (0 if disabled)
+    double stage_threshold;
+
     enum mp_output_chain_type type;
 
     // Expected media type.
@@ -71,6 +81,15 @@ struct mp_user_filter {
 
     bool failed;
     bool error_eof_sent;
+
+    // Measuring the filter's cost for maybe_add_stage().
+    bool profiling;
+    int profile_frames;
+
+    // If set, output of f goes through this queue before going to wrapper's
+    // output, so f can run ahead of the following filters.
+    struct mp_async_queue *stage_queue;
+    struct mp_filter *stage_out;
 };
 
 static void update_output_caps(struct chain *p)
@@ -145,6 +164,46 @@ static void check_in_format_change(struct mp_user_filter *u,
     }
 }
 
+static void reset_stage(struct mp_user_filter *u)
+{
+    if (u->stage_queue) {
+        mp_async_queue_reset(u->stage_queue);
+        mp_async_queue_resume(u->stage_queue);
+    }
+}
+
+// If the user filter is slow enough, insert a queue after it. With multiple
+// filter threads, f and the filters after it can then work on different frames
+// at the same time. Must be called while f->pins[1] is not in use.
+static void maybe_add_stage(struct mp_user_filter *u)
+{
+    struct chain *p = u->p;
+
+    if (!u->profiling || ++u->profile_frames < STAGE_PROFILE_FRAMES)
+        return;
+
+    u->profiling = false;
+    double cost = mp_filter_get_process_time(u->f) / 1e9 / u->profile_frames;
+    mp_filter_set_timing(u->f, false);
+    if (cost < p->stage_threshold)
+        return;
+
+    MP_VERBOSE(p, "[%s] takes %.1f ms per frame, running it as separate "
+               "stage.\n", u->name, cost * 1e3);
+
+    u->stage_queue = mp_async_queue_create();
+    mp_async_queue_set_config(u->stage_queue, (struct mp_async_queue_config){
+        .max_bytes = INT64_MAX,
+        .max_samples = STAGE_QUEUE_FRAMES,
+    });
+    struct mp_filter *in =
+        mp_async_queue_create_filter(u->wrapper, MP_PIN_IN, u->stage_queue);
+    u->stage_out =
+        mp_async_queue_create_filter(u->wrapper, MP_PIN_OUT, u->stage_queue);
+    mp_pin_connect(in->pins[0], u->f->pins[1]);
+    mp_async_queue_resume(u->stage_queue);
+}
+
 static void user_wrapper_process(struct mp_filter *f)
 {
     struct mp_user_filter *u = f->priv;
@@ -164,6 +223,7 @@ static void user_wrapper_process(struct mp_filter *f)
         } else {
             MP_ERR(p, "Disabling filter %s because it has failed.\n", name);
             mp_filter_reset(u->f); // clear out staled buffered data
+            reset_stage(u);
         }
         u->failed = true;
     }
@@ -194,14 +254,18 @@ static void user_wrapper_process(struct mp_filter *f)
         mp_pin_in_write(u->f->pins[0], frame);
     }
 
-    if (mp_pin_can_transfer_data(f->ppins[1], u->f->pins[1])) {
-        struct mp_frame frame = mp_pin_out_read(u->f->pins[1]);
+    struct mp_pin *out = u->stage_out ? u->stage_out->pins[0] : u->f->pins[1];
+    if (mp_pin_can_transfer_data(f->ppins[1], out)) {
+        struct mp_frame frame = mp_pin_out_read(out);
 
         double pts = mp_frame_get_pts(frame);
         if (pts != MP_NOPTS_VALUE)
             u->last_out_pts = pts;
 
+        bool is_data = frame.type == p->frame_type;
         mp_pin_in_write(f->ppins[1], frame);
+        if (is_data)
+            maybe_add_stage(u);
 
         struct mp_filter_command cmd = {.type = MP_FILTER_COMMAND_IS_ACTIVE};
         if (mp_filter_command(u->f, &cmd) && u->last_is_active != cmd.is_active) {
@@ -218,6 +282,7 @@ static void user_wrapper_reset(struct mp_filter *f)
 
     u->error_eof_sent = false;
     u->last_in_pts = u->last_out_pts = MP_NOPTS_VALUE;
+    reset_stage(u);
 }
 
 static void user_wrapper_destroy(struct mp_filter *f)
@@ -228,6 +293,7 @@ static void user_wrapper_destroy(struct mp_filter *f)
     m_option_free(&dummy, &u->args);
 
     mp_filter_free_children(f);
+    talloc_free(u->stage_queue);
 }
 
 static const struct mp_filter_info user_wrapper_filter = {
@@ -571,6 +637,11 @@ bool mp_output_chain_update_filters(struct mp_output_chain *c,
                 goto error;
             }
 
+            if (p->stage_threshold > 0 && mp_filter_graph_get_threads(p->f) > 1) {
+                mp_filter_set_timing(u->f, true);
+                u->profiling = true;
+            }
+
             struct m_obj_settings *args = (struct m_obj_settings[2]){*entry, {0}};
 
             struct m_option dummy = {.type = &m_option_type_obj_settings_list};
@@ -703,6 +774,10 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     p->log = f->log;
     p->type = type;
 
+    struct filter_opts *opts = mp_get_config_group(NULL, f->global, &filter_conf);
+    p->stage_threshold = opts->stage_threshold;
+    talloc_free(opts);
+
     struct mp_output_chain *c = &p->public;
     c->f = f;
     c->input_aformat = talloc_steal(p, mp_aframe_create());
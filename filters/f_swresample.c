@@ -35,6 +35,33 @@
 #include "f_swresample.h"
 #include "filter_internal.h"
 
+// Number of previously used resamplers kept around. Switching playback speed
+// back and forth (or between files with different formats) would otherwise
+// recreate them, which includes computing the filter banks.
+#define LAVRR_CACHE_SIZE 4
+
+struct lavrr_key {
+    int in_rate;
+    int in_format;
+    struct mp_chmap in_channels;
+    int out_rate;
+    int out_format;
+    struct mp_chmap out_channels;
+};
+
+// An initialized, but currently unused resampler. See priv for the fields.
+struct lavrr_cache_entry {
+    struct lavrr_key key;
+    struct SwrContext *avrctx;
+    struct SwrContext *avrctx_out;
+    struct mp_aframe *avrctx_fmt;
+    struct mp_aframe *pool_fmt;
+    struct mp_aframe *pre_out_fmt;
+    int reorder_in[MP_NUM_CHANNELS];
+    int reorder_out[MP_NUM_CHANNELS];
+    bool is_resampling;
+};
+
 struct priv {
     struct mp_log *log;
     bool is_resampling;
@@ -50,6 +77,10 @@ struct priv {
     struct mp_aframe_pool *reorder_buffer;
     struct mp_aframe_pool *out_pool;
 
+    struct lavrr_key avrctx_key; // parameters avrctx was configured with
+    struct lavrr_cache_entry lavrr_cache[LAVRR_CACHE_SIZE]; // most recent first
+    int num_lavrr_cache;
+
     int in_rate_user; // user input sample rate
     int in_rate;      // actual rate (used by lavr), adjusted for playback speed
     int in_format;
@@ -104,6 +135,96 @@ static void close_lavrr(struct priv *p)
     TA_FREEP(&p->pool_fmt);
 }
 
+static bool lavrr_key_equals(struct lavrr_key *a, struct lavrr_key *b)
+{
+    return a->in_rate == b->in_rate && a->in_format == b->in_format &&
+           mp_chmap_equals(&a->in_channels, &b->in_channels) &&
+           a->out_rate == b->out_rate && a->out_format == b->out_format &&
+           mp_chmap_equals(&a->out_channels, &b->out_channels);
+}
+
+static void free_cache_entry(struct lavrr_cache_entry *e)
+{
+    swr_free(&e->avrctx);
+    swr_free(&e->avrctx_out);
+    TA_FREEP(&e->pre_out_fmt);
+    TA_FREEP(&e->avrctx_fmt);
+    TA_FREEP(&e->pool_fmt);
+}
+
+static void flush_lavrr_cache(struct priv *p)
+{
+    for (int n = 0; n < p->num_lavrr_cache; n++)
+        free_cache_entry(&p->lavrr_cache[n]);
+    p->num_lavrr_cache = 0;
+}
+
+// Like close_lavrr(), but put the resampler into the cache.
+static void stash_lavrr(struct priv *p)
+{
+    if (!p->avrctx || !p->avrctx_out) {
+        close_lavrr(p);
+        return;
+    }
+
+    if (p->num_lavrr_cache == LAVRR_CACHE_SIZE)
+        free_cache_entry(&p->lavrr_cache[--p->num_lavrr_cache]);
+    memmove(&p->lavrr_cache[1], &p->lavrr_cache[0],
+            p->num_lavrr_cache * sizeof(p->lavrr_cache[0]));
+    p->num_lavrr_cache++;
+
+    struct lavrr_cache_entry *e = &p->lavrr_cache[0];
+    *e = (struct lavrr_cache_entry){
+        .key = p->avrctx_key,
+        .avrctx = p->avrctx,
+        .avrctx_out = p->avrctx_out,
+        .avrctx_fmt = p->avrctx_fmt,
+        .pool_fmt = p->pool_fmt,
+        .pre_out_fmt = p->pre_out_fmt,
+        .is_resampling = p->is_resampling,
+    };
+    memcpy(e->reorder_in, p->reorder_in, sizeof(e->reorder_in));
+    memcpy(e->reorder_out, p->reorder_out, sizeof(e->reorder_out));
+
+    p->avrctx = p->avrctx_out = NULL;
+    p->avrctx_fmt = p->pool_fmt = p->pre_out_fmt = NULL;
+}
+
+// Make a cached resampler for key the current one. The libswresample state is
+// reset, so no audio from its previous use is output.
+static bool unstash_lavrr(struct priv *p, struct lavrr_key *key)
+{
+    for (int n = 0; n < p->num_lavrr_cache; n++) {
+        struct lavrr_cache_entry *e = &p->lavrr_cache[n];
+        if (!lavrr_key_equals(&e->key, key))
+            continue;
+
+        mp_assert(!p->avrctx);
+        p->avrctx_key = e->key;
+        p->avrctx = e->avrctx;
+        p->avrctx_out = e->avrctx_out;
+        p->avrctx_fmt = e->avrctx_fmt;
+        p->pool_fmt = e->pool_fmt;
+        p->pre_out_fmt = e->pre_out_fmt;
+        p->is_resampling = e->is_resampling;
+        // The contexts point to p->reorder_in.
+        memcpy(p->reorder_in, e->reorder_in, sizeof(p->reorder_in));
+        memcpy(p->reorder_out, e->reorder_out, sizeof(p->reorder_out));
+
+        memmove(&p->lavrr_cache[n], &p->lavrr_cache[n + 1],
+                (p->num_lavrr_cache - n - 1) * sizeof(p->lavrr_cache[0]));
+        p->num_lavrr_cache--;
+
+        swr_close(p->avrctx);
+        if (swr_init(p->avrctx) < 0) {
+            close_lavrr(p);
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
 static int rate_from_speed(int rate, double speed)
 {
     return lrint(rate * speed);
@@ -158,7 +279,7 @@ static void transpose_order(int *map, int num)
 
 static bool configure_lavrr(struct priv *p, bool verbose)
 {
-    close_lavrr(p);
+    stash_lavrr(p);
 
     p->in_rate = rate_from_speed(p->in_rate_user, p->speed);
 
@@ -168,6 +289,20 @@ static bool configure_lavrr(struct priv *p, bool verbose)
                p->out_rate, mp_chmap_to_str(&p->out_channels),
                af_fmt_to_str(p->out_format));
 
+    struct lavrr_key key = {
+        .in_rate = p->in_rate,
+        .in_format = p->in_format,
+        .in_channels = p->in_channels,
+        .out_rate = p->out_rate,
+        .out_format = p->out_format,
+        .out_channels = p->out_channels,
+    };
+    if (unstash_lavrr(p, &key)) {
+        MP_VERBOSE(p, "Reusing cached resampler.\n");
+        return true;
+    }
+    p->avrctx_key = key;
+
     p->avrctx = swr_alloc();
     p->avrctx_out = swr_alloc();
     if (!p->avrctx || !p->avrctx_out)
@@ -634,6 +769,7 @@ static void swresample_destroy(struct mp_filter *f)
     struct priv *p = f->priv;
 
     close_lavrr(p);
+    flush_lavrr_cache(p);
     TA_FREEP(&p->input);
 }
 
@@ -142,6 +142,8 @@ struct mp_sws_filter *mp_sws_filter_create(struct mp_filter *parent)
     mp_filter_add_pin(f, MP_PIN_IN, "in");
     mp_filter_add_pin(f, MP_PIN_OUT, "out");
 
+    mp_filter_set_thread_safe(f, true);
+
     struct mp_sws_filter *s = f->priv;
     s->f = f;
     s->sws = mp_sws_alloc(s);
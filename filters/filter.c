@@ -7,6 +7,7 @@
 #include "common/global.h"
 #include "common/msg.h"
 #include "demux/packet_pool.h"
+#include "misc/thread_pool.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "video/hwdec.h"
@@ -61,6 +62,13 @@ struct mp_pin {
     bool data_requested;            // true if out wants new data
     struct mp_frame data;           // possibly buffered frame (MP_FRAME_NONE if
                                     // empty, usually only temporary)
+
+    // For mp_pin_set_batch_size(). Frames queued after data (only if data is
+    // set). With batch_size > 1, data_requested stays set until
+    // 1 + num_queue == batch_size.
+    int batch_size;
+    struct mp_frame *queue;
+    int num_queue;
 };
 
 // Root filters create this, all other filters reference it.
@@ -93,6 +101,17 @@ struct filter_runner {
     // across filters.
     mp_mutex async_lock;
 
+    // For mp_filter_graph_set_threads(). Filters marked with
+    // mp_filter_set_thread_safe() can run concurrently on the pool.
+    struct mp_task_pool *pool;
+    int threads;
+
+    // Set while filters are running concurrently. Only changed by the thread
+    // running the graph while no workers are active. If set, all pin state
+    // and the pending set are protected by lock.
+    bool parallel;
+    mp_mutex lock;
+
     // Wakeup is pending. Protected by async_lock.
     bool async_wakeup_sent;
 
@@ -115,12 +134,31 @@ struct mp_filter_internal {
 
     char *name;
     bool high_priority;
+    bool thread_safe;
+
+    bool timing;
+    int64_t process_time;
+
+    struct mp_filter_stats stats;
 
     bool pending;
     bool async_pending;
     bool failed;
 };
 
+// Lock the graph state if filters are running concurrently. Free otherwise.
+static void runner_lock(struct filter_runner *r)
+{
+    if (r->parallel)
+        mp_mutex_lock(&r->lock);
+}
+
+static void runner_unlock(struct filter_runner *r)
+{
+    if (r->parallel)
+        mp_mutex_unlock(&r->lock);
+}
+
 // Called when new work needs to be done on a pin belonging to the filter:
 //  - new data was requested
 //  - new data has been queued
@@ -190,7 +228,9 @@ void mp_filter_internal_mark_progress(struct mp_filter *f)
 {
     struct filter_runner *r = f->in->runner;
     mp_assert(r->filtering); // only call from f's process()
+    runner_lock(r);
     add_pending(f);
+    runner_unlock(r);
 }
 
 // Basically copy the async notifications to the sync ones. Done so that the
@@ -208,6 +248,55 @@ static void flush_async_notifications(struct filter_runner *r)
     mp_mutex_unlock(&r->async_lock);
 }
 
+static void process_filter(struct mp_filter *f)
+{
+    if (!f->in->info->process)
+        return;
+
+    int64_t start = mp_time_ns();
+    f->in->info->process(f);
+    int64_t time = mp_time_ns() - start;
+
+    f->in->stats.process_calls += 1;
+    f->in->stats.process_time += time;
+    if (f->in->timing)
+        f->in->process_time += time;
+}
+
+static void worker_fn(void *ptr, int index)
+{
+    struct mp_filter **batch = ptr;
+
+    process_filter(batch[index]);
+}
+
+// Run next, and up to r->threads - 1 other pending thread-safe filters, at the
+// same time. next was already removed from the pending set.
+static void run_parallel(struct filter_runner *r, struct mp_filter *next)
+{
+    struct mp_filter *batch[MP_FILTER_MAX_THREADS];
+    int num_batch = 0;
+
+    batch[num_batch++] = next;
+    for (int n = r->num_pending - 1; n >= 0 && num_batch < r->threads; n--) {
+        struct mp_filter *f = r->pending[n];
+        if (f->in->thread_safe && !f->in->high_priority) {
+            MP_TARRAY_REMOVE_AT(r->pending, r->num_pending, n);
+            f->in->pending = false;
+            batch[num_batch++] = f;
+        }
+    }
+
+    if (num_batch == 1) {
+        process_filter(next);
+        return;
+    }
+
+    r->parallel = true;
+    mp_task_pool_run_all(r->pool, MP_TASK_REALTIME, num_batch, worker_fn, batch);
+    r->parallel = false;
+}
+
 bool mp_filter_graph_run(struct mp_filter *filter)
 {
     struct filter_runner *r = filter->in->runner;
@@ -259,8 +348,11 @@ bool mp_filter_graph_run(struct mp_filter *filter)
             break;
 
         next->in->pending = false;
-        if (next->in->info->process)
-            next->in->info->process(next);
+        if (r->pool && next->in->thread_safe && !next->in->high_priority) {
+            run_parallel(r, next);
+        } else {
+            process_filter(next);
+        }
 
         if (end_time && mp_time_ns() >= end_time)
             mp_filter_graph_interrupt(r->root_filter);
@@ -273,52 +365,55 @@ bool mp_filter_graph_run(struct mp_filter *filter)
     return externals;
 }
 
-bool mp_pin_can_transfer_data(struct mp_pin *dst, struct mp_pin *src)
-{
-    return mp_pin_in_needs_data(dst) && mp_pin_out_request_data(src);
-}
-
-bool mp_pin_transfer_data(struct mp_pin *dst, struct mp_pin *src)
-{
-    if (!mp_pin_can_transfer_data(dst, src))
-        return false;
-    mp_pin_in_write(dst, mp_pin_out_read(src));
-    return true;
-}
+// The pin_*() functions implement the public mp_pin_*() ones without taking
+// the graph lock.
 
-bool mp_pin_in_needs_data(struct mp_pin *p)
+static bool pin_in_needs_data(struct mp_pin *p)
 {
     mp_assert(p->dir == MP_PIN_IN);
     mp_assert(!p->within_conn);
     return p->conn && p->conn->manual_connection && p->conn->data_requested;
 }
 
-bool mp_pin_in_write(struct mp_pin *p, struct mp_frame frame)
+static bool pin_in_write(struct mp_pin *p, struct mp_frame frame)
 {
-    if (!mp_pin_in_needs_data(p) || frame.type == MP_FRAME_NONE) {
+    if (!pin_in_needs_data(p) || frame.type == MP_FRAME_NONE) {
         if (frame.type)
             MP_ERR(p->owner, "losing frame on %s\n", p->name);
         mp_frame_unref(&frame);
         return false;
     }
-    mp_assert(p->conn->data.type == MP_FRAME_NONE);
-    p->conn->data = frame;
-    p->conn->data_requested = false;
-    add_pending_pin(p->conn);
+    if (mp_frame_is_data(frame)) {
+        p->owner->in->stats.frames_out += 1;
+        p->owner->in->stats.bytes_out += mp_frame_approx_size(frame);
+    }
+    struct mp_pin *c = p->conn;
+    if (c->data.type == MP_FRAME_NONE) {
+        c->data = frame;
+    } else {
+        mp_assert(c->batch_size > 1);
+        MP_TARRAY_APPEND(c, c->queue, c->num_queue, frame);
+    }
+    // Keep accepting frames until the batch is full. The writer is called
+    // again to fill it before the reader runs.
+    c->data_requested = 1 + c->num_queue < c->batch_size;
+    add_pending_pin(c);
+    if (c->data_requested)
+        add_pending_pin(p);
     filter_recursive(p);
     return true;
 }
 
-bool mp_pin_out_has_data(struct mp_pin *p)
+static bool pin_out_has_data(struct mp_pin *p)
 {
     mp_assert(p->dir == MP_PIN_OUT);
     mp_assert(!p->within_conn);
     return p->conn && p->conn->manual_connection && p->data.type != MP_FRAME_NONE;
 }
 
-bool mp_pin_out_request_data(struct mp_pin *p)
+static bool pin_out_request_data(struct mp_pin *p)
 {
-    if (mp_pin_out_has_data(p))
+    if (pin_out_has_data(p))
         return true;
     if (p->conn && p->conn->manual_connection) {
         if (!p->data_requested) {
@@ -327,36 +422,132 @@ bool mp_pin_out_request_data(struct mp_pin *p)
         }
         filter_recursive(p);
     }
-    return mp_pin_out_has_data(p);
+    return pin_out_has_data(p);
 }
 
-void mp_pin_out_request_data_next(struct mp_pin *p)
+static struct mp_frame pin_out_read(struct mp_pin *p)
 {
-    if (mp_pin_out_request_data(p))
-        add_pending_pin(p->conn);
-}
-
-struct mp_frame mp_pin_out_read(struct mp_pin *p)
-{
-    if (!mp_pin_out_request_data(p))
+    if (!pin_out_request_data(p))
         return MP_NO_FRAME;
     struct mp_frame res = p->data;
     p->data = MP_NO_FRAME;
+    if (p->num_queue) {
+        p->data = p->queue[0];
+        MP_TARRAY_REMOVE_AT(p->queue, p->num_queue, 0);
+    }
+    if (mp_frame_is_data(res))
+        p->owner->in->stats.frames_in += 1;
     return res;
 }
 
-void mp_pin_out_unread(struct mp_pin *p, struct mp_frame frame)
+static void pin_out_unread(struct mp_pin *p, struct mp_frame frame)
 {
     mp_assert(p->dir == MP_PIN_OUT);
     mp_assert(!p->within_conn);
     mp_assert(p->conn && p->conn->manual_connection);
     // Unread is allowed strictly only if you didn't do anything else with
-    // the pin since the time you read it.
-    mp_assert(!mp_pin_out_has_data(p));
-    mp_assert(!p->data_requested);
+    // the pin since the time you read it. (With batching, further frames may
+    // have been queued already; frame goes before them.)
+    if (p->batch_size > 1 && pin_out_has_data(p)) {
+        MP_TARRAY_INSERT_AT(p, p->queue, p->num_queue, 0, p->data);
+    } else {
+        mp_assert(!pin_out_has_data(p));
+        mp_assert(!p->data_requested || p->batch_size > 1);
+    }
     p->data = frame;
 }
 
+bool mp_pin_can_transfer_data(struct mp_pin *dst, struct mp_pin *src)
+{
+    struct filter_runner *r = src->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_in_needs_data(dst) && pin_out_request_data(src);
+    runner_unlock(r);
+    return res;
+}
+
+bool mp_pin_transfer_data(struct mp_pin *dst, struct mp_pin *src)
+{
+    struct filter_runner *r = src->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_in_needs_data(dst) && pin_out_request_data(src);
+    if (res)
+        pin_in_write(dst, pin_out_read(src));
+    runner_unlock(r);
+    return res;
+}
+
+bool mp_pin_in_needs_data(struct mp_pin *p)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_in_needs_data(p);
+    runner_unlock(r);
+    return res;
+}
+
+bool mp_pin_in_write(struct mp_pin *p, struct mp_frame frame)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_in_write(p, frame);
+    runner_unlock(r);
+    return res;
+}
+
+bool mp_pin_out_has_data(struct mp_pin *p)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_out_has_data(p);
+    runner_unlock(r);
+    return res;
+}
+
+bool mp_pin_out_request_data(struct mp_pin *p)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    bool res = pin_out_request_data(p);
+    runner_unlock(r);
+    return res;
+}
+
+void mp_pin_out_request_data_next(struct mp_pin *p)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    if (pin_out_request_data(p))
+        add_pending_pin(p->conn);
+    runner_unlock(r);
+}
+
+struct mp_frame mp_pin_out_read(struct mp_pin *p)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    struct mp_frame res = pin_out_read(p);
+    runner_unlock(r);
+    return res;
+}
+
+void mp_pin_out_unread(struct mp_pin *p, struct mp_frame frame)
+{
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    pin_out_unread(p, frame);
+    runner_unlock(r);
+}
+
+void mp_pin_set_batch_size(struct mp_pin *p, int n)
+{
+    mp_assert(p->dir == MP_PIN_OUT);
+    struct filter_runner *r = p->owner->in->runner;
+    runner_lock(r);
+    p->batch_size = n;
+    runner_unlock(r);
+}
+
 void mp_pin_out_repeat_eof(struct mp_pin *p)
 {
     mp_pin_out_unread(p, MP_EOF_FRAME);
@@ -473,6 +664,14 @@ struct mp_filter *mp_pin_get_manual_connection(struct mp_pin *p)
     return p->manual_connection;
 }
 
+static void clear_pin_data(struct mp_pin *p)
+{
+    mp_frame_unref(&p->data);
+    for (int n = 0; n < p->num_queue; n++)
+        mp_frame_unref(&p->queue[n]);
+    p->num_queue = 0;
+}
+
 static void deinit_connection(struct mp_pin *p)
 {
     if (p->dir == MP_PIN_OUT)
@@ -490,7 +689,7 @@ static void deinit_connection(struct mp_pin *p)
             MP_VERBOSE(p->owner, "dropping frame due to pin disconnect\n");
         if (p->data_requested)
             MP_VERBOSE(p->owner, "dropping request due to pin disconnect\n");
-        mp_frame_unref(&p->data);
+        clear_pin_data(p);
         p = p->other->user_conn;
     }
 }
@@ -542,6 +741,39 @@ void mp_filter_set_high_priority(struct mp_filter *f, bool pri)
     f->in->high_priority = pri;
 }
 
+void mp_filter_set_thread_safe(struct mp_filter *f, bool ts)
+{
+    f->in->thread_safe = ts;
+}
+
+void mp_filter_set_timing(struct mp_filter *f, bool enable)
+{
+    f->in->timing = enable;
+    f->in->process_time = 0;
+}
+
+int64_t mp_filter_get_process_time(struct mp_filter *f)
+{
+    return f->in->process_time;
+}
+
+void mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st)
+{
+    *st = f->in->stats;
+    st->type = f->in->info->name;
+    st->queued = 0;
+    for (int n = 0; n < f->num_pins; n++) {
+        st->queued += f->pins[n]->data.type != MP_FRAME_NONE;
+        st->queued += f->ppins[n]->data.type != MP_FRAME_NONE;
+        st->queued += f->pins[n]->num_queue + f->ppins[n]->num_queue;
+    }
+}
+
+struct mp_filter *mp_filter_get_child(struct mp_filter *f, int n)
+{
+    return n >= 0 && n < f->in->num_children ? f->in->children[n] : NULL;
+}
+
 void mp_filter_set_name(struct mp_filter *f, const char *name)
 {
     talloc_free(f->in->name);
@@ -564,6 +796,8 @@ void mp_filter_set_error_handler(struct mp_filter *f, struct mp_filter *handler)
 
 void mp_filter_internal_mark_failed(struct mp_filter *f)
 {
+    struct filter_runner *r = f->in->runner;
+    runner_lock(r);
     while (f) {
         f->in->failed = true;
         if (f->in->error_handler) {
@@ -572,12 +806,16 @@ void mp_filter_internal_mark_failed(struct mp_filter *f)
         }
         f = f->in->parent;
     }
+    runner_unlock(r);
 }
 
 bool mp_filter_has_failed(struct mp_filter *filter)
 {
+    struct filter_runner *r = filter->in->runner;
+    runner_lock(r);
     bool failed = filter->in->failed;
     filter->in->failed = false;
+    runner_unlock(r);
     return failed;
 }
 
@@ -587,7 +825,7 @@ static void reset_pin(struct mp_pin *p)
         mp_assert(!p->data.type);
         mp_assert(!p->data_requested);
     }
-    mp_frame_unref(&p->data);
+    clear_pin_data(p);
     p->data_requested = false;
 }
 
@@ -739,6 +977,27 @@ void mp_filter_graph_set_max_run_time(struct mp_filter *f, double seconds)
     r->max_run_time = seconds;
 }
 
+void mp_filter_graph_set_threads(struct mp_filter *f, int threads)
+{
+    struct filter_runner *r = f->in->runner;
+    mp_assert(f == r->root_filter); // user is supposed to call this on root only
+    mp_assert(!r->filtering);
+
+    threads = MPCLAMP(threads, 1, MP_FILTER_MAX_THREADS);
+    if (threads == r->threads)
+        return;
+
+    struct mp_task_pool *old = r->pool;
+    r->pool = threads > 1 ? mp_task_pool_get(r) : NULL;
+    r->threads = threads;
+    talloc_free(old);
+}
+
+int mp_filter_graph_get_threads(struct mp_filter *f)
+{
+    return f->in->runner->threads;
+}
+
 void mp_filter_graph_interrupt(struct mp_filter *f)
 {
     struct filter_runner *r = f->in->runner;
@@ -746,6 +1005,65 @@ void mp_filter_graph_interrupt(struct mp_filter *f)
     atomic_store(&r->interrupt_flag, true);
 }
 
+// Move f and its children to the filter graph of r. f must not receive async
+// notifications while this happens.
+static void move_to_runner(struct mp_filter *f, struct filter_runner *r)
+{
+    struct filter_runner *old = f->in->runner;
+
+    for (int n = 0; n < old->num_pending; n++) {
+        if (old->pending[n] == f) {
+            MP_TARRAY_REMOVE_AT(old->pending, old->num_pending, n);
+            break;
+        }
+    }
+    f->in->pending = false;
+
+    mp_mutex_lock(&old->async_lock);
+    for (int n = 0; n < old->num_async_pending; n++) {
+        if (old->async_pending[n] == f) {
+            MP_TARRAY_REMOVE_AT(old->async_pending, old->num_async_pending, n);
+            break;
+        }
+    }
+    f->in->async_pending = false;
+    f->in->runner = r;
+    mp_mutex_unlock(&old->async_lock);
+
+    // Pin state might have changed while nobody was looking.
+    add_pending(f);
+
+    for (int n = 0; n < f->in->num_children; n++)
+        move_to_runner(f->in->children[n], r);
+}
+
+void mp_filter_reparent(struct mp_filter *f, struct mp_filter *parent)
+{
+    mp_assert(f->in->parent && parent);
+    mp_assert(!f->in->runner->filtering);
+
+    for (int n = 0; n < f->num_pins; n++)
+        mp_pin_disconnect(f->pins[n]);
+
+    struct mp_filter_internal *old_p = f->in->parent->in;
+    for (int n = 0; n < old_p->num_children; n++) {
+        if (old_p->children[n] == f) {
+            MP_TARRAY_REMOVE_AT(old_p->children, old_p->num_children, n);
+            break;
+        }
+    }
+
+    if (parent->in->runner != f->in->runner)
+        move_to_runner(f, parent->in->runner);
+
+    f->in->parent = parent;
+    struct mp_filter_internal *new_p = parent->in;
+    MP_TARRAY_APPEND(new_p, new_p->children, new_p->num_children, f);
+
+    for (int n = 0; n < f->num_pins; n++)
+        mp_pin_set_manual_connection_for(f->pins[n], parent);
+}
+
 void mp_filter_free_children(struct mp_filter *f)
 {
     while(f->in->num_children)
@@ -790,6 +1108,8 @@ static void filter_destructor(void *p)
     if (r->root_filter == f) {
         mp_assert(!f->in->parent);
         mp_mutex_destroy(&r->async_lock);
+        talloc_free(r->pool);
+        mp_mutex_destroy(&r->lock);
         talloc_free(r->async_pending);
         talloc_free(r);
     }
@@ -804,7 +1124,8 @@ struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
         .priv = params->info->priv_size ?
                     talloc_zero_size(f, params->info->priv_size) : NULL,
         .global = params->global,
-        .packet_pool = demux_packet_pool_get(params->parent ? params->parent->global : params->global),
+        .packet_pool = demux_packet_pool_create_local(f,
+            demux_packet_pool_get(params->parent ? params->parent->global : params->global)),
         .in = talloc(f, struct mp_filter_internal),
     };
     *f->in = (struct mp_filter_internal){
@@ -821,8 +1142,10 @@ struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
             .global = params->global,
             .root_filter = f,
             .max_run_time = INFINITY,
+            .threads = 1,
         };
         mp_mutex_init(&f->in->runner->async_lock);
+        mp_mutex_init(&f->in->runner->lock);
     }
 
     if (!f->global)
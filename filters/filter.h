@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <libavutil/hwcontext.h>
 
 #include "frame.h"
@@ -86,6 +87,16 @@ struct mp_frame mp_pin_out_read(struct mp_pin *p);
 // that, call mp_filter_internal_mark_progress() manually in addition.
 void mp_pin_out_unread(struct mp_pin *p, struct mp_frame frame);
 
+// Allow up to n frames to be queued on p (n <= 1 disables this, the default).
+// Once data was requested, the writer may write further frames until the batch
+// is full, and it is scheduled to do so before the reader runs. The reader can
+// then read all of them in one process() call by calling mp_pin_out_read()
+// while mp_pin_out_has_data() returns true. This reduces scheduling overhead
+// for streams of many small frames, but adds buffering.
+// p must be a reading pin (dir==MP_PIN_OUT), normally one of the filter's own
+// input pins (f->ppins[n]).
+void mp_pin_set_batch_size(struct mp_pin *p, int n);
+
 // A helper to make draining on MP_FRAME_EOF frames easier. For filters which
 // buffer data, but have no easy way to buffer MP_FRAME_EOF frames natively.
 // This is to be used as follows:
@@ -352,6 +363,13 @@ void mp_filter_set_name(struct mp_filter *f, const char *name);
 // priority filters disable "interrupting" the filter graph.
 void mp_filter_set_high_priority(struct mp_filter *filter, bool pri);
 
+// Declare that the filter's process() function may run concurrently with other
+// such filters on a different thread (see mp_filter_graph_set_threads()). This
+// requires that process() only accesses the filter's own state, uses its own
+// pins only through the mp_pin_*() data flow functions, and does not create,
+// destroy, or (re)connect filters or pins.
+void mp_filter_set_thread_safe(struct mp_filter *filter, bool ts);
+
 // Get a pin from f->pins[] for which mp_pin_get_name() returns the same name.
 // If name is NULL, always return NULL.
 struct mp_pin *mp_filter_get_named_pin(struct mp_filter *f, const char *name);
@@ -429,6 +447,19 @@ bool mp_filter_graph_run(struct mp_filter *root);
 // Can be called on the root filter only.
 void mp_filter_graph_set_max_run_time(struct mp_filter *root, double seconds);
 
+#define MP_FILTER_MAX_THREADS 16
+
+// Set the number of threads mp_filter_graph_run() uses (default: 1). With more
+// than 1 thread, pending filters marked with mp_filter_set_thread_safe() are
+// processed concurrently on a worker pool; all other filters still run on the
+// calling thread, one at a time.
+// Can be called on the root filter only, and not while filtering.
+void mp_filter_graph_set_threads(struct mp_filter *root, int threads);
+
+// Return the number of threads set with mp_filter_graph_set_threads(). Can be
+// called on any filter of the graph.
+int mp_filter_graph_get_threads(struct mp_filter *f);
+
 // Interrupt mp_filter_graph_run() asynchronously. This does not stop filtering
 // in a destructive way, but merely suspends it. In practice, this will make
 // mp_filter_graph_run() return after the current filter's process() function has
@@ -459,6 +490,14 @@ void mp_filter_graph_interrupt(struct mp_filter *root);
 // on the root filters of the connected filters to drive data flow.
 struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 
+// Move the filter f (including all children) to a new parent filter, which
+// can be part of a different filter graph. All of f's pins are disconnected,
+// and then become manual connections of parent (like with newly created
+// filters). Connections between f and its children are kept. Neither graph
+// may be running, and the caller must make sure f does not receive async
+// notifications (mp_filter_wakeup()) during the call.
+void mp_filter_reparent(struct mp_filter *f, struct mp_filter *parent);
+
 // Asynchronous filters may need to wakeup the user thread if the status of any
 // mp_pin has changed. If this is called, the callback provider should get the
 // user's thread to call mp_filter_graph_run() again.
@@ -470,5 +509,23 @@ struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 void mp_filter_graph_set_wakeup_cb(struct mp_filter *root,
                                    void (*wakeup_cb)(void *ctx), void *ctx);
 
+// Counters which are always maintained for each filter since its creation.
+struct mp_filter_stats {
+    const char *type;       // mp_filter_info.name
+    int64_t process_calls;  // number of process() invocations
+    int64_t process_time;   // total time spent in process() (nanoseconds)
+    int64_t frames_in;      // data frames read from the filter's own pins
+    int64_t frames_out;     // data frames written to the filter's own pins
+    int64_t bytes_out;      // mp_frame_approx_size() sum of frames_out
+    int queued;             // frames currently buffered on the filter's pins
+};
+
+// Get the counters of f (not including its children). Must be called from the
+// thread running the filter graph, while it's not running.
+void mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st);
+
+// Return the n-th direct child of f, or NULL if there are fewer children.
+struct mp_filter *mp_filter_get_child(struct mp_filter *f, int n);
+
 // Debugging internal stuff.
 void mp_filter_dump_states(struct mp_filter *f);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "filter.h"
 
@@ -21,6 +22,15 @@ void mp_filter_mark_async_progress(struct mp_filter *f);
 // In practice, this means process() is repeated.
 void mp_filter_internal_mark_progress(struct mp_filter *f);
 
+// Measure the time spent in f's process() function (only f itself, not any
+// other filters like its children). Enabling or disabling it resets the total.
+// Disabled by default.
+void mp_filter_set_timing(struct mp_filter *f, bool enable);
+
+// Total time spent in f's process() function while timing was enabled, in
+// nanoseconds.
+int64_t mp_filter_get_process_time(struct mp_filter *f);
+
 // Flag the filter as having failed, and propagate the error to the parent
 // filter. The error propagation stops either at the root filter, or if a filter
 // has an error handler set.
@@ -84,6 +84,7 @@ const struct mp_user_filter_entry *vf_list[] = {
     &vf_format,
     &vf_lavfi,
     &vf_lavfi_bridge,
+    &vf_gpu_shader,
     &vf_sub,
 #if HAVE_ZIMG
     &vf_fingerprint,
@@ -248,7 +248,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 5)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 9)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1130,6 +1130,41 @@ MPV_EXPORT int mpv_set_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 MPV_EXPORT int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
                                 void *data);
 
+/**
+ * Opaque handle to a property, see mpv_resolve_property().
+ */
+typedef struct mpv_property_ref mpv_property_ref;
+
+/**
+ * Look up the property with the given name, and return a handle that can be
+ * passed to mpv_get_property_ref(). This is useful for properties which are
+ * read very often, because reading through the handle skips the name lookup.
+ * Sub-properties like "track-list/count" can be resolved as well.
+ *
+ * The handle can only be used with mpv_handles of the same core, and must be
+ * freed with mpv_free() before the core is destroyed. The set of properties
+ * never changes at runtime, so a handle never becomes invalid otherwise.
+ *
+ * @param name The property name.
+ * @return A new handle, or NULL if the property does not exist. Note that
+ *         properties which exist but are currently unavailable are resolved
+ *         successfully.
+ */
+MPV_EXPORT mpv_property_ref *mpv_resolve_property(mpv_handle *ctx, const char *name);
+
+/**
+ * Read the value of a property resolved with mpv_resolve_property(). This is
+ * the same as mpv_get_property() with the name the handle was resolved from.
+ *
+ * @param ref The property handle.
+ * @param format see enum mpv_format.
+ * @param[out] data see mpv_get_property().
+ * @return error code; MPV_ERROR_INVALID_PARAMETER if ref is NULL or belongs to
+ *         a different core
+ */
+MPV_EXPORT int mpv_get_property_ref(mpv_handle *ctx, mpv_property_ref *ref,
+                                    mpv_format format, void *data);
+
 /**
  * Return the value of the property with the given name as string. This is
  * equivalent to mpv_get_property() with MPV_FORMAT_STRING.
@@ -1368,6 +1403,12 @@ typedef enum mpv_event_id {
      * See also mpv_event and mpv_event_hook.
      */
     MPV_EVENT_HOOK              = 25,
+    /**
+     * Sent when a screenshot queued with --screenshot-queue was written
+     * (or failed to be written). See also mpv_event and mpv_event_screenshot.
+     * Since API version 2.9.
+     */
+    MPV_EVENT_SCREENSHOT_WRITTEN = 26,
     // Internal note: adjust INTERNAL_EVENT_BASE when adding new events.
 } mpv_event_id;
 
@@ -1567,6 +1608,19 @@ typedef struct mpv_event_hook {
     uint64_t id;
 } mpv_event_hook;
 
+// Since API version 2.9.
+typedef struct mpv_event_screenshot {
+    /**
+     * Path of the screenshot file.
+     */
+    const char *filename;
+    /**
+     * 0 if the file was written successfully, or a mpv_error value (<0) if
+     * encoding or writing it failed.
+     */
+    int error;
+} mpv_event_screenshot;
+
 // Since API version 1.102.
 typedef struct mpv_event_command {
     /**
@@ -1616,6 +1670,7 @@ typedef struct mpv_event {
      *  MPV_EVENT_START_FILE:             mpv_event_start_file* (since v1.108)
      *  MPV_EVENT_END_FILE:               mpv_event_end_file*
      *  MPV_EVENT_HOOK:                   mpv_event_hook*
+     *  MPV_EVENT_SCREENSHOT_WRITTEN:     mpv_event_screenshot* (since v2.9)
      *  MPV_EVENT_COMMAND_REPLY*          mpv_event_command*
      *  other: NULL
      *
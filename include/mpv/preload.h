@@ -42,12 +42,56 @@ extern "C" {
  */
 #define MPV_PRELOAD_DEFAULT_MAX_ENTRIES 4
 
+/**
+ * Default number of preloads that are opened concurrently.
+ * Can be changed at runtime via mpv_preload_set_max_concurrent_opens().
+ */
+#define MPV_PRELOAD_DEFAULT_MAX_OPENS 2
+
+/**
+ * Default buffer levels of the active playback for throttling preloads.
+ * See mpv_preload_set_throttle().
+ */
+#define MPV_PRELOAD_DEFAULT_THROTTLE_LOW 5.0
+#define MPV_PRELOAD_DEFAULT_THROTTLE_HIGH 20.0
+
 /**
  * Preload options.
  */
 typedef struct mpv_preload_options {
     int64_t max_bytes;      /**< Demuxer cache size in bytes (0 = default 10MB) */
     double readahead_secs;  /**< Readahead seconds (0 = default 10s) */
+    /**
+     * Also create the video decoder and decode the first frame, which are
+     * handed to the player together with the demuxer. This cuts the decoder
+     * init and first keyframe decode from the time to first frame.
+     */
+    bool prewarm_decoder;
+    /**
+     * --hwdec value for the prewarmed decoder (NULL = software decoding).
+     * There is no VO at preload time, so only copy-back modes (like
+     * "auto-copy") can use hardware decoding.
+     */
+    const char *prewarm_hwdec;
+    /**
+     * Priority for the memory budget (higher = more important, default 0).
+     * See mpv_preload_set_memory_budget().
+     */
+    int priority;
+    /**
+     * If >0, only fetch the header and the first head_keyframes GOPs, instead
+     * of doing the full readahead. This is enough to open the file and show
+     * the first frames quickly, while using very little bandwidth. The entry
+     * becomes CACHED when done, and can be switched to full readahead with
+     * mpv_preload_promote() (or by handing it to the player).
+     */
+    int head_keyframes;
+    /**
+     * Keep the first bytes of the file in the on-disk cache set with
+     * mpv_preload_set_disk_cache(), so future preloads of the same URL (also
+     * after a restart) open from local storage. Ignored if no disk cache is set.
+     */
+    bool persist_head;
 } mpv_preload_options;
 
 /**
@@ -72,6 +116,18 @@ typedef struct mpv_preload_info {
     int64_t file_size;          /**< Total file size (-1 if unknown) */
     double buffered_secs;       /**< Duration buffered in seconds */
     bool eof_cached;            /**< True if entire file is cached */
+    bool first_frame_ready;     /**< Prewarmed decoder has decoded the first frame */
+    /**
+     * Timing, in seconds since mpv_preload_start(), or -1 if not reached
+     * (yet). The values are kept after the demuxer was handed to the player.
+     */
+    double time_opening;        /**< Left the queue, started opening */
+    double time_connected;      /**< Stream opened (connected, response received) */
+    double time_header;         /**< Demuxer opened (header parsed) */
+    double time_first_packet;   /**< First packet (a keyframe) cached */
+    double time_ready;          /**< Status became READY */
+    double time_cached;         /**< Status became CACHED */
+    double download_rate;       /**< Current download rate in bytes/second */
 } mpv_preload_info;
 
 /**
@@ -108,7 +164,8 @@ MPV_EXPORT int mpv_preload_cancel(const char *url);
 /**
  * Clear all preloads.
  *
- * Cancels all ongoing preloads and frees resources.
+ * Cancels all ongoing preloads and frees resources. This also stops the
+ * background thread that monitors the preloads.
  */
 MPV_EXPORT void mpv_preload_clear_all(void);
 
@@ -128,7 +185,8 @@ MPV_EXPORT int mpv_preload_recycle(const char *url, struct demuxer *demuxer);
 /**
  * Callback type for preload status events.
  *
- * Called when preload status changes (READY, CACHED, or ERROR).
+ * Called when preload status changes (READY, CACHED, or ERROR), and when
+ * the prewarmed decoder has decoded the first frame (first_frame_ready).
  * Note: This callback is invoked from a background thread.
  *
  * @param url URL that was preloaded
@@ -172,6 +230,128 @@ MPV_EXPORT int mpv_preload_get_max_entries(void);
  */
 MPV_EXPORT int mpv_preload_get_active_count(void);
 
+/**
+ * Limit the total cache size of all preload entries.
+ *
+ * The budget is handed out by priority (newer entries first on ties). Entries
+ * that get less than their max_bytes have their demuxer cache shrunk, and are
+ * evicted if almost nothing is left for them. A new entry that doesn't fit is
+ * not started. Entries handed to the player don't count against the budget
+ * until they are recycled.
+ *
+ * @param bytes Total byte budget (0 = unlimited, the default)
+ * @return 0 on success, -1 on invalid value
+ */
+MPV_EXPORT int mpv_preload_set_memory_budget(int64_t bytes);
+
+/**
+ * Get the current memory budget.
+ *
+ * @return Budget in bytes (0 = unlimited)
+ */
+MPV_EXPORT int64_t mpv_preload_get_memory_budget(void);
+
+/**
+ * Change the priority of an existing preload entry and redistribute the
+ * memory budget accordingly. Lowering the priority can evict the entry.
+ *
+ * @param url URL of the entry
+ * @param priority New priority (higher = more important)
+ * @return 0 on success, -1 if not found
+ */
+MPV_EXPORT int mpv_preload_set_priority(const char *url, int priority);
+
+/**
+ * Set an option for the network access of all preloads started afterwards,
+ * like --name=value would do for the player (e.g. "user-agent", "cookies",
+ * "tls-ca-file", "http-header-fields", "stream-lavf-o"). Use the same values
+ * as for the player, so preloaded streams behave the same as directly opened
+ * ones.
+ *
+ * Preloads keep HTTP connections alive by setting
+ * "stream-lavf-o=multiple_requests=1". Setting "stream-lavf-o" replaces that,
+ * so include it if you still want it.
+ *
+ * Invalid names or values are silently ignored when the preload starts.
+ *
+ * @param name Option name, without leading "--"
+ * @param value Option value, or NULL to remove a previously set option
+ * @return 0 on success, -1 on error
+ */
+MPV_EXPORT int mpv_preload_set_network_option(const char *name, const char *value);
+
+/**
+ * Switch a head-only preload (see mpv_preload_options.head_keyframes) to the
+ * full readahead given by max_bytes and readahead_secs. If it was CACHED, it
+ * goes back to LOADING until the new target is reached. Does nothing for
+ * entries that already do the full readahead.
+ *
+ * @param url URL of the entry
+ * @return 0 on success, -1 if not found
+ */
+MPV_EXPORT int mpv_preload_promote(const char *url);
+
+/**
+ * Set how many preloads are opened at the same time. Opening (connecting,
+ * probing, reading headers, decoder prewarm) runs on a shared pool of at most
+ * this many worker threads; further preloads wait in LOADING state until a
+ * worker is free. After opening, an entry only keeps its demuxer thread.
+ *
+ * If the player requests an entry that is still waiting for a worker, the
+ * entry is dropped and the player opens the URL itself.
+ *
+ * Changing the value doesn't wait for or interrupt the preloads already being
+ * opened. If it's lowered, the limit applies once enough of them are done.
+ *
+ * @param num Maximum concurrent opens (1-64)
+ * @return 0 on success, -1 on invalid value
+ */
+MPV_EXPORT int mpv_preload_set_max_concurrent_opens(int num);
+
+/**
+ * Get the maximum number of concurrent opens.
+ *
+ * @return Current value
+ */
+MPV_EXPORT int mpv_preload_get_max_concurrent_opens(void);
+
+/**
+ * Configure how preloads yield network bandwidth to the file being played.
+ *
+ * While the player is paused for buffering, all preloads stop reading. While
+ * it has less than low_secs buffered, only preloads with priority > 0 keep
+ * reading. All preloads resume once it has at least high_secs buffered.
+ * Paused preloads keep their state and cached data.
+ *
+ * @param low_secs Buffer level below which preloads are throttled (<= 0
+ *                 disables throttling)
+ * @param high_secs Buffer level at which all preloads resume (>= low_secs)
+ * @return 0 on success, -1 on invalid values
+ */
+MPV_EXPORT int mpv_preload_set_throttle(double low_secs, double high_secs);
+
+/**
+ * Set the directory for the persistent on-disk cache that is used by preloads
+ * with mpv_preload_options.persist_head set.
+ *
+ * The first head_bytes of each such file are stored there. If they are
+ * present, the demuxer is opened from them and the first part of the file is
+ * played without network access; the network connection is only made once the
+ * player reads beyond the cached part. The least recently used files are
+ * deleted to keep the directory below max_bytes.
+ *
+ * Only seekable network streams are cached (not local files or live streams).
+ * If the size or mime type of the stream changed when the network connection
+ * is made, reading fails and the cached part is deleted.
+ *
+ * @param dir Cache directory (created if needed), or NULL to disable
+ * @param max_bytes Maximum total size of the cache files
+ * @param head_bytes Bytes to cache per file (0 = default 2MB)
+ * @return 0 on success, -1 on invalid values
+ */
+MPV_EXPORT int mpv_preload_set_disk_cache(const char *dir, int64_t max_bytes,
+                                          int64_t head_bytes);
+
 #ifdef __cplusplus
 }
 #endif
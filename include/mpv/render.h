@@ -50,6 +50,7 @@ extern "C" {
  * ------------------
  *
  * OpenGL: via MPV_RENDER_API_TYPE_OPENGL, see render_gl.h header.
+ * Vulkan: via MPV_RENDER_API_TYPE_VULKAN, see render_vk.h header.
  * Software: via MPV_RENDER_API_TYPE_SW, see section "Software renderer"
  *
  * Threading
@@ -138,8 +139,9 @@ extern "C" {
  * MPV_RENDER_PARAM_SW_STRIDE, MPV_RENDER_PARAM_SW_POINTER.
  *
  * This method of rendering is very slow, because everything, including color
- * conversion, scaling, and OSD rendering, is done on the CPU, single-threaded.
- * In particular, large video or display sizes, as well as presence of OSD or
+ * conversion, scaling, and OSD rendering, is done on the CPU. Conversion and
+ * OSD blending are split into slices, which are processed by multiple threads
+ * (see the "sws-threads" and "zimg-threads" options). In particular, large video or display sizes, as well as presence of OSD or
  * subtitles can make it too slow for realtime. As with other software rendering
  * VOs, setting "sw-fast" may help. Enabling or disabling zimg may help,
  * depending on the platform.
@@ -188,6 +190,9 @@ typedef enum mpv_render_param_type {
      *      It is expected that an OpenGL context is valid and "current" when
      *      calling mpv_render_* functions (unless specified otherwise). It
      *      must be the same context for the same mpv_render_context.
+     *   MPV_RENDER_API_TYPE_VULKAN:
+     *      Vulkan 1.2 or later, on a VkDevice created by the API user.
+     *      Providing MPV_RENDER_PARAM_VULKAN_INIT_PARAMS is required.
      */
     MPV_RENDER_PARAM_API_TYPE = 1,
     /**
@@ -422,6 +427,44 @@ typedef enum mpv_render_param_type {
      * See MPV_RENDER_PARAM_SW_STRIDE for alignment requirements.
      */
     MPV_RENDER_PARAM_SW_POINTER = 20,
+    /**
+     * Required for initializing the Vulkan renderer.
+     * Valid for mpv_render_context_create().
+     * Type: mpv_vulkan_init_params*
+     * See render_vk.h.
+     */
+    MPV_RENDER_PARAM_VULKAN_INIT_PARAMS = 21,
+    /**
+     * Describes the Vulkan image to render to. Required for
+     * MPV_RENDER_API_TYPE_VULKAN.
+     * Valid for mpv_render_context_render().
+     * Type: mpv_vulkan_image*
+     * See render_vk.h.
+     */
+    MPV_RENDER_PARAM_VULKAN_IMAGE = 22,
+    /**
+     * Create the render context as a mirror of another render context. Valid
+     * for mpv_render_context_create().
+     *
+     * A mirror receives the same video frames as the given source context, so
+     * the video is decoded only once. It has its own render backend and API
+     * type (so you can e.g. render a large view and a small thumbnail with
+     * different GPU contexts), and it is rendered at whatever target size is
+     * passed to mpv_render_context_render(). Mirrors never block playback:
+     * the source context alone determines timing, and if a mirror has not
+     * rendered a frame by the time the next one arrives, the old one is
+     * dropped. MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME has no effect on them.
+     *
+     * The mirror must be able to render the video format chosen for the
+     * source (for hardware decoding, it needs a matching interop). Otherwise,
+     * it renders black frames. MPV_RENDER_PARAM_ADVANCED_CONTROL is ignored
+     * on mirrors.
+     *
+     * All mirrors must be freed before their source context is freed.
+     *
+     * Type: mpv_render_context*
+     */
+    MPV_RENDER_PARAM_SOURCE_CONTEXT = 23,
 } mpv_render_param_type;
 
 /**
@@ -466,6 +509,8 @@ typedef struct mpv_render_param {
  */
 // See render_gl.h
 #define MPV_RENDER_API_TYPE_OPENGL "opengl"
+// See render_vk.h
+#define MPV_RENDER_API_TYPE_VULKAN "vulkan"
 // See section "Software renderer"
 #define MPV_RENDER_API_TYPE_SW "sw"
 
@@ -549,7 +594,8 @@ typedef struct mpv_render_frame_info {
  * the mpv core is destroyed may result in memory leaks or crashes.
  *
  * Currently, only at most 1 context can exists per mpv core (it represents the
- * main video output).
+ * main video output). Additional contexts showing the same video can be created
+ * with MPV_RENDER_PARAM_SOURCE_CONTEXT.
  *
  * You should pass the following parameters:
  *  - MPV_RENDER_PARAM_API_TYPE to select the underlying backend/GPU API.
@@ -0,0 +1,182 @@
+/* Copyright (C) 2026 the mpv developers
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MPV_CLIENT_API_RENDER_VK_H_
+#define MPV_CLIENT_API_RENDER_VK_H_
+
+#include <vulkan/vulkan.h>
+
+#include "render.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Vulkan backend
+ * --------------
+ *
+ * This header contains definitions for using Vulkan with the render.h API.
+ *
+ * Unlike OpenGL, Vulkan has no implicit state. The API user creates the
+ * VkInstance and VkDevice, and passes them to mpv with
+ * MPV_RENDER_PARAM_VULKAN_INIT_PARAMS. mpv renders into a VkImage owned by the
+ * API user, so video frames never need to be copied between APIs.
+ *
+ * The device must have been created with Vulkan 1.2 or later, and with the
+ * timelineSemaphore feature enabled. mpv may use additional extensions and
+ * features if they were enabled on the device (and listed in the init
+ * params), for example for hardware decoding interop.
+ *
+ * API use
+ * -------
+ *
+ * The mpv_render_* API is used. That API supports multiple backends, and this
+ * section documents specifics for the Vulkan backend.
+ *
+ * Use mpv_render_context_create() with MPV_RENDER_PARAM_API_TYPE set to
+ * MPV_RENDER_API_TYPE_VULKAN, and MPV_RENDER_PARAM_VULKAN_INIT_PARAMS provided.
+ *
+ * Call mpv_render_context_render() with MPV_RENDER_PARAM_VULKAN_IMAGE to
+ * render the video frame to a VkImage.
+ *
+ * Synchronization
+ * ---------------
+ *
+ * mpv submits its own work to the queue family passed at init. Access to the
+ * image is synchronized with timeline semaphores: mpv waits for
+ * mpv_vulkan_image.wait_semaphore to reach wait_value before it touches the
+ * image, and signals signal_semaphore with signal_value once rendering is
+ * done, at which point the image is in final_layout. The API user must wait on
+ * this semaphore before using the image. mpv_render_context_render() does not
+ * wait for the GPU, so it returns as soon as the work is submitted.
+ *
+ * If the API user submits to the same VkQueue from other threads, it must
+ * provide lock_queue/unlock_queue, since Vulkan requires external
+ * synchronization of queue access.
+ *
+ * Hardware decoding
+ * -----------------
+ *
+ * Hardware decoding with --hwdec=vulkan works if the device was created with
+ * the video decode queue and extensions FFmpeg requires. Other interops work
+ * as they do with --vo=gpu-next if the needed external memory extensions are
+ * enabled.
+ */
+
+/**
+ * For initializing the mpv Vulkan state via
+ * MPV_RENDER_PARAM_VULKAN_INIT_PARAMS. All handles are owned by the API user,
+ * and must stay valid until the mpv_render_context is freed.
+ */
+typedef struct mpv_vulkan_init_params {
+    /**
+     * The instance the device was created from. Mandatory.
+     */
+    VkInstance instance;
+    /**
+     * Used to resolve all Vulkan functions. Mandatory.
+     */
+    PFN_vkGetInstanceProcAddr get_proc_addr;
+    /**
+     * The physical device and logical device to render with. Mandatory.
+     */
+    VkPhysicalDevice phys_device;
+    VkDevice device;
+    /**
+     * Queue family mpv submits rendering to, and the number of queues of this
+     * family the device was created with. The family must support graphics
+     * and compute operations. Mandatory.
+     */
+    uint32_t queue_family;
+    uint32_t queue_count;
+    /**
+     * Device extensions enabled on the device. Optional, but mpv will not use
+     * extensions which are not listed here.
+     */
+    const char * const *extensions;
+    int num_extensions;
+    /**
+     * Features enabled on the device, as a VkPhysicalDeviceFeatures2 chain.
+     * Optional, but mpv will not use features which are not listed here.
+     */
+    const VkPhysicalDeviceFeatures2 *features;
+    /**
+     * The apiVersion passed to vkCreateInstance(). If 0, VK_API_VERSION_1_2
+     * is assumed.
+     */
+    uint32_t max_api_version;
+    /**
+     * Optional. Called around every access of a VkQueue by mpv. Needed if the
+     * API user uses the same queues concurrently.
+     */
+    void (*lock_queue)(void *ctx, uint32_t queue_family, uint32_t index);
+    void (*unlock_queue)(void *ctx, uint32_t queue_family, uint32_t index);
+    /**
+     * Value passed as ctx parameter to lock_queue() and unlock_queue().
+     */
+    void *queue_ctx;
+} mpv_vulkan_init_params;
+
+/**
+ * For MPV_RENDER_PARAM_VULKAN_IMAGE.
+ */
+typedef struct mpv_vulkan_image {
+    /**
+     * The image to render to. It must be a 2D image with a single mip level
+     * and layer, created with VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT. Including
+     * VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT and
+     * VK_IMAGE_USAGE_SAMPLED_BIT can enable faster rendering paths.
+     */
+    VkImage image;
+    /**
+     * Image dimensions. This must always be set.
+     */
+    int w, h;
+    /**
+     * The format and usage flags the image was created with. This must always
+     * be set.
+     */
+    VkFormat format;
+    VkImageUsageFlags usage;
+    /**
+     * The layout the image is in when mpv starts using it. Set to
+     * VK_IMAGE_LAYOUT_UNDEFINED to discard the previous contents.
+     */
+    VkImageLayout layout;
+    /**
+     * The layout the image is transitioned to when rendering is done, for
+     * example VK_IMAGE_LAYOUT_PRESENT_SRC_KHR.
+     */
+    VkImageLayout final_layout;
+    /**
+     * Timeline semaphore mpv waits on before accessing the image, or
+     * VK_NULL_HANDLE for no wait.
+     */
+    VkSemaphore wait_semaphore;
+    uint64_t wait_value;
+    /**
+     * Timeline semaphore mpv signals when it is done with the image.
+     * Mandatory.
+     */
+    VkSemaphore signal_semaphore;
+    uint64_t signal_value;
+} mpv_vulkan_image;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -75,6 +75,14 @@ struct cmd_bind_section {
     bstr section;
     struct mp_rect mouse_area;  // set at runtime, if at all
     bool mouse_area_set;        // mouse_area is valid and should be tested
+    // Hash index of binds[] by the last key of each binding. index[] has
+    // 1 << (32 - index_shift) bucket heads, and index_next[] links binds in
+    // the same bucket in ascending order (-1 terminates). Rebuilt on lookup
+    // if binds[] changed.
+    int *index;
+    int *index_next;
+    int index_shift;
+    bool index_valid;
 };
 
 #define MP_MAX_SOURCES 10
@@ -83,6 +91,7 @@ struct cmd_bind_section {
 struct active_section {
     bstr name;
     int flags;
+    struct cmd_bind_section *bs; // sections are never freed
 };
 
 struct cmd_queue {
@@ -150,6 +159,8 @@ struct input_ctx {
     // List of command binding sections
     struct cmd_bind_section **sections;
     int num_sections;
+    // input.conf parsing was deferred by mp_input_load_config()
+    bool config_pending;
 
     // List currently active command sections
     struct active_section *active_sections;
@@ -185,6 +196,7 @@ static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
                         const char *location, const bstr restrict_section);
 static void close_input_sources(struct input_ctx *ictx);
 static bool test_mouse(struct input_ctx *ictx, int x, int y, int rej_flags);
+static void load_pending_config(struct input_ctx *ictx);
 
 #define OPT_BASE_STRUCT struct input_opts
 struct input_opts {
@@ -359,6 +371,7 @@ static mp_cmd_t *handle_test(struct input_ctx *ictx, int code)
     talloc_free(key_buf);
 
     int count = 0;
+    load_pending_config(ictx);
     for (int n = 0; n < ictx->num_sections; n++) {
         struct cmd_bind_section *bs = ictx->sections[n];
 
@@ -386,6 +399,7 @@ static mp_cmd_t *handle_test(struct input_ctx *ictx, int code)
 static struct cmd_bind_section *find_section(struct input_ctx *ictx,
                                              bstr section)
 {
+    load_pending_config(ictx);
     for (int n = 0; n < ictx->num_sections; n++) {
         struct cmd_bind_section *bs = ictx->sections[n];
         if (bstr_equals(section, bs->section))
@@ -419,25 +433,51 @@ static void key_buf_add(int *buf, int code)
     buf[0] = code;
 }
 
-static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
-                                                  bstr section, int code)
+static unsigned int bind_hash(int code, int shift)
 {
-    struct cmd_bind_section *bs = get_bind_section(ictx, section);
+    return ((uint32_t)code * UINT32_C(2654435761)) >> shift;
+}
+
+static void build_bind_index(struct cmd_bind_section *bs)
+{
+    int bits = mp_log2(MPMAX(bs->num_binds, 1)) + 2;
+    int num_buckets = 1 << bits;
+    bs->index = talloc_realloc(bs, bs->index, int, num_buckets + bs->num_binds);
+    bs->index_next = bs->index + num_buckets;
+    bs->index_shift = 32 - bits;
+    for (int n = 0; n < num_buckets; n++)
+        bs->index[n] = -1;
+    for (int n = bs->num_binds - 1; n >= 0; n--) {
+        struct cmd_bind *b = &bs->binds[n];
+        unsigned int h = bind_hash(b->keys[b->num_keys - 1], bs->index_shift);
+        bs->index_next[n] = bs->index[h];
+        bs->index[h] = n;
+    }
+    bs->index_valid = true;
+}
 
+static struct cmd_bind *find_bind_in_section(struct input_ctx *ictx,
+                                             struct cmd_bind_section *bs,
+                                             int code)
+{
     if (!bs->num_binds)
         return NULL;
 
+    if (!bs->index_valid)
+        build_bind_index(bs);
+
     int keys[MP_MAX_KEY_DOWN];
     memcpy(keys, ictx->key_history, sizeof(keys));
     key_buf_add(keys, code);
 
     struct cmd_bind *best = NULL;
+    int head = bs->index[bind_hash(code, bs->index_shift)];
 
     // Prefer user-defined keys over builtin bindings
     for (int builtin = 0; builtin < 2; builtin++) {
         if (builtin && !ictx->opts->default_bindings)
             break;
-        for (int n = 0; n < bs->num_binds; n++) {
+        for (int n = head; n >= 0; n = bs->index_next[n]) {
             if (bs->binds[n].is_builtin == (bool)builtin) {
                 struct cmd_bind *b = &bs->binds[n];
                 // we have: keys=[key2 key1 keyX ...]
@@ -455,12 +495,20 @@ static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
     return best;
 }
 
+static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
+                                                  bstr section, int code)
+{
+    return find_bind_in_section(ictx, get_bind_section(ictx, section), code);
+}
+
 static struct cmd_bind *find_any_bind_for_key(struct input_ctx *ictx,
                                               bstr force_section, int code)
 {
     if (force_section.len)
         return find_bind_for_key_section(ictx, force_section, code);
 
+    load_pending_config(ictx);
+
     bool use_mouse = MP_KEY_DEPENDS_ON_MOUSE_POS(code);
 
     // First look whether a mouse section is capturing all mouse input
@@ -477,7 +525,7 @@ static struct cmd_bind *find_any_bind_for_key(struct input_ctx *ictx,
     struct cmd_bind *best_bind = NULL;
     for (int i = ictx->num_active_sections - 1; i >= 0; i--) {
         struct active_section *s = &ictx->active_sections[i];
-        struct cmd_bind *bind = find_bind_for_key_section(ictx, s->name, code);
+        struct cmd_bind *bind = find_bind_in_section(ictx, s->bs, code);
         if (bind) {
             struct cmd_bind_section *bs = bind->owner;
             if (!use_mouse || (bs->mouse_area_set && test_rect(&bs->mouse_area,
@@ -1242,7 +1290,7 @@ static bool test_mouse(struct input_ctx *ictx, int x, int y, int rej_flags)
         struct active_section *as = &ictx->active_sections[i];
         if (as->flags & rej_flags)
             continue;
-        struct cmd_bind_section *s = get_bind_section(ictx, as->name);
+        struct cmd_bind_section *s = as->bs;
         if (s->mouse_area_set && test_rect(&s->mouse_area, x, y)) {
             res = true;
             break;
@@ -1407,9 +1455,9 @@ void mp_input_disable_section(struct input_ctx *ictx, char *name)
 
 void mp_input_enable_section(struct input_ctx *ictx, char *name, int flags)
 {
-    bstr bname = bstr0(name);
     input_lock(ictx);
-    bname = normalize_section(ictx, bname);
+    struct cmd_bind_section *bs = get_bind_section(ictx, bstr0(name));
+    bstr bname = bs->section;
 
     disable_section(ictx, bname);
 
@@ -1424,7 +1472,7 @@ void mp_input_enable_section(struct input_ctx *ictx, char *name, int flags)
         }
     }
     MP_TARRAY_INSERT_AT(ictx, ictx->active_sections, ictx->num_active_sections,
-                        top, (struct active_section){bname, flags});
+                        top, (struct active_section){bname, flags, bs});
 
     MP_TRACE(ictx, "active section stack:\n");
     for (int n = 0; n < ictx->num_active_sections; n++) {
@@ -1468,6 +1516,7 @@ static void remove_binds(struct cmd_bind_section *bs, bool builtin)
             mp_assert(bs->num_binds >= 1);
             bs->binds[n] = bs->binds[bs->num_binds - 1];
             bs->num_binds--;
+            bs->index_valid = false;
         }
     }
 }
@@ -1500,6 +1549,7 @@ void mp_input_define_section(struct input_ctx *ictx, char *name, char *location,
 void mp_input_remove_sections_by_owner(struct input_ctx *ictx, char *owner)
 {
     input_lock(ictx);
+    load_pending_config(ictx);
     for (int n = 0; n < ictx->num_sections; n++) {
         struct cmd_bind_section *bs = ictx->sections[n];
         if (bs->owner && owner && strcmp(bs->owner, owner) == 0) {
@@ -1543,6 +1593,7 @@ static void bind_keys(struct input_ctx *ictx, bool builtin, bstr section,
         struct cmd_bind empty = {{0}};
         MP_TARRAY_APPEND(bs, bs->binds, bs->num_binds, empty);
         bind = &bs->binds[bs->num_binds - 1];
+        bs->index_valid = false;
     }
 
     bind_dealloc(bind);
@@ -1721,11 +1772,14 @@ void mp_input_update_opts(struct input_ctx *ictx)
     input_unlock(ictx);
 }
 
-void mp_input_load_config(struct input_ctx *ictx)
+// Parse the builtin and user input.conf. Called on the first access to the
+// binding sections, so that startup doesn't wait for it.
+static void load_pending_config(struct input_ctx *ictx)
 {
-    input_lock(ictx);
-
-    reload_opts(ictx, false);
+    if (!ictx->config_pending)
+        return;
+    // Parsing adds sections, which gets back here.
+    ictx->config_pending = false;
 
     // "Uncomment" the default key bindings in etc/input.conf and add them.
     // All lines that do not start with '# ' are parsed.
@@ -1748,6 +1802,14 @@ void mp_input_load_config(struct input_ctx *ictx)
             parse_config_file(ictx, files[n]);
         talloc_free(tmp);
     }
+}
+
+void mp_input_load_config(struct input_ctx *ictx)
+{
+    input_lock(ictx);
+
+    reload_opts(ictx, false);
+    ictx->config_pending = true;
 
     bool use_gamepad = ictx->opts->use_gamepad;
     input_unlock(ictx);
@@ -1847,6 +1909,7 @@ struct mpv_node mp_input_get_bindings(struct input_ctx *ictx)
     struct mpv_node root;
     node_init(&root, MPV_FORMAT_NODE_ARRAY, NULL);
 
+    load_pending_config(ictx);
     for (int x = 0; x < ictx->num_sections; x++) {
         struct cmd_bind_section *s = ictx->sections[x];
         int priority = -1;
@@ -264,13 +264,34 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
                               int out_fd[2]);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
+// Switch the IPC client connected with sock_fd to the shared memory transport
+// (ipc-shm.c, only if HAVE_IPC_SHM), and serve it until it disconnects or the
+// player shuts down. Returns false without sending anything if the transport
+// can't be set up, in which case the socket can still be used normally.
+bool mp_ipc_shm_run(struct mpv_handle *client, int sock_fd);
+
 // Serialize the given mpv_event structure to JSON. Returns an allocated string.
 struct mpv_event;
 char *mp_json_encode_event(struct mpv_event *event);
 
-// Given the raw IPC input buffer "buf", remove the first newline-separated
-// command, execute it and return the result (if any) as an allocated string.
+// Convert the event to the node that is sent to IPC clients, which is the
+// same for all encodings. All allocations are made under ta_parent.
+struct mpv_node;
+void mp_ipc_event_to_node(void *ta_parent, struct mpv_event *event,
+                          struct mpv_node *dst);
+
+// Execute an IPC request in its decoded form, i.e. a map with "command" (or
+// "command_list") and optionally "request_id" and "async" fields. msg can be NULL if decoding
+// failed. Return true and set *reply (allocated under ta_parent) if a reply
+// must be sent.
+bool mp_ipc_execute_node(struct mpv_handle *client, void *ta_parent,
+                         struct mpv_node *msg, struct mpv_node *reply);
+
+// Execute all newline-terminated commands at the start of "buf", and advance
+// buf past them. Return the replies (if any) as an allocated string.
+// Consecutive JSON requests for regular commands are run in a single core
+// dispatch (see mp_client_command_list()).
 struct mpv_handle;
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
+char *mp_ipc_execute_commands(struct mpv_handle *client, void *ctx, bstr *buf);
 
 #endif /* MPLAYER_INPUT_H */
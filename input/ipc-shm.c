@@ -0,0 +1,397 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Shared memory transport for the IPC protocol. A client connected to the IPC
+// socket can switch to it with the "shm-connect" line. It gets a memfd with
+// two ring buffers, and two eventfds for the wakeups, passed over the socket.
+// The messages are the same as with JSON IPC, encoded with node_bin_write().
+// The layout is documented in DOCS/man/ipc.rst.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "input/input.h"
+#include "misc/bstr.h"
+#include "misc/node_bin.h"
+#include "mpv/client.h"
+#include "osdep/io.h"
+#include "player/client.h"
+
+#define SHM_MAGIC 0x6d707673 // "mpvs"
+#define SHM_VERSION 1
+#define SHM_HEADER_SIZE 4096
+#define SHM_RING_SIZE (4 << 20)
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "needs lock-free 32 bit atomics");
+
+enum {
+    SHM_TO_MPV,     // commands; written by the client
+    SHM_TO_CLIENT,  // replies and events; written by mpv
+};
+
+// Each position is a byte counter that wraps around at 2^32, and is only
+// written by one side. write_pos - read_pos is the number of used bytes.
+struct shm_ring {
+    _Atomic uint32_t write_pos;
+    _Atomic uint32_t read_pos;
+};
+
+// The client can write to all of this, so mpv never reads the fields after
+// initializing them, except for the ring positions.
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;       // offset of the first ring's data
+    uint32_t ring_size;         // data size of each ring, a power of 2
+    struct shm_ring rings[2];   // data of rings[n] at header_size + n * ring_size
+};
+
+struct shm_channel {
+    struct mp_log *log;
+    struct shm_header *hdr;
+    size_t map_size;
+    uint8_t *data[2];
+    int memfd;
+    int efd[2];     // signaled by the writer of the ring with the same index
+
+    // Encoded messages which didn't fit into the SHM_TO_CLIENT ring yet.
+    bstr *pending;
+    int num_pending;
+};
+
+static void ring_copy(struct shm_channel *ch, int ring, uint32_t pos,
+                      void *buf, size_t size, bool to_ring)
+{
+    uint32_t mask = SHM_RING_SIZE - 1;
+    uint8_t *data = ch->data[ring];
+    uint8_t *ptr = buf;
+    while (size) {
+        uint32_t offset = pos & mask;
+        size_t part = MPMIN(size, (size_t)SHM_RING_SIZE - offset);
+        if (to_ring) {
+            memcpy(data + offset, ptr, part);
+        } else {
+            memcpy(ptr, data + offset, part);
+        }
+        ptr += part;
+        pos += part;
+        size -= part;
+    }
+}
+
+// Return false if the ring doesn't have enough free space.
+static bool ring_write(struct shm_channel *ch, int ring, bstr msg)
+{
+    struct shm_ring *r = &ch->hdr->rings[ring];
+    uint32_t wpos = atomic_load_explicit(&r->write_pos, memory_order_relaxed);
+    uint32_t rpos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+    uint32_t used = wpos - rpos;
+    if (used > SHM_RING_SIZE ||
+        msg.len + sizeof(uint32_t) > SHM_RING_SIZE - used)
+        return false;
+    uint32_t len = msg.len;
+    ring_copy(ch, ring, wpos, &len, sizeof(len), true);
+    ring_copy(ch, ring, wpos + sizeof(len), msg.start, msg.len, true);
+    atomic_store_explicit(&r->write_pos, wpos + sizeof(len) + len,
+                          memory_order_release);
+    return true;
+}
+
+// Return 1 and set *msg if a message was read, 0 if the ring is empty, and -1
+// if the ring contains garbage.
+static int ring_read(struct shm_channel *ch, int ring, void *ta_parent,
+                     bstr *msg)
+{
+    struct shm_ring *r = &ch->hdr->rings[ring];
+    uint32_t wpos = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+    uint32_t rpos = atomic_load_explicit(&r->read_pos, memory_order_relaxed);
+    uint32_t used = wpos - rpos;
+    if (!used)
+        return 0;
+    uint32_t len;
+    if (used > SHM_RING_SIZE || used < sizeof(len))
+        return -1;
+    ring_copy(ch, ring, rpos, &len, sizeof(len), false);
+    if (len > used - sizeof(len))
+        return -1;
+    *msg = (bstr){talloc_size(ta_parent, len), len};
+    ring_copy(ch, ring, rpos + sizeof(len), msg->start, len, false);
+    atomic_store_explicit(&r->read_pos, rpos + sizeof(len) + len,
+                          memory_order_release);
+    return 1;
+}
+
+static void channel_destroy(void *p)
+{
+    struct shm_channel *ch = p;
+    for (int n = 0; n < ch->num_pending; n++)
+        talloc_free(ch->pending[n].start);
+    if (ch->hdr)
+        munmap(ch->hdr, ch->map_size);
+    for (int n = 0; n < 2; n++) {
+        if (ch->efd[n] >= 0)
+            close(ch->efd[n]);
+    }
+    if (ch->memfd >= 0)
+        close(ch->memfd);
+}
+
+static struct shm_channel *channel_create(struct mp_log *log)
+{
+    struct shm_channel *ch = talloc_ptrtype(NULL, ch);
+    *ch = (struct shm_channel){
+        .log = log,
+        .map_size = SHM_HEADER_SIZE + 2 * SHM_RING_SIZE,
+        .memfd = -1,
+        .efd = {-1, -1},
+    };
+    talloc_set_destructor(ch, channel_destroy);
+
+    ch->memfd = memfd_create("mpv-ipc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ch->memfd < 0 || ftruncate(ch->memfd, ch->map_size) < 0)
+        goto fail;
+    // The client must not be able to resize the memory under our feet.
+    fcntl(ch->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    for (int n = 0; n < 2; n++) {
+        ch->efd[n] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (ch->efd[n] < 0)
+            goto fail;
+    }
+
+    void *map = mmap(NULL, ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     ch->memfd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+    ch->hdr = map;
+    *ch->hdr = (struct shm_header){
+        .magic = SHM_MAGIC,
+        .version = SHM_VERSION,
+        .header_size = SHM_HEADER_SIZE,
+        .ring_size = SHM_RING_SIZE,
+    };
+    for (int n = 0; n < 2; n++)
+        ch->data[n] = (uint8_t *)map + SHM_HEADER_SIZE + n * SHM_RING_SIZE;
+    return ch;
+
+fail:
+    MP_ERR(ch, "Could not create shared memory channel (%s)\n",
+           mp_strerror(errno));
+    talloc_free(ch);
+    return NULL;
+}
+
+static void signal_efd(int fd)
+{
+    (void)write(fd, &(uint64_t){1}, sizeof(uint64_t));
+}
+
+// Send the reply to "shm-connect", with the memfd, the SHM_TO_MPV eventfd and
+// the SHM_TO_CLIENT eventfd attached in this order.
+static bool send_fds(int sock_fd, struct shm_channel *ch)
+{
+    static const char reply[] = "{\"request_id\":0,\"error\":\"success\"}\n";
+    int fds[3] = {ch->memfd, ch->efd[SHM_TO_MPV], ch->efd[SHM_TO_CLIENT]};
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control = {0};
+    struct iovec iov = {.iov_base = (void *)reply, .iov_len = sizeof(reply) - 1};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    while (1) {
+        ssize_t rc = sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+        if (rc >= 0)
+            return rc == iov.iov_len;
+        if (errno == EAGAIN) {
+            poll(&(struct pollfd){.fd = sock_fd, .events = POLLOUT}, 1, -1);
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// Queue an encoded message for the client. Messages are written in order, so
+// this only goes to the ring if nothing is pending. Return whether it was
+// written right away.
+static bool send_msg(struct shm_channel *ch, bstr msg)
+{
+    if (msg.len > SHM_RING_SIZE - sizeof(uint32_t)) {
+        MP_ERR(ch, "Dropping message of %zu bytes, which does not fit into "
+               "the ring buffer.\n", msg.len);
+        talloc_free(msg.start);
+        return false;
+    }
+    if (!ch->num_pending && ring_write(ch, SHM_TO_CLIENT, msg)) {
+        talloc_free(msg.start);
+        return true;
+    }
+    MP_TARRAY_APPEND(ch, ch->pending, ch->num_pending, msg);
+    return false;
+}
+
+static bool send_node(struct shm_channel *ch, struct mpv_node *node)
+{
+    bstr msg = {0};
+    if (node_bin_write(&msg, node) < 0) {
+        MP_ERR(ch, "Encoding error\n");
+        talloc_free(msg.start);
+        return false;
+    }
+    return send_msg(ch, msg);
+}
+
+static bool flush_pending(struct shm_channel *ch)
+{
+    int n = 0;
+    while (n < ch->num_pending && ring_write(ch, SHM_TO_CLIENT, ch->pending[n]))
+        talloc_free(ch->pending[n++].start);
+    ch->num_pending -= n;
+    memmove(ch->pending, ch->pending + n, ch->num_pending * sizeof(ch->pending[0]));
+    return n > 0;
+}
+
+// Run commands from the client until the ring is empty, or a reply has to wait
+// for space. Return 1 if there was any progress, 0 if not, -1 on error.
+static int process_commands(struct shm_channel *ch, struct mpv_handle *client)
+{
+    int progress = 0;
+    while (!ch->num_pending) {
+        void *tmp = talloc_new(NULL);
+        bstr msg;
+        int r = ring_read(ch, SHM_TO_MPV, tmp, &msg);
+        if (r <= 0) {
+            talloc_free(tmp);
+            if (r < 0)
+                MP_ERR(ch, "Corrupted command ring buffer\n");
+            return r < 0 ? -1 : progress;
+        }
+        progress = 1;
+
+        struct mpv_node msg_node;
+        bool valid = node_bin_parse(tmp, &msg_node, &msg, MAX_NODE_BIN_DEPTH) >= 0
+                     && !msg.len;
+        if (!valid)
+            MP_ERR(ch, "Malformed command received\n");
+
+        struct mpv_node reply;
+        if (mp_ipc_execute_node(client, tmp, valid ? &msg_node : NULL, &reply))
+            send_node(ch, &reply);
+        talloc_free(tmp);
+    }
+    return progress;
+}
+
+bool mp_ipc_shm_run(struct mpv_handle *client, int sock_fd)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    int pipe_fd = mpv_get_wakeup_pipe(client);
+    struct shm_channel *ch = channel_create(log);
+    if (pipe_fd < 0 || !ch || !send_fds(sock_fd, ch)) {
+        mp_err(log, "Could not set up shared memory IPC\n");
+        talloc_free(ch);
+        return false;
+    }
+    // The client has its own references now.
+    close(ch->memfd);
+    ch->memfd = -1;
+
+    MP_VERBOSE(ch, "Switched to shared memory IPC\n");
+
+    struct pollfd fds[3] = {
+        {.events = POLLIN, .fd = pipe_fd},
+        {.events = POLLIN, .fd = ch->efd[SHM_TO_MPV]},
+        {.events = POLLIN, .fd = sock_fd},
+    };
+
+    while (1) {
+        bool progress = flush_pending(ch);
+
+        int r = process_commands(ch, client);
+        if (r < 0)
+            break;
+        progress |= r;
+
+        bool shutdown = false;
+        while (!ch->num_pending) {
+            mpv_event *event = mpv_wait_event(client, 0);
+            if (event->event_id == MPV_EVENT_NONE)
+                break;
+            if (event->event_id == MPV_EVENT_SHUTDOWN) {
+                shutdown = true;
+                break;
+            }
+            void *tmp = talloc_new(NULL);
+            struct mpv_node event_node;
+            mp_ipc_event_to_node(tmp, event, &event_node);
+            progress |= send_node(ch, &event_node);
+            talloc_free(tmp);
+        }
+
+        // Wake up the client for new messages, and for space freed in the
+        // command ring.
+        if (progress)
+            signal_efd(ch->efd[SHM_TO_CLIENT]);
+        if (shutdown)
+            break;
+
+        // While messages are pending, wait for the client to make space
+        // before reading further events or commands.
+        fds[0].fd = ch->num_pending ? -1 : pipe_fd;
+        if (poll(fds, 3, -1) < 0 && errno != EINTR) {
+            MP_ERR(ch, "Poll error\n");
+            break;
+        }
+        if (fds[0].revents & POLLIN)
+            mp_flush_wakeup_pipe(pipe_fd);
+        if (fds[1].revents & POLLIN)
+            (void)read(ch->efd[SHM_TO_MPV], &(uint64_t){0}, sizeof(uint64_t));
+        if (fds[2].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+            // Data sent over the socket is ignored, it's only used to detect
+            // that the client went away.
+            char buf[128];
+            ssize_t rc = read(sock_fd, buf, sizeof(buf));
+            if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EINTR)) {
+                MP_VERBOSE(ch, "Client disconnected\n");
+                break;
+            }
+        }
+    }
+
+    talloc_free(ch);
+    return true;
+}
@@ -15,6 +15,8 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
 #include <errno.h>
 #include <unistd.h>
 #include <limits.h>
@@ -42,6 +44,9 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Maximum amount of buffered client data before commands are executed.
+#define MAX_PIPELINE_BYTES (256 * 1024)
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
@@ -90,6 +95,63 @@ static int ipc_write_str(struct client_arg *client, const char *buf)
     return 0;
 }
 
+// Handle a "shm-connect" line, with *client_msg set to the data after it.
+// Return true if the connection was served by the shared memory transport, and
+// is done.
+static bool start_shm(struct client_arg *arg, bstr *client_msg)
+{
+#if HAVE_IPC_SHM
+    if (client_msg->len)
+        MP_WARN(arg, "Ignoring data sent after shm-connect.\n");
+    if (arg->writable && mp_ipc_shm_run(arg->client, arg->client_fd)) {
+        client_msg->len = 0;
+        return true;
+    }
+#endif
+
+    if (arg->writable &&
+        ipc_write_str(arg, "{\"request_id\":0,\"error\":\"not supported\"}\n") < 0)
+        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+    return false;
+}
+
+// Execute and remove the complete commands in *client_msg, up to and including
+// a "shm-connect" line. Return 1 if there was such a line, 0 if not, and -1 on
+// write errors.
+static int execute_commands(struct client_arg *arg, bstr *client_msg)
+{
+    bstr cmds = *client_msg;
+    bstr rest = cmds;
+    bool shm = false;
+    while (bstrchr(rest, '\n') != -1) {
+        bstr next;
+        bstr line = bstr_getline(rest, &next);
+        if (bstr_equals0(bstr_strip(line), "shm-connect")) {
+            cmds.len = line.start - cmds.start;
+            rest = next;
+            shm = true;
+            break;
+        }
+        rest = next;
+    }
+
+    int rc = 0;
+    char *reply_msg = mp_ipc_execute_commands(arg->client, NULL, &cmds);
+    if (reply_msg && arg->writable) {
+        rc = ipc_write_str(arg, reply_msg);
+        if (rc < 0)
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+    }
+    talloc_free(reply_msg);
+
+    if (!shm)
+        rest = cmds;
+    memmove(client_msg->start, rest.start, rest.len);
+    client_msg->len = rest.len;
+
+    return rc < 0 ? -1 : shm;
+}
+
 static MP_THREAD_VOID client_thread(void *p)
 {
     // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
@@ -161,44 +223,46 @@ static MP_THREAD_VOID client_thread(void *p)
         }
 
         if (fds[1].revents & (POLLIN | POLLHUP | POLLNVAL)) {
-            while (1) {
-                char buf[128];
+            bool more = true, eof = false;
+            while (more) {
+                char buf[4096];
                 bstr append = { buf, 0 };
 
                 ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
                 if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
+                    if (errno != EAGAIN) {
+                        MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+                        goto done;
+                    }
+                    bytes = 0;
+                    more = false;
+                } else if (bytes == 0) {
+                    eof = true;
+                    more = false;
                 }
 
                 append.len = bytes;
 
                 bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+                // Read all data that is available (up to a limit) before
+                // executing, so pipelined commands can be run together.
+                if (more && client_msg.len < MAX_PIPELINE_BYTES)
+                    continue;
 
-                    talloc_free(reply_msg);
+                while (bstrchr(client_msg, '\n') != -1) {
+                    rc = execute_commands(arg, &client_msg);
+                    if (rc < 0)
+                        goto done;
+                    if (rc > 0 && start_shm(arg, &client_msg))
+                        goto done;
                 }
             }
+
+            if (eof) {
+                MP_VERBOSE(arg, "Client disconnected\n");
+                goto done;
+            }
         }
     }
 
@@ -269,13 +269,13 @@ static MP_THREAD_VOID client_thread(void *p)
             }
 
             bstr_xappend(NULL, &client_msg, (bstr){buf, r});
-            while (bstrchr(client_msg, '\n') != -1) {
-                char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                    NULL, &client_msg);
-                if (reply_msg && arg->writable)
-                    ipc_write_str(arg, reply_msg);
-                talloc_free(reply_msg);
-            }
+            bstr rest = client_msg;
+            char *reply_msg = mp_ipc_execute_commands(arg->client, NULL, &rest);
+            if (reply_msg && arg->writable)
+                ipc_write_str(arg, reply_msg);
+            talloc_free(reply_msg);
+            memmove(client_msg.start, rest.start, rest.len);
+            client_msg.len = rest.len;
 
             // Begin the next read operation on the pipe
             if ((ioerr = async_read(arg->client_h, buf, 4096, &ol))) {
@@ -89,19 +89,24 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+void mp_ipc_event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
 {
-    void *ta_parent = talloc_new(NULL);
-
-    struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
-        event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        *dst = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_format_command_reply(ta_parent, event, dst);
     } else {
-        mpv_event_to_node(&event_node, event);
+        mpv_event_to_node(dst, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(ta_parent, node_get_alloc(dst));
     }
+}
+
+char *mp_json_encode_event(mpv_event *event)
+{
+    void *ta_parent = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    mp_ipc_event_to_node(ta_parent, event, &event_node);
 
     char *output = talloc_strdup(NULL, "");
     json_write(&output, &event_node);
@@ -112,15 +117,106 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Commands handled by mp_ipc_execute_node() itself.
+static const char *const ipc_commands[] = {
+    "client_name", "get_time_us", "get_version", "get_property",
+    "get_property_string", "set_property", "set_property_string",
+    "observe_property", "observe_property_string", "unobserve_property",
+    "request_log_messages", "enable_event", "disable_event", NULL
+};
+
+// Return the "command" entry of msg if it's a regular synchronous command,
+// whose reply mp_ipc_execute_node() would send without any other effects.
+static mpv_node *get_batch_command(mpv_node *msg)
+{
+    if (msg->format != MPV_FORMAT_NODE_MAP)
+        return NULL;
+
+    mpv_node *async_node = node_map_get(msg, "async");
+    if (async_node && (async_node->format != MPV_FORMAT_FLAG || async_node->u.flag))
+        return NULL;
+
+    mpv_node *reqid_node = node_map_get(msg, "request_id");
+    if (reqid_node && reqid_node->format != MPV_FORMAT_INT64)
+        return NULL;
+
+    mpv_node *cmd_node = node_map_get(msg, "command");
+    if (!cmd_node || node_map_get(msg, "command_list"))
+        return NULL;
+
+    if (cmd_node->format == MPV_FORMAT_NODE_ARRAY) {
+        mpv_node *cmd_str_node = mpv_node_array_get(cmd_node, 0);
+        if (!cmd_str_node || cmd_str_node->format != MPV_FORMAT_STRING)
+            return NULL;
+        for (int n = 0; ipc_commands[n]; n++) {
+            if (!strcmp(ipc_commands[n], cmd_str_node->u.string))
+                return NULL;
+        }
+    } else if (cmd_node->format != MPV_FORMAT_NODE_MAP) {
+        return NULL;
+    }
+
+    return cmd_node;
+}
+
+static void add_reply_status(void *ta_parent, mpv_node *reply,
+                             mpv_node *reqid_node, int rc)
+{
+    /* If the request contains a "request_id", copy it back into the response.
+     * This makes it easier on the requester to match up the IPC results with
+     * the original requests.
+     */
+    if (reqid_node) {
+        mpv_node_map_add(ta_parent, reply, "request_id", reqid_node);
+    } else {
+        mpv_node_map_add_int64(ta_parent, reply, "request_id", 0);
+    }
+
+    mpv_node_map_add_string(ta_parent, reply, "error", mpv_error_string(rc));
+}
+
+// Run the commands of a "command_list" request, and set the reply's "data" to
+// the list of their results.
+static int execute_command_list(struct mpv_handle *client, void *ta_parent,
+                                mpv_node *list_node, mpv_node *reply)
+{
+    if (list_node->format != MPV_FORMAT_NODE_ARRAY)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    int num = list_node->u.list->num;
+    mpv_node *results = talloc_array(NULL, mpv_node, num);
+    int *errors = talloc_array(results, int, num);
+    mp_client_command_list(client, num, list_node->u.list->values, results,
+                           errors);
+
+    mpv_node data = {
+        .format = MPV_FORMAT_NODE_ARRAY,
+        .u.list = talloc_zero(ta_parent, mpv_node_list),
+    };
+    for (int n = 0; n < num; n++) {
+        mpv_node entry = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_node_map_add_string(ta_parent, &entry, "error",
+                                mpv_error_string(errors[n]));
+        if (errors[n] >= 0)
+            mpv_node_map_add(ta_parent, &entry, "data", &results[n]);
+        MP_TARRAY_APPEND(ta_parent, data.u.list->values, data.u.list->num,
+                         entry);
+        mpv_free_node_contents(&results[n]);
+    }
+    mpv_node_map_add(ta_parent, reply, "data", &data);
+
+    talloc_free(results);
+    return MPV_ERROR_SUCCESS;
+}
+
+bool mp_ipc_execute_node(struct mpv_handle *client, void *ta_parent,
+                         mpv_node *msg, mpv_node *reply)
 {
     int rc;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
+    mpv_node msg_node = msg ? *msg : (mpv_node){0};
     mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
@@ -128,9 +224,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
+    if (!msg) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
@@ -163,6 +257,16 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         }
     }
 
+    mpv_node *list_node = node_map_get(&msg_node, "command_list");
+    if (list_node) {
+        if (async || node_map_get(&msg_node, "command")) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        } else {
+            rc = execute_command_list(client, ta_parent, list_node, &reply_node);
+        }
+        goto error;
+    }
+
     mpv_node *cmd_node = node_map_get(&msg_node, "command");
     if (!cmd_node) {
         rc = MPV_ERROR_INVALID_PARAMETER;
@@ -360,26 +464,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
     }
 
 error:
-    /* If the request contains a "request_id", copy it back into the response.
-     * This makes it easier on the requester to match up the IPC results with
-     * the original requests.
-     */
-    if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
-    } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
-    }
-
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    add_reply_status(ta_parent, &reply_node, reqid_node, rc);
 
-    char *output = talloc_strdup(ta_parent, "");
-
-    if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
-    }
-
-    return output;
+    *reply = reply_node;
+    return send_reply;
 }
 
 static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
@@ -389,28 +477,92 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
     return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+static void append_reply(char **output, mpv_node *reply)
 {
-    void *tmp = talloc_new(NULL);
+    json_write(output, reply);
+    *output = ta_talloc_strdup_append(*output, "\n");
+}
 
-    bstr rest;
-    bstr line = bstr_getline(*buf, &rest);
-    char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
-    *buf = bstrdup(NULL, rest);
+// Run the batched requests with mp_client_command_list(), and append the
+// replies to *output.
+static void flush_batch(struct mpv_handle *client, void *ta_parent,
+                        char **output, mpv_node **msgs, mpv_node *cmds, int num)
+{
+    if (!num)
+        return;
 
-    json_skip_whitespace(&line0);
+    mpv_node *results = talloc_array(NULL, mpv_node, num);
+    int *errors = talloc_array(results, int, num);
+    mp_client_command_list(client, num, cmds, results, errors);
+
+    for (int n = 0; n < num; n++) {
+        mpv_node reply = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        if (errors[n] >= 0)
+            mpv_node_map_add(ta_parent, &reply, "data", &results[n]);
+        add_reply_status(ta_parent, &reply,
+                         node_map_get(msgs[n], "request_id"), errors[n]);
+        append_reply(output, &reply);
+        mpv_free_node_contents(&results[n]);
+    }
+    talloc_free(results);
+}
 
-    char *reply_msg = NULL;
-    if (line0[0] == '\0' || line0[0] == '#') {
-        // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
-    } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+char *mp_ipc_execute_commands(struct mpv_handle *client, void *ctx, bstr *buf)
+{
+    struct mp_log *log = mp_client_get_log(client);
+    // The parsed requests and replies are only needed until the replies are
+    // written. The output string is kept out of the arena, because it's
+    // grown by repeated reallocation.
+    void *tmp = talloc_new_arena(NULL);
+    char *output = talloc_strdup(NULL, "");
+
+    // Consecutive requests that can be run with mp_client_command_list().
+    mpv_node **batch_msgs = NULL;
+    mpv_node *batch_cmds = NULL;
+    int num_batch = 0;
+
+    while (bstrchr(*buf, '\n') != -1) {
+        char *line0 = bstrto0(tmp, bstr_getline(*buf, buf));
+
+        json_skip_whitespace(&line0);
+
+        if (line0[0] == '\0' || line0[0] == '#')
+            continue;
+
+        bool is_json = line0[0] == '{';
+        mpv_node *msg = NULL;
+        if (is_json) {
+            msg = talloc_ptrtype(tmp, msg);
+            if (json_parse(tmp, msg, &line0, MAX_JSON_DEPTH) < 0) {
+                mp_err(log, "malformed JSON received: '%s'\n", line0);
+                msg = NULL;
+            } else {
+                mpv_node *cmd = get_batch_command(msg);
+                if (cmd) {
+                    MP_TARRAY_APPEND(tmp, batch_msgs, num_batch, msg);
+                    num_batch--;
+                    MP_TARRAY_APPEND(tmp, batch_cmds, num_batch, *cmd);
+                    continue;
+                }
+            }
+        }
+
+        flush_batch(client, tmp, &output, batch_msgs, batch_cmds, num_batch);
+        num_batch = 0;
+
+        if (is_json) {
+            mpv_node reply;
+            if (mp_ipc_execute_node(client, tmp, msg, &reply))
+                append_reply(&output, &reply);
+        } else {
+            text_execute_command(client, tmp, line0);
+        }
     }
 
-    talloc_steal(ctx, reply_msg);
+    flush_batch(client, tmp, &output, batch_msgs, batch_cmds, num_batch);
+
+    char *res = output[0] ? talloc_strdup(ctx, output) : NULL;
+    talloc_free(output);
     talloc_free(tmp);
-    return reply_msg;
+    return res;
 }
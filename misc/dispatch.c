@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -24,8 +25,22 @@
 
 #include "dispatch.h"
 
-struct mp_dispatch_queue {
+enum {
+    LANE_URGENT,
+    LANE_NORMAL,
+    NUM_LANES,
+};
+
+struct dispatch_lane {
     struct mp_dispatch_item *head, *tail;
+};
+
+struct mp_dispatch_queue {
+    // Items are taken from the first non-empty lane.
+    struct dispatch_lane lanes[NUM_LANES];
+    // Asynchronous normal items enqueued without taking the lock, in reverse
+    // order. Moved to LANE_NORMAL by whoever holds the lock next.
+    _Atomic(struct mp_dispatch_item *) incoming;
     mp_mutex lock;
     mp_cond cond;
     void (*wakeup_fn)(void *wakeup_ctx);
@@ -36,6 +51,9 @@ struct mp_dispatch_queue {
     int64_t wait;
     // Make mp_dispatch_queue_process() exit if it's idle.
     bool interrupted;
+    // wakeup_fn was called, and the target thread has not entered
+    // mp_dispatch_queue_process() since. Further items need no new wakeup.
+    bool wakeup_pending;
     // The target thread is in mp_dispatch_queue_process() (and either idling,
     // locked, or running a dispatch callback).
     bool in_process;
@@ -63,7 +81,9 @@ struct mp_dispatch_item {
 static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
-    mp_assert(!queue->head);
+    for (int n = 0; n < NUM_LANES; n++)
+        mp_assert(!queue->lanes[n].head);
+    mp_assert(!atomic_load(&queue->incoming));
     mp_assert(!queue->in_process);
     mp_assert(!queue->lock_requests);
     mp_assert(!queue->locked);
@@ -123,39 +143,107 @@ void mp_dispatch_set_onlock_fn(struct mp_dispatch_queue *queue,
     queue->onlock_ctx = onlock_ctx;
 }
 
+static void lane_append(struct dispatch_lane *lane,
+                        struct mp_dispatch_item *item)
+{
+    if (lane->tail) {
+        lane->tail->next = item;
+    } else {
+        lane->head = item;
+    }
+    lane->tail = item;
+}
+
+// Move items from the lock-free list to the normal lane. Must be called with
+// the lock held.
+static void drain_incoming(struct mp_dispatch_queue *queue)
+{
+    struct mp_dispatch_item *list = atomic_exchange(&queue->incoming, NULL);
+    struct mp_dispatch_item *rev = NULL;
+    while (list) {
+        struct mp_dispatch_item *next = list->next;
+        list->next = rev;
+        rev = list;
+        list = next;
+    }
+    while (rev) {
+        struct mp_dispatch_item *next = rev->next;
+        rev->next = NULL;
+        lane_append(&queue->lanes[LANE_NORMAL], rev);
+        rev = next;
+    }
+}
+
+// Make sure the target thread picks up the new item(s). Must be called with
+// the lock held; returns whether the caller has to call wakeup_fn after
+// releasing it.
+static bool signal_target(struct mp_dispatch_queue *queue)
+{
+    // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
+    // interrupted instead.
+    if (!queue->wakeup_fn)
+        queue->interrupted = true;
+    // If the target is in mp_dispatch_queue_process(), it runs all items
+    // before returning, and at most needs to be woken up from waiting on the
+    // condition. (Other threads wait on it only for other reasons.)
+    if (queue->in_process) {
+        mp_cond_broadcast(&queue->cond);
+        return false;
+    }
+    if (!queue->wakeup_fn || queue->wakeup_pending)
+        return false;
+    queue->wakeup_pending = true;
+    return true;
+}
+
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
-                               struct mp_dispatch_item *item)
+                               struct mp_dispatch_item *item, int lane)
 {
     mp_mutex_lock(&queue->lock);
+    drain_incoming(queue);
     if (item->mergeable) {
-        for (struct mp_dispatch_item *cur = queue->head; cur; cur = cur->next) {
-            if (cur->mergeable && cur->fn == item->fn &&
-                cur->fn_data == item->fn_data)
+        for (int n = 0; n < NUM_LANES; n++) {
+            for (struct mp_dispatch_item *cur = queue->lanes[n].head; cur;
+                 cur = cur->next)
             {
-                talloc_free(item);
-                mp_mutex_unlock(&queue->lock);
-                return;
+                if (cur->mergeable && cur->fn == item->fn &&
+                    cur->fn_data == item->fn_data)
+                {
+                    talloc_free(item);
+                    mp_mutex_unlock(&queue->lock);
+                    return;
+                }
             }
         }
     }
 
-    if (queue->tail) {
-        queue->tail->next = item;
-    } else {
-        queue->head = item;
-    }
-    queue->tail = item;
+    lane_append(&queue->lanes[lane], item);
 
-    // Wake up the main thread; note that other threads might wait on this
-    // condition for reasons, so broadcast the condition.
-    mp_cond_broadcast(&queue->cond);
-    // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
-    // interrupted instead.
-    if (!queue->wakeup_fn)
-        queue->interrupted = true;
+    bool wakeup = signal_target(queue);
+    mp_mutex_unlock(&queue->lock);
+
+    if (wakeup)
+        queue->wakeup_fn(queue->wakeup_ctx);
+}
+
+// Append an asynchronous item to the normal lane. Only the sender which finds
+// the lock-free list empty needs to take the lock and wake up the target;
+// everyone else piggybacks on that.
+static void mp_dispatch_append_async(struct mp_dispatch_queue *queue,
+                                     struct mp_dispatch_item *item)
+{
+    struct mp_dispatch_item *prev = atomic_load(&queue->incoming);
+    do {
+        item->next = prev;
+    } while (!atomic_compare_exchange_weak(&queue->incoming, &prev, item));
+    if (prev)
+        return;
+
+    mp_mutex_lock(&queue->lock);
+    bool wakeup = signal_target(queue);
     mp_mutex_unlock(&queue->lock);
 
-    if (queue->wakeup_fn)
+    if (wakeup)
         queue->wakeup_fn(queue->wakeup_ctx);
 }
 
@@ -174,7 +262,7 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
         .fn_data = fn_data,
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_append_async(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but the queue code will call talloc_free(fn_data)
@@ -190,7 +278,7 @@ void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
         .fn_data = talloc_steal(item, fn_data),
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_append_async(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but
@@ -204,13 +292,30 @@ void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
         .mergeable = true,
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_append(queue, item, LANE_NORMAL);
+}
+
+// Like mp_dispatch_enqueue(), but the item is run before all items enqueued
+// with the other functions (except earlier "urgent" items). Meant for work
+// that something time critical is waiting on, such as the VO thread rendering
+// the next frame, so it doesn't get stuck behind a burst of client requests.
+void mp_dispatch_enqueue_urgent(struct mp_dispatch_queue *queue,
+                                mp_dispatch_fn fn, void *fn_data)
+{
+    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
+    *item = (struct mp_dispatch_item){
+        .fn = fn,
+        .fn_data = fn_data,
+        .asynchronous = true,
+    };
+    mp_dispatch_append(queue, item, LANE_URGENT);
 }
 
 // Remove already queued item. Only items enqueued with the following functions
 // can be canceled:
 //  - mp_dispatch_enqueue()
 //  - mp_dispatch_enqueue_notify()
+//  - mp_dispatch_enqueue_urgent()
 // Items which were enqueued, and which are currently executing, can not be
 // canceled anymore. This function is mostly for being called from the same
 // context as mp_dispatch_queue_process(), where the "currently executing" case
@@ -219,33 +324,33 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data)
 {
     mp_mutex_lock(&queue->lock);
-    struct mp_dispatch_item **pcur = &queue->head;
-    queue->tail = NULL;
-    while (*pcur) {
-        struct mp_dispatch_item *cur = *pcur;
-        if (cur->fn == fn && cur->fn_data == fn_data) {
-            *pcur = cur->next;
-            talloc_free(cur);
-        } else {
-            queue->tail = cur;
-            pcur = &cur->next;
+    drain_incoming(queue);
+    for (int n = 0; n < NUM_LANES; n++) {
+        struct dispatch_lane *lane = &queue->lanes[n];
+        struct mp_dispatch_item **pcur = &lane->head;
+        lane->tail = NULL;
+        while (*pcur) {
+            struct mp_dispatch_item *cur = *pcur;
+            if (cur->fn == fn && cur->fn_data == fn_data) {
+                *pcur = cur->next;
+                talloc_free(cur);
+            } else {
+                lane->tail = cur;
+                pcur = &cur->next;
+            }
         }
     }
     mp_mutex_unlock(&queue->lock);
 }
 
-// Run fn(fn_data) on the target thread synchronously. This function enqueues
-// the callback and waits until the target thread is done doing this.
-// This is redundant to calling the function inside mp_dispatch_[un]lock(),
-// but can be helpful with code that relies on TLS (such as OpenGL).
-void mp_dispatch_run(struct mp_dispatch_queue *queue,
-                     mp_dispatch_fn fn, void *fn_data)
+static void dispatch_run(struct mp_dispatch_queue *queue,
+                         mp_dispatch_fn fn, void *fn_data, int lane)
 {
     struct mp_dispatch_item item = {
         .fn = fn,
         .fn_data = fn_data,
     };
-    mp_dispatch_append(queue, &item);
+    mp_dispatch_append(queue, &item, lane);
 
     mp_mutex_lock(&queue->lock);
     while (!item.completed)
@@ -253,6 +358,23 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
     mp_mutex_unlock(&queue->lock);
 }
 
+// Run fn(fn_data) on the target thread synchronously. This function enqueues
+// the callback and waits until the target thread is done doing this.
+// This is redundant to calling the function inside mp_dispatch_[un]lock(),
+// but can be helpful with code that relies on TLS (such as OpenGL).
+void mp_dispatch_run(struct mp_dispatch_queue *queue,
+                     mp_dispatch_fn fn, void *fn_data)
+{
+    dispatch_run(queue, fn, fn_data, LANE_NORMAL);
+}
+
+// Like mp_dispatch_run(), but use the lane of mp_dispatch_enqueue_urgent().
+void mp_dispatch_run_urgent(struct mp_dispatch_queue *queue,
+                            mp_dispatch_fn fn, void *fn_data)
+{
+    dispatch_run(queue, fn, fn_data, LANE_URGENT);
+}
+
 // Process any outstanding dispatch items in the queue. This also handles
 // suspending or locking the this thread from another thread via
 // mp_dispatch_lock().
@@ -276,18 +398,23 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     mp_assert(!queue->in_process); // recursion not allowed
     queue->in_process = true;
     queue->in_process_thread_id = mp_thread_current_id();
+    queue->wakeup_pending = false;
     // Wake up thread which called mp_dispatch_lock().
     if (queue->lock_requests)
         mp_cond_broadcast(&queue->cond);
     while (1) {
+        drain_incoming(queue);
+        struct dispatch_lane *lane = NULL;
+        for (int n = 0; n < NUM_LANES && !lane; n++)
+            lane = queue->lanes[n].head ? &queue->lanes[n] : NULL;
         if (queue->lock_requests) {
             // Block due to something having called mp_dispatch_lock().
             mp_cond_wait(&queue->cond, &queue->lock);
-        } else if (queue->head) {
-            struct mp_dispatch_item *item = queue->head;
-            queue->head = item->next;
-            if (!queue->head)
-                queue->tail = NULL;
+        } else if (lane) {
+            struct mp_dispatch_item *item = lane->head;
+            lane->head = item->next;
+            if (!lane->head)
+                lane->tail = NULL;
             item->next = NULL;
             // Unlock, because we want to allow other threads to queue items
             // while the dispatch item is processed.
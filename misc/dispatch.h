@@ -19,10 +19,14 @@ void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
                                   mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
                                 mp_dispatch_fn fn, void *fn_data);
+void mp_dispatch_enqueue_urgent(struct mp_dispatch_queue *queue,
+                                mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_run(struct mp_dispatch_queue *queue,
                      mp_dispatch_fn fn, void *fn_data);
+void mp_dispatch_run_urgent(struct mp_dispatch_queue *queue,
+                            mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout);
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue);
 void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until);
@@ -105,13 +105,16 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        // libc's strcspn() is usually vectorized, and strings are mostly long
+        // runs without escapes.
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -132,6 +135,34 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
+// Fast path for plain decimal integers, which are by far the most common kind
+// of numbers. Anything else (floats, hex/octal, overflows) is left to the
+// strtoll()/strtod() path, which defines the actual semantics.
+static int read_int(struct mpv_node *dst, char **src)
+{
+    char *cur = *src;
+    bool neg = eat_c(&cur, '-');
+    if (cur[0] < '1' || cur[0] > '9') {
+        // "0" alone is fine, but "0x", "01" etc. are not plain decimals
+        if (cur[0] != '0' || mp_isalnum(cur[1]) || cur[1] == '.')
+            return -1;
+    }
+    uint64_t val = 0;
+    int digits = 0;
+    while (cur[0] >= '0' && cur[0] <= '9') {
+        if (++digits > 18)
+            return -1; // might overflow
+        val = val * 10 + (cur[0] - '0');
+        cur++;
+    }
+    if (cur[0] == '.' || cur[0] == 'e' || cur[0] == 'E')
+        return -1; // float
+    *src = cur;
+    dst->format = MPV_FORMAT_INT64;
+    dst->u.int64 = neg ? -(int64_t)val : (int64_t)val;
+    return 0;
+}
+
 static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
                     int max_depth)
 {
@@ -216,6 +247,8 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
     } else if (c == '[' || c == '{') {
         return read_sub(ta_parent, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
+        if (read_int(dst, src) >= 0)
+            return 0;
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
         char *nsrci = *src, *nsrcf = *src;
@@ -260,8 +293,9 @@ static void write_json_str(bstr *b, unsigned char *str)
     mp_assert(str);
 
     APPEND(b, "\"");
+    unsigned char *cur;
     while (1) {
-        unsigned char *cur = str;
+        cur = str;
         while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
             cur++;
         if (!cur[0])
@@ -272,13 +306,17 @@ static void write_json_str(bstr *b, unsigned char *str)
         } else if (cur[0] == '\\') {
             bstr_xappend(NULL, b, (bstr){"\\\\", 2});
         } else if (cur[0] < sizeof(special_escape) && special_escape[cur[0]]) {
-            bstr_xappend_asprintf(NULL, b, "\\%c", special_escape[cur[0]]);
+            char esc[2] = {'\\', special_escape[cur[0]]};
+            bstr_xappend(NULL, b, (bstr){esc, 2});
         } else {
-            bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+            static const char hex[] = "0123456789abcdef";
+            char esc[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4], hex[cur[0] & 15]};
+            bstr_xappend(NULL, b, (bstr){esc, 6});
         }
         str = cur + 1;
     }
-    APPEND(b, str);
+    // cur is at the terminating \0, no need for strlen()
+    bstr_xappend(NULL, b, (bstr){str, cur - str});
     APPEND(b, "\"");
 }
 
@@ -300,9 +338,20 @@ int json_append(bstr *b, const struct mpv_node *src, int indent)
     case MPV_FORMAT_FLAG:
         APPEND(b, src->u.flag ? "true" : "false");
         return 0;
-    case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+    case MPV_FORMAT_INT64: {
+        // Avoid the printf overhead for the most common kind of number.
+        char buf[24];
+        char *end = buf + sizeof(buf), *cur = end;
+        uint64_t v = src->u.int64 < 0 ? -(uint64_t)src->u.int64 : src->u.int64;
+        do {
+            *--cur = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        if (src->u.int64 < 0)
+            *--cur = '-';
+        bstr_xappend(NULL, b, (bstr){cur, end - cur});
         return 0;
+    }
     case MPV_FORMAT_DOUBLE: {
         const char *px = (isfinite(src->u.double_) || indent == 0) ? "" : "\"";
         bstr_xappend_asprintf(NULL, b, "%s%f%s", px, src->u.double_, px);
@@ -0,0 +1,195 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Binary mpv_node encoding:
+ *
+ * Meant for exchanging nodes with other processes on the same machine (the
+ * shared memory IPC transport), so all values use the native byte order and
+ * representation. Each node is a 1 byte mpv_format value, followed by:
+ *
+ *  MPV_FORMAT_NONE:        nothing
+ *  MPV_FORMAT_FLAG:        1 byte, 0 or 1
+ *  MPV_FORMAT_INT64:       int64_t
+ *  MPV_FORMAT_DOUBLE:      double
+ *  MPV_FORMAT_STRING:      uint32_t length, then the bytes (no terminating 0)
+ *  MPV_FORMAT_BYTE_ARRAY:  like MPV_FORMAT_STRING
+ *  MPV_FORMAT_NODE_ARRAY:  uint32_t count, then count nodes
+ *  MPV_FORMAT_NODE_MAP:    uint32_t count, then count pairs of a key (a string
+ *                          without the format byte) and a node
+ *
+ * Strings must not contain 0 bytes.
+ */
+
+#include <string.h>
+
+#include <mpv/client.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+
+#include "node_bin.h"
+
+static bool read_bytes(bstr *src, void *dst, size_t size)
+{
+    if (src->len < size)
+        return false;
+    memcpy(dst, src->start, size);
+    *src = bstr_cut(*src, size);
+    return true;
+}
+
+static char *read_str(void *ta_parent, bstr *src)
+{
+    uint32_t len;
+    if (!read_bytes(src, &len, sizeof(len)) || src->len < len)
+        return NULL;
+    bstr str = bstr_splice(*src, 0, len);
+    if (memchr(str.start, '\0', str.len))
+        return NULL;
+    *src = bstr_cut(*src, len);
+    return bstrdup0(ta_parent, str);
+}
+
+/* Parse a node from the start of *src, and write the result into *dst.
+ * max_depth limits the recursion and tree depth.
+ * Returns:
+ *   0: success, *dst is valid, *src is advanced past the node
+ *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
+ *      (like json_parse())
+ * All allocations are made under ta_parent, and nothing points into *src.
+ */
+int node_bin_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                   int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    uint8_t format;
+    if (!read_bytes(src, &format, 1))
+        return -1;
+
+    *dst = (struct mpv_node){ .format = format };
+    switch (format) {
+    case MPV_FORMAT_NONE:
+        return 0;
+    case MPV_FORMAT_FLAG: {
+        uint8_t flag;
+        if (!read_bytes(src, &flag, 1) || flag > 1)
+            return -1;
+        dst->u.flag = flag;
+        return 0;
+    }
+    case MPV_FORMAT_INT64:
+        return read_bytes(src, &dst->u.int64, sizeof(dst->u.int64)) ? 0 : -1;
+    case MPV_FORMAT_DOUBLE:
+        return read_bytes(src, &dst->u.double_, sizeof(dst->u.double_)) ? 0 : -1;
+    case MPV_FORMAT_STRING:
+        dst->u.string = read_str(ta_parent, src);
+        return dst->u.string ? 0 : -1;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        uint32_t len;
+        if (!read_bytes(src, &len, sizeof(len)) || src->len < len)
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, src->start, len);
+        ba->size = len;
+        *src = bstr_cut(*src, len);
+        dst->u.ba = ba;
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        bool is_obj = format == MPV_FORMAT_NODE_MAP;
+        uint32_t num;
+        if (!read_bytes(src, &num, sizeof(num)))
+            return -1;
+        // Every entry takes at least 1 byte; don't trust num for allocations.
+        if (num > src->len)
+            return -1;
+        struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+        list->values = talloc_array(list, struct mpv_node, num);
+        if (is_obj)
+            list->keys = talloc_array(list, char *, num);
+        for (uint32_t n = 0; n < num; n++) {
+            if (is_obj && !(list->keys[n] = read_str(list, src)))
+                return -1;
+            if (node_bin_parse(ta_parent, &list->values[n], src, max_depth) < 0)
+                return -1;
+            list->num++;
+        }
+        dst->u.list = list;
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+static void write_bytes(bstr *b, const void *data, size_t size)
+{
+    bstr_xappend(NULL, b, (bstr){(unsigned char *)data, size});
+}
+
+static int write_str(bstr *b, const void *data, size_t size)
+{
+    if (size > UINT32_MAX)
+        return -1;
+    uint32_t len = size;
+    write_bytes(b, &len, sizeof(len));
+    write_bytes(b, data, size);
+    return 0;
+}
+
+// Append the binary encoding of src to *b. Returns -1 if src contains nodes
+// that can't be encoded (in which case *b contains partial data).
+int node_bin_write(bstr *b, const struct mpv_node *src)
+{
+    uint8_t format = src->format;
+    write_bytes(b, &format, 1);
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        return 0;
+    case MPV_FORMAT_FLAG:
+        write_bytes(b, &(uint8_t){!!src->u.flag}, 1);
+        return 0;
+    case MPV_FORMAT_INT64:
+        write_bytes(b, &src->u.int64, sizeof(src->u.int64));
+        return 0;
+    case MPV_FORMAT_DOUBLE:
+        write_bytes(b, &src->u.double_, sizeof(src->u.double_));
+        return 0;
+    case MPV_FORMAT_STRING:
+        return write_str(b, src->u.string, strlen(src->u.string));
+    case MPV_FORMAT_BYTE_ARRAY:
+        return write_str(b, src->u.ba->data, src->u.ba->size);
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        uint32_t num = list ? list->num : 0;
+        write_bytes(b, &num, sizeof(num));
+        for (uint32_t n = 0; n < num; n++) {
+            if (src->format == MPV_FORMAT_NODE_MAP &&
+                write_str(b, list->keys[n], strlen(list->keys[n])) < 0)
+                return -1;
+            if (node_bin_write(b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1;
+}
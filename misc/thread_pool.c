@@ -13,6 +13,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdatomic.h>
+
+#include <libavutil/cpu.h>
+
 #include "common/common.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
@@ -59,6 +63,10 @@ static MP_THREAD_VOID worker_thread(void *arg)
     int64_t destroy_deadline = 0;
     bool got_timeout = false;
     while (1) {
+        // Too many threads after mp_thread_pool_set_max_threads().
+        if (!pool->terminate && pool->num_threads > pool->max_threads)
+            break;
+
         struct work work = {0};
         if (pool->num_work > 0) {
             work = pool->work[pool->num_work - 1];
@@ -93,7 +101,8 @@ static MP_THREAD_VOID worker_thread(void *arg)
     }
 
     // If no termination signal was given, it must mean we died because of a
-    // timeout, and nobody is waiting for us. We have to remove ourselves.
+    // timeout (or the maximum was lowered), and nobody is waiting for us. We
+    // have to remove ourselves.
     if (!pool->terminate) {
         for (int n = 0; n < pool->num_threads; n++) {
             if (mp_thread_id_equal(mp_thread_get_id(pool->threads[n]),
@@ -178,6 +187,23 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
     return pool;
 }
 
+void mp_thread_pool_set_max_threads(struct mp_thread_pool *pool,
+                                    int max_threads)
+{
+    mp_mutex_lock(&pool->lock);
+    pool->max_threads = MPMAX(max_threads, MPMAX(pool->min_threads, 1));
+    // Start threads for queued work that had to wait for the old maximum.
+    while (pool->busy_threads + pool->num_work > pool->num_threads &&
+           pool->num_threads < pool->max_threads)
+    {
+        if (!add_thread(pool))
+            break;
+    }
+    // Excess threads exit once they are done with their current work.
+    mp_cond_broadcast(&pool->wakeup);
+    mp_mutex_unlock(&pool->lock);
+}
+
 static bool thread_pool_add(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                             void *fn_ctx, bool allow_queue)
 {
@@ -221,3 +247,265 @@ bool mp_thread_pool_run(struct mp_thread_pool *pool, void (*fn)(void *ctx),
 {
     return thread_pool_add(pool, fn, fn_ctx, false);
 }
+
+// --- Shared compute pool
+
+#define MAX_WORKERS 64
+
+struct fork_join {
+    void (*fn)(void *ctx, int index);
+    void *fn_ctx;
+
+    mp_mutex lock;
+    mp_cond done;
+    int pending;            // number of queued tasks which have not returned
+};
+
+struct task {
+    struct fork_join *job;
+    int index;
+};
+
+struct task_deque {
+    mp_mutex lock;
+    // Not a child of shared.ta: deques are appended to concurrently under
+    // their own locks, which must not race on a common talloc parent.
+    struct task *tasks;
+    int num_tasks;
+};
+
+struct worker {
+    mp_thread thread;
+    // The owner takes tasks from the front, thieves from the back.
+    struct task_deque queues[MP_TASK_PRIO_COUNT];
+};
+
+struct mp_task_pool {
+    char dummy;
+};
+
+static mp_static_mutex shared_lock = MP_STATIC_MUTEX_INITIALIZER;
+static mp_static_mutex idle_lock = MP_STATIC_MUTEX_INITIALIZER;
+static mp_cond idle_wakeup = MP_STATIC_COND_INITIALIZER;
+
+static struct {
+    // --- protected by shared_lock
+    int refs;
+    void *ta;
+
+    // --- constant while there are references
+    struct worker *workers;
+
+    // --- protected by idle_lock (constant while there are references)
+    int num_workers;
+    bool terminate;
+
+    atomic_int queued;      // total number of tasks in all deques
+} shared;
+
+static bool pop_task(struct task_deque *q, bool front, struct task *out)
+{
+    bool ok = false;
+    mp_mutex_lock(&q->lock);
+    if (q->num_tasks) {
+        int n = front ? 0 : q->num_tasks - 1;
+        *out = q->tasks[n];
+        MP_TARRAY_REMOVE_AT(q->tasks, q->num_tasks, n);
+        atomic_fetch_add(&shared.queued, -1);
+        ok = true;
+    }
+    mp_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static bool take_task(int self, int num_workers, struct task *out)
+{
+    for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++) {
+        if (pop_task(&shared.workers[self].queues[prio], true, out))
+            return true;
+        for (int n = 1; n < num_workers; n++) {
+            struct worker *w = &shared.workers[(self + n) % num_workers];
+            if (pop_task(&w->queues[prio], false, out))
+                return true;
+        }
+    }
+    return false;
+}
+
+static void finish_tasks(struct fork_join *job, int num)
+{
+    mp_mutex_lock(&job->lock);
+    job->pending -= num;
+    if (!job->pending)
+        mp_cond_signal(&job->done);
+    mp_mutex_unlock(&job->lock);
+}
+
+static MP_THREAD_VOID shared_worker(void *arg)
+{
+    int self = (intptr_t)arg;
+
+    mp_thread_set_name("compute");
+
+    while (1) {
+        mp_mutex_lock(&idle_lock);
+        while (!shared.terminate && !atomic_load(&shared.queued))
+            mp_cond_wait(&idle_wakeup, &idle_lock);
+        bool terminate = shared.terminate;
+        int num_workers = shared.num_workers;
+        mp_mutex_unlock(&idle_lock);
+        if (terminate)
+            break;
+
+        struct task t;
+        while (take_task(self, num_workers, &t)) {
+            t.job->fn(t.job->fn_ctx, t.index);
+            finish_tasks(t.job, 1);
+        }
+    }
+
+    MP_THREAD_RETURN();
+}
+
+static void shared_unref(void *ptr)
+{
+    mp_mutex_lock(&shared_lock);
+    mp_assert(shared.refs > 0);
+    shared.refs -= 1;
+    if (!shared.refs) {
+        mp_mutex_lock(&idle_lock);
+        shared.terminate = true;
+        mp_cond_broadcast(&idle_wakeup);
+        mp_mutex_unlock(&idle_lock);
+
+        for (int n = 0; n < shared.num_workers; n++)
+            mp_thread_join(shared.workers[n].thread);
+
+        for (int n = 0; n < shared.num_workers; n++) {
+            for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++) {
+                struct task_deque *q = &shared.workers[n].queues[prio];
+                mp_assert(!q->num_tasks);
+                TA_FREEP(&q->tasks);
+                mp_mutex_destroy(&q->lock);
+            }
+        }
+        mp_assert(!atomic_load(&shared.queued));
+        TA_FREEP(&shared.ta);
+        shared.workers = NULL;
+        shared.num_workers = 0;
+    }
+    mp_mutex_unlock(&shared_lock);
+}
+
+struct mp_task_pool *mp_task_pool_get(void *ta_parent)
+{
+    struct mp_task_pool *pool = talloc_zero(ta_parent, struct mp_task_pool);
+
+    mp_mutex_lock(&shared_lock);
+    if (!shared.refs) {
+        shared.ta = talloc_new(NULL);
+        shared.terminate = false;
+        int num = MPCLAMP(av_cpu_count(), 1, MAX_WORKERS);
+        shared.workers = talloc_zero_array(shared.ta, struct worker, num);
+        for (int n = 0; n < num; n++) {
+            for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++)
+                mp_mutex_init(&shared.workers[n].queues[prio].lock);
+        }
+        for (int n = 0; n < num; n++) {
+            struct worker *w = &shared.workers[n];
+            if (mp_thread_create(&w->thread, shared_worker, (void *)(intptr_t)n)) {
+                for (int i = n; i < num; i++) {
+                    for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++)
+                        mp_mutex_destroy(&shared.workers[i].queues[prio].lock);
+                }
+                break;
+            }
+            mp_mutex_lock(&idle_lock);
+            shared.num_workers = n + 1;
+            mp_mutex_unlock(&idle_lock);
+        }
+    }
+    shared.refs += 1;
+    mp_mutex_unlock(&shared_lock);
+
+    talloc_set_destructor(pool, shared_unref);
+    return pool;
+}
+
+int mp_task_pool_threads(struct mp_task_pool *pool)
+{
+    // Constant while pool is alive.
+    return pool ? shared.num_workers : 0;
+}
+
+void mp_task_pool_run_all(struct mp_task_pool *pool, enum mp_task_prio prio,
+                          int count, void (*fn)(void *ctx, int index),
+                          void *fn_ctx)
+{
+    mp_assert(prio >= 0 && prio < MP_TASK_PRIO_COUNT);
+
+    int num_workers = mp_task_pool_threads(pool);
+    if (count <= 1 || !num_workers) {
+        for (int n = 0; n < count; n++)
+            fn(fn_ctx, n);
+        return;
+    }
+
+    struct fork_join job = {
+        .fn = fn,
+        .fn_ctx = fn_ctx,
+        .pending = count - 1,
+    };
+    mp_mutex_init(&job.lock);
+    mp_cond_init(&job.done);
+
+    for (int n = 1; n < count; n++) {
+        struct task_deque *q = &shared.workers[(n - 1) % num_workers].queues[prio];
+        mp_mutex_lock(&q->lock);
+        MP_TARRAY_APPEND(NULL, q->tasks, q->num_tasks,
+                         (struct task){.job = &job, .index = n});
+        atomic_fetch_add(&shared.queued, 1);
+        mp_mutex_unlock(&q->lock);
+    }
+
+    mp_mutex_lock(&idle_lock);
+    if (count > 2) {
+        mp_cond_broadcast(&idle_wakeup);
+    } else {
+        mp_cond_signal(&idle_wakeup);
+    }
+    mp_mutex_unlock(&idle_lock);
+
+    fn(fn_ctx, 0);
+
+    // Take back whatever the workers have not started yet. This is also what
+    // makes nested calls from within tasks safe.
+    for (int w = num_workers - 1; w >= 0; w--) {
+        struct task_deque *q = &shared.workers[w].queues[prio];
+        while (1) {
+            struct task t = {0};
+            mp_mutex_lock(&q->lock);
+            for (int n = q->num_tasks - 1; n >= 0; n--) {
+                if (q->tasks[n].job == &job) {
+                    t = q->tasks[n];
+                    MP_TARRAY_REMOVE_AT(q->tasks, q->num_tasks, n);
+                    atomic_fetch_add(&shared.queued, -1);
+                    break;
+                }
+            }
+            mp_mutex_unlock(&q->lock);
+            if (!t.job)
+                break;
+            fn(fn_ctx, t.index);
+            finish_tasks(&job, 1);
+        }
+    }
+
+    mp_mutex_lock(&job.lock);
+    while (job.pending)
+        mp_cond_wait(&job.done, &job.lock);
+    mp_mutex_unlock(&job.lock);
+
+    mp_cond_destroy(&job.done);
+    mp_mutex_destroy(&job.lock);
+}
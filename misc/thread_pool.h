@@ -17,6 +17,12 @@ struct mp_thread_pool;
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
                                              int min_threads, int max_threads);
 
+// Change the max_threads value passed to mp_thread_pool_create() (it's clamped
+// to min_threads and 1). If it's lowered, busy threads above the new maximum
+// exit once their current work item is done. This never blocks on work items.
+void mp_thread_pool_set_max_threads(struct mp_thread_pool *pool,
+                                    int max_threads);
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
 // If no worker thread is currently available, it's appended to a list in memory
 // with unbounded size. This function always returns immediately.
@@ -32,4 +38,40 @@ bool mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
 bool mp_thread_pool_run(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                         void *fn_ctx);
 
+// --- Shared compute pool
+
+// Process-wide pool for CPU-bound fork-join work (scaling, OSD blending,
+// copy-back), so that independent users don't over-subscribe the cores with
+// private pools. Workers always pick up realtime tasks before background
+// tasks; running tasks are not preempted.
+enum mp_task_prio {
+    MP_TASK_REALTIME,       // needed for the next frame during playback
+    MP_TASK_BACKGROUND,     // screenshots, thumbnails, preloading
+    MP_TASK_PRIO_COUNT,
+};
+
+struct mp_task_pool;
+
+// Return a reference to the shared pool, creating the worker threads (one per
+// CPU) if this is the first reference. Free the reference with talloc_free(),
+// or indirectly with talloc_free(ta_parent). The threads are joined when the
+// last reference is freed. Never fails; if no threads could be created, all
+// work runs on the calling thread.
+struct mp_task_pool *mp_task_pool_get(void *ta_parent);
+
+// Number of worker threads (0 if none could be created).
+int mp_task_pool_threads(struct mp_task_pool *pool);
+
+// Call fn(fn_ctx, n) for each n in [0, count), and return once all calls have
+// returned. n=0 runs on the calling thread; the others are queued on the
+// workers, where task n always goes to the same worker (n-1 modulo the
+// number of workers), which keeps per-index state hot in the same cache.
+// Idle workers steal from the others. Tasks nobody picked up by the time the
+// caller is done with its own are run on the calling thread, so this can be
+// called from within a task without deadlocking. pool can be NULL, which runs
+// everything on the calling thread.
+void mp_task_pool_run_all(struct mp_task_pool *pool, enum mp_task_prio prio,
+                          int count, void (*fn)(void *ctx, int index),
+                          void *fn_ctx);
+
 #endif
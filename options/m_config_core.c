@@ -44,12 +44,28 @@ struct m_config_shadow {
     // Invariant: a parent is always at a lower index than any of its children.
     struct m_config_group *groups;
     int num_groups;
+    // Per group: timestamp of the current snapshot (readable without lock).
+    _Atomic uint64_t *group_ts;
     // -- protected by lock
-    struct m_config_data *data; // protected shadow copy of the option data
+    // Per group: current option data. NULL if the root group has no data.
+    struct group_snapshot **snapshots;
     struct config_cache **listeners;
     int num_listeners;
 };
 
+// Immutable copy of the data of one m_config_group. An option change creates
+// a new snapshot of the affected group only and swaps it in, so caches can
+// copy from a snapshot they hold a reference to without holding the lock.
+// (Substruct pointers in udata are not valid; only option fields are.)
+struct group_snapshot {
+    atomic_int refs;
+    const struct m_sub_options *group;
+    uint64_t ts;                        // value of shadow->ts on creation
+    char *udata;
+    struct force_update *force_update;  // opts written with force update
+    int num_force_update;
+};
+
 // Represents a sub-struct (OPT_SUBSTRUCT()).
 struct m_config_group {
     const struct m_sub_options *group;
@@ -79,13 +95,13 @@ struct config_cache {
     struct m_config_cache *public;
 
     struct m_config_data *data;     // public data
-    struct m_config_data *src;      // global data (currently ==shadow->data)
     struct m_config_shadow *shadow; // global metadata
     int group_start, group_end;     // derived from data->group_index etc.
     uint64_t ts;                    // timestamp of this data copy
     bool in_list;                   // part of m_config_shadow->listeners[]
     int upd_group;                  // for "incremental" change notification
     int upd_opt;
+    struct group_snapshot *upd_snap; // reference to source of upd_group
 
 
     // --- Implicitly synchronized by setting/unsetting wakeup_cb.
@@ -99,7 +115,7 @@ struct config_cache {
 };
 
 struct force_update {
-    char *name;
+    const char *name;                   // static (from the m_option)
     uint64_t ts;
 };
 
@@ -107,8 +123,6 @@ struct force_update {
 struct m_group_data {
     char *udata;                        // pointer to group user option struct
     uint64_t ts;                        // timestamp of the data copy
-    struct force_update **force_update; // tracks opts that are written with force update
-    int force_update_len;
 };
 
 static void add_sub_group(struct m_config_shadow *shadow, const char *name_prefix,
@@ -337,7 +351,7 @@ static void init_opt_inplace(const struct m_option *opt, void *dst,
 }
 
 static void alloc_group(struct m_config_data *data, int group_index,
-                        struct m_config_data *copy)
+                        struct group_snapshot **copy)
 {
     mp_assert(group_index == data->group_index + data->num_gdata);
     mp_assert(group_index < data->shadow->num_groups);
@@ -347,18 +361,17 @@ static void alloc_group(struct m_config_data *data, int group_index,
     MP_TARRAY_GROW(data, data->gdata, data->num_gdata);
     struct m_group_data *gdata = &data->gdata[data->num_gdata++];
 
-    struct m_group_data *copy_gdata =
-        copy ? m_config_gdata(copy, group_index) : NULL;
+    struct group_snapshot *copy_snap = copy ? copy[group_index] : NULL;
 
     *gdata = (struct m_group_data){
         .udata = talloc_zero_size(data, opts->size),
-        .ts = copy_gdata ? copy_gdata->ts : 0,
+        .ts = copy_snap ? copy_snap->ts : 0,
     };
 
     if (opts->defaults)
         memcpy(gdata->udata, opts->defaults, opts->size);
 
-    char *copy_src = copy_gdata ? copy_gdata->udata : NULL;
+    char *copy_src = copy_snap ? copy_snap->udata : NULL;
 
     for (int n = 0; opts->opts && opts->opts[n].name; n++) {
         const struct m_option *opt = &opts->opts[n];
@@ -405,12 +418,12 @@ static void free_option_data(void *p)
 
 // Allocate data using the option description in shadow, starting at group_index
 // (index into m_config.groups[]).
-// If copy is not NULL, copy all data from there (for groups which are in both
-// m_config_data instances), in all other cases init the data with the defaults.
+// If copy is not NULL, copy all data from the snapshots in it (indexed by
+// group), otherwise init the data with the defaults.
 static struct m_config_data *allocate_option_data(void *ta_parent,
                                                   struct m_config_shadow *shadow,
                                                   int group_index,
-                                                  struct m_config_data *copy)
+                                                  struct group_snapshot **copy)
 {
     mp_assert(group_index >= 0 && group_index < shadow->num_groups);
     struct m_config_data *data = talloc_zero(ta_parent, struct m_config_data);
@@ -428,6 +441,60 @@ static struct m_config_data *allocate_option_data(void *ta_parent,
     return data;
 }
 
+static void free_snapshot(void *p)
+{
+    struct group_snapshot *snap = p;
+    const struct m_option *opts = snap->group->opts;
+
+    for (int n = 0; opts && opts[n].name; n++) {
+        const struct m_option *opt = &opts[n];
+
+        if (opt->offset >= 0 && opt->type->size > 0)
+            m_option_free(opt, snap->udata + opt->offset);
+    }
+}
+
+// Create a snapshot of group group_index with the option values in src.
+// Must be called with the lock held (or during init).
+static struct group_snapshot *new_snapshot(struct m_config_shadow *shadow,
+                                           int group_index, const char *src)
+{
+    const struct m_sub_options *opts = shadow->groups[group_index].group;
+
+    // Not a talloc child of the shadow: the last reference can be dropped on
+    // any thread.
+    struct group_snapshot *snap = talloc_zero(NULL, struct group_snapshot);
+    talloc_set_destructor(snap, free_snapshot);
+    atomic_init(&snap->refs, 1);
+    snap->group = opts;
+    snap->udata = talloc_zero_size(snap, opts->size);
+    if (opts->defaults)
+        memcpy(snap->udata, opts->defaults, opts->size);
+
+    for (int n = 0; opts->opts && opts->opts[n].name; n++) {
+        const struct m_option *opt = &opts->opts[n];
+
+        if (opt->offset < 0 || opt->type->size == 0)
+            continue;
+
+        void *dst = snap->udata + opt->offset;
+        init_opt_inplace(opt, dst, src + opt->offset);
+    }
+
+    return snap;
+}
+
+static void ref_snapshot(struct group_snapshot *snap)
+{
+    atomic_fetch_add(&snap->refs, 1);
+}
+
+static void unref_snapshot(struct group_snapshot *snap)
+{
+    if (snap && atomic_fetch_add(&snap->refs, -1) == 1)
+        talloc_free(snap);
+}
+
 static void shadow_destroy(void *p)
 {
     struct m_config_shadow *shadow = p;
@@ -435,7 +502,10 @@ static void shadow_destroy(void *p)
     // must all have been unregistered
     mp_assert(shadow->num_listeners == 0);
 
-    talloc_free(shadow->data);
+    for (int n = 0; shadow->snapshots && n < shadow->num_groups; n++) {
+        mp_assert(atomic_load(&shadow->snapshots[n]->refs) == 1);
+        unref_snapshot(shadow->snapshots[n]);
+    }
     mp_mutex_destroy(&shadow->lock);
 }
 
@@ -447,10 +517,20 @@ struct m_config_shadow *m_config_shadow_new(const struct m_sub_options *root)
 
     add_sub_group(shadow, NULL, -1, -1, root);
 
+    shadow->group_ts = talloc_zero_array(shadow, _Atomic uint64_t,
+                                         shadow->num_groups);
+    for (int n = 0; n < shadow->num_groups; n++)
+        atomic_init(&shadow->group_ts[n], 0);
+
     if (!root->size)
         return shadow;
 
-    shadow->data = allocate_option_data(shadow, shadow, 0, NULL);
+    struct m_config_data *data = allocate_option_data(NULL, shadow, 0, NULL);
+    shadow->snapshots = talloc_zero_array(shadow, struct group_snapshot *,
+                                          shadow->num_groups);
+    for (int n = 0; n < shadow->num_groups; n++)
+        shadow->snapshots[n] = new_snapshot(shadow, n, data->gdata[n].udata);
+    talloc_free(data);
 
     return shadow;
 }
@@ -553,6 +633,8 @@ static void cache_destroy(void *p)
     // breaking is a feature provided by these functions)
     m_config_cache_set_wakeup_cb(cache, NULL, NULL);
     m_config_cache_set_dispatch_change_cb(cache, NULL, NULL, NULL);
+
+    unref_snapshot(cache->internal->upd_snap);
 }
 
 struct m_config_cache *m_config_cache_from_shadow(void *ta_parent,
@@ -583,10 +665,10 @@ struct m_config_cache *m_config_cache_from_shadow(void *ta_parent,
 
     struct config_cache *in = cache->internal;
     in->shadow = shadow;
-    in->src = shadow->data;
 
     mp_mutex_lock(&shadow->lock);
-    in->data = allocate_option_data(cache, shadow, group_index, in->src);
+    in->data = allocate_option_data(cache, shadow, group_index,
+                                    shadow->snapshots);
     mp_mutex_unlock(&shadow->lock);
 
     cache->opts = in->data->gdata[0].udata;
@@ -607,27 +689,13 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     return m_config_cache_from_shadow(ta_parent, global->config, group);
 }
 
-static void append_force_update(struct m_config_cache *cache, struct m_group_data *gdata,
-                                const char *opt_name)
-{
-    for (int i = 0; i < gdata->force_update_len; ++i) {
-        if (strcmp(opt_name, gdata->force_update[i]->name) == 0) {
-            gdata->force_update[i]->ts = gdata->ts;
-            return;
-        }
-    }
-    struct force_update *new_update = talloc_zero(cache, struct force_update);
-    new_update->name = talloc_strdup(cache, opt_name);
-    new_update->ts = gdata->ts;
-    MP_TARRAY_APPEND(cache, gdata->force_update, gdata->force_update_len, new_update);
-}
-
-static bool check_force_update(struct m_group_data *gdata, const char *opt_name,
-                               uint64_t timestamp)
+// Whether opt_name was written with force update after timestamp ts.
+static bool check_force_update(struct group_snapshot *snap, const char *opt_name,
+                               uint64_t ts)
 {
-    for (int i = 0; i < gdata->force_update_len; ++i) {
-        if ((strcmp(opt_name, gdata->force_update[i]->name) == 0) &&
-            gdata->force_update[i]->ts == timestamp)
+    for (int i = 0; i < snap->num_force_update; ++i) {
+        if (snap->force_update[i].ts > ts &&
+            strcmp(opt_name, snap->force_update[i].name) == 0)
         {
             return true;
         }
@@ -639,32 +707,41 @@ static void update_next_option(struct m_config_cache *cache, void **p_opt)
 {
     struct config_cache *in = cache->internal;
     struct m_config_data *dst = in->data;
-    struct m_config_data *src = in->src;
-
-    mp_assert(src->group_index == 0); // must be the option root currently
+    struct m_config_shadow *shadow = in->shadow;
 
     *p_opt = NULL;
 
     while (in->upd_group < dst->group_index + dst->num_gdata) {
-        struct m_group_data *gsrc = m_config_gdata(src, in->upd_group);
         struct m_group_data *gdst = m_config_gdata(dst, in->upd_group);
-        mp_assert(gsrc && gdst);
+        mp_assert(gdst);
 
-        if (gdst->ts < gsrc->ts) {
-            struct m_config_group *g = &dst->shadow->groups[in->upd_group];
+        // Groups which did not change are skipped without taking the lock.
+        if (!in->upd_snap &&
+            gdst->ts < atomic_load(&shadow->group_ts[in->upd_group]))
+        {
+            mp_mutex_lock(&shadow->lock);
+            in->upd_snap = shadow->snapshots[in->upd_group];
+            ref_snapshot(in->upd_snap);
+            mp_mutex_unlock(&shadow->lock);
+        }
+
+        struct group_snapshot *snap = in->upd_snap;
+        if (snap) {
+            struct m_config_group *g = &shadow->groups[in->upd_group];
             const struct m_option *opts = g->group->opts;
 
             while (opts && opts[in->upd_opt].name) {
                 const struct m_option *opt = &opts[in->upd_opt];
-                void *dsrc = gsrc->udata + opt->offset;
+                void *dsrc = snap->udata + opt->offset;
                 void *ddst = gdst->udata + opt->offset;
 
                 if (opt->offset >= 0 && opt->type->size) {
                     bool opt_equal = m_option_equal(opt, ddst, dsrc);
                     bool force_update = opt->force_update &&
-                                        check_force_update(gsrc, opt->name, in->ts);
+                                        check_force_update(snap, opt->name,
+                                                           gdst->ts);
                     if (!opt_equal || force_update) {
-                        uint64_t ch = get_opt_change_mask(dst->shadow,
+                        uint64_t ch = get_opt_change_mask(shadow,
                                         in->upd_group, dst->group_index, opt);
 
                         if (cache->debug && !opt_equal) {
@@ -689,7 +766,9 @@ static void update_next_option(struct m_config_cache *cache, void **p_opt)
                 in->upd_opt++;
             }
 
-            gdst->ts = gsrc->ts;
+            gdst->ts = snap->ts;
+            unref_snapshot(snap);
+            in->upd_snap = NULL;
         }
 
         in->upd_group++;
@@ -704,8 +783,8 @@ static bool cache_check_update(struct m_config_cache *cache)
     struct config_cache *in = cache->internal;
     struct m_config_shadow *shadow = in->shadow;
 
-    // Using atomics and checking outside of the lock - it's unknown whether
-    // this makes it faster or slower. Just cargo culting it.
+    // Checked without the lock. Nothing is copied unless one of the groups
+    // in this cache has a newer snapshot.
     uint64_t new_ts = atomic_load(&shadow->ts);
     if (in->ts >= new_ts)
         return false;
@@ -718,13 +797,9 @@ static bool cache_check_update(struct m_config_cache *cache)
 
 bool m_config_cache_update(struct m_config_cache *cache)
 {
-    struct config_cache *in = cache->internal;
-    struct m_config_shadow *shadow = in->shadow;
-
     if (!cache_check_update(cache))
         return false;
 
-    mp_mutex_lock(&shadow->lock);
     bool res = false;
     while (1) {
         void *p;
@@ -733,22 +808,18 @@ bool m_config_cache_update(struct m_config_cache *cache)
             break;
         res = true;
     }
-    mp_mutex_unlock(&shadow->lock);
     return res;
 }
 
 bool m_config_cache_get_next_changed(struct m_config_cache *cache, void **opt)
 {
     struct config_cache *in = cache->internal;
-    struct m_config_shadow *shadow = in->shadow;
 
     *opt = NULL;
     if (!cache_check_update(cache) && in->upd_group < 0)
         return false;
 
-    mp_mutex_lock(&shadow->lock);
     update_next_option(cache, opt);
-    mp_mutex_unlock(&shadow->lock);
     return !!*opt;
 }
 
@@ -795,16 +866,29 @@ bool m_config_cache_write_opt(struct m_config_cache *cache, void *ptr)
 
     mp_mutex_lock(&shadow->lock);
 
-    struct m_group_data *gdst = m_config_gdata(in->data, group_idx);
-    struct m_group_data *gsrc = m_config_gdata(in->src, group_idx);
-    mp_assert(gdst && gsrc);
+    struct group_snapshot *old = shadow->snapshots[group_idx];
 
-    bool changed = !m_option_equal(opt, gsrc->udata + opt->offset, ptr) ||
+    bool changed = !m_option_equal(opt, old->udata + opt->offset, ptr) ||
                    opt->force_update;
     if (changed) {
-        m_option_copy(opt, gsrc->udata + opt->offset, ptr);
+        struct group_snapshot *snap = new_snapshot(shadow, group_idx, old->udata);
+        m_option_copy(opt, snap->udata + opt->offset, ptr);
+        snap->ts = atomic_fetch_add(&shadow->ts, 1) + 1;
+
+        // Carry over the force update history (one entry per option).
+        for (int i = 0; i < old->num_force_update; i++) {
+            struct force_update *fu = &old->force_update[i];
+            if (!opt->force_update || strcmp(fu->name, opt->name) != 0)
+                MP_TARRAY_APPEND(snap, snap->force_update, snap->num_force_update, *fu);
+        }
+        if (opt->force_update) {
+            MP_TARRAY_APPEND(snap, snap->force_update, snap->num_force_update,
+                             (struct force_update){opt->name, snap->ts});
+        }
 
-        gsrc->ts = atomic_fetch_add(&shadow->ts, 1) + 1;
+        shadow->snapshots[group_idx] = snap;
+        atomic_store(&shadow->group_ts[group_idx], snap->ts);
+        unref_snapshot(old);
 
         for (int n = 0; n < shadow->num_listeners; n++) {
             struct config_cache *listener = shadow->listeners[n];
@@ -813,9 +897,6 @@ bool m_config_cache_write_opt(struct m_config_cache *cache, void *ptr)
         }
     }
 
-    if (opt->force_update)
-        append_force_update(cache, gsrc, opt->name);
-
     mp_mutex_unlock(&shadow->lock);
 
     return changed;
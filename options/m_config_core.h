@@ -86,8 +86,9 @@ void m_config_cache_set_dispatch_change_cb(struct m_config_cache *cache,
                                            void (*cb)(void *ctx), void *cb_ctx);
 
 // Update the options in cache->opts to current global values. Return whether
-// there was an update notification at all (which may or may not indicate that
-// some options have changed).
+// any option changed. Option groups that were not written since the last call
+// are skipped without locking or comparing anything; changed groups are copied
+// from an immutable snapshot without holding the global lock.
 // Keep in mind that while the cache->opts pointer does not change, the option
 // data itself will (e.g. string options might be reallocated).
 // New change flags are or-ed into cache->change_flags with this call (if you
@@ -944,7 +944,7 @@ struct m_profile *m_config_add_profile(struct m_config *config, char *name)
 }
 
 int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
-                                bstr name, bstr val)
+                                bstr name, bstr val, bool check)
 {
     if (bstr_equals0(name, "profile-desc")) {
         talloc_free(p->desc);
@@ -963,11 +963,13 @@ int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
                               &p->restore_mode);
     }
 
-    int i = m_config_set_option_cli(config, name, val,
-                                    M_SETOPT_CHECK_ONLY |
-                                    M_SETOPT_FROM_CONFIG_FILE);
-    if (i < 0)
-        return i;
+    if (check) {
+        int i = m_config_set_option_cli(config, name, val,
+                                        M_SETOPT_CHECK_ONLY |
+                                        M_SETOPT_FROM_CONFIG_FILE);
+        if (i < 0)
+            return i;
+    }
     p->opts = talloc_realloc(p, p->opts, char *, 2 * (p->num_opts + 2));
     p->opts[p->num_opts * 2] = bstrto0(p, name);
     p->opts[p->num_opts * 2 + 1] = bstrto0(p, val);
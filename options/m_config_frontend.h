@@ -243,9 +243,11 @@ struct m_profile *m_config_add_profile(struct m_config *config, char *name);
  *  \param p The profile object.
  *  \param name The option's name.
  *  \param val The option's value.
+ *  \param check Whether to check the option first. Can be false only if
+ *               the same name/value pair passed the check before.
  */
 int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
-                                bstr name, bstr val);
+                                bstr name, bstr val, bool check);
 
 /*  Enables profile usage
  *  Used by the config file parser when loading a profile.
@@ -71,6 +71,10 @@ extern const m_option_type_t m_option_type_node;
 extern const m_option_type_t m_option_type_rect;
 extern const m_option_type_t m_option_type_cycle_dir;
 
+// Return the talloc allocation that owns all memory of a m_option_type_node
+// value (NULL if there is none).
+void *node_get_alloc(struct mpv_node *node);
+
 // Used internally by m_config.c
 extern const m_option_type_t m_option_type_alias;
 extern const m_option_type_t m_option_type_cli_alias;
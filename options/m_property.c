@@ -34,16 +34,90 @@
 #include "common/msg.h"
 #include "common/common.h"
 
+struct m_property_index {
+    const struct m_property *list;
+    // Indexes into list, -1 for unused slots. Open addressing, linear probing.
+    int *table;
+    uint32_t mask;
+};
+
+static uint32_t name_hash(bstr name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    int num = 0;
+    while (list[num].name)
+        num++;
+
+    struct m_property_index *index = talloc_zero(ta_parent, struct m_property_index);
+    uint32_t size = mp_round_next_power_of_2(num * 2 + 1);
+    index->list = list;
+    index->mask = size - 1;
+    index->table = talloc_array(index, int, size);
+    for (uint32_t n = 0; n < size; n++)
+        index->table[n] = -1;
+
+    for (int n = 0; n < num; n++) {
+        bstr name = bstr0(list[n].name);
+        uint32_t slot = name_hash(name) & index->mask;
+        while (index->table[slot] >= 0) {
+            // Like a linear search, the first entry with a name wins.
+            if (bstr_equals0(name, list[index->table[slot]].name))
+                break;
+            slot = (slot + 1) & index->mask;
+        }
+        if (index->table[slot] < 0)
+            index->table[slot] = n;
+    }
+    return index;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name)
+{
+    uint32_t slot = name_hash(name) & index->mask;
+    for (int n; (n = index->table[slot]) >= 0; slot = (slot + 1) & index->mask) {
+        if (bstr_equals0(name, index->list[n].name))
+            return (struct m_property *)&index->list[n];
+    }
+    return NULL;
+}
+
+bool m_property_resolve(const struct m_property_index *index, const char *name,
+                        struct m_property_ref *ref)
+{
+    bstr base = bstr0(name);
+    const char *key = NULL;
+    const char *sep = strchr(name, '/');
+    if (sep && sep[1]) {
+        base = bstr_splice(base, 0, sep - name);
+        key = sep + 1;
+    }
+    *ref = (struct m_property_ref){
+        .prop = m_property_index_find(index, base),
+        .name = bstr0(name),
+        .key = key,
+    };
+    return ref->prop;
+}
+
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
-                               const char *property, double f, void *ctx)
+                               const struct m_property_ref *ref,
+                               double f, void *ctx)
 {
     union m_option_value val = m_option_value_default;
     struct m_option opt = {0};
     int r;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                      &opt, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_GET_CONSTRICTED_TYPE, &opt, ctx);
     if (r != M_PROPERTY_OK)
         return r;
     mp_assert(opt.type);
@@ -51,58 +125,51 @@ static int m_property_multiply(struct mp_log *log,
     if (!opt.type->multiply)
         return M_PROPERTY_NOT_IMPLEMENTED;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET, &val, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_GET, &val, ctx);
     if (r != M_PROPERTY_OK)
         return r;
     opt.type->multiply(&opt, &val, f);
-    r = m_property_do(log, prop_list, property, M_PROPERTY_SET, &val, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_SET, &val, ctx);
     m_option_free(&opt, &val);
     return r;
 }
 
-struct m_property *m_property_list_find(const struct m_property *list,
-                                        const char *name)
+static int do_action(const struct m_property_ref *ref, int action, void *arg,
+                     void *ctx)
 {
-    for (int n = 0; list && list[n].name; n++) {
-        if (strcmp(list[n].name, name) == 0)
-            return (struct m_property *)&list[n];
-    }
-    return NULL;
-}
-
-static int do_action(const struct m_property *prop_list, const char *name,
-                     int action, void *arg, void *ctx)
-{
-    struct m_property *prop;
     struct m_property_action_arg ka;
-    const char *sep = strchr(name, '/');
-    if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+    if (!ref->prop)
+        return M_PROPERTY_UNKNOWN;
+    if (ref->key) {
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = ref->key,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
-    if (!prop)
+    }
+    return ref->prop->call(ctx, ref->prop, action, arg);
+}
+
+int m_property_do(struct mp_log *log, const struct m_property_index *index,
+                  const char *name, int action, void *arg, void *ctx)
+{
+    struct m_property_ref ref;
+    if (!m_property_resolve(index, name, &ref))
         return M_PROPERTY_UNKNOWN;
-    return prop->call(ctx, prop, action, arg);
+    return m_property_do_ref(log, &ref, action, arg, ctx);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
-                  const char *name, int action, void *arg, void *ctx)
+int m_property_do_ref(struct mp_log *log, const struct m_property_ref *ref,
+                      int action, void *arg, void *ctx)
 {
     union m_option_value val = m_option_value_default;
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(ref, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     mp_assert(opt.type);
@@ -110,10 +177,10 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     switch (action) {
     case M_PROPERTY_FIXED_LEN_PRINT:
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, action, arg, ctx)) >= 0)
+        if ((r = do_action(ref, action, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val, action == M_PROPERTY_FIXED_LEN_PRINT);
         m_option_free(&opt, &val);
@@ -121,7 +188,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -130,51 +197,56 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do_ref(log, ref, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_MULTIPLY: {
-        return m_property_multiply(log, prop_list, name, *(double *)arg, ctx);
+        return m_property_multiply(log, ref, *(double *)arg, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                          &opt, ctx);
+        r = m_property_do_ref(log, ref, M_PROPERTY_GET_CONSTRICTED_TYPE, &opt,
+                              ctx);
         if (r <= 0)
             return r;
         mp_assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(ref, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        r = do_action(prop_list, name, action, arg, ctx);
+        r = do_action(ref, action, arg, ctx);
         if (r >= 0 || r == M_PROPERTY_UNAVAILABLE)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
             return r;
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(ref, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
+        if (opt.type == CONF_TYPE_NODE) {
+            // Already in the right format; avoid a deep copy.
+            *node = *(struct mpv_node *)&val;
+            return M_PROPERTY_OK;
+        }
         int err = m_option_get_node(&opt, NULL, node, &val);
         if (err == M_OPT_UNKNOWN) {
             r = M_PROPERTY_NOT_IMPLEMENTED;
@@ -189,22 +261,22 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        int err = m_option_set_node_or_string(log, &opt, bstr0(name), &val, arg);
+        int err = m_option_set_node_or_string(log, &opt, ref->name, &val, arg);
         if (err == M_OPT_UNKNOWN) {
             r = M_PROPERTY_NOT_IMPLEMENTED;
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(ref, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(ref, action, arg, ctx);
     }
 }
 
@@ -235,11 +307,21 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *index, bstr name,
                               int action, void *arg, void *ctx)
 {
+    // Sub-keys are passed on as C strings, so only these need a copy.
+    if (bstrchr(name, '/') < 0) {
+        struct m_property_ref ref = {
+            .prop = m_property_index_find(index, name),
+            .name = name,
+        };
+        if (!ref.prop)
+            return M_PROPERTY_UNKNOWN;
+        return m_property_do_ref(NULL, &ref, action, arg, ctx);
+    }
     char *name0 = bstrdup0(NULL, name);
-    int ret = m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    int ret = m_property_do(NULL, index, name0, action, arg, ctx);
     talloc_free(name0);
     return ret;
 }
@@ -252,7 +334,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *index, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -268,7 +350,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     method = fixed_len ? M_PROPERTY_FIXED_LEN_PRINT : method;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(index, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -285,7 +367,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *index,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -319,7 +401,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
 #endif
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(index, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
@@ -549,6 +631,59 @@ int m_property_read_sub(const struct m_sub_property *props, int action, void *ar
 // count: number of items.
 // get_item: callback to access a single item.
 // ctx: userdata passed to get_item.
+// Read the items [start, start + count) as a node array.
+static void read_list_items(struct mpv_node *dst, int start, int count,
+                            m_get_item_cb get_item, void *ctx)
+{
+    struct mpv_node node;
+    node.format = MPV_FORMAT_NODE_ARRAY;
+    node.u.list = talloc_zero(NULL, mpv_node_list);
+    node.u.list->num = count;
+    node.u.list->values = talloc_array(node.u.list, mpv_node, count);
+    for (int n = 0; n < count; n++) {
+        struct mpv_node *sub = &node.u.list->values[n];
+        sub->format = MPV_FORMAT_NONE;
+        int r;
+        r = get_item(start + n, M_PROPERTY_GET_NODE, sub, ctx);
+        if (r == M_PROPERTY_NOT_IMPLEMENTED) {
+            struct m_option opt = {0};
+            r = get_item(start + n, M_PROPERTY_GET_TYPE, &opt, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            union m_option_value val = m_option_value_default;
+            r = get_item(start + n, M_PROPERTY_GET, &val, ctx);
+            if (r != M_PROPERTY_OK)
+                goto err;
+            if (opt.type == CONF_TYPE_NODE) {
+                *sub = *(struct mpv_node *)&val;
+                talloc_steal(node.u.list, node_get_alloc(sub));
+            } else {
+                m_option_get_node(&opt, node.u.list, sub, &val);
+                m_option_free(&opt, &val);
+            }
+        err: ;
+        }
+    }
+    *dst = node;
+}
+
+// Parse the "START/COUNT" part of a "range/START/COUNT" key, and clamp the
+// range to the list size.
+static bool parse_list_range(const char *key, int size, int *start, int *count)
+{
+    bstr rest = bstr0(key);
+    long long s = bstrtoll(rest, &rest, 10);
+    if (rest.start == (unsigned char *)key || !bstr_eatstart0(&rest, "/") || !rest.len)
+        return false;
+    unsigned char *count_start = rest.start;
+    long long c = bstrtoll(rest, &rest, 10);
+    if (rest.start == count_start || rest.len || s < 0 || c < 0)
+        return false;
+    *start = MPMIN(s, size);
+    *count = MPMIN(c, size - *start);
+    return true;
+}
+
 int m_property_read_list(int action, void *arg, int count,
                          m_get_item_cb get_item, void *ctx)
 {
@@ -557,34 +692,9 @@ int m_property_read_list(int action, void *arg, int count,
     case M_PROPERTY_GET_TYPE:
         *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
         return M_PROPERTY_OK;
-    case M_PROPERTY_GET: {
-        struct mpv_node node;
-        node.format = MPV_FORMAT_NODE_ARRAY;
-        node.u.list = talloc_zero(NULL, mpv_node_list);
-        node.u.list->num = count;
-        node.u.list->values = talloc_array(node.u.list, mpv_node, count);
-        for (int n = 0; n < count; n++) {
-            struct mpv_node *sub = &node.u.list->values[n];
-            sub->format = MPV_FORMAT_NONE;
-            int r;
-            r = get_item(n, M_PROPERTY_GET_NODE, sub, ctx);
-            if (r == M_PROPERTY_NOT_IMPLEMENTED) {
-                struct m_option opt = {0};
-                r = get_item(n, M_PROPERTY_GET_TYPE, &opt, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                union m_option_value val = m_option_value_default;
-                r = get_item(n, M_PROPERTY_GET, &val, ctx);
-                if (r != M_PROPERTY_OK)
-                    goto err;
-                m_option_get_node(&opt, node.u.list, sub, &val);
-                m_option_free(&opt, &val);
-            err: ;
-            }
-        }
-        *(struct mpv_node *)arg = node;
+    case M_PROPERTY_GET:
+        read_list_items(arg, 0, MPMAX(count, 0), get_item, ctx);
         return M_PROPERTY_OK;
-    }
     case M_PROPERTY_PRINT: {
         // See m_property_read_sub() remarks.
         char *res = NULL;
@@ -616,6 +726,20 @@ int m_property_read_list(int action, void *arg, int count,
             }
             return M_PROPERTY_NOT_IMPLEMENTED;
         }
+        if (strncmp(ka->key, "range/", 6) == 0) {
+            int start, num;
+            if (!parse_list_range(ka->key + 6, MPMAX(count, 0), &start, &num))
+                return M_PROPERTY_UNKNOWN;
+            switch (ka->action) {
+            case M_PROPERTY_GET_TYPE:
+                *(struct m_option *)ka->arg = (struct m_option){.type = CONF_TYPE_NODE};
+                return M_PROPERTY_OK;
+            case M_PROPERTY_GET:
+                read_list_items(ka->arg, start, num, get_item, ctx);
+                return M_PROPERTY_OK;
+            }
+            return M_PROPERTY_NOT_IMPLEMENTED;
+        }
         // This is expected of the form "123" or "123/rest"
         char *end;
         long int item = strtol(ka->key, &end, 10);
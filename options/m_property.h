@@ -151,16 +151,38 @@ struct m_property {
     bool coalesce;
 };
 
-struct m_property *m_property_list_find(const struct m_property *list,
-                                        const char *name);
+// Hash table for looking up the properties of a {0}-terminated list by name.
+// The list must stay valid and unchanged for the lifetime of the index.
+struct m_property_index;
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list);
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name);
+
+// A property path resolved to the property, so it can be accessed repeatedly
+// without looking up the name. For "a/b/c", prop is "a" and key is "b/c".
+struct m_property_ref {
+    struct m_property *prop;
+    bstr name;          // the full path
+    const char *key;    // NULL if there is no sub-key; points into name
+};
+
+// Resolve the property path name into *ref. Return false if the property is
+// unknown. ref references name, which must stay valid while ref is used.
+bool m_property_resolve(const struct m_property_index *index, const char *name,
+                        struct m_property_ref *ref);
 
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *index,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Like m_property_do(), with a property resolved by m_property_resolve().
+int m_property_do_ref(struct mp_log *log, const struct m_property_ref *ref,
+                      int action, void *arg, void *ctx);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -183,7 +205,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(const struct m_property_index *index,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
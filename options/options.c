@@ -77,6 +77,7 @@ extern const struct m_sub_options vd_lavc_conf;
 extern const struct m_sub_options ad_lavc_conf;
 extern const struct m_sub_options hwdec_conf;
 extern const struct m_sub_options input_config;
+extern const struct m_sub_options client_conf;
 extern const struct m_sub_options encode_config;
 extern const struct m_sub_options ra_ctx_conf;
 extern const struct m_sub_options gl_video_conf;
@@ -85,6 +86,8 @@ extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
 extern const struct m_sub_options demux_cache_conf;
+extern const struct m_sub_options stream_file_conf;
+extern const struct m_sub_options stream_mirror_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -252,6 +255,7 @@ static const m_option_t mp_vo_opt_list[] = {
     {"d3d11-composition-size", OPT_SIZE_BOX(d3d11_composition_size)},
 #endif
     {"swapchain-depth", OPT_INT(swapchain_depth), M_RANGE(1, VO_MAX_SWAPCHAIN_DEPTH)},
+    {"video-late-latching", OPT_BOOL(late_latching)},
     {"override-display-fps", OPT_REPLACED("display-fps-override")},
     {0}
 };
@@ -350,6 +354,7 @@ const struct m_sub_options mp_subtitle_sub_opts = {
         {"sub-lavc-o", OPT_KEYVALUELIST(sub_avopts), .flags = UPDATE_SUB_HARD},
         {"sub-glyph-limit", OPT_INT(sub_glyph_limit)},
         {"sub-bitmap-max-size", OPT_INT(sub_bitmap_max_size)},
+        {"sub-render-ahead", OPT_BOOL(sub_render_ahead)},
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
@@ -467,11 +472,14 @@ const struct m_sub_options filter_conf = {
             {"tff", MP_FIELD_PARITY_TFF},
             {"bff", MP_FIELD_PARITY_BFF},
             {"auto", MP_FIELD_PARITY_AUTO})},
+        {"filter-stage-threshold", OPT_DOUBLE(stage_threshold), M_RANGE(0, 1)},
+        {"lavfi-spare-graph", OPT_BOOL(lavfi_spare_graph)},
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
     .defaults = &(const struct filter_opts){
         .field_parity = MP_FIELD_PARITY_AUTO,
+        .stage_threshold = 0.005,
     },
     .change_flags = UPDATE_IMGPAR,
 };
@@ -557,6 +565,7 @@ static const m_option_t mp_opts[] = {
     {"script-opts", OPT_KEYVALUELIST(script_opts)},
     {"script-opt", OPT_CLI_ALIAS("script-opts-append")},
     {"load-scripts", OPT_BOOL(auto_load_scripts)},
+    {"script-threads", OPT_INT(script_threads), M_RANGE(0, 64)},
 #endif
 #if HAVE_JAVASCRIPT
     {"js-memory-report", OPT_BOOL(js_memory_report)},
@@ -578,6 +587,8 @@ static const m_option_t mp_opts[] = {
     {"load-positioning", OPT_BOOL(lua_load_positioning), .flags = UPDATE_BUILTIN_SCRIPTS},
     {"load-commands", OPT_BOOL(lua_load_commands), .flags = UPDATE_BUILTIN_SCRIPTS},
     {"load-context-menu", OPT_BOOL(lua_load_context_menu), .flags = UPDATE_BUILTIN_SCRIPTS},
+    {"builtin-scripts-on-demand", OPT_BOOL(builtin_scripts_on_demand),
+        .flags = UPDATE_BUILTIN_SCRIPTS},
 #endif
 
 // ------------------------- stream options --------------------
@@ -612,6 +623,7 @@ static const m_option_t mp_opts[] = {
         M_RANGE(0, INT_MAX)},
 
     {"pause", OPT_BOOL(pause)},
+    {"pause-sleep", OPT_BOOL(pause_sleep)},
     {"keep-open", OPT_CHOICE(keep_open,
         {"no", 0},
         {"yes", 1},
@@ -662,6 +674,8 @@ static const m_option_t mp_opts[] = {
     {"demuxer-termination-timeout", OPT_DOUBLE(demux_termination_timeout)},
     {"demuxer-cache-wait", OPT_BOOL(demuxer_cache_wait)},
     {"prefetch-playlist", OPT_BOOL(prefetch_open)},
+    {"prefetch-playlist-decoders", OPT_BOOL(prefetch_decoders)},
+    {"shared-source", OPT_BOOL(shared_source)},
     {"cache-pause", OPT_BOOL(cache_pause)},
     {"cache-pause-initial", OPT_BOOL(cache_pause_initial)},
     {"cache-pause-wait", OPT_FLOAT(cache_pause_wait), M_RANGE(0, FLT_MAX)},
@@ -670,6 +684,8 @@ static const m_option_t mp_opts[] = {
     {"dvbin", OPT_SUBSTRUCT(stream_dvb_opts, stream_dvb_conf)},
 #endif
     {"", OPT_SUBSTRUCT(stream_lavf_opts, stream_lavf_conf)},
+    {"", OPT_SUBSTRUCT(stream_file_opts, stream_file_conf)},
+    {"", OPT_SUBSTRUCT(stream_mirror_opts, stream_mirror_conf)},
 
 // ------------------------- a-v sync options --------------------
 
@@ -692,6 +708,7 @@ static const m_option_t mp_opts[] = {
 
     {"af", OPT_SETTINGSLIST(af_settings, &af_obj_list)},
     {"vf", OPT_SETTINGSLIST(vf_settings, &vf_obj_list)},
+    {"filter-threads", OPT_INT(filter_threads), M_RANGE(1, 16)},
 
     {"", OPT_SUBSTRUCT(filter_opts, filter_conf)},
 
@@ -767,6 +784,7 @@ static const m_option_t mp_opts[] = {
     {"volume-gain", OPT_FLOAT(softvol_gain), .flags = UPDATE_VOL,
         M_RANGE(-150, 150)},
     {"mute", OPT_BOOL(softvol_mute), .flags = UPDATE_VOL},
+    {"volume-clip", OPT_BOOL(softvol_clip), .flags = UPDATE_VOL},
     {"replaygain", OPT_CHOICE(rgain_mode,
         {"no", 0},
         {"track", 1},
@@ -781,6 +799,10 @@ static const m_option_t mp_opts[] = {
         {"no", 0},
         {"yes", 1},
         {"weak", -1})},
+    {"gapless-audio-handover", OPT_BOOL(gapless_audio_handover)},
+    {"audio-waveform", OPT_BOOL(audio_waveform)},
+    {"audio-waveform-interval", OPT_DOUBLE(audio_waveform_interval),
+        M_RANGE(0.001, 10)},
 
     {"title", OPT_STRING(wintitle)},
     {"force-media-title", OPT_STRING(media_title)},
@@ -844,6 +866,7 @@ static const m_option_t mp_opts[] = {
     {"watch-later-dir", OPT_STRING(watch_later_dir),
         .flags = M_OPT_FILE},
     {"watch-later-directory", OPT_ALIAS("watch-later-dir")},
+    {"watch-later-database", OPT_BOOL(watch_later_database)},
     {"watch-later-options", OPT_STRINGLIST(watch_later_options)},
 
     {"save-watch-history", OPT_BOOL(save_watch_history)},
@@ -913,11 +936,15 @@ static const m_option_t mp_opts[] = {
         .flags = M_OPT_FILE},
     {"screenshot-directory", OPT_ALIAS("screenshot-dir")},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-max-size", OPT_SIZE_BOX(screenshot_max_size)},
+    {"screenshot-queue", OPT_INT(screenshot_queue), M_RANGE(0, 64)},
 
     {"", OPT_SUBSTRUCT(resample_opts, resample_conf)},
 
     {"", OPT_SUBSTRUCT(input_opts, input_config)},
 
+    {"", OPT_SUBSTRUCT(client_opts, client_conf)},
+
     {"clipboard", OPT_SUBSTRUCT(clipboard_opts, clipboard_conf)},
 
     {"", OPT_SUBSTRUCT(vo, vo_sub_opts)},
@@ -997,6 +1024,8 @@ static const struct MPOpts mp_default_opts = {
     .softvol_gain_min = -96,
     .softvol_gain = 0,
     .gapless_audio = -1,
+    .gapless_audio_handover = true,
+    .audio_waveform_interval = 0.05,
     .wintitle = "${?media-title:${media-title}}${!media-title:No file} - mpv",
     .stop_screensaver = 1,
     .cursor_autohide_delay = 1000,
@@ -1065,6 +1094,7 @@ static const struct MPOpts mp_default_opts = {
     .subs_fallback_forced = 1,
     .audio_display = 1,
     .audio_output_format = 0,  // AF_FORMAT_UNKNOWN
+    .filter_threads = 1,
     .playback_speed = 1.,
     .playback_pitch = 1.,
     .pitch_correction = true,
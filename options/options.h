@@ -89,6 +89,7 @@ typedef struct mp_vo_opts {
     struct m_geometry d3d11_composition_size;
 
     int swapchain_depth;  // max number of images to render ahead
+    bool late_latching;
 
     struct m_geometry video_crop;
 } mp_vo_opts;
@@ -133,6 +134,7 @@ struct mp_subtitle_opts {
     bool sub_past_video_end;
     int sub_glyph_limit;
     int sub_bitmap_max_size;
+    bool sub_render_ahead;
     char **sub_avopts;
 };
 
@@ -161,6 +163,7 @@ struct mp_osd_render_opts {
 struct mp_bluray_opts {
     char *bluray_device;
     int angle;
+    int64_t readahead_size;
 };
 
 typedef struct MPOpts {
@@ -180,6 +183,7 @@ typedef struct MPOpts {
     char **reset_options;
     char **script_files;
     char **script_opts;
+    int script_threads;
     bool js_memory_report;
     bool lua_load_osc;
     bool lua_load_ytdl;
@@ -192,6 +196,7 @@ typedef struct MPOpts {
     bool lua_load_positioning;
     bool lua_load_commands;
     bool lua_load_context_menu;
+    bool builtin_scripts_on_demand;
 
     bool auto_load_scripts;
 
@@ -208,9 +213,13 @@ typedef struct MPOpts {
     bool softvol_mute;
     float softvol_max;
     float softvol_gain;
+    bool softvol_clip;
     float softvol_gain_min;
     float softvol_gain_max;
     int gapless_audio;
+    bool gapless_audio_handover;
+    bool audio_waveform;
+    double audio_waveform_interval;
 
     mp_vo_opts *vo;
     struct ao_opts *ao_opts;
@@ -295,10 +304,12 @@ typedef struct MPOpts {
     bool write_filename_in_watch_later_config;
     bool ignore_path_in_watch_later_config;
     char *watch_later_dir;
+    bool watch_later_database;
     char **watch_later_options;
     bool save_watch_history;
     char *watch_history_path;
     bool pause;
+    bool pause_sleep;
     int keep_open;
     bool keep_open_pause;
     double image_display_duration;
@@ -319,6 +330,8 @@ typedef struct MPOpts {
     double demux_termination_timeout;
     bool demuxer_cache_wait;
     bool prefetch_open;
+    bool prefetch_decoders;
+    bool shared_source;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -330,6 +343,8 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_dir;
     bool screenshot_sw;
+    struct m_geometry screenshot_max_size;
+    int screenshot_queue;
 
     struct m_channels audio_output_channels;
     int audio_output_format;
@@ -339,6 +354,7 @@ typedef struct MPOpts {
     bool pitch_correction;
     struct m_obj_settings *vf_settings;
     struct m_obj_settings *af_settings;
+    int filter_threads;
     struct filter_opts *filter_opts;
     struct dec_wrapper_opts *dec_wrapper;
     char **sub_name;
@@ -367,6 +383,8 @@ typedef struct MPOpts {
     struct cdda_opts *stream_cdda_opts;
     struct dvb_opts *stream_dvb_opts;
     struct lavf_opts *stream_lavf_opts;
+    struct stream_file_opts *stream_file_opts;
+    struct stream_mirror_opts *stream_mirror_opts;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
@@ -388,6 +406,8 @@ typedef struct MPOpts {
 
     struct input_opts *input_opts;
 
+    struct client_opts *client_opts;
+
     struct clipboard_opts *clipboard_opts;
 
     struct encode_opts *encode_opts;
@@ -427,6 +447,8 @@ struct cuda_opts {
 struct filter_opts {
     int deinterlace;
     int field_parity;
+    double stage_threshold;
+    bool lavfi_spare_graph;
 };
 
 extern const struct m_sub_options vo_sub_opts;
@@ -20,8 +20,10 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/stat.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #include "parse_configfile.h"
 #include "common/common.h"
@@ -31,6 +33,98 @@
 #include "m_config.h"
 #include "stream/stream.h"
 
+// Process-wide cache of parsed config files, so that creating many players
+// doesn't read and check the same files over and over. Only files that
+// parsed without errors into the toplevel player config are cached, which
+// means every option in them is known to pass the option check.
+#define MAX_CACHED_FILES 16
+
+struct config_line {
+    char *profile;      // if set, this is a [profile] line
+    char *option;
+    char *value;        // NULL if there was no "="
+};
+
+struct cached_file {
+    int refs;           // protected by cache_lock
+    char *path;
+    int64_t mtime, size;
+    struct config_line *lines;
+    int num_lines;
+};
+
+static mp_static_mutex cache_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct cached_file *cache[MAX_CACHED_FILES]; // most recent first
+static int num_cache;
+
+static void unref_cached_file(struct cached_file *f)
+{
+    mp_mutex_lock(&cache_lock);
+    bool free_it = --f->refs == 0;
+    mp_mutex_unlock(&cache_lock);
+    if (free_it)
+        talloc_free(f);
+}
+
+static struct cached_file *lookup_cached_file(const char *path,
+                                              const struct stat *st)
+{
+    struct cached_file *res = NULL;
+    mp_mutex_lock(&cache_lock);
+    for (int n = 0; n < num_cache; n++) {
+        struct cached_file *f = cache[n];
+        if (strcmp(f->path, path) == 0 && f->mtime == st->st_mtime &&
+            f->size == st->st_size)
+        {
+            f->refs++;
+            res = f;
+            break;
+        }
+    }
+    mp_mutex_unlock(&cache_lock);
+    return res;
+}
+
+// Takes over the caller's reference.
+static void add_cached_file(struct cached_file *f)
+{
+    struct cached_file *drop[MAX_CACHED_FILES];
+    int num_drop = 0;
+    mp_mutex_lock(&cache_lock);
+    for (int n = num_cache - 1; n >= 0; n--) {
+        if (strcmp(cache[n]->path, f->path) == 0 || num_cache == MAX_CACHED_FILES) {
+            if (--cache[n]->refs == 0)
+                drop[num_drop++] = cache[n];
+            memmove(&cache[n], &cache[n + 1], (num_cache - n - 1) * sizeof(cache[0]));
+            num_cache--;
+        }
+    }
+    memmove(&cache[1], &cache[0], num_cache * sizeof(cache[0]));
+    cache[0] = f;
+    num_cache++;
+    mp_mutex_unlock(&cache_lock);
+    for (int n = 0; n < num_drop; n++)
+        talloc_free(drop[n]);
+}
+
+static void apply_cached_file(m_config_t *config, struct cached_file *f,
+                              char *initial_section, int flags)
+{
+    m_profile_t *profile = m_config_add_profile(config, initial_section);
+    for (int n = 0; n < f->num_lines; n++) {
+        struct config_line *l = &f->lines[n];
+        if (l->profile) {
+            profile = m_config_add_profile(config, l->profile);
+        } else {
+            m_config_set_profile_option(config, profile, bstr0(l->option),
+                                        bstr0(l->value), false);
+        }
+    }
+
+    if (config->recursion_depth == 0)
+        m_config_finish_default_profile(config, flags);
+}
+
 // Skip whitespace and comments (assuming there are no line breaks)
 static bool skip_ws(bstr *s)
 {
@@ -40,8 +134,11 @@ static bool skip_ws(bstr *s)
     return s->len;
 }
 
-int m_config_parse(m_config_t *config, const char *location, bstr data,
-                   char *initial_section, int flags)
+// Like m_config_parse(), but if record is not NULL, add the parsed lines to
+// it. Returns the number of errors.
+static int parse_config(m_config_t *config, const char *location, bstr data,
+                        char *initial_section, int flags,
+                        struct cached_file *record)
 {
     m_profile_t *profile = m_config_add_profile(config, initial_section);
     void *tmp = talloc_new(NULL);
@@ -75,6 +172,11 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
                 goto error;
             }
             profile = m_config_add_profile(config, bstrto0(tmp, profilename));
+            if (record) {
+                MP_TARRAY_APPEND(record, record->lines, record->num_lines,
+                                 (struct config_line){
+                                     .profile = bstrto0(record, profilename)});
+            }
             continue;
         }
 
@@ -126,12 +228,20 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
             goto error;
         }
 
-        int res = m_config_set_profile_option(config, profile, option, value);
+        int res = m_config_set_profile_option(config, profile, option, value,
+                                              true);
         if (res < 0) {
             MP_ERR(config, "%s setting option %.*s='%.*s' failed.\n",
                    loc, BSTR_P(option), BSTR_P(value));
             goto error;
         }
+        if (record) {
+            MP_TARRAY_APPEND(record, record->lines, record->num_lines,
+                             (struct config_line){
+                                 .option = bstrto0(record, option),
+                                 .value = value.start ? bstrto0(record, value)
+                                                      : NULL});
+        }
 
         ok = true;
     error:
@@ -147,6 +257,13 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
         m_config_finish_default_profile(config, flags);
 
     talloc_free(tmp);
+    return errors;
+}
+
+int m_config_parse(m_config_t *config, const char *location, bstr data,
+                   char *initial_section, int flags)
+{
+    parse_config(config, location, data, initial_section, flags, NULL);
     return 1;
 }
 
@@ -165,10 +282,40 @@ int m_config_parse_config_file(m_config_t *config, struct mpv_global *global,
 
     int r = 0;
 
+    struct stat st;
+    bool cacheable = config->is_toplevel && !stat(conffile, &st) &&
+                     S_ISREG(st.st_mode);
+    struct cached_file *cached = cacheable ? lookup_cached_file(conffile, &st)
+                                           : NULL;
+    if (cached) {
+        MP_DBG(config, "Using cached parse of %s\n", conffile);
+        apply_cached_file(config, cached, initial_section, flags);
+        unref_cached_file(cached);
+        return 1;
+    }
+
     bstr data = stream_read_file2(conffile, NULL, STREAM_ORIGIN_DIRECT | STREAM_READ,
                                   global, 1000000000);
-    if (data.start)
-        r = m_config_parse(config, conffile, data, initial_section, flags);
+    if (data.start) {
+        struct cached_file *record = NULL;
+        if (cacheable) {
+            record = talloc_ptrtype(NULL, record);
+            *record = (struct cached_file){
+                .refs = 1,
+                .path = talloc_strdup(record, conffile),
+                .mtime = st.st_mtime,
+                .size = st.st_size,
+            };
+        }
+        int errors = parse_config(config, conffile, data, initial_section,
+                                  flags, record);
+        if (record && !errors) {
+            add_cached_file(record);
+        } else {
+            talloc_free(record);
+        }
+        r = 1;
+    }
 
     talloc_free(data.start);
     return r;
@@ -32,10 +32,12 @@
 
 #include "audio/format.h"
 #include "audio/out/ao.h"
+#include "audio/waveform.h"
 #include "demux/demux.h"
 #include "filters/f_async_queue.h"
 #include "filters/f_decoder_wrapper.h"
 #include "filters/filter_internal.h"
+#include "preload.h"
 
 #include "core.h"
 #include "command.h"
@@ -191,6 +193,7 @@ void audio_update_volume(struct MPContext *mpctx)
 
     float gain = audio_get_gain(mpctx);
     ao_set_gain(ao_c->ao, gain);
+    ao_set_clip(ao_c->ao, mpctx->opts->softvol_clip);
 }
 
 // Call this if opts->playback_speed or mpctx->speed_factor_* change.
@@ -240,6 +243,24 @@ void reset_audio_state(struct MPContext *mpctx)
     mpctx->logged_async_diff = -1;
 }
 
+static bool old_audio_is_playing(struct MPContext *mpctx, struct ao *ao)
+{
+    // Note: with gapless_audio, stop_play is not correctly set
+    return (mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE) &&
+           ao_is_playing(ao) && !get_internal_paused(mpctx);
+}
+
+static void close_ao(struct MPContext *mpctx, struct ao *ao)
+{
+    if (old_audio_is_playing(mpctx, ao)) {
+        MP_VERBOSE(mpctx, "draining left over audio\n");
+        ao_drain(ao);
+    }
+    ao_uninit(ao);
+
+    mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
+}
+
 void uninit_audio_out(struct MPContext *mpctx)
 {
     struct ao_chain *ao_c = mpctx->ao_chain;
@@ -248,18 +269,8 @@ void uninit_audio_out(struct MPContext *mpctx)
         TA_FREEP(&ao_c->queue_filter);
         ao_c->ao = NULL;
     }
-    if (mpctx->ao) {
-        // Note: with gapless_audio, stop_play is not correctly set
-        if ((mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE) &&
-            ao_is_playing(mpctx->ao) && !get_internal_paused(mpctx))
-        {
-            MP_VERBOSE(mpctx, "draining left over audio\n");
-            ao_drain(mpctx->ao);
-        }
-        ao_uninit(mpctx->ao);
-
-        mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
-    }
+    if (mpctx->ao)
+        close_ao(mpctx, mpctx->ao);
     mpctx->ao = NULL;
     TA_FREEP(&mpctx->ao_filter_fmt);
 }
@@ -281,6 +292,7 @@ static void ao_chain_uninit(struct ao_chain *ao_c)
 
     talloc_free(ao_c->filter->f);
     talloc_free(ao_c->ao_filter);
+    talloc_free(ao_c->waveform_filter);
     talloc_free(ao_c);
 }
 
@@ -408,6 +420,17 @@ static int reinit_audio_filters_and_output(struct MPContext *mpctx)
         return 0;
     }
 
+    // Open the new AO while the old one still plays the end of the previous
+    // file, so that the time it takes to open the device isn't added to the
+    // gap between the files.
+    struct ao *old_ao = NULL;
+    if (opts->gapless_audio_handover && mpctx->ao && !mpctx->encode_lavc_ctx &&
+        !opts->audio_exclusive && old_audio_is_playing(mpctx, mpctx->ao))
+    {
+        old_ao = mpctx->ao;
+        mpctx->ao = NULL;
+    }
+
     uninit_audio_out(mpctx);
 
     int out_rate = mp_aframe_get_rate(out_fmt);
@@ -447,6 +470,23 @@ static int reinit_audio_filters_and_output(struct MPContext *mpctx)
                              mpctx, mpctx->encode_lavc_ctx, out_rate,
                              out_format, out_channels);
 
+    if (old_ao) {
+        // If the device can't be opened twice, ao_init_best() falls back to
+        // another AO. Close the old AO first and retry in this case.
+        if (!mpctx->ao || strcmp(ao_get_name(mpctx->ao), ao_get_name(old_ao))) {
+            MP_VERBOSE(mpctx, "Could not open the audio device while the old "
+                       "one is playing.\n");
+            if (mpctx->ao)
+                ao_uninit(mpctx->ao);
+            close_ao(mpctx, old_ao);
+            mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_core_cb,
+                                     mpctx, mpctx->encode_lavc_ctx, out_rate,
+                                     out_format, out_channels);
+        } else {
+            close_ao(mpctx, old_ao);
+        }
+    }
+
     int ao_rate = 0;
     int ao_format = 0;
     struct mp_chmap ao_channels = {0};
@@ -523,6 +563,25 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     if (!track->stream)
         goto init_error;
 
+    struct mp_preload_decoder *pd = mpctx->preload_adec;
+    if (pd && pd->stream == track->stream) {
+        if (track->ao_c && mp_decoder_wrapper_reparent(pd->dec,
+                                                       mpctx->filter_root,
+                                                       pd->first_frame))
+        {
+            MP_VERBOSE(mpctx, "Using prewarmed audio decoder.\n");
+            track->dec = pd->dec;
+            pd->dec = NULL;
+            pd->first_frame = MP_NO_FRAME;
+        }
+        // The discarded decoder took packets from the demuxer.
+        if (!track->dec)
+            issue_refresh_seek(mpctx, MPSEEK_EXACT);
+    }
+    TA_FREEP(&mpctx->preload_adec);
+    if (track->dec)
+        return 1;
+
     track->dec = mp_decoder_wrapper_create(mpctx->filter_root, track->stream);
     if (!track->dec)
         goto init_error;
@@ -561,6 +620,59 @@ static const struct mp_filter_info ao_filter = {
     .process = ao_process,
 };
 
+// Passes through decoded audio, and feeds it to ao_c->waveform.
+static void waveform_process(struct mp_filter *f)
+{
+    struct ao_chain *ao_c = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    bool filled = false;
+    if (frame.type == MP_FRAME_AUDIO) {
+        filled = mp_waveform_add(ao_c->waveform, frame.data);
+    } else if (frame.type == MP_FRAME_EOF) {
+        filled = mp_waveform_finish(ao_c->waveform);
+    }
+    if (filled)
+        mp_notify_property(ao_c->mpctx, "audio-waveform");
+    mp_pin_in_write(f->ppins[1], frame);
+}
+
+static void waveform_reset(struct mp_filter *f)
+{
+    struct ao_chain *ao_c = f->priv;
+
+    mp_waveform_reset(ao_c->waveform);
+}
+
+static const struct mp_filter_info waveform_filter = {
+    .name = "waveform",
+    .process = waveform_process,
+    .reset = waveform_reset,
+};
+
+// Insert the waveform analysis between the decoder and the filter chain.
+static struct mp_pin *create_waveform_filter(struct ao_chain *ao_c,
+                                             struct mp_pin *src)
+{
+    struct MPContext *mpctx = ao_c->mpctx;
+
+    ao_c->waveform_filter = mp_filter_create(mpctx->filter_root,
+                                             &waveform_filter);
+    if (!ao_c->waveform_filter)
+        return src;
+    ao_c->waveform_filter->priv = ao_c;
+    ao_c->waveform = mp_waveform_create(ao_c->waveform_filter,
+                                        mpctx->opts->audio_waveform_interval);
+
+    mp_filter_add_pin(ao_c->waveform_filter, MP_PIN_IN, "in");
+    mp_filter_add_pin(ao_c->waveform_filter, MP_PIN_OUT, "out");
+    mp_pin_connect(ao_c->waveform_filter->pins[0], src);
+    return ao_c->waveform_filter->pins[1];
+}
+
 // (track=NULL creates a blank chain, used for lavfi-complex)
 void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track)
 {
@@ -592,7 +704,10 @@ void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track)
         if (!init_audio_decoder(mpctx, track))
             goto init_error;
         ao_c->dec_src = track->dec->f->pins[0];
-        mp_pin_connect(ao_c->filter->f->pins[0], ao_c->dec_src);
+        struct mp_pin *src = ao_c->dec_src;
+        if (mpctx->opts->audio_waveform)
+            src = create_waveform_filter(ao_c, src);
+        mp_pin_connect(ao_c->filter->f->pins[0], src);
     }
 
     reset_audio_state(mpctx);
@@ -59,6 +59,26 @@
  *
  */
 
+#define OPT_BASE_STRUCT struct client_opts
+struct client_opts {
+    int event_queue_size;
+};
+
+const struct m_sub_options client_conf = {
+    .opts = (const struct m_option[]) {
+        {"client-event-queue-size", OPT_INT(event_queue_size),
+            M_RANGE(16, 1000000)},
+        {0}
+    },
+    .size = sizeof(struct client_opts),
+    .defaults = &(const struct client_opts){
+        .event_queue_size = 1000,
+    },
+};
+
+// Initial number of allocated entries in mpv_handle.events.
+#define MIN_EVENTS 16
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -89,6 +109,7 @@ struct observe_property {
     char *name;
     int id;                 // ==mp_get_property_id(name)
     uint64_t event_mask;    // ==mp_get_property_event_mask(name)
+    struct m_property_ref ref; // ref.prop is NULL if the property is unknown
     int64_t reply_id;
     mpv_format format;
     const struct m_option *type;
@@ -132,11 +153,18 @@ struct mpv_handle {
     uint64_t event_mask;
     bool queued_wakeup;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
+    mpv_event *events;      // ringbuffer of alloc_events entries
+    int64_t *event_times;   // mp_time_ns() at which events[n] was queued
+    int alloc_events;       // allocated number of entries in events
+    int max_events;         // maximum number of entries (queue size limit)
     int first_event;        // events[first_event] is the first readable event
     int num_events;         // number of readable events
     int reserved_events;    // number of entries reserved for replies
+    int peak_events;        // maximum of num_events + reserved_events so far
+    uint64_t dropped_events; // events lost due to queue overflow
+    uint64_t overflows;     // number of times the queue overflowed
+    uint64_t delivered_events; // events returned by mpv_wait_event()
+    int64_t event_latency;  // sum of time from queuing to returning events
     size_t async_counter;   // pending other async events
     bool choked;            // recovering from queue overflow
     bool destroying;        // pending destruction; no API accesses allowed
@@ -257,8 +285,45 @@ bool mp_client_id_exists(struct MPContext *mpctx, int64_t id)
     return r;
 }
 
+void mp_client_get_event_queue_stats(struct MPContext *mpctx,
+                                     struct mpv_node *dst)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    mp_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *ctx = clients->clients[n];
+        struct mpv_node *entry = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+
+        mp_mutex_lock(&ctx->lock);
+        node_map_add_string(entry, "name", ctx->name);
+        node_map_add_int64(entry, "id", ctx->id);
+        node_map_add_int64(entry, "queued", ctx->num_events);
+        node_map_add_int64(entry, "reserved", ctx->reserved_events);
+        node_map_add_int64(entry, "peak", ctx->peak_events);
+        node_map_add_int64(entry, "allocated", ctx->alloc_events);
+        node_map_add_int64(entry, "limit", ctx->max_events);
+        node_map_add_int64(entry, "dropped", ctx->dropped_events);
+        node_map_add_int64(entry, "overflows", ctx->overflows);
+        node_map_add_int64(entry, "delivered", ctx->delivered_events);
+        if (ctx->delivered_events) {
+            node_map_add_double(entry, "avg-latency",
+                MP_TIME_NS_TO_S(ctx->event_latency) / ctx->delivered_events);
+        }
+        mp_mutex_unlock(&ctx->lock);
+    }
+    mp_mutex_unlock(&clients->lock);
+}
+
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name)
 {
+    struct client_opts *opts =
+        mp_get_config_group(NULL, clients->mpctx->global, &client_conf);
+    int num_events = opts->event_queue_size;
+    talloc_free(opts);
+
     mp_mutex_lock(&clients->lock);
 
     char nname[MAX_CLIENT_NAME];
@@ -280,8 +345,6 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         return NULL;
     }
 
-    int num_events = 1000;
-
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
     *client = (struct mpv_handle){
         .log = mp_log_new(client, clients->mpctx->log, nname),
@@ -289,7 +352,9 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .clients = clients,
         .id = ++(clients->id_alloc),
         .cur_event = talloc_zero(client, struct mpv_event),
-        .events = talloc_array(client, mpv_event, num_events),
+        .events = talloc_array(client, mpv_event, MIN_EVENTS),
+        .event_times = talloc_array(client, int64_t, MIN_EVENTS),
+        .alloc_events = MIN_EVENTS,
         .max_events = num_events,
         .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
         .wakeup_pipe = {-1, -1},
@@ -466,7 +531,7 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
             while (ctx->num_events) {
                 talloc_free(ctx->events[ctx->first_event].data);
-                ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
+                ctx->first_event = (ctx->first_event + 1) % ctx->alloc_events;
                 ctx->num_events--;
             }
             mp_msg_log_buffer_destroy(ctx->messages);
@@ -581,6 +646,8 @@ void mp_shutdown_clients(struct MPContext *mpctx)
         }
 
         mp_client_broadcast_event(mpctx, MPV_EVENT_SHUTDOWN, NULL);
+        // The wakeup callbacks were cleared above.
+        mp_script_host_wakeup(mpctx);
         mp_wait_events(mpctx);
 
         mp_mutex_lock(&clients->lock);
@@ -701,6 +768,13 @@ static void dup_event_data(struct mpv_event *ev)
     case MPV_EVENT_END_FILE:
         ev->data = talloc_memdup(NULL, ev->data, sizeof(mpv_event_end_file));
         break;
+    case MPV_EVENT_SCREENSHOT_WRITTEN: {
+        struct mpv_event_screenshot *shot =
+            talloc_memdup(NULL, ev->data, sizeof(mpv_event_screenshot));
+        shot->filename = talloc_strdup(shot, shot->filename);
+        ev->data = shot;
+        break;
+    }
     default:
         // Doesn't use events with memory allocation.
         if (ev->data)
@@ -708,6 +782,36 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Make sure the ring buffer has space for one more entry, growing it if
+// needed. Returns false if the queue size limit is reached.
+static bool make_event_space(struct mpv_handle *ctx)
+{
+    int used = ctx->num_events + ctx->reserved_events;
+    if (used >= ctx->max_events)
+        return false;
+    ctx->peak_events = MPMAX(ctx->peak_events, used + 1);
+    if (used < ctx->alloc_events)
+        return true;
+
+    int old_alloc = ctx->alloc_events;
+    int new_alloc = MPMIN(old_alloc * 2, ctx->max_events);
+    ctx->events = talloc_realloc(ctx, ctx->events, mpv_event, new_alloc);
+    ctx->event_times = talloc_realloc(ctx, ctx->event_times, int64_t, new_alloc);
+    // Move the entries between first_event and the old end to the new end,
+    // so the rest of the ring (which wraps around) stays in place.
+    if (ctx->first_event + ctx->num_events > old_alloc) {
+        int n = old_alloc - ctx->first_event;
+        int first = new_alloc - n;
+        memmove(&ctx->events[first], &ctx->events[ctx->first_event],
+                n * sizeof(ctx->events[0]));
+        memmove(&ctx->event_times[first], &ctx->event_times[ctx->first_event],
+                n * sizeof(ctx->event_times[0]));
+        ctx->first_event = first;
+    }
+    ctx->alloc_events = new_alloc;
+    return true;
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
@@ -716,8 +820,7 @@ static int reserve_reply(struct mpv_handle *ctx)
 {
     int res = MPV_ERROR_EVENT_QUEUE_FULL;
     mp_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
+    if (!ctx->choked && make_event_space(ctx)) {
         ctx->reserved_events++;
         res = 0;
     }
@@ -725,15 +828,23 @@ static int reserve_reply(struct mpv_handle *ctx)
     return res;
 }
 
+// Like append_event(), for an entry reserved with reserve_reply().
+static void append_reserved_event(struct mpv_handle *ctx, struct mpv_event event)
+{
+    int pos = (ctx->first_event + ctx->num_events) % ctx->alloc_events;
+    ctx->events[pos] = event;
+    ctx->event_times[pos] = mp_time_ns();
+    ctx->num_events++;
+    wakeup_client(ctx);
+}
+
 static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
+    if (!make_event_space(ctx))
         return -1;
     if (copy)
         dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
-    wakeup_client(ctx);
+    append_reserved_event(ctx, event);
     if (event.event_id == MPV_EVENT_SHUTDOWN)
         ctx->event_mask &= ctx->event_mask & ~(1ULL << MPV_EVENT_SHUTDOWN);
     return 0;
@@ -749,12 +860,15 @@ static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy
     if (!(ctx->event_mask & mask)) {
         r = 0;
     } else if (ctx->choked) {
+        ctx->dropped_events++;
         r = -1;
     } else {
         r = append_event(ctx, *event, copy);
         if (r < 0) {
             MP_ERR(ctx, "Too many events queued.\n");
             ctx->choked = true;
+            ctx->dropped_events++;
+            ctx->overflows++;
         }
     }
     mp_mutex_unlock(&ctx->lock);
@@ -771,8 +885,7 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
     // If this fails, reserve_reply() probably wasn't called.
     mp_assert(ctx->reserved_events > 0);
     ctx->reserved_events--;
-    if (append_event(ctx, *event, false) < 0)
-        MP_ASSERT_UNREACHABLE();
+    append_reserved_event(ctx, *event);
     mp_mutex_unlock(&ctx->lock);
 }
 
@@ -946,7 +1059,9 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         }
         if (ev) {
             *event = *ev;
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
+            ctx->delivered_events++;
+            ctx->event_latency += mp_time_ns() - ctx->event_times[ctx->first_event];
+            ctx->first_event = (ctx->first_event + 1) % ctx->alloc_events;
             ctx->num_events--;
             talloc_steal(event, event->data);
             break;
@@ -1153,6 +1268,54 @@ static int run_client_command(mpv_handle *ctx, struct mp_cmd *cmd, mpv_node *res
     return req.status;
 }
 
+void mp_client_command_list(mpv_handle *ctx, int num, mpv_node *cmds,
+                            mpv_node *results, int *errors)
+{
+    bool locked = false;
+    for (int n = 0; n < num; n++) {
+        results[n] = (mpv_node){.format = MPV_FORMAT_NONE};
+        struct mp_cmd *cmd = mp_input_parse_cmd_node(ctx->log, &cmds[n]);
+        if (!cmd || !ctx->mpctx->initialized) {
+            errors[n] = cmd ? MPV_ERROR_UNINITIALIZED : MPV_ERROR_INVALID_PARAMETER;
+            talloc_free(cmd);
+            continue;
+        }
+
+        cmd->sender = ctx->name;
+
+        struct cmd_request req = {
+            .mpctx = ctx->mpctx,
+            .cmd = cmd,
+            .res = &results[n],
+            .completion = MP_WAITER_INITIALIZER,
+        };
+
+        if (!locked)
+            lock_core(ctx);
+        locked = true;
+        if (cmd->flags & MP_ASYNC_CMD) {
+            run_command(ctx->mpctx, cmd, NULL, NULL, NULL);
+        } else {
+            struct mp_abort_entry *abort = NULL;
+            if (cmd->def->can_abort) {
+                abort = talloc_zero(NULL, struct mp_abort_entry);
+                abort->client = ctx;
+            }
+            run_command(ctx->mpctx, cmd, abort, cmd_complete, &req);
+            // Commands which don't complete immediately run outside of the
+            // lock, like with mpv_command_node().
+            if (!mp_waiter_poll(&req.completion)) {
+                unlock_core(ctx);
+                locked = false;
+            }
+            mp_waiter_wait(&req.completion);
+        }
+        errors[n] = req.status;
+    }
+    if (locked)
+        unlock_core(ctx);
+}
+
 int mpv_command(mpv_handle *ctx, const char **args)
 {
     return run_client_command(ctx, mp_input_parse_cmd_strv(ctx->log, args), NULL);
@@ -1392,6 +1555,7 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_ref *ref; // if set, used instead of name
     mpv_format format;
     void *data;
     int status;
@@ -1406,6 +1570,13 @@ static void free_prop_data(void *ptr)
     m_option_free(type, prop->data);
 }
 
+static int get_property(struct getproperty_request *req, int action, void *arg)
+{
+    if (req->ref)
+        return mp_property_do_ref(req->ref, action, arg, req->mpctx);
+    return mp_property_do(req->name, action, arg, req->mpctx);
+}
+
 static void getproperty_fn(void *arg)
 {
     struct getproperty_request *req = arg;
@@ -1417,11 +1588,11 @@ static void getproperty_fn(void *arg)
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = get_property(req, M_PROPERTY_PRINT, data);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = get_property(req, M_PROPERTY_GET_STRING, &s);
         if (err == M_PROPERTY_OK)
             *(char **)data = s;
         break;
@@ -1431,13 +1602,12 @@ static void getproperty_fn(void *arg)
     case MPV_FORMAT_INT64:
     case MPV_FORMAT_DOUBLE: {
         struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
+        err = get_property(req, M_PROPERTY_GET_NODE, &node);
         if (err == M_PROPERTY_NOT_IMPLEMENTED) {
             // Go through explicit string conversion. Same reasoning as on the
             // GET code path.
             char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
+            err = get_property(req, M_PROPERTY_GET_STRING, &s);
             if (err != M_PROPERTY_OK)
                 break;
             node.format = MPV_FORMAT_STRING;
@@ -1480,8 +1650,9 @@ static void getproperty_fn(void *arg)
     }
 }
 
-int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
-                     void *data)
+static int get_property_sync(mpv_handle *ctx, const char *name,
+                             const struct m_property_ref *ref,
+                             mpv_format format, void *data)
 {
     if (!ctx->mpctx->initialized)
         return MPV_ERROR_UNINITIALIZED;
@@ -1493,6 +1664,7 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     struct getproperty_request req = {
         .mpctx = ctx->mpctx,
         .name = name,
+        .ref = ref,
         .format = format,
         .data = data,
     };
@@ -1500,6 +1672,35 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     return req.status;
 }
 
+int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
+                     void *data)
+{
+    return get_property_sync(ctx, name, NULL, format, data);
+}
+
+struct mpv_property_ref {
+    struct MPContext *mpctx;
+    struct m_property_ref ref;
+};
+
+mpv_property_ref *mpv_resolve_property(mpv_handle *ctx, const char *name)
+{
+    struct mpv_property_ref *ref = talloc_zero(NULL, struct mpv_property_ref);
+    ref->mpctx = ctx->mpctx;
+    // The property list is fixed after init, so this needs no locking.
+    if (!mp_property_resolve(ctx->mpctx, talloc_strdup(ref, name), &ref->ref))
+        TA_FREEP(&ref);
+    return ref;
+}
+
+int mpv_get_property_ref(mpv_handle *ctx, mpv_property_ref *ref,
+                         mpv_format format, void *data)
+{
+    if (!ref || ref->mpctx != ctx->mpctx)
+        return MPV_ERROR_INVALID_PARAMETER;
+    return get_property_sync(ctx, NULL, &ref->ref, format, data);
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -1572,6 +1773,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .value = m_option_value_default,
         .value_ret = m_option_value_default,
     };
+    mp_property_resolve(ctx->mpctx, prop->name, &prop->ref);
     ctx->properties_change_ts += 1;
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
     ctx->property_event_masks |= prop->event_mask;
@@ -1677,8 +1879,67 @@ static void notify_property_events(struct mpv_handle *ctx, int event)
         mp_dispatch_adjust_timeout(ctx->mpctx->dispatch, 0);
 }
 
+// Values read during one mp_client_send_property_changes() run. Clients often
+// observe the same properties (e.g. several scripts watching "time-pos"), and
+// this makes sure each of them is read only once per run.
+struct prop_read {
+    int id;
+    char *name;
+    mpv_format format;
+    const struct m_option *type;
+    int status;
+    union m_option_value value;
+};
+
+struct prop_read_cache {
+    struct prop_read *reads;
+    int num_reads;
+};
+
+static void prop_read_cache_free(struct prop_read_cache *cache)
+{
+    for (int n = 0; n < cache->num_reads; n++) {
+        struct prop_read *r = &cache->reads[n];
+        if (r->status >= 0)
+            m_option_free(r->type, &r->value);
+        talloc_free(r->name);
+    }
+    talloc_free(cache->reads);
+    *cache = (struct prop_read_cache){0};
+}
+
+static struct prop_read *find_prop_read(struct prop_read_cache *cache,
+                                        struct observe_property *prop)
+{
+    for (int n = 0; n < cache->num_reads; n++) {
+        struct prop_read *r = &cache->reads[n];
+        if (r->id == prop->id && r->format == prop->format &&
+            strcmp(r->name, prop->name) == 0)
+            return r;
+    }
+    return NULL;
+}
+
+static void add_prop_read(struct prop_read_cache *cache,
+                          struct observe_property *prop, int status,
+                          union m_option_value *val)
+{
+    struct prop_read r = {
+        .id = prop->id,
+        .name = talloc_strdup(NULL, prop->name),
+        .format = prop->format,
+        .type = prop->type,
+        .status = status,
+        .value = m_option_value_default,
+    };
+    if (status >= 0)
+        m_option_copy(prop->type, &r.value, val);
+    MP_TARRAY_APPEND(NULL, cache->reads, cache->num_reads, r);
+}
+
 // Call with ctx->lock held (only). May temporarily drop the lock.
-static void send_client_property_changes(struct mpv_handle *ctx)
+static void send_client_property_changes(struct mpv_handle *ctx,
+                                         struct prop_read_cache *cache)
 {
     uint64_t cur_ts = ctx->properties_change_ts;
 
@@ -1694,36 +1955,49 @@ static void send_client_property_changes(struct mpv_handle *ctx)
         if (prop->format) {
             const struct m_option *type = prop->type;
             union m_option_value val = m_option_value_default;
-            struct getproperty_request req = {
-                .mpctx = ctx->mpctx,
-                .name = prop->name,
-                .format = prop->format,
-                .data = &val,
-            };
+            int status;
 
-            // Temporarily unlock and read the property. The very important
-            // thing is that property getters can do whatever they want, _and_
-            // that they may wait on the client API user thread (if vo_libmpv
-            // or similar things are involved).
-            prop->refcount += 1; // keep prop alive (esp. prop->name)
-            ctx->async_counter += 1; // keep ctx alive
-            mp_mutex_unlock(&ctx->lock);
-            getproperty_fn(&req);
-            mp_mutex_lock(&ctx->lock);
-            ctx->async_counter -= 1;
-            prop_unref(prop);
-
-            // Set if observed properties was changed or something similar
-            // => start over, retry next time.
-            if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
-                m_option_free(type, &val);
-                mp_wakeup_core(ctx->mpctx);
-                ctx->has_pending_properties = true;
-                break;
+            struct prop_read *cached = find_prop_read(cache, prop);
+            if (cached) {
+                status = cached->status;
+                if (status >= 0)
+                    m_option_copy(type, &val, &cached->value);
+            } else {
+                struct getproperty_request req = {
+                    .mpctx = ctx->mpctx,
+                    .name = prop->name,
+                    .ref = prop->ref.prop ? &prop->ref : NULL,
+                    .format = prop->format,
+                    .data = &val,
+                };
+
+                // Temporarily unlock and read the property. The very important
+                // thing is that property getters can do whatever they want,
+                // _and_ that they may wait on the client API user thread (if
+                // vo_libmpv or similar things are involved).
+                prop->refcount += 1; // keep prop alive (esp. prop->name)
+                ctx->async_counter += 1; // keep ctx alive
+                mp_mutex_unlock(&ctx->lock);
+                getproperty_fn(&req);
+                mp_mutex_lock(&ctx->lock);
+                ctx->async_counter -= 1;
+                prop_unref(prop);
+
+                // Set if observed properties was changed or something similar
+                // => start over, retry next time.
+                if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
+                    m_option_free(type, &val);
+                    mp_wakeup_core(ctx->mpctx);
+                    ctx->has_pending_properties = true;
+                    break;
+                }
+                mp_assert(prop->refcount > 0);
+
+                status = req.status;
+                add_prop_read(cache, prop, status, &val);
             }
-            mp_assert(prop->refcount > 0);
 
-            bool val_valid = req.status >= 0;
+            bool val_valid = status >= 0;
             changed = prop->value_valid != val_valid;
             if (prop->value_valid && val_valid)
                 changed = !equal_mpv_value(&prop->value, &val, prop->format);
@@ -1766,6 +2040,8 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
 {
     struct mp_client_api *clients = mpctx->clients;
 
+    struct prop_read_cache cache = {0};
+
     mp_mutex_lock(&clients->lock);
     uint64_t cur_ts = clients->clients_list_change_ts;
 
@@ -1779,7 +2055,7 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
         }
         // Keep ctx->lock locked (unlock order does not matter).
         mp_mutex_unlock(&clients->lock);
-        send_client_property_changes(ctx);
+        send_client_property_changes(ctx, &cache);
         mp_mutex_unlock(&ctx->lock);
         mp_mutex_lock(&clients->lock);
         if (cur_ts != clients->clients_list_change_ts) {
@@ -1790,6 +2066,7 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
     }
 
     mp_mutex_unlock(&clients->lock);
+    prop_read_cache_free(&cache);
 }
 
 // Set ctx->cur_event to a generated property change event, if there is any
@@ -2067,6 +2344,15 @@ int mpv_event_to_node(mpv_node *dst, mpv_event *event)
         break;
     }
 
+    case MPV_EVENT_SCREENSHOT_WRITTEN: {
+        mpv_event_screenshot *shot = event->data;
+
+        node_map_add_string(dst, "filename", shot->filename);
+        if (shot->error < 0)
+            node_map_add_string(dst, "error", mpv_error_string(shot->error));
+        break;
+    }
+
     }
     return 0;
 }
@@ -2126,6 +2412,7 @@ static const char *const event_table[] = {
     [MPV_EVENT_PROPERTY_CHANGE] = "property-change",
     [MPV_EVENT_QUEUE_OVERFLOW] = "event-queue-overflow",
     [MPV_EVENT_HOOK] = "hook",
+    [MPV_EVENT_SCREENSHOT_WRITTEN] = "screenshot-written",
 };
 
 const char *mpv_event_name(mpv_event_id event)
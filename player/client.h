@@ -31,6 +31,12 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
 void mp_client_send_property_changes(struct MPContext *mpctx);
 
+// Set dst to a list with the event queue state of each client (for the
+// client-event-queues property).
+struct mpv_node;
+void mp_client_get_event_queue_stats(struct MPContext *mpctx,
+                                     struct mpv_node *dst);
+
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 void mp_client_set_weak(struct mpv_handle *ctx);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
@@ -39,8 +45,12 @@ struct mpv_global *mp_client_get_global(struct mpv_handle *ctx);
 void mp_client_broadcast_event_external(struct mp_client_api *api, int event,
                                         void *data);
 
-// m_option.c
-void *node_get_alloc(struct mpv_node *node);
+// Like mpv_command_node() on each of cmds[0..num-1] in order, but run all
+// commands that complete immediately under a single core lock. Sets
+// results[n] (free with mpv_free_node_contents()) and errors[n] for cmds[n].
+void mp_client_command_list(struct mpv_handle *ctx, int num,
+                            struct mpv_node *cmds, struct mpv_node *results,
+                            int *errors);
 
 // for vo_libmpv.c
 struct osd_state;
@@ -159,20 +159,45 @@ const char *mp_clipboard_get_backend_name(struct clipboard_ctx *cl)
     return cl ? cl->backend->name : NULL;
 }
 
+static void create_clipboard(struct MPContext *mpctx,
+                             struct clipboard_opts *opts)
+{
+    struct clipboard_init_params params = {
+        .mpctx = mpctx,
+        .backends = opts->backends,
+    };
+    params.flags |= opts->monitor ? CLIPBOARD_INIT_ENABLE_MONITORING : 0;
+    params.flags |= opts->xwayland ? CLIPBOARD_INIT_ENABLE_XWAYLAND : 0;
+    mpctx->clipboard = mp_clipboard_create(&params, mpctx->global);
+}
+
 void reinit_clipboard(struct MPContext *mpctx)
 {
     mp_clipboard_destroy(mpctx->clipboard);
     mpctx->clipboard = NULL;
+    mpctx->clipboard_pending = false;
 
     struct clipboard_opts *opts = mp_get_config_group(NULL, mpctx->global, &clipboard_conf);
     if (opts->backends && opts->backends[0].name) {
-        struct clipboard_init_params params = {
-            .mpctx = mpctx,
-            .backends = opts->backends,
-        };
-        params.flags |= opts->monitor ? CLIPBOARD_INIT_ENABLE_MONITORING : 0;
-        params.flags |= opts->xwayland ? CLIPBOARD_INIT_ENABLE_XWAYLAND : 0;
-        mpctx->clipboard = mp_clipboard_create(&params, mpctx->global);
+        // Backend init can be expensive (e.g. connecting to the display
+        // server), so defer it to the first access unless monitoring.
+        if (opts->monitor) {
+            create_clipboard(mpctx, opts);
+        } else {
+            mpctx->clipboard_pending = true;
+        }
     }
     talloc_free(opts);
 }
+
+struct clipboard_ctx *mp_get_clipboard(struct MPContext *mpctx)
+{
+    if (mpctx->clipboard_pending) {
+        mpctx->clipboard_pending = false;
+        struct clipboard_opts *opts =
+            mp_get_config_group(NULL, mpctx->global, &clipboard_conf);
+        create_clipboard(mpctx, opts);
+        talloc_free(opts);
+    }
+    return mpctx->clipboard;
+}
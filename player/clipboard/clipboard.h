@@ -95,3 +95,5 @@ int mp_clipboard_set_data(struct clipboard_ctx *cl, struct clipboard_access_para
 const char *mp_clipboard_get_backend_name(struct clipboard_ctx *cl);
 
 void reinit_clipboard(struct MPContext *mpctx);
+// Return mpctx->clipboard, creating it first if reinit_clipboard() deferred it.
+struct clipboard_ctx *mp_get_clipboard(struct MPContext *mpctx);
@@ -55,6 +55,7 @@
 #include "sub/osd_state.h"
 #include "stream/stream.h"
 #include "demux/demux.h"
+#include "demux/packet_pool.h"
 #include "demux/stheader.h"
 #include "common/playlist.h"
 #include "sub/dec_sub.h"
@@ -68,9 +69,11 @@
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/mp_image_pool.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
+#include "audio/waveform.h"
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
 #include "screenshot.h"
@@ -93,6 +96,7 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    struct m_property_index *prop_index;
 
     double last_seek_time;
     double last_seek_pts;
@@ -379,12 +383,9 @@ static int count_lines(char *text)
 // "text" might be returned as is, or it can be freed and a new allocation is
 // returned.
 // This is only a heuristic - we can't deal with line breaking.
-static char *cut_osd_list(struct MPContext *mpctx, char *header, char *text, int pos)
+// Number of list lines that fit on the OSD or terminal, including the header.
+static int get_osd_list_lines(struct MPContext *mpctx)
 {
-    int count = count_lines(text);
-    if (!count)
-        return text;
-
     int max_lines;
     if (mpctx->video_out && mpctx->opts->video_osd) {
         int screen_h, font_h;
@@ -398,11 +399,26 @@ static char *cut_osd_list(struct MPContext *mpctx, char *header, char *text, int
         max_lines -= msg[0] ? count_lines(msg) : 1;
         talloc_free(msg);
     }
+    return max_lines;
+}
+
+// First line to show of a list with count lines, so that line pos is centered.
+static int get_osd_list_start(int pos, int count, int max_lines)
+{
+    return MPMIN(MPMAX(pos - max_lines / 2, 0), count - max_lines);
+}
+
+static char *cut_osd_list(struct MPContext *mpctx, char *header, char *text, int pos)
+{
+    int count = count_lines(text);
+    if (!count)
+        return text;
+
     // Subtract 1 for the header.
-    max_lines--;
+    int max_lines = get_osd_list_lines(mpctx) - 1;
 
     char *new = talloc_asprintf(NULL, "%s [%d/%d]:\n", header, pos + 1, count);
-    int start = MPMIN(MPMAX(pos - max_lines / 2, 0), count - max_lines);
+    int start = get_osd_list_start(pos, count, max_lines);
     char *head = skip_n_lines(text, start);
     char *tail = skip_n_lines(head, max_lines);
     new = talloc_asprintf_append_buffer(new, "%.*s",
@@ -731,6 +747,22 @@ static int mp_property_frame_drop_dec(void *ctx, struct m_property *prop,
                              mp_decoder_wrapper_get_frames_dropped(dec));
 }
 
+static int mp_property_dec_queue_duration(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int type = *(int *)prop->priv;
+    struct track *track = mpctx->current_track[0][type];
+    struct mp_decoder_wrapper *dec = track ? track->dec : NULL;
+    if (!dec)
+        return M_PROPERTY_UNAVAILABLE;
+
+    double duration = mp_decoder_wrapper_get_queue_duration(dec);
+    if (duration < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, duration);
+}
+
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
                                             int action, void *arg)
 {
@@ -1450,6 +1482,47 @@ static int mp_property_seeking(void *ctx, struct m_property *prop,
     return m_property_bool_ro(action, arg, !mpctx->restart_complete);
 }
 
+// Times of the load/seek phases in seconds since the start, phases that were
+// not reached (yet) are left out.
+static int property_load_timing(struct mp_load_timing *t, int action, void *arg)
+{
+    if (!t->t[LOAD_PHASE_START])
+        return M_PROPERTY_UNAVAILABLE;
+
+    static const char *const names[LOAD_PHASE_COUNT] = {
+        [LOAD_PHASE_OPEN]           = "open",
+        [LOAD_PHASE_PROBE]          = "probe",
+        [LOAD_PHASE_DECODER_INIT]   = "decoder-init",
+        [LOAD_PHASE_FIRST_DECODE]   = "first-decode",
+        [LOAD_PHASE_FIRST_PRESENT]  = "first-present",
+    };
+    struct m_sub_property props[LOAD_PHASE_COUNT];
+    int num = 0;
+    for (int n = LOAD_PHASE_START + 1; n < LOAD_PHASE_COUNT; n++) {
+        props[num++] = (struct m_sub_property){
+            .name = names[n],
+            SUB_PROP_DOUBLE(MP_TIME_NS_TO_S(t->t[n] - t->t[LOAD_PHASE_START])),
+            .unavailable = !t->t[n],
+        };
+    }
+    props[num] = (struct m_sub_property){0};
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_load_timing(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    return property_load_timing(&mpctx->load_timing, action, arg);
+}
+
+static int mp_property_seek_timing(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    return property_load_timing(&mpctx->seek_timing, action, arg);
+}
+
 static int mp_property_playback_abort(void *ctx, struct m_property *prop,
                                       int action, void *arg)
 {
@@ -1521,6 +1594,19 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_bool_ro(action, arg, s.idle);
 }
 
+static int mp_property_demuxer_cache_gen(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct demux_reader_state s;
+    demux_get_reader_state(mpctx->demuxer, &s);
+
+    return m_property_int64_ro(action, arg, s.seek_ranges_gen);
+}
+
 static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
                                            int action, void *arg)
 {
@@ -1559,6 +1645,8 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
         node_map_add_int64(r, "file-cache-bytes", s.file_cache_bytes);
     if (s.bytes_per_second > 0)
         node_map_add_int64(r, "raw-input-rate", s.bytes_per_second);
+    if (s.stream_buffer_size > 0)
+        node_map_add_int64(r, "stream-buffer-size", s.stream_buffer_size);
     if (s.seeking != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-seeking", s.seeking);
     node_map_add_int64(r, "debug-low-level-seeks", s.low_level_seeks);
@@ -1587,6 +1675,7 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
 
     node_map_add_flag(r, "bof-cached", s.bof_cached);
     node_map_add_flag(r, "eof-cached", s.eof_cached);
+    node_map_add_int64(r, "seekable-ranges-generation", s.seek_ranges_gen);
 
     struct mpv_node *ranges =
         node_map_add(r, "seekable-ranges", MPV_FORMAT_NODE_ARRAY);
@@ -1919,6 +2008,70 @@ static int mp_property_audio_out_params(void *ctx, struct m_property *prop,
     return r;
 }
 
+static void add_waveform_array(struct mpv_node *dst, const char *name,
+                               float *data, int num)
+{
+    struct mpv_byte_array *ba = node_map_add(dst, name, MPV_FORMAT_BYTE_ARRAY)->u.ba;
+    *ba = (struct mpv_byte_array){
+        .data = talloc_memdup(ba, data, num * sizeof(float)),
+        .size = num * sizeof(float),
+    };
+}
+
+static void get_waveform_node(struct mp_waveform *w, int start, mpv_node *res)
+{
+    int num = w->num_bins - start;
+    node_init(res, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_double(res, "interval", w->interval);
+    node_map_add_int64(res, "start", start);
+    node_map_add_int64(res, "count", num);
+    add_waveform_array(res, "peak", w->peak + start, num);
+    add_waveform_array(res, "rms", w->rms + start, num);
+    add_waveform_array(res, "loudness", w->loudness + start, num);
+}
+
+static int mp_property_audio_waveform(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_waveform *w = mpctx->ao_chain ? mpctx->ao_chain->waveform : NULL;
+    if (!w)
+        return M_PROPERTY_UNAVAILABLE;
+
+    // "audio-waveform/<start>" returns the bins starting at this index.
+    if (action == M_PROPERTY_KEY_ACTION) {
+        struct m_property_action_arg *ka = arg;
+        char *end;
+        long long start = strtoll(ka->key, &end, 10);
+        if (end != ka->key && !end[0]) {
+            if (start < 0 || start > w->num_bins)
+                return M_PROPERTY_UNKNOWN;
+            switch (ka->action) {
+            case M_PROPERTY_GET_TYPE:
+                *(struct m_option *)ka->arg = (struct m_option){.type = CONF_TYPE_NODE};
+                return M_PROPERTY_OK;
+            case M_PROPERTY_GET:
+                get_waveform_node(w, start, ka->arg);
+                return M_PROPERTY_OK;
+            }
+            return M_PROPERTY_NOT_IMPLEMENTED;
+        }
+    }
+
+    if (action == M_PROPERTY_GET) {
+        get_waveform_node(w, 0, arg);
+        return M_PROPERTY_OK;
+    }
+
+    struct m_sub_property props[] = {
+        {"interval", SUB_PROP_DOUBLE(w->interval)},
+        {"count", SUB_PROP_INT(w->num_bins)},
+        {"filled", SUB_PROP_INT(w->num_filled)},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
 static struct track* track_next(struct MPContext *mpctx, enum stream_type type,
                                 int direction, struct track *track)
 {
@@ -2776,6 +2929,17 @@ static int mp_property_vsync_jitter(void *ctx, struct m_property *prop,
     return m_property_double_ro(action, arg, stddev);
 }
 
+static int mp_property_vsync_phase_error(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo *vo = mpctx->video_out;
+    double error;
+    if (!vo || !vo_get_vsync_phase_error(vo, &error))
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, error);
+}
+
 static int mp_property_display_resolution(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -2980,6 +3144,91 @@ static int mp_property_vo_passes(void *ctx, struct m_property *prop,
     return M_PROPERTY_OK;
 }
 
+static void get_filter_stats(struct mpv_node *list, struct mp_filter *f,
+                             int depth)
+{
+    struct mp_filter_stats st;
+    mp_filter_get_stats(f, &st);
+
+    struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+    const char *name = mp_filter_get_name(f);
+    node_map_add_string(e, "name", name ? name : st.type);
+    node_map_add_string(e, "type", st.type);
+    node_map_add_int64(e, "depth", depth);
+    node_map_add_int64(e, "process-calls", st.process_calls);
+    node_map_add_double(e, "process-time", st.process_time / 1e9);
+    node_map_add_int64(e, "frames-in", st.frames_in);
+    node_map_add_int64(e, "frames-out", st.frames_out);
+    node_map_add_int64(e, "bytes-out", st.bytes_out);
+    node_map_add_int64(e, "queued", st.queued);
+
+    struct mp_filter *child;
+    for (int n = 0; (child = mp_filter_get_child(f, n)); n++)
+        get_filter_stats(list, child, depth + 1);
+}
+
+static int mp_property_filter_graph_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->filter_root)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    get_filter_stats(r, mpctx->filter_root, 0);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_vo_frame_timings(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct vo_frame_timing *timings =
+        talloc_array(NULL, struct vo_frame_timing, VO_FRAME_TIMINGS);
+    int num = vo_get_frame_timings(mpctx->video_out, 0, timings,
+                                   VO_FRAME_TIMINGS);
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < num; n++) {
+        struct vo_frame_timing *t = &timings[n];
+        struct mpv_node *e = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", t->id);
+        node_map_add_int64(e, "frame-id", t->frame_id);
+        if (t->target)
+            node_map_add_int64(e, "target", t->target);
+        if (t->queued)
+            node_map_add_int64(e, "queued", t->queued);
+        node_map_add_int64(e, "render-start", t->render_start);
+        node_map_add_int64(e, "render-end", t->render_end);
+        node_map_add_int64(e, "flip", t->flip);
+        node_map_add_int64(e, "display", t->display);
+        node_map_add_flag(e, "redraw", t->redraw);
+        node_map_add_flag(e, "display-synced", t->display_synced);
+    }
+
+    talloc_free(timings);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_perf_info(void *ctx, struct m_property *p, int action,
                                  void *arg)
 {
@@ -2997,6 +3246,74 @@ static int mp_property_perf_info(void *ctx, struct m_property *p, int action,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_memory_usage(void *ctx, struct m_property *p,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node *r = arg;
+        node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+        // Packet cache of all demuxers (main file and external tracks).
+        int64_t cache_bytes = 0;
+        for (int n = 0; n < mpctx->num_tracks; n++) {
+            struct demuxer *d = mpctx->tracks[n]->demuxer;
+            bool dup = false;
+            for (int i = 0; i < n; i++)
+                dup |= mpctx->tracks[i]->demuxer == d;
+            if (!d || dup)
+                continue;
+            struct demux_reader_state s;
+            demux_get_reader_state(d, &s);
+            cache_bytes += s.total_bytes;
+        }
+        struct mpv_node *e = node_map_add(r, "demuxer-cache", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "bytes", cache_bytes);
+
+        int64_t num, bytes;
+        demux_packet_pool_get_usage(demux_packet_pool_get(mpctx->global),
+                                    &num, &bytes);
+        e = node_map_add(r, "packet-pool", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "packets", num);
+        node_map_add_int64(e, "bytes", bytes);
+
+        struct mp_image_pool_usage pools;
+        mp_image_pool_get_usage(&pools);
+        e = node_map_add(r, "image-pools", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "images", pools.images);
+        node_map_add_int64(e, "bytes", pools.bytes);
+        node_map_add_int64(e, "free-images", pools.free_images);
+        node_map_add_int64(e, "free-bytes", pools.free_bytes);
+
+        e = node_map_add(r, "playlist", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "bytes", talloc_get_tree_size(mpctx->playlist));
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_client_event_queues(void *ctx, struct m_property *p,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        mp_client_get_event_queue_stats(mpctx, (struct mpv_node *)arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3497,9 +3814,21 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
     MPContext *mpctx = ctx;
     if (action == M_PROPERTY_PRINT) {
         struct playlist *pl = mpctx->playlist;
-        char *res = talloc_strdup(NULL, "");
+        if (!pl->num_entries) {
+            *(char **)arg = talloc_strdup(NULL, "");
+            return M_PROPERTY_OK;
+        }
+
+        // Like cut_osd_list(), but format only the visible entries, as the
+        // playlist can be huge.
+        int pos = playlist_entry_to_index(pl, pl->current);
+        int max_lines = get_osd_list_lines(mpctx) - 1;
+        int start = MPMAX(get_osd_list_start(pos, pl->num_entries, max_lines), 0);
+        int end = MPMIN(start + MPMAX(max_lines, 0), pl->num_entries);
+        char *res = talloc_asprintf(NULL, "Playlist [%d/%d]:\n", pos + 1,
+                                    pl->num_entries);
 
-        for (int n = 0; n < pl->num_entries; n++) {
+        for (int n = start; n < end; n++) {
             struct playlist_entry *e = pl->entries[n];
             if (pl->current == e)
                 res = append_selected_style(mpctx, res);
@@ -3514,14 +3843,16 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
                 }
             }
             if (!e->title || p == e->title || mpctx->opts->playlist_entry_name == 1) {
-                res = talloc_asprintf_append(res, "%s%s\n", p, reset);
+                res = talloc_asprintf_append_buffer(res, "%s%s\n", p, reset);
             } else {
-                res = talloc_asprintf_append(res, "%s (%s)%s\n", e->title, p, reset);
+                res = talloc_asprintf_append_buffer(res, "%s (%s)%s\n",
+                                                    e->title, p, reset);
             }
         }
+        // Strip the final newline to not print it in the terminal.
+        res[strlen(res) - 1] = '\0';
 
-        *(char **)arg = cut_osd_list(mpctx, "Playlist", res,
-                                     playlist_entry_to_index(pl, pl->current));
+        *(char **)arg = res;
         return M_PROPERTY_OK;
     }
 
@@ -4241,7 +4572,7 @@ static int mp_property_current_clipboard_backend(void *ctx, struct m_property *p
                                                  int action, void *arg)
 {
     MPContext *mpctx = ctx;
-    return m_property_strdup_ro(action, arg, mp_clipboard_get_backend_name(mpctx->clipboard));
+    return m_property_strdup_ro(action, arg, mp_clipboard_get_backend_name(mp_get_clipboard(mpctx)));
 }
 
 static int get_clipboard(struct MPContext *mpctx, void *arg,
@@ -4250,7 +4581,7 @@ static int get_clipboard(struct MPContext *mpctx, void *arg,
     struct clipboard_data data;
     void *tmp = talloc_new(NULL);
 
-    int ret = mp_clipboard_get_data(mpctx->clipboard, params, &data, tmp);
+    int ret = mp_clipboard_get_data(mp_get_clipboard(mpctx), params, &data, tmp);
     if (ret != CLIPBOARD_SUCCESS) {
         talloc_free(tmp);
         return ret == CLIPBOARD_UNAVAILABLE ? M_PROPERTY_UNAVAILABLE : M_PROPERTY_ERROR;
@@ -4281,7 +4612,7 @@ static int set_clipboard(struct MPContext *mpctx, void *arg,
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
 
-    int ret = mp_clipboard_set_data(mpctx->clipboard, params, &data);
+    int ret = mp_clipboard_set_data(mp_get_clipboard(mpctx), params, &data);
     if (ret == CLIPBOARD_SUCCESS)
         return M_PROPERTY_OK;
     return ret == CLIPBOARD_UNAVAILABLE ? M_PROPERTY_UNAVAILABLE : M_PROPERTY_ERROR;
@@ -4388,6 +4719,10 @@ static const struct m_property mp_properties_base[] = {
     {"display-height", mp_property_display_resolution},
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
     {"frame-drop-count", mp_property_frame_drop_vo},
+    {"vd-queue-duration", mp_property_dec_queue_duration,
+        .priv = (void *)&(const int){STREAM_VIDEO}},
+    {"ad-queue-duration", mp_property_dec_queue_duration,
+        .priv = (void *)&(const int){STREAM_AUDIO}},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
@@ -4412,12 +4747,15 @@ static const struct m_property mp_properties_base[] = {
     {"eof-reached", mp_property_eof_reached},
     {"seeking", mp_property_seeking},
     {"playback-abort", mp_property_playback_abort},
+    {"load-timing", mp_property_load_timing},
+    {"seek-timing", mp_property_seek_timing},
     {"cache-speed", mp_property_cache_speed},
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
     {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"demuxer-cache-ranges-generation", mp_property_demuxer_cache_gen},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"demuxer-via-network", mp_property_demuxer_is_network},
@@ -4453,6 +4791,7 @@ static const struct m_property mp_properties_base[] = {
     M_PROPERTY_ALIAS("audio-codec", "current-tracks/audio/codec-desc"),
     {"audio-params", mp_property_audio_params},
     {"audio-out-params", mp_property_audio_out_params},
+    {"audio-waveform", mp_property_audio_waveform},
     {"aid", mp_property_switch_track, .priv = (void *)(const int[]){0, STREAM_AUDIO}},
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
@@ -4473,7 +4812,11 @@ static const struct m_property mp_properties_base[] = {
     {"current-window-scale", mp_property_current_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
+    {"vo-frame-timings", mp_property_vo_frame_timings},
     {"perf-info", mp_property_perf_info},
+    {"memory-usage", mp_property_memory_usage},
+    {"client-event-queues", mp_property_client_event_queues},
+    {"filter-graph-stats", mp_property_filter_graph_stats},
     {"current-vo", mp_property_vo},
     {"current-gpu-context", mp_property_gpu_context},
     {"container-fps", mp_property_fps},
@@ -4541,6 +4884,7 @@ static const struct m_property mp_properties_base[] = {
     {"display-fps", mp_property_display_fps},
     {"estimated-display-fps", mp_property_estimated_display_fps},
     {"vsync-jitter", mp_property_vsync_jitter},
+    {"vsync-phase-error", mp_property_vsync_phase_error},
     {"display-hidpi-scale", mp_property_hidpi_scale},
     {"ambient-light", mp_property_ambient_light},
 
@@ -4604,7 +4948,8 @@ static const char *const *const mp_event_property_change[] = {
       "percent-pos", "time-remaining", "playtime-remaining", "playback-time",
       "estimated-vf-fps", "total-avsync-change", "audio-speed-correction",
       "video-speed-correction", "vo-delayed-frame-count", "mistimed-frame-count",
-      "vsync-ratio", "estimated-display-fps", "vsync-jitter", "sub-text",
+      "vsync-ratio", "estimated-display-fps", "vsync-jitter",
+      "vsync-phase-error", "sub-text",
       "secondary-sub-text", "audio-bitrate", "video-bitrate", "sub-bitrate",
       "decoder-frame-drop-count", "frame-drop-count", "video-frame-info",
       "vf-metadata", "af-metadata", "sub-start", "sub-end", "secondary-sub-start",
@@ -4619,15 +4964,17 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_AUDIO_RECONFIG, "audio-format", "audio-codec", "audio-bitrate",
       "samplerate", "channels", "audio", "volume", "volume-gain", "mute",
       "current-ao", "audio-codec-name", "audio-params", "track-list", "current-tracks",
-      "audio-out-params", "volume-max", "volume-gain-min", "volume-gain-max", "mixer-active"),
-    E(MPV_EVENT_SEEK, "seeking", "core-idle", "eof-reached"),
-    E(MPV_EVENT_PLAYBACK_RESTART, "seeking", "core-idle", "eof-reached"),
+      "audio-out-params", "volume-max", "volume-gain-min", "volume-gain-max", "mixer-active",
+      "audio-waveform"),
+    E(MPV_EVENT_SEEK, "seeking", "core-idle", "eof-reached", "seek-timing"),
+    E(MPV_EVENT_PLAYBACK_RESTART, "seeking", "core-idle", "eof-reached",
+      "load-timing", "seek-timing"),
     E(MP_EVENT_METADATA_UPDATE, "metadata", "filtered-metadata", "media-title"),
     E(MP_EVENT_CHAPTER_CHANGE, "chapter", "chapter-metadata"),
     E(MP_EVENT_CACHE_UPDATE,
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time", "cache-buffering-state", "cache-speed",
-      "demuxer-cache-state"),
+      "demuxer-cache-state", "demuxer-cache-ranges-generation"),
     E(MP_EVENT_WIN_RESIZE, "current-window-scale", "osd-width", "osd-height",
       "osd-par", "osd-dimensions"),
     E(MP_EVENT_WIN_STATE, "display-names", "display-fps", "display-width",
@@ -4684,11 +5031,14 @@ uint64_t mp_get_property_event_mask(const char *name)
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    // Same as the first entry for which match_property() is true.
+    bstr base = bstr0(name);
+    bstr_eatstart0(&base, "options/");
+    int end = bstrchr(base, '/');
+    if (end >= 0)
+        base = bstr_splice(base, 0, end);
+    struct m_property *prop = m_property_index_find(ctx->prop_index, base);
+    return prop ? prop - ctx->properties : -1;
 }
 
 static bool is_property_set(int action, void *val)
@@ -4709,36 +5059,56 @@ static bool is_property_set(int action, void *val)
     }
 }
 
+static void log_property_set(struct MPContext *ctx, bstr name, int action,
+                             void *val, int r)
+{
+    if (!mp_msg_test(ctx->log, MSGL_V) || !is_property_set(action, val))
+        return;
+    struct m_option option_type = {0};
+    void *data = val;
+    switch (action) {
+    case M_PROPERTY_SET_NODE:
+        option_type.type = &m_option_type_node;
+        break;
+    case M_PROPERTY_SET_STRING:
+        option_type.type = &m_option_type_string;
+        data = &val;
+        break;
+    }
+    char *t = option_type.type ? m_option_print(&option_type, data) : NULL;
+    MP_VERBOSE(ctx, "Set property: %.*s%s%s -> %d\n",
+               BSTR_P(name), t ? "=" : "", t ? t : "", r);
+    talloc_free(t);
+}
+
 int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
-
-    if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
-        struct m_option option_type = {0};
-        void *data = val;
-        switch (action) {
-        case M_PROPERTY_SET_NODE:
-            option_type.type = &m_option_type_node;
-            break;
-        case M_PROPERTY_SET_STRING:
-            option_type.type = &m_option_type_string;
-            data = &val;
-            break;
-        }
-        char *t = option_type.type ? m_option_print(&option_type, data) : NULL;
-        MP_VERBOSE(ctx, "Set property: %s%s%s -> %d\n",
-                   name, t ? "=" : "", t ? t : "", r);
-        talloc_free(t);
-    }
+    int r = m_property_do(ctx->log, cmd->prop_index, name, action, val, ctx);
+    log_property_set(ctx, bstr0(name), action, val, r);
+    return r;
+}
+
+bool mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_ref *ref)
+{
+    struct command_ctx *ctx = mpctx->command_ctx;
+    return m_property_resolve(ctx->prop_index, name, ref);
+}
+
+int mp_property_do_ref(const struct m_property_ref *ref, int action, void *val,
+                       struct MPContext *ctx)
+{
+    int r = m_property_do_ref(ctx->log, ref, action, val, ctx);
+    log_property_set(ctx, ref->name, action, val, r);
     return r;
 }
 
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->prop_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -5342,7 +5712,7 @@ static void change_property_cmd(struct mp_cmd_ctx *cmd,
     struct m_property *prop = NULL;
     if (cmd->cmd->coalesce) {
         struct command_ctx *ctx = cmd->mpctx->command_ctx;
-        prop = m_property_list_find(ctx->properties, name);
+        prop = m_property_index_find(ctx->prop_index, bstr0(name));
         if (prop)
             prop->coalesce = true;
     }
@@ -5697,6 +6067,24 @@ static void cmd_seek(void *p)
         mpctx->add_osd_seek_info |= OSD_SEEK_INFO_TEXT;
 }
 
+static void cmd_seek_hint(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    double v = cmd->args[0].v.d;
+    if (cmd->args[1].v.i) {
+        double now = get_current_time(mpctx);
+        v = now == MP_NOPTS_VALUE ? MP_NOPTS_VALUE : now + v;
+    }
+    if (!mpctx->demuxer || v == MP_NOPTS_VALUE) {
+        cmd->success = false;
+        return;
+    }
+
+    demux_add_seek_hint(mpctx->demuxer, v);
+}
+
 static void cmd_revert_seek(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -6176,9 +6564,13 @@ static void cmd_loadlist(void *p)
 
     struct load_action action = get_load_action(mpctx, action_flag);
 
+    // Reading and parsing the playlist needs no player state, so don't block
+    // playback meanwhile.
     char *path = mp_get_user_path(NULL, mpctx->global, filename);
+    mp_core_unlock(mpctx);
     struct playlist *pl = playlist_parse_file(path, cmd->abort->cancel,
                                               mpctx->global);
+    mp_core_lock(mpctx);
     talloc_free(path);
 
     if (pl) {
@@ -6712,6 +7104,40 @@ static void cmd_drop_buffers(void *p)
         demux_flush(mpctx->demuxer);
 }
 
+enum {
+    TRIM_MEMORY_LIGHT,
+    TRIM_MEMORY_MODERATE,
+    TRIM_MEMORY_COMPLETE,
+};
+
+static void cmd_trim_memory(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    int level = cmd->args[0].v.i;
+    bool back_buffer = level >= TRIM_MEMORY_MODERATE;
+
+    struct demuxer *last = NULL;
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        // (Tracks of the same demuxer are usually adjacent.)
+        if (track->demuxer && track->demuxer != last) {
+            demux_trim_memory(track->demuxer, back_buffer);
+            last = track->demuxer;
+        }
+        if (back_buffer && track->d_sub)
+            sub_control(track->d_sub, SD_CTRL_TRIM_MEMORY, NULL);
+    }
+    if (mpctx->demuxer && mpctx->demuxer != last)
+        demux_trim_memory(mpctx->demuxer, back_buffer);
+    demux_packet_pool_clear(demux_packet_pool_get(mpctx->global));
+
+    mp_image_pool_trim_all();
+
+    if (level >= TRIM_MEMORY_COMPLETE && mpctx->video_out)
+        vo_control(mpctx->video_out, VOCTRL_TRIM_MEMORY, NULL);
+}
+
 static void cmd_ao_reload(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -6772,6 +7198,7 @@ static void cmd_script_binding(void *p)
         snprintf(space, sizeof(space), "%.*s", (int)(sep - name), name);
         target = space;
         name = sep + 1;
+        mp_load_builtin_script_on_demand(mpctx, target);
     }
     char state[4] = {'p', incmd->is_mouse_button ? 'm' : '-',
                           incmd->canceled ? 'c' : '-'};
@@ -6815,6 +7242,7 @@ static void cmd_script_message_to(void *p)
         MP_TARRAY_APPEND(event, event->args, event->num_args,
                          talloc_strdup(event, cmd->args[n].v.s));
     }
+    mp_load_builtin_script_on_demand(mpctx, cmd->args[0].v.s);
     if (mp_client_send_event(mpctx, cmd->args[0].v.s, 0,
                                 MPV_EVENT_CLIENT_MESSAGE, event) < 0)
     {
@@ -6847,6 +7275,7 @@ static void cmd_write_watch_later_config(void *p)
     struct MPContext *mpctx = cmd->mpctx;
 
     mp_write_watch_later_conf(mpctx);
+    mp_flush_watch_later_conf(mpctx);
 }
 
 static void cmd_delete_watch_later_config(void *p)
@@ -6858,6 +7287,7 @@ static void cmd_delete_watch_later_config(void *p)
     if (filename && !filename[0])
         filename = NULL;
     mp_delete_watch_later_conf(mpctx, filename);
+    mp_flush_watch_later_conf(mpctx);
 }
 
 static void cmd_mouse(void *p)
@@ -7109,6 +7539,31 @@ static void cmd_context_menu(void *p)
         vo_control(vo, VOCTRL_SHOW_MENU, NULL);
 }
 
+static void cmd_stats_trace(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    char *path = mp_get_user_path(NULL, mpctx->global, cmd->args[0].v.s);
+
+    stats_global_trace_start(mpctx->global);
+    mp_cmd_msg(cmd, MSGL_INFO, "Recording stats trace.");
+
+    // Record without blocking the player. The wait ends early if the command
+    // is aborted, e.g. on quit.
+    mp_core_unlock(mpctx);
+    mp_cancel_wait(cmd->abort->cancel, cmd->args[1].v.d);
+    mp_core_lock(mpctx);
+
+    int num = stats_global_trace_stop(mpctx->global, path);
+    if (num < 0) {
+        mp_cmd_msg(cmd, MSGL_ERR, "Failed to write stats trace to '%s'.", path);
+        cmd->success = false;
+    } else {
+        mp_cmd_msg(cmd, MSGL_INFO, "Wrote %d intervals to '%s'.", num, path);
+    }
+    talloc_free(path);
+}
+
 static void cmd_flush_status_line(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -7173,6 +7628,14 @@ const struct mp_cmd_def mp_cmds[] = {
         .allow_auto_repeat = true,
         .scalable = true,
     },
+    { "seek-hint", cmd_seek_hint,
+        {
+            {"target", OPT_TIME(v.d)},
+            {"flags", OPT_CHOICE(v.i, {"absolute", 0}, {"relative", 1}),
+                .flags = MP_CMD_OPT_ARG},
+        },
+        .is_noisy = true,
+    },
     { "revert-seek", cmd_revert_seek,
         { {"flags", OPT_FLAGS(v.i, {"mark", 2|0}, {"mark-permanent", 2|1}),
            .flags = MP_CMD_OPT_ARG} },
@@ -7417,6 +7880,29 @@ const struct mp_cmd_def mp_cmds[] = {
                 OPTDEF_INT(0)},
         },
     },
+    { "screenshot-frames", cmd_screenshot_frames,
+        {
+            {"times", OPT_STRINGLIST(v.str_list)},
+            {"template", OPT_STRING(v.s)},
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+    },
+    { "thumbnail-raw", cmd_thumbnail_raw,
+        {
+            {"count", OPT_INT(v.i), M_RANGE(1, 1000)},
+            {"width", OPT_INT(v.i), M_RANGE(1, 4096)},
+            {"height", OPT_INT(v.i), M_RANGE(1, 4096)},
+            {"format", OPT_CHOICE(v.i,
+                {"bgr0", 0},
+                {"bgra", 1},
+                {"rgba", 2}),
+                OPTDEF_INT(0)},
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+        .abort_on_playback_end = true,
+    },
     { "loadfile", cmd_loadfile,
         {
             {"url", OPT_STRING(v.s)},
@@ -7532,6 +8018,16 @@ const struct mp_cmd_def mp_cmds[] = {
 
     { "drop-buffers", cmd_drop_buffers, },
 
+    { "trim-memory", cmd_trim_memory,
+        {
+            {"level", OPT_CHOICE(v.i,
+                {"light", TRIM_MEMORY_LIGHT},
+                {"moderate", TRIM_MEMORY_MODERATE},
+                {"complete", TRIM_MEMORY_COMPLETE}),
+                OPTDEF_INT(TRIM_MEMORY_MODERATE)},
+        },
+    },
+
     { "af", cmd_filter, { {"operation", OPT_STRING(v.s)},
                           {"value", OPT_STRING(v.s)}, },
         .priv = &(const int){STREAM_AUDIO} },
@@ -7654,6 +8150,15 @@ const struct mp_cmd_def mp_cmds[] = {
 
     { "context-menu", cmd_context_menu },
 
+    { "stats-trace", cmd_stats_trace,
+        {
+            {"filename", OPT_STRING(v.s)},
+            {"duration", OPT_DOUBLE(v.d), M_RANGE(0, 3600), OPTDEF_DOUBLE(5)},
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+    },
+
     { "flush-status-line", cmd_flush_status_line, { {"clear", OPT_BOOL(v.b)} } },
 
     { "notify-property", cmd_notify_property, { {"property", OPT_STRING(v.s)} } },
@@ -7745,6 +8250,7 @@ void command_init(struct MPContext *mpctx)
 
         ctx->properties[count++] = prop;
     }
+    ctx->prop_index = m_property_index_create(ctx, ctx->properties);
 
     node_init(&ctx->mdata, MPV_FORMAT_NODE_ARRAY, NULL);
     talloc_steal(ctx, ctx->mdata.u.list);
@@ -28,6 +28,7 @@ struct mp_cmd;
 struct mp_log;
 struct mpv_node;
 struct m_config_option;
+struct m_property_ref;
 
 void command_init(struct MPContext *mpctx);
 void command_uninit(struct MPContext *mpctx);
@@ -84,6 +85,13 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx);
 int mp_property_do(const char* name, int action, void* val,
                    struct MPContext *mpctx);
+// Resolve a property name once, for repeated access with mp_property_do_ref().
+// The property list doesn't change after init, so *ref stays valid as long as
+// name does.
+bool mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_ref *ref);
+int mp_property_do_ref(const struct m_property_ref *ref, int action, void *val,
+                       struct MPContext *mpctx);
 
 void mp_option_change_callback(void *ctx, struct m_config_option *co, uint64_t flags,
                                bool self_update);
@@ -100,7 +108,7 @@ uint64_t mp_get_property_event_mask(const char *name);
 enum {
     // Must start with the first unused positive value in enum mpv_event_id
     // MPV_EVENT_* and MP_EVENT_* must not overlap.
-    INTERNAL_EVENT_BASE = 26,
+    INTERNAL_EVENT_BASE = 27,
     MP_EVENT_CHANGE_ALL,
     MP_EVENT_CACHE_UPDATE,
     MP_EVENT_WIN_RESIZE,
@@ -22,12 +22,6 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
-#ifdef _WIN32
-#include <sys/utime.h>
-#else
-#include <utime.h>
-#endif
-
 #include <libavutil/md5.h>
 
 #include "mpv_talloc.h"
@@ -50,6 +44,7 @@
 
 #include "core.h"
 #include "command.h"
+#include "watch_later.h"
 
 static void load_all_cfgfiles(struct MPContext *mpctx, char *section,
                               char *filename)
@@ -171,30 +166,17 @@ void mp_load_auto_profiles(struct MPContext *mpctx)
 
 #define MP_WATCH_LATER_CONF "watch_later"
 
-static bool check_mtime(const char *f1, const char *f2)
+static struct mp_watch_later *get_watch_later(struct MPContext *mpctx)
 {
-    struct stat st1, st2;
-    if (stat(f1, &st1) != 0 || stat(f2, &st2) != 0)
-        return false;
-    return st1.st_mtime == st2.st_mtime;
+    if (!mpctx->watch_later)
+        mpctx->watch_later = mp_watch_later_create(mpctx->global, mpctx->log);
+    return mpctx->watch_later;
 }
 
-static bool copy_mtime(const char *f1, const char *f2)
+static int64_t get_mtime(const char *path)
 {
-    struct stat st1, st2;
-
-    if (stat(f1, &st1) != 0 || stat(f2, &st2) != 0)
-        return false;
-
-    struct utimbuf ut = {
-        .actime = st2.st_atime,  // we want to pass this through intact
-        .modtime = st1.st_mtime,
-    };
-
-    if (utime(f2, &ut) != 0)
-        return false;
-
-    return true;
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_mtime : -1;
 }
 
 char *mp_get_playback_resume_dir(struct MPContext *mpctx)
@@ -208,25 +190,52 @@ char *mp_get_playback_resume_dir(struct MPContext *mpctx)
     return wl_dir;
 }
 
-static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
-                                                    const char *path)
+// Name of the resume entry of path in the watch later directory.
+static char *get_resume_name(struct MPContext *mpctx, void *ta_parent,
+                             const char *path)
 {
-    struct MPOpts *opts = mpctx->opts;
-    char *res = NULL;
-    void *tmp = talloc_new(NULL);
-    if (opts->ignore_path_in_watch_later_config && !mp_is_url(bstr0(path)))
+    if (mpctx->opts->ignore_path_in_watch_later_config && !mp_is_url(bstr0(path)))
         path = mp_basename(path);
     uint8_t md5[16];
     av_md5_sum(md5, path, strlen(path));
-    char *conf = talloc_strdup(tmp, "");
+    char *conf = talloc_strdup(ta_parent, "");
     for (int i = 0; i < 16; i++)
         conf = talloc_asprintf_append(conf, "%02X", md5[i]);
+    return conf;
+}
 
+// Queue writing data as resume state of path, or deleting it if data is NULL.
+static void put_resume_state(struct MPContext *mpctx, const char *path,
+                             const char *data)
+{
+    struct MPOpts *opts = mpctx->opts;
     char *wl_dir = mp_get_playback_resume_dir(mpctx);
-    if (wl_dir && wl_dir[0])
-        res = mp_path_join(NULL, wl_dir, conf);
+    if (wl_dir && wl_dir[0]) {
+        int64_t mtime = -1;
+        if (data && opts->position_check_mtime && !mp_is_url(bstr0(path))) {
+            mtime = get_mtime(path);
+            if (mtime < 0)
+                MP_WARN(mpctx, "Can't get mtime of %s\n", path);
+        }
+        char *name = get_resume_name(mpctx, NULL, path);
+        mp_watch_later_put(get_watch_later(mpctx), wl_dir,
+                           opts->watch_later_database, name, data, mtime);
+        talloc_free(name);
+    }
+    talloc_free(wl_dir);
+}
+
+static bool has_resume_state(struct MPContext *mpctx, const char *path)
+{
+    bool res = false;
+    char *wl_dir = mp_get_playback_resume_dir(mpctx);
+    if (wl_dir && wl_dir[0]) {
+        char *name = get_resume_name(mpctx, NULL, path);
+        res = mp_watch_later_exists(get_watch_later(mpctx), wl_dir,
+                                    mpctx->opts->watch_later_database, name);
+        talloc_free(name);
+    }
     talloc_free(wl_dir);
-    talloc_free(tmp);
     return res;
 }
 
@@ -243,7 +252,7 @@ static bool needs_config_quoting(const char *s)
     return false;
 }
 
-static void write_filename(struct MPContext *mpctx, FILE *file, char *filename)
+static void write_filename(struct MPContext *mpctx, char **data, char *filename)
 {
     if (mpctx->opts->ignore_path_in_watch_later_config && !mp_is_url(bstr0(filename)))
         filename = mp_basename(filename);
@@ -252,27 +261,16 @@ static void write_filename(struct MPContext *mpctx, FILE *file, char *filename)
         char write_name[1024] = {0};
         for (int n = 0; filename[n] && n < sizeof(write_name) - 1; n++)
             write_name[n] = (unsigned char)filename[n] < 32 ? '_' : filename[n];
-        fprintf(file, "# %s\n", write_name);
+        *data = talloc_asprintf_append_buffer(*data, "# %s\n", write_name);
     }
 }
 
 static void write_redirect(struct MPContext *mpctx, char *path)
 {
-    char *conffile = mp_get_playback_resume_config_filename(mpctx, path);
-    if (conffile) {
-        FILE *file = fopen(conffile, "wb");
-        if (file) {
-            fprintf(file, "# redirect entry\n");
-            write_filename(mpctx, file, path);
-            fclose(file);
-        }
-
-        if (mpctx->opts->position_check_mtime &&
-            !mp_is_url(bstr0(path)) && !copy_mtime(path, conffile))
-            MP_WARN(mpctx, "Can't copy mtime from %s to %s\n", path, conffile);
-
-        talloc_free(conffile);
-    }
+    char *data = talloc_strdup(NULL, "# redirect entry\n");
+    write_filename(mpctx, &data, path);
+    put_resume_state(mpctx, path, data);
+    talloc_free(data);
 }
 
 static void write_redirects_for_parent_dirs(struct MPContext *mpctx, char *path)
@@ -301,30 +299,23 @@ static void write_redirects_for_parent_dirs(struct MPContext *mpctx, char *path)
 void mp_write_watch_later_conf(struct MPContext *mpctx)
 {
     struct playlist_entry *cur = mpctx->playing;
-    char *conffile = NULL;
+    char *data = NULL;
 
     if (!cur)
         goto exit;
 
     struct demuxer *demux = mpctx->demuxer;
 
-    conffile = mp_get_playback_resume_config_filename(mpctx, cur->filename);
-    if (!conffile)
-        goto exit;
-
     char *wl_dir = mp_get_playback_resume_dir(mpctx);
-    mp_mkdirp(wl_dir);
+    bool has_dir = wl_dir && wl_dir[0];
     talloc_free(wl_dir);
+    if (!has_dir)
+        goto exit;
 
     MP_INFO(mpctx, "Saving state.\n");
 
-    FILE *file = fopen(conffile, "wb");
-    if (!file) {
-        MP_WARN(mpctx, "Can't open %s for writing\n", conffile);
-        goto exit;
-    }
-
-    write_filename(mpctx, file, cur->filename);
+    data = talloc_strdup(NULL, "");
+    write_filename(mpctx, &data, cur->filename);
 
     bool write_start = true;
     double pos = get_playback_time(mpctx);
@@ -340,7 +331,7 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
         char *pname = watch_later_options[i];
         // Always save start if we have it in the array.
         if (write_start && strcmp(pname, "start") == 0) {
-            fprintf(file, "%s=%f\n", pname, pos);
+            data = talloc_asprintf_append_buffer(data, "%s=%f\n", pname, pos);
             continue;
         }
         // Only store it if it's different from the initial value.
@@ -352,21 +343,17 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
                     "writing watch-later file\n", pname);
             } else if (needs_config_quoting(val)) {
                 // e.g. '%6%STRING'
-                fprintf(file, "%s=%%%d%%%s\n", pname, (int)strlen(val), val);
+                data = talloc_asprintf_append_buffer(data, "%s=%%%d%%%s\n",
+                                                     pname, (int)strlen(val), val);
             } else {
-                fprintf(file, "%s=%s\n", pname, val);
+                data = talloc_asprintf_append_buffer(data, "%s=%s\n", pname, val);
             }
             talloc_free(val);
         }
     }
-    fclose(file);
 
-    if (mpctx->opts->position_check_mtime && !mp_is_url(bstr0(cur->filename)) &&
-        !copy_mtime(cur->filename, conffile))
-    {
-        MP_WARN(mpctx, "Can't copy mtime from %s to %s\n", cur->filename,
-                conffile);
-    }
+    // The files are written by the watch later writer thread.
+    put_resume_state(mpctx, cur->filename, data);
 
     write_redirects_for_parent_dirs(mpctx, cur->filename);
 
@@ -381,7 +368,13 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
     }
 
 exit:
-    talloc_free(conffile);
+    talloc_free(data);
+}
+
+void mp_flush_watch_later_conf(struct MPContext *mpctx)
+{
+    if (mpctx->watch_later)
+        mp_watch_later_flush(mpctx->watch_later);
 }
 
 void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file)
@@ -391,12 +384,7 @@ void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file)
     if (!path)
         goto exit;
 
-    char *fname = mp_get_playback_resume_config_filename(mpctx, path);
-    if (!fname)
-        goto exit;
-
-    unlink(fname);
-    talloc_free(fname);
+    put_resume_state(mpctx, path, NULL);
 
     if (mp_is_url(bstr0(path)) || mpctx->opts->ignore_path_in_watch_later_config)
         goto exit;
@@ -405,11 +393,7 @@ void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file)
     while (dir.len > 1 && dir.len < strlen(path)) {
         path[dir.len] = '\0';
         mp_path_strip_trailing_separator(path);
-        fname = mp_get_playback_resume_config_filename(mpctx, path);
-        if (!fname)
-            break;
-        unlink(fname);
-        talloc_free(fname);
+        put_resume_state(mpctx, path, NULL);
         dir = mp_dirname(path);
     }
 
@@ -419,26 +403,37 @@ exit:
 
 bool mp_load_playback_resume(struct MPContext *mpctx, const char *file)
 {
-    bool resume = false;
-    if (!mpctx->opts->position_resume)
-        return resume;
-    char *fname = mp_get_playback_resume_config_filename(mpctx, file);
-    if (fname && mp_path_exists(fname)) {
-        if (mpctx->opts->position_check_mtime &&
-            !mp_is_url(bstr0(file)) && !check_mtime(file, fname))
-        {
-            talloc_free(fname);
-            return resume;
-        }
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->position_resume)
+        return false;
+    char *wl_dir = mp_get_playback_resume_dir(mpctx);
+    if (!wl_dir || !wl_dir[0]) {
+        talloc_free(wl_dir);
+        return false;
+    }
 
+    void *tmp = talloc_new(NULL);
+    char *name = get_resume_name(mpctx, tmp, file);
+    int64_t mtime;
+    char *data = mp_watch_later_get(get_watch_later(mpctx), wl_dir,
+                                    opts->watch_later_database, name, tmp,
+                                    &mtime);
+    bool resume = false;
+    if (data && (!opts->position_check_mtime || mp_is_url(bstr0(file)) ||
+                 (mtime >= 0 && get_mtime(file) == mtime)))
+    {
         // Never apply the saved start position to following files
         m_config_backup_opt(mpctx->mconfig, "start");
         MP_INFO(mpctx, "Resuming playback. This behavior can "
                "be disabled with --no-resume-playback.\n");
-        try_load_config(mpctx, fname, M_SETOPT_PRESERVE_CMDLINE, MSGL_V);
+        char *location = mp_path_join(tmp, wl_dir, name);
+        MP_VERBOSE(mpctx, "Loading config '%s'\n", location);
+        m_config_parse(mpctx->mconfig, location, bstr0(data), NULL,
+                       M_SETOPT_PRESERVE_CMDLINE | M_SETOPT_FROM_CONFIG_FILE);
         resume = true;
     }
-    talloc_free(fname);
+    talloc_free(tmp);
+    talloc_free(wl_dir);
     return resume;
 }
 
@@ -454,10 +449,7 @@ struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
         return NULL;
     for (int n = 0; n < playlist->num_entries; n++) {
         struct playlist_entry *e = playlist->entries[n];
-        char *conf = mp_get_playback_resume_config_filename(mpctx, e->filename);
-        bool exists = conf && mp_path_exists(conf);
-        talloc_free(conf);
-        if (exists)
+        if (has_resume_state(mpctx, e->filename))
             return e;
     }
     return NULL;
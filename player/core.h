@@ -203,6 +203,10 @@ struct ao_chain {
     struct mp_pin *filter_src;
     struct mp_pin *dec_src;
 
+    // Optional analysis of the decoded audio (--audio-waveform).
+    struct mp_filter *waveform_filter;
+    struct mp_waveform *waveform;
+
     double delay;
     bool untimed_throttle;
 
@@ -232,6 +236,21 @@ extern const int num_ptracks[STREAM_TYPE_COUNT];
 // Maximum of all num_ptracks[] values.
 #define MAX_PTRACKS 2
 
+// Phases of loading a file or seeking, see mark_load_timing().
+enum mp_load_phase {
+    LOAD_PHASE_START,           // loadfile or seek started
+    LOAD_PHASE_OPEN,            // stream opened
+    LOAD_PHASE_PROBE,           // demuxer opened (header probed)
+    LOAD_PHASE_DECODER_INIT,    // decoders created
+    LOAD_PHASE_FIRST_DECODE,    // first video frame decoded
+    LOAD_PHASE_FIRST_PRESENT,   // first frame shown (or playback started)
+    LOAD_PHASE_COUNT
+};
+
+struct mp_load_timing {
+    int64_t t[LOAD_PHASE_COUNT]; // mp_time_ns(), 0 if not reached (yet)
+};
+
 typedef struct MPContext {
     bool initialized;
     bool is_cli;
@@ -240,6 +259,7 @@ typedef struct MPContext {
     struct MPOpts *opts;
     struct mp_log *log;
     struct stats_ctx *stats;
+    char *stats_trace_file; // MPV_STATS_TRACE, written on destruction
     struct m_config *mconfig;
     struct input_ctx *input;
     struct mp_client_api *clients;
@@ -254,8 +274,14 @@ typedef struct MPContext {
 
     struct mp_thread_pool *thread_pool; // for coarse I/O, often during loading
 
+    // --sub-files being opened in parallel with the main file (loadfile.c).
+    struct ext_prefetch **sub_prefetch;
+    int num_sub_prefetch;
+
     struct mp_log *statusline;
     struct osd_state *osd;
+    struct mp_ass_preload *ass_preload;
+    struct mp_watch_later *watch_later; // created on first use
     char *term_osd_text;
     char *term_osd_status;
     char *term_osd_subs[2];
@@ -305,6 +331,8 @@ typedef struct MPContext {
 
     struct demuxer *demuxer;
     char *preload_url;  // If non-NULL, demuxer came from preload queue (for recycling)
+    struct mp_preload_decoder *preload_dec; // prewarmed video decoder, if unused yet
+    struct mp_preload_decoder *preload_adec; // same for audio
     struct mp_tags *filtered_tags;
 
     struct track **tracks;
@@ -408,6 +436,10 @@ typedef struct MPContext {
 
     struct seek_params seek;
 
+    // Phases of the last file load and seek (load-timing/seek-timing
+    // properties).
+    struct mp_load_timing load_timing, seek_timing;
+
     /* Heuristic for relative chapter seeks: keep track which chapter
      * the user wanted to go to, even if we aren't exactly within the
      * boundaries of that chapter due to an inaccurate seek. */
@@ -445,8 +477,23 @@ typedef struct MPContext {
     int num_option_callbacks;
 
     struct mp_ipc_ctx *ipc_ctx;
+    struct script_host *script_host;
 
     int64_t builtin_script_ids[9];
+    // Builtin scripts that are enabled, but not loaded yet because of
+    // --builtin-scripts-on-demand.
+    bool builtin_script_deferred[9];
+    // Clipboard needs to be (re)created on first access.
+    bool clipboard_pending;
+
+    // Time spent in each phase of mp_create()/mp_initialize(), printed with
+    // --msg-level=startup=v.
+    struct mp_startup_phase {
+        const char *name;
+        int64_t duration;
+    } startup_phases[16];
+    int num_startup_phases;
+    int64_t startup_phase_start;
 
     mp_mutex abort_lock;
 
@@ -466,11 +513,15 @@ typedef struct MPContext {
     char *open_format;
     int open_url_flags;
     bool open_for_prefetch;
+    bool open_decoders; // --prefetch-playlist-decoders
+    bool open_shared; // --shared-source
     bool demuxer_changed;
     // --- All fields below are owned by open_thread, unless open_done was set
     //     to true.
     struct demuxer *open_res_demuxer;
+    struct mp_preload_decoder *open_res_vdec, *open_res_adec;
     int open_res_error;
+    int64_t open_res_stream_ns, open_res_demux_ns;
 
     struct mp_als *als_state; // lazily initialized on first use
 } MPContext;
@@ -519,10 +570,14 @@ void mp_load_auto_profiles(struct MPContext *mpctx);
 bool mp_load_playback_resume(struct MPContext *mpctx, const char *file);
 char *mp_get_playback_resume_dir(struct MPContext *mpctx);
 void mp_write_watch_later_conf(struct MPContext *mpctx);
+void mp_flush_watch_later_conf(struct MPContext *mpctx);
 void mp_delete_watch_later_conf(struct MPContext *mpctx, const char *file);
 struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
                                                 struct playlist *playlist);
 
+// encode_segments.c
+bool mp_encode_segments(struct MPContext *mpctx, char **options);
+
 // loadfile.c
 void mp_abort_playback_async(struct MPContext *mpctx);
 void mp_abort_add(struct MPContext *mpctx, struct mp_abort_entry *abort);
@@ -559,6 +614,7 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel);
 struct track *select_default_track(struct MPContext *mpctx, int order,
                                    enum stream_type type);
 void prefetch_next(struct MPContext *mpctx);
+void mark_load_timing(struct MPContext *mpctx, enum mp_load_phase phase);
 void update_lavfi_complex(struct MPContext *mpctx);
 
 // main.c
@@ -648,16 +704,30 @@ struct mp_scripting {
     const char *file_ext;   // e.g. "lua"
     bool no_thread;         // don't run load() on dedicated thread
     int (*load)(struct mp_script_args *args);
+    // Optional, for running on the shared threads with --script-threads.
+    // start() is like load(), but may return after the script was initialized
+    // by setting *state. Then dispatch() is called to process pending events
+    // and timers without blocking. It sets *timeout to the seconds until the
+    // next timer (<0 if none), and returns false when the script wants to
+    // exit. unload() frees the state.
+    int (*start)(struct mp_script_args *args, void **state);
+    bool (*dispatch)(void *state, double *timeout);
+    void (*unload)(void *state);
 };
 bool mp_load_scripts(struct MPContext *mpctx);
 void mp_load_builtin_scripts(struct MPContext *mpctx);
+bool mp_load_builtin_script_on_demand(struct MPContext *mpctx,
+                                      const char *client_name);
 int64_t mp_load_user_script(struct MPContext *mpctx, const char *fname);
+void mp_script_host_wakeup(struct MPContext *mpctx);
+void mp_script_host_destroy(struct MPContext *mpctx);
 
 // sub.c
 void redraw_subs(struct MPContext *mpctx);
 void reset_subtitle_state(struct MPContext *mpctx);
 void reinit_sub(struct MPContext *mpctx, struct track *track);
 void reinit_sub_all(struct MPContext *mpctx);
+void update_sub_attachments(struct MPContext *mpctx);
 void uninit_sub(struct MPContext *mpctx, struct track *track);
 void uninit_sub_all(struct MPContext *mpctx);
 void update_osd_msg(struct MPContext *mpctx);
@@ -0,0 +1,490 @@
+/*
+ * Segment-parallel encoding (--osegments).
+ *
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavformat/avformat.h>
+
+#include "osdep/io.h"
+
+#include "mpv_talloc.h"
+#include "common/av_common.h"
+#include "common/common.h"
+#include "common/encode_lavc.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "input/input.h"
+#include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/threads.h"
+#include "stream/stream.h"
+#include "core.h"
+
+// How many packets to read after a seek while looking for a keyframe.
+#define MAX_PROBE_PACKETS 2000
+
+struct segment {
+    struct MPContext *parent;
+    mp_mutex *lock;
+    char **args;            // option list for the segment's player core
+    char *file;             // temporary output file
+    double start;           // first timestamp of the segment on the timeline
+    mp_thread thread;
+
+    // Guarded by lock.
+    struct MPContext *child;
+    bool abort;
+    bool done;
+    bool ok;
+};
+
+static MP_THREAD_VOID segment_thread(void *arg)
+{
+    struct segment *seg = arg;
+    mp_thread_set_name("segment");
+
+    bool ok = false;
+    struct MPContext *child = mp_create();
+    if (child) {
+        mp_mutex_lock(seg->lock);
+        seg->child = child;
+        bool abort = seg->abort;
+        mp_mutex_unlock(seg->lock);
+
+        if (!abort && mp_initialize(child, seg->args) == 0) {
+            mp_play_files(child);
+            ok = child->files_played && !child->files_errored &&
+                 !child->files_broken && child->stop_play != PT_QUIT;
+        }
+
+        mp_mutex_lock(seg->lock);
+        seg->child = NULL;
+        mp_mutex_unlock(seg->lock);
+
+        mp_destroy(child);
+    }
+
+    mp_mutex_lock(seg->lock);
+    seg->done = true;
+    seg->ok = ok;
+    mp_mutex_unlock(seg->lock);
+
+    mp_wakeup_core(seg->parent);
+    MP_THREAD_RETURN();
+}
+
+// Like rel_time_to_abs(), but against the probed file instead of the playing
+// one. base is the timeline position of the file start.
+static double resolve_time(struct m_rel_time t, double base, double length)
+{
+    switch (t.type) {
+    case REL_TIME_ABSOLUTE:
+        return t.pos;
+    case REL_TIME_RELATIVE:
+        if (t.pos >= 0)
+            return base + t.pos;
+        if (length >= 0)
+            return base + MPMAX(length + t.pos, 0.0);
+        break;
+    case REL_TIME_PERCENT:
+        if (length >= 0)
+            return base + length * (t.pos / 100.0);
+        break;
+    }
+    return MP_NOPTS_VALUE;
+}
+
+// Open the file, resolve --start/--end/--length, and put the boundaries of up
+// to num segments into b[0..num]. The inner boundaries are video keyframes, so
+// that each segment can start decoding without depending on the previous one.
+// Returns the number of segments, or 0 on failure. *out_base is set to the
+// timeline position of the file start.
+static int find_segments(struct MPContext *mpctx, const char *filename,
+                         int num, double *b, double *out_base)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .stream_flags = STREAM_ORIGIN_DIRECT | STREAM_LOCAL_FS_ONLY,
+    };
+    char *path = mp_get_user_path(NULL, mpctx->global, filename);
+    struct demuxer *demuxer = demux_open_url(path, &params,
+                                             mpctx->playback_abort,
+                                             mpctx->global);
+    talloc_free(path);
+    if (!demuxer) {
+        MP_WARN(mpctx, "--osegments: could not open the file.\n");
+        return 0;
+    }
+
+    int res = 0;
+    struct sh_stream *video = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (!video && sh->type == STREAM_VIDEO && !sh->attached_picture)
+            video = sh;
+    }
+    if (!video || !demuxer->seekable || demuxer->duration < 0) {
+        MP_WARN(mpctx, "--osegments: the file has no seekable video track "
+                "with a known duration.\n");
+        goto done;
+    }
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, sh == video);
+    }
+
+    double base = 0;
+    if (opts->rebase_start_time) {
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+    } else {
+        base = demuxer->start_time;
+    }
+    double length = demuxer->duration;
+
+    double start = resolve_time(opts->play_start, base, length);
+    if (start == MP_NOPTS_VALUE || start < base)
+        start = base;
+    double end = resolve_time(opts->play_end, base, length);
+    double play_length = resolve_time(opts->play_length, 0, length);
+    if (play_length != MP_NOPTS_VALUE &&
+        (end == MP_NOPTS_VALUE || start + play_length < end))
+        end = start + play_length;
+    if (end == MP_NOPTS_VALUE || end > base + length)
+        end = base + length;
+    if (end <= start)
+        goto done;
+
+    b[0] = start;
+    res = 1;
+    for (int k = 1; k < num; k++) {
+        double target = start + (end - start) * k / num;
+        demux_seek(demuxer, target, SEEK_FORWARD);
+        double pts = MP_NOPTS_VALUE;
+        for (int i = 0; i < MAX_PROBE_PACKETS && pts == MP_NOPTS_VALUE; i++) {
+            struct demux_packet *pkt = demux_read_any_packet(demuxer);
+            if (!pkt)
+                break;
+            if (pkt->keyframe)
+                pts = pkt->pts != MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            talloc_free(pkt);
+        }
+        // Keyframes can be sparse; several targets may map to the same one.
+        if (pts != MP_NOPTS_VALUE && pts > b[res - 1] && pts < end)
+            b[res++] = pts;
+    }
+    b[res] = end;
+    *out_base = base;
+
+done:
+    demux_free(demuxer);
+    return res;
+}
+
+// Remux the segment files into dst one after another, shifting each one by
+// its start on the timeline.
+static bool join_segments(struct MPContext *mpctx, const AVOutputFormat *ofmt,
+                          const char *dst, struct segment *segs, int num)
+{
+    struct encode_opts *eopts = mpctx->opts->encode_opts;
+    AVFormatContext *out = NULL;
+    AVFormatContext *in = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    MP_HANDLE_OOM(pkt);
+    int64_t *last_dts = NULL;
+    bool ok = false;
+
+    if (avformat_alloc_output_context2(&out, ofmt, NULL, dst) < 0)
+        goto done;
+
+    for (int k = 0; k < num; k++) {
+        if (avformat_open_input(&in, segs[k].file, NULL, NULL) < 0 ||
+            avformat_find_stream_info(in, NULL) < 0)
+        {
+            MP_ERR(mpctx, "Could not open segment '%s'.\n", segs[k].file);
+            goto done;
+        }
+
+        if (k == 0) {
+            for (int n = 0; n < in->nb_streams; n++) {
+                AVStream *ist = in->streams[n];
+                AVStream *ost = avformat_new_stream(out, NULL);
+                MP_HANDLE_OOM(ost);
+                if (avcodec_parameters_copy(ost->codecpar, ist->codecpar) < 0)
+                    goto done;
+                ost->codecpar->codec_tag = 0;
+                ost->time_base = ist->time_base;
+                av_dict_copy(&ost->metadata, ist->metadata, 0);
+            }
+            av_dict_copy(&out->metadata, in->metadata, 0);
+
+            last_dts = talloc_array(NULL, int64_t, out->nb_streams);
+            for (int n = 0; n < out->nb_streams; n++)
+                last_dts[n] = INT64_MIN;
+
+            if (!(ofmt->flags & AVFMT_NOFILE)) {
+                MP_INFO(mpctx, "Opening output file: %s\n", dst);
+                if (avio_open(&out->pb, dst, AVIO_FLAG_WRITE) < 0) {
+                    MP_ERR(mpctx, "could not open '%s'\n", dst);
+                    goto done;
+                }
+            }
+
+            AVDictionary *fopts = NULL;
+            mp_set_avdict(&fopts, eopts->fopts);
+            int r = avformat_write_header(out, &fopts);
+            av_dict_free(&fopts);
+            if (r < 0)
+                goto done;
+        }
+
+        bool match = in->nb_streams == out->nb_streams;
+        for (int n = 0; match && n < in->nb_streams; n++) {
+            match = in->streams[n]->codecpar->codec_type ==
+                    out->streams[n]->codecpar->codec_type;
+        }
+        if (!match) {
+            MP_ERR(mpctx, "Segment '%s' has different streams.\n", segs[k].file);
+            goto done;
+        }
+
+        double offset = segs[k].start - segs[0].start;
+        while (av_read_frame(in, pkt) >= 0) {
+            AVStream *ist = in->streams[pkt->stream_index];
+            AVStream *ost = out->streams[pkt->stream_index];
+            av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
+            int64_t shift = llrint(offset / av_q2d(ost->time_base));
+            if (pkt->pts != AV_NOPTS_VALUE)
+                pkt->pts += shift;
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                // Encoder delay at the start of a segment can make the DTS
+                // overlap with the end of the previous one.
+                int64_t *last = &last_dts[pkt->stream_index];
+                pkt->dts += shift;
+                if (*last != INT64_MIN && pkt->dts <= *last)
+                    pkt->dts = *last + 1;
+                if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+                    pkt->pts = pkt->dts;
+                *last = pkt->dts;
+            }
+            pkt->pos = -1;
+            if (av_interleaved_write_frame(out, pkt) < 0) {
+                MP_ERR(mpctx, "Error writing packet.\n");
+                goto done;
+            }
+        }
+        avformat_close_input(&in);
+    }
+
+    ok = av_write_trailer(out) >= 0;
+    if (out->pb && avio_closep(&out->pb) < 0)
+        ok = false;
+
+done:
+    avformat_close_input(&in);
+    if (out && out->pb && !(ofmt->flags & AVFMT_NOFILE))
+        avio_closep(&out->pb);
+    avformat_free_context(out);
+    av_packet_free(&pkt);
+    talloc_free(last_dts);
+    return ok;
+}
+
+static void abort_segments(struct segment *segs, int num)
+{
+    for (int n = 0; n < num; n++) {
+        struct segment *seg = &segs[n];
+        mp_mutex_lock(seg->lock);
+        seg->abort = true;
+        if (seg->child) {
+            struct input_ctx *input = seg->child->input;
+            mp_input_queue_cmd(input, mp_input_parse_cmd(input, bstr0("quit"),
+                                                         "<segment>"));
+        }
+        mp_mutex_unlock(seg->lock);
+    }
+}
+
+// If --osegments applies, encode the single playlist entry as that many
+// segments in parallel and join them, instead of playing the playlist.
+// options is the command line the player was initialized with. Returns false
+// if the caller should use mp_play_files() as usual.
+bool mp_encode_segments(struct MPContext *mpctx, char **options)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct encode_opts *eopts = opts->encode_opts;
+    int num = eopts->segments;
+    if (num < 2 || !mpctx->encode_lavc_ctx)
+        return false;
+
+    const char *reason = NULL;
+    struct playlist *pl = mpctx->playlist;
+    const char *filename =
+        pl->num_entries == 1 ? pl->entries[0]->filename : NULL;
+    if (!filename) {
+        reason = "needs exactly one input file";
+    } else if (mp_is_url(bstr0(filename)) &&
+               !bstr_startswith0(bstr0(filename), "file://"))
+    {
+        reason = "needs a local input file";
+    } else if (!strcmp(eopts->file, "-")) {
+        reason = "cannot write to stdout";
+    } else if (eopts->rawts) {
+        reason = "not supported with --orawts";
+    } else if (opts->play_start.type == REL_TIME_CHAPTER ||
+               opts->play_end.type == REL_TIME_CHAPTER ||
+               opts->play_length.type == REL_TIME_CHAPTER)
+    {
+        reason = "chapter times are not supported";
+    }
+    if (reason) {
+        MP_WARN(mpctx, "--osegments: %s, encoding in one piece.\n", reason);
+        return false;
+    }
+
+    double *b = talloc_array(NULL, double, num + 1);
+    double base = 0;
+    num = find_segments(mpctx, filename, num, b, &base);
+    if (num < 2) {
+        MP_WARN(mpctx, "--osegments: could not split the input, encoding "
+                "in one piece.\n");
+        talloc_free(b);
+        return false;
+    }
+
+    bool user_end = opts->play_end.type != REL_TIME_NONE ||
+                    opts->play_length.type != REL_TIME_NONE;
+
+    // The segments write their own files; the joined output is muxed here.
+    struct encode_lavc_context *ectx = mpctx->encode_lavc_ctx;
+    const AVOutputFormat *ofmt = ectx->oformat;
+    char *dst = mp_get_user_path(b, mpctx->global, eopts->file);
+    encode_lavc_discard(ectx);
+    mpctx->encode_lavc_ctx = NULL;
+
+    MP_INFO(mpctx, "Encoding %d segments in parallel.\n", num);
+
+    mp_mutex lock;
+    mp_mutex_init(&lock);
+    struct segment *segs = talloc_zero_array(b, struct segment, num);
+    int num_started = 0;
+    for (int k = 0; k < num; k++) {
+        struct segment *seg = &segs[k];
+        seg->parent = mpctx;
+        seg->lock = &lock;
+        seg->start = b[k];
+        seg->file = talloc_asprintf(b, "%s.part%d", dst, k);
+
+        int num_args = 0;
+        for (int n = 0; options && options[n]; n++)
+            MP_TARRAY_APPEND(b, seg->args, num_args, options[n]);
+        char *extra[] = {
+            talloc_asprintf(b, "--start=%.6f", b[k] - base),
+            k + 1 < num || user_end
+                ? talloc_asprintf(b, "--end=%.6f", b[k + 1] - base)
+                : "--end=none",
+            "--length=none",
+            talloc_asprintf(b, "--o=%s", seg->file),
+            talloc_asprintf(b, "--of=%s", ofmt->name),
+            "--osegments=1",
+            "--resume-playback=no",
+            "--save-position-on-quit=no",
+            "--loop-file=no",
+            "--loop-playlist=no",
+            "--idle=no",
+            "--keep-open=no",
+            "--load-scripts=no",
+            "--input-ipc-server=",
+            "--input-terminal=no",
+            "--quiet",
+            "--msg-level=all=warn",
+        };
+        for (int n = 0; n < MP_ARRAY_SIZE(extra); n++)
+            MP_TARRAY_APPEND(b, seg->args, num_args, extra[n]);
+        MP_TARRAY_APPEND(b, seg->args, num_args, NULL);
+
+        MP_VERBOSE(mpctx, "Segment %d: %f - %f\n", k, b[k], b[k + 1]);
+        if (mp_thread_create(&seg->thread, segment_thread, seg)) {
+            MP_ERR(mpctx, "Could not start segment thread.\n");
+            break;
+        }
+        num_started++;
+    }
+
+    bool ok = num_started == num;
+    if (!ok)
+        abort_segments(segs, num_started);
+
+    bool aborted = false;
+    int num_reported = 0;
+    while (1) {
+        int num_done = 0;
+        bool failed = false;
+        mp_mutex_lock(&lock);
+        for (int k = 0; k < num_started; k++) {
+            num_done += segs[k].done;
+            failed |= segs[k].done && !segs[k].ok;
+        }
+        mp_mutex_unlock(&lock);
+        if (num_done > num_reported) {
+            MP_INFO(mpctx, "Segments done: %d/%d\n", num_done, num);
+            num_reported = num_done;
+        }
+        if (num_done == num_started)
+            break;
+        if (!aborted && (failed || mpctx->stop_play == PT_QUIT)) {
+            abort_segments(segs, num_started);
+            aborted = true;
+        }
+        mp_idle(mpctx);
+    }
+
+    for (int k = 0; k < num_started; k++) {
+        mp_thread_join(segs[k].thread);
+        ok &= segs[k].ok;
+    }
+    mp_mutex_destroy(&lock);
+
+    if (ok) {
+        MP_INFO(mpctx, "Joining segments.\n");
+        ok = join_segments(mpctx, ofmt, dst, segs, num);
+    }
+    if (!ok && mpctx->stop_play != PT_QUIT)
+        MP_ERR(mpctx, "Segment-parallel encoding failed.\n");
+
+    for (int k = 0; k < num_started; k++)
+        unlink(segs[k].file);
+
+    if (ok) {
+        mpctx->files_played++;
+    } else {
+        mpctx->files_errored++;
+    }
+
+    talloc_free(b);
+    return true;
+}
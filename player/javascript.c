@@ -63,6 +63,12 @@ struct script_ctx {
     char *last_error_str;
     size_t js_malloc_size;
     struct stats_ctx *stats;
+    // All handles in the prop_refs registry object (freed on unload).
+    mpv_property_ref **prop_refs;
+    int num_prop_refs;
+    js_State *state;
+    bool hosted;        // running on the shared script threads
+    bool loop_deferred; // hosted, and the default event loop wasn't run
 };
 
 static struct script_ctx *jctx(js_State *J)
@@ -77,6 +83,7 @@ static mpv_handle *jclient(js_State *J)
 
 static void pushnode(js_State *J, mpv_node *node);
 static void makenode(void *ta_ctx, mpv_node *dst, js_State *J, int idx);
+static int get_obj_properties(void *ta_ctx, char ***keys, js_State *J, int idx);
 static int jsL_checkint(js_State *J, int idx);
 static uint64_t jsL_checkuint64(js_State *J, int idx);
 
@@ -432,10 +439,22 @@ static void script__run_script(js_State *J)
     struct script_ctx *ctx = jctx(J);
     add_functions(J, ctx);
     run_file(J, "@/defaults.js");
+    js_getglobal(J, "mp_event_loop");
+    js_setregistry(J, "default_event_loop");
     run_file(J, ctx->filename);  // the main file to run
 
     if (!js_hasproperty(J, 0, "mp_event_loop") || !js_iscallable(J, -1))
         js_error(J, "no event loop function");
+    if (ctx->hosted) {
+        // Scripts with their own event loop can't be dispatched from outside.
+        js_getregistry(J, "default_event_loop");
+        if (js_strictequal(J)) {
+            ctx->loop_deferred = true;
+            js_pop(J, 2);
+            return;
+        }
+        js_pop(J, 1);
+    }
     js_copy(J, 0);
     js_call(J, 0); // mp_event_loop
 }
@@ -466,6 +485,8 @@ static int s_init_js(js_State *J, struct script_ctx *ctx)
         return 1;
     js_setcontext(J, ctx);
     js_setreport(J, report_handler);
+    js_newobject(J);
+    js_setregistry(J, "prop_refs");  // used by get_prop_ref
     js_newcfunction(J, script__run_script, "run_script", 0);
     js_pushglobal(J);  // 'this' for script__run_script
     js_endtry(J);
@@ -502,7 +523,19 @@ static void *mp_js_alloc(void *actx, void *ptr, int size_)
 //
 // Note: init functions don't need autofree. They can use ctx as a talloc
 // context and free normally. If they throw - ctx is freed right afterwards.
-static int s_load_javascript(struct mp_script_args *args)
+static void s_unload_javascript(void *p)
+{
+    struct script_ctx *ctx = p;
+    if (ctx->state)
+        js_freestate(ctx->state);
+
+    for (int n = 0; n < ctx->num_prop_refs; n++)
+        mpv_free(ctx->prop_refs[n]);
+    talloc_free(ctx);
+}
+
+// If state is not NULL, the script is hosted (see mp_scripting.start()).
+static int s_run_javascript(struct mp_script_args *args, void **state)
 {
     struct script_ctx *ctx = talloc_ptrtype(NULL, ctx);
     *ctx = (struct script_ctx) {
@@ -515,9 +548,12 @@ static int s_load_javascript(struct mp_script_args *args)
         .js_malloc_size = 0,
         .stats = stats_ctx_create(ctx, args->mpctx->global,
                     mp_tprintf(80, "script/%s", mpv_client_name(args->client))),
+        .hosted = !!state,
     };
 
-    stats_register_thread_cputime(ctx->stats, "cpu");
+    // The shared script threads run many scripts.
+    if (!ctx->hosted)
+        stats_register_thread_cputime(ctx->stats, "cpu");
 
     js_Alloc alloc_fn = NULL;
     void *actx = NULL;
@@ -528,7 +564,7 @@ static int s_load_javascript(struct mp_script_args *args)
     }
 
     int r = -1;
-    js_State *J = js_newstate(alloc_fn, actx, 0);
+    js_State *J = ctx->state = js_newstate(alloc_fn, actx, 0);
     if (!J || s_init_js(J, ctx))
         goto error_out;
 
@@ -540,16 +576,52 @@ static int s_load_javascript(struct mp_script_args *args)
 
     r = 0;
 
+    if (ctx->loop_deferred) {
+        js_pop(J, 1);  // return value of script__run_script
+        *state = ctx;
+        return r;
+    }
+
 error_out:
     if (r)
         MP_FATAL(ctx, "%s\n", ctx->last_error_str);
-    if (J)
-        js_freestate(J);
-
-    talloc_free(ctx);
+    s_unload_javascript(ctx);
     return r;
 }
 
+static int s_load_javascript(struct mp_script_args *args)
+{
+    return s_run_javascript(args, NULL);
+}
+
+static int s_start_javascript(struct mp_script_args *args, void **state)
+{
+    *state = NULL;
+    return s_run_javascript(args, state);
+}
+
+// Call mp_dispatch_events() once, which doesn't wait for new events.
+static bool s_dispatch_javascript(void *p, double *timeout)
+{
+    struct script_ctx *ctx = p;
+    js_State *J = ctx->state;
+    if (js_try(J)) {
+        s_top_to_last_error(ctx, J);
+        MP_FATAL(ctx, "%s\n", ctx->last_error_str);
+        return false;
+    }
+    js_getglobal(J, "mp_dispatch_events");
+    js_pushglobal(J);
+    js_call(J, 0);
+    *timeout = js_tonumber(J, -1);
+    js_getglobal(J, "mp");
+    js_getproperty(J, -1, "keep_running");
+    bool keep_running = js_toboolean(J, -1);
+    js_pop(J, 3);
+    js_endtry(J);
+    return keep_running;
+}
+
 /**********************************************************************
  *  Main mp.* scripting APIs and helpers
  *********************************************************************/
@@ -736,6 +808,120 @@ static void script_get_property_native(js_State *J, void *af)
         pushnode(J, presult_node);
 }
 
+// Return the handle for the given property, resolving it on first use. The
+// handles are cached in the prop_refs registry object. Returns NULL if the
+// property does not exist.
+static mpv_property_ref *get_prop_ref(js_State *J, const char *name)
+{
+    struct script_ctx *ctx = jctx(J);
+    mpv_property_ref *ref = NULL;
+    js_getregistry(J, "prop_refs");
+    if (js_hasproperty(J, -1, name)) {
+        if (js_isuserdata(J, -1, "prop_ref"))
+            ref = js_touserdata(J, -1, "prop_ref");
+        js_pop(J, 1);
+    }
+    if (!ref) {
+        ref = mpv_resolve_property(ctx->client, name);
+        if (ref) {
+            MP_TARRAY_APPEND(ctx, ctx->prop_refs, ctx->num_prop_refs, ref);
+            js_pushnull(J);  // a prototype for the userdata object
+            js_newuserdata(J, "prop_ref", ref, NULL);
+            js_setproperty(J, -2, name);
+        }
+    }
+    js_pop(J, 1);
+    return ref;
+}
+
+// Set the property at the object at index obj, or delete it on error.
+static void set_property_ref(js_State *J, void *af, int obj, const char *name,
+                             mpv_format format)
+{
+    mpv_handle *h = jclient(J);
+    mpv_property_ref *ref = get_prop_ref(J, name);
+    int e = MPV_ERROR_PROPERTY_NOT_FOUND;
+
+    switch (format) {
+    case MPV_FORMAT_DOUBLE: {
+        double v = 0;
+        if (ref)
+            e = mpv_get_property_ref(h, ref, format, &v);
+        if (e >= 0)
+            js_pushnumber(J, v);
+        break;
+    }
+    case MPV_FORMAT_FLAG: {
+        int v = 0;
+        if (ref)
+            e = mpv_get_property_ref(h, ref, format, &v);
+        if (e >= 0)
+            js_pushboolean(J, v);
+        break;
+    }
+    case MPV_FORMAT_STRING: {
+        char *v = NULL;
+        if (ref)
+            e = mpv_get_property_ref(h, ref, format, &v);
+        if (e >= 0) {
+            add_af_mpv_alloc(af, v);
+            js_pushstring(J, v);
+        }
+        break;
+    }
+    default: {
+        mpv_node *node = new_af_mpv_node(af);
+        if (ref)
+            e = mpv_get_property_ref(h, ref, MPV_FORMAT_NODE, node);
+        if (e >= 0)
+            pushnode(J, node);
+        break;
+    }
+    }
+
+    if (e >= 0) {
+        js_setproperty(J, obj, name);
+    } else {
+        js_delproperty(J, obj, name);
+    }
+}
+
+// args: array of names or object of name: type [,result object]
+static void script_get_properties(js_State *J, void *af)
+{
+    const char *fmts[] = {"native", "bool", "string", "number", NULL};
+    const mpv_format mf[] = {MPV_FORMAT_NODE, MPV_FORMAT_FLAG,
+                             MPV_FORMAT_STRING, MPV_FORMAT_DOUBLE};
+
+    if (!js_isobject(J, 1))
+        js_error(J, "properties must be an array or an object");
+    if (js_isobject(J, 2)) {
+        js_copy(J, 2);
+    } else {
+        js_newobject(J);
+    }
+    int obj = js_gettop(J) - 1;
+
+    if (js_isarray(J, 1)) {
+        int length = js_getlength(J, 1);
+        for (int n = 0; n < length; n++) {
+            js_getindex(J, 1, n);
+            char *name = talloc_strdup(af, js_tostring(J, -1));
+            js_pop(J, 1);
+            set_property_ref(J, af, obj, name, MPV_FORMAT_NODE);
+        }
+    } else {
+        char **keys;
+        int length = get_obj_properties(af, &keys, J, 1);
+        for (int n = 0; n < length; n++) {
+            js_getproperty(J, 1, keys[n]);
+            mpv_format f = mf[checkopt(J, -1, "native", fmts, "property type")];
+            js_pop(J, 1);
+            set_property_ref(J, af, obj, keys[n], f);
+        }
+    }
+}
+
 // args: name [,def]
 static void script_get_property_osd(js_State *J, void *af)
 {
@@ -1176,6 +1362,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_property_bool, 2),
     FN_ENTRY(get_property_number, 2),
     AF_ENTRY(get_property_native, 2),
+    AF_ENTRY(get_properties, 2),
     AF_ENTRY(get_property, 2),
     AF_ENTRY(get_property_osd, 2),
     FN_ENTRY(set_property, 2),
@@ -1254,4 +1441,7 @@ const struct mp_scripting mp_scripting_js = {
     .name = "js",
     .file_ext = "js",
     .load = s_load_javascript,
+    .start = s_start_javascript,
+    .dispatch = s_dispatch_javascript,
+    .unload = s_unload_javascript,
 };
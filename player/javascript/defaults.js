@@ -807,6 +807,25 @@ g.mp_event_loop = function mp_event_loop() {
     } while (mp.keep_running);
 };
 
+// Used instead of mp_event_loop with --script-threads: dispatch the queued
+// events, timers and idle observers without waiting. Returns the wait in
+// seconds till the next timer, or a negative value if nothing pends.
+g.mp_dispatch_events = function mp_dispatch_events() {
+    var wait = 0;
+    while (mp.keep_running && wait == 0) {
+        var e = mp.wait_event(0);
+        if (e.event != "none") {
+            dispatch_event(e);
+        } else {
+            wait = process_timers() / 1000;
+            if (wait != 0 && iobservers.length) {
+                notify_idle_observers();
+                wait = peek_timers_wait() / 1000;
+            }
+        }
+    }
+    return wait;
+};
 
 // let the user extend us, e.g. by adding items to mp.module_paths
 var initjs = mp.find_config_file("init.js");  // ~~/init.js
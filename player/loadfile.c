@@ -19,12 +19,14 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <math.h>
 #include <time.h>
 
 #include <libavutil/avutil.h>
 
 #include "mpv_talloc.h"
 
+#include "misc/dispatch.h"
 #include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "osdep/io.h"
@@ -205,6 +207,13 @@ static void uninit_demuxer(struct MPContext *mpctx)
 
     struct demuxer **demuxers = NULL;
     int num_demuxers = 0;
+
+    // Reads from mpctx->demuxer, so get rid of it before recycling.
+    TA_FREEP(&mpctx->preload_dec);
+    TA_FREEP(&mpctx->preload_adec);
+
+    // Nothing is playing from the network anymore.
+    mp_preload_update_playback(INFINITY, false);
     
     // Track recycled demuxer to exclude it from cleanup
     struct demuxer *recycled_demuxer = NULL;
@@ -397,6 +406,8 @@ void update_demuxer_properties(struct MPContext *mpctx)
     }
     if (events & DEMUX_EVENT_DURATION)
         mp_notify(mpctx, MP_EVENT_DURATION_UPDATE, NULL);
+    if ((events & DEMUX_EVENT_ATTACHMENTS) && !(events & DEMUX_EVENT_INIT))
+        update_sub_attachments(mpctx);
     demuxer->events = 0;
 }
 
@@ -865,6 +876,107 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
     return true;
 }
 
+struct ext_prefetch {
+    char *path;
+    char *filename;
+    struct demuxer_params params;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    struct mp_waiter waiter;
+    struct demuxer *demuxer;    // result, valid after waiter was woken up
+};
+
+static struct demuxer_params external_file_params(struct MPOpts *opts,
+                                                  enum stream_type filter)
+{
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+        .allow_playlist_create = false,
+    };
+
+    switch (filter) {
+    case STREAM_SUB:
+        params.force_format = opts->sub_demuxer_name;
+        break;
+    case STREAM_AUDIO:
+        params.force_format = opts->audio_demuxer_name;
+        break;
+    }
+
+    return params;
+}
+
+static void sub_prefetch_thread(void *p)
+{
+    struct ext_prefetch *e = p;
+    e->demuxer = demux_open_url(e->path, &e->params, e->cancel, e->global);
+    mp_waiter_wakeup(&e->waiter, 0);
+}
+
+// Start opening --sub-files, so that large subtitle files are read while the
+// main file is opened. mp_add_external_file() picks up the results.
+static void start_sub_prefetch(struct MPContext *mpctx)
+{
+    char **files = mpctx->opts->sub_name;
+    for (int n = 0; files && files[n]; n++) {
+        struct ext_prefetch *e = talloc_ptrtype(NULL, e);
+        *e = (struct ext_prefetch){
+            .path = mp_get_user_path(e, mpctx->global, files[n]),
+            .filename = talloc_strdup(e, files[n]),
+            .params = external_file_params(mpctx->opts, STREAM_SUB),
+            .global = mpctx->global,
+            .cancel = mp_cancel_new(e),
+            .waiter = MP_WAITER_INITIALIZER,
+        };
+        e->params.force_format = talloc_strdup(e, e->params.force_format);
+        mp_cancel_set_parent(e->cancel, mpctx->playback_abort);
+        if (!mp_thread_pool_queue(mpctx->thread_pool, sub_prefetch_thread, e)) {
+            talloc_free(e);
+            continue;
+        }
+        MP_TARRAY_APPEND(mpctx, mpctx->sub_prefetch, mpctx->num_sub_prefetch, e);
+    }
+}
+
+// Return and remove the prefetch entry for filename, or NULL.
+static struct ext_prefetch *take_sub_prefetch(struct MPContext *mpctx,
+                                              const char *filename)
+{
+    for (int n = 0; n < mpctx->num_sub_prefetch; n++) {
+        struct ext_prefetch *e = mpctx->sub_prefetch[n];
+        if (strcmp(e->filename, filename) == 0) {
+            MP_TARRAY_REMOVE_AT(mpctx->sub_prefetch, mpctx->num_sub_prefetch, n);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Wait for the prefetch and return its demuxer, which is now controlled by
+// cancel. Frees e.
+static struct demuxer *finish_sub_prefetch(struct ext_prefetch *e,
+                                           struct mp_cancel *cancel)
+{
+    mp_waiter_wait(&e->waiter);
+    struct demuxer *demuxer = e->demuxer;
+    if (demuxer)
+        mp_cancel_set_parent(demuxer->cancel, cancel);
+    talloc_free(e);
+    return demuxer;
+}
+
+// Abort prefetches that weren't used (e.g. the option was changed by a hook).
+static void cancel_sub_prefetch(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_sub_prefetch; n++) {
+        struct ext_prefetch *e = mpctx->sub_prefetch[n];
+        mp_cancel_trigger(e->cancel);
+        demux_cancel_and_free(finish_sub_prefetch(e, NULL));
+    }
+    mpctx->num_sub_prefetch = 0;
+}
+
 // Add the given file as additional track. The filter argument controls how or
 // if tracks are auto-selected at any point.
 // To be run on a worker thread, locked (temporarily unlocks core).
@@ -886,27 +998,20 @@ int mp_add_external_file(struct MPContext *mpctx, char *filename,
         disp_filename = unescaped_url = mp_url_unescape(NULL, disp_filename);
     }
 
-    struct demuxer_params params = {
-        .is_top_level = true,
-        .stream_flags = STREAM_ORIGIN_DIRECT,
-        .allow_playlist_create = false,
-    };
-
-    switch (filter) {
-    case STREAM_SUB:
-        params.force_format = opts->sub_demuxer_name;
-        break;
-    case STREAM_AUDIO:
-        params.force_format = opts->audio_demuxer_name;
-        break;
-    }
+    struct demuxer_params params = external_file_params(opts, filter);
+    struct ext_prefetch *prefetch =
+        filter == STREAM_SUB ? take_sub_prefetch(mpctx, filename) : NULL;
 
     mp_core_unlock(mpctx);
 
-    char *path = mp_get_user_path(NULL, mpctx->global, filename);
-    struct demuxer *demuxer =
-        demux_open_url(path, &params, cancel, mpctx->global);
-    talloc_free(path);
+    struct demuxer *demuxer = NULL;
+    if (prefetch) {
+        demuxer = finish_sub_prefetch(prefetch, cancel);
+    } else {
+        char *path = mp_get_user_path(NULL, mpctx->global, filename);
+        demuxer = demux_open_url(path, &params, cancel, mpctx->global);
+        talloc_free(path);
+    }
 
     if (demuxer)
         enable_demux_thread(mpctx, demuxer);
@@ -1001,6 +1106,7 @@ static void open_external_files(struct MPContext *mpctx, char **files,
 }
 
 // See mp_add_external_file() for meaning of cancel parameter.
+// to be run on a worker thread, locked (temporarily unlocks core)
 void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -1011,9 +1117,22 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
         return;
 
     void *tmp = talloc_new(NULL);
-    struct subfn *list = find_external_files(mpctx->global, mpctx->filename, opts);
+
+    // Scanning directories is slow on network filesystems. Do it with the core
+    // unlocked, on a snapshot of the options and the filename.
+    struct playlist_entry *playing = mpctx->playing;
+    struct MPOpts *opts_copy = mp_get_config_group(tmp, mpctx->global, &mp_opt_root);
+    char *filename = talloc_strdup(tmp, mpctx->filename);
+    mp_core_unlock(mpctx);
+    struct subfn *list = find_external_files(mpctx->global, filename, opts_copy);
+    mp_core_lock(mpctx);
     talloc_steal(tmp, list);
 
+    if (mpctx->playing != playing || mp_cancel_test(cancel)) {
+        talloc_free(tmp);
+        return;
+    }
+
     int sc[STREAM_TYPE_COUNT] = {0};
     for (int n = 0; n < mpctx->num_tracks; n++) {
         if (!mpctx->tracks[n]->attached_picture)
@@ -1166,6 +1285,37 @@ static void load_per_file_options(m_config_t *conf,
     }
 }
 
+static void wakeup_dispatch(void *ctx)
+{
+    mp_dispatch_interrupt(ctx);
+}
+
+// --prefetch-playlist-decoders: create the decoders of the prefetched file and
+// decode their first frames. Run by open_thread.
+static void prewarm_decoders(struct MPContext *mpctx, struct demuxer *demux)
+{
+    struct mp_dispatch_queue *dispatch = mp_dispatch_create(NULL);
+    mp_cancel_set_cb(mpctx->open_cancel, wakeup_dispatch, dispatch);
+
+    // The decoder would be created without the VO's hwdec interop, and then
+    // stay on software decoding.
+    if (!vd_lavc_hwdec_requested(mpctx->global)) {
+        mpctx->open_res_vdec =
+            mp_preload_decoder_create(mpctx->global, demux, STREAM_VIDEO,
+                                      mpctx->open_cancel, dispatch);
+    }
+    mpctx->open_res_adec =
+        mp_preload_decoder_create(mpctx->global, demux, STREAM_AUDIO,
+                                  mpctx->open_cancel, dispatch);
+
+    MP_VERBOSE(mpctx, "Prewarmed decoders:%s%s\n",
+               mpctx->open_res_vdec ? " video" : "",
+               mpctx->open_res_adec ? " audio" : "");
+
+    mp_cancel_set_cb(mpctx->open_cancel, NULL, NULL);
+    talloc_free(dispatch);
+}
+
 static MP_THREAD_VOID open_demux_thread(void *ctx)
 {
     struct MPContext *mpctx = ctx;
@@ -1180,9 +1330,13 @@ static MP_THREAD_VOID open_demux_thread(void *ctx)
         .allow_playlist_create = mpctx->playlist->num_entries <= 1 &&
                                  !mpctx->playlist->playlist_dir,
     };
-    struct demuxer *demux =
+    struct demuxer *demux = mpctx->open_shared ?
+        mp_preload_open_shared(mpctx->open_url, &p, mpctx->open_cancel,
+                               mpctx->global) :
         demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
     mpctx->open_res_demuxer = demux;
+    mpctx->open_res_stream_ns = p.stream_opened_ns;
+    mpctx->open_res_demux_ns = demux ? mp_time_ns() : 0;
 
     if (demux) {
         MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
@@ -1197,6 +1351,9 @@ static MP_THREAD_VOID open_demux_thread(void *ctx)
             demux_set_wakeup_cb(demux, wakeup_demux, mpctx);
             demux_start_thread(demux);
             demux_start_prefetch(demux);
+
+            if (mpctx->open_decoders)
+                prewarm_decoders(mpctx, demux);
         }
     } else {
         MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", mpctx->open_url);
@@ -1222,6 +1379,9 @@ static void cancel_open(struct MPContext *mpctx)
         mp_thread_join(mpctx->open_thread);
     mpctx->open_active = false;
 
+    // (Read from open_res_demuxer.)
+    TA_FREEP(&mpctx->open_res_vdec);
+    TA_FREEP(&mpctx->open_res_adec);
     if (mpctx->open_res_demuxer)
         demux_cancel_and_free(mpctx->open_res_demuxer);
     mpctx->open_res_demuxer = NULL;
@@ -1249,7 +1409,13 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags,
     mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
     mpctx->open_url_flags = url_flags;
     mpctx->open_for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+    mpctx->open_decoders = mpctx->open_for_prefetch &&
+                           mpctx->opts->prefetch_decoders;
+    // Prefetching would only make the source run for nothing.
+    mpctx->open_shared = !for_prefetch && mpctx->opts->shared_source &&
+                         mp_is_url(bstr0(url));
     mpctx->demuxer_changed = false;
+    mpctx->open_res_stream_ns = mpctx->open_res_demux_ns = 0;
 
     if (mp_thread_create(&mpctx->open_thread, open_demux_thread, mpctx)) {
         cancel_open(mpctx);
@@ -1259,14 +1425,63 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags,
     mpctx->open_active = true;
 }
 
+// Log how the preload of the now playing file went, and make it visible in the
+// stats page.
+static void report_preload_timing(struct MPContext *mpctx, const char *url)
+{
+    mpv_preload_info info;
+    if (mpv_preload_get_info(url, &info) < 0)
+        return;
+
+    MP_VERBOSE(mpctx, "Preload timing: opening %.3fs, connected %.3fs, "
+               "header %.3fs, first packet %.3fs, ready %.3fs, cached %.3fs, "
+               "%.0f KiB/s\n", info.time_opening, info.time_connected,
+               info.time_header, info.time_first_packet, info.time_ready,
+               info.time_cached, info.download_rate / 1024);
+
+    stats_value(mpctx->stats, "preload-connected", info.time_connected);
+    stats_value(mpctx->stats, "preload-header", info.time_header);
+    stats_value(mpctx->stats, "preload-first-packet", info.time_first_packet);
+    stats_value(mpctx->stats, "preload-ready", info.time_ready);
+    stats_size_value(mpctx->stats, "preload-rate", info.download_rate);
+}
+
+// Record when a phase of the current load or seek was reached, for the
+// load-timing and seek-timing properties. Only the first time is kept.
+void mark_load_timing(struct MPContext *mpctx, enum mp_load_phase phase)
+{
+    int64_t now = mp_time_ns();
+    struct mp_load_timing *timings[] = {&mpctx->load_timing, &mpctx->seek_timing};
+    for (int n = 0; n < MP_ARRAY_SIZE(timings); n++) {
+        struct mp_load_timing *t = timings[n];
+        if (t->t[LOAD_PHASE_START] && !t->t[phase])
+            t->t[phase] = now;
+    }
+}
+
+// The opener thread may have run before the load started (prefetching), in
+// which case these phases took no time for this load.
+static void set_open_timing(struct MPContext *mpctx, int64_t opened,
+                            int64_t probed)
+{
+    struct mp_load_timing *t = &mpctx->load_timing;
+    t->t[LOAD_PHASE_OPEN] = MPMAX(opened, t->t[LOAD_PHASE_START]);
+    t->t[LOAD_PHASE_PROBE] = MPMAX(probed, t->t[LOAD_PHASE_OPEN]);
+}
+
 static void open_demux_reentrant(struct MPContext *mpctx)
 {
     char *url = mpctx->stream_open_filename;
     
-    // Check preload cache first
-    struct demuxer *preloaded = mpv_preload_get_demuxer(url, mpctx->open_cancel);
+    // Check preload cache first (with --shared-source, a preloaded demuxer
+    // becomes the shared source instead)
+    bool shared = mpctx->opts->shared_source && mp_is_url(bstr0(url));
+    struct demuxer *preloaded = shared ? NULL :
+        mpv_preload_get_demuxer(url, mpctx->open_cancel, &mpctx->preload_dec);
     if (preloaded) {
         MP_VERBOSE(mpctx, "Using preloaded demuxer for: %s\n", url);
+        report_preload_timing(mpctx, url);
+        set_open_timing(mpctx, mp_time_ns(), 0);
         mpctx->demuxer = preloaded;
         // Save URL for recycling when player closes
         mpctx->preload_url = talloc_strdup(mpctx, url);
@@ -1324,6 +1539,11 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     if (mpctx->open_res_demuxer) {
         mpctx->demuxer = mpctx->open_res_demuxer;
         mpctx->open_res_demuxer = NULL;
+        set_open_timing(mpctx, mpctx->open_res_stream_ns,
+                        mpctx->open_res_demux_ns);
+        mpctx->preload_dec = mpctx->open_res_vdec;
+        mpctx->preload_adec = mpctx->open_res_adec;
+        mpctx->open_res_vdec = mpctx->open_res_adec = NULL;
         mp_cancel_set_parent(mpctx->demuxer->cancel, mpctx->playback_abort);
     } else {
         mpctx->error_playing = mpctx->open_res_error;
@@ -1729,6 +1949,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->filter_root = mp_filter_create_root(mpctx->global);
     mp_filter_graph_set_wakeup_cb(mpctx->filter_root, mp_wakeup_core_cb, mpctx);
     mp_filter_graph_set_max_run_time(mpctx->filter_root, 0.1);
+    mp_filter_graph_set_threads(mpctx->filter_root, opts->filter_threads);
 
     reset_playback_state(mpctx);
 
@@ -1774,6 +1995,11 @@ static void play_current_file(struct MPContext *mpctx)
 
     mpctx->max_frames = opts->play_frames;
 
+    mpctx->load_timing = (struct mp_load_timing){
+        .t[LOAD_PHASE_START] = mp_time_ns(),
+    };
+    mpctx->seek_timing = (struct mp_load_timing){0};
+
     handle_force_window(mpctx, false);
 
     if (mpctx->playlist->num_entries > 1 ||
@@ -1792,6 +2018,8 @@ static void play_current_file(struct MPContext *mpctx)
         goto terminate_playback;
     }
 
+    start_sub_prefetch(mpctx);
+
     open_demux_reentrant(mpctx);
     if (!mpctx->stop_play && !mpctx->demuxer) {
         process_hooks(mpctx, "on_load_fail");
@@ -1831,9 +2059,15 @@ static void play_current_file(struct MPContext *mpctx)
     add_demuxer_tracks(mpctx, mpctx->demuxer);
 
     load_external_opts(mpctx);
+    cancel_sub_prefetch(mpctx);
     if (mpctx->stop_play)
         goto terminate_playback;
 
+    // Chapter starts are likely seek targets (--demuxer-seek-prefetch). Add
+    // them in reverse, so the first chapters are prefetched first.
+    for (int n = mpctx->num_chapters - 1; n >= 0; n--)
+        demux_add_seek_hint(mpctx->demuxer, mpctx->chapters[n].pts);
+
     check_previous_track_selection(mpctx);
 
     process_hooks(mpctx, "on_preloaded");
@@ -1895,6 +2129,11 @@ static void play_current_file(struct MPContext *mpctx)
 
     reinit_video_chain(mpctx);
     reinit_audio_chain(mpctx);
+    mark_load_timing(mpctx, LOAD_PHASE_DECODER_INIT);
+
+    // Not used by the selected tracks.
+    TA_FREEP(&mpctx->preload_dec);
+    TA_FREEP(&mpctx->preload_adec);
     reinit_sub_all(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
@@ -2008,6 +2247,7 @@ terminate_playback:
     mpctx->playback_initialized = false;
 
     uninit_demuxer(mpctx);
+    cancel_sub_prefetch(mpctx);
 
     // Possibly stop ongoing async commands.
     mp_abort_playback_async(mpctx);
@@ -110,6 +110,13 @@ struct script_ctx {
     lua_Alloc lua_allocf;
     void *lua_alloc_ud;
     struct stats_ctx *stats;
+    // All handles in the PROP_REFS registry table (freed on unload).
+    mpv_property_ref **prop_refs;
+    int num_prop_refs;
+    bool hosted;        // running on the shared script threads
+    bool loop_deferred; // hosted, and the default event loop wasn't run
+    bool keep_running;  // result of dispatch_lua()
+    double timeout;     // result of dispatch_lua()
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -328,6 +335,9 @@ static int load_scripts(lua_State *L)
 
     require(L, "mp.defaults");
 
+    lua_getglobal(L, "mp_event_loop"); // fn
+    lua_setfield(L, LUA_REGISTRYINDEX, "DEFAULT_EVENT_LOOP"); // -
+
     if (fname[0] == '@') {
         require(L, fname);
     } else {
@@ -337,6 +347,16 @@ static int load_scripts(lua_State *L)
     lua_getglobal(L, "mp_event_loop"); // fn
     if (lua_isnil(L, -1))
         luaL_error(L, "no event loop function\n");
+    if (ctx->hosted) {
+        // Scripts with their own event loop can't be dispatched from outside.
+        lua_getfield(L, LUA_REGISTRYINDEX, "DEFAULT_EVENT_LOOP"); // fn def
+        if (lua_rawequal(L, -1, -2)) {
+            ctx->loop_deferred = true;
+            lua_pop(L, 2); // -
+            return 0;
+        }
+        lua_pop(L, 1); // fn
+    }
     lua_call(L, 0, 0); // -
 
     return 0;
@@ -415,6 +435,10 @@ static int run_lua(lua_State *L)
     lua_setfield(L, LUA_REGISTRYINDEX, "ARRAY"); // mp table
     lua_setfield(L, -2, "ARRAY"); // mp
 
+    // used by get_prop_ref()
+    lua_newtable(L); // mp table
+    lua_setfield(L, LUA_REGISTRYINDEX, "PROP_REFS"); // mp
+
     lua_pop(L, 1); // -
 
     mp_assert(lua_gettop(L) == 0);
@@ -447,7 +471,20 @@ static int run_lua(lua_State *L)
     return 0;
 }
 
-static int load_lua(struct mp_script_args *args)
+static void unload_lua(void *p)
+{
+    struct script_ctx *ctx = p;
+    if (ctx->lua_allocf)
+        lua_setallocf(ctx->state, ctx->lua_allocf, ctx->lua_alloc_ud);
+    if (ctx->state)
+        lua_close(ctx->state);
+    for (int n = 0; n < ctx->num_prop_refs; n++)
+        mpv_free(ctx->prop_refs[n]);
+    talloc_free(ctx);
+}
+
+// If state is not NULL, the script is hosted (see mp_scripting.start()).
+static int run_script_lua(struct mp_script_args *args, void **state)
 {
     int r = -1;
 
@@ -461,9 +498,12 @@ static int load_lua(struct mp_script_args *args)
         .path = args->path,
         .stats = stats_ctx_create(ctx, args->mpctx->global,
                     mp_tprintf(80, "script/%s", mpv_client_name(args->client))),
+        .hosted = !!state,
     };
 
-    stats_register_thread_cputime(ctx->stats, "cpu");
+    // The shared script threads run many scripts.
+    if (!ctx->hosted)
+        stats_register_thread_cputime(ctx->stats, "cpu");
 
     if (LUA_VERSION_NUM != 501 && LUA_VERSION_NUM != 502) {
         MP_FATAL(ctx, "Only Lua 5.1 and 5.2 are supported.\n");
@@ -490,15 +530,66 @@ static int load_lua(struct mp_script_args *args)
 
     r = 0;
 
+    if (ctx->loop_deferred) {
+        *state = ctx;
+        return r;
+    }
+
 error_out:
-    if (ctx->lua_allocf)
-        lua_setallocf(L, ctx->lua_allocf, ctx->lua_alloc_ud);
-    if (ctx->state)
-        lua_close(ctx->state);
-    talloc_free(ctx);
+    unload_lua(ctx);
     return r;
 }
 
+static int load_lua(struct mp_script_args *args)
+{
+    return run_script_lua(args, NULL);
+}
+
+static int start_lua(struct mp_script_args *args, void **state)
+{
+    *state = NULL;
+    return run_script_lua(args, state);
+}
+
+// Call mp.dispatch_events() once, which doesn't wait for new events.
+static int run_dispatch(lua_State *L)
+{
+    struct script_ctx *ctx = lua_touserdata(L, -1);
+    lua_pop(L, 1); // -
+
+    ctx->keep_running = false;
+    lua_pushcfunction(L, error_handler); // errf
+    lua_getglobal(L, "mp"); // errf mp
+    lua_getfield(L, -1, "dispatch_events"); // errf mp fn
+    if (lua_pcall(L, 0, 1, -3)) { // errf mp [error]
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        return 0;
+    }
+    // errf mp timeout
+    ctx->timeout = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : -1;
+    lua_getfield(L, -2, "keep_running"); // errf mp timeout keep_running
+    ctx->keep_running = lua_toboolean(L, -1);
+    lua_pop(L, 4); // -
+    return 0;
+}
+
+static bool dispatch_lua(void *p, double *timeout)
+{
+    struct script_ctx *ctx = p;
+    lua_State *L = ctx->state;
+    if (mp_cpcall(L, run_dispatch, ctx)) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING) // avoid allocation
+            err = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", err);
+        return false;
+    }
+    mp_assert(lua_gettop(L) == 0);
+    *timeout = ctx->timeout;
+    return ctx->keep_running;
+}
+
 static int check_loglevel(lua_State *L, int arg)
 {
     const char *level = luaL_checkstring(L, arg);
@@ -961,6 +1052,113 @@ static mpv_format check_property_format(lua_State *L, int arg)
     abort();
 }
 
+// Return the handle for the given property, resolving it on first use. The
+// handles are cached in the PROP_REFS registry table. Returns NULL if the
+// property does not exist.
+static mpv_property_ref *get_prop_ref(lua_State *L, const char *name)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, "PROP_REFS"); // refs
+    lua_getfield(L, -1, name); // refs ref
+    mpv_property_ref *ref = lua_touserdata(L, -1);
+    lua_pop(L, 1); // refs
+    if (!ref) {
+        ref = mpv_resolve_property(ctx->client, name);
+        if (ref) {
+            MP_TARRAY_APPEND(ctx, ctx->prop_refs, ctx->num_prop_refs, ref);
+            lua_pushlightuserdata(L, ref); // refs ref
+            lua_setfield(L, -2, name); // refs
+        }
+    }
+    lua_pop(L, 1); // -
+    return ref;
+}
+
+// Push the value of the property, or nil on error.
+static void push_property_ref(lua_State *L, void *tmp, const char *name,
+                              mpv_format format)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    mpv_property_ref *ref = get_prop_ref(L, name);
+    int err = MPV_ERROR_PROPERTY_NOT_FOUND;
+
+    switch (format) {
+    case MPV_FORMAT_DOUBLE: {
+        double v = 0;
+        if (ref)
+            err = mpv_get_property_ref(ctx->client, ref, format, &v);
+        if (err >= 0)
+            lua_pushnumber(L, v);
+        break;
+    }
+    case MPV_FORMAT_FLAG: {
+        int v = 0;
+        if (ref)
+            err = mpv_get_property_ref(ctx->client, ref, format, &v);
+        if (err >= 0)
+            lua_pushboolean(L, v);
+        break;
+    }
+    case MPV_FORMAT_STRING: {
+        char *v = NULL;
+        if (ref)
+            err = mpv_get_property_ref(ctx->client, ref, format, &v);
+        if (err >= 0) {
+            add_af_mpv_alloc(tmp, v);
+            lua_pushstring(L, v);
+        }
+        break;
+    }
+    default: {
+        mpv_node node;
+        if (ref)
+            err = mpv_get_property_ref(ctx->client, ref, MPV_FORMAT_NODE, &node);
+        if (err >= 0) {
+            steal_node_allocations(tmp, &node);
+            pushnode(L, &node);
+        }
+        break;
+    }
+    }
+
+    if (err < 0)
+        lua_pushnil(L);
+}
+
+// args: props table, optional result table
+static int script_get_properties(lua_State *L, void *tmp)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    if (lua_isnoneornil(L, 2)) {
+        lua_settop(L, 1); // props
+        lua_newtable(L); // props t
+    } else {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_settop(L, 2); // props t
+    }
+
+    lua_pushnil(L); // props t nil
+    while (lua_next(L, 1)) { // props t key value
+        const char *name;
+        mpv_format format = MPV_FORMAT_NODE;
+        if (lua_type(L, 3) == LUA_TSTRING) {
+            // name = "type" entry
+            name = lua_tostring(L, 3);
+            format = check_property_format(L, 4);
+            if (format == MPV_FORMAT_NONE)
+                luaL_error(L, "invalid property type for '%s'", name);
+        } else {
+            // plain array entry, read it as native value
+            name = luaL_checkstring(L, 4);
+        }
+        push_property_ref(L, tmp, name, format); // props t key value res
+        lua_setfield(L, 2, name); // props t key value
+        lua_pop(L, 1); // props t key
+    }
+
+    return 1;
+}
+
 // It has a raw_ prefix, because there is a more high level API in defaults.lua.
 static int script_raw_observe_property(lua_State *L)
 {
@@ -1240,6 +1438,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_property_bool),
     FN_ENTRY(get_property_number),
     AF_ENTRY(get_property_native),
+    AF_ENTRY(get_properties),
     FN_ENTRY(del_property),
     FN_ENTRY(set_property),
     FN_ENTRY(set_property_bool),
@@ -1352,4 +1551,7 @@ const struct mp_scripting mp_scripting_lua = {
     .name = "lua",
     .file_ext = "lua",
     .load = load_lua,
+    .start = start_lua,
+    .dispatch = dispatch_lua,
+    .unload = unload_lua,
 };
@@ -555,7 +555,7 @@ function mp.dispatch_events(allow_wait)
                 end
             end
             if allow_wait ~= true then
-                return
+                return wait
             end
         end
         local e = mp.wait_event(wait)
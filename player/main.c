@@ -61,13 +61,16 @@
 
 #include "audio/out/ao.h"
 #include "misc/thread_tools.h"
+#include "sub/ass_mp.h"
 #include "sub/osd.h"
 #include "video/out/vo.h"
+#include "video/sws_utils.h"
 
 #include "core.h"
 #include "client.h"
 #include "command.h"
 #include "screenshot.h"
+#include "watch_later.h"
 
 static const char def_config[] =
 #include "etc/builtin.conf.inc"
@@ -174,7 +177,13 @@ void mp_print_version(struct mp_log *log, int always)
 
 void mp_destroy(struct MPContext *mpctx)
 {
+    if (mpctx->stats_trace_file &&
+        stats_global_trace_stop(mpctx->global, mpctx->stats_trace_file) < 0)
+        MP_ERR(mpctx, "Failed to write '%s'.\n", mpctx->stats_trace_file);
+
     mp_shutdown_clients(mpctx);
+    mp_script_host_destroy(mpctx);
+    screenshot_uninit(mpctx);
 
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
@@ -191,6 +200,10 @@ void mp_destroy(struct MPContext *mpctx)
     mp_clients_destroy(mpctx);
 
     osd_free(mpctx->osd);
+    mp_ass_preload_wait(mpctx->ass_preload);
+    // Finish writing the resume state that was queued when quitting.
+    mp_watch_later_destroy(mpctx->watch_later);
+    mpctx->watch_later = NULL;
 
 #if HAVE_COCOA
     cocoa_set_input_context(NULL);
@@ -253,6 +266,32 @@ static bool check_locale(void)
     return !name || strcmp(name, "C") == 0 || strcmp(name, "C.UTF-8") == 0;
 }
 
+// Account the time since the previous call as startup phase "name".
+static void startup_phase(struct MPContext *mpctx, const char *name)
+{
+    int64_t now = mp_time_ns();
+    if (mpctx->num_startup_phases < MP_ARRAY_SIZE(mpctx->startup_phases)) {
+        mpctx->startup_phases[mpctx->num_startup_phases++] =
+            (struct mp_startup_phase){name, now - mpctx->startup_phase_start};
+    }
+    mpctx->startup_phase_start = now;
+}
+
+// Phases are only printed at the end, because --msg-level is not applied
+// while most of them run.
+static void print_startup_phases(struct MPContext *mpctx)
+{
+    struct mp_log *log = mp_log_new(NULL, mpctx->log, "!startup");
+    int64_t total = 0;
+    for (int n = 0; n < mpctx->num_startup_phases; n++) {
+        struct mp_startup_phase *ph = &mpctx->startup_phases[n];
+        mp_msg(log, MSGL_V, "%-16s %8.3f ms\n", ph->name, ph->duration / 1e6);
+        total += ph->duration;
+    }
+    mp_msg(log, MSGL_V, "%-16s %8.3f ms\n", "total", total / 1e6);
+    talloc_free(log);
+}
+
 struct MPContext *mp_create(void)
 {
     if (!check_locale()) {
@@ -280,10 +319,14 @@ struct MPContext *mp_create(void)
         .thread_pool = mp_thread_pool_create(mpctx, 0, 1, 30),
         .stop_play = PT_NEXT_ENTRY,
         .play_dir = 1,
+        .startup_phase_start = mp_time_ns(),
     };
 
     mp_mutex_init(&mpctx->abort_lock);
 
+    // Let scaler contexts reuse each other's conversion plans.
+    mp_sws_plan_cache_ref(mpctx);
+
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
 
     demux_packet_pool_init(mpctx->global);
@@ -295,6 +338,14 @@ struct MPContext *mp_create(void)
     mpctx->statusline = mp_log_new(mpctx, mpctx->log, "!statusline");
 
     mpctx->stats = stats_ctx_create(mpctx, mpctx->global, "main");
+    startup_phase(mpctx, "core");
+
+    // Record a trace of the whole lifetime, as with the stats-trace command.
+    char *trace_env = getenv("MPV_STATS_TRACE");
+    if (trace_env && trace_env[0]) {
+        mpctx->stats_trace_file = talloc_strdup(mpctx, trace_env);
+        stats_global_trace_start(mpctx->global);
+    }
 
     // Create the config context and register the options
     mpctx->mconfig = m_config_new(mpctx, mpctx->log, &mp_opt_root);
@@ -306,13 +357,17 @@ struct MPContext *mp_create(void)
     mpctx->mconfig->is_toplevel = true;
     mpctx->mconfig->global = mpctx->global;
     m_config_parse(mpctx->mconfig, "", bstr0(def_config), NULL, 0);
+    startup_phase(mpctx, "builtin config");
 
     mpctx->input = mp_input_init(mpctx->global, mp_wakeup_core_cb, mpctx);
     screenshot_init(mpctx);
     command_init(mpctx);
+    startup_phase(mpctx, "input/commands");
     init_libav(mpctx->global);
+    startup_phase(mpctx, "libav");
     mp_clients_init(mpctx);
     mpctx->osd = osd_create(mpctx->global);
+    startup_phase(mpctx, "clients/osd");
 
 #if HAVE_COCOA
     cocoa_set_input_context(mpctx->input);
@@ -338,6 +393,9 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_assert(!mpctx->initialized);
 
+    // Don't count the time the API user spent setting options.
+    mpctx->startup_phase_start = mp_time_ns();
+
     // Preparse the command line, so we can init the terminal early.
     if (options) {
         m_config_preparse_command_line(mpctx->mconfig, mpctx->global,
@@ -357,13 +415,17 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_print_version(mpctx->log, false);
 
+    startup_phase(mpctx, "logging");
+
     mp_parse_cfgfiles(mpctx);
+    startup_phase(mpctx, "config files");
 
     if (options) {
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
                                                mpctx->global, options);
         if (r < 0)
             return r == M_OPT_EXIT ? 1 : -1;
+        startup_phase(mpctx, "command line");
     }
 
     if (opts->operation_mode == 1) {
@@ -378,6 +440,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     m_config_backup_watch_later_opts(mpctx->mconfig);
 
     mp_input_load_config(mpctx->input);
+    startup_phase(mpctx, "input.conf");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -387,6 +450,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     // Run all update handlers.
     mp_option_change_callback(mpctx, NULL, UPDATE_OPTS_MASK, false);
     handle_option_callbacks(mpctx);
+    startup_phase(mpctx, "option handlers");
 
     if (handle_help_options(mpctx))
         return 1; // help
@@ -409,6 +473,10 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     MP_STATS(mpctx, "start init");
 
+    // Set up fonts while the first file is opened.
+    mpctx->ass_preload = mp_ass_preload_start(mpctx->global,
+                                              opts->subs_rend->sub_style);
+
 #if HAVE_COCOA
     mpv_handle *ctx = mp_new_client(mpctx->clients, "mac");
     cocoa_set_mpv_handle(ctx);
@@ -420,6 +488,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 #endif
 
     mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
+    startup_phase(mpctx, "ipc");
 
     if (opts->encode_opts->file && opts->encode_opts->file[0]) {
         mpctx->encode_lavc_ctx = encode_lavc_init(mpctx->global);
@@ -430,15 +499,19 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 
     mp_load_scripts(mpctx);
+    startup_phase(mpctx, "user scripts");
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
+    if (opts->force_vo == 2)
+        startup_phase(mpctx, "force-window");
 
     // Needed to properly enter _initial_ idle mode if playlist empty.
     if (mpctx->opts->player_idle_mode && !mpctx->playlist->num_entries)
         mpctx->stop_play = PT_STOP;
 
     MP_STATS(mpctx, "end init");
+    print_startup_phases(mpctx);
 
     return 0;
 }
@@ -453,7 +526,7 @@ int mpv_main(int argc, char *argv[])
 
     char **options = argv && argv[0] ? argv + 1 : NULL; // skips program name
     int r = mp_initialize(mpctx, options);
-    if (r == 0)
+    if (r == 0 && !mp_encode_segments(mpctx, options))
         mp_play_files(mpctx);
 
     int rc = 0;
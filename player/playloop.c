@@ -25,6 +25,7 @@
 #include "command.h"
 #include "core.h"
 #include "mpv_talloc.h"
+#include "preload.h"
 #include "screenshot.h"
 
 #include "audio/out/ao.h"
@@ -293,6 +294,10 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
     if (!mpctx->demuxer || !seek.type || seek.amount == MP_NOPTS_VALUE)
         return;
 
+    mpctx->seek_timing = (struct mp_load_timing){
+        .t[LOAD_PHASE_START] = mp_time_ns(),
+    };
+
     if (seek.type == MPSEEK_CHAPTER) {
         mpctx->last_chapter_flag = false;
         seek.type = MPSEEK_ABSOLUTE;
@@ -693,6 +698,15 @@ static void handle_osd_redraw(struct MPContext *mpctx)
     vo_redraw(mpctx->video_out);
 }
 
+// With --pause-sleep, an idle or paused player schedules no periodic work, so
+// the core only wakes up for actual events.
+static bool pause_sleep_active(struct MPContext *mpctx)
+{
+    if (!mpctx->opts->pause_sleep)
+        return false;
+    return !mpctx->playing || (mpctx->paused && !mpctx->paused_for_cache);
+}
+
 static void clear_underruns(struct MPContext *mpctx)
 {
     if (mpctx->ao_chain && mpctx->ao_chain->underrun) {
@@ -784,13 +798,22 @@ static void handle_update_cache(struct MPContext *mpctx)
     bool busy = !s.idle;
     if (fabs(mpctx->cache_update_pts - mpctx->playback_pts) >= 1.0)
         busy = true;
+    bool sleep = pause_sleep_active(mpctx);
     if (busy || mpctx->next_cache_update > 0) {
-        if (mpctx->next_cache_update <= now) {
+        if (mpctx->next_cache_update <= now || (sleep && !busy)) {
             mpctx->next_cache_update = busy ? now + 0.25 : 0;
             force_update = true;
         }
-        if (mpctx->next_cache_update > 0)
-            mp_set_timeout(mpctx, mpctx->next_cache_update - now);
+        if (mpctx->next_cache_update > 0) {
+            if (sleep) {
+                // Instead of polling, get woken up once the demuxer stops
+                // reading, which makes for the final update.
+                demux_set_buffer_notify(mpctx->demuxer, INT64_MAX,
+                                        mp_wakeup_core_cb, mpctx);
+            } else {
+                mp_set_timeout(mpctx, mpctx->next_cache_update - now);
+            }
+        }
     }
 
     if (mpctx->cache_buffer != cache_buffer) {
@@ -817,6 +840,9 @@ static void handle_update_cache(struct MPContext *mpctx)
     if (force_update) {
         mpctx->cache_update_pts = mpctx->playback_pts;
         mp_notify(mpctx, MP_EVENT_CACHE_UPDATE, NULL);
+        // Preloads compete for the same bandwidth; let them back off.
+        mp_preload_update_playback(s.idle ? INFINITY : s.ts_info.duration,
+                                   mpctx->paused_for_cache);
     }
 }
 
@@ -1112,6 +1138,8 @@ err:
 // Potentially needed by some Lua scripts, which assume TICK always comes.
 static void handle_dummy_ticks(struct MPContext *mpctx)
 {
+    if (pause_sleep_active(mpctx))
+        return;
     if ((mpctx->video_status != STATUS_PLAYING &&
          mpctx->video_status != STATUS_DRAINING) ||
          mpctx->paused)
@@ -1183,6 +1211,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->hrseek_active = false;
         mpctx->restart_complete = true;
         mpctx->current_seek = (struct seek_params){0};
+        mark_load_timing(mpctx, LOAD_PHASE_FIRST_PRESENT);
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
         update_core_idle_state(mpctx);
@@ -6,7 +6,10 @@
  * handed off to a player even while still loading.
  */
 
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -18,50 +21,133 @@
 #include "common/msg.h"
 #include "common/stats.h"
 #include "demux/demux.h"
+#include "demux/demux_fanout.h"
 #include "stream/stream.h"
 #include "demux/packet_pool.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
 #include "options/m_config_core.h"
+#include "options/m_option.h"
 #include "options/options.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "misc/dispatch.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "stream/stream.h"
+#include "video/mp_image.h"
 
 // Preload entry
 struct preload_entry {
     char *url;
+    uint32_t url_hash;
+    int hash_next;          // next entry in the URL index bucket (index + 1)
     struct mpv_global *global;      // Independent global context
     struct demuxer *demuxer;
     struct mp_cancel *cancel;
-    mpv_preload_status status;
-    
-    mp_thread thread;
-    bool thread_running;
+    // Written with lock held, but atomic so that mpv_preload_get_info() can
+    // read it with only state_lock (like the timing fields below).
+    _Atomic mpv_preload_status status;
+    uint64_t id;            // unique for each started preload (0 = unused)
+    
+    // All of these are protected by the lock.
+    bool job_queued;        // open job queued, but not started yet
+    bool job_running;       // open job running (demux_open, decoder prewarm)
+    int busy;               // open job or status callback using the entry
+    bool monitored;         // open done, status updated by the monitor thread
+    bool head_limited;      // demuxer prefetch limited to head_keyframes
+    bool throttled;         // demuxer reading blocked for the active playback
     bool cancel_requested;
     
     // Configuration
     int64_t max_bytes;
     double readahead_secs;
+    int priority;
+    int head_keyframes;     // 0 = full prefetch (under lock)
+    int64_t cache_limit;    // max_bytes after applying the global budget
+    bool evicting;          // marked by apply_budget_locked() (under lock)
+    bool prewarm_decoder;
+    char *prewarm_hwdec;
+    bool persist_head;
+
+    // Prewarmed video decoder (only with prewarm_decoder)
+    struct mp_dispatch_queue *dispatch; // open job wakeups
+    struct mp_preload_decoder *dec;
     
     time_t create_time;
+
+    // Timing (mp_time_ns() values, 0 = not reached yet)
+    _Atomic int64_t time_start;     // mpv_preload_start() called
+    _Atomic int64_t time_opening;   // open job started
+    _Atomic int64_t time_connected; // stream opened
+    _Atomic int64_t time_header;    // demuxer opened
+    _Atomic int64_t time_first_packet;
+    _Atomic int64_t time_ready;
+    _Atomic int64_t time_cached;
+    _Atomic uint64_t bytes_per_second;  // last known download rate
     
     // Persistent storage for async callback
     mpv_preload_info callback_info;
 };
 
 // Forward declarations (after struct definition)
-static void *preload_thread(void *arg);
+static void preload_job(void *arg);
 static void cleanup_entry(struct preload_entry *entry);
+static void request_check(struct preload_entry *entry);
+
+// Context of a queued open job
+struct preload_job {
+    struct preload_entry *entry;
+    uint64_t id;            // entry->id at queue time
+};
 
 // Global cache with pre-allocated array (safe for concurrent access)
 #define PRELOAD_CACHE_CAPACITY 64  // Fixed capacity
+#define PRELOAD_HASH_BUCKETS 64    // URL index size
+
+// If the memory budget leaves less than this to an entry, it's evicted
+// instead of being shrunk further.
+#define PRELOAD_MIN_CACHE_BYTES (1 * 1024 * 1024)
+
 static struct {
     struct preload_entry entries[PRELOAD_CACHE_CAPACITY];  // Static array
     int max_entries;  // Logical limit (user-configurable, 1-64)
+    int64_t memory_budget;  // Sum of all cache limits (0 = unlimited)
+    // Options applied to every new entry, as name/value pairs (strdup'ed)
+    char **net_opts;
+    int num_net_opts;
+    uint64_t next_id;
+    // Throttling for the active playback (see mp_preload_update_playback())
+    double throttle_low, throttle_high;     // low <= 0: disabled
+    int throttle_level;     // 0: all run, 1: only priority > 0, 2: none
+    // On-disk head cache (see mpv_preload_set_disk_cache())
+    char *disk_cache_dir;
+    int64_t disk_cache_max_bytes;
+    int64_t disk_cache_head_bytes;
+    // Opening is done on a bounded pool instead of a thread per entry; after
+    // that, a single monitor thread updates the status of all entries.
+    struct mp_thread_pool *pool;
+    int max_opens;
+    bool monitor_running;
+    mp_thread monitor;
+    bool *monitor_exit;     // set (with monitor_lock) to stop the monitor
+    // URL index: first entry of each bucket (index + 1, 0 = empty)
+    int buckets[PRELOAD_HASH_BUCKETS];
     pthread_mutex_t lock;
+    // Changing the URL index or the url, demuxer and dec fields of an entry
+    // requires holding state_lock for writing in addition to lock. Read-only
+    // access (mpv_preload_get_info()) only needs it for reading, so polling
+    // the status doesn't wait on the lock, which can be held for a long time.
+    // (The status and timing fields it reads are atomic for that reason.)
+    pthread_rwlock_t state_lock;
     pthread_cond_t demuxer_ready_cond;  // Signaled when any demuxer becomes ready
+                                        // (and when an entry becomes idle)
     bool initialized;
+
+    // Monitor wakeups; monitor_lock can be taken with any other lock held.
+    pthread_mutex_t monitor_lock;
+    pthread_cond_t monitor_cond;
+    bool check_pending[PRELOAD_CACHE_CAPACITY];
 } preload_cache;
 
 // Global callback for completion events
@@ -72,6 +158,12 @@ void mpv_preload_set_callback(mpv_preload_callback callback)
     g_preload_callback = callback;
 }
 
+// Seconds between the two mp_time_ns() values, -1 if t wasn't reached
+static double preload_time(int64_t start, int64_t t)
+{
+    return t ? MP_TIME_NS_TO_S(t - start) : -1;
+}
+
 // Helper to fill preload info from entry state
 static void fill_preload_info(struct preload_entry *entry, mpv_preload_info *info)
 {
@@ -81,6 +173,16 @@ static void fill_preload_info(struct preload_entry *entry, mpv_preload_info *inf
     info->file_size = -1;
     info->buffered_secs = 0;
     info->eof_cached = false;
+    info->first_frame_ready = entry->dec && entry->dec->first_frame.type;
+
+    int64_t start = entry->time_start;
+    info->time_opening = preload_time(start, entry->time_opening);
+    info->time_connected = preload_time(start, entry->time_connected);
+    info->time_header = preload_time(start, entry->time_header);
+    info->time_first_packet = preload_time(start, entry->time_first_packet);
+    info->time_ready = preload_time(start, entry->time_ready);
+    info->time_cached = preload_time(start, entry->time_cached);
+    info->download_rate = entry->bytes_per_second;
     
     // Fill in demuxer state if available
     if (entry->demuxer) {
@@ -89,6 +191,7 @@ static void fill_preload_info(struct preload_entry *entry, mpv_preload_info *inf
         info->fw_bytes = state.fw_bytes;
         info->total_bytes = state.total_bytes;
         info->eof_cached = state.eof_cached;
+        info->download_rate = state.bytes_per_second;
         if (state.ts_info.duration >= 0)
             info->buffered_secs = state.ts_info.duration;
         // Get file size from stream
@@ -115,7 +218,13 @@ static void ensure_initialized(void)
     if (!preload_cache.initialized) {
         mp_time_init();  // Initialize timer subsystem
         pthread_mutex_init(&preload_cache.lock, NULL);
+        pthread_rwlock_init(&preload_cache.state_lock, NULL);
         pthread_cond_init(&preload_cache.demuxer_ready_cond, NULL);
+        pthread_mutex_init(&preload_cache.monitor_lock, NULL);
+        pthread_cond_init(&preload_cache.monitor_cond, NULL);
+        preload_cache.max_opens = MPV_PRELOAD_DEFAULT_MAX_OPENS;
+        preload_cache.throttle_low = MPV_PRELOAD_DEFAULT_THROTTLE_LOW;
+        preload_cache.throttle_high = MPV_PRELOAD_DEFAULT_THROTTLE_HIGH;
         
         // Set default logical limit (static array is already zero-initialized)
         preload_cache.max_entries = MPV_PRELOAD_DEFAULT_MAX_ENTRIES;
@@ -124,17 +233,59 @@ static void ensure_initialized(void)
     }
 }
 
-// Find entry by URL (must hold lock)
+// FNV-1a
+static uint32_t hash_url(const char *url)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)url; *c; c++)
+        hash = (hash ^ *c) * 16777619u;
+    return hash;
+}
+
+// Find entry by URL (must hold lock or state_lock)
 static struct preload_entry *find_entry_locked(const char *url)
 {
-    for (int i = 0; i < preload_cache.max_entries; i++) {
-        struct preload_entry *e = &preload_cache.entries[i];
-        if (e->url && strcmp(e->url, url) == 0)
+    uint32_t hash = hash_url(url);
+    int i = preload_cache.buckets[hash % PRELOAD_HASH_BUCKETS];
+    while (i) {
+        struct preload_entry *e = &preload_cache.entries[i - 1];
+        if (e->url_hash == hash && !e->evicting && strcmp(e->url, url) == 0)
             return e;
+        i = e->hash_next;
     }
     return NULL;
 }
 
+// Set the URL of an unused entry and add it to the index (must hold lock)
+static bool set_entry_url_locked(struct preload_entry *entry, const char *url)
+{
+    char *new_url = strdup(url);
+    if (!new_url)
+        return false;
+
+    uint32_t hash = hash_url(url);
+    int *bucket = &preload_cache.buckets[hash % PRELOAD_HASH_BUCKETS];
+    pthread_rwlock_wrlock(&preload_cache.state_lock);
+    entry->url = new_url;
+    entry->url_hash = hash;
+    entry->hash_next = *bucket;
+    *bucket = (entry - preload_cache.entries) + 1;
+    pthread_rwlock_unlock(&preload_cache.state_lock);
+    return true;
+}
+
+// Remove the entry from the index (must hold lock and state_lock for writing)
+static void remove_entry_url_locked(struct preload_entry *entry)
+{
+    int idx = (entry - preload_cache.entries) + 1;
+    int *link = &preload_cache.buckets[entry->url_hash % PRELOAD_HASH_BUCKETS];
+    while (*link && *link != idx)
+        link = &preload_cache.entries[*link - 1].hash_next;
+    if (*link)
+        *link = entry->hash_next;
+    entry->hash_next = 0;
+}
+
 // Find free slot (must hold lock)
 static struct preload_entry *find_free_slot_locked(void)
 {
@@ -157,11 +308,42 @@ static struct preload_entry *find_free_slot_locked(void)
     
     if (oldest) {
         cleanup_entry(oldest);
+        // (Could have been taken while cleanup_entry() waited.)
+        if (oldest->url)
+            oldest = NULL;
     }
     
     return oldest;
 }
 
+// Set an option in the preload context by name, like --name=value would do.
+static bool set_preload_option(struct mpv_global *global, const char *name,
+                               const char *value)
+{
+    struct m_config_cache *cache =
+        m_config_cache_from_shadow(NULL, global->config, &mp_opt_root);
+    bool ok = false;
+    int32_t id = -1;
+    while (m_config_cache_get_next_opt(cache, &id)) {
+        char buf[M_CONFIG_MAX_OPT_NAME_LEN];
+        const char *opt_name = m_config_shadow_get_opt_name(global->config, id,
+                                                            buf, sizeof(buf));
+        if (strcmp(opt_name, name) != 0)
+            continue;
+        const struct m_option *opt = m_config_shadow_get_opt(global->config, id);
+        void *data = m_config_cache_get_opt_data(cache, id);
+        if (data && m_option_parse(global->log, opt, bstr0(name), bstr0(value),
+                                   data) >= 0)
+        {
+            m_config_cache_write_opt(cache, data);
+            ok = true;
+        }
+        break;
+    }
+    talloc_free(cache);
+    return ok;
+}
+
 // Create minimal mpv_global for demux operations
 static struct mpv_global *create_minimal_global(int64_t max_bytes, double readahead_secs)
 {
@@ -195,26 +377,128 @@ static struct mpv_global *create_minimal_global(int64_t max_bytes, double readah
     return global;
 }
 
-// Cleanup an entry (must NOT hold lock, or call with lock and handle thread join)
+// Higher priority first; among equal priority, newer entries first.
+static int compare_entry_priority(const void *a, const void *b)
+{
+    const struct preload_entry *e1 = *(struct preload_entry **)a;
+    const struct preload_entry *e2 = *(struct preload_entry **)b;
+    if (e1->priority != e2->priority)
+        return e1->priority > e2->priority ? -1 : 1;
+    if (e1->create_time != e2->create_time)
+        return e1->create_time > e2->create_time ? -1 : 1;
+    return e1 < e2 ? -1 : (e1 > e2);
+}
+
+// Change the demuxer cache size of an entry (must hold lock)
+static void set_cache_limit_locked(struct preload_entry *entry, int64_t limit)
+{
+    if (entry->cache_limit == limit)
+        return;
+    entry->cache_limit = limit;
+
+    // (If there is no global yet, the preload thread uses cache_limit when
+    // creating it. Recycled entries have it owned by the demuxer.)
+    struct mpv_global *global =
+        entry->demuxer ? entry->demuxer->global : entry->global;
+    if (!global)
+        return;
+
+    struct m_config_cache *cache =
+        m_config_cache_from_shadow(NULL, global->config, &demux_conf);
+    struct demux_opts *opts = cache->opts;
+    opts->max_bytes = limit;
+    m_config_cache_write_opt(cache, &opts->max_bytes);
+    talloc_free(cache);
+
+    // Shrinking prunes through the demuxer's normal cache pruning.
+    if (entry->demuxer)
+        demux_update_opts(entry->demuxer);
+    // Re-evaluate the CACHED threshold.
+    request_check(entry);
+}
+
+// Distribute the memory budget over all entries that hold (or will hold)
+// preloaded data, by priority. Entries that don't fit anymore are marked with
+// evicting=true; the caller must call evict_marked_entries() after unlocking.
+static void apply_budget_locked(void)
+{
+    struct preload_entry *list[PRELOAD_CACHE_CAPACITY];
+    int num = 0;
+    for (int i = 0; i < preload_cache.max_entries; i++) {
+        struct preload_entry *e = &preload_cache.entries[i];
+        if (e->url && !e->evicting && e->status != MPV_PRELOAD_STATUS_DETACHED &&
+            e->status != MPV_PRELOAD_STATUS_ERROR)
+            list[num++] = e;
+    }
+    qsort(list, num, sizeof(list[0]), compare_entry_priority);
+
+    int64_t remaining = preload_cache.memory_budget > 0
+                      ? preload_cache.memory_budget : INT64_MAX;
+    for (int n = 0; n < num; n++) {
+        struct preload_entry *e = list[n];
+        int64_t limit = MPMIN(e->max_bytes, remaining);
+        if (limit < e->max_bytes) {
+            int64_t used = 0;
+            if (e->demuxer) {
+                struct demux_reader_state state;
+                demux_get_reader_state(e->demuxer, &state);
+                used = state.total_bytes;
+            }
+            // Already buffered forward data can't be pruned, so if it's over
+            // the new limit, the entry has to go completely.
+            if (limit < PRELOAD_MIN_CACHE_BYTES || used > limit) {
+                e->evicting = true;
+                continue;
+            }
+        }
+        set_cache_limit_locked(e, limit);
+        remaining -= limit;
+    }
+}
+
+// Wait until no open job or callback uses the entry (must hold lock, which is
+// dropped while waiting). Returns false if the entry was freed meanwhile.
+static bool wait_idle_locked(struct preload_entry *entry)
+{
+    uint64_t id = entry->id;
+    while (entry->busy && entry->id == id)
+        pthread_cond_wait(&preload_cache.demuxer_ready_cond, &preload_cache.lock);
+    return entry->id == id;
+}
+
+// Cleanup an entry (must hold lock, which may be dropped while waiting for the
+// open job to abort)
 static void cleanup_entry(struct preload_entry *entry)
 {
     if (!entry->url)
         return;
     
     entry->cancel_requested = true;
+    entry->monitored = false;
     
     if (entry->cancel)
         mp_cancel_trigger(entry->cancel);
     
-    if (entry->thread_running) {
-        mp_thread_join(entry->thread);
-        entry->thread_running = false;
-    }
-    
-    if (entry->demuxer) {
-        demux_cancel_and_free(entry->demuxer);
-        entry->demuxer = NULL;
-    }
+    // A job that was queued, but not started, notices the id change.
+    if (!wait_idle_locked(entry))
+        return;  // freed by someone else meanwhile
+    
+    // After this, get_info can't see the entry anymore.
+    pthread_rwlock_wrlock(&preload_cache.state_lock);
+    remove_entry_url_locked(entry);
+    struct mp_preload_decoder *dec = entry->dec;
+    struct demuxer *demuxer = entry->demuxer;
+    entry->dec = NULL;
+    entry->demuxer = NULL;
+    pthread_rwlock_unlock(&preload_cache.state_lock);
+
+    // The decoder reads from the demuxer, so it must go first.
+    talloc_free(dec);
+
+    if (demuxer)
+        demux_cancel_and_free(demuxer);
+
+    TA_FREEP(&entry->dispatch);
     
     if (entry->cancel) {
         talloc_free(entry->cancel);
@@ -227,40 +511,304 @@ static void cleanup_entry(struct preload_entry *entry)
     }
     
     free(entry->url);
+    free(entry->prewarm_hwdec);
     memset(entry, 0, sizeof(*entry));
 }
 
-// Preload thread function
-static void *preload_thread(void *arg)
+static void destroy_preload_decoder(void *ptr)
+{
+    struct mp_preload_decoder *pd = ptr;
+
+    if (pd->dec)
+        talloc_free(pd->dec->f);
+    talloc_free(pd->root);
+    mp_frame_unref(&pd->first_frame);
+}
+
+static void wakeup_preload_job(void *ptr)
+{
+    struct preload_entry *entry = ptr;
+
+    mp_dispatch_interrupt(entry->dispatch);
+}
+
+static void wakeup_dispatch(void *ptr)
+{
+    mp_dispatch_interrupt(ptr);
+}
+
+struct mp_preload_decoder *mp_preload_decoder_create(struct mpv_global *global,
+                                                     struct demuxer *demuxer,
+                                                     enum stream_type type,
+                                                     struct mp_cancel *cancel,
+                                                     struct mp_dispatch_queue *dispatch)
+{
+    struct sh_stream *sh = NULL;
+    int num_streams = demux_get_num_stream(demuxer);
+    for (int i = 0; i < num_streams; i++) {
+        struct sh_stream *s = demux_get_stream(demuxer, i);
+        if (s->type == type && !s->attached_picture) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh)
+        return NULL;
+
+    int frame_type = type == STREAM_VIDEO ? MP_FRAME_VIDEO : MP_FRAME_AUDIO;
+
+    struct mp_preload_decoder *pd = talloc_zero(NULL, struct mp_preload_decoder);
+    talloc_set_destructor(pd, destroy_preload_decoder);
+    pd->stream = sh;
+    pd->root = mp_filter_create_root(global);
+    mp_filter_graph_set_wakeup_cb(pd->root, wakeup_dispatch, dispatch);
+
+    pd->dec = mp_decoder_wrapper_create_detached(pd->root, sh);
+    if (!pd->dec)
+        goto error;
+    // Like init_audio_decoder() with an audio output.
+    if (type == STREAM_AUDIO)
+        mp_decoder_wrapper_set_spdif_flag(pd->dec, true);
+    if (!mp_decoder_wrapper_reinit(pd->dec))
+        goto error;
+
+    struct mp_pin *out = pd->dec->f->pins[0];
+    while (!mp_cancel_test(cancel)) {
+        if (mp_pin_out_request_data(out)) {
+            struct mp_frame frame = mp_pin_out_read(out);
+            if (frame.type == frame_type) {
+                pd->first_frame = frame;
+                break;
+            }
+            bool eof = frame.type == MP_FRAME_EOF;
+            mp_frame_unref(&frame);
+            if (eof)
+                break;
+            continue;
+        }
+        mp_filter_graph_run(pd->root);
+        if (mp_filter_has_failed(pd->root))
+            break;
+        if (!mp_pin_out_has_data(out))
+            mp_dispatch_queue_process(dispatch, INFINITY);
+    }
+
+    if (!pd->first_frame.type)
+        goto error;
+
+    return pd;
+
+error:
+    talloc_free(pd);
+    return NULL;
+}
+
+// Stop and free entries marked by apply_budget_locked() (must NOT hold lock)
+static void evict_marked_entries(void)
+{
+    pthread_mutex_lock(&preload_cache.lock);
+    for (int i = 0; i < preload_cache.max_entries; i++) {
+        struct preload_entry *e = &preload_cache.entries[i];
+        if (e->url && e->evicting)
+            cleanup_entry(e);
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+}
+
+// Make the monitor thread re-check the entry's status. Can be called from any
+// thread with any locks held (including demuxer internal ones).
+static void request_check(struct preload_entry *entry)
+{
+    pthread_mutex_lock(&preload_cache.monitor_lock);
+    preload_cache.check_pending[entry - preload_cache.entries] = true;
+    pthread_cond_signal(&preload_cache.monitor_cond);
+    pthread_mutex_unlock(&preload_cache.monitor_lock);
+}
+
+static void request_check_cb(void *ptr)
+{
+    request_check(ptr);
+}
+
+// Update the status of an opened entry (must hold lock). The demuxer triggers
+// request_check() when the cache target is reached (or on EOF), so the CACHED
+// status is set without polling. Returns whether the status changed.
+static bool check_entry_locked(struct preload_entry *entry)
+{
+    if (!entry->monitored || entry->cancel_requested || !entry->demuxer)
+        return false;
+
+    bool changed = false;
+
+    // Give the bandwidth to the active playback if it's low on buffer.
+    int level = preload_cache.throttle_level;
+    bool throttle = level == 2 || (level == 1 && entry->priority <= 0);
+    if (throttle != entry->throttled) {
+        entry->throttled = throttle;
+        demux_block_reading(entry->demuxer, throttle);
+    }
+
+    // Head-only preload promoted to full prefetch (mpv_preload_promote())
+    if (entry->head_limited && !entry->head_keyframes) {
+        entry->head_limited = false;
+        demux_set_prefetch_keyframes(entry->demuxer, 0);
+        if (entry->status == MPV_PRELOAD_STATUS_CACHED) {
+            entry->status = MPV_PRELOAD_STATUS_LOADING;
+            changed = true;
+        }
+    }
+
+    struct demux_reader_state state;
+    demux_get_reader_state(entry->demuxer, &state);
+    entry->bytes_per_second = state.bytes_per_second;
+
+    // The first packet after opening is a keyframe.
+    if (!entry->time_first_packet && (state.fw_bytes > 0 || state.eof))
+        entry->time_first_packet = mp_time_ns();
+
+    // Check if cache target reached or entire file cached
+    if (entry->status != MPV_PRELOAD_STATUS_CACHED) {
+        // Trigger CACHED when: target bytes reached OR entire file cached
+        // OR the head-only part is complete
+        if (state.fw_bytes >= entry->cache_limit || state.eof_cached ||
+            (entry->head_limited && state.prefetch_limited))
+        {
+            demux_set_buffer_notify(entry->demuxer, 0, NULL, NULL);
+            entry->status = MPV_PRELOAD_STATUS_CACHED;
+            if (!entry->time_cached)
+                entry->time_cached = mp_time_ns();
+            changed = true;
+        } else {
+            // (Re-)arm; also needed if the target was changed. Until the
+            // first packet arrives, get woken up for it too.
+            int64_t target = entry->time_first_packet ? entry->cache_limit : 1;
+            demux_set_buffer_notify(entry->demuxer, target,
+                                    request_check_cb, entry);
+        }
+    }
+
+    return changed;
+}
+
+// arg is the bool that stops this thread. (Each monitor has its own, so that a
+// new one can be started while the old one is still exiting.)
+static MP_THREAD_VOID monitor_thread(void *arg)
+{
+    bool *exit = arg;
+
+    mp_thread_set_name("preload-mon");
+
+    pthread_mutex_lock(&preload_cache.monitor_lock);
+    while (!*exit) {
+        int idx = -1;
+        for (int n = 0; n < PRELOAD_CACHE_CAPACITY; n++) {
+            if (preload_cache.check_pending[n]) {
+                idx = n;
+                break;
+            }
+        }
+        if (idx < 0) {
+            pthread_cond_wait(&preload_cache.monitor_cond,
+                              &preload_cache.monitor_lock);
+            continue;
+        }
+        preload_cache.check_pending[idx] = false;
+        pthread_mutex_unlock(&preload_cache.monitor_lock);
+
+        struct preload_entry *entry = &preload_cache.entries[idx];
+        pthread_mutex_lock(&preload_cache.lock);
+        if (check_entry_locked(entry)) {
+            entry->busy++;
+            pthread_mutex_unlock(&preload_cache.lock);
+            invoke_callback(entry);
+            pthread_mutex_lock(&preload_cache.lock);
+            entry->busy--;
+            pthread_cond_broadcast(&preload_cache.demuxer_ready_cond);
+        }
+        pthread_mutex_unlock(&preload_cache.lock);
+
+        pthread_mutex_lock(&preload_cache.monitor_lock);
+    }
+    // A wakeup meant for a new monitor could have been taken by this one.
+    pthread_cond_broadcast(&preload_cache.monitor_cond);
+    pthread_mutex_unlock(&preload_cache.monitor_lock);
+    MP_THREAD_RETURN();
+}
+
+// Open the demuxer (and prewarm the decoder). Runs on the pool.
+static void run_preload(struct preload_entry *entry)
 {
-    struct preload_entry *entry = arg;
-    
-    mp_thread_set_name("preload");
-    
     // Create minimal global context
-    entry->global = create_minimal_global(entry->max_bytes, entry->readahead_secs);
+    pthread_mutex_lock(&preload_cache.lock);
+    entry->global = create_minimal_global(entry->cache_limit, entry->readahead_secs);
+    if (entry->global) {
+        // Keep the HTTP connection open across requests. Probing and the
+        // initial seeks (e.g. mp4 with the index at the end) then don't redo
+        // the TCP connect and TLS handshake each time, and the warm connection
+        // is handed to the player together with the demuxer.
+        set_preload_option(entry->global, "stream-lavf-o", "multiple_requests=1");
+        for (int n = 0; n < preload_cache.num_net_opts; n += 2) {
+            set_preload_option(entry->global, preload_cache.net_opts[n],
+                               preload_cache.net_opts[n + 1]);
+        }
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
     if (!entry->global) {
         entry->status = MPV_PRELOAD_STATUS_ERROR;
         invoke_callback(entry);
-        return NULL;
+        return;
     }
     
-    // Create cancel token
+    if (entry->prewarm_decoder) {
+        // The decoder thread is what makes the decoder movable to the player.
+        // Keep its queue minimal, so only the first frame(s) get decoded.
+        set_preload_option(entry->global, "vd-queue-enable", "yes");
+        set_preload_option(entry->global, "vd-queue-max-samples", "1");
+        if (entry->prewarm_hwdec)
+            set_preload_option(entry->global, "hwdec", entry->prewarm_hwdec);
+    }
+
+    // Create cancel token; triggering it also wakes up this job
     entry->cancel = mp_cancel_new(NULL);
+    entry->dispatch = mp_dispatch_create(NULL);
+    mp_cancel_set_cb(entry->cancel, wakeup_preload_job, entry);
     
     // Set up demuxer params
     struct demuxer_params params = {
         .is_top_level = true,
         .stream_flags = STREAM_ORIGIN_NET,
     };
+
+    pthread_mutex_lock(&preload_cache.lock);
+    if (entry->persist_head && preload_cache.disk_cache_dir) {
+        params.head_cache_dir =
+            talloc_strdup(entry->global, preload_cache.disk_cache_dir);
+        params.head_cache_bytes = preload_cache.disk_cache_head_bytes;
+    }
+    int64_t disk_cache_max = preload_cache.disk_cache_max_bytes;
+    pthread_mutex_unlock(&preload_cache.lock);
+
+    // Make room for the head of this entry, if it's not cached yet.
+    if (params.head_cache_dir) {
+        stream_headcache_trim(params.head_cache_dir,
+                              MPMAX(disk_cache_max - params.head_cache_bytes, 0));
+    }
     
-    // Open demuxer (this does network I/O)
-    entry->demuxer = demux_open_url(entry->url, &params, entry->cancel, entry->global);
+    // Open demuxer (this does network I/O, unless the head is cached on disk)
+    struct demuxer *demuxer =
+        demux_open_url(entry->url, &params, entry->cancel, entry->global);
+    pthread_rwlock_wrlock(&preload_cache.state_lock);
+    entry->demuxer = demuxer;
+    entry->time_connected = params.stream_opened_ns;
+    if (demuxer)
+        entry->time_header = mp_time_ns();
+    pthread_rwlock_unlock(&preload_cache.state_lock);
     
     if (!entry->demuxer) {
+        mp_cancel_set_cb(entry->cancel, NULL, NULL);
         entry->status = MPV_PRELOAD_STATUS_ERROR;
         invoke_callback(entry);
-        return NULL;
+        return;
     }
     
     // Select all video and audio streams for prefetching
@@ -273,38 +821,68 @@ static void *preload_thread(void *arg)
     }
     
     // Start demux thread for prefetching
+    pthread_mutex_lock(&preload_cache.lock);
+    int head_keyframes = entry->head_keyframes;
+    entry->head_limited = head_keyframes > 0;
+    pthread_mutex_unlock(&preload_cache.lock);
+    demux_set_prefetch_keyframes(entry->demuxer, head_keyframes);
     demux_start_thread(entry->demuxer);
     demux_start_prefetch(entry->demuxer);
     
     // Demuxer is now usable - mark as ready and invoke callback
+    entry->time_ready = mp_time_ns();
     entry->status = MPV_PRELOAD_STATUS_READY;
-    
-    // Signal any waiters that demuxer is now available
+    invoke_callback(entry);
+
+    if (entry->prewarm_decoder) {
+        // Packets read by the decoder are gone from the demuxer's point of
+        // view, so the player has to wait for this to finish before taking
+        // the demuxer (see mpv_preload_get_demuxer()).
+        struct mp_preload_decoder *dec =
+            mp_preload_decoder_create(entry->global, entry->demuxer,
+                                      STREAM_VIDEO, entry->cancel,
+                                      entry->dispatch);
+        pthread_mutex_lock(&preload_cache.lock);
+        pthread_rwlock_wrlock(&preload_cache.state_lock);
+        entry->dec = dec;
+        pthread_rwlock_unlock(&preload_cache.state_lock);
+        pthread_mutex_unlock(&preload_cache.lock);
+        if (dec)
+            invoke_callback(entry);
+    }
+
+    // The demuxer and cancel token may outlive the job (handed to the player).
+    mp_cancel_set_cb(entry->cancel, NULL, NULL);
+}
+
+static void preload_job(void *arg)
+{
+    struct preload_job *job = arg;
+    struct preload_entry *entry = job->entry;
+
     pthread_mutex_lock(&preload_cache.lock);
+    bool run = entry->id == job->id && !entry->cancel_requested;
+    if (run) {
+        entry->job_queued = false;
+        entry->job_running = true;
+        entry->busy++;
+        entry->time_opening = mp_time_ns();
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+    free(job);
+    if (!run)
+        return;  // cancelled or freed while queued
+
+    run_preload(entry);
+
+    pthread_mutex_lock(&preload_cache.lock);
+    entry->job_running = false;
+    entry->busy--;
+    entry->monitored = entry->demuxer && !entry->cancel_requested;
     pthread_cond_broadcast(&preload_cache.demuxer_ready_cond);
     pthread_mutex_unlock(&preload_cache.lock);
-    
-    invoke_callback(entry);
-    
-    // Wait until user requests the demuxer or cancels
-    // Check for cache target reached to trigger CACHED callback
-    bool target_notified = false;
-    while (!entry->cancel_requested && !mp_cancel_test(entry->cancel)) {
-        // Check if cache target reached or entire file cached
-        if (!target_notified && entry->demuxer) {
-            struct demux_reader_state state;
-            demux_get_reader_state(entry->demuxer, &state);
-            // Trigger CACHED when: target bytes reached OR entire file cached
-            if (state.fw_bytes >= entry->max_bytes || state.eof_cached) {
-                entry->status = MPV_PRELOAD_STATUS_CACHED;
-                invoke_callback(entry);
-                target_notified = true;
-            }
-        }
-        mp_cancel_wait(entry->cancel, 0.5);
-    }
-    
-    return NULL;
+
+    request_check(entry);
 }
 
 int mpv_preload_start(const char *url, const mpv_preload_options *opts)
@@ -331,10 +909,15 @@ int mpv_preload_start(const char *url, const mpv_preload_options *opts)
     }
     
     // Initialize entry
-    entry->url = strdup(url);
+    if (!set_entry_url_locked(entry, url)) {
+        pthread_mutex_unlock(&preload_cache.lock);
+        return -1;
+    }
     entry->status = MPV_PRELOAD_STATUS_LOADING;
     entry->create_time = time(NULL);
     entry->cancel_requested = false;
+    entry->id = ++preload_cache.next_id;
+    entry->time_start = mp_time_ns();
     
     // Apply options
     entry->max_bytes = (opts && opts->max_bytes > 0) 
@@ -343,19 +926,60 @@ int mpv_preload_start(const char *url, const mpv_preload_options *opts)
     entry->readahead_secs = (opts && opts->readahead_secs > 0) 
         ? opts->readahead_secs 
         : 10.0;  // Default 10s
-    
-    // Start preload thread
-    if (mp_thread_create(&entry->thread, preload_thread, entry) != 0) {
+    entry->prewarm_decoder = opts && opts->prewarm_decoder;
+    entry->prewarm_hwdec = opts && opts->prewarm_hwdec
+        ? strdup(opts->prewarm_hwdec) : NULL;
+    entry->priority = opts ? opts->priority : 0;
+    entry->head_keyframes = opts ? MPMAX(opts->head_keyframes, 0) : 0;
+    entry->persist_head = opts && opts->persist_head;
+    entry->cache_limit = entry->max_bytes;
+
+    // Make room for the new entry, possibly at the expense of entries with
+    // lower priority. If even that is not enough, don't start it at all.
+    apply_budget_locked();
+
+    if (!preload_cache.pool) {
+        preload_cache.pool =
+            mp_thread_pool_create(NULL, 0, 0, preload_cache.max_opens);
+    }
+    if (!preload_cache.monitor_running) {
+        bool *exit = calloc(1, sizeof(*exit));
+        preload_cache.monitor_running = exit &&
+            mp_thread_create(&preload_cache.monitor, monitor_thread, exit) == 0;
+        if (preload_cache.monitor_running) {
+            preload_cache.monitor_exit = exit;
+        } else {
+            free(exit);
+        }
+    }
+    struct preload_job *job = malloc(sizeof(*job));
+    if (job)
+        *job = (struct preload_job){entry, entry->id};
+    entry->job_queued = true;
+    
+    // Queue the open job
+    if (entry->evicting || !job || !preload_cache.monitor_running ||
+        !mp_thread_pool_queue(preload_cache.pool, preload_job, job))
+    {
+        free(job);
+        entry->job_queued = false;
+        entry->id = 0;
+        pthread_rwlock_wrlock(&preload_cache.state_lock);
+        remove_entry_url_locked(entry);
         free(entry->url);
         entry->url = NULL;
+        pthread_rwlock_unlock(&preload_cache.state_lock);
+        free(entry->prewarm_hwdec);
+        entry->prewarm_hwdec = NULL;
         entry->status = MPV_PRELOAD_STATUS_NONE;
+        entry->evicting = false;
         pthread_mutex_unlock(&preload_cache.lock);
+        evict_marked_entries();
         return -1;
     }
     
-    entry->thread_running = true;
-    
     pthread_mutex_unlock(&preload_cache.lock);
+    evict_marked_entries();
     return 0;
 }
 
@@ -366,24 +990,28 @@ int mpv_preload_get_info(const char *url, mpv_preload_info *info)
     
     memset(info, 0, sizeof(*info));
     
-    pthread_mutex_lock(&preload_cache.lock);
+    pthread_rwlock_rdlock(&preload_cache.state_lock);
     
     struct preload_entry *entry = find_entry_locked(url);
     if (!entry) {
-        pthread_mutex_unlock(&preload_cache.lock);
+        pthread_rwlock_unlock(&preload_cache.state_lock);
         info->status = MPV_PRELOAD_STATUS_NONE;
         return -1;
     }
     
     fill_preload_info(entry, info);
     
-    pthread_mutex_unlock(&preload_cache.lock);
+    pthread_rwlock_unlock(&preload_cache.state_lock);
     return 0;
 }
 
 
-struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cancel)
+struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cancel,
+                                        struct mp_preload_decoder **out_dec)
 {
+    if (out_dec)
+        *out_dec = NULL;
+
     if (!url || !preload_cache.initialized)
         return NULL;
     
@@ -398,10 +1026,19 @@ struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cance
         return NULL;
     }
     
-    // If LOADING (demux_open in progress), wait for demuxer to become available
-    // or for the operation to be cancelled.
-    if (entry->status == MPV_PRELOAD_STATUS_LOADING && !entry->demuxer) {
-        while (entry->status == MPV_PRELOAD_STATUS_LOADING && !entry->demuxer) {
+    // If the open job is still waiting for a free worker, waiting for it
+    // would only be slower than opening directly.
+    if (entry->job_queued) {
+        cleanup_entry(entry);
+        pthread_mutex_unlock(&preload_cache.lock);
+        return NULL;
+    }
+
+    // If the open job is running (demux_open in progress), wait for it to
+    // finish or for the operation to be cancelled. This includes the decoder
+    // prewarm stage, which reads packets from the demuxer.
+    if (entry->job_running) {
+        while (entry->job_running) {
             // Check for cancellation
             if (cancel && mp_cancel_test(cancel)) {
                 pthread_mutex_unlock(&preload_cache.lock);
@@ -435,23 +1072,46 @@ struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cance
         return NULL;
     }
     
-    // Request preload thread to stop
+    // Stop status monitoring
     // DON'T trigger cancel - that would propagate to demuxer's child cancel
-    // and stop network reads. The preload thread will exit on its own
-    // within 0.5s (mp_cancel_wait timeout).
+    // and stop network reads.
     entry->cancel_requested = true;
+    entry->monitored = false;
     
-    // Wait for thread to finish (max 0.5s wait due to mp_cancel_wait timeout)
-    if (entry->thread_running) {
+    // Wait for a running status callback
+    if (!wait_idle_locked(entry)) {
         pthread_mutex_unlock(&preload_cache.lock);
-        mp_thread_join(entry->thread);
-        pthread_mutex_lock(&preload_cache.lock);
-        entry->thread_running = false;
+        return NULL;
     }
     
     // Take ownership of demuxer
+    pthread_rwlock_wrlock(&preload_cache.state_lock);
     struct demuxer *demux = entry->demuxer;
     entry->demuxer = NULL;  // Detach from entry
+    struct demux_reader_state state;
+    demux_get_reader_state(demux, &state);
+    entry->bytes_per_second = state.bytes_per_second;
+    struct mp_preload_decoder *dec = entry->dec;
+    entry->dec = NULL;
+    pthread_rwlock_unlock(&preload_cache.state_lock);
+    demux_set_buffer_notify(demux, 0, NULL, NULL);
+
+    // The player wants the normal readahead, even if only the head was loaded.
+    demux_set_prefetch_keyframes(demux, 0);
+    if (entry->throttled) {
+        demux_block_reading(demux, false);
+        entry->throttled = false;
+    }
+
+    // The prewarmed decoder goes with it (or is dropped if the caller can't
+    // use it - it has consumed packets the demuxer won't return again).
+    if (out_dec && dec) {
+        mp_filter_graph_set_wakeup_cb(dec->root, NULL, NULL);
+        *out_dec = dec;
+        dec = NULL;
+    }
+    talloc_free(dec);
+    TA_FREEP(&entry->dispatch);
     
     // Transfer ownership of global and cancel to demuxer using talloc_steal.
     // Since we don't initialize stats in preload global (stats_ctx_create returns NULL),
@@ -475,6 +1135,52 @@ struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cance
     return demux;
 }
 
+// demux_fanout_open_fn for mp_preload_open_shared()
+static struct demuxer *open_shared_source(void *ctx, const char *url,
+                                          struct mp_cancel *cancel)
+{
+    // A preloaded demuxer becomes the shared source, so the data it has
+    // already fetched is used.
+    struct demuxer *demuxer = mpv_preload_get_demuxer(url, cancel, NULL);
+    if (demuxer) {
+        demux_stop_thread(demuxer);
+        demux_set_prefetch_keyframes(demuxer, 0);
+        return demuxer;
+    }
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    struct mpv_global *global = create_minimal_global(0, 0);
+    for (int n = 0; n < preload_cache.num_net_opts; n += 2) {
+        set_preload_option(global, preload_cache.net_opts[n],
+                           preload_cache.net_opts[n + 1]);
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .stream_flags = STREAM_ORIGIN_NET,
+    };
+    demuxer = demux_open_url(url, &params, cancel, global);
+    if (!demuxer) {
+        talloc_free(global);
+        return NULL;
+    }
+    // The source outlives the player that opened it.
+    mp_cancel_set_parent(demuxer->cancel, NULL);
+    talloc_steal(demuxer, global);
+    return demuxer;
+}
+
+struct demuxer *mp_preload_open_shared(const char *url,
+                                       struct demuxer_params *params,
+                                       struct mp_cancel *cancel,
+                                       struct mpv_global *global)
+{
+    return demux_fanout_open(url, open_shared_source, NULL, params, cancel,
+                             global);
+}
+
 int mpv_preload_cancel(const char *url)
 {
     if (!url || !preload_cache.initialized)
@@ -488,19 +1194,6 @@ int mpv_preload_cancel(const char *url)
         return -1;
     }
     
-    entry->cancel_requested = true;
-    if (entry->cancel)
-        mp_cancel_trigger(entry->cancel);
-    
-    pthread_mutex_unlock(&preload_cache.lock);
-    
-    // Join thread outside lock
-    if (entry->thread_running) {
-        mp_thread_join(entry->thread);
-        entry->thread_running = false;
-    }
-    
-    pthread_mutex_lock(&preload_cache.lock);
     cleanup_entry(entry);
     pthread_mutex_unlock(&preload_cache.lock);
     
@@ -512,7 +1205,7 @@ void mpv_preload_clear_all(void)
     if (!preload_cache.initialized)
         return;
     
-    // First, request all to cancel
+    // First, request all to cancel, so they abort in parallel
     pthread_mutex_lock(&preload_cache.lock);
     for (int i = 0; i < preload_cache.max_entries; i++) {
         struct preload_entry *entry = &preload_cache.entries[i];
@@ -522,23 +1215,28 @@ void mpv_preload_clear_all(void)
                 mp_cancel_trigger(entry->cancel);
         }
     }
-    pthread_mutex_unlock(&preload_cache.lock);
     
-    // Join all threads
-    for (int i = 0; i < preload_cache.max_entries; i++) {
-        struct preload_entry *entry = &preload_cache.entries[i];
-        if (entry->thread_running) {
-            mp_thread_join(entry->thread);
-            entry->thread_running = false;
-        }
-    }
-    
-    // Cleanup all
-    pthread_mutex_lock(&preload_cache.lock);
-    for (int i = 0; i < preload_cache.max_entries; i++) {
+    // Cleanup all (waits for the open jobs)
+    for (int i = 0; i < preload_cache.max_entries; i++)
         cleanup_entry(&preload_cache.entries[i]);
-    }
+
+    // Nothing left to monitor. The next mpv_preload_start() starts a new one.
+    bool stop_monitor = preload_cache.monitor_running;
+    mp_thread monitor = preload_cache.monitor;
+    bool *monitor_exit = preload_cache.monitor_exit;
+    preload_cache.monitor_running = false;
+    preload_cache.monitor_exit = NULL;
     pthread_mutex_unlock(&preload_cache.lock);
+
+    // (The monitor takes lock, so it can't be joined with lock held.)
+    if (stop_monitor) {
+        pthread_mutex_lock(&preload_cache.monitor_lock);
+        *monitor_exit = true;
+        pthread_cond_broadcast(&preload_cache.monitor_cond);
+        pthread_mutex_unlock(&preload_cache.monitor_lock);
+        mp_thread_join(monitor);
+        free(monitor_exit);
+    }
 }
 
 int mpv_preload_recycle(const char *url, struct demuxer *demuxer)
@@ -567,9 +1265,23 @@ int mpv_preload_recycle(const char *url, struct demuxer *demuxer)
     demux_reset_state(demuxer);
 
     // Return demuxer to entry
+    pthread_rwlock_wrlock(&preload_cache.state_lock);
     entry->demuxer = demuxer;
+    pthread_rwlock_unlock(&preload_cache.state_lock);
     entry->status = MPV_PRELOAD_STATUS_CACHED;
     entry->create_time = time(NULL);  // Refresh timestamp for LRU
+
+    // Its cache counts against the budget again.
+    apply_budget_locked();
+    if (entry->evicting) {
+        pthread_rwlock_wrlock(&preload_cache.state_lock);
+        entry->demuxer = NULL;
+        pthread_rwlock_unlock(&preload_cache.state_lock);
+        cleanup_entry(entry);
+        pthread_mutex_unlock(&preload_cache.lock);
+        evict_marked_entries();
+        return -1;  // Caller frees the demuxer
+    }
     
     // Note: global and cancel were talloc_steal'd to demuxer in get_demuxer.
     // We don't reclaim them here - they stay with demuxer and will be properly
@@ -578,6 +1290,7 @@ int mpv_preload_recycle(const char *url, struct demuxer *demuxer)
     // (no thread running, no need to access global/cancel from entry).
     
     pthread_mutex_unlock(&preload_cache.lock);
+    evict_marked_entries();
     
     // Notify about recycle (status changed to CACHED)
     invoke_callback(entry);
@@ -632,3 +1345,184 @@ int mpv_preload_get_active_count(void)
     pthread_mutex_unlock(&preload_cache.lock);
     return count;
 }
+
+int mpv_preload_set_memory_budget(int64_t bytes)
+{
+    if (bytes < 0)
+        return -1;
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    preload_cache.memory_budget = bytes;
+    apply_budget_locked();
+    pthread_mutex_unlock(&preload_cache.lock);
+    evict_marked_entries();
+    return 0;
+}
+
+int64_t mpv_preload_get_memory_budget(void)
+{
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    int64_t bytes = preload_cache.memory_budget;
+    pthread_mutex_unlock(&preload_cache.lock);
+    return bytes;
+}
+
+int mpv_preload_set_priority(const char *url, int priority)
+{
+    if (!url || !preload_cache.initialized)
+        return -1;
+
+    pthread_mutex_lock(&preload_cache.lock);
+    struct preload_entry *entry = find_entry_locked(url);
+    if (!entry) {
+        pthread_mutex_unlock(&preload_cache.lock);
+        return -1;
+    }
+    entry->priority = priority;
+    if (entry->monitored)
+        request_check(entry);   // may change whether it's throttled
+    apply_budget_locked();
+    pthread_mutex_unlock(&preload_cache.lock);
+    evict_marked_entries();
+    return 0;
+}
+
+int mpv_preload_set_network_option(const char *name, const char *value)
+{
+    if (!name || !name[0])
+        return -1;
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    int idx = -1;
+    for (int n = 0; n < preload_cache.num_net_opts; n += 2) {
+        if (strcmp(preload_cache.net_opts[n], name) == 0)
+            idx = n;
+    }
+    if (idx >= 0) {
+        free(preload_cache.net_opts[idx]);
+        free(preload_cache.net_opts[idx + 1]);
+        preload_cache.num_net_opts -= 2;
+        for (int n = idx; n < preload_cache.num_net_opts; n++)
+            preload_cache.net_opts[n] = preload_cache.net_opts[n + 2];
+    }
+    if (value) {
+        char **opts = realloc(preload_cache.net_opts,
+                    (preload_cache.num_net_opts + 2) * sizeof(opts[0]));
+        if (!opts) {
+            pthread_mutex_unlock(&preload_cache.lock);
+            return -1;
+        }
+        preload_cache.net_opts = opts;
+        opts[preload_cache.num_net_opts++] = strdup(name);
+        opts[preload_cache.num_net_opts++] = strdup(value);
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+    return 0;
+}
+
+int mpv_preload_promote(const char *url)
+{
+    if (!url || !preload_cache.initialized)
+        return -1;
+
+    pthread_mutex_lock(&preload_cache.lock);
+    struct preload_entry *entry = find_entry_locked(url);
+    if (!entry || entry->status == MPV_PRELOAD_STATUS_ERROR ||
+        entry->status == MPV_PRELOAD_STATUS_DETACHED)
+    {
+        pthread_mutex_unlock(&preload_cache.lock);
+        return -1;
+    }
+    if (entry->head_keyframes) {
+        entry->head_keyframes = 0;
+        request_check(entry);
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+    return 0;
+}
+
+int mpv_preload_set_max_concurrent_opens(int num)
+{
+    if (num < 1 || num > PRELOAD_CACHE_CAPACITY)
+        return -1;
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    preload_cache.max_opens = num;
+    // Running opens are not interrupted; if the limit was lowered, their
+    // threads exit as they finish.
+    if (preload_cache.pool)
+        mp_thread_pool_set_max_threads(preload_cache.pool, num);
+    pthread_mutex_unlock(&preload_cache.lock);
+    return 0;
+}
+
+int mpv_preload_get_max_concurrent_opens(void)
+{
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    int num = preload_cache.max_opens;
+    pthread_mutex_unlock(&preload_cache.lock);
+    return num;
+}
+
+int mpv_preload_set_disk_cache(const char *dir, int64_t max_bytes,
+                               int64_t head_bytes)
+{
+    if (dir && (!dir[0] || max_bytes <= 0 || head_bytes < 0))
+        return -1;
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    talloc_free(preload_cache.disk_cache_dir);
+    preload_cache.disk_cache_dir = dir ? talloc_strdup(NULL, dir) : NULL;
+    preload_cache.disk_cache_max_bytes = max_bytes;
+    preload_cache.disk_cache_head_bytes = head_bytes > 0 ? head_bytes
+                                        : 2 * 1024 * 1024;  // Default 2MB
+    pthread_mutex_unlock(&preload_cache.lock);
+    return 0;
+}
+
+int mpv_preload_set_throttle(double low_secs, double high_secs)
+{
+    if (low_secs > 0 && high_secs < low_secs)
+        return -1;
+
+    ensure_initialized();
+    pthread_mutex_lock(&preload_cache.lock);
+    preload_cache.throttle_low = low_secs;
+    preload_cache.throttle_high = high_secs;
+    pthread_mutex_unlock(&preload_cache.lock);
+    return 0;
+}
+
+void mp_preload_update_playback(double buffered_secs, bool buffering)
+{
+    if (!preload_cache.initialized)
+        return;
+
+    pthread_mutex_lock(&preload_cache.lock);
+    int level = preload_cache.throttle_level;
+    if (preload_cache.throttle_low <= 0) {
+        level = 0;
+    } else if (buffering) {
+        level = 2;
+    } else if (buffered_secs < preload_cache.throttle_low) {
+        level = 1;
+    } else if (buffered_secs >= preload_cache.throttle_high) {
+        level = 0;
+    } else if (level == 2) {
+        level = 1;  // recovering, but not healthy yet
+    }
+    if (level != preload_cache.throttle_level) {
+        preload_cache.throttle_level = level;
+        for (int i = 0; i < preload_cache.max_entries; i++) {
+            if (preload_cache.entries[i].monitored)
+                request_check(&preload_cache.entries[i]);
+        }
+    }
+    pthread_mutex_unlock(&preload_cache.lock);
+}
@@ -8,9 +8,42 @@
 // Include public API
 #include "mpv/preload.h"
 
+#include "demux/stheader.h"
+#include "filters/frame.h"
+
 // Forward declaration for internal use
 struct demuxer;
+struct demuxer_params;
 struct mp_cancel;
+struct mp_decoder_wrapper;
+struct mp_dispatch_queue;
+struct mp_filter;
+struct mpv_global;
+
+/**
+ * Decoder created by the prewarm stage (mpv_preload_options.prewarm_decoder,
+ * --prefetch-playlist-decoders). Free with talloc_free(); this destroys the
+ * decoder and the frame if they were not taken. Must be freed before the
+ * demuxer it reads from.
+ */
+struct mp_preload_decoder {
+    struct sh_stream *stream;         // stream the decoder reads from
+    struct mp_decoder_wrapper *dec;   // uses a decoder thread, can be reparented
+    struct mp_filter *root;           // temporary filter graph dec was created in
+    struct mp_frame first_frame;      // first decoded frame, read from dec
+};
+
+/**
+ * Create a decoder for the first stream of the given type (STREAM_VIDEO or
+ * STREAM_AUDIO) and decode its first frame. The stream must be selected.
+ * dispatch is used to wait for the decoder, and must be interrupted when
+ * cancel is triggered. Returns NULL on failure or cancellation.
+ */
+struct mp_preload_decoder *mp_preload_decoder_create(struct mpv_global *global,
+                                                     struct demuxer *demuxer,
+                                                     enum stream_type type,
+                                                     struct mp_cancel *cancel,
+                                                     struct mp_dispatch_queue *dispatch);
 
 /**
  * Get demuxer for a URL (internal use).
@@ -19,9 +52,32 @@ struct mp_cancel;
  * Caller takes ownership.
  *
  * @param url URL to get demuxer for
+ * @param out_dec If not NULL, set to the prewarmed decoder (or NULL if none).
+ *                Caller takes ownership.
  * @return demuxer or NULL if not found
  */
-struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cancel);
+struct demuxer *mpv_preload_get_demuxer(const char *url, struct mp_cancel *cancel,
+                                        struct mp_preload_decoder **out_dec);
+
+/**
+ * Open url as a reader of a shared source (--shared-source, see
+ * demux_fanout_open()). The source is opened with its own global context
+ * like a preload (with the mpv_preload_set_network_option() options), or is
+ * a preloaded demuxer for the URL if there is one.
+ */
+struct demuxer *mp_preload_open_shared(const char *url,
+                                       struct demuxer_params *params,
+                                       struct mp_cancel *cancel,
+                                       struct mpv_global *global);
+
+/**
+ * Report the buffer state of the active playback. Preloads are throttled
+ * while it's low (see mpv_preload_set_throttle()).
+ *
+ * @param buffered_secs Seconds buffered ahead (INFINITY if nothing's missing)
+ * @param buffering Playback is paused waiting for the cache
+ */
+void mp_preload_update_playback(double buffered_secs, bool buffering);
 
 #endif /* MP_PLAYER_PRELOAD_H */
 
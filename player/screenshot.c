@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -31,8 +32,15 @@
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
+#include "common/av_common.h"
+#include "common/common.h"
 #include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "options/m_option.h"
 #include "options/path.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
@@ -47,6 +55,10 @@
 #define MODE_SUBTITLES 2
 #define MODE_OSD 4
 
+// Maximum number of screenshots encoded at the same time with
+// --screenshot-queue.
+#define MAX_WRITERS 2
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
     struct mp_log *log;
@@ -56,8 +68,30 @@ typedef struct screenshot_ctx {
 
     int frameno;
     uint64_t last_frame_count;
+
+    // For --screenshot-queue. The pool is created on first use.
+    struct mp_thread_pool *writers;
+    mp_mutex lock;
+    mp_cond wakeup;
+    int queued;             // guarded by lock
 } screenshot_ctx;
 
+struct screenshot_job {
+    struct screenshot_ctx *ctx;
+    struct mp_image *img;
+    char *filename;
+    struct image_writer_opts opts;
+    bool overwrite;
+    bool ok;
+};
+
+static void ctx_destroy(void *p)
+{
+    struct screenshot_ctx *ctx = p;
+    mp_mutex_destroy(&ctx->lock);
+    mp_cond_destroy(&ctx->wakeup);
+}
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -66,6 +100,19 @@ void screenshot_init(struct MPContext *mpctx)
         .frameno = 1,
         .log = mp_log_new(mpctx, mpctx->log, "screenshot")
     };
+    mp_mutex_init(&mpctx->screenshot_ctx->lock);
+    mp_cond_init(&mpctx->screenshot_ctx->wakeup);
+    talloc_set_destructor(mpctx->screenshot_ctx, ctx_destroy);
+}
+
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    // Blocks until all queued screenshots are written.
+    TA_FREEP(&ctx->writers);
+    // Run the completion callbacks they left on the core's queue.
+    mp_dispatch_queue_process(mpctx->dispatch, 0);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -76,6 +123,104 @@ static char *stripext(void *talloc_ctx, const char *s)
     return talloc_asprintf(talloc_ctx, "%.*s", (int)(end - s), s);
 }
 
+// Called on the core thread once a queued screenshot was written.
+static void finish_job(void *p)
+{
+    struct screenshot_job *job = p;
+    struct screenshot_ctx *ctx = job->ctx;
+
+    if (job->ok) {
+        MP_INFO(ctx, "Screenshot: '%s'\n", job->filename);
+    } else {
+        MP_ERR(ctx, "Error writing screenshot '%s'!\n", job->filename);
+    }
+
+    struct mpv_event_screenshot ev = {
+        .filename = job->filename,
+        .error = job->ok ? 0 : MPV_ERROR_GENERIC,
+    };
+    mp_notify(ctx->mpctx, MPV_EVENT_SCREENSHOT_WRITTEN, &ev);
+}
+
+static void run_job(void *p)
+{
+    struct screenshot_job *job = p;
+    struct screenshot_ctx *ctx = job->ctx;
+    struct MPContext *mpctx = ctx->mpctx;
+
+    job->ok = write_image(job->img, &job->opts, job->filename, mpctx->global,
+                          ctx->log, job->overwrite);
+    TA_FREEP(&job->img);
+
+    mp_mutex_lock(&ctx->lock);
+    ctx->queued--;
+    mp_cond_broadcast(&ctx->wakeup);
+    mp_mutex_unlock(&ctx->lock);
+
+    mp_dispatch_enqueue_autofree(mpctx->dispatch, finish_job, job);
+}
+
+// Hand the image to the writer threads, waiting for a free slot if
+// --screenshot-queue screenshots are already pending. Returns false if the
+// caller has to write the image itself.
+static bool queue_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
+                             const char *filename,
+                             struct image_writer_opts *opts, bool overwrite)
+{
+    struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    int max_queued = mpctx->opts->screenshot_queue;
+
+    if (!max_queued)
+        return false;
+
+    struct screenshot_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct screenshot_job){
+        .ctx = ctx,
+        .img = mp_image_new_ref(img),
+        .filename = talloc_strdup(job, filename),
+        .opts = *opts,
+        .overwrite = overwrite,
+    };
+    if (!job->img) {
+        talloc_free(job);
+        return false;
+    }
+    talloc_steal(job, job->img);
+    job->opts.avif_encoder = talloc_strdup(job, opts->avif_encoder);
+    job->opts.avif_pixfmt = talloc_strdup(job, opts->avif_pixfmt);
+    job->opts.avif_opts = mp_dup_str_array(job, opts->avif_opts);
+
+    if (!ctx->writers)
+        ctx->writers = mp_thread_pool_create(ctx, 0, 0, MAX_WRITERS);
+
+    mp_mutex_lock(&ctx->lock);
+    if (ctx->queued >= max_queued) {
+        mp_cmd_msg(cmd, MSGL_V, "Screenshot queue full, waiting.");
+        mp_mutex_unlock(&ctx->lock);
+        mp_core_unlock(mpctx);
+        mp_mutex_lock(&ctx->lock);
+        while (ctx->queued >= max_queued)
+            mp_cond_wait(&ctx->wakeup, &ctx->lock);
+        mp_mutex_unlock(&ctx->lock);
+        mp_core_lock(mpctx);
+        mp_mutex_lock(&ctx->lock);
+    }
+    ctx->queued++;
+    mp_mutex_unlock(&ctx->lock);
+
+    if (!mp_thread_pool_queue(ctx->writers, run_job, job)) {
+        mp_mutex_lock(&ctx->lock);
+        ctx->queued--;
+        mp_mutex_unlock(&ctx->lock);
+        talloc_free(job);
+        return false;
+    }
+
+    mp_cmd_msg(cmd, MSGL_V, "Queued screenshot: '%s'", filename);
+    return true;
+}
+
 static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
                              const char *filename, struct image_writer_opts *opts,
                              bool overwrite)
@@ -84,6 +229,9 @@ static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
     struct image_writer_opts *gopts = mpctx->opts->screenshot_image_opts;
     struct image_writer_opts opts_copy = opts ? *opts : *gopts;
 
+    if (img && queue_screenshot(cmd, img, filename, &opts_copy, overwrite))
+        return true;
+
     mp_cmd_msg(cmd, MSGL_V, "Starting screenshot: '%s'", filename);
 
     mp_core_unlock(mpctx);
@@ -337,6 +485,52 @@ static void add_osd(struct MPContext *mpctx, struct mp_image *image, int mode)
     }
 }
 
+// Downscale image to --screenshot-max-size, if the VO didn't.
+static struct mp_image *fit_image(struct MPContext *mpctx,
+                                  struct mp_image *image, int max_w, int max_h)
+{
+    if (mp_image_crop_valid(&image->params) &&
+        (mp_rect_w(image->params.crop) != image->w ||
+         mp_rect_h(image->params.crop) != image->h))
+    {
+        struct mp_image *nimage = mp_image_new_ref(image);
+        talloc_free(image);
+        if (!nimage)
+            return NULL;
+        mp_image_crop_rc(nimage, nimage->params.crop);
+        image = nimage;
+    }
+
+    int d_w, d_h;
+    mp_image_params_get_dsize(&image->params, &d_w, &d_h);
+    double f = 1.0;
+    if (max_w > 0 && d_w > max_w)
+        f = MPMIN(f, max_w / (double)d_w);
+    if (max_h > 0 && d_h > max_h)
+        f = MPMIN(f, max_h / (double)d_h);
+    if (f >= 1.0)
+        return image;
+
+    int w = MPMAX(lrint(image->w * f), 1);
+    int h = MPMAX(lrint(image->h * f), 1);
+    struct mp_image *nimage = mp_image_alloc(image->imgfmt, w, h);
+    if (!nimage) {
+        talloc_free(image);
+        return NULL;
+    }
+    mp_image_copy_attributes(nimage, image);
+    nimage->params.crop = (struct mp_rect){0, 0, w, h};
+    struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->background = true;
+    mp_sws_enable_cmdline_opts(sws, mpctx->global);
+    bool ok = mp_sws_scale(sws, nimage, image) >= 0;
+    talloc_free(sws);
+    talloc_free(image);
+    if (!ok)
+        TA_FREEP(&nimage);
+    return nimage;
+}
+
 static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode,
                                        bool high_depth)
 {
@@ -361,8 +555,15 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode,
         .high_bit_depth = high_depth && imgopts->high_bit_depth,
         .native_csp = image_writer_flexible_csp(imgopts),
     };
-    if (!use_sw)
+    struct m_geometry *max_size = &mpctx->opts->screenshot_max_size;
+    if (max_size->wh_valid) {
+        ctrl.max_w = max_size->w_per ? 0 : max_size->w;
+        ctrl.max_h = max_size->h_per ? 0 : max_size->h;
+    }
+    if (!use_sw) {
         vo_control(mpctx->video_out, VOCTRL_SCREENSHOT, &ctrl);
+        vo_screenshot_wait(mpctx->video_out, &ctrl);
+    }
     image = ctrl.res;
 
     // VOCTRL_SCREENSHOT_WIN gets the complete rendered image so it's only
@@ -408,6 +609,7 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode,
                 return NULL;
             }
             struct mp_sws_context *sws = mp_sws_alloc(NULL);
+            sws->background = true;
             mp_sws_scale(sws, nimage, image);
             talloc_free(image);
             talloc_free(sws);
@@ -420,6 +622,11 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode,
 
     if (use_sw && mode != 0)
         add_osd(mpctx, image, mode);
+    if (ctrl.max_w > 0 || ctrl.max_h > 0) {
+        image = fit_image(mpctx, image, ctrl.max_w, ctrl.max_h);
+        if (!image)
+            return NULL;
+    }
     mp_image_params_guess_csp(&image->params);
     return image;
 }
@@ -452,6 +659,7 @@ struct mp_image *convert_image(struct mp_image *image, int destfmt,
     dst->params = p;
 
     struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->background = true;
     sws->log = log;
     if (global)
         mp_sws_enable_cmdline_opts(sws, global);
@@ -589,6 +797,494 @@ void cmd_screenshot_raw(void *p)
     talloc_steal(ba, img);
 }
 
+// Decode the first keyframe at or before pts. d has only sh selected.
+static struct mp_image *decode_keyframe(struct demuxer *d, struct sh_stream *sh,
+                                        AVCodecContext *avctx, double pts)
+{
+    if (!demux_seek(d, pts, 0))
+        return NULL;
+
+    AVRational tb = mp_get_codec_timebase(sh->codec);
+    AVPacket *avpkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    struct mp_image *res = NULL;
+
+    // Reading too far would mean the file has no usable keyframes here.
+    for (int n = 0; n < 1000 && avpkt && frame; n++) {
+        struct demux_packet *pkt = demux_read_any_packet(d);
+        if (!pkt)
+            break;
+        bool keyframe = pkt->keyframe;
+        if (keyframe) {
+            mp_set_av_packet(avpkt, pkt, &tb);
+            avcodec_send_packet(avctx, avpkt);
+            avcodec_send_packet(avctx, NULL);
+        }
+        talloc_free(pkt);
+        if (keyframe) {
+            if (avcodec_receive_frame(avctx, frame) >= 0) {
+                res = mp_image_from_av_frame(frame);
+                if (res)
+                    res->pts = mp_pts_from_av(frame->pts, &tb);
+            }
+            break;
+        }
+    }
+
+    avcodec_flush_buffers(avctx);
+    av_frame_free(&frame);
+    av_packet_free(&avpkt);
+    return res;
+}
+
+// Scale the image to fit into w x h, keeping the display aspect ratio.
+static struct mp_image *scale_thumbnail(struct mp_image *img, int imgfmt,
+                                        int w, int h, struct mp_log *log)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (d_w <= 0 || d_h <= 0)
+        return NULL;
+    if ((int64_t)w * d_h > (int64_t)h * d_w) {
+        w = MPMAX(1, (int64_t)h * d_w / d_h);
+    } else {
+        h = MPMAX(1, (int64_t)w * d_h / d_w);
+    }
+
+    struct mp_image *dst = mp_image_alloc(imgfmt, w, h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, img);
+    dst->params.imgfmt = imgfmt;
+    dst->params.w = w;
+    dst->params.h = h;
+    dst->params.p_w = dst->params.p_h = 1;
+    dst->params.repr = (struct pl_color_repr){0};
+    dst->params.color = (struct pl_color_space){0};
+    mp_image_params_guess_csp(&dst->params);
+
+    struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->background = true;
+    sws->log = log;
+    bool ok = mp_sws_scale(sws, dst, img) >= 0;
+    talloc_free(sws);
+    if (!ok)
+        TA_FREEP(&dst);
+    return dst;
+}
+
+void cmd_thumbnail_raw(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    struct mpv_node *res = &cmd->result;
+    int count = cmd->args[0].v.i;
+    int w = cmd->args[1].v.i;
+    int h = cmd->args[2].v.i;
+
+    const enum mp_imgfmt formats[] = {IMGFMT_BGR0, IMGFMT_BGRA, IMGFMT_RGBA};
+    const char *format_names[] = {"bgr0", "bgra", "rgba"};
+    int idx = cmd->args[3].v.i;
+    mp_assert(idx >= 0 && idx < MP_ARRAY_SIZE(formats));
+
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    if (!track || track->image || !track->demuxer || !track->stream ||
+        !track->demuxer->filename || mpctx->stop_play)
+    {
+        mp_cmd_msg(cmd, MSGL_ERR, "No video to create thumbnails from.");
+        cmd->success = false;
+        return;
+    }
+
+    // The thumbnails are read with a separate demuxer, so that playback is not
+    // disturbed. With --stream-shared-cache, it shares data with the player's
+    // demuxer.
+    char *url = talloc_strdup(NULL, track->demuxer->filename);
+    int stream_index = track->stream->index;
+    struct demuxer_params params = {
+        .stream_flags = track->demuxer->stream_origin,
+    };
+    struct mp_log *log = mp_log_new(url, mpctx->log, "thumbnail");
+
+    mp_core_unlock(mpctx);
+
+    struct demuxer *d = demux_open_url(url, &params, cmd->abort->cancel,
+                                       mpctx->global);
+    struct sh_stream *sh = NULL;
+    AVCodecContext *avctx = NULL;
+    if (d && stream_index < demux_get_num_stream(d)) {
+        sh = demux_get_stream(d, stream_index);
+        if (sh->type != STREAM_VIDEO)
+            sh = NULL;
+    }
+    if (sh) {
+        const AVCodec *codec =
+            avcodec_find_decoder(mp_codec_to_av_codec_id(sh->codec->codec));
+        avctx = codec ? avcodec_alloc_context3(codec) : NULL;
+        if (avctx) {
+            avctx->skip_frame = AVDISCARD_NONKEY;
+            avctx->thread_count = 1;
+            if (mp_set_avctx_codec_headers(avctx, sh->codec) < 0 ||
+                avcodec_open2(avctx, codec, NULL) < 0)
+                avcodec_free_context(&avctx);
+        }
+    }
+
+    bool ok = !!avctx;
+    if (ok) {
+        node_init(res, MPV_FORMAT_NODE_ARRAY, NULL);
+        demuxer_select_track(d, sh, MP_NOPTS_VALUE, true);
+    }
+    double duration = d ? d->duration : -1;
+    for (int n = 0; ok && n < count; n++) {
+        if (mp_cancel_test(cmd->abort->cancel)) {
+            ok = false;
+            break;
+        }
+        double pts = duration > 0 ? duration * (n + 0.5) / count : 0;
+        struct mp_image *frame = decode_keyframe(d, sh, avctx, pts);
+        struct mp_image *img =
+            frame ? scale_thumbnail(frame, formats[idx], w, h, log) : NULL;
+        if (img) {
+            struct mpv_node *e = node_array_add(res, MPV_FORMAT_NODE_MAP);
+            node_map_add_double(e, "time", frame->pts);
+            node_map_add_int64(e, "w", img->w);
+            node_map_add_int64(e, "h", img->h);
+            node_map_add_int64(e, "stride", img->stride[0]);
+            node_map_add_string(e, "format", format_names[idx]);
+            struct mpv_byte_array *ba =
+                node_map_add(e, "data", MPV_FORMAT_BYTE_ARRAY)->u.ba;
+            *ba = (struct mpv_byte_array){
+                .data = img->planes[0],
+                .size = img->stride[0] * img->h,
+            };
+            talloc_steal(ba, img);
+        }
+        talloc_free(frame);
+    }
+
+    avcodec_free_context(&avctx);
+    demux_free(d);
+    talloc_free(url);
+
+    mp_core_lock(mpctx);
+
+    if (!ok) {
+        mp_cmd_msg(cmd, MSGL_ERR, "Creating thumbnails failed.");
+        cmd->success = false;
+    }
+}
+
+// Decoding state for screenshot-frames. d has only sh selected.
+struct frame_grabber {
+    struct demuxer *d;
+    struct sh_stream *sh;
+    AVCodecContext *avctx;
+    AVRational tb;
+    AVPacket *avpkt;
+    AVFrame *avframe;
+    bool active;            // decoding continues from the last position
+    bool eof;
+    struct mp_image *prev;  // last frame at or before the last target
+    struct mp_image *next;  // decoded frame after prev
+    double last_key;        // pts of the last keyframe sent to the decoder
+    double key_interval;    // largest keyframe distance seen so far
+};
+
+// Targets at most this far after the last frame are decoded to without seeking,
+// even if the keyframe distance is not known yet.
+#define GRAB_MAX_FORWARD 2.0
+
+static struct mp_image *grabber_decode(struct frame_grabber *g)
+{
+    while (1) {
+        int r = avcodec_receive_frame(g->avctx, g->avframe);
+        if (r >= 0) {
+            struct mp_image *img = mp_image_from_av_frame(g->avframe);
+            int64_t ts = g->avframe->best_effort_timestamp;
+            av_frame_unref(g->avframe);
+            if (img)
+                img->pts = mp_pts_from_av(ts, &g->tb);
+            return img;
+        }
+        if (r != AVERROR(EAGAIN) || g->eof)
+            return NULL;
+
+        struct demux_packet *pkt = demux_read_any_packet(g->d);
+        if (!pkt) {
+            g->eof = true;
+            avcodec_send_packet(g->avctx, NULL);
+            continue;
+        }
+        if (pkt->keyframe && pkt->pts != MP_NOPTS_VALUE) {
+            if (g->last_key != MP_NOPTS_VALUE && pkt->pts > g->last_key)
+                g->key_interval = MPMAX(g->key_interval, pkt->pts - g->last_key);
+            g->last_key = pkt->pts;
+        }
+        mp_set_av_packet(g->avpkt, pkt, &g->tb);
+        avcodec_send_packet(g->avctx, g->avpkt);
+        talloc_free(pkt);
+    }
+}
+
+// Return the frame shown at pts (or the first one after it). Targets must be
+// passed in ascending order to benefit from reusing decoded frames.
+static struct mp_image *grab_frame(struct frame_grabber *g, double pts)
+{
+    // Seeking goes back to the keyframe before pts. If pts is still within
+    // the GOP being decoded, this would only decode the same frames again.
+    bool reuse = g->active && g->prev && g->prev->pts != MP_NOPTS_VALUE &&
+                 pts >= g->prev->pts &&
+                 (pts < g->last_key + g->key_interval ||
+                  pts - g->prev->pts <= GRAB_MAX_FORWARD);
+    if (!reuse) {
+        TA_FREEP(&g->prev);
+        TA_FREEP(&g->next);
+        avcodec_flush_buffers(g->avctx);
+        g->eof = false;
+        g->last_key = MP_NOPTS_VALUE;
+        g->active = demux_seek(g->d, pts, 0);
+        if (!g->active)
+            return NULL;
+    }
+
+    while (1) {
+        if (!g->next)
+            g->next = grabber_decode(g);
+        if (!g->next)
+            break;
+        if (g->next->pts == MP_NOPTS_VALUE || g->next->pts > pts)
+            break;
+        talloc_free(g->prev);
+        g->prev = g->next;
+        g->next = NULL;
+    }
+
+    struct mp_image *res = g->prev ? g->prev : g->next;
+    return res ? mp_image_new_ref(res) : NULL;
+}
+
+struct frame_batch {
+    struct screenshot_ctx *ctx;
+    struct image_writer_opts *opts;
+    struct mp_image **imgs;
+    char **filenames;
+    bool *ok;
+};
+
+static void write_batch_frame(void *p, int n)
+{
+    struct frame_batch *b = p;
+    b->ok[n] = write_image(b->imgs[n], b->opts, b->filenames[n],
+                           b->ctx->mpctx->global, b->ctx->log, true);
+}
+
+// Expand %n (or %0Nn, N digits) with the 1-based frame index.
+static char *batch_fname(void *ta_ctx, const char *template, int index,
+                         const char *ext)
+{
+    char *res = talloc_strdup(ta_ctx, "");
+    for (const char *t = template; *t; t++) {
+        if (*t != '%') {
+            res = talloc_strndup_append(res, t, 1);
+            continue;
+        }
+        t++;
+        int digits = 4;
+        if (*t == '0' && t[1] >= '0' && t[1] <= '9') {
+            digits = t[1] - '0';
+            t += 2;
+        }
+        if (*t == 'n') {
+            res = talloc_asprintf_append(res, "%0*d", digits, index);
+        } else if (*t == '%') {
+            res = talloc_strdup_append(res, "%");
+        } else {
+            return NULL;
+        }
+    }
+    return talloc_asprintf_append(res, ".%s", ext);
+}
+
+static int compare_time(const void *a, const void *b)
+{
+    const double *t1 = a, *t2 = b;
+    return t1[0] < t2[0] ? -1 : t1[0] > t2[0];
+}
+
+void cmd_screenshot_frames(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    struct mpv_node *res = &cmd->result;
+    char **times = cmd->args[0].v.str_list;
+    char *template = cmd->args[1].v.s;
+
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    if (!track || track->image || !track->demuxer || !track->stream ||
+        !track->demuxer->filename || mpctx->stop_play)
+    {
+        mp_cmd_msg(cmd, MSGL_ERR, "No video to extract frames from.");
+        cmd->success = false;
+        return;
+    }
+
+    void *ta = talloc_new(NULL);
+
+    // (time, index) pairs, sorted by time; index is the position in the list.
+    double *targets = NULL;
+    int num = 0;
+    const struct m_option time_opt = {.type = &m_option_type_time};
+    for (int n = 0; times && times[n]; n++) {
+        double t;
+        if (m_option_parse(mpctx->log, &time_opt, bstr0("time"),
+                           bstr0(times[n]), &t) < 0 || t == MP_NOPTS_VALUE)
+        {
+            mp_cmd_msg(cmd, MSGL_ERR, "Invalid time: '%s'", times[n]);
+            cmd->success = false;
+            talloc_free(ta);
+            return;
+        }
+        MP_TARRAY_GROW(ta, targets, num * 2 + 1);
+        targets[num * 2 + 0] = t;
+        targets[num * 2 + 1] = num;
+        num++;
+    }
+    qsort(targets, num, sizeof(double[2]), compare_time);
+
+    struct image_writer_opts opts = *mpctx->opts->screenshot_image_opts;
+    opts.avif_encoder = talloc_strdup(ta, opts.avif_encoder);
+    opts.avif_pixfmt = talloc_strdup(ta, opts.avif_pixfmt);
+    opts.avif_opts = mp_dup_str_array(ta, opts.avif_opts);
+    char **filenames = talloc_zero_array(ta, char *, num);
+    for (int n = 0; n < num; n++) {
+        char *name = batch_fname(ta, template, n + 1,
+                                 image_writer_file_ext(&opts));
+        filenames[n] = name ? mp_get_user_path(ta, mpctx->global, name) : NULL;
+        if (!filenames[n]) {
+            mp_cmd_msg(cmd, MSGL_ERR, "Invalid filename template.");
+            cmd->success = false;
+            talloc_free(ta);
+            return;
+        }
+    }
+
+    // Like thumbnail-raw, this uses a separate demuxer, so that playback is
+    // not disturbed.
+    char *url = talloc_strdup(ta, track->demuxer->filename);
+    int stream_index = track->stream->index;
+    bool rebase = mpctx->opts->rebase_start_time;
+    struct demuxer_params params = {
+        .stream_flags = track->demuxer->stream_origin,
+    };
+    struct mp_log *log = mp_log_new(ta, mpctx->log, "frames");
+
+    mp_core_unlock(mpctx);
+
+    struct frame_grabber g = {
+        .d = demux_open_url(url, &params, cmd->abort->cancel, mpctx->global),
+        .avpkt = av_packet_alloc(),
+        .avframe = av_frame_alloc(),
+        .last_key = MP_NOPTS_VALUE,
+    };
+    MP_HANDLE_OOM(g.avpkt);
+    MP_HANDLE_OOM(g.avframe);
+    if (g.d && stream_index < demux_get_num_stream(g.d)) {
+        g.sh = demux_get_stream(g.d, stream_index);
+        if (g.sh->type != STREAM_VIDEO)
+            g.sh = NULL;
+    }
+    if (g.sh) {
+        const AVCodec *codec =
+            avcodec_find_decoder(mp_codec_to_av_codec_id(g.sh->codec->codec));
+        g.avctx = codec ? avcodec_alloc_context3(codec) : NULL;
+        if (g.avctx) {
+            mp_set_avcodec_threads(log, g.avctx, 0);
+            if (mp_set_avctx_codec_headers(g.avctx, g.sh->codec) < 0 ||
+                avcodec_open2(g.avctx, codec, NULL) < 0)
+                avcodec_free_context(&g.avctx);
+        }
+    }
+
+    bool ok = !!g.avctx;
+    if (ok) {
+        g.tb = mp_get_codec_timebase(g.sh->codec);
+        if (rebase)
+            demux_set_ts_offset(g.d, -g.d->start_time);
+        demuxer_select_track(g.d, g.sh, MP_NOPTS_VALUE, true);
+        node_init(res, MPV_FORMAT_NODE_ARRAY, NULL);
+    }
+
+    // Frames are decoded in batches, and each batch is written in parallel.
+    struct mp_task_pool *pool = mp_task_pool_get(ta);
+    int batch_size = MPMAX(1, mp_task_pool_threads(pool));
+    struct frame_batch batch = {
+        .ctx = ctx,
+        .opts = &opts,
+        .imgs = talloc_zero_array(ta, struct mp_image *, batch_size),
+        .filenames = talloc_zero_array(ta, char *, batch_size),
+        .ok = talloc_zero_array(ta, bool, batch_size),
+    };
+    double *batch_times = talloc_zero_array(ta, double, batch_size * 2);
+    int num_written = 0;
+
+    for (int n = 0; ok && n < num; n += batch_size) {
+        int count = 0;
+        for (int i = n; i < MPMIN(n + batch_size, num); i++) {
+            if (mp_cancel_test(cmd->abort->cancel)) {
+                ok = false;
+                break;
+            }
+            struct mp_image *img = grab_frame(&g, targets[i * 2]);
+            if (!img) {
+                MP_WARN(ctx, "Could not decode a frame at %f.\n",
+                        targets[i * 2]);
+                continue;
+            }
+            batch.imgs[count] = img;
+            batch.filenames[count] = filenames[(int)targets[i * 2 + 1]];
+            batch_times[count * 2 + 0] = targets[i * 2];
+            batch_times[count * 2 + 1] = img->pts;
+            count++;
+        }
+
+        mp_task_pool_run_all(pool, MP_TASK_BACKGROUND, count,
+                             write_batch_frame, &batch);
+
+        for (int i = 0; i < count; i++) {
+            if (batch.ok[i]) {
+                struct mpv_node *e = node_array_add(res, MPV_FORMAT_NODE_MAP);
+                node_map_add_double(e, "time", batch_times[i * 2 + 0]);
+                node_map_add_double(e, "pts", batch_times[i * 2 + 1]);
+                node_map_add_string(e, "filename", batch.filenames[i]);
+                num_written++;
+            } else {
+                MP_ERR(ctx, "Error writing '%s'!\n", batch.filenames[i]);
+            }
+            TA_FREEP(&batch.imgs[i]);
+        }
+    }
+
+    talloc_free(g.prev);
+    talloc_free(g.next);
+    av_frame_free(&g.avframe);
+    av_packet_free(&g.avpkt);
+    avcodec_free_context(&g.avctx);
+    demux_free(g.d);
+
+    mp_core_lock(mpctx);
+
+    if (ok) {
+        mp_cmd_msg(cmd, MSGL_INFO, "Extracted %d of %d frames.", num_written,
+                   num);
+    } else {
+        mp_cmd_msg(cmd, MSGL_ERR, "Extracting frames failed.");
+        cmd->success = false;
+    }
+    talloc_free(ta);
+}
+
 static void screenshot_fin(struct mp_cmd_ctx *cmd)
 {
     void **a = cmd->on_completion_priv;
@@ -28,6 +28,9 @@ struct mpv_global;
 // One time initialization at program start.
 void screenshot_init(struct MPContext *mpctx);
 
+// Wait until all screenshots queued with --screenshot-queue are written.
+void screenshot_uninit(struct MPContext *mpctx);
+
 // Called by the playback core on each iteration.
 void handle_each_frame_screenshot(struct MPContext *mpctx);
 
@@ -42,5 +45,7 @@ struct mp_image *convert_image(struct mp_image *image, int destfmt,
 void cmd_screenshot(void *p);
 void cmd_screenshot_to_file(void *p);
 void cmd_screenshot_raw(void *p);
+void cmd_thumbnail_raw(void *p);
+void cmd_screenshot_frames(void *p);
 
 #endif /* MPLAYER_SCREENSHOT_H */
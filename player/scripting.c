@@ -25,6 +25,7 @@
 #include "osdep/io.h"
 #include "osdep/subprocess.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -102,6 +103,223 @@ static MP_THREAD_VOID script_thread(void *p)
     MP_THREAD_RETURN();
 }
 
+// Shared threads for scripts with --script-threads. Each hosted script is
+// dispatched by at most one thread at a time, and is scheduled when its
+// client gets a wakeup or its next timer is due.
+struct script_host {
+    mp_mutex lock;
+    mp_cond wakeup;
+    mp_thread *threads;
+    int num_threads;
+    bool terminate;
+    // Round-robin order: a script is moved to the end when it's dispatched.
+    struct hosted_script **scripts;
+    int num_scripts;
+};
+
+struct hosted_script {
+    struct script_host *host;
+    struct mp_script_args *args;
+    void *state;        // from mp_scripting.start(), NULL if not started yet
+    int64_t deadline;   // mp_time_ns() when the next timer is due
+    bool pending;       // new events (or not started yet)
+    bool running;       // a thread is in start() or dispatch()
+};
+
+static void wakeup_hosted_script(void *p)
+{
+    struct hosted_script *s = p;
+    struct script_host *host = s->host;
+    mp_mutex_lock(&host->lock);
+    s->pending = true;
+    mp_cond_signal(&host->wakeup);
+    mp_mutex_unlock(&host->lock);
+}
+
+static struct hosted_script *get_runnable_script(struct script_host *host,
+                                                 int64_t *wait_until)
+{
+    int64_t now = mp_time_ns();
+    *wait_until = INT64_MAX;
+    for (int n = 0; n < host->num_scripts; n++) {
+        struct hosted_script *s = host->scripts[n];
+        if (s->running)
+            continue;
+        if (s->pending || s->deadline <= now) {
+            MP_TARRAY_REMOVE_AT(host->scripts, host->num_scripts, n);
+            MP_TARRAY_APPEND(host, host->scripts, host->num_scripts, s);
+            return s;
+        }
+        *wait_until = MPMIN(*wait_until, s->deadline);
+    }
+    return NULL;
+}
+
+// Run start() or dispatch() once. Returns false if the script is done.
+static bool run_hosted_script(struct hosted_script *s)
+{
+    struct mp_script_args *arg = s->args;
+    const struct mp_scripting *backend = arg->backend;
+    double timeout = -1;
+
+    if (!s->state) {
+        if (backend->start(arg, &s->state) < 0) {
+            MP_ERR(arg, "Could not load %s script %s\n", backend->name,
+                   arg->filename);
+        }
+        if (!s->state)
+            return false;
+        s->pending = true; // process events which arrived meanwhile
+    } else if (!backend->dispatch(s->state, &timeout)) {
+        return false;
+    }
+
+    s->deadline = INT64_MAX;
+    if (timeout >= 0 && timeout < 1e9)
+        s->deadline = mp_time_ns() + MP_TIME_S_TO_NS(timeout);
+    return true;
+}
+
+static MP_THREAD_VOID script_host_thread(void *p)
+{
+    struct script_host *host = p;
+    mp_thread_set_name("script");
+
+    mp_mutex_lock(&host->lock);
+    while (!host->terminate) {
+        int64_t wait_until;
+        struct hosted_script *s = get_runnable_script(host, &wait_until);
+        if (!s) {
+            if (wait_until == INT64_MAX) {
+                mp_cond_wait(&host->wakeup, &host->lock);
+            } else {
+                mp_cond_timedwait_until(&host->wakeup, &host->lock, wait_until);
+            }
+            continue;
+        }
+
+        s->pending = false;
+        s->running = true;
+        mp_mutex_unlock(&host->lock);
+        bool alive = run_hosted_script(s);
+        mp_mutex_lock(&host->lock);
+        s->running = false;
+
+        if (alive) {
+            // Another thread may be able to take over a pending wakeup.
+            if (s->pending)
+                mp_cond_signal(&host->wakeup);
+            continue;
+        }
+
+        for (int n = 0; n < host->num_scripts; n++) {
+            if (host->scripts[n] == s) {
+                MP_TARRAY_REMOVE_AT(host->scripts, host->num_scripts, n);
+                break;
+            }
+        }
+        mp_mutex_unlock(&host->lock);
+
+        if (s->state)
+            s->args->backend->unload(s->state);
+        mpv_handle *client = s->args->client;
+        talloc_free(s);
+        // No more wakeup callbacks after this.
+        mpv_destroy(client);
+
+        mp_mutex_lock(&host->lock);
+    }
+    mp_mutex_unlock(&host->lock);
+
+    MP_THREAD_RETURN();
+}
+
+static struct script_host *get_script_host(struct MPContext *mpctx)
+{
+    if (mpctx->script_host)
+        return mpctx->script_host;
+
+    struct script_host *host = talloc_zero(NULL, struct script_host);
+    mp_mutex_init(&host->lock);
+    mp_cond_init(&host->wakeup);
+    int num = mpctx->opts->script_threads;
+    host->threads = talloc_array(host, mp_thread, num);
+    for (int n = 0; n < num; n++) {
+        if (mp_thread_create(&host->threads[n], script_host_thread, host))
+            break;
+        host->num_threads++;
+    }
+    if (!host->num_threads) {
+        MP_ERR(mpctx, "Could not create script threads.\n");
+        mp_cond_destroy(&host->wakeup);
+        mp_mutex_destroy(&host->lock);
+        talloc_free(host);
+        return NULL;
+    }
+    MP_VERBOSE(mpctx, "Running scripts on %d shared threads.\n",
+               host->num_threads);
+    mpctx->script_host = host;
+    return host;
+}
+
+// Takes over arg. Returns false if the script could not be added, in which
+// case arg is left untouched.
+static bool add_hosted_script(struct MPContext *mpctx,
+                              struct mp_script_args *arg)
+{
+    struct script_host *host = get_script_host(mpctx);
+    if (!host)
+        return false;
+
+    struct hosted_script *s = talloc_ptrtype(NULL, s);
+    *s = (struct hosted_script){
+        .host = host,
+        .args = talloc_steal(s, arg),
+        .deadline = INT64_MAX,
+        .pending = true,
+    };
+    mpv_set_wakeup_callback(arg->client, wakeup_hosted_script, s);
+
+    mp_mutex_lock(&host->lock);
+    MP_TARRAY_APPEND(host, host->scripts, host->num_scripts, s);
+    mp_cond_signal(&host->wakeup);
+    mp_mutex_unlock(&host->lock);
+    return true;
+}
+
+// Schedule all hosted scripts. Used on shutdown, when the client wakeup
+// callbacks are not called anymore.
+void mp_script_host_wakeup(struct MPContext *mpctx)
+{
+    struct script_host *host = mpctx->script_host;
+    if (!host)
+        return;
+    mp_mutex_lock(&host->lock);
+    for (int n = 0; n < host->num_scripts; n++)
+        host->scripts[n]->pending = true;
+    mp_cond_broadcast(&host->wakeup);
+    mp_mutex_unlock(&host->lock);
+}
+
+// Must be called after all clients were destroyed.
+void mp_script_host_destroy(struct MPContext *mpctx)
+{
+    struct script_host *host = mpctx->script_host;
+    if (!host)
+        return;
+    mp_mutex_lock(&host->lock);
+    mp_assert(!host->num_scripts);
+    host->terminate = true;
+    mp_cond_broadcast(&host->wakeup);
+    mp_mutex_unlock(&host->lock);
+    for (int n = 0; n < host->num_threads; n++)
+        mp_thread_join(host->threads[n]);
+    mp_cond_destroy(&host->wakeup);
+    mp_mutex_destroy(&host->lock);
+    talloc_free(host);
+    mpctx->script_host = NULL;
+}
+
 static int64_t mp_load_script(struct MPContext *mpctx, const char *fname)
 {
     char *ext = mp_splitext(fname, NULL);
@@ -187,6 +405,10 @@ static int64_t mp_load_script(struct MPContext *mpctx, const char *fname)
 
     if (backend->no_thread) {
         run_script(arg);
+    } else if (backend->start && mpctx->opts->script_threads > 0 &&
+               add_hosted_script(mpctx, arg))
+    {
+        // runs on the shared script threads
     } else {
         mp_thread thread;
         if (mp_thread_create(&thread, script_thread, arg)) {
@@ -238,15 +460,38 @@ static char **list_script_files(void *talloc_ctx, char *path)
     return files;
 }
 
-static void load_builtin_script(struct MPContext *mpctx, int slot, bool enable,
-                                const char *fname)
+static const struct {
+    const char *fname;
+    // Only reached through script-binding/script-message-to, so it can be
+    // loaded on first use with --builtin-scripts-on-demand.
+    bool on_demand;
+} builtin_scripts[] = {
+    {"@osc.lua"},
+    {"@ytdl_hook.lua"},
+    {"@stats.lua", true},
+    {"@console.lua", true},
+    {"@auto_profiles.lua"},
+    {"@select.lua", true},
+    {"@positioning.lua", true},
+    {"@commands.lua", true},
+    {"@context_menu.lua", true},
+};
+
+static void load_builtin_script(struct MPContext *mpctx, int slot, bool enable)
 {
-    mp_assert(slot < MP_ARRAY_SIZE(mpctx->builtin_script_ids));
+    static_assert(MP_ARRAY_SIZE(builtin_scripts) ==
+                  MP_ARRAY_SIZE(mpctx->builtin_script_ids), "");
+    const char *fname = builtin_scripts[slot].fname;
     int64_t *pid = &mpctx->builtin_script_ids[slot];
     if (*pid > 0 && !mp_client_id_exists(mpctx, *pid)) {
         MP_DBG(mpctx, "Client for script %s is no longer alive. Marking as unloaded.\n", fname);
         *pid = 0; // died
     }
+    bool defer = enable && *pid <= 0 && builtin_scripts[slot].on_demand &&
+                 mpctx->opts->builtin_scripts_on_demand;
+    mpctx->builtin_script_deferred[slot] = defer;
+    if (defer)
+        return;
     if ((*pid > 0) != enable) {
         if (enable) {
             *pid = mp_load_script(mpctx, fname);
@@ -261,16 +506,39 @@ static void load_builtin_script(struct MPContext *mpctx, int slot, bool enable,
 
 void mp_load_builtin_scripts(struct MPContext *mpctx)
 {
-    load_builtin_script(mpctx, 0, mpctx->opts->lua_load_osc, "@osc.lua");
-    load_builtin_script(mpctx, 1, mpctx->opts->lua_load_ytdl, "@ytdl_hook.lua");
-    load_builtin_script(mpctx, 2, mpctx->opts->lua_load_stats, "@stats.lua");
-    load_builtin_script(mpctx, 3, mpctx->opts->lua_load_console, "@console.lua");
-    load_builtin_script(mpctx, 4, mpctx->opts->lua_load_auto_profiles,
-                        "@auto_profiles.lua");
-    load_builtin_script(mpctx, 5, mpctx->opts->lua_load_select, "@select.lua");
-    load_builtin_script(mpctx, 6, mpctx->opts->lua_load_positioning, "@positioning.lua");
-    load_builtin_script(mpctx, 7, mpctx->opts->lua_load_commands, "@commands.lua");
-    load_builtin_script(mpctx, 8, mpctx->opts->lua_load_context_menu, "@context_menu.lua");
+    load_builtin_script(mpctx, 0, mpctx->opts->lua_load_osc);
+    load_builtin_script(mpctx, 1, mpctx->opts->lua_load_ytdl);
+    load_builtin_script(mpctx, 2, mpctx->opts->lua_load_stats);
+    load_builtin_script(mpctx, 3, mpctx->opts->lua_load_console);
+    load_builtin_script(mpctx, 4, mpctx->opts->lua_load_auto_profiles);
+    load_builtin_script(mpctx, 5, mpctx->opts->lua_load_select);
+    load_builtin_script(mpctx, 6, mpctx->opts->lua_load_positioning);
+    load_builtin_script(mpctx, 7, mpctx->opts->lua_load_commands);
+    load_builtin_script(mpctx, 8, mpctx->opts->lua_load_context_menu);
+}
+
+bool mp_load_builtin_script_on_demand(struct MPContext *mpctx,
+                                      const char *client_name)
+{
+    if (!client_name)
+        return false;
+    for (int n = 0; n < MP_ARRAY_SIZE(builtin_scripts); n++) {
+        if (!mpctx->builtin_script_deferred[n])
+            continue;
+        void *tmp = talloc_new(NULL);
+        char *name = script_name_from_filename(tmp, builtin_scripts[n].fname);
+        bool match = strcmp(name, client_name) == 0;
+        talloc_free(tmp);
+        if (match) {
+            MP_VERBOSE(mpctx, "Loading builtin script %s on first use.\n",
+                       builtin_scripts[n].fname);
+            mpctx->builtin_script_deferred[n] = false;
+            mpctx->builtin_script_ids[n] =
+                mp_load_script(mpctx, builtin_scripts[n].fname);
+            return mpctx->builtin_script_ids[n] > 0;
+        }
+    }
+    return false;
 }
 
 bool mp_load_scripts(struct MPContext *mpctx)
@@ -119,7 +119,7 @@ static bool update_subtitle(struct MPContext *mpctx, double video_pts,
         // Assume fully_read implies no interleaved audio/video streams.
         // (Reading packets will change the demuxer position.)
         demux_seek(track->demuxer, 0, 0);
-        sub_preload(dec_sub);
+        sub_preload(dec_sub, mp_wakeup_core_cb, mpctx);
     }
 
     bool packets_read = false;
@@ -251,3 +251,22 @@ void reinit_sub_all(struct MPContext *mpctx)
     for (int n = 0; n < num_ptracks[STREAM_SUB]; n++)
         reinit_sub(mpctx, mpctx->current_track[n][STREAM_SUB]);
 }
+
+// Called if a demuxer added attachments (e.g. fonts) after initialization.
+void update_sub_attachments(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        if (!track->d_sub)
+            continue;
+        sub_set_attachments(track->d_sub, get_all_attachments(mpctx));
+        uint64_t flags = UPDATE_SUB_HARD;
+        if (sub_control(track->d_sub, SD_CTRL_UPDATE_OPTS, &flags) == CONTROL_OK) {
+            sub_redecode_cached_packets(track->d_sub);
+            sub_reset(track->d_sub);
+            if (track->selected)
+                reselect_demux_stream(mpctx, track, true);
+        }
+    }
+    redraw_subs(mpctx);
+}
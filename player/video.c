@@ -43,6 +43,7 @@
 
 #include "core.h"
 #include "command.h"
+#include "preload.h"
 #include "screenshot.h"
 
 enum {
@@ -184,6 +185,21 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     if (track->vo_c)
         parent = track->vo_c->filter->f;
 
+    struct mp_preload_decoder *pd = mpctx->preload_dec;
+    if (pd && pd->stream == track->stream) {
+        if (mp_decoder_wrapper_reparent(pd->dec, parent, pd->first_frame)) {
+            MP_VERBOSE(mpctx, "Using prewarmed video decoder.\n");
+            track->dec = pd->dec;
+            pd->dec = NULL;
+            pd->first_frame = MP_NO_FRAME;
+        }
+        TA_FREEP(&mpctx->preload_dec);
+        if (track->dec)
+            return 1;
+        // The discarded decoder took packets from the demuxer.
+        issue_refresh_seek(mpctx, MPSEEK_EXACT);
+    }
+
     track->dec = mp_decoder_wrapper_create(parent, track->stream);
     if (!track->dec)
         goto err_out;
@@ -535,6 +551,7 @@ static int video_output_image(struct MPContext *mpctx, bool *logical_eof)
                 }
                 mp_image_unrefp(&mpctx->saved_frame);
                 add_new_frame(mpctx, img);
+                mark_load_timing(mpctx, LOAD_PHASE_FIRST_DECODE);
                 img = NULL;
             }
             talloc_free(img);
@@ -1288,6 +1305,7 @@ void write_video(struct MPContext *mpctx)
             vo_wait_frame(vo);
             MP_VERBOSE(mpctx, "first video frame after restart shown\n");
         }
+        mark_load_timing(mpctx, LOAD_PHASE_FIRST_PRESENT);
     }
 
     mp_notify(mpctx, MPV_EVENT_TICK, NULL);
@@ -0,0 +1,540 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "mpv_talloc.h"
+
+#include "osdep/io.h"
+#include "osdep/threads.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "stream/stream.h"
+
+#include "watch_later.h"
+
+// Name of the database file in the watch later directory.
+#define DATABASE_FILE "resume.db"
+// First line of the database file. Each record follows as a line with
+// "<name> <mtime> <length>", followed by length bytes of data and a newline.
+#define DATABASE_HEADER "# mpv watch later database v1\n"
+
+struct entry {
+    char *dir;
+    bool database;
+    char *name;
+    char *data;             // NULL: delete the entry
+    int64_t mtime;          // -1: unset
+};
+
+struct db_record {
+    char *name;
+    char *data;
+    int64_t mtime;
+};
+
+// Records of the database file in dir, sorted by name.
+struct db {
+    char *dir;
+    struct db_record *records;
+    int num_records;
+};
+
+struct mp_watch_later {
+    struct mpv_global *global;
+    struct mp_log *log;
+    mp_thread thread;
+    bool have_thread;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+
+    // --- Protected by lock.
+    // Entries not written yet, at most one per directory and name.
+    struct entry **queue;
+    int num_queue;
+    // Entries currently written by the thread; not modified until done.
+    struct entry **batch;
+    int num_batch;
+    bool terminate;
+    // Only loaded when needed, and replaced if another directory is used.
+    struct db *db;
+};
+
+static int find_entry(struct entry **entries, int num, const char *dir,
+                      bool database, const char *name)
+{
+    for (int n = 0; n < num; n++) {
+        struct entry *e = entries[n];
+        if (e->database == database && strcmp(e->name, name) == 0 &&
+            strcmp(e->dir, dir) == 0)
+            return n;
+    }
+    return -1;
+}
+
+// Return the newest queued entry. Called locked.
+static struct entry *find_queued(struct mp_watch_later *wl, const char *dir,
+                                 bool database, const char *name)
+{
+    int n = find_entry(wl->queue, wl->num_queue, dir, database, name);
+    if (n >= 0)
+        return wl->queue[n];
+    n = find_entry(wl->batch, wl->num_batch, dir, database, name);
+    return n >= 0 ? wl->batch[n] : NULL;
+}
+
+// Return the index of the record with the given name, or where it would have
+// to be inserted.
+static int find_record(struct db *db, const char *name, bool *found)
+{
+    int lo = 0, hi = db->num_records;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(db->records[mid].name, name);
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = false;
+    return lo;
+}
+
+static void set_record(struct db *db, const char *name, const char *data,
+                       int64_t mtime)
+{
+    bool found;
+    int n = find_record(db, name, &found);
+    if (!data) {
+        if (found) {
+            talloc_free(db->records[n].name);
+            talloc_free(db->records[n].data);
+            MP_TARRAY_REMOVE_AT(db->records, db->num_records, n);
+        }
+        return;
+    }
+    if (!found) {
+        struct db_record rec = {.name = talloc_strdup(db, name)};
+        MP_TARRAY_INSERT_AT(db, db->records, db->num_records, n, rec);
+    }
+    talloc_free(db->records[n].data);
+    db->records[n].data = talloc_strdup(db, data);
+    db->records[n].mtime = mtime;
+}
+
+static void parse_db(struct mp_watch_later *wl, struct db *db,
+                     const char *path, bstr data)
+{
+    if (!bstr_eatstart0(&data, DATABASE_HEADER)) {
+        MP_WARN(wl, "Ignoring %s: unknown format.\n", path);
+        return;
+    }
+    while (data.len) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        char header[128];
+        snprintf(header, sizeof(header), "%.*s", BSTR_P(line));
+        char name[64];
+        long long mtime, len;
+        if (sscanf(header, "%63s %lld %lld", name, &mtime, &len) != 3 ||
+            len < 0 || len > data.len)
+        {
+            MP_WARN(wl, "Ignoring the rest of %s: broken record.\n", path);
+            return;
+        }
+        char *rec_data = bstrto0(NULL, bstr_splice(data, 0, len));
+        set_record(db, name, rec_data, mtime);
+        talloc_free(rec_data);
+        data = bstr_cut(data, len);
+        bstr_eatstart0(&data, "\n");
+    }
+}
+
+// Read the database file of dir. Called unlocked.
+static struct db *read_db(struct mp_watch_later *wl, const char *dir)
+{
+    struct db *db = talloc_zero(NULL, struct db);
+    db->dir = talloc_strdup(db, dir);
+
+    char *path = mp_path_join(NULL, dir, DATABASE_FILE);
+    if (mp_path_exists(path)) {
+        bstr data = stream_read_file2(path, NULL,
+                                      STREAM_ORIGIN_DIRECT | STREAM_READ,
+                                      wl->global, 1000000000);
+        parse_db(wl, db, path, data);
+        talloc_free(data.start);
+        MP_VERBOSE(wl, "Loaded %d entries from %s.\n", db->num_records, path);
+    }
+    talloc_free(path);
+    return db;
+}
+
+// Make the database of dir the current one. Called locked; unlocks while
+// reading the file, so queued entries must be looked up again after this.
+static void load_db(struct mp_watch_later *wl, const char *dir)
+{
+    if (wl->db && strcmp(wl->db->dir, dir) == 0)
+        return;
+
+    mp_mutex_unlock(&wl->lock);
+    struct db *db = read_db(wl, dir);
+    mp_mutex_lock(&wl->lock);
+
+    // Someone else could have loaded it meanwhile.
+    if (wl->db && strcmp(wl->db->dir, dir) == 0) {
+        talloc_free(db);
+        return;
+    }
+    talloc_free(wl->db);
+    wl->db = db;
+}
+
+static char *serialize_db(struct db *db, void *ta_parent)
+{
+    char *res = talloc_strdup(ta_parent, DATABASE_HEADER);
+    for (int n = 0; n < db->num_records; n++) {
+        struct db_record *rec = &db->records[n];
+        res = talloc_asprintf_append_buffer(res, "%s %lld %zu\n%s\n", rec->name,
+                                            (long long)rec->mtime,
+                                            strlen(rec->data), rec->data);
+    }
+    return res;
+}
+
+static void sync_file(FILE *f)
+{
+    fflush(f);
+#ifdef _WIN32
+    _commit(_fileno(f));
+#else
+    fsync(fileno(f));
+#endif
+}
+
+static bool set_mtime(const char *path, int64_t mtime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+
+    struct utimbuf ut = {
+        .actime = st.st_atime,  // we want to pass this through intact
+        .modtime = mtime,
+    };
+    return utime(path, &ut) == 0;
+}
+
+static void write_db_file(struct mp_watch_later *wl, const char *dir,
+                          const char *data)
+{
+    void *tmp = talloc_new(NULL);
+    char *path = mp_path_join(tmp, dir, DATABASE_FILE);
+    char *tmp_path = talloc_asprintf(tmp, "%s.tmp", path);
+
+    mp_mkdirp(dir);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        MP_WARN(wl, "Can't open %s for writing\n", tmp_path);
+        goto done;
+    }
+    bool ok = fputs(data, f) >= 0;
+    sync_file(f);
+    ok &= fclose(f) == 0;
+    // Replace the old file only with a completely written one.
+    if (!ok || rename(tmp_path, path) != 0) {
+        MP_WARN(wl, "Can't write %s\n", path);
+        unlink(tmp_path);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+struct written_file {
+    FILE *f;
+    char *path;
+    struct entry *e;
+};
+
+// Write wl->batch. Called unlocked; the batch is not changed meanwhile.
+static void write_batch(struct mp_watch_later *wl)
+{
+    void *tmp = talloc_new(NULL);
+    struct written_file *files = NULL;
+    int num_files = 0;
+
+    for (int n = 0; n < wl->num_batch; n++) {
+        struct entry *e = wl->batch[n];
+        if (e->database)
+            continue;
+        char *path = mp_path_join(tmp, e->dir, e->name);
+        if (!e->data) {
+            unlink(path);
+            continue;
+        }
+        mp_mkdirp(e->dir);
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            MP_WARN(wl, "Can't open %s for writing\n", path);
+            continue;
+        }
+        fputs(e->data, f);
+        MP_TARRAY_APPEND(tmp, files, num_files,
+                         (struct written_file){f, path, e});
+    }
+
+    // Sync the whole batch after writing it, instead of waiting for each file
+    // before writing the next one.
+    for (int n = 0; n < num_files; n++) {
+        struct written_file *wf = &files[n];
+        sync_file(wf->f);
+        if (fclose(wf->f) != 0)
+            MP_WARN(wl, "Can't write %s\n", wf->path);
+        if (wf->e->mtime >= 0 && !set_mtime(wf->path, wf->e->mtime))
+            MP_WARN(wl, "Can't set mtime of %s\n", wf->path);
+    }
+
+    // Each database is written once for all of its entries in the batch.
+    for (int n = 0; n < wl->num_batch; n++) {
+        struct entry *e = wl->batch[n];
+        if (!e->database)
+            continue;
+        bool first = true;
+        for (int i = 0; i < n; i++)
+            first &= !(wl->batch[i]->database &&
+                       strcmp(wl->batch[i]->dir, e->dir) == 0);
+        if (!first)
+            continue;
+
+        mp_mutex_lock(&wl->lock);
+        load_db(wl, e->dir);
+        for (int i = n; i < wl->num_batch; i++) {
+            struct entry *o = wl->batch[i];
+            if (o->database && strcmp(o->dir, e->dir) == 0)
+                set_record(wl->db, o->name, o->data, o->mtime);
+        }
+        char *data = serialize_db(wl->db, tmp);
+        mp_mutex_unlock(&wl->lock);
+
+        write_db_file(wl, e->dir, data);
+    }
+
+    talloc_free(tmp);
+}
+
+// Write all queued entries. Called locked; unlocks while writing.
+static void write_queue(struct mp_watch_later *wl)
+{
+    mp_assert(!wl->num_batch);
+    wl->batch = wl->queue;
+    wl->num_batch = wl->num_queue;
+    wl->queue = NULL;
+    wl->num_queue = 0;
+
+    mp_mutex_unlock(&wl->lock);
+    write_batch(wl);
+    mp_mutex_lock(&wl->lock);
+
+    for (int n = 0; n < wl->num_batch; n++)
+        talloc_free(wl->batch[n]);
+    TA_FREEP(&wl->batch);
+    wl->num_batch = 0;
+    mp_cond_broadcast(&wl->wakeup);
+}
+
+static MP_THREAD_VOID writer_thread(void *p)
+{
+    struct mp_watch_later *wl = p;
+    mp_thread_set_name("watch-later");
+
+    mp_mutex_lock(&wl->lock);
+    while (wl->num_queue || !wl->terminate) {
+        if (wl->num_queue) {
+            write_queue(wl);
+        } else {
+            mp_cond_wait(&wl->wakeup, &wl->lock);
+        }
+    }
+    mp_mutex_unlock(&wl->lock);
+
+    MP_THREAD_RETURN();
+}
+
+struct mp_watch_later *mp_watch_later_create(struct mpv_global *global,
+                                             struct mp_log *log)
+{
+    struct mp_watch_later *wl = talloc_zero(NULL, struct mp_watch_later);
+    wl->global = global;
+    wl->log = mp_log_new(wl, log, "watch_later");
+    mp_mutex_init(&wl->lock);
+    mp_cond_init(&wl->wakeup);
+
+    wl->have_thread = !mp_thread_create(&wl->thread, writer_thread, wl);
+    if (!wl->have_thread)
+        MP_WARN(wl, "Could not create writer thread, writing synchronously.\n");
+    return wl;
+}
+
+void mp_watch_later_destroy(struct mp_watch_later *wl)
+{
+    if (!wl)
+        return;
+
+    if (wl->have_thread) {
+        mp_mutex_lock(&wl->lock);
+        wl->terminate = true;
+        mp_cond_broadcast(&wl->wakeup);
+        mp_mutex_unlock(&wl->lock);
+        mp_thread_join(wl->thread);
+    }
+
+    talloc_free(wl->db);
+    mp_mutex_destroy(&wl->lock);
+    mp_cond_destroy(&wl->wakeup);
+    talloc_free(wl);
+}
+
+void mp_watch_later_put(struct mp_watch_later *wl, const char *dir,
+                        bool database, const char *name, const char *data,
+                        int64_t mtime)
+{
+    struct entry *e = talloc_ptrtype(NULL, e);
+    *e = (struct entry){
+        .dir = talloc_strdup(e, dir),
+        .database = database,
+        .name = talloc_strdup(e, name),
+        .data = talloc_strdup(e, data),
+        .mtime = mtime,
+    };
+
+    mp_mutex_lock(&wl->lock);
+    // Only the newest state of an entry is written.
+    int n = find_entry(wl->queue, wl->num_queue, dir, database, name);
+    if (n >= 0) {
+        talloc_free(wl->queue[n]);
+        MP_TARRAY_REMOVE_AT(wl->queue, wl->num_queue, n);
+    }
+    MP_TARRAY_APPEND(wl, wl->queue, wl->num_queue, e);
+    if (wl->have_thread) {
+        mp_cond_broadcast(&wl->wakeup);
+    } else {
+        write_queue(wl);
+    }
+    mp_mutex_unlock(&wl->lock);
+}
+
+char *mp_watch_later_get(struct mp_watch_later *wl, const char *dir,
+                         bool database, const char *name, void *ta_parent,
+                         int64_t *out_mtime)
+{
+    char *res = NULL;
+    *out_mtime = -1;
+
+    mp_mutex_lock(&wl->lock);
+    struct entry *e = find_queued(wl, dir, database, name);
+    if (!e && database) {
+        load_db(wl, dir);
+        e = find_queued(wl, dir, database, name);
+    }
+    if (e || database) {
+        if (e) {
+            res = talloc_strdup(ta_parent, e->data);
+            *out_mtime = e->mtime;
+        } else {
+            bool found;
+            int n = find_record(wl->db, name, &found);
+            if (found) {
+                res = talloc_strdup(ta_parent, wl->db->records[n].data);
+                *out_mtime = wl->db->records[n].mtime;
+            }
+        }
+        mp_mutex_unlock(&wl->lock);
+        return res;
+    }
+    mp_mutex_unlock(&wl->lock);
+
+    char *path = mp_path_join(NULL, dir, name);
+    struct stat st;
+    if (mp_path_exists(path) && stat(path, &st) == 0) {
+        bstr data = stream_read_file2(path, NULL,
+                                      STREAM_ORIGIN_DIRECT | STREAM_READ,
+                                      wl->global, 1000000000);
+        if (data.start) {
+            res = bstrto0(ta_parent, data);
+            *out_mtime = st.st_mtime;
+        }
+        talloc_free(data.start);
+    }
+    talloc_free(path);
+    return res;
+}
+
+bool mp_watch_later_exists(struct mp_watch_later *wl, const char *dir,
+                           bool database, const char *name)
+{
+    bool res = false;
+
+    mp_mutex_lock(&wl->lock);
+    struct entry *e = find_queued(wl, dir, database, name);
+    if (!e && database) {
+        load_db(wl, dir);
+        e = find_queued(wl, dir, database, name);
+    }
+    if (e || database) {
+        if (e) {
+            res = !!e->data;
+        } else {
+            find_record(wl->db, name, &res);
+        }
+        mp_mutex_unlock(&wl->lock);
+        return res;
+    }
+    mp_mutex_unlock(&wl->lock);
+
+    char *path = mp_path_join(NULL, dir, name);
+    res = mp_path_exists(path);
+    talloc_free(path);
+    return res;
+}
+
+void mp_watch_later_flush(struct mp_watch_later *wl)
+{
+    mp_mutex_lock(&wl->lock);
+    while (wl->num_queue || wl->num_batch)
+        mp_cond_wait(&wl->wakeup, &wl->lock);
+    mp_mutex_unlock(&wl->lock);
+}
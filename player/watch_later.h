@@ -0,0 +1,58 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_PLAYER_WATCH_LATER_H
+#define MP_PLAYER_WATCH_LATER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mp_log;
+struct mpv_global;
+
+// Storage of resume state entries, each identified by the watch later
+// directory and a name within it. The entries are either separate files in
+// the directory, or records of a single database file in it (database=true).
+// All writes are done by a background thread; lookups see queued writes.
+struct mp_watch_later;
+
+struct mp_watch_later *mp_watch_later_create(struct mpv_global *global,
+                                             struct mp_log *log);
+
+// Write all queued entries, and free the store.
+void mp_watch_later_destroy(struct mp_watch_later *wl);
+
+// Queue writing data as entry, or deleting the entry if data is NULL. If
+// mtime is >= 0, it's stored as modification time of the entry.
+void mp_watch_later_put(struct mp_watch_later *wl, const char *dir,
+                        bool database, const char *name, const char *data,
+                        int64_t mtime);
+
+// Return the contents of the entry (allocated with ta_parent), or NULL if it
+// doesn't exist. *out_mtime is set to the modification time of the entry, or
+// -1 if unknown.
+char *mp_watch_later_get(struct mp_watch_later *wl, const char *dir,
+                         bool database, const char *name, void *ta_parent,
+                         int64_t *out_mtime);
+
+bool mp_watch_later_exists(struct mp_watch_later *wl, const char *dir,
+                           bool database, const char *name);
+
+// Wait until all queued entries were written.
+void mp_watch_later_flush(struct mp_watch_later *wl);
+
+#endif
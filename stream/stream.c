@@ -48,11 +48,14 @@ extern const stream_info_t stream_info_dvb;
 extern const stream_info_t stream_info_null;
 extern const stream_info_t stream_info_memory;
 extern const stream_info_t stream_info_mf;
+extern const stream_info_t stream_info_http_parallel;
 extern const stream_info_t stream_info_ffmpeg;
 extern const stream_info_t stream_info_ffmpeg_unsafe;
 extern const stream_info_t stream_info_avdevice;
 extern const stream_info_t stream_info_file;
 extern const stream_info_t stream_info_slice;
+extern const stream_info_t stream_info_mirror;
+extern const stream_info_t stream_info_throttle;
 extern const stream_info_t stream_info_fd;
 extern const stream_info_t stream_info_ifo_dvdnav;
 extern const stream_info_t stream_info_dvdnav;
@@ -88,8 +91,11 @@ static const stream_info_t *const stream_list[] = {
     &stream_info_edl,
     &stream_info_file,
     &stream_info_slice,
+    &stream_info_mirror,
+    &stream_info_throttle,
     &stream_info_fd,
     &stream_info_cb,
+    &stream_info_http_parallel,
     &stream_info_ffmpeg,
     &stream_info_ffmpeg_unsafe,
 };
@@ -101,9 +107,17 @@ static const stream_info_t *const stream_list[] = {
 // Must be power of 2.
 #define STREAM_MAX_BUFFER_SIZE (512 * 1024 * 1024)
 
+// Limit for --stream-buffer-adaptive (unless --stream-buffer-size is larger).
+#define STREAM_ADAPTIVE_MAX_BUFFER_SIZE (8 * 1024 * 1024)
+// Try to buffer this much time worth of data with --stream-buffer-adaptive.
+#define STREAM_ADAPTIVE_WINDOW_S 0.1
+
 struct stream_opts {
     int64_t buffer_size;
     bool load_unsafe_playlists;
+    int64_t shared_cache_size;
+    bool buffer_adaptive;
+    int64_t readahead_size;
 };
 
 #define OPT_BASE_STRUCT struct stream_opts
@@ -113,6 +127,11 @@ const struct m_sub_options stream_conf = {
         {"stream-buffer-size", OPT_BYTE_SIZE(buffer_size),
             M_RANGE(STREAM_MIN_BUFFER_SIZE, STREAM_MAX_BUFFER_SIZE)},
         {"load-unsafe-playlists", OPT_BOOL(load_unsafe_playlists)},
+        {"stream-shared-cache", OPT_BYTE_SIZE(shared_cache_size),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"stream-buffer-adaptive", OPT_BOOL(buffer_adaptive)},
+        {"stream-readahead", OPT_BYTE_SIZE(readahead_size),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
         {0}
     },
     .size = sizeof(struct stream_opts),
@@ -361,6 +380,8 @@ static int stream_create_instance(const stream_info_t *sinfo,
     s->path = talloc_strdup(s, path);
     s->mode = flags & (STREAM_READ | STREAM_WRITE);
     s->requested_buffer_size = opts->buffer_size;
+    s->base_buffer_size = opts->buffer_size;
+    s->adaptive_buffer = opts->buffer_adaptive;
     s->allow_partial_read = flags & STREAM_ALLOW_PARTIAL_READ;
 
     if (flags & STREAM_LESS_NOISE)
@@ -464,6 +485,16 @@ int stream_create_with_args(struct stream_open_args *args, struct stream **ret)
         talloc_free(log);
     }
 
+    if (*ret && (args->flags & (STREAM_SHARED_CACHE | STREAM_READAHEAD))) {
+        struct stream_opts *opts =
+            mp_get_config_group(NULL, args->global, &stream_conf);
+        if (args->flags & STREAM_SHARED_CACHE)
+            *ret = stream_shared_wrap(*ret, opts->shared_cache_size);
+        if (args->flags & STREAM_READAHEAD)
+            *ret = stream_readahead_wrap(*ret, opts->readahead_size);
+        talloc_free(opts);
+    }
+
     return r;
 }
 
@@ -492,20 +523,67 @@ stream_t *open_output_stream(const char *filename, struct mpv_global *global)
     return s;
 }
 
+// Update the --stream-buffer-adaptive statistics with a fill_buffer call that
+// read bytes in time_ns, and pick a new buffer size. The buffer is made large
+// enough to hold STREAM_ADAPTIVE_WINDOW_S worth of data at the measured read
+// rate, but not much larger than the typical distance between seeks, because
+// any data read past that is discarded. The buffer itself is resized on the
+// next read that needs more space, or shrunk on the next seek.
+static void stream_adapt_buffer(stream_t *s, int bytes, int64_t time_ns)
+{
+    s->adapt_read_bytes = s->adapt_read_bytes * 0.875 + bytes * 0.125;
+    s->adapt_read_time = s->adapt_read_time * 0.875 +
+                         MPMAX(time_ns, 1000) / 1e9 * 0.125;
+    s->adapt_bytes_since_seek += bytes;
+
+    double size = s->adapt_read_bytes / s->adapt_read_time *
+                  STREAM_ADAPTIVE_WINDOW_S;
+    // Buffering more than twice of what is read between seeks is a waste.
+    if (s->adapt_seek_distance > 0)
+        size = MPMIN(size, MPMAX(s->adapt_seek_distance,
+                                 s->adapt_bytes_since_seek) * 2);
+    int max = MPMAX(s->base_buffer_size, STREAM_ADAPTIVE_MAX_BUFFER_SIZE);
+    size = MPCLAMP(size, s->base_buffer_size, max);
+
+    int new = mp_round_next_power_of_2(size);
+    if (new != s->requested_buffer_size) {
+        MP_DBG(s, "Adaptive buffer size: %d -> %d (%.0f KiB/s)\n",
+               s->requested_buffer_size, new,
+               s->adapt_read_bytes / s->adapt_read_time / 1024);
+        s->requested_buffer_size = new;
+    }
+}
+
 // Read function bypassing the local stream buffer. This will not write into
-// s->buffer, but into buf[0..len] instead.
+// s->buffer, but into the given buffers (in order) instead.
 // Returns 0 on error or EOF, and length of bytes read on success.
-// Partial reads are possible, even if EOF is not reached.
-static int stream_read_unbuffered(stream_t *s, void *buf, int len)
+// Partial reads are possible, even if EOF is not reached. If the stream has no
+// fill_buffer_vec callback, only the first buffer is read into.
+static int stream_read_unbuffered_vec(stream_t *s, struct stream_iovec *iov,
+                                      int num_iov)
 {
-    mp_assert(len >= 0);
+    mp_assert(num_iov > 0 && num_iov <= STREAM_MAX_IOVEC);
+    int len = 0;
+    for (int n = 0; n < num_iov; n++) {
+        mp_assert(iov[n].len >= 0);
+        len += iov[n].len;
+    }
     if (len <= 0)
         return 0;
 
     int res = 0;
+    int64_t start = s->adaptive_buffer ? mp_time_ns() : 0;
     // we will retry even if we already reached EOF previously.
-    if (s->fill_buffer && !mp_cancel_test(s->cancel))
-        res = s->fill_buffer(s, buf, len);
+    if (!mp_cancel_test(s->cancel)) {
+        if (s->fill_buffer_vec && num_iov > 1) {
+            res = s->fill_buffer_vec(s, iov, num_iov);
+        } else if (s->fill_buffer) {
+            len = iov[0].len;
+            res = len ? s->fill_buffer(s, iov[0].base, len) : 0;
+        }
+    }
+    if (s->adaptive_buffer && res > 0)
+        stream_adapt_buffer(s, res, mp_time_ns() - start);
     if (res <= 0) {
         s->eof = 1;
         return 0;
@@ -518,6 +596,13 @@ static int stream_read_unbuffered(stream_t *s, void *buf, int len)
     return res;
 }
 
+static int stream_read_unbuffered(stream_t *s, void *buf, int len)
+{
+    mp_assert(len >= 0);
+    struct stream_iovec iov = {buf, len};
+    return stream_read_unbuffered_vec(s, &iov, 1);
+}
+
 // Ask for having at most "forward" bytes ready to read in the buffer.
 // To read everything, you may have to call this in a loop.
 //  forward: desired amount of bytes in buffer after s->cur_pos
@@ -554,12 +639,15 @@ static bool stream_read_more(struct stream *s, int forward)
     int read = buf_alloc - (buf_old + forward_avail); // free buffer past end
 
     int pos = s->buf_end & s->buffer_mask;
-    read = MPMIN(read, buf_alloc - pos);
+    struct stream_iovec iov[2] = {
+        {&s->buffer[pos], MPMIN(read, buf_alloc - pos)},
+        {&s->buffer[0], read - MPMIN(read, buf_alloc - pos)},
+    };
 
-    // Note: if wrap-around happens, we need to make two calls. This may
-    // affect latency (e.g. waiting for new data on a socket), so do only
-    // 1 read call always.
-    read = stream_read_unbuffered(s, &s->buffer[pos], read);
+    // Note: if wrap-around happens, we need to make two calls, unless the
+    // stream supports vectored reads. This may affect latency (e.g. waiting
+    // for new data on a socket), so do only 1 read call always.
+    read = stream_read_unbuffered_vec(s, iov, iov[1].len ? 2 : 1);
 
     s->buf_end += read;
 
@@ -594,14 +682,20 @@ int stream_read_partial(stream_t *s, void *buf, int buf_size)
 {
     mp_assert(s->buf_cur <= s->buf_end);
     mp_assert(buf_size >= 0);
-    if (s->buf_cur == s->buf_end && buf_size > 0) {
-        if (buf_size > (s->buffer_mask + 1) / 2) {
-            // Direct read if the buffer is too small anyway.
-            stream_drop_buffers(s);
-            return stream_read_unbuffered(s, buf, buf_size);
-        }
-        stream_read_more(s, 1);
+    int avail = s->buf_end - s->buf_cur;
+    if (avail < buf_size && buf_size - avail > (s->buffer_mask + 1) / 2 &&
+        s->seekable)
+    {
+        // Direct read of the part not in the buffer if the buffer is too small
+        // anyway. This avoids copying large reads through the buffer. Not done
+        // for unseekable streams, which rely on the buffer for seeking back.
+        int res = ring_copy(s, buf, avail, s->buf_cur);
+        s->buf_cur += res;
+        stream_drop_buffers(s);
+        return res + stream_read_unbuffered(s, (char *)buf + res, buf_size - res);
     }
+    if (s->buf_cur == s->buf_end && buf_size > 0)
+        stream_read_more(s, 1);
     int res = ring_copy(s, buf, buf_size, s->buf_cur);
     s->buf_cur += res;
     return res;
@@ -713,6 +807,11 @@ static bool stream_seek_unbuffered(stream_t *s, int64_t newpos)
                    (long long)newpos, (long long)stream_get_size(s));
             return false;
         }
+        if (s->adaptive_buffer) {
+            s->adapt_seek_distance = s->adapt_seek_distance * 0.75 +
+                                     s->adapt_bytes_since_seek * 0.25;
+            s->adapt_bytes_since_seek = 0;
+        }
         stream_drop_buffers(s);
         s->pos = newpos;
     }
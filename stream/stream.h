@@ -54,6 +54,8 @@
 #define STREAM_LOCAL_FS_ONLY      (1 << 5) // stream_file only, no URLs
 #define STREAM_LESS_NOISE         (1 << 6) // try to log errors only
 #define STREAM_ALLOW_PARTIAL_READ (1 << 7) // allows partial read with stream_read_file()
+#define STREAM_SHARED_CACHE       (1 << 8) // share data per URL (--stream-shared-cache)
+#define STREAM_READAHEAD          (1 << 9) // read in a thread (--stream-readahead)
 
 // Default flags used by stream_read_file().
 #define STREAM_READ_FILE_FLAGS_DEFAULT \
@@ -127,15 +129,29 @@ typedef struct stream_info_st {
     char **(*get_protocols)(void);
     bool can_write;     // correctly checks for READ/WRITE modes
     bool local_fs;      // supports STREAM_LOCAL_FS_ONLY
+    bool shareable;     // data only depends on the URL (STREAM_SHARED_CACHE)
     int stream_origin;  // 0 or set of STREAM_ORIGIN_*; if 0, the same origin
                         // is set, or the stream's open() function handles it
 } stream_info_t;
 
+// Buffer for stream.fill_buffer_vec.
+struct stream_iovec {
+    void *base;
+    int len;
+};
+
+#define STREAM_MAX_IOVEC 4
+
 typedef struct stream {
     const struct stream_info_st *info;
 
     // Read
     int (*fill_buffer)(struct stream *s, void *buffer, int max_len);
+    // Optional; like fill_buffer, but reads into num_iov (<= STREAM_MAX_IOVEC)
+    // buffers in sequence (a later buffer only gets data if all previous ones
+    // are full). Returns the total number of bytes read.
+    int (*fill_buffer_vec)(struct stream *s, struct stream_iovec *iov,
+                           int num_iov);
     // Write
     int (*write_buffer)(struct stream *s, void *buffer, int len);
     // Seek
@@ -179,6 +195,15 @@ typedef struct stream {
     // Buffer size requested by user; s->buffer may have a different size
     int requested_buffer_size;
 
+    // --stream-buffer-adaptive: requested_buffer_size is adjusted between
+    // base_buffer_size (--stream-buffer-size) and an upper limit.
+    bool adaptive_buffer;
+    int base_buffer_size;
+    double adapt_read_bytes;        // average bytes per fill_buffer call
+    double adapt_read_time;         // average seconds per fill_buffer call
+    double adapt_seek_distance;     // average bytes read between seeks
+    int64_t adapt_bytes_since_seek;
+
     // This is a ring buffer. It is reset only on seeks (or when buffers are
     // dropped). Otherwise old contents always stay valid.
     // The valid buffer is from buf_start to buf_end; buf_end can be larger
@@ -270,6 +295,28 @@ struct stream *stream_memory_open(struct mpv_global *global, void *data, int len
 struct stream *stream_concat_open(struct mpv_global *global, struct mp_cancel *c,
                                   struct stream **streams, int num_streams);
 
+// stream_headcache.c
+struct stream *stream_headcache_open(const char *url, int flags,
+                                     struct mp_cancel *c,
+                                     struct mpv_global *global,
+                                     const char *dir, int64_t head_bytes);
+void stream_headcache_trim(const char *dir, int64_t max_bytes);
+
+// stream_shared.c
+struct stream *stream_shared_wrap(struct stream *inner, int64_t max_bytes);
+
+// stream_readahead.c
+struct stream *stream_readahead_wrap(struct stream *inner, int64_t size);
+struct mp_disc_readahead;
+struct mp_disc_readahead *mp_disc_readahead_create(struct stream *s,
+        int (*read)(struct stream *s, void *buf, int len),
+        int block_size, int64_t size);
+void mp_disc_readahead_destroy(struct mp_disc_readahead *ra);
+int mp_disc_readahead_read(struct mp_disc_readahead *ra, void *buf, int len);
+void mp_disc_readahead_lock(struct mp_disc_readahead *ra);
+void mp_disc_readahead_unlock(struct mp_disc_readahead *ra);
+void mp_disc_readahead_flush(struct mp_disc_readahead *ra);
+
 // stream_file.c
 char *mp_file_url_to_filename(void *talloc_ctx, bstr url);
 char *mp_file_get_path(void *talloc_ctx, bstr url);
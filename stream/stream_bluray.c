@@ -79,11 +79,13 @@ const struct m_sub_options stream_bluray_conf = {
     .opts = (const struct m_option[]) {
         {"device", OPT_STRING(bluray_device), .flags = M_OPT_FILE},
         {"angle", OPT_INT(angle), M_RANGE(1, 999)},
+        {"readahead", OPT_BYTE_SIZE(readahead_size), M_RANGE(0, M_MAX_MEM_BYTES)},
         {0},
     },
     .size = sizeof(struct mp_bluray_opts),
     .defaults = &(const struct mp_bluray_opts){
         .angle = 1,
+        .readahead_size = 32 * 1024 * 1024,
     },
 };
 
@@ -101,6 +103,10 @@ struct bluray_priv_s {
 
     struct mp_bluray_opts *opts;
     struct m_config_cache *opts_cache;
+
+    // If set, libbluray is read in a thread, and accesses to it have to be
+    // done with mp_disc_readahead_lock() held.
+    struct mp_disc_readahead *readahead;
 };
 
 inline static int play_playlist(struct bluray_priv_s *priv, int playlist)
@@ -119,6 +125,8 @@ static void bluray_stream_close(stream_t *s)
     if (!priv)
         return;
 
+    mp_disc_readahead_destroy(priv->readahead);
+    priv->readahead = NULL;
     if (priv->title_info)
         bd_free_title_info(priv->title_info);
     if (priv->bd)
@@ -176,7 +184,7 @@ static void handle_event(stream_t *s, const BD_EVENT *ev)
     }
 }
 
-static int bluray_stream_fill_buffer(stream_t *s, void *buf, int len)
+static int bluray_read(stream_t *s, void *buf, int len)
 {
     struct bluray_priv_s *b = s->priv;
     BD_EVENT event;
@@ -185,7 +193,15 @@ static int bluray_stream_fill_buffer(stream_t *s, void *buf, int len)
     return bd_read(b->bd, buf, len);
 }
 
-static int bluray_stream_control(stream_t *s, int cmd, void *arg)
+static int bluray_stream_fill_buffer(stream_t *s, void *buf, int len)
+{
+    struct bluray_priv_s *b = s->priv;
+    if (b->readahead)
+        return mp_disc_readahead_read(b->readahead, buf, len);
+    return bluray_read(s, buf, len);
+}
+
+static int bluray_control_locked(stream_t *s, int cmd, void *arg)
 {
     struct bluray_priv_s *b = s->priv;
 
@@ -214,6 +230,7 @@ static int bluray_stream_control(stream_t *s, int cmd, void *arg)
         const uint32_t title = *((unsigned int*)arg);
         if (title >= b->num_titles || !play_title(b, title))
             return STREAM_UNSUPPORTED;
+        mp_disc_readahead_flush(b->readahead);
         b->current_title = title;
         return STREAM_OK;
     }
@@ -239,6 +256,7 @@ static int bluray_stream_control(stream_t *s, int cmd, void *arg)
     case STREAM_CTRL_SEEK_TO_TIME: {
         double pts = *((double *) arg);
         bd_seek_time(b->bd, BD_TIME_FROM_MP(pts));
+        mp_disc_readahead_flush(b->readahead);
         stream_drop_buffers(s);
         // API makes it hard to determine seeking success
         return STREAM_OK;
@@ -327,6 +345,15 @@ static int bluray_stream_control(stream_t *s, int cmd, void *arg)
     return STREAM_UNSUPPORTED;
 }
 
+static int bluray_stream_control(stream_t *s, int cmd, void *arg)
+{
+    struct bluray_priv_s *b = s->priv;
+    mp_disc_readahead_lock(b->readahead);
+    int r = bluray_control_locked(s, cmd, arg);
+    mp_disc_readahead_unlock(b->readahead);
+    return r;
+}
+
 static const char *aacs_strerr(int err)
 {
     switch (err) {
@@ -497,6 +524,11 @@ static int bluray_stream_open_internal(stream_t *s)
     s->priv        = b;
     s->demuxer     = "+disc";
 
+    // Read a multiple of the sector size, so reads stay aligned.
+    b->readahead = mp_disc_readahead_create(s, bluray_read,
+                                            BLURAY_SECTOR_SIZE * 10,
+                                            b->opts->readahead_size);
+
     MP_VERBOSE(s, "Blu-ray successfully opened.\n");
 
     return STREAM_OK;
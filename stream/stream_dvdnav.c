@@ -70,12 +70,17 @@ struct priv {
     char *device;
 
     struct dvd_opts *opts;
+
+    // If set, libdvdnav is read in a thread, and accesses to it have to be
+    // done with mp_disc_readahead_lock() held.
+    struct mp_disc_readahead *readahead;
 };
 
 struct dvd_opts {
     int angle;
     int speed;
     char *device;
+    int64_t readahead_size;
 };
 
 #define OPT_BASE_STRUCT struct dvd_opts
@@ -85,11 +90,13 @@ const struct m_sub_options dvd_conf = {
         {"device", OPT_STRING(device), .flags = M_OPT_FILE},
         {"speed", OPT_INT(speed)},
         {"angle", OPT_INT(angle), M_RANGE(1, 99)},
+        {"readahead", OPT_BYTE_SIZE(readahead_size), M_RANGE(0, M_MAX_MEM_BYTES)},
         {0}
     },
     .size = sizeof(struct dvd_opts),
     .defaults = &(const struct dvd_opts){
         .angle = 1,
+        .readahead_size = 8 * 1024 * 1024,
     },
 };
 
@@ -276,7 +283,7 @@ static int mp_dvdnav_number_of_subs(stream_t *stream)
     return n;
 }
 
-static int fill_buffer(stream_t *s, void *buf, int max_len)
+static int read_block(stream_t *s, void *buf, int max_len)
 {
     struct priv *priv = s->priv;
     dvdnav_t *dvdnav = priv->dvdnav;
@@ -322,7 +329,7 @@ static int fill_buffer(stream_t *s, void *buf, int max_len)
         case DVDNAV_VTS_CHANGE: {
             int tit = 0, part = 0;
             dvdnav_vts_change_event_t *vts_event =
-                (dvdnav_vts_change_event_t *)s->buffer;
+                (dvdnav_vts_change_event_t *)buf;
             MP_INFO(s, "DVDNAV, switched to title: %d\n",
                    vts_event->new_vtsN);
             if (!priv->had_initial_vts) {
@@ -358,7 +365,15 @@ static int fill_buffer(stream_t *s, void *buf, int max_len)
     return 0;
 }
 
-static int control(stream_t *stream, int cmd, void *arg)
+static int fill_buffer(stream_t *s, void *buf, int max_len)
+{
+    struct priv *priv = s->priv;
+    if (priv->readahead)
+        return mp_disc_readahead_read(priv->readahead, buf, max_len);
+    return read_block(s, buf, max_len);
+}
+
+static int control_locked(stream_t *stream, int cmd, void *arg)
 {
     struct priv *priv = stream->priv;
     dvdnav_t *dvdnav = priv->dvdnav;
@@ -444,6 +459,7 @@ static int control(stream_t *stream, int cmd, void *arg)
         int title = *((unsigned int *) arg);
         if (dvdnav_title_play(priv->dvdnav, title + 1) != DVDNAV_STATUS_OK)
             break;
+        mp_disc_readahead_flush(priv->readahead);
         stream_drop_buffers(stream);
         return STREAM_OK;
     }
@@ -464,6 +480,7 @@ static int control(stream_t *stream, int cmd, void *arg)
         MP_VERBOSE(stream, "seek to PTS %f (%"PRId64")\n", d, tm);
         if (dvdnav_time_search(dvdnav, tm) != DVDNAV_STATUS_OK)
             break;
+        mp_disc_readahead_flush(priv->readahead);
         stream_drop_buffers(stream);
         d = dvdnav_get_current_time(dvdnav) / 90000.0f;
         MP_VERBOSE(stream, "landed at: %f\n", d);
@@ -534,9 +551,20 @@ static int control(stream_t *stream, int cmd, void *arg)
     return STREAM_UNSUPPORTED;
 }
 
+static int control(stream_t *stream, int cmd, void *arg)
+{
+    struct priv *priv = stream->priv;
+    mp_disc_readahead_lock(priv->readahead);
+    int r = control_locked(stream, cmd, arg);
+    mp_disc_readahead_unlock(priv->readahead);
+    return r;
+}
+
 static void stream_dvdnav_close(stream_t *s)
 {
     struct priv *priv = s->priv;
+    mp_disc_readahead_destroy(priv->readahead);
+    priv->readahead = NULL;
     if (priv->dvdnav)
         dvdnav_close(priv->dvdnav);
     priv->dvdnav = NULL;
@@ -646,6 +674,10 @@ static int open_s_internal(stream_t *stream)
     stream->demuxer = "+disc";
     stream->lavf_type = "mpeg";
 
+    // libdvdnav returns one 2048 byte block per dvdnav_get_next_block() call.
+    p->readahead = mp_disc_readahead_create(stream, read_block, 2048,
+                                            p->opts->readahead_size);
+
     return STREAM_OK;
 
 err:
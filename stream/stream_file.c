@@ -27,6 +27,7 @@
 
 #ifndef _WIN32
 #include <poll.h>
+#include <sys/uio.h>
 #endif
 
 #include "osdep/io.h"
@@ -35,6 +36,7 @@
 #include "common/msg.h"
 #include "misc/thread_tools.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -47,6 +49,10 @@
 #include <sys/vfs.h>
 #endif
 
+#if HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 #ifdef _WIN32
 #include <windows.h>
 #include <winioctl.h>
@@ -85,6 +91,20 @@ typedef enum _FSINFOCLASS {
 #endif
 #endif
 
+struct stream_file_opts {
+    bool io_uring;
+};
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const struct m_option[]){
+        {"stream-io-uring", OPT_BOOL(io_uring)},
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+};
+
 struct priv {
     int fd;
     bool close;
@@ -93,12 +113,218 @@ struct priv {
     bool appending;
     int64_t orig_size;
     struct mp_cancel *cancel;
+#if HAVE_LIBURING
+    struct uring_state *uring;  // NULL if read() is used
+#endif
 };
 
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
 #define RETRY_TIMEOUT 0.2
 #define MAX_RETRIES 10
 
+#if HAVE_LIBURING
+
+// Number of reads kept in flight, and size of each.
+#define URING_DEPTH 8
+#define URING_CHUNK (256 * 1024)
+
+struct uring_req {
+    uint8_t *buf;
+    int64_t offset;     // file position of buf[0]
+    int res;            // bytes read, or negative errno
+    bool pending;       // submitted, but not completed yet
+};
+
+// Reads ahead of the stream position with io_uring. The queued requests are
+// at consecutive file offsets, reqs[head] contains (or is about to contain)
+// the byte at pos. The kernel file position is not used, except when falling
+// back to read() (see uring_reset()).
+struct uring_state {
+    struct io_uring ring;
+    struct uring_req reqs[URING_DEPTH];
+    int head;
+    int num;            // number of queued requests starting at head
+    int64_t pos;        // file position of the next byte returned
+};
+
+static bool uring_init(stream_t *s)
+{
+    struct priv *p = s->priv;
+
+    struct uring_state *u = talloc_zero(p, struct uring_state);
+    int r = io_uring_queue_init(URING_DEPTH, &u->ring, 0);
+    if (r < 0) {
+        MP_VERBOSE(s, "io_uring not available (%s), using read().\n",
+                   mp_strerror(-r));
+        talloc_free(u);
+        return false;
+    }
+    for (int n = 0; n < URING_DEPTH; n++)
+        u->reqs[n].buf = talloc_size(u, URING_CHUNK);
+
+    p->uring = u;
+    return true;
+}
+
+// Process one completion. Returns false if none was available (or on error).
+static bool uring_reap(struct uring_state *u, bool block)
+{
+    struct io_uring_cqe *cqe;
+    int r;
+    do {
+        r = block ? io_uring_wait_cqe(&u->ring, &cqe)
+                  : io_uring_peek_cqe(&u->ring, &cqe);
+    } while (r == -EINTR);
+    if (r < 0)
+        return false;
+
+    struct uring_req *req = io_uring_cqe_get_data(cqe);
+    req->res = cqe->res;
+    req->pending = false;
+    io_uring_cqe_seen(&u->ring, cqe);
+    return true;
+}
+
+// Fill up the queue with reads following the last queued one.
+static void uring_queue(struct priv *p, struct uring_state *u)
+{
+    int queued = 0;
+    while (u->num < URING_DEPTH) {
+        int64_t offset = u->pos;
+        if (u->num) {
+            struct uring_req *last = &u->reqs[(u->head + u->num - 1) % URING_DEPTH];
+            // Short read: end of file.
+            if (!last->pending && last->res < URING_CHUNK)
+                break;
+            offset = last->offset + URING_CHUNK;
+        }
+
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+        if (!sqe)
+            break;
+
+        struct uring_req *req = &u->reqs[(u->head + u->num) % URING_DEPTH];
+        *req = (struct uring_req){
+            .buf = req->buf,
+            .offset = offset,
+            .pending = true,
+        };
+        io_uring_prep_read(sqe, p->fd, req->buf, URING_CHUNK, offset);
+        io_uring_sqe_set_data(sqe, req);
+        u->num++;
+        queued++;
+    }
+
+    if (queued)
+        io_uring_submit(&u->ring);
+}
+
+// Wait for and drop all queued reads, and sync the kernel file position to
+// u->pos, so that read() can continue from there.
+static void uring_reset(struct priv *p, struct uring_state *u)
+{
+    for (int n = 0; n < u->num; n++) {
+        struct uring_req *req = &u->reqs[(u->head + n) % URING_DEPTH];
+        while (req->pending) {
+            if (!uring_reap(u, true)) {
+                // Can't reuse the buffers; stick to read(). (They're freed
+                // only after io_uring_queue_exit().)
+                p->uring = NULL;
+                break;
+            }
+        }
+    }
+    u->head = u->num = 0;
+    lseek(p->fd, u->pos, SEEK_SET);
+}
+
+// Return the request containing the data at u->pos. Returns NULL if there is
+// none (EOF, errors), or if !block and it's not completed yet.
+static struct uring_req *uring_next(struct priv *p, struct uring_state *u,
+                                    bool block)
+{
+    while (1) {
+        uring_queue(p, u);
+        if (!u->num)
+            return NULL;
+
+        struct uring_req *req = &u->reqs[u->head];
+        while (req->pending) {
+            if (!uring_reap(u, block))
+                return NULL;
+        }
+
+        if (req->res <= 0)
+            return NULL;
+        if (u->pos < req->offset + req->res)
+            return req;
+        if (req->res < URING_CHUNK)
+            return NULL;
+
+        u->head = (u->head + 1) % URING_DEPTH;
+        u->num--;
+    }
+}
+
+// Copy completed readahead data. Blocks only if nothing is available yet.
+// Returns 0 if read() has to be used (and has been prepared for).
+static int uring_read(stream_t *s, struct stream_iovec *iov, int num_iov)
+{
+    struct priv *p = s->priv;
+    struct uring_state *u = p->uring;
+    int total = 0;
+
+    for (int n = 0; n < num_iov; n++) {
+        int done = 0;
+        while (done < iov[n].len) {
+            struct uring_req *req = uring_next(p, u, !total);
+            if (!req)
+                goto done;
+            int skip = u->pos - req->offset;
+            int copy = MPMIN(req->res - skip, iov[n].len - done);
+            memcpy((char *)iov[n].base + done, req->buf + skip, copy);
+            done += copy;
+            total += copy;
+            u->pos += copy;
+        }
+    }
+
+done:
+    // Errors and EOF (including files being appended) are left to read().
+    if (!total)
+        uring_reset(p, u);
+    return total;
+}
+
+static bool uring_seek(struct priv *p, struct uring_state *u, int64_t newpos)
+{
+    // Keep the reads if the target is within them.
+    if (u->num) {
+        struct uring_req *first = &u->reqs[u->head];
+        int64_t end = first->offset + (int64_t)u->num * URING_CHUNK;
+        if (newpos >= first->offset && newpos < end) {
+            u->pos = newpos;
+            return true;
+        }
+    }
+
+    u->pos = newpos;
+    uring_reset(p, u);
+    return true;
+}
+
+static void uring_uninit(struct priv *p)
+{
+    struct uring_state *u = p->uring;
+    if (!u)
+        return;
+    uring_reset(p, u);
+    io_uring_queue_exit(&u->ring);
+    p->uring = NULL;
+}
+
+#endif
+
 static int64_t get_size(stream_t *s)
 {
     struct priv *p = s->priv;
@@ -112,10 +338,18 @@ static int64_t get_size(stream_t *s)
     return -1;
 }
 
-static int fill_buffer(stream_t *s, void *buffer, int max_len)
+static int fill_buffer_vec(stream_t *s, struct stream_iovec *iov, int num_iov)
 {
     struct priv *p = s->priv;
 
+#if HAVE_LIBURING
+    if (p->uring) {
+        int r = uring_read(s, iov, num_iov);
+        if (r > 0)
+            return r;
+    }
+#endif
+
 #ifndef _WIN32
     if (p->use_poll) {
         int c = mp_cancel_get_fd(p->cancel);
@@ -127,12 +361,26 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
         if (fds[1].revents & POLLIN)
             return -1;
     }
+
+    struct iovec vec[STREAM_MAX_IOVEC];
+    for (int n = 0; n < num_iov; n++)
+        vec[n] = (struct iovec){iov[n].base, iov[n].len};
 #endif
 
     for (int retries = 0; retries < MAX_RETRIES; retries++) {
-        int r = read(p->fd, buffer, max_len);
-        if (r > 0)
+#ifndef _WIN32
+        int r = num_iov > 1 ? readv(p->fd, vec, num_iov)
+                            : read(p->fd, iov[0].base, iov[0].len);
+#else
+        int r = read(p->fd, iov[0].base, iov[0].len);
+#endif
+        if (r > 0) {
+#if HAVE_LIBURING
+            if (p->uring)
+                p->uring->pos += r;
+#endif
             return r;
+        }
 
         // Try to detect and handle files being appended during playback.
         int64_t size = get_size(s);
@@ -152,6 +400,12 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
     return 0;
 }
 
+static int fill_buffer(stream_t *s, void *buffer, int max_len)
+{
+    struct stream_iovec iov = {buffer, max_len};
+    return fill_buffer_vec(s, &iov, 1);
+}
+
 static int write_buffer(stream_t *s, void *buffer, int len)
 {
     struct priv *p = s->priv;
@@ -161,12 +415,19 @@ static int write_buffer(stream_t *s, void *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+#if HAVE_LIBURING
+    if (p->uring)
+        return uring_seek(p, p->uring, newpos);
+#endif
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#if HAVE_LIBURING
+    uring_uninit(p);
+#endif
     if (p->close)
         close(p->fd);
 }
@@ -358,6 +619,12 @@ static int open_f(stream_t *stream, const struct stream_open_args *args)
             // O_NONBLOCK has weird semantics on file locks; remove it.
             int val = fcntl(p->fd, F_GETFL) & ~(unsigned)O_NONBLOCK;
             fcntl(p->fd, F_SETFL, val);
+#endif
+#if HAVE_POSIX && defined(POSIX_FADV_SEQUENTIAL)
+            // Playback reads mostly sequentially; let the kernel read ahead
+            // more aggressively.
+            if (!write)
+                posix_fadvise(p->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 #endif
         } else {
 #ifndef __MINGW32__
@@ -380,6 +647,7 @@ static int open_f(stream_t *stream, const struct stream_open_args *args)
 
     stream->fast_skip = true;
     stream->fill_buffer = fill_buffer;
+    stream->fill_buffer_vec = fill_buffer_vec;
     stream->write_buffer = write_buffer;
     stream->get_size = get_size;
     stream->close = s_close;
@@ -396,6 +664,15 @@ static int open_f(stream_t *stream, const struct stream_open_args *args)
 
     p->orig_size = get_size(stream);
 
+#if HAVE_LIBURING
+    struct stream_file_opts *opts =
+        mp_get_config_group(stream, stream->global, &stream_file_conf);
+    if (opts->io_uring && p->regular_file && stream->seekable && !write &&
+        uring_init(stream))
+        MP_VERBOSE(stream, "Reading with io_uring.\n");
+    talloc_free(opts);
+#endif
+
     p->cancel = mp_cancel_new(p);
     if (stream->cancel)
         mp_cancel_set_parent(p->cancel, stream->cancel);
@@ -409,6 +686,7 @@ const stream_info_t stream_info_file = {
     .protocols = (const char*const[]){ "file", "", "appending", NULL },
     .can_write = true,
     .local_fs = true,
+    .shareable = true,
     .stream_origin = STREAM_ORIGIN_FS,
 };
 
@@ -0,0 +1,491 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Persistent cache for the first bytes of a stream. The first time a URL is
+// opened, the first head_bytes read from it are written to a file in the
+// cache directory. The next time (even after a restart), reads within that
+// range are served from the file, and the actual stream is opened only once
+// something after it is read. This makes opening and the first seconds of
+// playback independent from the network.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include <libavutil/intreadwrite.h>
+#include <libavutil/md5.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/path_utils.h"
+#include "osdep/io.h"
+#include "stream.h"
+
+#define HEADCACHE_MAGIC "mpvhead2"
+#define HEADCACHE_EXT ".head"
+
+// File header, followed by the URL, the mime type, and the stream data. In the
+// file, the fields are stored in this order, little endian and without
+// padding (see write_header()).
+#define HEADCACHE_HEADER_SIZE 34
+struct headcache_header {
+    char magic[8];
+    int64_t head_len;   // bytes of stream data in the file
+    int64_t size;       // size of the whole stream, or -1
+    uint32_t url_len;
+    uint32_t mime_len;
+    uint8_t streaming, is_network;
+};
+
+struct priv {
+    const char *url;
+    char *path;             // cache file
+    int flags;
+    struct stream *inner;   // opened lazily if the head was cached
+    bool inner_failed;
+
+    FILE *file;
+    struct headcache_header hdr;
+    int64_t data_offset;    // file offset of stream data
+
+    // Only while writing the file.
+    bool writing;
+    int64_t head_max;
+    char *tmp_path;
+};
+
+static bool write_header(FILE *f, struct headcache_header *hdr)
+{
+    uint8_t buf[HEADCACHE_HEADER_SIZE];
+    memcpy(buf, hdr->magic, 8);
+    AV_WL64(buf + 8, hdr->head_len);
+    AV_WL64(buf + 16, hdr->size);
+    AV_WL32(buf + 24, hdr->url_len);
+    AV_WL32(buf + 28, hdr->mime_len);
+    buf[32] = hdr->streaming;
+    buf[33] = hdr->is_network;
+    return fwrite(buf, sizeof(buf), 1, f) == 1;
+}
+
+static bool read_header(FILE *f, struct headcache_header *hdr)
+{
+    uint8_t buf[HEADCACHE_HEADER_SIZE];
+    if (fread(buf, sizeof(buf), 1, f) != 1)
+        return false;
+    memcpy(hdr->magic, buf, 8);
+    hdr->head_len = AV_RL64(buf + 8);
+    hdr->size = AV_RL64(buf + 16);
+    hdr->url_len = AV_RL32(buf + 24);
+    hdr->mime_len = AV_RL32(buf + 28);
+    hdr->streaming = buf[32];
+    hdr->is_network = buf[33];
+    return true;
+}
+
+static char *cache_file_name(void *ta_ctx, const char *dir, const char *url)
+{
+    uint8_t md5[16];
+    av_md5_sum(md5, url, strlen(url));
+    char *name = talloc_strdup(ta_ctx, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+    name = talloc_strdup_append(name, HEADCACHE_EXT);
+    char *path = mp_path_join(ta_ctx, dir, name);
+    talloc_free(name);
+    return path;
+}
+
+static void abort_writing(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (!p->writing)
+        return;
+    fclose(p->file);
+    p->file = NULL;
+    unlink(p->tmp_path);
+    p->writing = false;
+}
+
+// The head is complete (or the stream ended within it): make the file visible.
+static void finish_writing(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (!p->writing)
+        return;
+    p->hdr.size = stream_get_size(p->inner);
+    bool ok = fseek(p->file, 0, SEEK_SET) == 0 &&
+              write_header(p->file, &p->hdr);
+    ok = fclose(p->file) == 0 && ok;
+    p->file = NULL;
+    p->writing = false;
+    if (!ok || rename(p->tmp_path, p->path) != 0) {
+        MP_WARN(s, "Could not write head cache file %s.\n", p->path);
+        unlink(p->tmp_path);
+        return;
+    }
+    MP_VERBOSE(s, "Cached first %"PRId64" bytes in %s.\n", p->hdr.head_len,
+               p->path);
+}
+
+// Whether the stream still looks like the one the cached head was read from.
+// (Only the size and mime type are known; the HTTP validators are not exposed
+// by the stream layer.)
+static bool is_same_stream(struct stream *s, struct stream *inner)
+{
+    struct priv *p = s->priv;
+
+    int64_t size = stream_get_size(inner);
+    if (p->hdr.size >= 0 && size >= 0 && size != p->hdr.size)
+        return false;
+    if (s->mime_type && inner->mime_type &&
+        bstrcasecmp0(bstr0(s->mime_type), inner->mime_type) != 0)
+        return false;
+    return true;
+}
+
+static bool open_inner(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (!p->inner && !p->inner_failed) {
+        MP_VERBOSE(s, "Leaving cached head, opening %s\n", p->url);
+        p->inner = stream_create(p->url, p->flags, s->cancel, s->global);
+        // The data read from the head so far can't be taken back, so all that
+        // can be done is failing, and not using the cache file again.
+        if (p->inner && !p->writing && p->file && !is_same_stream(s, p->inner)) {
+            MP_ERR(s, "Stream changed since its head was cached, discarding "
+                   "%s.\n", p->path);
+            unlink(p->path);
+            free_stream(p->inner);
+            p->inner = NULL;
+        }
+        p->inner_failed = !p->inner;
+    }
+    return p->inner;
+}
+
+static int fill_buffer(struct stream *s, void *buffer, int len)
+{
+    struct priv *p = s->priv;
+
+    if (!p->writing && p->file && s->pos < p->hdr.head_len) {
+        len = MPMIN(len, p->hdr.head_len - s->pos);
+        if (fseek(p->file, p->data_offset + s->pos, SEEK_SET) != 0)
+            return -1;
+        size_t res = fread(buffer, 1, len, p->file);
+        return res > 0 ? res : -1;
+    }
+
+    if (!open_inner(s))
+        return -1;
+    if (stream_tell(p->inner) != s->pos && !stream_seek(p->inner, s->pos))
+        return -1;
+
+    int res = stream_read_partial(p->inner, buffer, len);
+
+    // Append only what continues the cached data.
+    if (p->writing && s->pos == p->hdr.head_len) {
+        if (res <= 0) {
+            finish_writing(s); // whole stream fits into the head
+        } else {
+            int64_t n = MPMIN(res, p->head_max - p->hdr.head_len);
+            if (fwrite(buffer, n, 1, p->file) != 1) {
+                abort_writing(s);
+            } else {
+                p->hdr.head_len += n;
+                if (p->hdr.head_len >= p->head_max)
+                    finish_writing(s);
+            }
+        }
+    }
+
+    return res;
+}
+
+static int seek(struct stream *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+
+    // Reads from the cached head seek the file in fill_buffer().
+    if (!p->writing && p->file && newpos < p->hdr.head_len)
+        return 1;
+    if (!open_inner(s))
+        return 0;
+    return stream_seek(p->inner, newpos);
+}
+
+static int64_t get_size(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (p->inner)
+        return stream_get_size(p->inner);
+    return p->hdr.size;
+}
+
+static void s_close(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    abort_writing(s);
+    if (p->file)
+        fclose(p->file);
+    free_stream(p->inner);
+}
+
+static bool read_string(FILE *f, void *ta_ctx, uint32_t len, char **out)
+{
+    *out = NULL;
+    if (!len)
+        return true;
+    if (len > 64 * 1024)
+        return false;
+    char *str = talloc_zero_size(ta_ctx, len + 1);
+    *out = str;
+    return fread(str, len, 1, f) == 1;
+}
+
+// Open an existing cache file for url. Returns false if there is none.
+static bool open_cached(struct stream *s, const char *path)
+{
+    struct priv *p = s->priv;
+
+    p->file = fopen(path, "rb");
+    if (!p->file)
+        return false;
+
+    char *url = NULL, *mime = NULL;
+    if (!read_header(p->file, &p->hdr) ||
+        memcmp(p->hdr.magic, HEADCACHE_MAGIC, sizeof(p->hdr.magic)) != 0 ||
+        !read_string(p->file, s, p->hdr.url_len, &url) ||
+        !read_string(p->file, s, p->hdr.mime_len, &mime) ||
+        !url || strcmp(url, p->url) != 0 || p->hdr.head_len <= 0)
+    {
+        MP_VERBOSE(s, "Ignoring invalid head cache file %s.\n", path);
+        fclose(p->file);
+        p->file = NULL;
+        return false;
+    }
+
+    p->data_offset = ftell(p->file);
+    s->mime_type = mime;
+    s->streaming = p->hdr.streaming;
+    s->is_network = p->hdr.is_network;
+    s->seekable = true;
+
+    // Mark it as recently used for stream_headcache_trim().
+    utime(path, NULL);
+
+    MP_VERBOSE(s, "Using %"PRId64" cached bytes from %s.\n", p->hdr.head_len,
+               path);
+    return true;
+}
+
+static bool start_writing(struct stream *s, const char *path)
+{
+    struct priv *p = s->priv;
+    struct stream *inner = p->inner;
+
+    p->tmp_path = talloc_asprintf(s, "%s.tmp", path);
+    p->file = fopen(p->tmp_path, "wb");
+    if (!p->file)
+        return false;
+
+    const char *mime = inner->mime_type ? inner->mime_type : "";
+    p->hdr = (struct headcache_header){
+        .magic = HEADCACHE_MAGIC,
+        .size = -1,
+        .url_len = strlen(p->url),
+        .mime_len = strlen(mime),
+        .streaming = inner->streaming,
+        .is_network = inner->is_network,
+    };
+    p->writing = true;
+    if (!write_header(p->file, &p->hdr) ||
+        fwrite(p->url, p->hdr.url_len, 1, p->file) != 1 ||
+        (p->hdr.mime_len && fwrite(mime, p->hdr.mime_len, 1, p->file) != 1))
+    {
+        abort_writing(s);
+        return false;
+    }
+    return true;
+}
+
+struct headcache_args {
+    const char *dir;
+    int64_t head_bytes;
+};
+
+static int open2(struct stream *stream, const struct stream_open_args *args)
+{
+    struct headcache_args *hargs = args->special_arg;
+    struct priv *p = talloc_zero(stream, struct priv);
+    stream->priv = p;
+
+    stream->fill_buffer = fill_buffer;
+    stream->get_size = get_size;
+    stream->close = s_close;
+
+    // Pretend to be the actual URL, so demuxers (e.g. HLS) resolve relative
+    // references correctly.
+    p->url = talloc_strdup(p, stream->path);
+    stream->url = talloc_strdup(stream, p->url);
+    // The read-ahead thread is put around this stream, not the inner one.
+    p->flags = args->flags & ~STREAM_READAHEAD;
+    p->head_max = hargs->head_bytes;
+
+    char *path = cache_file_name(p, hargs->dir, p->url);
+    p->path = path;
+    if (open_cached(stream, path)) {
+        stream->seek = seek;
+        return STREAM_OK;
+    }
+
+    struct stream_open_args args2 = *args;
+    args2.url = p->url;
+    args2.sinfo = NULL;
+    args2.special_arg = NULL;
+    int ret = stream_create_with_args(&args2, &p->inner);
+    if (ret != STREAM_OK)
+        return ret;
+
+    struct stream *inner = p->inner;
+    if (inner->is_directory) {
+        free_stream(inner);
+        p->inner = NULL;
+        return STREAM_ERROR;
+    }
+    stream->seekable = inner->seekable;
+    if (stream->seekable)
+        stream->seek = seek;
+    stream->stream_origin = inner->stream_origin;
+    stream->streaming = inner->streaming;
+    stream->is_network = inner->is_network;
+    stream->is_local_fs = inner->is_local_fs;
+    stream->fast_skip = inner->fast_skip;
+    stream->mime_type = inner->mime_type;
+    stream->demuxer = inner->demuxer;
+    stream->lavf_type = inner->lavf_type;
+
+    // Local files and live streams don't benefit, or can't be resumed after
+    // the cached part.
+    if (!inner->is_local_fs && inner->seekable && !inner->demuxer &&
+        p->head_max > 0)
+    {
+        mp_mkdirp(hargs->dir);
+        if (!start_writing(stream, path))
+            MP_VERBOSE(stream, "Could not create %s.\n", path);
+    }
+
+    return STREAM_OK;
+}
+
+static const stream_info_t stream_info_headcache = {
+    .name = "headcache",
+    .open2 = open2,
+    .protocols = (const char*const[]){ "headcache", NULL },
+};
+
+// Open url like stream_create(), but persist the first head_bytes of it in
+// dir, or use them from dir if they were persisted before.
+struct stream *stream_headcache_open(const char *url, int flags,
+                                     struct mp_cancel *c,
+                                     struct mpv_global *global,
+                                     const char *dir, int64_t head_bytes)
+{
+    struct headcache_args hargs = {
+        .dir = dir,
+        .head_bytes = head_bytes,
+    };
+
+    void *tmp = talloc_new(NULL);
+    struct stream_open_args sargs = {
+        .global = global,
+        .cancel = c,
+        .url = talloc_asprintf(tmp, "headcache://%s", url),
+        .flags = flags,
+        .sinfo = &stream_info_headcache,
+        .special_arg = &hargs,
+    };
+
+    struct stream *s = NULL;
+    stream_create_with_args(&sargs, &s);
+    talloc_free(tmp);
+    return s;
+}
+
+struct headcache_file {
+    char *path;
+    int64_t size;
+    time_t mtime;
+};
+
+static int compare_mtime(const void *a, const void *b)
+{
+    const struct headcache_file *f1 = a, *f2 = b;
+    return f1->mtime < f2->mtime ? -1 : (f1->mtime > f2->mtime);
+}
+
+// Delete the least recently used cache files in dir, until the total size is
+// at most max_bytes.
+void stream_headcache_trim(const char *dir, int64_t max_bytes)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+
+    void *tmp = talloc_new(NULL);
+    struct headcache_file *files = NULL;
+    int num_files = 0;
+    int64_t total = 0;
+
+    struct dirent *ep;
+    while ((ep = readdir(d))) {
+        bstr name = bstr0(ep->d_name);
+        if (!bstr_endswith0(name, HEADCACHE_EXT))
+            continue;
+        char *path = mp_path_join(tmp, dir, ep->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0)
+            continue;
+        struct headcache_file f = {path, st.st_size, st.st_mtime};
+        MP_TARRAY_APPEND(tmp, files, num_files, f);
+        total += st.st_size;
+    }
+    closedir(d);
+
+    qsort(files, num_files, sizeof(files[0]), compare_mtime);
+    for (int n = 0; n < num_files && total > max_bytes; n++) {
+        if (unlink(files[n].path) == 0)
+            total -= files[n].size;
+    }
+
+    talloc_free(tmp);
+}
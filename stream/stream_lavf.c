@@ -27,6 +27,7 @@
 #include "demux/demux.h"
 #include "misc/charset_conv.h"
 #include "misc/thread_tools.h"
+#include "osdep/threads.h"
 #include "stream.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -50,6 +51,8 @@ struct stream_lavf_params {
     char *tls_key_file;
     double timeout;
     char *http_proxy;
+    int http_parallel;
+    int64_t http_parallel_chunk_size;
 };
 
 const struct m_sub_options stream_lavf_conf = {
@@ -66,12 +69,16 @@ const struct m_sub_options stream_lavf_conf = {
         {"tls-key-file", OPT_STRING(tls_key_file), .flags = M_OPT_FILE},
         {"network-timeout", OPT_DOUBLE(timeout), M_RANGE(0, DBL_MAX)},
         {"http-proxy", OPT_STRING(http_proxy)},
+        {"http-parallel", OPT_INT(http_parallel), M_RANGE(0, 16)},
+        {"http-parallel-chunk-size", OPT_BYTE_SIZE(http_parallel_chunk_size),
+            M_RANGE(64 * 1024, 64 * 1024 * 1024)},
         {0}
     },
     .size = sizeof(struct stream_lavf_params),
     .defaults = &(const struct stream_lavf_params){
         .useragent = "libmpv",
         .timeout = 60,
+        .http_parallel_chunk_size = 2 * 1024 * 1024,
     },
 };
 
@@ -528,11 +535,380 @@ done:
     return res;
 }
 
+// --http-parallel: fetch byte ranges of the file ahead of the read position
+// over several connections, and return them in order.
+
+enum {
+    CHUNK_FREE,
+    CHUNK_QUEUED,       // waiting for a worker
+    CHUNK_LOADING,      // being read by a worker
+    CHUNK_DONE,
+    CHUNK_FAILED,
+};
+
+#define CHUNK_MAX_RETRIES 3
+
+struct parallel_chunk {
+    uint8_t *data;
+    int64_t offset;     // file position of data[0]
+    int size;           // requested size
+    int filled;         // bytes read so far (can be read while loading)
+    int state;          // CHUNK_*
+    int retries;
+    bool stale;         // left the readahead window while loading
+};
+
+struct parallel_priv {
+    struct mp_log *log;
+    char *url;
+    AVDictionary *opts;         // for opening further connections
+    struct mp_cancel *cancel;   // slave of stream->cancel; also used on close
+    AVIOContext *first_avio;    // connection from opening, taken by a worker
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    mp_thread *workers;
+    int num_workers;
+    struct parallel_chunk *chunks;
+    int num_chunks;
+    int chunk_size;
+    int64_t size;
+    int64_t pos;                // read position
+};
+
+static int parallel_interrupt_cb(void *ctx)
+{
+    struct parallel_priv *p = ctx;
+    return mp_cancel_test(p->cancel);
+}
+
+static void parallel_wakeup(void *ctx)
+{
+    struct parallel_priv *p = ctx;
+    mp_mutex_lock(&p->lock);
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+// Return the chunk containing pos, if it's queued or loaded.
+static struct parallel_chunk *parallel_find(struct parallel_priv *p, int64_t pos)
+{
+    for (int n = 0; n < p->num_chunks; n++) {
+        struct parallel_chunk *c = &p->chunks[n];
+        if (c->state != CHUNK_FREE && !c->stale && pos >= c->offset &&
+            pos < c->offset + c->size)
+            return c;
+    }
+    return NULL;
+}
+
+// Drop chunks outside of the readahead window, and queue missing ones.
+static void parallel_schedule(struct parallel_priv *p)
+{
+    int64_t first = p->pos - p->pos % p->chunk_size;
+    int64_t end = first + p->num_chunks * (int64_t)p->chunk_size;
+
+    for (int n = 0; n < p->num_chunks; n++) {
+        struct parallel_chunk *c = &p->chunks[n];
+        if (c->state == CHUNK_FREE || c->stale)
+            continue;
+        if (c->offset < first || c->offset >= end) {
+            if (c->state == CHUNK_LOADING) {
+                c->stale = true;
+            } else {
+                c->state = CHUNK_FREE;
+            }
+        }
+    }
+
+    bool queued = false;
+    for (int64_t offset = first; offset < end && offset < p->size;
+         offset += p->chunk_size)
+    {
+        if (parallel_find(p, offset))
+            continue;
+        struct parallel_chunk *c = NULL;
+        for (int n = 0; n < p->num_chunks; n++) {
+            if (p->chunks[n].state == CHUNK_FREE) {
+                c = &p->chunks[n];
+                break;
+            }
+        }
+        if (!c)
+            break;
+        *c = (struct parallel_chunk){
+            .data = c->data,
+            .offset = offset,
+            .size = MPMIN(p->chunk_size, p->size - offset),
+            .state = CHUNK_QUEUED,
+        };
+        queued = true;
+    }
+
+    if (queued)
+        mp_cond_broadcast(&p->wakeup);
+}
+
+static MP_THREAD_VOID parallel_worker(void *ptr)
+{
+    struct parallel_priv *p = ptr;
+    mp_thread_set_name("http-fetch");
+
+    AVIOContext *avio = NULL;
+    AVIOInterruptCB cb = {
+        .callback = parallel_interrupt_cb,
+        .opaque = p,
+    };
+
+    mp_mutex_lock(&p->lock);
+    while (!mp_cancel_test(p->cancel)) {
+        // Prefer the chunk needed first.
+        struct parallel_chunk *c = NULL;
+        for (int n = 0; n < p->num_chunks; n++) {
+            struct parallel_chunk *cur = &p->chunks[n];
+            if (cur->state == CHUNK_QUEUED && (!c || cur->offset < c->offset))
+                c = cur;
+        }
+        if (!c) {
+            mp_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        c->state = CHUNK_LOADING;
+        int filled = c->filled;
+        if (!avio) {
+            avio = p->first_avio;
+            p->first_avio = NULL;
+        }
+        mp_mutex_unlock(&p->lock);
+
+        bool ok = true;
+        if (!avio) {
+            AVDictionary *dict = NULL;
+            av_dict_copy(&dict, p->opts, 0);
+            ok = avio_open2(&avio, p->url, AVIO_FLAG_READ, &cb, &dict) >= 0;
+            av_dict_free(&dict);
+        }
+        ok = ok && avio_seek(avio, c->offset + filled, SEEK_SET) >= 0;
+
+        bool stale = false;
+        while (ok && !stale && filled < c->size) {
+            int r = avio_read_partial(avio, c->data + filled, c->size - filled);
+            ok = r > 0;
+            if (ok)
+                filled += r;
+
+            mp_mutex_lock(&p->lock);
+            c->filled = filled;
+            stale = c->stale;
+            mp_cond_broadcast(&p->wakeup);
+            mp_mutex_unlock(&p->lock);
+        }
+
+        // Reconnect for the next chunk.
+        if (!ok && avio)
+            avio_closep(&avio);
+
+        mp_mutex_lock(&p->lock);
+        if (c->stale) {
+            c->state = CHUNK_FREE;
+            c->stale = false;
+        } else if (ok) {
+            c->state = CHUNK_DONE;
+        } else if (c->retries++ < CHUNK_MAX_RETRIES &&
+                   !mp_cancel_test(p->cancel)) {
+            MP_VERBOSE(p, "Retrying range at %"PRId64".\n", c->offset + filled);
+            c->state = CHUNK_QUEUED;
+        } else {
+            c->state = CHUNK_FAILED;
+        }
+        mp_cond_broadcast(&p->wakeup);
+    }
+    mp_mutex_unlock(&p->lock);
+
+    if (avio)
+        avio_close(avio);
+    MP_THREAD_RETURN();
+}
+
+static int parallel_fill_buffer(stream_t *s, void *buffer, int max_len)
+{
+    struct parallel_priv *p = s->priv;
+    int res = -1;
+
+    mp_mutex_lock(&p->lock);
+    while (!mp_cancel_test(p->cancel)) {
+        if (p->pos >= p->size) {
+            res = 0;
+            break;
+        }
+        parallel_schedule(p);
+        struct parallel_chunk *c = parallel_find(p, p->pos);
+        // (A failed chunk can still have data before the point it failed.)
+        if (c && c->offset + c->filled > p->pos) {
+            int skip = p->pos - c->offset;
+            res = MPMIN(max_len, c->filled - skip);
+            memcpy(buffer, c->data + skip, res);
+            p->pos += res;
+            break;
+        }
+        if (c && c->state == CHUNK_FAILED) {
+            MP_ERR(s, "Failed to read range at %"PRId64".\n",
+                   c->offset + c->filled);
+            break;
+        }
+        mp_cond_wait(&p->wakeup, &p->lock);
+    }
+    mp_mutex_unlock(&p->lock);
+
+    return res;
+}
+
+static int parallel_seek(stream_t *s, int64_t newpos)
+{
+    struct parallel_priv *p = s->priv;
+    mp_mutex_lock(&p->lock);
+    p->pos = newpos;
+    mp_mutex_unlock(&p->lock);
+    return 1;
+}
+
+static int64_t parallel_get_size(stream_t *s)
+{
+    struct parallel_priv *p = s->priv;
+    return p->size;
+}
+
+static void parallel_close(stream_t *s)
+{
+    struct parallel_priv *p = s->priv;
+
+    mp_cancel_trigger(p->cancel);
+    for (int n = 0; n < p->num_workers; n++)
+        mp_thread_join(p->workers[n]);
+    mp_cancel_set_cb(p->cancel, NULL, NULL);
+
+    if (p->first_avio)
+        avio_close(p->first_avio);
+    av_dict_free(&p->opts);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+}
+
+static int open_parallel(stream_t *stream)
+{
+    void *temp = talloc_new(NULL);
+    struct stream_lavf_params *opts =
+        mp_get_config_group(temp, stream->global, &stream_lavf_conf);
+    int res = STREAM_UNSUPPORTED;
+    struct parallel_priv *p = NULL;
+    AVIOContext *avio = NULL;
+    AVDictionary *dict = NULL;
+
+    if (opts->http_parallel < 2 || stream->mode != STREAM_READ)
+        goto out;
+
+    p = talloc_zero(NULL, struct parallel_priv);
+    *p = (struct parallel_priv){
+        .log = stream->log,
+        .url = normalize_url(p, stream->url),
+        .cancel = mp_cancel_new(p),
+        .num_chunks = opts->http_parallel * 2,
+        .chunk_size = opts->http_parallel_chunk_size,
+    };
+    // (The first connection is used by a worker, so it needs this callback.)
+    mp_cancel_set_parent(p->cancel, stream->cancel);
+
+    av_dict_set(&p->opts, "reconnect", "1", 0);
+    av_dict_set(&p->opts, "reconnect_delay_max", "7", 0);
+    mp_setup_av_network_options(&p->opts, NULL, stream->global, stream->log);
+    // Metadata interleaved with the data can't be handled per range.
+    av_dict_set(&p->opts, "icy", "0", 0);
+
+    AVIOInterruptCB cb = {
+        .callback = parallel_interrupt_cb,
+        .opaque = p,
+    };
+    av_dict_copy(&dict, p->opts, 0);
+    if (avio_open2(&avio, p->url, AVIO_FLAG_READ, &cb, &dict) < 0) {
+        // Let the normal stream report the error.
+        MP_VERBOSE(stream, "Opening for parallel reading failed.\n");
+        goto out;
+    }
+
+    p->size = avio_size(avio);
+    if (!(avio->seekable & AVIO_SEEKABLE_NORMAL) || p->size <= 0) {
+        MP_VERBOSE(stream, "No range requests possible; not reading in "
+                   "parallel.\n");
+        goto out;
+    }
+
+    if (avio->av_class) {
+        uint8_t *mt = NULL;
+        if (av_opt_get(avio, "mime_type", AV_OPT_SEARCH_CHILDREN, &mt) >= 0) {
+            stream->mime_type = talloc_strdup(stream, mt);
+            av_free(mt);
+        }
+    }
+    p->first_avio = avio;
+    avio = NULL;
+
+    p->chunks = talloc_zero_array(p, struct parallel_chunk, p->num_chunks);
+    for (int n = 0; n < p->num_chunks; n++)
+        p->chunks[n].data = talloc_size(p, p->chunk_size);
+
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+    mp_cancel_set_cb(p->cancel, parallel_wakeup, p);
+
+    talloc_steal(stream, p);
+    stream->priv = p;
+    stream->close = parallel_close;
+
+    p->workers = talloc_zero_array(p, mp_thread, opts->http_parallel);
+    for (int n = 0; n < opts->http_parallel; n++) {
+        if (mp_thread_create(&p->workers[n], parallel_worker, p))
+            break;
+        p->num_workers = n + 1;
+    }
+    if (!p->num_workers) {
+        MP_ERR(stream, "Failed to create threads.\n");
+        parallel_close(stream);
+        stream->close = NULL;
+        stream->priv = NULL;
+        res = STREAM_ERROR;
+        goto out;
+    }
+
+    MP_VERBOSE(stream, "Reading with %d parallel connections.\n",
+               p->num_workers);
+
+    stream->seekable = true;
+    stream->seek = parallel_seek;
+    stream->fill_buffer = parallel_fill_buffer;
+    stream->get_size = parallel_get_size;
+    stream->streaming = true;
+    stream->is_network = true;
+    p = NULL;
+    res = STREAM_OK;
+
+out:
+    if (avio)
+        avio_close(avio);
+    if (p) {
+        av_dict_free(&p->opts);
+        talloc_free(p);
+    }
+    av_dict_free(&dict);
+    talloc_free(temp);
+    return res;
+}
+
 const stream_info_t stream_info_ffmpeg = {
     .name = "ffmpeg",
     .open = open_f,
     .get_protocols = get_safe_protocols,
     .can_write = true,
+    .shareable = true,
     .stream_origin = STREAM_ORIGIN_NET,
 };
 
@@ -547,3 +923,11 @@ const stream_info_t stream_info_ffmpeg_unsafe = {
     .stream_origin = STREAM_ORIGIN_UNSAFE,
     .can_write = true,
 };
+
+const stream_info_t stream_info_http_parallel = {
+    .name = "http-parallel",
+    .open = open_parallel,
+    .protocols = (const char *const[]){ "http", "https", NULL },
+    .shareable = true,
+    .stream_origin = STREAM_ORIGIN_NET,
+};
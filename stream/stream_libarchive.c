@@ -111,6 +111,8 @@ static ssize_t read_cb(struct archive *arch, void *priv, const void **buffer)
         return 0;
     if (!volume_seek(vol))
         return -1;
+    vol->mpa->buffer_volume = vol->index;
+    vol->mpa->buffer_pos = stream_tell(vol->src);
     int res = stream_read_partial(vol->src, vol->mpa->buffer,
                                   sizeof(vol->mpa->buffer));
     *buffer = vol->mpa->buffer;
@@ -456,6 +458,9 @@ struct priv {
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    // >= 0 if the entry is stored uncompressed at this offset in src, and is
+    // read directly from there.
+    int64_t direct_offset;
 };
 
 static int reopen_archive(stream_t *s)
@@ -493,6 +498,64 @@ static int reopen_archive(stream_t *s)
     return STREAM_ERROR;
 }
 
+// Check whether the current entry is stored uncompressed in the primary
+// volume. libarchive returns such data without copying it, i.e. pointing into
+// the buffer read_cb() filled, which tells the position of the data in src.
+// Consumes the first data block, so the archive has to be reopened if it's not.
+static bool find_direct_offset(stream_t *s)
+{
+    struct priv *p = s->priv;
+    struct mp_archive *mpa = p->mpa;
+    if (!p->src->seekable || p->entry_size <= 0)
+        return false;
+
+    const void *data = NULL;
+    size_t len = 0;
+    la_int64_t offset = -1;
+    locale_t oldlocale = uselocale(mpa->locale);
+    int r = archive_read_data_block(mpa->arch, &data, &len, &offset);
+    uselocale(oldlocale);
+
+    const char *buf = data;
+    if (r != ARCHIVE_OK || offset != 0 || !len || mpa->buffer_volume != 0 ||
+        buf < mpa->buffer || buf + len > mpa->buffer + sizeof(mpa->buffer))
+        return false;
+
+    int64_t pos = mpa->buffer_pos + (buf - mpa->buffer);
+    int64_t src_size = stream_get_size(p->src);
+    if (src_size >= 0 && pos + p->entry_size > src_size)
+        return false; // continued in another volume
+
+    // Verify, in case libarchive did something unexpected with the buffer.
+    void *tmp = talloc_memdup(NULL, data, len);
+    uint8_t *check = talloc_size(tmp, len);
+    bool ok = stream_seek(p->src, pos) &&
+              stream_read(p->src, check, len) == (int)len &&
+              memcmp(check, tmp, len) == 0;
+    talloc_free(tmp);
+    if (!ok)
+        return false;
+
+    p->direct_offset = pos;
+    return true;
+}
+
+static int direct_fill_buffer(stream_t *s, void *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int64_t pos = p->direct_offset + s->pos;
+    if (stream_tell(p->src) != pos && !stream_seek(p->src, pos))
+        return -1;
+    int len = MPMIN(max_len, p->entry_size - s->pos);
+    return len > 0 ? stream_read_partial(p->src, buffer, len) : 0;
+}
+
+static int direct_seek(stream_t *s, int64_t newpos)
+{
+    // direct_fill_buffer() seeks src.
+    return 1;
+}
+
 static int archive_entry_fill_buffer(stream_t *s, void *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -607,7 +670,12 @@ static int archive_entry_open(stream_t *stream)
         return STREAM_ERROR;
     }
 
+    p->direct_offset = -1;
     int r = reopen_archive(stream);
+    if (r >= STREAM_OK && !find_direct_offset(stream)) {
+        p->direct_offset = -1;
+        r = reopen_archive(stream);
+    }
     if (r < STREAM_OK) {
         archive_entry_close(stream);
         return r;
@@ -618,6 +686,15 @@ static int archive_entry_open(stream_t *stream)
         stream->seek = archive_entry_seek;
         stream->seekable = true;
     }
+    if (p->direct_offset >= 0) {
+        MP_VERBOSE(stream, "entry is stored at offset %" PRId64 ", reading it "
+                   "directly\n", p->direct_offset);
+        // libarchive is not needed anymore.
+        mp_archive_free(p->mpa);
+        p->mpa = NULL;
+        stream->fill_buffer = direct_fill_buffer;
+        stream->seek = direct_seek;
+    }
     stream->close = archive_entry_close;
     stream->get_size = archive_entry_get_size;
     stream->streaming = true;
@@ -14,6 +14,9 @@ struct mp_archive {
     struct archive *arch;
     struct stream *primary_src;
     char buffer[4096];
+    // Volume and position the data in buffer was read from.
+    int buffer_volume;
+    int64_t buffer_pos;
     int flags;
     int num_volumes; // INT_MAX if unknown (initial state)
 
@@ -0,0 +1,423 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// mirror://URL1|URL2|... opens the same data from a list of mirrors. The
+// mirrors are opened in parallel (each one started a bit later than the
+// previous one), and the first that delivers data is used. If that one stalls
+// or fails while reading, the stream switches to another mirror at the same
+// position.
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/thread_tools.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "stream.h"
+
+struct stream_mirror_opts {
+    double stagger;
+    double stall_timeout;
+};
+
+#define OPT_BASE_STRUCT struct stream_mirror_opts
+
+const struct m_sub_options stream_mirror_conf = {
+    .opts = (const struct m_option[]){
+        {"stream-mirror-stagger", OPT_DOUBLE(stagger), M_RANGE(0, 60)},
+        {"stream-mirror-stall-timeout", OPT_DOUBLE(stall_timeout),
+            M_RANGE(0, 3600)},
+        {0}
+    },
+    .size = sizeof(struct stream_mirror_opts),
+    .defaults = &(const struct stream_mirror_opts){
+        .stagger = 0.25,
+        .stall_timeout = 5,
+    },
+};
+
+struct priv {
+    struct stream_open_args args;   // for opening mirrors (url/cancel unset)
+    struct stream_mirror_opts *opts;
+    char **urls;
+    int num_urls;
+    int cur;                        // index into urls of inner
+    struct stream *inner;
+    struct mp_cancel *inner_cancel; // for inner only; slave of stream->cancel
+    int64_t size;
+
+    // Stall watchdog.
+    bool has_watchdog;
+    mp_thread watchdog;
+    mp_mutex lock;
+    mp_cond wakeup;
+    int64_t read_start;             // mp_time_ns() of current read, or 0
+    bool stalled;                   // read_start timed out
+    bool terminate;
+};
+
+struct race;
+
+struct candidate {
+    struct race *race;
+    int index;                      // start order
+    char *url;
+    struct mp_cancel *cancel;       // slave of race->cancel
+    mp_thread thread;
+    struct stream *s;               // result, NULL on failure
+};
+
+struct race {
+    struct stream_open_args args;
+    int64_t start;
+    int64_t stagger;
+    struct mp_cancel *cancel;       // slave of the parent stream's cancel
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    int winner;                     // index into cands, or -1
+    int num_failed;
+    struct candidate *cands;
+    int num_cands;
+};
+
+static void race_wakeup(void *ctx)
+{
+    struct race *r = ctx;
+    mp_mutex_lock(&r->lock);
+    mp_cond_broadcast(&r->wakeup);
+    mp_mutex_unlock(&r->lock);
+}
+
+static MP_THREAD_VOID race_thread(void *ptr)
+{
+    struct candidate *c = ptr;
+    struct race *r = c->race;
+    mp_thread_set_name("mirror-open");
+
+    // Wait for the staggered start time, or until all mirrors that were
+    // started earlier have failed.
+    mp_mutex_lock(&r->lock);
+    int64_t start = r->start + c->index * r->stagger;
+    while (!mp_cancel_test(c->cancel) && r->num_failed < c->index &&
+           mp_time_ns() < start)
+        mp_cond_timedwait_until(&r->wakeup, &r->lock, start);
+    mp_mutex_unlock(&r->lock);
+
+    struct stream *s = NULL;
+    if (!mp_cancel_test(c->cancel)) {
+        struct stream_open_args args = r->args;
+        args.url = c->url;
+        args.cancel = c->cancel;
+        stream_create_with_args(&args, &s);
+        // What matters is when the first byte arrives, not the connection.
+        if (s && (s->is_directory || stream_peek(s, 1) < 1)) {
+            free_stream(s);
+            s = NULL;
+        }
+    }
+
+    mp_mutex_lock(&r->lock);
+    c->s = s;
+    if (!s) {
+        r->num_failed++;
+    } else if (r->winner < 0) {
+        r->winner = c->index;
+    }
+    mp_cond_broadcast(&r->wakeup);
+    mp_mutex_unlock(&r->lock);
+
+    MP_THREAD_RETURN();
+}
+
+// Open the given URLs concurrently, and return the index of the first one
+// that could read data (its stream and mp_cancel are returned, the latter is
+// allocated under ta_parent), or -1.
+static int open_race(struct stream *stream, char **urls, int num_urls,
+                     void *ta_parent, struct stream **out_s,
+                     struct mp_cancel **out_cancel)
+{
+    struct priv *p = stream->priv;
+    struct race *r = talloc_zero(NULL, struct race);
+    r->args = p->args;
+    r->start = mp_time_ns();
+    r->stagger = MP_TIME_S_TO_NS(p->opts->stagger);
+    r->winner = -1;
+    mp_mutex_init(&r->lock);
+    mp_cond_init(&r->wakeup);
+    r->cancel = mp_cancel_new(r);
+    mp_cancel_set_parent(r->cancel, stream->cancel);
+    mp_cancel_set_cb(r->cancel, race_wakeup, r);
+
+    r->cands = talloc_zero_array(r, struct candidate, num_urls);
+    for (int n = 0; n < num_urls; n++) {
+        struct candidate *c = &r->cands[n];
+        *c = (struct candidate){
+            .race = r,
+            .index = n,
+            .url = urls[n],
+            .cancel = mp_cancel_new(NULL),
+        };
+        mp_cancel_set_parent(c->cancel, r->cancel);
+        if (mp_thread_create(&c->thread, race_thread, c)) {
+            talloc_free(c->cancel);
+            break;
+        }
+        r->num_cands++;
+    }
+
+    mp_mutex_lock(&r->lock);
+    // Threads that could not be created count as failed.
+    r->num_failed += num_urls - r->num_cands;
+    while (r->winner < 0 && r->num_failed < num_urls)
+        mp_cond_wait(&r->wakeup, &r->lock);
+    int winner = r->winner;
+    mp_mutex_unlock(&r->lock);
+
+    // Abort all others and wait for them to give up.
+    if (winner >= 0)
+        mp_cancel_set_parent(r->cands[winner].cancel, stream->cancel);
+    mp_cancel_trigger(r->cancel);
+    for (int n = 0; n < r->num_cands; n++) {
+        struct candidate *c = &r->cands[n];
+        mp_thread_join(c->thread);
+        if (n == winner) {
+            *out_s = c->s;
+            *out_cancel = talloc_steal(ta_parent, c->cancel);
+        } else {
+            free_stream(c->s);
+            talloc_free(c->cancel);
+        }
+    }
+
+    mp_cancel_set_cb(r->cancel, NULL, NULL);
+    mp_cond_destroy(&r->wakeup);
+    mp_mutex_destroy(&r->lock);
+    talloc_free(r);
+
+    if (winner >= 0)
+        MP_VERBOSE(stream, "Using mirror %s\n", urls[winner]);
+    return winner;
+}
+
+static void close_inner(struct priv *p)
+{
+    free_stream(p->inner);
+    p->inner = NULL;
+    TA_FREEP(&p->inner_cancel);
+}
+
+// Switch to another mirror and continue at the current position.
+static bool failover(struct stream *s)
+{
+    struct priv *p = s->priv;
+    int64_t pos = stream_tell(p->inner);
+
+    if (!p->inner->seekable || p->num_urls < 2)
+        return false;
+
+    MP_WARN(s, "Mirror %s failed, trying others.\n", p->urls[p->cur]);
+    close_inner(p);
+
+    char **urls = talloc_zero_array(NULL, char *, p->num_urls - 1);
+    for (int n = 0; n < p->num_urls - 1; n++)
+        urls[n] = p->urls[(p->cur + 1 + n) % p->num_urls];
+
+    struct stream *inner = NULL;
+    struct mp_cancel *cancel = NULL;
+    int res = open_race(s, urls, p->num_urls - 1, p, &inner, &cancel);
+    talloc_free(urls);
+    if (res < 0)
+        return false;
+
+    p->cur = (p->cur + 1 + res) % p->num_urls;
+    p->inner = inner;
+    p->inner_cancel = cancel;
+
+    if (stream_get_size(inner) != p->size || !stream_seek(inner, pos)) {
+        MP_ERR(s, "Mirror %s does not have the same data.\n", p->urls[p->cur]);
+        close_inner(p);
+        return false;
+    }
+    return true;
+}
+
+static int fill_buffer(struct stream *s, void *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+
+    while (p->inner && !mp_cancel_test(s->cancel)) {
+        mp_mutex_lock(&p->lock);
+        p->read_start = mp_time_ns();
+        p->stalled = false;
+        mp_cond_broadcast(&p->wakeup);
+        mp_mutex_unlock(&p->lock);
+
+        int res = stream_read_partial(p->inner, buffer, max_len);
+
+        mp_mutex_lock(&p->lock);
+        p->read_start = 0;
+        bool stalled = p->stalled;
+        mp_mutex_unlock(&p->lock);
+
+        if (res > 0)
+            return res;
+
+        // A short read is EOF, unless the mirror stalled or the size says
+        // there must be more data.
+        bool truncated = p->size >= 0 && stream_tell(p->inner) < p->size;
+        if (mp_cancel_test(s->cancel) || !(stalled || truncated) ||
+            !failover(s))
+            break;
+    }
+    return -1;
+}
+
+static int seek(struct stream *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    return p->inner && stream_seek(p->inner, newpos);
+}
+
+static int control(struct stream *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    return p->inner ? stream_control(p->inner, cmd, arg) : STREAM_UNSUPPORTED;
+}
+
+static int64_t get_size(struct stream *s)
+{
+    struct priv *p = s->priv;
+    return p->inner ? stream_get_size(p->inner) : p->size;
+}
+
+static MP_THREAD_VOID watchdog_thread(void *ptr)
+{
+    struct stream *s = ptr;
+    struct priv *p = s->priv;
+    mp_thread_set_name("mirror-watch");
+
+    int64_t timeout = MP_TIME_S_TO_NS(p->opts->stall_timeout);
+
+    mp_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        if (p->read_start && !p->stalled) {
+            int64_t until = p->read_start + timeout;
+            if (mp_time_ns() >= until) {
+                // Keep the lock, so that the reader can't free inner_cancel.
+                MP_WARN(s, "Mirror stalled for %.1f seconds.\n",
+                        p->opts->stall_timeout);
+                p->stalled = true;
+                mp_cancel_trigger(p->inner_cancel);
+                continue;
+            }
+            mp_cond_timedwait_until(&p->wakeup, &p->lock, until);
+        } else {
+            mp_cond_wait(&p->wakeup, &p->lock);
+        }
+    }
+    mp_mutex_unlock(&p->lock);
+
+    MP_THREAD_RETURN();
+}
+
+static void s_close(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (p->has_watchdog) {
+        mp_mutex_lock(&p->lock);
+        p->terminate = true;
+        mp_cond_broadcast(&p->wakeup);
+        mp_mutex_unlock(&p->lock);
+        mp_thread_join(p->watchdog);
+    }
+
+    close_inner(p);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+}
+
+static int open2(struct stream *stream, const struct stream_open_args *args)
+{
+    struct priv *p = talloc_zero(stream, struct priv);
+    stream->priv = p;
+
+    p->opts = mp_get_config_group(p, stream->global, &stream_mirror_conf);
+    p->args = *args;
+    p->args.sinfo = NULL;
+    p->args.special_arg = NULL;
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+
+    stream->fill_buffer = fill_buffer;
+    stream->seek = seek;
+    stream->control = control;
+    stream->get_size = get_size;
+    stream->close = s_close;
+
+    bstr rest = bstr0(stream->path);
+    while (rest.len) {
+        bstr url = bstr_splitchar(rest, &rest, '|');
+        if (bstr_endswith0(url, "|"))
+            url.len--;
+        url = bstr_strip(url);
+        if (url.len)
+            MP_TARRAY_APPEND(p, p->urls, p->num_urls, bstrto0(p, url));
+    }
+    if (!p->num_urls) {
+        MP_ERR(stream, "No mirror URLs in '%s'\n", stream->url);
+        return STREAM_ERROR;
+    }
+
+    int res = open_race(stream, p->urls, p->num_urls, p, &p->inner,
+                        &p->inner_cancel);
+    if (res < 0) {
+        MP_ERR(stream, "No mirror could be opened.\n");
+        return STREAM_ERROR;
+    }
+    p->cur = res;
+    p->size = stream_get_size(p->inner);
+
+    struct stream *inner = p->inner;
+    stream->seekable = inner->seekable;
+    stream->stream_origin = inner->stream_origin;
+    stream->streaming = inner->streaming;
+    stream->is_network = inner->is_network;
+    stream->fast_skip = inner->fast_skip;
+    stream->mime_type = talloc_strdup(stream, inner->mime_type);
+    stream->lavf_type = talloc_strdup(stream, inner->lavf_type);
+    stream->demuxer = talloc_strdup(stream, inner->demuxer);
+
+    if (p->opts->stall_timeout > 0 && p->num_urls > 1 && stream->seekable) {
+        if (mp_thread_create(&p->watchdog, watchdog_thread, stream)) {
+            MP_WARN(stream, "Could not start stall detection.\n");
+        } else {
+            p->has_watchdog = true;
+        }
+    }
+
+    return STREAM_OK;
+}
+
+const stream_info_t stream_info_mirror = {
+    .name = "mirror",
+    .open2 = open2,
+    .protocols = (const char*const[]){ "mirror", NULL },
+};
@@ -0,0 +1,573 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Read-ahead thread for streams opened with STREAM_READAHEAD
+// (--stream-readahead). A thread reads the inner stream sequentially into a
+// ring buffer, so that waiting for I/O overlaps with the demuxer parsing the
+// data read before. A seek outside of the buffered data makes the thread seek
+// the inner stream.
+
+#include <limits.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/thread_tools.h"
+#include "osdep/threads.h"
+#include "stream.h"
+
+#define READ_CHUNK (64 * 1024)
+
+struct priv {
+    struct stream *inner;   // accessed by the thread only
+    struct mp_cancel *cancel; // inner's, to abort its reads on closing
+    mp_thread thread;
+    int has_avseek;         // STREAM_CTRL_HAS_AVSEEK result of inner
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool terminate;
+    // Control run by the thread (see control()).
+    bool ctrl_pending;
+    int ctrl_cmd;
+    void *ctrl_arg;
+    int ctrl_res;
+    struct mp_tags *metadata; // new STREAM_CTRL_GET_METADATA result, or NULL
+    bool resync;        // take the next read position as pos (after AVSEEK)
+    uint8_t *ring;
+    size_t ring_size;
+    size_t start;       // index of the byte at pos in ring
+    size_t len;         // buffered bytes
+    int64_t pos;        // file position of the first buffered byte
+    bool eof;           // thread hit EOF/error at pos + len
+    bool seek_pending;  // thread has to seek the inner stream to pos
+    uint64_t gen;       // incremented on each seek, to discard stale reads
+    int64_t size;       // last stream_get_size() of inner
+};
+
+struct readahead_args {
+    struct stream *inner;
+    int64_t size;
+};
+
+static MP_THREAD_VOID readahead_thread(void *ptr)
+{
+    struct priv *p = ptr;
+    mp_thread_set_name("stream-read");
+
+    uint8_t *chunk = talloc_size(NULL, READ_CHUNK);
+
+    mp_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        if (p->ctrl_pending) {
+            int cmd = p->ctrl_cmd;
+            void *arg = p->ctrl_arg;
+            mp_mutex_unlock(&p->lock);
+
+            int r = stream_control(p->inner, cmd, arg);
+
+            mp_mutex_lock(&p->lock);
+            // The inner stream continues at an unknown byte position.
+            if (cmd == STREAM_CTRL_AVSEEK && r == STREAM_OK) {
+                p->start = p->len = 0;
+                p->eof = false;
+                p->seek_pending = false;
+                p->resync = true;
+                p->gen++;
+            }
+            p->ctrl_res = r;
+            p->ctrl_pending = false;
+            mp_cond_broadcast(&p->wakeup);
+            continue;
+        }
+
+        if (p->seek_pending) {
+            int64_t target = p->pos;
+            uint64_t gen = p->gen;
+            p->seek_pending = false;
+            mp_mutex_unlock(&p->lock);
+
+            bool ok = stream_seek(p->inner, target);
+
+            mp_mutex_lock(&p->lock);
+            if (gen == p->gen)
+                p->eof = !ok;
+            mp_cond_broadcast(&p->wakeup);
+            continue;
+        }
+
+        if (p->eof || p->ring_size - p->len < READ_CHUNK) {
+            mp_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+
+        uint64_t gen = p->gen;
+        mp_mutex_unlock(&p->lock);
+
+        int r = stream_read_partial(p->inner, chunk, READ_CHUNK);
+        int64_t size = stream_get_size(p->inner);
+        // (Returns new metadata only once, e.g. on a new icy packet.)
+        struct mp_tags *tags = NULL;
+        if (stream_control(p->inner, STREAM_CTRL_GET_METADATA, &tags) != 1)
+            tags = NULL;
+
+        mp_mutex_lock(&p->lock);
+        p->size = size;
+        if (tags) {
+            talloc_free(p->metadata);
+            p->metadata = tags;
+        }
+        if (gen != p->gen)
+            continue; // seeked meanwhile, drop the data
+        if (r > 0) {
+            size_t end = (p->start + p->len) % p->ring_size;
+            size_t part = MPMIN(r, p->ring_size - end);
+            memcpy(p->ring + end, chunk, part);
+            memcpy(p->ring, chunk + part, r - part);
+            p->len += r;
+        } else {
+            p->eof = true;
+        }
+        mp_cond_broadcast(&p->wakeup);
+    }
+    mp_mutex_unlock(&p->lock);
+
+    talloc_free(chunk);
+    MP_THREAD_RETURN();
+}
+
+static int fill_buffer(struct stream *s, void *buffer, int len)
+{
+    struct priv *p = s->priv;
+
+    mp_mutex_lock(&p->lock);
+
+    if (p->resync) {
+        p->pos = s->pos;
+        p->resync = false;
+    }
+
+    if (s->pos != p->pos) {
+        if (s->pos > p->pos && s->pos <= p->pos + (int64_t)p->len) {
+            size_t skip = s->pos - p->pos;
+            p->start = (p->start + skip) % p->ring_size;
+            p->len -= skip;
+        } else {
+            p->start = p->len = 0;
+            p->eof = false;
+            p->seek_pending = true;
+            p->gen++;
+        }
+        p->pos = s->pos;
+        mp_cond_broadcast(&p->wakeup);
+    }
+
+    // (Woken up by wakeup_cancel() when cancelled.)
+    while (!p->len && !p->eof && !mp_cancel_test(p->cancel))
+        mp_cond_wait(&p->wakeup, &p->lock);
+
+    int res = MPMIN(len, p->len);
+    size_t part = MPMIN(res, p->ring_size - p->start);
+    memcpy(buffer, p->ring + p->start, part);
+    memcpy((uint8_t *)buffer + part, p->ring, res - part);
+    p->start = (p->start + res) % p->ring_size;
+    p->len -= res;
+    p->pos += res;
+    mp_cond_broadcast(&p->wakeup);
+
+    mp_mutex_unlock(&p->lock);
+    return res;
+}
+
+static int seek(struct stream *s, int64_t newpos)
+{
+    // fill_buffer() repositions the thread if needed.
+    return 1;
+}
+
+// Controls that only query state are answered from what the thread got
+// from the inner stream. Others are run by the thread between two reads, so
+// they can wait for the current read to finish.
+static int control(struct stream *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+
+    switch (cmd) {
+    case STREAM_CTRL_HAS_AVSEEK:
+        return p->has_avseek;
+    case STREAM_CTRL_GET_METADATA: {
+        mp_mutex_lock(&p->lock);
+        struct mp_tags *tags = p->metadata;
+        p->metadata = NULL;
+        mp_mutex_unlock(&p->lock);
+        if (!tags)
+            return STREAM_UNSUPPORTED;
+        *(struct mp_tags **)arg = tags;
+        return 1;
+    }
+    }
+
+    mp_mutex_lock(&p->lock);
+    p->ctrl_cmd = cmd;
+    p->ctrl_arg = arg;
+    p->ctrl_pending = true;
+    mp_cond_broadcast(&p->wakeup);
+    while (p->ctrl_pending)
+        mp_cond_wait(&p->wakeup, &p->lock);
+    int r = p->ctrl_res;
+    mp_mutex_unlock(&p->lock);
+    return r;
+}
+
+static int64_t get_size(struct stream *s)
+{
+    struct priv *p = s->priv;
+    mp_mutex_lock(&p->lock);
+    int64_t size = p->size;
+    mp_mutex_unlock(&p->lock);
+    return size;
+}
+
+static void wakeup_cancel(void *ptr)
+{
+    struct priv *p = ptr;
+    mp_mutex_lock(&p->lock);
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+// Undo the cancel setup in open2(). inner must not be used anymore (or be
+// freed already).
+static void uninit_cancel(struct priv *p)
+{
+    mp_cancel_set_cb(p->cancel, NULL, NULL);
+    TA_FREEP(&p->cancel);
+}
+
+static void s_close(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    mp_mutex_lock(&p->lock);
+    p->terminate = true;
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+    // Don't wait for a read that can take arbitrarily long.
+    mp_cancel_trigger(p->cancel);
+    mp_thread_join(p->thread);
+
+    free_stream(p->inner);
+    uninit_cancel(p);
+    talloc_free(p->metadata);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+}
+
+static int open2(struct stream *stream, const struct stream_open_args *args)
+{
+    struct readahead_args *rargs = args->special_arg;
+    struct stream *inner = rargs->inner;
+    struct priv *p = talloc_zero(stream, struct priv);
+    stream->priv = p;
+    p->inner = inner;
+    p->ring_size = MPMAX(rargs->size, READ_CHUNK * 2);
+    p->ring = talloc_size(p, p->ring_size);
+    p->pos = stream_tell(inner);
+    p->size = stream_get_size(inner);
+    p->has_avseek = stream_control(inner, STREAM_CTRL_HAS_AVSEEK, NULL);
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+
+    // Give inner its own mp_cancel, so that s_close() can abort its reads
+    // without cancelling everything else that uses the same one.
+    p->cancel = mp_cancel_new(p);
+    mp_cancel_set_parent(p->cancel, inner->cancel);
+    mp_cancel_set_cb(p->cancel, wakeup_cancel, p);
+    inner->cancel = p->cancel;
+
+    if (mp_thread_create(&p->thread, readahead_thread, p)) {
+        inner->cancel = stream->cancel;
+        uninit_cancel(p);
+        mp_cond_destroy(&p->wakeup);
+        mp_mutex_destroy(&p->lock);
+        return STREAM_ERROR;
+    }
+
+    stream->fill_buffer = fill_buffer;
+    if (inner->seekable)
+        stream->seek = seek;
+    stream->control = control;
+    stream->get_size = get_size;
+    stream->close = s_close;
+
+    stream->url = talloc_strdup(stream, inner->url);
+    stream->path = talloc_strdup(stream, inner->path);
+    stream->seekable = inner->seekable;
+    stream->stream_origin = inner->stream_origin;
+    stream->streaming = inner->streaming;
+    stream->is_network = inner->is_network;
+    stream->is_local_fs = inner->is_local_fs;
+    stream->fast_skip = inner->fast_skip;
+    stream->mime_type = inner->mime_type;
+    stream->lavf_type = inner->lavf_type;
+
+    // The position of the inner stream is owned by the thread from now on.
+    stream->pos = p->pos;
+
+    MP_VERBOSE(stream, "Reading ahead %zu bytes.\n", p->ring_size);
+    return STREAM_OK;
+}
+
+static const stream_info_t stream_info_readahead = {
+    .name = "readahead",
+    .open2 = open2,
+    .protocols = (const char*const[]){ "readahead", NULL },
+};
+
+// Wrap inner into a stream that reads up to size bytes ahead in a thread.
+// Takes ownership of inner. Returns inner itself if it can't be wrapped.
+struct stream *stream_readahead_wrap(struct stream *inner, int64_t size)
+{
+    if (inner->mode != STREAM_READ || inner->is_directory || inner->demuxer ||
+        size <= 0)
+        return inner;
+
+    struct readahead_args rargs = {
+        .inner = inner,
+        .size = MPMIN(size, INT_MAX),
+    };
+
+    void *tmp = talloc_new(NULL);
+    struct stream_open_args args = {
+        .global = inner->global,
+        .cancel = inner->cancel,
+        .url = talloc_asprintf(tmp, "readahead://%s", inner->url),
+        .flags = STREAM_READ | inner->stream_origin,
+        .sinfo = &stream_info_readahead,
+        .special_arg = &rargs,
+    };
+
+    struct stream *s = NULL;
+    stream_create_with_args(&args, &s);
+    talloc_free(tmp);
+    return s ? s : inner;
+}
+
+// Read-ahead for disc streams (stream_bluray.c, stream_dvdnav.c). These can't
+// be wrapped with stream_readahead_wrap(), because they read through the
+// navigation state of the disc library, which the stream controls access as
+// well. Instead, the stream passes its read function, which the thread calls
+// to fill a queue of blocks. A read returning <= 0 (navigation points like
+// still frames, end of title) is queued as a boundary, and the thread stops
+// there until the stream has returned it, so that the demuxer sees it at the
+// same place as without read-ahead.
+
+struct mp_disc_readahead {
+    struct stream *s;
+    int (*read)(struct stream *s, void *buf, int len);
+    struct mp_cancel *cancel; // child of s->cancel, wakes up waiting reads
+    mp_thread thread;
+
+    // Held by the thread while reading, and by the stream during controls.
+    mp_mutex nav_lock;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool terminate;
+    uint8_t *data;      // num_blocks * block_size bytes
+    int *block_len;     // return value of read() for each block
+    int block_size;
+    int num_blocks;
+    int head;           // index of the first queued block
+    int count;          // number of queued blocks
+    int head_offset;    // bytes already returned from the first block
+    bool stopped;       // a boundary is queued
+    bool paused;        // flushed, and not read since
+    uint64_t gen;       // incremented on each flush, to discard stale reads
+};
+
+static MP_THREAD_VOID disc_readahead_thread(void *ptr)
+{
+    struct mp_disc_readahead *ra = ptr;
+    mp_thread_set_name("disc-read");
+
+    mp_mutex_lock(&ra->lock);
+    while (!ra->terminate) {
+        if (ra->paused || ra->stopped || ra->count == ra->num_blocks) {
+            mp_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+
+        int idx = (ra->head + ra->count) % ra->num_blocks;
+        uint64_t gen = ra->gen;
+        mp_mutex_unlock(&ra->lock);
+
+        // Only this thread accesses the free blocks.
+        mp_mutex_lock(&ra->nav_lock);
+        int r = ra->read(ra->s, ra->data + (size_t)idx * ra->block_size,
+                         ra->block_size);
+        mp_mutex_unlock(&ra->nav_lock);
+
+        mp_mutex_lock(&ra->lock);
+        if (gen != ra->gen)
+            continue; // flushed meanwhile, drop the data
+        ra->block_len[idx] = r;
+        ra->count++;
+        if (r <= 0)
+            ra->stopped = true;
+        mp_cond_broadcast(&ra->wakeup);
+    }
+    mp_mutex_unlock(&ra->lock);
+
+    MP_THREAD_RETURN();
+}
+
+static void disc_wakeup_cancel(void *ptr)
+{
+    struct mp_disc_readahead *ra = ptr;
+    mp_mutex_lock(&ra->lock);
+    mp_cond_broadcast(&ra->wakeup);
+    mp_mutex_unlock(&ra->lock);
+}
+
+// Start reading s with read() in a thread, buffering up to size bytes in
+// blocks of block_size bytes (each read() call fills one block). Returns NULL
+// if read-ahead is disabled (size <= 0) or on failure.
+struct mp_disc_readahead *mp_disc_readahead_create(struct stream *s,
+        int (*read)(struct stream *s, void *buf, int len),
+        int block_size, int64_t size)
+{
+    if (size <= 0)
+        return NULL;
+
+    struct mp_disc_readahead *ra = talloc_zero(NULL, struct mp_disc_readahead);
+    ra->s = s;
+    ra->read = read;
+    ra->block_size = block_size;
+    ra->num_blocks = MPCLAMP(size / block_size, 2, INT_MAX / block_size);
+    ra->data = talloc_size(ra, (size_t)ra->num_blocks * block_size);
+    ra->block_len = talloc_zero_array(ra, int, ra->num_blocks);
+    mp_mutex_init(&ra->nav_lock);
+    mp_mutex_init(&ra->lock);
+    mp_cond_init(&ra->wakeup);
+    ra->cancel = mp_cancel_new(ra);
+    mp_cancel_set_parent(ra->cancel, s->cancel);
+    mp_cancel_set_cb(ra->cancel, disc_wakeup_cancel, ra);
+
+    if (mp_thread_create(&ra->thread, disc_readahead_thread, ra)) {
+        mp_cancel_set_cb(ra->cancel, NULL, NULL);
+        mp_cond_destroy(&ra->wakeup);
+        mp_mutex_destroy(&ra->lock);
+        mp_mutex_destroy(&ra->nav_lock);
+        talloc_free(ra);
+        return NULL;
+    }
+
+    MP_VERBOSE(s, "Reading ahead %zu bytes.\n",
+               (size_t)ra->num_blocks * block_size);
+    return ra;
+}
+
+// Stop the thread. Must be called before the disc library is closed.
+void mp_disc_readahead_destroy(struct mp_disc_readahead *ra)
+{
+    if (!ra)
+        return;
+
+    mp_mutex_lock(&ra->lock);
+    ra->terminate = true;
+    mp_cond_broadcast(&ra->wakeup);
+    mp_mutex_unlock(&ra->lock);
+    mp_thread_join(ra->thread);
+
+    mp_cancel_set_cb(ra->cancel, NULL, NULL);
+    mp_cond_destroy(&ra->wakeup);
+    mp_mutex_destroy(&ra->lock);
+    mp_mutex_destroy(&ra->nav_lock);
+    talloc_free(ra);
+}
+
+// Return the next data read by the thread, with the same semantics as the
+// read function passed to mp_disc_readahead_create() (for use as fill_buffer).
+int mp_disc_readahead_read(struct mp_disc_readahead *ra, void *buf, int len)
+{
+    mp_mutex_lock(&ra->lock);
+
+    if (ra->paused) {
+        ra->paused = false;
+        mp_cond_broadcast(&ra->wakeup);
+    }
+
+    // (Woken up by disc_wakeup_cancel() when cancelled.)
+    while (!ra->count && !mp_cancel_test(ra->cancel))
+        mp_cond_wait(&ra->wakeup, &ra->lock);
+
+    int res = 0;
+    if (ra->count) {
+        int block_len = ra->block_len[ra->head];
+        if (block_len > 0) {
+            res = MPMIN(len, block_len - ra->head_offset);
+            memcpy(buf, ra->data + (size_t)ra->head * ra->block_size +
+                        ra->head_offset, res);
+            ra->head_offset += res;
+        } else {
+            res = block_len;
+            ra->stopped = false;
+        }
+        if (ra->head_offset >= block_len) {
+            ra->head = (ra->head + 1) % ra->num_blocks;
+            ra->count--;
+            ra->head_offset = 0;
+        }
+        mp_cond_broadcast(&ra->wakeup);
+    }
+
+    mp_mutex_unlock(&ra->lock);
+    return res;
+}
+
+// Lock out the thread from reading, so that the disc library can be accessed
+// (e.g. by stream controls). ra can be NULL (then this does nothing).
+void mp_disc_readahead_lock(struct mp_disc_readahead *ra)
+{
+    if (ra)
+        mp_mutex_lock(&ra->nav_lock);
+}
+
+void mp_disc_readahead_unlock(struct mp_disc_readahead *ra)
+{
+    if (ra)
+        mp_mutex_unlock(&ra->nav_lock);
+}
+
+// Discard the data read ahead, after the position of the disc library was
+// changed (seeks, title changes). Must be called with the lock held. The
+// thread doesn't read again until the next mp_disc_readahead_read() call, so
+// that position queries right after the seek reflect the new position.
+void mp_disc_readahead_flush(struct mp_disc_readahead *ra)
+{
+    if (!ra)
+        return;
+
+    mp_mutex_lock(&ra->lock);
+    ra->head = ra->count = ra->head_offset = 0;
+    ra->stopped = false;
+    ra->paused = true;
+    ra->gen++;
+    mp_cond_broadcast(&ra->wakeup);
+    mp_mutex_unlock(&ra->lock);
+}
@@ -0,0 +1,333 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Process-wide cache of data read from streams (--stream-shared-cache). All
+// streams opened with STREAM_SHARED_CACHE that refer to the same file or URL
+// (and report the same size, and for local files have the same inode and
+// modification time) share an entry, which holds aligned blocks of the
+// data read by any of them. This way, e.g. an external audio track that is
+// the same file as the main stream, or a preloaded file that is being opened
+// by the player, doesn't read the same data twice. An entry lives as long as
+// any stream is using it.
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/path_utils.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
+#include "stream.h"
+
+#define SHARED_BLOCK_SIZE (64 * 1024)
+
+struct shared_block {
+    int64_t index;      // block covers index * SHARED_BLOCK_SIZE
+    int len;            // < SHARED_BLOCK_SIZE only for the last block
+    uint64_t last_use;
+    uint8_t *data;
+};
+
+// Identifies the data of an entry (besides the URL or path).
+struct shared_version {
+    int64_t size;
+    // Local files only (0 otherwise), so that a file replaced or modified in
+    // place with the same size is not served from the old data.
+    uint64_t ino;
+    int64_t mtime;
+};
+
+struct shared_entry {
+    char *key;
+    struct shared_version version;
+    int refcount;
+    // Sorted by index.
+    struct shared_block **blocks;
+    int num_blocks;
+    int64_t total_bytes;
+    int64_t max_bytes;
+    uint64_t use_counter;
+};
+
+// Protects all entries and their blocks.
+static mp_static_mutex shared_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct shared_entry **shared_entries;
+static int num_shared_entries;
+
+struct priv {
+    struct stream *inner;
+    struct shared_entry *entry;
+};
+
+struct shared_args {
+    struct stream *inner;
+    int64_t max_bytes;
+};
+
+// Return the position in entry->blocks where index is or would be inserted.
+static int find_block(struct shared_entry *e, int64_t index)
+{
+    int lo = 0, hi = e->num_blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (e->blocks[mid]->index < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static struct shared_block *get_block(struct shared_entry *e, int64_t index)
+{
+    int n = find_block(e, index);
+    if (n < e->num_blocks && e->blocks[n]->index == index) {
+        e->blocks[n]->last_use = ++e->use_counter;
+        return e->blocks[n];
+    }
+    return NULL;
+}
+
+static void evict_blocks(struct shared_entry *e)
+{
+    while (e->total_bytes > e->max_bytes && e->num_blocks) {
+        int oldest = 0;
+        for (int n = 1; n < e->num_blocks; n++) {
+            if (e->blocks[n]->last_use < e->blocks[oldest]->last_use)
+                oldest = n;
+        }
+        e->total_bytes -= e->blocks[oldest]->len;
+        talloc_free(e->blocks[oldest]);
+        MP_TARRAY_REMOVE_AT(e->blocks, e->num_blocks, oldest);
+    }
+}
+
+static void add_block(struct shared_entry *e, int64_t index, void *data,
+                      int len)
+{
+    int n = find_block(e, index);
+    if (n < e->num_blocks && e->blocks[n]->index == index)
+        return; // another stream was faster
+
+    struct shared_block *b = talloc_zero(e, struct shared_block);
+    b->index = index;
+    b->len = len;
+    b->last_use = ++e->use_counter;
+    b->data = talloc_memdup(b, data, len);
+    MP_TARRAY_INSERT_AT(e, e->blocks, e->num_blocks, n, b);
+    e->total_bytes += len;
+
+    evict_blocks(e);
+}
+
+static int fill_buffer(struct stream *s, void *buffer, int len)
+{
+    struct priv *p = s->priv;
+    struct shared_entry *e = p->entry;
+    int64_t index = s->pos / SHARED_BLOCK_SIZE;
+    int offset = s->pos % SHARED_BLOCK_SIZE;
+    int res = -1;
+
+    mp_mutex_lock(&shared_lock);
+    struct shared_block *b = get_block(e, index);
+    if (b && offset < b->len) {
+        res = MPMIN(len, b->len - offset);
+        memcpy(buffer, b->data + offset, res);
+    }
+    mp_mutex_unlock(&shared_lock);
+    if (res > 0)
+        return res;
+
+    // Read the whole block, so that it can be added. The inner stream's own
+    // buffer makes the seek cheap if it's already near.
+    int64_t start = index * SHARED_BLOCK_SIZE;
+    if (stream_tell(p->inner) != start && !stream_seek(p->inner, start))
+        return -1;
+
+    uint8_t *data = talloc_size(NULL, SHARED_BLOCK_SIZE);
+    int got = stream_read(p->inner, data, SHARED_BLOCK_SIZE);
+    if (got > offset) {
+        // A short block is valid only at the end of the file.
+        bool complete = got == SHARED_BLOCK_SIZE || start + got == e->version.size;
+        mp_mutex_lock(&shared_lock);
+        if (complete)
+            add_block(e, index, data, got);
+        mp_mutex_unlock(&shared_lock);
+        res = MPMIN(len, got - offset);
+        memcpy(buffer, data + offset, res);
+    }
+    talloc_free(data);
+
+    return res;
+}
+
+static int seek(struct stream *s, int64_t newpos)
+{
+    // fill_buffer() seeks the inner stream if needed.
+    return 1;
+}
+
+static int control(struct stream *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    return stream_control(p->inner, cmd, arg);
+}
+
+static int64_t get_size(struct stream *s)
+{
+    struct priv *p = s->priv;
+    return stream_get_size(p->inner);
+}
+
+static void s_close(struct stream *s)
+{
+    struct priv *p = s->priv;
+
+    if (p->entry) {
+        mp_mutex_lock(&shared_lock);
+        struct shared_entry *e = p->entry;
+        if (--e->refcount == 0) {
+            for (int n = 0; n < num_shared_entries; n++) {
+                if (shared_entries[n] == e) {
+                    MP_TARRAY_REMOVE_AT(shared_entries, num_shared_entries, n);
+                    break;
+                }
+            }
+            talloc_free(e);
+            if (!num_shared_entries)
+                TA_FREEP(&shared_entries);
+        }
+        mp_mutex_unlock(&shared_lock);
+    }
+
+    free_stream(p->inner);
+}
+
+static struct shared_entry *acquire_entry(const char *key,
+                                          struct shared_version version,
+                                          int64_t max_bytes)
+{
+    mp_mutex_lock(&shared_lock);
+
+    struct shared_entry *e = NULL;
+    for (int n = 0; n < num_shared_entries; n++) {
+        struct shared_entry *cur = shared_entries[n];
+        if (strcmp(cur->key, key) == 0 &&
+            cur->version.size == version.size &&
+            cur->version.ino == version.ino &&
+            cur->version.mtime == version.mtime)
+        {
+            e = cur;
+            break;
+        }
+    }
+
+    if (!e) {
+        e = talloc_zero(NULL, struct shared_entry);
+        e->key = talloc_strdup(e, key);
+        e->version = version;
+        MP_TARRAY_APPEND(NULL, shared_entries, num_shared_entries, e);
+    }
+    e->refcount++;
+    e->max_bytes = MPMAX(e->max_bytes, max_bytes);
+
+    mp_mutex_unlock(&shared_lock);
+    return e;
+}
+
+static int open2(struct stream *stream, const struct stream_open_args *args)
+{
+    struct shared_args *sargs = args->special_arg;
+    struct priv *p = talloc_zero(stream, struct priv);
+    struct stream *inner = sargs->inner;
+    stream->priv = p;
+    p->inner = inner;
+
+    stream->fill_buffer = fill_buffer;
+    stream->seek = seek;
+    stream->control = control;
+    stream->get_size = get_size;
+    stream->close = s_close;
+
+    // Local files can be referred to by different paths.
+    char *key = inner->url;
+    struct shared_version version = {.size = stream_get_size(inner)};
+    if (inner->is_local_fs) {
+        key = mp_normalize_path(p, inner->path);
+        struct stat st;
+        if (stat(key, &st) == 0) {
+            version.ino = st.st_ino;
+            version.mtime = st.st_mtime;
+        }
+    }
+    p->entry = acquire_entry(key, version, sargs->max_bytes);
+
+    stream->url = talloc_strdup(stream, inner->url);
+    stream->path = talloc_strdup(stream, inner->path);
+    stream->seekable = true;
+    stream->stream_origin = inner->stream_origin;
+    stream->streaming = inner->streaming;
+    stream->is_network = inner->is_network;
+    stream->is_local_fs = inner->is_local_fs;
+    stream->fast_skip = inner->fast_skip;
+    stream->mime_type = inner->mime_type;
+    stream->lavf_type = inner->lavf_type;
+
+    MP_VERBOSE(stream, "Sharing data of %s (%d users).\n", key,
+               p->entry->refcount);
+    return STREAM_OK;
+}
+
+static const stream_info_t stream_info_shared = {
+    .name = "shared",
+    .open2 = open2,
+    .protocols = (const char*const[]){ "shared", NULL },
+};
+
+// Wrap inner (opened with STREAM_SHARED_CACHE) into a stream that shares read
+// data with other streams for the same URL. Takes ownership of inner. Returns
+// inner itself if its data can't be shared.
+struct stream *stream_shared_wrap(struct stream *inner, int64_t max_bytes)
+{
+    if (!inner->info->shareable || inner->mode != STREAM_READ ||
+        !inner->seekable || inner->is_directory || inner->demuxer ||
+        stream_get_size(inner) <= 0 || max_bytes <= 0)
+        return inner;
+
+    struct shared_args sargs = {
+        .inner = inner,
+        .max_bytes = max_bytes,
+    };
+
+    void *tmp = talloc_new(NULL);
+    struct stream_open_args args = {
+        .global = inner->global,
+        .cancel = inner->cancel,
+        .url = talloc_asprintf(tmp, "shared://%s", inner->url),
+        .flags = STREAM_READ | inner->stream_origin,
+        .sinfo = &stream_info_shared,
+        .special_arg = &sargs,
+    };
+
+    struct stream *s = NULL;
+    stream_create_with_args(&args, &s);
+    talloc_free(tmp);
+    return s ? s : inner;
+}
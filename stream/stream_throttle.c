@@ -0,0 +1,289 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/random.h"
+#include "misc/thread_tools.h"
+#include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/timer.h"
+#include "stream.h"
+
+// Reads are split into chunks of at most this duration at the configured
+// rate, so that the data arrives smoothly, and stalls can start mid-read.
+#define CHUNK_TIME 0.05
+
+struct priv {
+    struct stream *inner;
+
+    // Parameters
+    int64_t rate;       // bytes per second, 0 for unlimited
+    double latency;     // seconds before the first byte after open/seek
+    double jitter;      // random extra delay per chunk, up to this
+    double stall_rate;  // average number of stalls per second of reading
+    double stall_time;  // duration of each stall
+    int64_t seed;       // 0 for random
+
+    mp_rand_state rnd;
+    bool need_latency;
+    int64_t rate_start; // mp_time_ns() at which rate_bytes started
+    int64_t rate_bytes;
+
+    // Statistics
+    int64_t total_bytes;
+    int num_seeks;
+    int num_stalls;
+};
+
+#define OPT_PARAM(name, field, type) \
+    {name, &m_option_type_##type, offsetof(struct priv, field)}
+
+static const struct {
+    const char *name;
+    const m_option_type_t *type;
+    size_t offset;
+} params[] = {
+    OPT_PARAM("rate", rate, byte_size),
+    OPT_PARAM("latency", latency, time),
+    OPT_PARAM("jitter", jitter, time),
+    OPT_PARAM("stalls", stall_rate, double),
+    OPT_PARAM("stall-time", stall_time, time),
+    OPT_PARAM("seed", seed, int64),
+};
+
+// Sleep for the given number of seconds. Returns false if the stream was
+// cancelled meanwhile.
+static bool delay(struct stream *s, double secs)
+{
+    if (secs <= 0)
+        return !(s->cancel && mp_cancel_test(s->cancel));
+    if (!s->cancel) {
+        mp_sleep_ns(MP_TIME_S_TO_NS(secs));
+        return true;
+    }
+    return !mp_cancel_wait(s->cancel, secs);
+}
+
+// Time at which all data read since rate_start is allowed to have arrived.
+static int64_t rate_due(struct priv *p)
+{
+    return p->rate_start + MP_TIME_S_TO_NS(p->rate_bytes / (double)p->rate);
+}
+
+static int fill_buffer(struct stream *s, void *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+
+    double wait = 0;
+    if (p->need_latency) {
+        wait += p->latency;
+        p->need_latency = false;
+    }
+    if (p->jitter > 0)
+        wait += mp_rand_next_double(&p->rnd) * p->jitter;
+
+    int len = max_len;
+    double chunk_time = CHUNK_TIME;
+    if (p->rate > 0) {
+        len = MPCLAMP(p->rate * CHUNK_TIME, 1, max_len);
+        chunk_time = len / (double)p->rate;
+    }
+
+    // Poisson process: the probability of a stall starting during this chunk.
+    if (p->stall_rate > 0 && p->stall_time > 0 &&
+        mp_rand_next_double(&p->rnd) < 1 - exp(-p->stall_rate * chunk_time))
+    {
+        MP_VERBOSE(s, "Stalling for %.2f seconds.\n", p->stall_time);
+        wait += p->stall_time;
+        p->num_stalls++;
+    }
+
+    if (wait > 0) {
+        if (!delay(s, wait))
+            return -1;
+        // Time spent waiting can't be made up by sending data faster.
+        p->rate_start = mp_time_ns();
+        p->rate_bytes = 0;
+    }
+
+    // Don't let idle time (e.g. while the cache is full) turn into a burst.
+    int64_t now = mp_time_ns();
+    if (p->rate > 0 && now - rate_due(p) > MP_TIME_S_TO_NS(CHUNK_TIME)) {
+        p->rate_start = now;
+        p->rate_bytes = 0;
+    }
+
+    int res = stream_read_partial(p->inner, buffer, len);
+    if (res <= 0)
+        return res;
+
+    p->total_bytes += res;
+    if (p->rate > 0) {
+        p->rate_bytes += res;
+        int64_t due = rate_due(p);
+        now = mp_time_ns();
+        if (due > now && !delay(s, MP_TIME_NS_TO_S(due - now)))
+            return -1;
+    }
+
+    return res;
+}
+
+static int seek(struct stream *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    p->need_latency = true;
+    p->num_seeks++;
+    return stream_seek(p->inner, newpos);
+}
+
+static int control(struct stream *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    return stream_control(p->inner, cmd, arg);
+}
+
+static int64_t get_size(struct stream *s)
+{
+    struct priv *p = s->priv;
+    return stream_get_size(p->inner);
+}
+
+static void s_close(struct stream *s)
+{
+    struct priv *p = s->priv;
+    MP_VERBOSE(s, "Read %"PRId64" bytes, %d seeks, %d stalls.\n",
+               p->total_bytes, p->num_seeks, p->num_stalls);
+    free_stream(p->inner);
+}
+
+static int parse_params(struct stream *stream)
+{
+    struct priv *p = stream->priv;
+
+    bstr proto_with_params, inner_url;
+    if (!bstr_split_tok(bstr0(stream->url), "@", &proto_with_params, &inner_url)) {
+        MP_ERR(stream, "Expected throttle://[param=value,...]@URL: '%s'\n",
+               stream->url);
+        return STREAM_ERROR;
+    }
+    if (!inner_url.len) {
+        MP_ERR(stream, "URL expected to follow 'throttle://...@': '%s'\n",
+               stream->url);
+        return STREAM_ERROR;
+    }
+    stream->path = bstrto0(stream, inner_url);
+
+    bstr rest;
+    mp_split_proto(proto_with_params, &rest);
+    while (rest.len) {
+        bstr param = bstr_strip(bstr_splitchar(rest, &rest, ','));
+        if (bstr_endswith0(param, ","))
+            param.len--;
+        if (!param.len)
+            continue;
+        bstr name, val;
+        if (!bstr_split_tok(param, "=", &name, &val)) {
+            MP_ERR(stream, "Expected param=value: '%.*s'\n", BSTR_P(param));
+            return STREAM_ERROR;
+        }
+        int n;
+        for (n = 0; n < MP_ARRAY_SIZE(params); n++) {
+            if (bstr_equals0(name, params[n].name))
+                break;
+        }
+        if (n == MP_ARRAY_SIZE(params)) {
+            MP_ERR(stream, "Unknown parameter '%.*s'\n", BSTR_P(name));
+            return STREAM_ERROR;
+        }
+        const struct m_option opt = {.type = params[n].type};
+        if (m_option_parse(stream->log, &opt, name, val,
+                           (char *)p + params[n].offset) < 0)
+            return STREAM_ERROR;
+    }
+
+    if (p->rate < 0 || p->latency < 0 || p->jitter < 0 || p->stall_rate < 0 ||
+        p->stall_time < 0)
+    {
+        MP_ERR(stream, "Parameters can't be negative: '%s'\n", stream->url);
+        return STREAM_ERROR;
+    }
+
+    return STREAM_OK;
+}
+
+static int open2(struct stream *stream, const struct stream_open_args *args)
+{
+    struct priv *p = talloc_zero(stream, struct priv);
+    stream->priv = p;
+
+    stream->fill_buffer = fill_buffer;
+    stream->seek = seek;
+    stream->control = control;
+    stream->get_size = get_size;
+    stream->close = s_close;
+
+    int res = parse_params(stream);
+    if (res != STREAM_OK)
+        return res;
+
+    p->rnd = mp_rand_seed(p->seed);
+
+    // Connection setup takes as long as a request.
+    if (!delay(stream, p->latency))
+        return STREAM_ERROR;
+    p->need_latency = true;
+
+    struct stream_open_args args2 = *args;
+    args2.url = stream->path;
+    res = stream_create_with_args(&args2, &p->inner);
+    if (res != STREAM_OK)
+        return res;
+
+    if (p->inner->is_directory) {
+        MP_FATAL(stream, "Inner stream '%s' is a directory\n", p->inner->url);
+        free_stream(p->inner);
+        return STREAM_ERROR;
+    }
+
+    struct stream *inner = p->inner;
+    stream->seekable = inner->seekable;
+    stream->stream_origin = inner->stream_origin;
+    stream->fast_skip = inner->fast_skip;
+    stream->mime_type = talloc_strdup(stream, inner->mime_type);
+    stream->lavf_type = talloc_strdup(stream, inner->lavf_type);
+    stream->demuxer = talloc_strdup(stream, inner->demuxer);
+    // Behave like a network stream, so that --cache=auto enables the cache.
+    stream->streaming = true;
+    stream->is_network = true;
+
+    return STREAM_OK;
+}
+
+const stream_info_t stream_info_throttle = {
+    .name = "throttle",
+    .open2 = open2,
+    .protocols = (const char*const[]){ "throttle", NULL },
+    .can_write = false,
+};
@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <math.h>
+#include <inttypes.h>
 
 #include <ass/ass.h>
 #include <ass/ass_types.h>
@@ -30,6 +31,7 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "options/path.h"
+#include "osdep/threads.h"
 #include "ass_mp.h"
 #include "osd.h"
 #include "stream/stream.h"
@@ -76,27 +78,89 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
     style->Italic = opts->italic;
 }
 
-void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
-                            struct mpv_global *global, struct mp_log *log)
+// Everything that goes into setting up the fonts of a library/renderer pair.
+// key identifies the setup in the handle cache.
+struct font_setup {
+    char *fonts_dir;
+    char *default_font;
+    char *config;
+    const char *family;
+    int provider;
+    const struct mp_ass_font *fonts;
+    int num_fonts;
+    char *key;
+};
+
+static void append_key(char **key, const char *s)
 {
-    void *tmp = talloc_new(NULL);
-    char *default_font = mp_find_config_file(tmp, global, "subfont.ttf");
-    char *config       = mp_find_config_file(tmp, global, "fonts.conf");
+    *key = talloc_asprintf_append(*key, "%c%s\n", s ? '+' : '-', s ? s : "");
+}
 
-    if (default_font && !mp_path_exists(default_font))
-        default_font = NULL;
+// FNV-1a, so that handles are only reused for identical font data.
+static uint64_t hash_data(uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *ptr = data;
+    for (size_t n = 0; n < size; n++)
+        h = (h ^ ptr[n]) * 0x100000001b3ULL;
+    return h;
+}
+
+static struct font_setup *get_font_setup(void *ta_parent,
+                                         struct mpv_global *global,
+                                         struct osd_style_opts *opts,
+                                         const struct mp_ass_font *fonts,
+                                         int num_fonts)
+{
+    struct font_setup *setup = talloc_zero(ta_parent, struct font_setup);
+    setup->fonts_dir = opts->fonts_dir && opts->fonts_dir[0] ?
+                       mp_get_user_path(setup, global, opts->fonts_dir) :
+                       mp_find_config_file(setup, global, "fonts");
+    setup->default_font = mp_find_config_file(setup, global, "subfont.ttf");
+    setup->config = mp_find_config_file(setup, global, "fonts.conf");
+    setup->family = opts->font;
+    setup->fonts = fonts;
+    setup->num_fonts = num_fonts;
 
-    int font_provider = ASS_FONTPROVIDER_AUTODETECT;
+    if (setup->default_font && !mp_path_exists(setup->default_font))
+        setup->default_font = NULL;
+
+    setup->provider = ASS_FONTPROVIDER_AUTODETECT;
     if (opts->font_provider == 1)
-        font_provider = ASS_FONTPROVIDER_NONE;
+        setup->provider = ASS_FONTPROVIDER_NONE;
     if (opts->font_provider == 2)
-        font_provider = ASS_FONTPROVIDER_FONTCONFIG;
+        setup->provider = ASS_FONTPROVIDER_FONTCONFIG;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int n = 0; n < num_fonts; n++) {
+        hash = hash_data(hash, fonts[n].name, strlen(fonts[n].name) + 1);
+        hash = hash_data(hash, &fonts[n].size, sizeof(fonts[n].size));
+        hash = hash_data(hash, fonts[n].data, fonts[n].size);
+    }
+
+    setup->key = talloc_asprintf(setup, "%d %d %016"PRIx64"\n", setup->provider,
+                                 num_fonts, hash);
+    append_key(&setup->key, setup->fonts_dir);
+    append_key(&setup->key, setup->default_font);
+    append_key(&setup->key, setup->config);
+    append_key(&setup->key, setup->family);
+    return setup;
+}
 
+static void set_fonts(ASS_Renderer *priv, struct font_setup *setup,
+                      struct mp_log *log)
+{
     mp_verbose(log, "Setting up fonts...\n");
-    ass_set_fonts(priv, default_font, opts->font, font_provider, config, 1);
+    ass_set_fonts(priv, setup->default_font, setup->family, setup->provider,
+                  setup->config, 1);
     mp_verbose(log, "Done.\n");
+}
 
-    talloc_free(tmp);
+void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
+                            struct mpv_global *global, struct mp_log *log)
+{
+    struct font_setup *setup = get_font_setup(NULL, global, opts, NULL, 0);
+    set_fonts(priv, setup, log);
+    talloc_free(setup);
 }
 
 static const int map_ass_level[] = {
@@ -122,22 +186,176 @@ static void message_callback(int level, const char *format, va_list va, void *ct
     mp_msg(log, level, "\n");
 }
 
-ASS_Library *mp_ass_init(struct mpv_global *global,
-                         struct osd_style_opts *opts, struct mp_log *log)
+// Released handles kept for reuse, oldest first. Each holds a renderer with
+// fonts set up, which includes fontconfig's font database - a few MB at most.
+#define MAX_IDLE_HANDLES 4
+
+static mp_static_mutex cache_lock = MP_STATIC_MUTEX_INITIALIZER;
+static mp_cond cache_wakeup = MP_STATIC_COND_INITIALIZER;
+static struct mp_ass_handle *cache_idle[MAX_IDLE_HANDLES];
+static int cache_num_idle;
+// Keys of handles being set up by mp_ass_preload_start().
+static char **cache_pending;
+static int cache_num_pending;
+
+static struct mp_ass_handle *create_handle(struct font_setup *setup,
+                                           struct mp_log *log)
 {
-    char *path = opts->fonts_dir && opts->fonts_dir[0] ?
-                 mp_get_user_path(NULL, global, opts->fonts_dir) :
-                 mp_find_config_file(NULL, global, "fonts");
     mp_dbg(log, "ASS library version: 0x%x (runtime 0x%x)\n",
            (unsigned)LIBASS_VERSION, ass_library_version());
-    ASS_Library *priv = ass_library_init();
-    if (!priv)
+    struct mp_ass_handle *h = talloc_zero(NULL, struct mp_ass_handle);
+    h->key = talloc_strdup(h, setup->key);
+    h->reusable = true;
+    h->library = ass_library_init();
+    if (!h->library)
         abort();
-    ass_set_message_cb(priv, message_callback, log);
-    if (path)
-        ass_set_fonts_dir(priv, path);
-    talloc_free(path);
-    return priv;
+    ass_set_message_cb(h->library, message_callback, log);
+    if (setup->fonts_dir)
+        ass_set_fonts_dir(h->library, setup->fonts_dir);
+    for (int n = 0; n < setup->num_fonts; n++) {
+        const struct mp_ass_font *f = &setup->fonts[n];
+        ass_add_font(h->library, (char *)f->name, (char *)f->data, f->size);
+    }
+    h->renderer = ass_renderer_init(h->library);
+    if (!h->renderer)
+        abort();
+    set_fonts(h->renderer, setup, log);
+    return h;
+}
+
+static void destroy_handle(struct mp_ass_handle *h)
+{
+    if (h->renderer)
+        ass_renderer_done(h->renderer);
+    ass_library_done(h->library);
+    talloc_free(h);
+}
+
+static int find_pending(const char *key)
+{
+    for (int n = 0; n < cache_num_pending; n++) {
+        if (strcmp(cache_pending[n], key) == 0)
+            return n;
+    }
+    return -1;
+}
+
+struct mp_ass_handle *mp_ass_acquire(struct mpv_global *global,
+                                     struct osd_style_opts *opts,
+                                     struct mp_log *log,
+                                     const struct mp_ass_font *fonts,
+                                     int num_fonts)
+{
+    struct font_setup *setup = get_font_setup(NULL, global, opts, fonts,
+                                              num_fonts);
+    struct mp_ass_handle *h = NULL;
+
+    mp_mutex_lock(&cache_lock);
+    while (1) {
+        for (int n = cache_num_idle - 1; n >= 0; n--) {
+            if (strcmp(cache_idle[n]->key, setup->key) == 0) {
+                h = cache_idle[n];
+                MP_TARRAY_REMOVE_AT(cache_idle, cache_num_idle, n);
+                break;
+            }
+        }
+        // Waiting for a preload is never slower than doing the same work.
+        if (h || find_pending(setup->key) < 0)
+            break;
+        mp_cond_wait(&cache_wakeup, &cache_lock);
+    }
+    mp_mutex_unlock(&cache_lock);
+
+    if (h) {
+        mp_verbose(log, "Reusing fonts set up earlier.\n");
+        ass_set_message_cb(h->library, message_callback, log);
+    } else {
+        h = create_handle(setup, log);
+    }
+    talloc_free(setup);
+    return h;
+}
+
+void mp_ass_release(struct mp_ass_handle *h)
+{
+    if (!h)
+        return;
+    if (!h->renderer || !h->reusable) {
+        destroy_handle(h);
+        return;
+    }
+
+    ass_set_message_cb(h->library, message_callback, NULL);
+    ass_set_extract_fonts(h->library, 0);
+    ass_set_style_overrides(h->library, NULL);
+
+    struct mp_ass_handle *old = NULL;
+    mp_mutex_lock(&cache_lock);
+    if (cache_num_idle == MAX_IDLE_HANDLES) {
+        old = cache_idle[0];
+        MP_TARRAY_REMOVE_AT(cache_idle, cache_num_idle, 0);
+    }
+    cache_idle[cache_num_idle++] = h;
+    mp_mutex_unlock(&cache_lock);
+
+    if (old)
+        destroy_handle(old);
+}
+
+struct mp_ass_preload {
+    mp_thread thread;
+    struct font_setup *setup;
+};
+
+static MP_THREAD_VOID preload_thread(void *arg)
+{
+    struct mp_ass_preload *p = arg;
+    mp_thread_set_name("ass-preload");
+
+    mp_ass_release(create_handle(p->setup, mp_null_log));
+
+    mp_mutex_lock(&cache_lock);
+    int n = find_pending(p->setup->key);
+    MP_TARRAY_REMOVE_AT(cache_pending, cache_num_pending, n);
+    if (!cache_num_pending)
+        TA_FREEP(&cache_pending);
+    mp_cond_broadcast(&cache_wakeup);
+    mp_mutex_unlock(&cache_lock);
+
+    MP_THREAD_RETURN();
+}
+
+struct mp_ass_preload *mp_ass_preload_start(struct mpv_global *global,
+                                            struct osd_style_opts *opts)
+{
+    struct mp_ass_preload *p = talloc_zero(NULL, struct mp_ass_preload);
+    p->setup = get_font_setup(p, global, opts, NULL, 0);
+
+    mp_mutex_lock(&cache_lock);
+    bool needed = find_pending(p->setup->key) < 0;
+    for (int n = 0; n < cache_num_idle; n++)
+        needed &= strcmp(cache_idle[n]->key, p->setup->key) != 0;
+    if (needed) {
+        MP_TARRAY_APPEND(NULL, cache_pending, cache_num_pending,
+                         talloc_strdup(p, p->setup->key));
+        if (mp_thread_create(&p->thread, preload_thread, p)) {
+            cache_num_pending--;
+            needed = false;
+        }
+    }
+    mp_mutex_unlock(&cache_lock);
+
+    if (!needed)
+        TA_FREEP(&p);
+    return p;
+}
+
+void mp_ass_preload_wait(struct mp_ass_preload *p)
+{
+    if (!p)
+        return;
+    mp_thread_join(p->thread);
+    talloc_free(p);
 }
 
 void mp_ass_flush_old_events(ASS_Track *track, long long ts)
@@ -21,6 +21,7 @@
 #define MPLAYER_ASS_MP_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <ass/ass.h>
 #include <ass/ass_types.h>
@@ -42,6 +43,7 @@ struct mpv_global;
 struct mp_osd_res;
 struct osd_style_opts;
 struct mp_log;
+struct mp_ass_preload;
 
 void mp_ass_flush_old_events(ASS_Track *track, long long ts);
 void mp_ass_set_style(ASS_Style *style, double res_y,
@@ -49,8 +51,46 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
 
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log);
-ASS_Library *mp_ass_init(struct mpv_global *global,
-                         struct osd_style_opts *opts, struct mp_log *log);
+
+// A library and a renderer with fonts set up. Setting up fonts is slow (mostly
+// fontconfig), so released handles are kept in a process-wide cache, and are
+// handed out again for the same font configuration and memory fonts.
+struct mp_ass_handle {
+    ASS_Library *library;
+    ASS_Renderer *renderer;     // may be destroyed and set to NULL by the user
+    // Set to false if the user changed the renderer or added fonts to the
+    // library, so that mp_ass_release() won't put it into the cache.
+    bool reusable;
+    char *key;                  // private
+};
+
+// A font added to the library before fonts are set up.
+struct mp_ass_font {
+    const char *name;
+    const void *data;
+    size_t size;
+};
+
+// Return a cached handle with the same setup, or create a new one. The fonts
+// are copied by libass. If the user enables font extraction with
+// ass_set_extract_fonts() and a track contains fonts, it must set reusable to
+// false. Style overrides and font extraction are reset on release.
+struct mp_ass_handle *mp_ass_acquire(struct mpv_global *global,
+                                     struct osd_style_opts *opts,
+                                     struct mp_log *log,
+                                     const struct mp_ass_font *fonts,
+                                     int num_fonts);
+void mp_ass_release(struct mp_ass_handle *h);
+
+// Set up fonts for opts without memory fonts on a thread, and put the result
+// into the cache. This makes fontconfig scan the system fonts and update its
+// on-disk cache early, instead of when the first subtitle is shown.
+// mp_ass_acquire() waits for a preload with the same setup to finish.
+// Returns NULL if nothing needs to be done.
+struct mp_ass_preload *mp_ass_preload_start(struct mpv_global *global,
+                                            struct osd_style_opts *opts);
+// Wait until the preload is done and free it. p can be NULL.
+void mp_ass_preload_wait(struct mp_ass_preload *p);
 
 void mp_ass_get_bb(ASS_Image *image_list, ASS_Track *track,
                    struct mp_osd_res *res, double *out_rc);
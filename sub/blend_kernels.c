@@ -0,0 +1,428 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "blend_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_NEON_SIMD 1
+#include <arm_neon.h>
+#else
+#define HAVE_NEON_SIMD 0
+#endif
+
+// The SIMD functions process a prefix of the data, and return the number of
+// pixels they handled. The rest is done by the C code.
+
+// The SIMD code divides by 255 as (x + 1 + (x >> 8)) >> 8, which is exact for
+// 0 <= x <= 255 * 255, and by 255 * 255 as (x * DIV65025_MUL) >> DIV65025_SHIFT,
+// which is exact for 0 <= x < 2^25.
+#define DIV65025_MUL 33818121
+#define DIV65025_SHIFT 41
+
+#if HAVE_X86_SIMD
+__attribute__((target("avx")))
+static int blend_f32_avx(float *dst, const float *src, const float *src_a, int w)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256 d = _mm256_loadu_ps(dst + x);
+        __m256 a = _mm256_sub_ps(one, _mm256_loadu_ps(src_a + x));
+        __m256 s = _mm256_loadu_ps(src + x);
+        _mm256_storeu_ps(dst + x, _mm256_add_ps(s, _mm256_mul_ps(d, a)));
+    }
+    return x;
+}
+
+__attribute__((target("sse")))
+static int blend_f32_sse(float *dst, const float *src, const float *src_a, int w)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128 d = _mm_loadu_ps(dst + x);
+        __m128 a = _mm_sub_ps(one, _mm_loadu_ps(src_a + x));
+        __m128 s = _mm_loadu_ps(src + x);
+        _mm_storeu_ps(dst + x, _mm_add_ps(s, _mm_mul_ps(d, a)));
+    }
+    return x;
+}
+
+// Blend 32 bytes. Unpack and pack both work within 128 bit lanes, so the order
+// of the bytes is restored.
+__attribute__((target("avx2")))
+static inline __m256i blend_u8_x32_avx2(__m256i d, __m256i s, __m256i a)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi16(1);
+    __m256i c255 = _mm256_set1_epi16(255);
+    __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero),
+                        _mm256_sub_epi16(c255, _mm256_unpacklo_epi8(a, zero)));
+    __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero),
+                        _mm256_sub_epi16(c255, _mm256_unpackhi_epi8(a, zero)));
+    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one),
+                                            _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one),
+                                            _mm256_srli_epi16(hi, 8)), 8);
+    // The sum wraps around like the uint8_t store in the C code.
+    return _mm256_add_epi8(s, _mm256_packus_epi16(lo, hi));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i blend_u8_x16_sse2(__m128i d, __m128i s, __m128i a)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi16(1);
+    __m128i c255 = _mm_set1_epi16(255);
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                 _mm_sub_epi16(c255, _mm_unpacklo_epi8(a, zero)));
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                 _mm_sub_epi16(c255, _mm_unpackhi_epi8(a, zero)));
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one),
+                                      _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one),
+                                      _mm_srli_epi16(hi, 8)), 8);
+    return _mm_add_epi8(s, _mm_packus_epi16(lo, hi));
+}
+
+__attribute__((target("avx2")))
+static int blend_u8_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *src_a,
+                         int w)
+{
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i d = _mm256_loadu_si256((__m256i *)(dst + x));
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + x));
+        __m256i a = _mm256_loadu_si256((__m256i *)(src_a + x));
+        _mm256_storeu_si256((__m256i *)(dst + x), blend_u8_x32_avx2(d, s, a));
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+static int blend_u8_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *src_a,
+                         int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i d = _mm_loadu_si128((__m128i *)(dst + x));
+        __m128i s = _mm_loadu_si128((__m128i *)(src + x));
+        __m128i a = _mm_loadu_si128((__m128i *)(src_a + x));
+        _mm_storeu_si128((__m128i *)(dst + x), blend_u8_x16_sse2(d, s, a));
+    }
+    return x;
+}
+
+// Replicate the alpha byte of each pixel to all 4 bytes.
+__attribute__((target("avx2")))
+static int blend_bgra_avx2(uint32_t *dst, const uint32_t *src, int w)
+{
+    __m256i rep = _mm256_set1_epi32(0x01010101);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i d = _mm256_loadu_si256((__m256i *)(dst + x));
+        __m256i s = _mm256_loadu_si256((__m256i *)(src + x));
+        __m256i a = _mm256_mullo_epi32(_mm256_srli_epi32(s, 24), rep);
+        _mm256_storeu_si256((__m256i *)(dst + x), blend_u8_x32_avx2(d, s, a));
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+static int blend_bgra_sse2(uint32_t *dst, const uint32_t *src, int w)
+{
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128i d = _mm_loadu_si128((__m128i *)(dst + x));
+        __m128i s = _mm_loadu_si128((__m128i *)(src + x));
+        __m128i a = _mm_srli_epi32(s, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        _mm_storeu_si128((__m128i *)(dst + x), blend_u8_x16_sse2(d, s, a));
+    }
+    return x;
+}
+
+// One component of mp_blend_ass() for 8 pixels. k is the color component
+// multiplied with the alpha, inv is 255 * 255 - v * alpha for each pixel.
+__attribute__((target("avx2")))
+static inline __m256i blend_ass_comp_avx2(__m256i v, __m256i inv, __m256i dc,
+                                          __m256i k)
+{
+    __m256i m = _mm256_set1_epi32(DIV65025_MUL);
+    __m256i num = _mm256_add_epi32(_mm256_mullo_epi32(v, k),
+                                   _mm256_mullo_epi32(dc, inv));
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(num, m), DIV65025_SHIFT);
+    __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(num, 32),
+                                                     m), DIV65025_SHIFT);
+    return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+__attribute__((target("avx2")))
+static int blend_ass_avx2(uint32_t *dst, const uint8_t *src, int w,
+                          const unsigned k[4], unsigned a)
+{
+    __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i va = _mm256_set1_epi32(a);
+    __m256i c65025 = _mm256_set1_epi32(255 * 255);
+    __m256i kb = _mm256_set1_epi32(k[0]);
+    __m256i kg = _mm256_set1_epi32(k[1]);
+    __m256i kr = _mm256_set1_epi32(k[2]);
+    __m256i ka = _mm256_set1_epi32(k[3]);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(src + x)));
+        __m256i inv = _mm256_sub_epi32(c65025, _mm256_mullo_epi32(v, va));
+        __m256i d = _mm256_loadu_si256((__m256i *)(dst + x));
+        __m256i b = blend_ass_comp_avx2(v, inv, _mm256_and_si256(d, mask), kb);
+        __m256i g = blend_ass_comp_avx2(v, inv,
+                        _mm256_and_si256(_mm256_srli_epi32(d, 8), mask), kg);
+        __m256i r = blend_ass_comp_avx2(v, inv,
+                        _mm256_and_si256(_mm256_srli_epi32(d, 16), mask), kr);
+        __m256i al = blend_ass_comp_avx2(v, inv, _mm256_srli_epi32(d, 24), ka);
+        __m256i res = _mm256_or_si256(
+            _mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(al, 24)));
+        _mm256_storeu_si256((__m256i *)(dst + x), res);
+    }
+    return x;
+}
+
+// 32 bit product of 32 bit lanes which contain values below 2^16. SSE2 has no
+// 32 bit multiplication, so combine the halves of the 16 bit product.
+__attribute__((target("sse2")))
+static inline __m128i mul_u16_sse2(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_mullo_epi16(a, b),
+                        _mm_slli_epi32(_mm_mulhi_epu16(a, b), 16));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i blend_ass_comp_sse2(__m128i v, __m128i inv, __m128i dc,
+                                          __m128i k)
+{
+    __m128i m = _mm_set1_epi32(DIV65025_MUL);
+    __m128i num = _mm_add_epi32(mul_u16_sse2(v, k), mul_u16_sse2(dc, inv));
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(num, m), DIV65025_SHIFT);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(num, 32), m),
+                                 DIV65025_SHIFT);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+__attribute__((target("sse2")))
+static int blend_ass_sse2(uint32_t *dst, const uint8_t *src, int w,
+                          const unsigned k[4], unsigned a)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i va = _mm_set1_epi32(a);
+    __m128i c65025 = _mm_set1_epi32(255 * 255);
+    __m128i kb = _mm_set1_epi32(k[0]);
+    __m128i kg = _mm_set1_epi32(k[1]);
+    __m128i kr = _mm_set1_epi32(k[2]);
+    __m128i ka = _mm_set1_epi32(k[3]);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        int32_t v4;
+        memcpy(&v4, src + x, 4);
+        __m128i v = _mm_cvtsi32_si128(v4);
+        v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+        // v * a < 2^16, so the 16 bit product is enough.
+        __m128i inv = _mm_sub_epi32(c65025, _mm_mullo_epi16(v, va));
+        __m128i d = _mm_loadu_si128((__m128i *)(dst + x));
+        __m128i b = blend_ass_comp_sse2(v, inv, _mm_and_si128(d, mask), kb);
+        __m128i g = blend_ass_comp_sse2(v, inv,
+                        _mm_and_si128(_mm_srli_epi32(d, 8), mask), kg);
+        __m128i r = blend_ass_comp_sse2(v, inv,
+                        _mm_and_si128(_mm_srli_epi32(d, 16), mask), kr);
+        __m128i al = blend_ass_comp_sse2(v, inv, _mm_srli_epi32(d, 24), ka);
+        __m128i res = _mm_or_si128(
+            _mm_or_si128(b, _mm_slli_epi32(g, 8)),
+            _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(al, 24)));
+        _mm_storeu_si128((__m128i *)(dst + x), res);
+    }
+    return x;
+}
+#endif
+
+#if HAVE_NEON_SIMD
+static int blend_f32_neon(float *dst, const float *src, const float *src_a, int w)
+{
+    float32x4_t one = vdupq_n_f32(1.0f);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        float32x4_t d = vld1q_f32(dst + x);
+        float32x4_t a = vsubq_f32(one, vld1q_f32(src_a + x));
+        vst1q_f32(dst + x, vaddq_f32(vld1q_f32(src + x), vmulq_f32(d, a)));
+    }
+    return x;
+}
+
+static inline uint8x16_t blend_u8_x16_neon(uint8x16_t d, uint8x16_t s,
+                                           uint8x16_t a)
+{
+    uint16x8_t one = vdupq_n_u16(1);
+    uint8x16_t ia = vmvnq_u8(a); // 255 - a
+    uint16x8_t lo = vmull_u8(vget_low_u8(d), vget_low_u8(ia));
+    uint16x8_t hi = vmull_u8(vget_high_u8(d), vget_high_u8(ia));
+    lo = vaddq_u16(vaddq_u16(lo, one), vshrq_n_u16(lo, 8));
+    hi = vaddq_u16(vaddq_u16(hi, one), vshrq_n_u16(hi, 8));
+    return vaddq_u8(s, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+}
+
+static int blend_u8_neon(uint8_t *dst, const uint8_t *src, const uint8_t *src_a,
+                         int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16_t r = blend_u8_x16_neon(vld1q_u8(dst + x), vld1q_u8(src + x),
+                                         vld1q_u8(src_a + x));
+        vst1q_u8(dst + x, r);
+    }
+    return x;
+}
+
+static int blend_bgra_neon(uint32_t *dst, const uint32_t *src, int w)
+{
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        uint32x4_t s = vld1q_u32(src + x);
+        uint32x4_t a = vmulq_n_u32(vshrq_n_u32(s, 24), 0x01010101);
+        uint8x16_t r = blend_u8_x16_neon(vreinterpretq_u8_u32(vld1q_u32(dst + x)),
+                                         vreinterpretq_u8_u32(s),
+                                         vreinterpretq_u8_u32(a));
+        vst1q_u32(dst + x, vreinterpretq_u32_u8(r));
+    }
+    return x;
+}
+#endif
+
+void mp_blend_f32(float *dst, const float *src, const float *src_a, int w)
+{
+    int x = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX) {
+        x = blend_f32_avx(dst, src, src_a, w);
+    } else if (flags & AV_CPU_FLAG_SSE) {
+        x = blend_f32_sse(dst, src, src_a, w);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = blend_f32_neon(dst, src, src_a, w);
+#endif
+    for (; x < w; x++)
+        dst[x] = src[x] + dst[x] * (1.0f - src_a[x]);
+}
+
+void mp_blend_u8(uint8_t *dst, const uint8_t *src, const uint8_t *src_a, int w)
+{
+    int x = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        x = blend_u8_avx2(dst, src, src_a, w);
+    } else if (flags & AV_CPU_FLAG_SSE2) {
+        x = blend_u8_sse2(dst, src, src_a, w);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = blend_u8_neon(dst, src, src_a, w);
+#endif
+    for (; x < w; x++)
+        dst[x] = src[x] + dst[x] * (255u - src_a[x]) / 255u;
+}
+
+void mp_blend_bgra(uint32_t *dst, const uint32_t *src, int w)
+{
+    int x = 0;
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        x = blend_bgra_avx2(dst, src, w);
+    } else if (flags & AV_CPU_FLAG_SSE2) {
+        x = blend_bgra_sse2(dst, src, w);
+    }
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = blend_bgra_neon(dst, src, w);
+#endif
+    for (; x < w; x++) {
+        uint32_t srcpix = src[x];
+        uint32_t dstpix = dst[x];
+        unsigned int srcb =  srcpix        & 0xFF;
+        unsigned int srcg = (srcpix >>  8) & 0xFF;
+        unsigned int srcr = (srcpix >> 16) & 0xFF;
+        unsigned int srca = (srcpix >> 24) & 0xFF;
+        unsigned int dstb =  dstpix        & 0xFF;
+        unsigned int dstg = (dstpix >>  8) & 0xFF;
+        unsigned int dstr = (dstpix >> 16) & 0xFF;
+        unsigned int dsta = (dstpix >> 24) & 0xFF;
+        dstb = srcb + dstb * (255 - srca) / 255;
+        dstg = srcg + dstg * (255 - srca) / 255;
+        dstr = srcr + dstr * (255 - srca) / 255;
+        dsta = srca + dsta * (255 - srca) / 255;
+        dst[x] = (dstb & 0xFF) | ((dstg & 0xFF) << 8) | ((dstr & 0xFF) << 16) |
+                 (dsta << 24);
+    }
+}
+
+void mp_blend_ass(uint32_t *dst, const uint8_t *src, int w, uint32_t color)
+{
+    const unsigned int r = (color >> 24) & 0xff;
+    const unsigned int g = (color >> 16) & 0xff;
+    const unsigned int b = (color >>  8) & 0xff;
+    const unsigned int a = 0xff - (color & 0xff);
+
+    int x = 0;
+#if HAVE_X86_SIMD
+    const unsigned int k[4] = {b * a, g * a, r * a, 255 * a};
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        x = blend_ass_avx2(dst, src, w, k, a);
+    } else if (flags & AV_CPU_FLAG_SSE2) {
+        x = blend_ass_sse2(dst, src, w, k, a);
+    }
+#endif
+    for (; x < w; x++) {
+        const unsigned int v = src[x];
+        unsigned int aa = a * v;
+        uint32_t dstpix = dst[x];
+        unsigned int dstb =  dstpix        & 0xFF;
+        unsigned int dstg = (dstpix >>  8) & 0xFF;
+        unsigned int dstr = (dstpix >> 16) & 0xFF;
+        unsigned int dsta = (dstpix >> 24) & 0xFF;
+        dstb = (v * b * a   + dstb * (255 * 255 - aa)) / (255 * 255);
+        dstg = (v * g * a   + dstg * (255 * 255 - aa)) / (255 * 255);
+        dstr = (v * r * a   + dstr * (255 * 255 - aa)) / (255 * 255);
+        dsta = (aa * 255    + dsta * (255 * 255 - aa)) / (255 * 255);
+        dst[x] = dstb | (dstg << 8) | (dstr << 16) | (dsta << 24);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Inner loops of the software OSD renderer (draw_bmp.c). These use SIMD where
+// the CPU supports it (checked with av_get_cpu_flags() on every call, so
+// av_force_cpu_flags() can be used to select the C versions), and produce the
+// same results on all code paths.
+
+// Blend premultiplied src over dst, per component:
+//  dst[x] = src[x] + dst[x] * (1 - src_a[x])
+void mp_blend_f32(float *dst, const float *src, const float *src_a, int w);
+
+// Like mp_blend_f32(), but for 8 bit components, with truncating division:
+//  dst[x] = src[x] + dst[x] * (255 - src_a[x]) / 255
+void mp_blend_u8(uint8_t *dst, const uint8_t *src, const uint8_t *src_a, int w);
+
+// Blend premultiplied BGRA src over BGRA dst, with the same formula as
+// mp_blend_u8() for each component.
+void mp_blend_bgra(uint32_t *dst, const uint32_t *src, int w);
+
+// Blend a libass coverage bitmap src with the given RGBA color (libass
+// convention: inverted alpha in the low byte) over premultiplied BGRA dst.
+void mp_blend_ass(uint32_t *dst, const uint8_t *src, int w, uint32_t color);
@@ -33,6 +33,7 @@
 #include "common/recorder.h"
 #include "misc/dispatch.h"
 #include "osdep/threads.h"
+#include "video/mp_image.h"
 
 extern const struct sd_functions sd_ass;
 extern const struct sd_functions sd_lavc;
@@ -84,6 +85,36 @@ struct dec_sub {
     struct demux_packet **cached_pkts;
     int cached_pkt_pos;
     int num_cached_pkts;
+
+    // sub_preload() decodes the packets it read on this thread. Anything that
+    // would interfere with it waits for it to finish with wait_preload().
+    mp_thread preload_thread;
+    bool preload_thread_valid;
+    bool preloading;            // thread is running
+    bool preload_terminate;
+    int preload_pos;            // next cached_pkts entry the thread decodes
+    mp_cond preload_wakeup;     // signaled when preloading becomes false
+    void (*preload_wakeup_cb)(void *ctx);
+    void *preload_wakeup_ctx;
+
+    // --sub-render-ahead: after each sub_get_bitmaps() call, the thread
+    // renders the frame expected next (extrapolated from the last pts step),
+    // so the VO thread only has to pick up the result.
+    mp_thread ahead_thread;
+    bool ahead_thread_valid;
+    bool ahead_terminate;
+    mp_cond ahead_wakeup;
+    uint64_t change_id;         // incremented if rendered output may change
+    struct mp_image_params video_params;
+    double last_render_pts;
+    bool ahead_request;         // thread should render ahead_pts
+    bool ahead_done;            // ahead_res is the result for ahead_pts
+    bool ahead_unseen;          // renderer state advanced by the thread
+    struct mp_osd_res ahead_dim;
+    int ahead_format;
+    double ahead_pts;
+    uint64_t ahead_change_id;   // change_id ahead_res was rendered at
+    struct sub_bitmaps *ahead_res;
 };
 
 static void update_subtitle_speed(struct dec_sub *sub)
@@ -148,12 +179,28 @@ void sub_destroy(struct dec_sub *sub)
 {
     if (!sub)
         return;
+    if (sub->ahead_thread_valid) {
+        mp_mutex_lock(&sub->lock);
+        sub->ahead_terminate = true;
+        mp_cond_signal(&sub->ahead_wakeup);
+        mp_mutex_unlock(&sub->lock);
+        mp_thread_join(sub->ahead_thread);
+    }
+    if (sub->preload_thread_valid) {
+        mp_mutex_lock(&sub->lock);
+        sub->preload_terminate = true;
+        mp_mutex_unlock(&sub->lock);
+        mp_thread_join(sub->preload_thread);
+    }
+    talloc_free(sub->ahead_res);
     demux_set_stream_wakeup_cb(sub->sh, NULL, NULL);
     if (sub->sd) {
         sub_reset(sub);
         sub->sd->driver->uninit(sub->sd);
     }
     talloc_free(sub->sd);
+    mp_cond_destroy(&sub->ahead_wakeup);
+    mp_cond_destroy(&sub->preload_wakeup);
     mp_mutex_destroy(&sub->lock);
     talloc_free(sub);
 }
@@ -212,12 +259,15 @@ struct dec_sub *sub_create(struct mpv_global *global, struct track *track,
         .order = order,
         .last_pkt_pts = MP_NOPTS_VALUE,
         .last_vo_pts = MP_NOPTS_VALUE,
+        .last_render_pts = MP_NOPTS_VALUE,
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
     };
     sub->opts = sub->opts_cache->opts;
     sub->shared_opts = sub->shared_opts_cache->opts;
     mp_mutex_init(&sub->lock);
+    mp_cond_init(&sub->ahead_wakeup);
+    mp_cond_init(&sub->preload_wakeup);
 
     sub->sd = init_decoder(sub);
     if (sub->sd) {
@@ -253,6 +303,7 @@ static void update_segment(struct dec_sub *sub)
             MP_ERR(sub, "Can't change to new codec.\n");
         }
         sub->sd->driver->decode(sub->sd, sub->new_segment);
+        sub->change_id++;
         talloc_free(sub->new_segment);
         sub->new_segment = NULL;
     }
@@ -267,7 +318,57 @@ bool sub_can_preload(struct dec_sub *sub)
     return r;
 }
 
-void sub_preload(struct dec_sub *sub)
+#define PRELOAD_BATCH 64
+
+// Decodes the packets sub_preload() read, while the player continues. Takes
+// sub->lock for batches of packets only, so rendering and reading are not
+// blocked for long.
+static MP_THREAD_VOID preload_thread(void *arg)
+{
+    struct dec_sub *sub = arg;
+    mp_thread_set_name("sub/preload");
+
+    void (*wakeup_cb)(void *ctx) = sub->preload_wakeup_cb;
+    void *wakeup_ctx = sub->preload_wakeup_ctx;
+
+    // Once preloading is false, the lock isn't touched anymore, so the thread
+    // can be joined with the lock held.
+    bool done = false;
+    while (!done) {
+        mp_mutex_lock(&sub->lock);
+        int end = MPMIN(sub->preload_pos + PRELOAD_BATCH, sub->num_cached_pkts);
+        while (sub->preload_pos < end)
+            sub->sd->driver->decode(sub->sd, sub->cached_pkts[sub->preload_pos++]);
+        sub->change_id++;
+        done = sub->preload_terminate || sub->preload_pos == sub->num_cached_pkts;
+        if (done) {
+            sub->preloading = false;
+            mp_cond_broadcast(&sub->preload_wakeup);
+        }
+        mp_mutex_unlock(&sub->lock);
+        wakeup_cb(wakeup_ctx);
+    }
+
+    MP_THREAD_RETURN();
+}
+
+// Called locked. Wait until all preloaded packets were decoded.
+static void wait_preload(struct dec_sub *sub)
+{
+    while (sub->preloading)
+        mp_cond_wait(&sub->preload_wakeup, &sub->lock);
+}
+
+// Called locked. Whether everything up to pts (in subtitle time) is decoded.
+static bool preload_ready(struct dec_sub *sub, double pts)
+{
+    // Fully read demuxers return packets sorted by pts.
+    return !sub->preloading || (pts != MP_NOPTS_VALUE &&
+                                sub->cached_pkts[sub->preload_pos]->pts > pts);
+}
+
+void sub_preload(struct dec_sub *sub, void (*wakeup_cb)(void *ctx),
+                 void *wakeup_ctx)
 {
     mp_mutex_lock(&sub->lock);
 
@@ -275,7 +376,10 @@ void sub_preload(struct dec_sub *sub)
     demux_set_stream_wakeup_cb(sub->sh, wakeup_demux, demux_waiter);
 
     sub->preload_attempted = true;
+    int first = sub->num_cached_pkts;
 
+    // Reading is cheap with fully read demuxers, decoding (and with that
+    // filtering) isn't, and is done on a separate thread.
     for (;;) {
         struct demux_packet *pkt = NULL;
         int r = demux_read_packet_async(sub->sh, &pkt);
@@ -285,13 +389,33 @@ void sub_preload(struct dec_sub *sub)
         }
         if (!pkt)
             break;
-        sub->sd->driver->decode(sub->sd, pkt);
         MP_TARRAY_APPEND(sub, sub->cached_pkts, sub->num_cached_pkts, pkt);
     }
 
     demux_set_stream_wakeup_cb(sub->sh, NULL, NULL);
     talloc_free(demux_waiter);
 
+    wait_preload(sub);
+    if (sub->preload_thread_valid) {
+        mp_thread_join(sub->preload_thread);
+        sub->preload_thread_valid = false;
+    }
+    sub->preload_pos = first;
+    sub->preload_wakeup_cb = wakeup_cb;
+    sub->preload_wakeup_ctx = wakeup_ctx;
+    if (first < sub->num_cached_pkts) {
+        sub->preloading = true;
+        sub->preload_thread_valid = true;
+        if (mp_thread_create(&sub->preload_thread, preload_thread, sub)) {
+            MP_ERR(sub, "Could not create preload thread.\n");
+            sub->preload_thread_valid = false;
+            sub->preloading = false;
+            for (int n = first; n < sub->num_cached_pkts; n++)
+                sub->sd->driver->decode(sub->sd, sub->cached_pkts[n]);
+            sub->change_id++;
+        }
+    }
+
     mp_mutex_unlock(&sub->lock);
 }
 
@@ -324,7 +448,10 @@ static bool update_pkt_cache(struct dec_sub *sub, double video_pts)
 
     if (next_pts < pts || end_pts < pts) {
         if (sub->cached_pkt_pos + 1 < sub->num_cached_pkts) {
-            TA_FREEP(&sub->cached_pkts[sub->cached_pkt_pos]);
+            // (Packets the preload thread didn't decode yet are freed with
+            // the others on reset.)
+            if (!sub->preloading || sub->cached_pkt_pos < sub->preload_pos)
+                TA_FREEP(&sub->cached_pkts[sub->cached_pkt_pos]);
             pkt = NULL;
             sub->cached_pkt_pos++;
         }
@@ -394,9 +521,13 @@ void sub_read_packets(struct dec_sub *sub, double video_pts, bool force,
             break;
         }
 
-        if (!(sub->preload_attempted && sub->sd->preload_ok))
+        if (!(sub->preload_attempted && sub->sd->preload_ok)) {
             sub->sd->driver->decode(sub->sd, pkt);
+            sub->change_id++;
+        }
     }
+    if (!preload_ready(sub, video_pts))
+        *packets_read = false;
     if (sub->cached_pkts && sub->num_cached_pkts) {
         bool visible = is_packet_visible(sub->cached_pkts[sub->cached_pkt_pos], video_pts);
         *sub_updated = update_pkt_cache(sub, video_pts) || sub->sub_visible != visible;
@@ -410,14 +541,80 @@ void sub_read_packets(struct dec_sub *sub, double video_pts, bool force,
 void sub_redecode_cached_packets(struct dec_sub *sub)
 {
     mp_mutex_lock(&sub->lock);
+    wait_preload(sub);
     int index = sub->cached_pkt_pos;
     while (index < sub->num_cached_pkts) {
         sub->sd->driver->decode(sub->sd, sub->cached_pkts[index]);
         ++index;
     }
+    sub->change_id++;
     mp_mutex_unlock(&sub->lock);
 }
 
+// Called locked.
+static struct sub_bitmaps *render_bitmaps(struct dec_sub *sub,
+                                          struct mp_osd_res dim, int format,
+                                          double pts)
+{
+    if ((sub->end != MP_NOPTS_VALUE && pts >= sub->end) ||
+        !sub->sd->driver->get_bitmaps)
+        return NULL;
+    return sub->sd->driver->get_bitmaps(sub->sd, dim, format, pts);
+}
+
+static MP_THREAD_VOID ahead_thread(void *arg)
+{
+    struct dec_sub *sub = arg;
+    mp_thread_set_name("sub/render");
+
+    mp_mutex_lock(&sub->lock);
+    while (!sub->ahead_terminate) {
+        if (!sub->ahead_request) {
+            mp_cond_wait(&sub->ahead_wakeup, &sub->lock);
+            continue;
+        }
+        sub->ahead_request = false;
+        sub->ahead_res = render_bitmaps(sub, sub->ahead_dim, sub->ahead_format,
+                                        sub->ahead_pts);
+        sub->ahead_change_id = sub->change_id;
+        sub->ahead_done = true;
+        sub->ahead_unseen = true;
+    }
+    mp_mutex_unlock(&sub->lock);
+
+    MP_THREAD_RETURN();
+}
+
+// Called locked. Schedule rendering of the frame after pts.
+static void render_ahead(struct dec_sub *sub, struct mp_osd_res dim, int format,
+                         double pts)
+{
+    double last = sub->last_render_pts;
+    if (pts == last)
+        return; // same frame rendered again (redraw, screenshot, ...)
+    sub->last_render_pts = pts;
+    double step = pts - last;
+    if (last == MP_NOPTS_VALUE || !(fabs(step) < 1.0))
+        return; // seek, or no useful prediction
+
+    if (!sub->ahead_thread_valid) {
+        sub->ahead_thread_valid = true;
+        if (mp_thread_create(&sub->ahead_thread, ahead_thread, sub)) {
+            MP_ERR(sub, "Could not create render-ahead thread.\n");
+            sub->ahead_thread_valid = false;
+            return;
+        }
+    }
+
+    TA_FREEP(&sub->ahead_res);
+    sub->ahead_done = false;
+    sub->ahead_request = true;
+    sub->ahead_dim = dim;
+    sub->ahead_format = format;
+    sub->ahead_pts = pts + step;
+    mp_cond_signal(&sub->ahead_wakeup);
+}
+
 // Unref sub_bitmaps.rc to free the result. May return NULL.
 struct sub_bitmaps *sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim,
                                     int format, double pts)
@@ -431,9 +628,25 @@ struct sub_bitmaps *sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim,
 
     struct sub_bitmaps *res = NULL;
 
-    if (!(sub->end != MP_NOPTS_VALUE && pts >= sub->end) &&
-        sub->sd->driver->get_bitmaps)
-        res = sub->sd->driver->get_bitmaps(sub->sd, dim, format, pts);
+    if (sub->ahead_done && sub->ahead_pts == pts &&
+        sub->ahead_change_id == sub->change_id &&
+        sub->ahead_format == format && osd_res_equals(sub->ahead_dim, dim))
+    {
+        res = sub->ahead_res;
+        sub->ahead_res = NULL;
+        sub->ahead_done = false;
+        sub->ahead_unseen = false;
+    } else {
+        res = render_bitmaps(sub, dim, format, pts);
+        // The sd's change detection is relative to the last rendered frame,
+        // which the caller never saw if it was rendered ahead.
+        if (res && sub->ahead_unseen)
+            res->change_id += 1;
+        sub->ahead_unseen = false;
+    }
+
+    if (sub->opts->sub_render_ahead)
+        render_ahead(sub, dim, format, pts);
 
     mp_mutex_unlock(&sub->lock);
     return res;
@@ -490,10 +703,13 @@ struct sd_times sub_get_times(struct dec_sub *sub, double pts)
 void sub_reset(struct dec_sub *sub)
 {
     mp_mutex_lock(&sub->lock);
+    wait_preload(sub);
     if (sub->sd->driver->reset)
         sub->sd->driver->reset(sub->sd);
+    sub->change_id++;
     sub->last_pkt_pts = MP_NOPTS_VALUE;
     sub->last_vo_pts = MP_NOPTS_VALUE;
+    sub->last_render_pts = MP_NOPTS_VALUE;
     destroy_cached_pkts(sub);
     demux_packet_pool_push(sub->packet_pool, sub->new_segment);
     sub->new_segment = NULL;
@@ -505,6 +721,7 @@ void sub_select(struct dec_sub *sub, bool selected)
     mp_mutex_lock(&sub->lock);
     if (sub->sd->driver->select)
         sub->sd->driver->select(sub->sd, selected);
+    sub->change_id++;
     mp_mutex_unlock(&sub->lock);
 }
 
@@ -512,12 +729,26 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
 {
     int r = CONTROL_UNKNOWN;
     mp_mutex_lock(&sub->lock);
+    // These need all events, or recreate the track.
+    if (cmd == SD_CTRL_SUB_STEP || cmd == SD_CTRL_UPDATE_OPTS)
+        wait_preload(sub);
     bool propagate = false;
     switch (cmd) {
     case SD_CTRL_SET_VIDEO_DEF_FPS:
         sub->video_fps = *(double *)arg;
         update_subtitle_speed(sub);
+        sub->change_id++;
+        break;
+    case SD_CTRL_SET_VIDEO_PARAMS: {
+        // (Set on every frame.)
+        struct mp_image_params *params = arg;
+        if (!mp_image_params_equal(params, &sub->video_params)) {
+            sub->video_params = *params;
+            sub->change_id++;
+        }
+        propagate = true;
         break;
+    }
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
         double arg2[2] = {a[0], a[1]};
@@ -534,6 +765,7 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
             update_subtitle_speed(sub);
         m_config_cache_update(sub->shared_opts_cache);
         propagate = true;
+        sub->change_id++;
         if (flags & UPDATE_SUB_HARD) {
             // forget about the previous preload because
             // UPDATE_SUB_HARD will cause a sub reinit
@@ -558,6 +790,19 @@ void sub_set_recorder_sink(struct dec_sub *sub, struct mp_recorder_sink *sink)
     mp_mutex_unlock(&sub->lock);
 }
 
+// Replace the attachments (e.g. fonts) used by the decoder. They take effect
+// with the next SD_CTRL_UPDATE_OPTS/UPDATE_SUB_HARD. Ownership of attachments
+// goes to the callee.
+void sub_set_attachments(struct dec_sub *sub, struct attachment_list *attachments)
+{
+    mp_mutex_lock(&sub->lock);
+    talloc_free(sub->attachments);
+    sub->attachments = talloc_steal(sub, attachments);
+    if (sub->sd)
+        sub->sd->attachments = sub->attachments;
+    mp_mutex_unlock(&sub->lock);
+}
+
 void sub_set_play_dir(struct dec_sub *sub, int dir)
 {
     mp_mutex_lock(&sub->lock);
@@ -20,6 +20,7 @@ enum sd_ctrl {
     SD_CTRL_SET_VIDEO_PARAMS,
     SD_CTRL_SET_VIDEO_DEF_FPS,
     SD_CTRL_UPDATE_OPTS,
+    SD_CTRL_TRIM_MEMORY,
 };
 
 enum sd_text_type {
@@ -43,7 +44,11 @@ struct dec_sub *sub_create(struct mpv_global *global, struct track *track,
 void sub_destroy(struct dec_sub *sub);
 
 bool sub_can_preload(struct dec_sub *sub);
-void sub_preload(struct dec_sub *sub);
+// Read all packets, and decode them on a background thread. Until the packets
+// due at the current pts are decoded, sub_read_packets() reports that packets
+// are missing. wakeup_cb is called whenever more packets were decoded.
+void sub_preload(struct dec_sub *sub, void (*wakeup_cb)(void *ctx),
+                 void *wakeup_ctx);
 void sub_redecode_cached_packets(struct dec_sub *sub);
 void sub_read_packets(struct dec_sub *sub, double video_pts, bool force,
                       bool *packets_read, bool *sub_updated);
@@ -55,6 +60,7 @@ struct sd_times sub_get_times(struct dec_sub *sub, double pts);
 void sub_reset(struct dec_sub *sub);
 void sub_select(struct dec_sub *sub, bool selected);
 void sub_set_recorder_sink(struct dec_sub *sub, struct mp_recorder_sink *sink);
+void sub_set_attachments(struct dec_sub *sub, struct attachment_list *attachments);
 void sub_set_play_dir(struct dec_sub *sub, int dir);
 bool sub_is_primary_visible(struct dec_sub *sub);
 bool sub_is_secondary_visible(struct dec_sub *sub);
@@ -21,9 +21,13 @@
 #include <math.h>
 #include <inttypes.h>
 
+#include <libavutil/cpu.h>
+
 #include "common/common.h"
+#include "blend_kernels.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
+#include "misc/thread_pool.h"
 #include "video/mp_image.h"
 #include "video/repack.h"
 #include "video/sws_utils.h"
@@ -58,6 +62,31 @@ struct slice {
     uint16_t x0, x1;
 };
 
+#define MAX_THREADS 64
+
+// Minimum amount of libass bitmap pixels per band when rendering the overlay
+// with multiple threads. Below this, the thread overhead isn't worth it.
+#define MIN_BAND_PIXELS (16 * 1024)
+
+// Blending state for a horizontal band of the target image. Each band has its
+// own repackers and temporary images, so bands can be blended concurrently.
+// bands[0] aliases the fields in mp_draw_sub_cache.
+struct blend_band {
+    struct mp_draw_sub_cache *p;
+    struct mp_image *dst;
+    struct sub_bitmaps *sb;
+    int y0, y1;
+    void (*fn)(struct blend_band *b);
+
+    struct mp_repack *overlay_to_f32;
+    struct mp_repack *calpha_to_f32;
+    struct mp_repack *video_to_f32;
+    struct mp_repack *video_from_f32;
+    struct mp_image *overlay_tmp;
+    struct mp_image *calpha_tmp;
+    struct mp_image *video_tmp;
+};
+
 struct mp_draw_sub_cache
 {
     struct mpv_global *global;
@@ -103,34 +132,29 @@ struct mp_draw_sub_cache
     // Function that works on the _f32 data.
     void (*blend_line)(void *dst, void *src, void *src_a, int w);
 
+    int threads;                    // number of bands blended concurrently
+    struct mp_task_pool *pool;      // not a child of the cache (survives reinit)
+    struct blend_band *bands;
+    int num_bands;
+
     struct mp_image res_overlay;    // returned by mp_draw_sub_overlay()
 };
 
 static void blend_line_f32(void *dst, void *src, void *src_a, int w)
 {
-    float *dst_f = dst;
-    float *src_f = src;
-    float *src_a_f = src_a;
-
-    for (int x = 0; x < w; x++)
-        dst_f[x] = src_f[x] + dst_f[x] * (1.0f - src_a_f[x]);
+    mp_blend_f32(dst, src, src_a, w);
 }
 
 static void blend_line_u8(void *dst, void *src, void *src_a, int w)
 {
-    uint8_t *dst_i = dst;
-    uint8_t *src_i = src;
-    uint8_t *src_a_i = src_a;
-
-    for (int x = 0; x < w; x++)
-        dst_i[x] = src_i[x] + dst_i[x] * (255u - src_a_i[x]) / 255u;
+    mp_blend_u8(dst, src, src_a, w);
 }
 
-static void blend_slice(struct mp_draw_sub_cache *p)
+static void blend_slice(struct mp_draw_sub_cache *p, struct blend_band *b)
 {
-    struct mp_image *ov = p->overlay_tmp;
-    struct mp_image *ca = p->calpha_tmp;
-    struct mp_image *vid = p->video_tmp;
+    struct mp_image *ov = b->overlay_tmp;
+    struct mp_image *ca = b->calpha_tmp;
+    struct mp_image *vid = b->video_tmp;
 
     for (int plane = 0; plane < vid->num_planes; plane++) {
         int xs = vid->fmt.xs[plane];
@@ -147,18 +171,15 @@ static void blend_slice(struct mp_draw_sub_cache *p)
     }
 }
 
-static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
-                                     struct mp_image *dst)
+static void blend_band(struct blend_band *b)
 {
-    if (!repack_config_buffers(p->video_to_f32, 0, p->video_tmp, 0, dst, NULL))
-        return false;
-    if (!repack_config_buffers(p->video_from_f32, 0, dst, 0, p->video_tmp, NULL))
-        return false;
+    struct mp_draw_sub_cache *p = b->p;
+    struct mp_image *dst = b->dst;
 
     int xs = dst->fmt.chroma_xs;
     int ys = dst->fmt.chroma_ys;
 
-    for (int y = 0; y < dst->h; y += p->align_y) {
+    for (int y = b->y0; y < b->y1; y += p->align_y) {
         struct slice *line = &p->slices[y * p->s_w];
 
         for (int sx = 0; sx < p->s_w; sx++) {
@@ -173,16 +194,58 @@ static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
             mp_assert(MP_IS_ALIGNED(w, p->align_x));
             mp_assert(x + w <= p->w);
 
-            repack_line(p->overlay_to_f32, 0, 0, x, y, w);
-            repack_line(p->video_to_f32, 0, 0, x, y, w);
-            if (p->calpha_to_f32)
-                repack_line(p->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
+            repack_line(b->overlay_to_f32, 0, 0, x, y, w);
+            repack_line(b->video_to_f32, 0, 0, x, y, w);
+            if (b->calpha_to_f32)
+                repack_line(b->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
 
-            blend_slice(p);
+            blend_slice(p, b);
 
-            repack_line(p->video_from_f32, x, y, 0, 0, w);
+            repack_line(b->video_from_f32, x, y, 0, 0, w);
         }
     }
+}
+
+static void run_band_task(void *ptr, int index)
+{
+    struct mp_draw_sub_cache *p = ptr;
+    struct blend_band *b = &p->bands[index];
+    b->fn(b);
+}
+
+// Split the lines [0, h) into at most max_bands bands aligned to p->align_y,
+// and call fn on each band, concurrently if there is a worker pool.
+static void run_bands(struct mp_draw_sub_cache *p, int h, int max_bands,
+                      void (*fn)(struct blend_band *b))
+{
+    int lines = MP_ALIGN_UP(h, p->align_y) / p->align_y;
+    int num_bands = MPCLAMP(lines, 1, MPMIN(max_bands, p->num_bands));
+    int band_h = (lines + num_bands - 1) / num_bands * p->align_y;
+
+    for (int n = 0; n < num_bands; n++) {
+        struct blend_band *b = &p->bands[n];
+        b->fn = fn;
+        b->y0 = MPMIN(n * band_h, h);
+        b->y1 = MPMIN(b->y0 + band_h, h);
+    }
+
+    mp_task_pool_run_all(p->pool, MP_TASK_REALTIME, num_bands, run_band_task, p);
+}
+
+static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
+                                     struct mp_image *dst)
+{
+    for (int n = 0; n < p->num_bands; n++) {
+        struct blend_band *b = &p->bands[n];
+        if (!repack_config_buffers(b->video_to_f32, 0, b->video_tmp, 0, dst, NULL))
+            return false;
+        if (!repack_config_buffers(b->video_from_f32, 0, dst, 0, b->video_tmp, NULL))
+            return false;
+        b->dst = dst;
+    }
+
+    // Bands write disjoint lines of dst, and only read the shared overlay.
+    run_bands(p, dst->h, p->num_bands, blend_band);
 
     return true;
 }
@@ -287,8 +350,6 @@ static void mark_rect(struct mp_draw_sub_cache *p, int x0, int y0, int x1, int y
         // beyond the total width.
         struct slice *last_s = &line[p->s_w - 1];
         last_s->x1 = MPMIN(p->w - ((p->s_w - 1) * SLICE_W), last_s->x1);
-
-        p->any_osd = true;
     }
 }
 
@@ -296,70 +357,60 @@ static void draw_ass_rgba(uint8_t *dst, ptrdiff_t dst_stride,
                           uint8_t *src, ptrdiff_t src_stride,
                           int w, int h, uint32_t color)
 {
-    const unsigned int r = (color >> 24) & 0xff;
-    const unsigned int g = (color >> 16) & 0xff;
-    const unsigned int b = (color >>  8) & 0xff;
-    const unsigned int a = 0xff - (color & 0xff);
-
     for (int y = 0; y < h; y++) {
-        uint32_t *dstrow = (uint32_t *) dst;
-        for (int x = 0; x < w; x++) {
-            const unsigned int v = src[x];
-            unsigned int aa = a * v;
-            uint32_t dstpix = dstrow[x];
-            unsigned int dstb =  dstpix        & 0xFF;
-            unsigned int dstg = (dstpix >>  8) & 0xFF;
-            unsigned int dstr = (dstpix >> 16) & 0xFF;
-            unsigned int dsta = (dstpix >> 24) & 0xFF;
-            dstb = (v * b * a   + dstb * (255 * 255 - aa)) / (255 * 255);
-            dstg = (v * g * a   + dstg * (255 * 255 - aa)) / (255 * 255);
-            dstr = (v * r * a   + dstr * (255 * 255 - aa)) / (255 * 255);
-            dsta = (aa * 255    + dsta * (255 * 255 - aa)) / (255 * 255);
-            dstrow[x] = dstb | (dstg << 8) | (dstr << 16) | (dsta << 24);
-        }
+        mp_blend_ass((uint32_t *)dst, src, w, color);
         dst += dst_stride;
         src += src_stride;
     }
 }
 
-static void render_ass(struct mp_draw_sub_cache *p, struct sub_bitmaps *sb)
+// Draw the lines of all parts which are within the band. Bands write disjoint
+// lines of rgba_overlay and slices, and each band keeps the order of the parts.
+static void render_ass_band(struct blend_band *b)
 {
-    mp_assert(sb->format == SUBBITMAP_LIBASS);
+    struct mp_draw_sub_cache *p = b->p;
+    struct sub_bitmaps *sb = b->sb;
 
     for (int i = 0; i < sb->num_parts; i++) {
         struct sub_bitmap *s = &sb->parts[i];
 
-        draw_ass_rgba(mp_image_pixel_ptr(p->rgba_overlay, 0, s->x, s->y),
-                      p->rgba_overlay->stride[0], s->bitmap, s->stride,
-                      s->w, s->h, s->libass.color);
+        int y0 = MPMAX(s->y, b->y0);
+        int y1 = MPMIN(s->y + s->h, b->y1);
+        if (y0 >= y1)
+            continue;
+
+        draw_ass_rgba(mp_image_pixel_ptr(p->rgba_overlay, 0, s->x, y0),
+                      p->rgba_overlay->stride[0],
+                      (uint8_t *)s->bitmap + (y0 - s->y) * s->stride, s->stride,
+                      s->w, y1 - y0, s->libass.color);
 
-        mark_rect(p, s->x, s->y, s->x + s->w, s->y + s->h);
+        mark_rect(p, s->x, y0, s->x + s->w, y1);
     }
 }
 
+static void render_ass(struct mp_draw_sub_cache *p, struct sub_bitmaps *sb)
+{
+    mp_assert(sb->format == SUBBITMAP_LIBASS);
+
+    if (!sb->num_parts)
+        return;
+
+    int64_t pixels = 0;
+    for (int i = 0; i < sb->num_parts; i++)
+        pixels += sb->parts[i].w * (int64_t)sb->parts[i].h;
+
+    for (int n = 0; n < p->num_bands; n++)
+        p->bands[n].sb = sb;
+    run_bands(p, p->h, MPMAX(pixels / MIN_BAND_PIXELS, 1), render_ass_band);
+
+    p->any_osd = true;
+}
+
 static void draw_rgba(uint8_t *dst, ptrdiff_t dst_stride,
                       uint8_t *src, ptrdiff_t src_stride, int w, int h)
 {
     for (int y = 0; y < h; y++) {
-        uint32_t *srcrow = (uint32_t *)src;
-        uint32_t *dstrow = (uint32_t *)dst;
-        for (int x = 0; x < w; x++) {
-            uint32_t srcpix = srcrow[x];
-            uint32_t dstpix = dstrow[x];
-            unsigned int srcb =  srcpix        & 0xFF;
-            unsigned int srcg = (srcpix >>  8) & 0xFF;
-            unsigned int srcr = (srcpix >> 16) & 0xFF;
-            unsigned int srca = (srcpix >> 24) & 0xFF;
-            unsigned int dstb =  dstpix        & 0xFF;
-            unsigned int dstg = (dstpix >>  8) & 0xFF;
-            unsigned int dstr = (dstpix >> 16) & 0xFF;
-            unsigned int dsta = (dstpix >> 24) & 0xFF;
-            dstb = srcb + dstb * (255 - srca) / 255;
-            dstg = srcg + dstg * (255 - srca) / 255;
-            dstr = srcr + dstr * (255 - srca) / 255;
-            dsta = srca + dsta * (255 - srca) / 255;
-            dstrow[x] = dstb | (dstg << 8) | (dstr << 16) | (dsta << 24);
-        }
+        mp_blend_bgra((uint32_t *)dst, (uint32_t *)src, w);
         dst += dst_stride;
         src += src_stride;
     }
@@ -454,6 +505,7 @@ static bool render_rgba(struct mp_draw_sub_cache *p, struct part *part,
                   p->rgba_overlay->stride[0], s_ptr, s_stride, dw, dh);
 
         mark_rect(p, x0, y0, x1, y1);
+        p->any_osd = true;
     }
 
     return true;
@@ -508,10 +560,84 @@ static struct mp_sws_context *alloc_scaler(struct mp_draw_sub_cache *p)
     return s;
 }
 
+static struct mp_repack *create_repack(struct mp_draw_sub_cache *p, int imgfmt,
+                                       bool pack, int flags)
+{
+    return talloc_steal(p, mp_repack_create_planar(imgfmt, pack, flags));
+}
+
+static struct mp_image *alloc_tmp(struct mp_draw_sub_cache *p,
+                                  struct mp_image *like)
+{
+    struct mp_image *img =
+        talloc_steal(p, mp_image_alloc(like->imgfmt, like->w, like->h));
+    if (img) {
+        img->params.repr = like->params.repr;
+        img->params.color = like->params.color;
+    }
+    return img;
+}
+
+// Create the per-band blend state. The first band reuses the state set up by
+// reinit_to_video(), the others get copies of it.
+static bool init_bands(struct mp_draw_sub_cache *p, int rflags)
+{
+    p->bands[0] = (struct blend_band){
+        .p = p,
+        .overlay_to_f32 = p->overlay_to_f32,
+        .calpha_to_f32 = p->calpha_to_f32,
+        .video_to_f32 = p->video_to_f32,
+        .video_from_f32 = p->video_from_f32,
+        .overlay_tmp = p->overlay_tmp,
+        .calpha_tmp = p->calpha_tmp,
+        .video_tmp = p->video_tmp,
+    };
+
+    struct mp_image *overlay = p->video_overlay ? p->video_overlay
+                                                : p->rgba_overlay;
+
+    for (int n = 1; n < p->num_bands; n++) {
+        struct blend_band *b = &p->bands[n];
+
+        int overlay_fmt = mp_repack_get_format_src(p->overlay_to_f32);
+        b->overlay_to_f32 = create_repack(p, overlay_fmt, false, rflags);
+        b->video_to_f32 = create_repack(p, p->params.imgfmt, false, rflags);
+        b->video_from_f32 = create_repack(p, p->params.imgfmt, true, rflags);
+        b->overlay_tmp = alloc_tmp(p, p->overlay_tmp);
+        b->video_tmp = alloc_tmp(p, p->video_tmp);
+        if (!b->overlay_to_f32 || !b->video_to_f32 || !b->video_from_f32 ||
+            !b->overlay_tmp || !b->video_tmp)
+            return false;
+
+        if (!repack_config_buffers(b->overlay_to_f32, 0, b->overlay_tmp,
+                                   0, overlay, NULL))
+            return false;
+
+        if (p->calpha_to_f32) {
+            int calpha_fmt = mp_repack_get_format_src(p->calpha_to_f32);
+            b->calpha_to_f32 = create_repack(p, calpha_fmt, false, rflags);
+            b->calpha_tmp = alloc_tmp(p, p->calpha_tmp);
+            if (!b->calpha_to_f32 || !b->calpha_tmp)
+                return false;
+
+            if (!repack_config_buffers(b->calpha_to_f32, 0, b->calpha_tmp,
+                                       0, p->calpha_overlay, NULL))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 static void init_general(struct mp_draw_sub_cache *p)
 {
     p->sub_scale = alloc_scaler(p);
 
+    p->num_bands = p->pool ? MPCLAMP(p->threads, 1, MAX_THREADS) : 1;
+    p->bands = talloc_zero_array(p, struct blend_band, p->num_bands);
+    for (int n = 0; n < p->num_bands; n++)
+        p->bands[n].p = p;
+
     p->s_w = MP_ALIGN_UP(p->rgba_overlay->w, SLICE_W) / SLICE_W;
 
     p->slices = talloc_zero_array(p, struct slice, p->s_w * p->rgba_overlay->h);
@@ -775,6 +901,9 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
 
     init_general(p);
 
+    if (!init_bands(p, rflags))
+        return false;
+
     return true;
 }
 
@@ -816,10 +945,13 @@ static bool check_reinit(struct mp_draw_sub_cache *p,
 {
     if (!mp_image_params_equal(&p->params, params) || !p->rgba_overlay) {
         talloc_free_children(p);
-        *p = (struct mp_draw_sub_cache){.global = p->global, .params = *params};
+        *p = (struct mp_draw_sub_cache){.global = p->global, .params = *params,
+                                        .threads = p->threads, .pool = p->pool};
         if (!(to_video ? reinit_to_video(p) : reinit_to_overlay(p))) {
             talloc_free_children(p);
-            *p = (struct mp_draw_sub_cache){.global = p->global};
+            *p = (struct mp_draw_sub_cache){.global = p->global,
+                                            .threads = p->threads,
+                                            .pool = p->pool};
             return false;
         }
     }
@@ -841,13 +973,39 @@ char *mp_draw_sub_get_dbg_info(struct mp_draw_sub_cache *p)
         mp_imgfmt_to_name(p->calpha_tmp ? p->calpha_tmp->imgfmt : 0));
 }
 
+static void destroy_cache(void *ptr)
+{
+    struct mp_draw_sub_cache *p = ptr;
+    talloc_free(p->pool);
+}
+
 struct mp_draw_sub_cache *mp_draw_sub_alloc(void *ta_parent, struct mpv_global *g)
 {
     struct mp_draw_sub_cache *c = talloc_zero(ta_parent, struct mp_draw_sub_cache);
+    talloc_set_destructor(c, destroy_cache);
     c->global = g;
+    c->threads = 1;
     return c;
 }
 
+void mp_draw_sub_set_threads(struct mp_draw_sub_cache *p, int threads)
+{
+    if (threads < 1)
+        threads = av_cpu_count();
+    threads = MPCLAMP(threads, 1, MAX_THREADS);
+    if (threads == p->threads)
+        return;
+
+    // (Take the new reference first, so the workers are not restarted.)
+    struct mp_task_pool *old = p->pool;
+    p->pool = threads > 1 ? mp_task_pool_get(NULL) : NULL;
+    p->threads = threads;
+    talloc_free(old);
+
+    // Force check_reinit() to recreate the per-band state.
+    p->params = (struct mp_image_params){0};
+}
+
 // For tests.
 struct mp_draw_sub_cache *mp_draw_sub_alloc_test(struct mp_image *dst)
 {
@@ -25,6 +25,11 @@ struct mp_draw_sub_cache *mp_draw_sub_alloc_test(struct mp_image *dst);
 bool mp_draw_sub_bitmaps(struct mp_draw_sub_cache *cache, struct mp_image *dst,
                          struct sub_bitmap_list *sbs_list);
 
+// Blend OSD onto video with the given number of threads, each one working on
+// a horizontal band of the image. 0 means auto (number of CPUs). The default
+// is 1.
+void mp_draw_sub_set_threads(struct mp_draw_sub_cache *cache, int threads);
+
 char *mp_draw_sub_get_dbg_info(struct mp_draw_sub_cache *c);
 
 // Return a RGBA overlay with subtitles. The returned image uses IMGFMT_BGRA and
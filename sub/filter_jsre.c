@@ -59,6 +59,10 @@ struct priv {
     js_State *J;
     int num_regexes;
     int offset;
+    // Regexes with combined[n] set are also part of an alternation at global
+    // index num_regexes, so most lines are checked with a single test() call.
+    bool *combined;
+    bool have_all;
 };
 
 static void destruct_priv(void *p)
@@ -66,6 +70,38 @@ static void destruct_priv(void *p)
     js_freestate(((struct priv *)p)->J);
 }
 
+static void combine_regexes(struct sd_filter *ft, char **items)
+{
+    struct priv *p = ft->priv;
+    char *all = talloc_strdup(NULL, "");
+    int num = 0;
+
+    for (int n = 0; n < p->num_regexes; n++) {
+        if (!sd_filter_regex_combinable(items[n]))
+            continue;
+        all = talloc_asprintf_append_buffer(all, "%s(?:%s)", num ? "|" : "",
+                                            items[n]);
+        p->combined[n] = true;
+        num++;
+    }
+
+    // Not worth it for a single regex.
+    if (num > 1) {
+        if (p_regcomp(p->J, p->num_regexes, all, JS_REGEXP_I | JS_REGEXP_M) == 0) {
+            p->have_all = true;
+            MP_VERBOSE(ft, "jsre: combined %d of %d regexes.\n", num,
+                       p->num_regexes);
+        } else {
+            js_pop(p->J, 1);
+        }
+    }
+    if (!p->have_all) {
+        for (int n = 0; n < p->num_regexes; n++)
+            p->combined[n] = false;
+    }
+    talloc_free(all);
+}
+
 static bool jsre_init(struct sd_filter *ft)
 {
     if (strcmp(ft->codec, "ass") != 0)
@@ -87,6 +123,10 @@ static bool jsre_init(struct sd_filter *ft)
     }
     talloc_set_destructor(p, destruct_priv);
 
+    // Items that compiled, in the same order as the regexes in the VM.
+    char **items = NULL;
+    int num_items = 0;
+
     for (int n = 0; ft->opts->jsre_items[n]; n++) {
         char *item = ft->opts->jsre_items[n];
 
@@ -97,12 +137,17 @@ static bool jsre_init(struct sd_filter *ft)
             continue;
         }
 
+        MP_TARRAY_APPEND(p, items, num_items, item);
         p->num_regexes += 1;
     }
 
     if (!p->num_regexes)
         return false;
 
+    p->combined = talloc_zero_array(p, bool, p->num_regexes);
+    combine_regexes(ft, items);
+    talloc_free(items);
+
     p->offset = sd_ass_fmt_offset(ft->event_format);
     return true;
 }
@@ -117,7 +162,20 @@ static struct demux_packet *jsre_filter(struct sd_filter *ft,
     if (ft->opts->rf_plain)
         sd_ass_to_plaintext(&text, text);
 
+    // If the combined regex matches, the loop below finds which part does for
+    // the log message. Otherwise only the regexes that couldn't be combined
+    // need to be checked.
+    bool check_all = !p->have_all;
+    if (p->have_all) {
+        int found, err = p_regexec(p->J, p->num_regexes, text, &found);
+        if (err)
+            js_pop(p->J, 1);
+        check_all = err || found;
+    }
+
     for (int n = 0; n < p->num_regexes; n++) {
+        if (p->combined[n] && !check_all)
+            continue;
         int found, err = p_regexec(p->J, n, text, &found);
         if (err == 0 && found) {
             int level = ft->opts->rf_warn ? MSGL_WARN : MSGL_V;
@@ -11,8 +11,41 @@ struct priv {
     int offset;
     regex_t *regexes;
     int num_regexes;
+    // All regexes with combined[n] set are also part of the alternation in
+    // all_regex, so most lines are checked with a single regexec() call.
+    bool *combined;
+    regex_t all_regex;
+    bool have_all;
 };
 
+static const int rf_flags = REG_ICASE | REG_EXTENDED | REG_NOSUB | REG_NEWLINE;
+
+static void combine_regexes(struct sd_filter *ft, char **items)
+{
+    struct priv *p = ft->priv;
+    char *all = talloc_strdup(NULL, "");
+    int num = 0;
+
+    for (int n = 0; n < p->num_regexes; n++) {
+        if (!sd_filter_regex_combinable(items[n]))
+            continue;
+        all = talloc_asprintf_append_buffer(all, "%s(%s)", num ? "|" : "",
+                                            items[n]);
+        p->combined[n] = true;
+        num++;
+    }
+
+    // Not worth it for a single regex.
+    if (num > 1 && regcomp(&p->all_regex, all, rf_flags) == 0) {
+        p->have_all = true;
+        MP_VERBOSE(ft, "Combined %d of %d regexes.\n", num, p->num_regexes);
+    } else {
+        for (int n = 0; n < p->num_regexes; n++)
+            p->combined[n] = false;
+    }
+    talloc_free(all);
+}
+
 static bool rf_init(struct sd_filter *ft)
 {
     if (strcmp(ft->codec, "ass") != 0)
@@ -24,13 +57,17 @@ static bool rf_init(struct sd_filter *ft)
     struct priv *p = talloc_zero(ft, struct priv);
     ft->priv = p;
 
+    // Items that compiled, in the same order as p->regexes.
+    char **items = NULL;
+    int num_items = 0;
+
     for (int n = 0; ft->opts->rf_items && ft->opts->rf_items[n]; n++) {
         char *item = ft->opts->rf_items[n];
 
         MP_TARRAY_GROW(p, p->regexes, p->num_regexes);
         regex_t *preg = &p->regexes[p->num_regexes];
 
-        int err = regcomp(preg, item, REG_ICASE | REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
+        int err = regcomp(preg, item, rf_flags);
         if (err) {
             char errbuf[512];
             regerror(err, preg, errbuf, sizeof(errbuf));
@@ -38,12 +75,17 @@ static bool rf_init(struct sd_filter *ft)
             continue;
         }
 
+        MP_TARRAY_APPEND(p, items, num_items, item);
         p->num_regexes += 1;
     }
 
     if (!p->num_regexes)
         return false;
 
+    p->combined = talloc_zero_array(p, bool, p->num_regexes);
+    combine_regexes(ft, items);
+    talloc_free(items);
+
     p->offset = sd_ass_fmt_offset(ft->event_format);
     return true;
 }
@@ -54,6 +96,8 @@ static void rf_uninit(struct sd_filter *ft)
 
     for (int n = 0; n < p->num_regexes; n++)
         regfree(&p->regexes[n]);
+    if (p->have_all)
+        regfree(&p->all_regex);
 }
 
 static struct demux_packet *rf_filter(struct sd_filter *ft,
@@ -66,7 +110,19 @@ static struct demux_packet *rf_filter(struct sd_filter *ft,
     if (ft->opts->rf_plain)
         sd_ass_to_plaintext(&text, text);
 
+    // If the combined regex matches, one of its parts does, and the loop
+    // below finds which one for the log message. Otherwise only the regexes
+    // that couldn't be combined need to be checked.
+    bool check_all = !p->have_all;
+    if (p->have_all) {
+        int err = regexec(&p->all_regex, text, 0, NULL, 0);
+        if (err != REG_NOMATCH)
+            check_all = true;
+    }
+
     for (int n = 0; n < p->num_regexes; n++) {
+        if (p->combined[n] && !check_all)
+            continue;
         int err = regexec(&p->regexes[n], text, 0, NULL, 0);
         if (err == 0) {
             int level = ft->opts->rf_warn ? MSGL_WARN : MSGL_V;
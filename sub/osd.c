@@ -40,8 +40,10 @@
 #include "dec_sub.h"
 #include "img_convert.h"
 #include "draw_bmp.h"
+#include "packer.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
+#include "video/sws_utils.h"
 
 #define OPT_BASE_STRUCT struct osd_style_opts
 static const m_option_t style_opts[] = {
@@ -205,7 +207,7 @@ void osd_set_text(struct osd_state *osd, const char *text)
     if (strcmp(osd_obj->text, text) != 0) {
         talloc_free(osd_obj->text);
         osd_obj->text = talloc_strdup(osd_obj, text);
-        osd_obj->osd_changed = true;
+        osd_obj->text_changed = true;
         osd->want_redraw_notification = true;
     }
     mp_mutex_unlock(&osd->lock);
@@ -260,15 +262,22 @@ void osd_set_progbar(struct osd_state *osd, struct osd_progbar_state *s)
 {
     mp_mutex_lock(&osd->lock);
     struct osd_object *osd_obj = osd->objs[OSDTYPE_OSD];
-    osd_obj->progbar_state.type = s->type;
-    osd_obj->progbar_state.value = s->value;
-    osd_obj->progbar_state.num_stops = s->num_stops;
-    MP_TARRAY_GROW(osd_obj, osd_obj->progbar_state.stops, s->num_stops);
-    if (s->num_stops) {
-        memcpy(osd_obj->progbar_state.stops, s->stops,
-               sizeof(osd_obj->progbar_state.stops[0]) * s->num_stops);
+    struct osd_progbar_state *cur = &osd_obj->progbar_state;
+    if (cur->type == s->type && cur->value == s->value &&
+        cur->num_stops == s->num_stops &&
+        (!s->num_stops ||
+         !memcmp(cur->stops, s->stops, sizeof(s->stops[0]) * s->num_stops)))
+    {
+        mp_mutex_unlock(&osd->lock);
+        return;
     }
-    osd_obj->osd_changed = true;
+    cur->type = s->type;
+    cur->value = s->value;
+    cur->num_stops = s->num_stops;
+    MP_TARRAY_GROW(osd_obj, cur->stops, s->num_stops);
+    if (s->num_stops)
+        memcpy(cur->stops, s->stops, sizeof(cur->stops[0]) * s->num_stops);
+    osd_obj->progbar_changed = true;
     osd->want_redraw_notification = true;
     mp_mutex_unlock(&osd->lock);
 }
@@ -354,6 +363,68 @@ static struct sub_bitmaps *render_object(struct osd_state *osd,
     return res;
 }
 
+static int find_item(struct sub_bitmap_list *list, int render_index)
+{
+    for (int n = 0; n < list->num_items; n++) {
+        if (list->items[n]->render_index == render_index)
+            return n;
+    }
+    return -1;
+}
+
+// Replace the primary and secondary subtitle items with a single one, so that
+// VOs handle (and upload) one image instead of two when both are shown.
+static void merge_subs(struct osd_state *osd, struct sub_bitmap_list *list)
+{
+    struct osd_object *obj = osd->objs[OSDTYPE_SUB];
+    int ia = find_item(list, OSDTYPE_SUB);
+    int ib = find_item(list, OSDTYPE_SUB2);
+    struct sub_bitmaps *a = ia >= 0 ? list->items[ia] : NULL;
+    struct sub_bitmaps *b = ib >= 0 ? list->items[ib] : NULL;
+
+    struct sub_bitmaps *res = NULL;
+    int id = 0;
+    if (a && b && a->format == SUBBITMAP_LIBASS &&
+        b->format == SUBBITMAP_LIBASS &&
+        a->video_color_space == b->video_color_space)
+    {
+        // Both change_ids only grow, so their sum changes with either input.
+        id = a->change_id + b->change_id;
+        if (!osd->sub_merge_packer)
+            osd->sub_merge_packer = mp_sub_packer_alloc(osd);
+        struct sub_bitmaps merged;
+        struct sub_bitmaps *lists[] = {a, b};
+        mp_sub_packer_merge_libass(osd->sub_merge_packer, lists, 2,
+                                   !osd->subs_merged || id != osd->sub_merge_id,
+                                   &merged);
+        if (merged.packed)
+            res = sub_bitmaps_copy(NULL, &merged);
+    }
+
+    if (!res) {
+        if (osd->subs_merged) {
+            // Don't let the VO mistake the next primary-only image for the
+            // last merged one.
+            obj->vo_change_id = MPMAX(obj->vo_change_id, osd->sub_merge_id) + 1;
+            if (a)
+                a->change_id = obj->vo_change_id;
+            osd->subs_merged = false;
+            list->change_id += 1;
+        }
+        return;
+    }
+
+    res->render_index = OSDTYPE_SUB;
+    res->change_id = id;
+    osd->subs_merged = true;
+    osd->sub_merge_id = id;
+
+    talloc_free(a);
+    talloc_free(b);
+    list->items[ia] = talloc_steal(list, res);
+    MP_TARRAY_REMOVE_AT(list->items, list->num_items, ib);
+}
+
 // Render OSD to a list of bitmap and return it. The returned object is
 // refcounted. Typically you should hold it only for a short time, and then
 // release it.
@@ -414,6 +485,8 @@ struct sub_bitmap_list *osd_render(struct osd_state *osd, struct mp_osd_res res,
         talloc_free(imgs);
     }
 
+    merge_subs(osd, list);
+
     double elapsed = MP_TIME_NS_TO_MS(mp_time_ns() - start_time);
     bool slow = elapsed > 5;
     mp_msg(osd->log, slow ? MSGL_DEBUG : MSGL_TRACE, "Spent %.3f ms in %s%s\n",
@@ -471,8 +544,11 @@ void osd_draw_on_image_p(struct osd_state *osd, struct mp_osd_res res,
     // Need to lock for the dumb osd->draw_cache thing.
     mp_mutex_lock(&osd->lock);
 
-    if (!osd->draw_cache)
+    if (!osd->draw_cache) {
         osd->draw_cache = mp_draw_sub_alloc(osd, osd->global);
+        mp_draw_sub_set_threads(osd->draw_cache,
+                                mp_sws_get_cmdline_threads(osd->global));
+    }
 
     stats_time_start(osd->stats, "draw-bmp");
 
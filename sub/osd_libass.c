@@ -48,16 +48,12 @@ static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
         return;
 
     ass->log = mp_log_new(NULL, osd->log, "libass");
-    ass->library = mp_ass_init(osd->global, osd->opts->osd_style, ass->log);
-    ass_add_font(ass->library, "mpv-osd-symbols", (void *)osd_font_pfb,
-                 sizeof(osd_font_pfb) - 1);
-
-    ass->render = ass_renderer_init(ass->library);
-    if (!ass->render)
-        abort();
-
-    mp_ass_configure_fonts(ass->render, osd->opts->osd_style,
-                           osd->global, ass->log);
+    struct mp_ass_font font = {"mpv-osd-symbols", osd_font_pfb,
+                               sizeof(osd_font_pfb) - 1};
+    ass->handle = mp_ass_acquire(osd->global, osd->opts->osd_style, ass->log,
+                                 &font, 1);
+    ass->library = ass->handle->library;
+    ass->render = ass->handle->renderer;
     ass_set_pixel_aspect(ass->render, 1.0);
 }
 
@@ -66,11 +62,10 @@ static void destroy_ass_renderer(struct ass_state *ass)
     if (ass->track)
         ass_free_track(ass->track);
     ass->track = NULL;
-    if (ass->render)
-        ass_renderer_done(ass->render);
+    mp_ass_release(ass->handle);
+    ass->handle = NULL;
+    ass->imgs_valid = false;
     ass->render = NULL;
-    if (ass->library)
-        ass_library_done(ass->library);
     ass->library = NULL;
     talloc_free(ass->log);
     ass->log = NULL;
@@ -87,6 +82,7 @@ void osd_destroy_backend(struct osd_state *osd)
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct osd_object *obj = osd->objs[n];
         destroy_ass_renderer(&obj->ass);
+        destroy_ass_renderer(&obj->progbar_ass);
         for (int i = 0; i < obj->num_externals; i++)
             destroy_external(obj->externals[i]);
         obj->num_externals = 0;
@@ -121,6 +117,7 @@ static void create_ass_track(struct osd_state *osd, struct osd_object *obj,
 
     ASS_Track *track = ass->track;
     struct mp_osd_render_opts *opts = osd->opts;
+    ass->imgs_valid = false;
     if (!track)
         track = ass->track = ass_new_track(ass->library);
 
@@ -191,6 +188,7 @@ static void clear_ass(struct ass_state *ass)
 {
     if (ass->track)
         ass_flush_events(ass->track);
+    ass->imgs_valid = false;
 }
 
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
@@ -383,10 +381,10 @@ static void get_osd_bar_box(struct osd_state *osd, struct osd_object *obj,
     struct mp_osd_render_opts *opts = osd->opts;
     struct osd_bar_style_opts *bar_opts = opts->osd_bar_style;
 
-    create_ass_track(osd, obj, &obj->ass);
-    ASS_Track *track = obj->ass.track;
+    create_ass_track(osd, obj, &obj->progbar_ass);
+    ASS_Track *track = obj->progbar_ass.track;
 
-    ASS_Style *style = get_style(&obj->ass, "progbar");
+    ASS_Style *style = get_style(&obj->progbar_ass, "progbar");
     if (!style) {
         *o_x = *o_y = *o_w = *o_h = *o_border = 0;
         return;
@@ -423,7 +421,7 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     float px, py, width, height, border;
     get_osd_bar_box(osd, obj, &px, &py, &width, &height, &border);
 
-    ASS_Track *track = obj->ass.track;
+    ASS_Track *track = obj->progbar_ass.track;
 
     float sx = px - border * 2 - height / 4; // includes additional spacing
     float sy = py + height / 2;
@@ -517,12 +515,19 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     ass_draw_reset(d);
 }
 
+// The text and the bar are separate layers, so that e.g. the playback time
+// ticking in the OSD doesn't re-render the bar.
 static void update_osd(struct osd_state *osd, struct osd_object *obj)
 {
-    obj->osd_changed = false;
-    clear_ass(&obj->ass);
-    update_osd_text(osd, obj);
-    update_progbar(osd, obj);
+    if (obj->osd_changed || obj->text_changed) {
+        clear_ass(&obj->ass);
+        update_osd_text(osd, obj);
+    }
+    if (obj->osd_changed || obj->progbar_changed) {
+        clear_ass(&obj->progbar_ass);
+        update_progbar(osd, obj);
+    }
+    obj->osd_changed = obj->text_changed = obj->progbar_changed = false;
 }
 
 static void update_external(struct osd_state *osd, struct osd_object *obj,
@@ -668,15 +673,22 @@ static void append_ass(struct ass_state *ass, struct mp_osd_res *res,
         return;
     }
 
-    update_playres(ass, res);
+    // OSD tracks are always rendered at time 0, so the result can only change
+    // if the track or the resolution did.
+    if (!ass->imgs_valid || !osd_res_equals(*res, ass->imgs_res)) {
+        update_playres(ass, res);
 
-    ass_set_frame_size(ass->render, res->w, res->h);
-    ass_set_pixel_aspect(ass->render, res->display_par);
+        ass_set_frame_size(ass->render, res->w, res->h);
+        ass_set_pixel_aspect(ass->render, res->display_par);
 
-    int ass_changed;
-    *img_list = ass_render_frame(ass->render, ass->track, 0, &ass_changed);
+        int ass_changed;
+        ass->imgs = ass_render_frame(ass->render, ass->track, 0, &ass_changed);
+        ass->imgs_valid = true;
+        ass->imgs_res = *res;
 
-    ass->changed |= ass_changed;
+        ass->changed |= ass_changed;
+    }
+    *img_list = ass->imgs;
 
     if (changed) {
         *changed |= ass->changed;
@@ -688,7 +700,7 @@ struct sub_bitmaps *osd_object_get_bitmaps(struct osd_state *osd,
                                            struct osd_object *obj, int format)
 {
     if (obj->type == OSDTYPE_OSD) {
-        if (obj->osd_changed) {
+        if (obj->osd_changed || obj->text_changed || obj->progbar_changed) {
             update_osd(osd, obj);
         } else {
             mp_require(obj->sub_packer);
@@ -699,22 +711,25 @@ struct sub_bitmaps *osd_object_get_bitmaps(struct osd_state *osd,
     if (!obj->sub_packer)
         obj->sub_packer = mp_sub_packer_alloc(obj);
 
-    MP_TARRAY_GROW(obj, obj->ass_imgs, obj->num_externals + 1);
+    // Unchanged layers reuse their last libass output.
+    MP_TARRAY_GROW(obj, obj->ass_imgs, obj->num_externals + 2);
 
     append_ass(&obj->ass, &obj->vo_res, &obj->ass_imgs[0], &obj->changed);
+    append_ass(&obj->progbar_ass, &obj->vo_res, &obj->ass_imgs[1],
+               &obj->changed);
     for (int n = 0; n < obj->num_externals; n++) {
         if (obj->externals[n]->ov.hidden) {
             update_playres(&obj->externals[n]->ass, &obj->vo_res);
-            obj->ass_imgs[n + 1] = NULL;
+            obj->ass_imgs[n + 2] = NULL;
         } else {
             append_ass(&obj->externals[n]->ass, &obj->vo_res,
-                       &obj->ass_imgs[n + 1], &obj->changed);
+                       &obj->ass_imgs[n + 2], &obj->changed);
         }
     }
 
 done:;
     struct sub_bitmaps out_imgs = {0};
-    mp_sub_packer_pack_ass(obj->sub_packer, obj->ass_imgs, obj->num_externals + 1,
+    mp_sub_packer_pack_ass(obj->sub_packer, obj->ass_imgs, obj->num_externals + 2,
                        obj->changed, false, format, &out_imgs);
 
     obj->changed = false;
@@ -23,9 +23,14 @@ struct ass_state {
     struct ass_track *track;
     struct ass_renderer *render;
     struct ass_library *library;
+    struct mp_ass_handle *handle;   // owns render and library
     int res_x, res_y;
     bool changed;
     struct mp_osd_res vo_res; // last known value
+    // Last ass_render_frame() result, reused while the track is unchanged.
+    struct ass_image *imgs;
+    bool imgs_valid;
+    struct mp_osd_res imgs_res;
 };
 
 struct osd_object {
@@ -33,7 +38,9 @@ struct osd_object {
     bool is_sub;
 
     // OSDTYPE_OSD
-    bool osd_changed;
+    bool osd_changed;       // style or size changed, update all layers
+    bool text_changed;
+    bool progbar_changed;
     char *text;
     struct osd_progbar_state progbar_state;
 
@@ -55,6 +62,7 @@ struct osd_object {
     // Internally used by osd_libass.c
     bool changed;
     struct ass_state ass;
+    struct ass_state progbar_ass; // OSDTYPE_OSD
     struct mp_sub_packer *sub_packer;
     struct sub_bitmap_copy_cache *copy_cache;
     struct ass_image **ass_imgs;
@@ -83,6 +91,11 @@ struct osd_state {
     struct stats_ctx *stats;
 
     struct mp_draw_sub_cache *draw_cache;
+
+    // Packs the secondary subtitles into the image of the primary ones.
+    struct mp_sub_packer *sub_merge_packer;
+    bool subs_merged;           // OSDTYPE_SUB2 was merged in the last render
+    int sub_merge_id;           // change_id of the last merged result
 };
 
 // defined in osd_libass.c
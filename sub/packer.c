@@ -45,6 +45,7 @@ struct mp_sub_packer {
     bool cached_subs_valid;
     struct sub_bitmap rgba_imgs[MP_SUB_BB_LIST_MAX];
     struct bitmap_packer *packer;
+    uint64_t *keys;
 };
 
 // Free with talloc_free().
@@ -59,11 +60,20 @@ struct mp_sub_packer *mp_sub_packer_alloc(void *ta_parent)
 static bool pack(struct mp_sub_packer *p, struct sub_bitmaps *res, int imgfmt)
 {
     packer_set_size(p->packer, res->num_parts);
+    MP_TARRAY_GROW(p, p->keys, res->num_parts);
 
-    for (int n = 0; n < res->num_parts; n++)
-        p->packer->in[n] = (struct pos){res->parts[n].w, res->parts[n].h};
+    // Bitmaps at the same screen position with the same size are likely
+    // unchanged, and keep their place in the packed image. This way, a VO
+    // updating only the rows that changed has to upload less.
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        p->packer->in[n] = (struct pos){b->w, b->h};
+        p->keys[n] = ((uint64_t)(uint16_t)b->x << 48) |
+                     ((uint64_t)(uint16_t)b->y << 32) |
+                     ((uint64_t)(uint16_t)b->w << 16) | (uint16_t)b->h;
+    }
 
-    if (p->packer->count == 0 || packer_pack(p->packer) < 0)
+    if (p->packer->count == 0 || packer_pack_stable(p->packer, p->keys) < 0)
         return false;
 
     struct pos bb[2];
@@ -263,6 +273,25 @@ static bool pack_rgba(struct mp_sub_packer *p, struct sub_bitmaps *res)
     return true;
 }
 
+static void pack_parts(struct mp_sub_packer *p, struct sub_bitmaps *res,
+                       int format, struct sub_bitmaps *out)
+{
+    bool r = false;
+    if (format == SUBBITMAP_BGRA) {
+        r = pack_rgba(p, res);
+    } else {
+        r = pack_libass(p, res);
+    }
+
+    if (!r)
+        return;
+
+    *out = *res;
+    p->cached_subs = *res;
+    p->cached_subs.change_id = 0;
+    p->cached_subs_valid = true;
+}
+
 // Pack the contents of image_lists[0] to image_lists[num_image_lists-1] into
 // a single image, and make *out point to it. *out is completely overwritten.
 // If libass reported any change, image_lists_changed must be set (it then
@@ -310,20 +339,42 @@ void mp_sub_packer_pack_ass(struct mp_sub_packer *p, ASS_Image **image_lists,
         }
     }
 
-    bool r = false;
-    if (format == SUBBITMAP_BGRA) {
-        r = pack_rgba(p, &res);
-    } else {
-        r = pack_libass(p, &res);
-    }
+    pack_parts(p, &res, format, out);
+}
 
-    if (!r)
+// Like mp_sub_packer_pack_ass(), but repack the parts of lists[0] to
+// lists[num_lists-1], which must all be SUBBITMAP_LIBASS, into a single image.
+// If changed is false, the previous result is returned.
+void mp_sub_packer_merge_libass(struct mp_sub_packer *p, struct sub_bitmaps **lists,
+                                int num_lists, bool changed, struct sub_bitmaps *out)
+{
+    if (p->cached_subs_valid && !changed &&
+        p->cached_subs.format == SUBBITMAP_LIBASS)
+    {
+        *out = p->cached_subs;
         return;
+    }
 
-    *out = res;
-    p->cached_subs = res;
-    p->cached_subs.change_id = 0;
-    p->cached_subs_valid = true;
+    *out = (struct sub_bitmaps){.change_id = 1};
+    p->cached_subs_valid = false;
+
+    struct sub_bitmaps res = {
+        .change_id = 1,
+        .format = SUBBITMAP_LIBASS,
+        .parts = p->cached_parts,
+        .video_color_space = num_lists && lists[0]->video_color_space,
+    };
+
+    for (int n = 0; n < num_lists; n++) {
+        mp_assert(lists[n]->format == SUBBITMAP_LIBASS);
+        for (int i = 0; i < lists[n]->num_parts; i++) {
+            MP_TARRAY_GROW(p, p->cached_parts, res.num_parts);
+            res.parts = p->cached_parts;
+            res.parts[res.num_parts++] = lists[n]->parts[i];
+        }
+    }
+
+    pack_parts(p, &res, SUBBITMAP_LIBASS, out);
 }
 
 #if HAVE_SUBRANDR
@@ -33,6 +33,8 @@ struct mp_sub_packer *mp_sub_packer_alloc(void *ta_parent);
 void mp_sub_packer_pack_ass(struct mp_sub_packer *p, ASS_Image **image_lists,
                             int num_image_lists, bool changed, bool video_color_space,
                             int preferred_osd_format, struct sub_bitmaps *out);
+void mp_sub_packer_merge_libass(struct mp_sub_packer *p, struct sub_bitmaps **lists,
+                                int num_lists, bool changed, struct sub_bitmaps *out);
 
 #if HAVE_SUBRANDR
 struct sbr_instanced_raster_pass;
@@ -130,4 +130,9 @@ bstr sd_ass_pkt_text(struct sd_filter *ft, struct demux_packet *pkt, int offset)
 // *out will not be reallocated if *out == in.
 bstr sd_ass_to_plaintext(char **out, const char *in);
 
+// whether a regex can be wrapped in a group and joined with others into a
+// single alternation without changing what it matches (no backreferences,
+// balanced parentheses). conservative: may reject some combinable patterns.
+bool sd_filter_regex_combinable(const char *pattern);
+
 #endif
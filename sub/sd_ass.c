@@ -42,8 +42,7 @@
 #include "sd.h"
 
 struct sd_ass_priv {
-    struct ass_library *ass_library;
-    struct ass_renderer *ass_renderer;
+    struct mp_ass_handle *ass;
     struct ass_track *ass_track;
     struct ass_track *shadow_track; // for --sub-ass=no rendering
     bool ass_configured;
@@ -60,14 +59,25 @@ struct sd_ass_priv {
     struct mp_osd_res osd;
     struct seen_packet *seen_packets;
     int num_seen_packets;
-    int *packets_animated;
-    int num_packets_animated;
     bool check_animated;
+    // All events of ass_track, sorted by start time, for finding the events
+    // at a given time without scanning the whole track.
+    struct event_entry *event_index;
+    int num_event_index;
+    int *found_events;
+    int num_found_events;
 };
 
 struct seen_packet {
     int64_t pos;
     double pts;
+    int animated;
+};
+
+struct event_entry {
+    long long start;
+    long long max_end;  // maximum end time of this and all previous entries
+    int event;          // index into ASS_Track.events
 };
 
 #undef OPT_BASE_STRUCT
@@ -179,17 +189,20 @@ static bool attachment_is_font(struct mp_log *log, struct demux_attachment *f)
     return false;
 }
 
-static void add_subtitle_fonts(struct sd *sd)
+static int get_subtitle_fonts(struct sd *sd, struct mp_ass_font **fonts)
 {
-    struct sd_ass_priv *ctx = sd->priv;
     struct mp_subtitle_opts *opts = sd->opts;
+    int num_fonts = 0;
     if (!opts->ass_enabled || !opts->use_embedded_fonts || !sd->attachments)
-        return;
+        return 0;
     for (int i = 0; i < sd->attachments->num_entries; i++) {
         struct demux_attachment *f = &sd->attachments->entries[i];
-        if (attachment_is_font(sd->log, f))
-            ass_add_font(ctx->ass_library, f->name, f->data, f->data_size);
+        if (attachment_is_font(sd->log, f)) {
+            struct mp_ass_font font = {f->name, f->data, f->data_size};
+            MP_TARRAY_APPEND(sd->priv, *fonts, num_fonts, font);
+        }
     }
+    return num_fonts;
 }
 
 static void filters_destroy(struct sd *sd)
@@ -233,15 +246,16 @@ static void filters_init(struct sd *sd)
 static void enable_output(struct sd *sd, bool enable)
 {
     struct sd_ass_priv *ctx = sd->priv;
-    if (enable == !!ctx->ass_renderer)
+    if (enable == !!ctx->ass->renderer)
         return;
-    if (ctx->ass_renderer) {
-        ass_renderer_done(ctx->ass_renderer);
-        ctx->ass_renderer = NULL;
+    if (ctx->ass->renderer) {
+        ass_renderer_done(ctx->ass->renderer);
+        ctx->ass->renderer = NULL;
     } else {
-        ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+        ctx->ass->renderer = ass_renderer_init(ctx->ass->library);
+        ctx->ass->reusable = false;
 
-        mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
+        mp_ass_configure_fonts(ctx->ass->renderer, sd->opts->sub_style,
                                sd->global, sd->log);
     }
 }
@@ -252,18 +266,21 @@ static void assobjects_init(struct sd *sd)
     struct mp_subtitle_opts *opts = sd->opts;
     struct mp_subtitle_shared_opts *shared_opts = sd->shared_opts;
 
-    ctx->ass_library = mp_ass_init(sd->global, sd->opts->sub_style, sd->log);
-    ass_set_extract_fonts(ctx->ass_library, opts->use_embedded_fonts);
-
-    add_subtitle_fonts(sd);
+    struct mp_ass_font *fonts = NULL;
+    int num_fonts = get_subtitle_fonts(sd, &fonts);
+    ctx->ass = mp_ass_acquire(sd->global, opts->sub_style, sd->log,
+                              fonts, num_fonts);
+    talloc_free(fonts);
+    ass_set_extract_fonts(ctx->ass->library, opts->use_embedded_fonts);
 
     if (shared_opts->ass_style_override[sd->order])
-        ass_set_style_overrides(ctx->ass_library, opts->ass_style_override_list);
+        ass_set_style_overrides(ctx->ass->library, opts->ass_style_override_list);
 
-    ctx->ass_track = ass_new_track(ctx->ass_library);
+    ctx->ass_track = ass_new_track(ctx->ass->library);
     ctx->ass_track->track_type = TRACK_TYPE_ASS;
+    ctx->num_event_index = 0;
 
-    ctx->shadow_track = ass_new_track(ctx->ass_library);
+    ctx->shadow_track = ass_new_track(ctx->ass->library);
     ctx->shadow_track->PlayResX = MP_ASS_FONT_PLAYRESX;
     ctx->shadow_track->PlayResY = MP_ASS_FONT_PLAYRESY;
     mp_ass_add_default_styles(sd, ctx->shadow_track, opts, shared_opts);
@@ -274,8 +291,16 @@ static void assobjects_init(struct sd *sd)
         extradata = lavc_conv_get_extradata(ctx->converter);
         extradata_size = extradata ? strlen(extradata) : 0;
     }
-    if (extradata)
+    if (extradata) {
+        // Fonts extracted from the script are added to the library.
+        if (opts->use_embedded_fonts &&
+            bstr_find0((bstr){(unsigned char *)extradata, extradata_size},
+                       "[Fonts]") >= 0)
+        {
+            ctx->ass->reusable = false;
+        }
         ass_process_codec_private(ctx->ass_track, extradata, extradata_size);
+    }
 
     mp_ass_add_default_styles(sd, ctx->ass_track, opts, shared_opts);
 
@@ -287,8 +312,7 @@ static void assobjects_init(struct sd *sd)
     ass_configure_prune(ctx->ass_track, sd->opts->ass_prune_delay * 1000.0);
 #endif
 
-    enable_output(sd, true);
-    ass_set_cache_limits(ctx->ass_renderer, sd->opts->sub_glyph_limit, sd->opts->sub_bitmap_max_size);
+    ass_set_cache_limits(ctx->ass->renderer, sd->opts->sub_glyph_limit, sd->opts->sub_bitmap_max_size);
 }
 
 static void assobjects_destroy(struct sd *sd)
@@ -297,8 +321,8 @@ static void assobjects_destroy(struct sd *sd)
 
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
-    enable_output(sd, false);
-    ass_library_done(ctx->ass_library);
+    mp_ass_release(ctx->ass);
+    ctx->ass = NULL;
 }
 
 static int init(struct sd *sd)
@@ -392,7 +416,8 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
     // This bookkeeping only has any practical use for ASS subs
     // over a VO with no video.
     if (!ctx->is_converted) {
-        if (!pkt->seen) {
+        struct seen_packet *seen = &ctx->seen_packets[orig_pkt->seen_pos];
+        if (!orig_pkt->seen) {
             for (int n = track->n_events - 1; n >= 0; n--) {
                 if (n + 1 == old_n_events || pkt->animated == 1)
                     break;
@@ -402,18 +427,18 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
                 if (ctx->check_animated && pkt->animated != 1)
                     pkt->animated = is_animated(event->Text);
             }
-            MP_TARRAY_APPEND(ctx, ctx->packets_animated, ctx->num_packets_animated, pkt->animated);
+            seen->animated = pkt->animated;
         } else {
-            if (ctx->check_animated && ctx->packets_animated[pkt->seen_pos] == -1) {
+            if (ctx->check_animated && seen->animated == -1) {
                 for (int n = track->n_events - 1; n >= 0; n--) {
                     if (n + 1 == old_n_events || pkt->animated == 1)
                         break;
                     ASS_Event *event = &track->events[n];
-                    ctx->packets_animated[pkt->seen_pos] = is_animated(event->Text);
-                    pkt->animated = ctx->packets_animated[pkt->seen_pos];
+                    seen->animated = is_animated(event->Text);
+                    pkt->animated = seen->animated;
                 }
             } else {
-                pkt->animated = ctx->packets_animated[pkt->seen_pos];
+                pkt->animated = seen->animated;
             }
         }
     }
@@ -446,10 +471,124 @@ static bool check_packet_seen(struct sd *sd, struct demux_packet *packet)
     }
     packet->seen_pos = a;
     MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets, a,
-                        (struct seen_packet){packet->pos, packet->pts});
+                        (struct seen_packet){packet->pos, packet->pts, -1});
     return false;
 }
 
+#define END(ev) ((ev)->Start + (ev)->Duration)
+
+static int cmp_event_entry(const void *a, const void *b)
+{
+    const struct event_entry *ea = a, *eb = b;
+    if (ea->start != eb->start)
+        return ea->start < eb->start ? -1 : 1;
+    return ea->event - eb->event;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Return the number of index entries with a start time below ts.
+static int event_index_search(struct sd_ass_priv *ctx, long long ts)
+{
+    int a = 0;
+    int b = ctx->num_event_index;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (ctx->event_index[mid].start < ts) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    return a;
+}
+
+// Recompute event_entry.max_end for all entries starting at pos.
+static void event_index_update_end(struct sd_ass_priv *ctx, int pos)
+{
+    ASS_Event *events = ctx->ass_track->events;
+    for (int n = pos; n < ctx->num_event_index; n++) {
+        struct event_entry *e = &ctx->event_index[n];
+        e->max_end = END(&events[e->event]);
+        if (n > 0)
+            e->max_end = MPMAX(e->max_end, e[-1].max_end);
+    }
+}
+
+// Add events which were appended to the track since the last call. Events are
+// normally added in order, which makes this O(1) per event.
+static void update_event_index(struct sd_ass_priv *ctx)
+{
+    ASS_Track *track = ctx->ass_track;
+    if (track->n_events < ctx->num_event_index)
+        ctx->num_event_index = 0; // flushed or pruned
+    int first = ctx->num_event_index;
+    int num_new = track->n_events - first;
+    if (!num_new)
+        return;
+
+    int pos = first;
+    bool need_sort = false;
+    for (int n = first; n < track->n_events; n++) {
+        struct event_entry e = {.start = track->events[n].Start, .event = n};
+        int num = ctx->num_event_index;
+        if (!num || ctx->event_index[num - 1].start <= e.start || num_new > 16) {
+            need_sort |= num && ctx->event_index[num - 1].start > e.start;
+            MP_TARRAY_APPEND(ctx, ctx->event_index, ctx->num_event_index, e);
+        } else {
+            // Insert after all entries with the same start time, which keeps
+            // the order by event index.
+            int at = event_index_search(ctx, e.start + 1);
+            MP_TARRAY_INSERT_AT(ctx, ctx->event_index, ctx->num_event_index,
+                                at, e);
+            pos = MPMIN(pos, at);
+        }
+    }
+    if (need_sort) {
+        qsort(ctx->event_index, ctx->num_event_index, sizeof(ctx->event_index[0]),
+              cmp_event_entry);
+        pos = 0;
+    }
+    event_index_update_end(ctx, pos);
+}
+
+// Must be called if the duration of an event in the track was changed.
+static void event_index_changed(struct sd_ass_priv *ctx, int event)
+{
+    if (event >= ctx->num_event_index)
+        return; // not indexed yet
+    int pos = event_index_search(ctx, ctx->ass_track->events[event].Start);
+    while (ctx->event_index[pos].event != event)
+        pos++;
+    event_index_update_end(ctx, pos);
+}
+
+// Find all events of ass_track which overlap with the time range [start, end]
+// (both inclusive). The indexes of the events are returned in found_events,
+// in track order. Returns the number of events found.
+static int find_events(struct sd_ass_priv *ctx, long long start, long long end)
+{
+    update_event_index(ctx);
+
+    ASS_Event *events = ctx->ass_track->events;
+    ctx->num_found_events = 0;
+    for (int n = event_index_search(ctx, end + 1) - 1; n >= 0; n--) {
+        struct event_entry *e = &ctx->event_index[n];
+        if (e->max_end < start)
+            break;
+        if (END(&events[e->event]) >= start) {
+            MP_TARRAY_APPEND(ctx, ctx->found_events, ctx->num_found_events,
+                             e->event);
+        }
+    }
+    if (ctx->num_found_events > 1)
+        qsort(ctx->found_events, ctx->num_found_events, sizeof(int), cmp_int);
+    return ctx->num_found_events;
+}
+
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
 static void decode(struct sd *sd, struct demux_packet *packet)
@@ -493,6 +632,7 @@ static void decode(struct sd *sd, struct demux_packet *packet)
                 } else if (track->events[n].Start == track->events[n + 1].Start) {
                     track->events[n].Duration = track->events[n + 1].Duration;
                 }
+                event_index_changed(ctx, n);
             }
             if (n > 0 && track->events[n].Start != track->events[n - 1].Start)
                 break;
@@ -527,7 +667,7 @@ static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
     struct mp_subtitle_opts *opts = sd->opts;
     struct mp_subtitle_shared_opts *shared_opts = sd->shared_opts;
     struct sd_ass_priv *ctx = sd->priv;
-    ASS_Renderer *priv = ctx->ass_renderer;
+    ASS_Renderer *priv = ctx->ass->renderer;
 
     ass_set_frame_size(priv, dim->w, dim->h);
     ass_set_margins(priv, dim->mt, dim->mb, dim->ml, dim->mr);
@@ -655,8 +795,6 @@ static bool has_overrides(char *s)
            strstr(s, "\\iclip") || strstr(s, "\\org") || strstr(s, "\\p");
 }
 
-#define END(ev) ((ev)->Start + (ev)->Duration)
-
 static long long find_timestamp(struct sd *sd, double pts)
 {
     struct sd_ass_priv *priv = sd->priv;
@@ -674,20 +812,14 @@ static long long find_timestamp(struct sd *sd, double pts)
     int threshold = sd->opts->sub_fix_timing_threshold;
     int keep = sd->opts->sub_fix_timing_keep;
 
-    // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
-
-    if (n_ev != 2)
+    // Find the "current" event. Give up on multiple overlaps (probably complex
+    // subs).
+    if (find_events(priv, ts - threshold, ts + threshold) != 2)
         return ts;
+    ASS_Event *ev[2] = {
+        &track->events[priv->found_events[0]],
+        &track->events[priv->found_events[1]],
+    };
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -733,7 +865,7 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
         shared_opts->ass_style_override[sd->order] == ASS_STYLE_OVERRIDE_STRIP;
     bool converted = (ctx->is_converted && !lavc_conv_is_styled(ctx->converter)) || no_ass;
     ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
-    ASS_Renderer *renderer = ctx->ass_renderer;
+    ASS_Renderer *renderer = ctx->ass->renderer;
     struct sub_bitmaps *res = &(struct sub_bitmaps){0};
 
     // Always update the osd_res
@@ -778,7 +910,11 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
         fill_plaintext(sd, pts);
 
     int changed;
+    int n_events = track->n_events;
     ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
+    // libass may prune events while rendering, which renumbers them.
+    if (track == ctx->ass_track && track->n_events != n_events)
+        ctx->num_event_index = 0;
     mp_sub_packer_pack_ass(ctx->packer, &imgs, 1, changed, !converted, format, res);
 
 done:
@@ -870,8 +1006,9 @@ static bstr get_text_buf(struct sd *sd, double pts, enum sd_text_type type)
 
     b->len = 0;
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
+    int num_events = find_events(ctx, ipts, ipts);
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + ctx->found_events[i];
         if (ipts >= event->Start && ipts < event->Start + event->Duration) {
             if (event->Text) {
                 int start = b->len;
@@ -932,8 +1069,9 @@ static struct sd_times get_times(struct sd *sd, double pts)
 
     long long ipts = find_timestamp(sd, pts);
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
+    int num_events = find_events(ctx, ipts, ipts);
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + ctx->found_events[i];
         if (ipts >= event->Start && ipts < event->Start + event->Duration) {
             double start = event->Start / 1000.0;
             double end = event->Duration == UNKNOWN_DURATION ?
@@ -998,6 +1136,7 @@ static void reset(struct sd *sd)
     if (sd->opts->sub_clear_on_seek || ctx->clear_once) {
         ass_flush_events(ctx->ass_track);
         ctx->num_seen_packets = 0;
+        ctx->num_event_index = 0;
         sd->preload_ok = false;
         ctx->clear_once = false;
     }
@@ -1054,6 +1193,23 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
         ctx->ass_configured = false; // ass always needs to be reconfigured
         return CONTROL_OK;
     }
+    case SD_CTRL_TRIM_MEMORY: {
+        ASS_Renderer *renderer = ctx->ass ? ctx->ass->renderer : NULL;
+        if (!renderer)
+            return CONTROL_OK;
+        // libass prunes its caches to the limits when starting a frame, so
+        // render an empty track with minimal limits.
+        ASS_Track *track = ass_new_track(ctx->ass->library);
+        if (track) {
+            int changed;
+            ass_set_cache_limits(renderer, 1, 1);
+            ass_render_frame(renderer, track, 0, &changed);
+            ass_free_track(track);
+            ass_set_cache_limits(renderer, sd->opts->sub_glyph_limit,
+                                 sd->opts->sub_bitmap_max_size);
+        }
+        return CONTROL_OK;
+    }
     default:
         return CONTROL_UNKNOWN;
     }
@@ -1214,3 +1370,21 @@ bstr sd_ass_to_plaintext(char **out, const char *in)
     *out = b.start;
     return b;
 }
+
+bool sd_filter_regex_combinable(const char *pattern)
+{
+    int depth = 0;
+    for (const char *s = pattern; *s; s++) {
+        if (*s == '\\') {
+            if (!s[1] || (s[1] >= '1' && s[1] <= '9'))
+                return false;
+            s++;
+        } else if (*s == '(') {
+            depth++;
+        } else if (*s == ')') {
+            if (--depth < 0)
+                return false;
+        }
+    }
+    return depth == 0;
+}
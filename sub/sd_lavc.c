@@ -28,7 +28,9 @@
 #include "common/msg.h"
 #include "common/av_common.h"
 #include "demux/stheader.h"
+#include "misc/thread_pool.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 #include "video/mp_image.h"
 #include "video/out/bitmap_packer.h"
 #include "img_convert.h"
@@ -38,16 +40,27 @@
 #define MAX_QUEUE 4
 
 struct sub {
+    struct sd_lavc_priv *priv;
     bool valid;
     AVSubtitle avsub;
+    double pts;
+    double endpts;
+    int64_t id;
+    // Converting avsub to bitmaps runs on sd_lavc_priv.pool, while the
+    // subtitle waits in the queue. The fields below are owned by the job until
+    // converting is cleared, and are allocated under ta, which is only used
+    // by one thread at a time.
+    bool converting; // protected by sd_lavc_priv.lock
+    void *ta;
+    struct bitmap_packer *packer;
+    float gauss;
+    bool gray;
+    bool forced_only;
     struct sub_bitmap *inbitmaps;
     int count;
     struct mp_image *data;
     int bound_w, bound_h;
     int src_w, src_h;
-    double pts;
-    double endpts;
-    int64_t id;
 };
 
 struct seekpoint {
@@ -56,11 +69,12 @@ struct seekpoint {
 };
 
 struct sd_lavc_priv {
+    struct mp_log *log;
     struct mp_codec_params *codec;
     AVCodecContext *avctx;
     AVPacket *avpkt;
     AVRational pkt_timebase;
-    struct sub subs[MAX_QUEUE]; // most recent event first
+    struct sub *subs[MAX_QUEUE]; // most recent event first
     struct sub_bitmap *outbitmaps;
     struct sub_bitmap *prevret;
     int prevret_num;
@@ -70,7 +84,9 @@ struct sd_lavc_priv {
     double current_pts;
     struct seekpoint *seekpoints;
     int num_seekpoints;
-    struct bitmap_packer *packer;
+    struct mp_thread_pool *pool;
+    mp_mutex lock;
+    mp_cond wakeup;
 };
 
 static int init(struct sd *sd)
@@ -137,7 +153,18 @@ static int init(struct sd *sd)
     sd->priv = priv;
     priv->displayed_id = -1;
     priv->current_pts = MP_NOPTS_VALUE;
-    priv->packer = talloc_zero(priv, struct bitmap_packer);
+    priv->log = sd->log;
+    for (int n = 0; n < MAX_QUEUE; n++) {
+        struct sub *sub = talloc_zero(priv, struct sub);
+        sub->priv = priv;
+        sub->ta = talloc_new(sub);
+        sub->packer = talloc_zero(sub->ta, struct bitmap_packer);
+        sub->pts = sub->endpts = MP_NOPTS_VALUE;
+        priv->subs[n] = sub;
+    }
+    priv->pool = mp_thread_pool_create(priv, 0, 0, 1);
+    mp_mutex_init(&priv->lock);
+    mp_cond_init(&priv->wakeup);
     return 0;
 
 error:
@@ -149,8 +176,18 @@ error_probe:
     return -1;
 }
 
+static void wait_sub(struct sub *sub)
+{
+    struct sd_lavc_priv *priv = sub->priv;
+    mp_mutex_lock(&priv->lock);
+    while (sub->converting)
+        mp_cond_wait(&priv->wakeup, &priv->lock);
+    mp_mutex_unlock(&priv->lock);
+}
+
 static void clear_sub(struct sub *sub)
 {
+    wait_sub(sub);
     sub->count = 0;
     sub->pts = MP_NOPTS_VALUE;
     sub->endpts = MP_NOPTS_VALUE;
@@ -161,17 +198,17 @@ static void clear_sub(struct sub *sub)
 
 static void alloc_sub(struct sd_lavc_priv *priv)
 {
-    clear_sub(&priv->subs[MAX_QUEUE - 1]);
-    struct sub tmp = priv->subs[MAX_QUEUE - 1];
+    clear_sub(priv->subs[MAX_QUEUE - 1]);
+    struct sub *tmp = priv->subs[MAX_QUEUE - 1];
     for (int n = MAX_QUEUE - 1; n > 0; n--)
         priv->subs[n] = priv->subs[n - 1];
     priv->subs[0] = tmp;
     // clear only some fields; the memory allocs can be reused
-    priv->subs[0].valid = false;
-    priv->subs[0].count = 0;
-    priv->subs[0].src_w = 0;
-    priv->subs[0].src_h = 0;
-    priv->subs[0].id = priv->new_id++;
+    priv->subs[0]->valid = false;
+    priv->subs[0]->count = 0;
+    priv->subs[0]->src_w = 0;
+    priv->subs[0]->src_h = 0;
+    priv->subs[0]->id = priv->new_id++;
 }
 
 static void convert_pal(uint32_t *colors, size_t count, bool gray)
@@ -192,25 +229,25 @@ static void convert_pal(uint32_t *colors, size_t count, bool gray)
     }
 }
 
-// Initialize sub from sub->avsub.
-static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
+// Initialize sub from sub->avsub. Runs on the thread pool.
+static void read_sub_bitmaps(struct sub *sub)
 {
-    struct mp_subtitle_opts *opts = sd->opts;
-    struct sd_lavc_priv *priv = sd->priv;
+    struct sd_lavc_priv *priv = sub->priv;
+    struct bitmap_packer *packer = sub->packer;
     AVSubtitle *avsub = &sub->avsub;
 
-    MP_TARRAY_GROW(priv, sub->inbitmaps, avsub->num_rects);
+    MP_TARRAY_GROW(sub->ta, sub->inbitmaps, avsub->num_rects);
 
-    packer_set_size(priv->packer, avsub->num_rects);
+    packer_set_size(packer, avsub->num_rects);
 
     // If we blur, we want a transparent region around the bitmap data to
     // avoid "cut off" artifacts on the borders.
-    bool apply_blur = opts->sub_gauss != 0.0f;
+    bool apply_blur = sub->gauss != 0.0f;
     int extend = apply_blur ? 5 : 0;
     // Assume consumers may use bilinear scaling on it (2x2 filter)
     int padding = 1 + extend;
 
-    priv->packer->padding = padding;
+    packer->padding = padding;
 
     // For the sake of libswscale, which in some cases takes sub-rects as
     // source images, and wants 16 byte start pointer and stride alignment.
@@ -221,24 +258,24 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         struct sub_bitmap *b = &sub->inbitmaps[sub->count];
 
         if (r->type != SUBTITLE_BITMAP) {
-            MP_ERR(sd, "unsupported subtitle type from decoder (%d)\n", r->type);
+            MP_ERR(priv, "unsupported subtitle type from decoder (%d)\n", r->type);
             continue;
         }
-        if (!(r->flags & AV_SUBTITLE_FLAG_FORCED) && opts->sub_forced_events_only)
+        if (!(r->flags & AV_SUBTITLE_FLAG_FORCED) && sub->forced_only)
             continue;
         if (r->w <= 0 || r->h <= 0)
             continue;
 
         b->bitmap = r; // save for later (dumb hack to avoid more complexity)
 
-        priv->packer->in[sub->count] = (struct pos){r->w + (align - 1), r->h};
+        packer->in[sub->count] = (struct pos){r->w + (align - 1), r->h};
         sub->count++;
     }
 
-    priv->packer->count = sub->count;
+    packer->count = sub->count;
 
-    if (packer_pack(priv->packer) < 0) {
-        MP_ERR(sd, "Unable to pack subtitle bitmaps.\n");
+    if (packer_pack(packer) < 0) {
+        MP_ERR(priv, "Unable to pack subtitle bitmaps.\n");
         sub->count = 0;
     }
 
@@ -246,19 +283,19 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         return;
 
     struct pos bb[2];
-    packer_get_bb(priv->packer, bb);
+    packer_get_bb(packer, bb);
 
     sub->bound_w = bb[1].x;
     sub->bound_h = bb[1].y;
 
     if (!sub->data || sub->data->w < sub->bound_w || sub->data->h < sub->bound_h) {
         talloc_free(sub->data);
-        sub->data = mp_image_alloc(IMGFMT_BGRA, priv->packer->w, priv->packer->h);
+        sub->data = mp_image_alloc(IMGFMT_BGRA, packer->w, packer->h);
         if (!sub->data) {
             sub->count = 0;
             return;
         }
-        talloc_steal(priv, sub->data);
+        talloc_steal(sub->ta, sub->data);
     }
 
     if (!mp_image_make_writeable(sub->data)) {
@@ -268,7 +305,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
     for (int i = 0; i < sub->count; i++) {
         struct sub_bitmap *b = &sub->inbitmaps[i];
-        struct pos pos = priv->packer->result[i];
+        struct pos pos = packer->result[i];
         struct AVSubtitleRect *r = b->bitmap;
         uint8_t **data = r->data;
         int *linesize = r->linesize;
@@ -292,7 +329,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         mp_assert(r->nb_colors <= 256);
         uint32_t pal[256] = {0};
         memcpy(pal, data[1], r->nb_colors * 4);
-        convert_pal(pal, 256, opts->sub_gray);
+        convert_pal(pal, 256, sub->gray);
 
         for (int y = -padding; y < b->h + padding; y++) {
             uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
@@ -318,10 +355,23 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         b->h += extend * 2;
 
         if (apply_blur)
-            mp_blur_rgba_sub_bitmap(b, opts->sub_gauss);
+            mp_blur_rgba_sub_bitmap(b, sub->gauss);
     }
 }
 
+static void convert_job(void *ptr)
+{
+    struct sub *sub = ptr;
+    struct sd_lavc_priv *priv = sub->priv;
+
+    read_sub_bitmaps(sub);
+
+    mp_mutex_lock(&priv->lock);
+    sub->converting = false;
+    mp_cond_broadcast(&priv->wakeup);
+    mp_mutex_unlock(&priv->lock);
+}
+
 static void decode(struct sd *sd, struct demux_packet *packet)
 {
     struct mp_subtitle_opts *opts = sd->opts;
@@ -369,7 +419,7 @@ static void decode(struct sd *sd, struct demux_packet *packet)
         pts += sub.start_display_time / 1000.0;
 
         // set end time of previous sub
-        struct sub *prev = &priv->subs[0];
+        struct sub *prev = priv->subs[0];
         if (prev->valid) {
             if (prev->endpts == MP_NOPTS_VALUE || prev->endpts > pts)
                 prev->endpts = pts;
@@ -393,14 +443,21 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     }
 
     alloc_sub(priv);
-    struct sub *current = &priv->subs[0];
+    struct sub *current = priv->subs[0];
 
     current->valid = true;
     current->pts = pts;
     current->endpts = endpts;
     current->avsub = sub;
+    current->gauss = opts->sub_gauss;
+    current->gray = opts->sub_gray;
+    current->forced_only = opts->sub_forced_events_only;
 
-    read_sub_bitmaps(sd, current);
+    // Convert while the subtitle is queued, so that large bitmaps (e.g. 4K
+    // PGS) are usually ready when they are displayed.
+    current->converting = true;
+    if (!mp_thread_pool_queue(priv->pool, convert_job, current))
+        convert_job(current);
 
     if (pts != MP_NOPTS_VALUE) {
         for (int n = 0; n < priv->num_seekpoints; n++) {
@@ -420,7 +477,7 @@ static struct sub *get_current(struct sd_lavc_priv *priv, double pts)
 {
     struct sub *current = NULL;
     for (int n = 0; n < MAX_QUEUE; n++) {
-        struct sub *sub = &priv->subs[n];
+        struct sub *sub = priv->subs[n];
         if (!sub->valid)
             continue;
         if (pts == MP_NOPTS_VALUE ||
@@ -451,6 +508,8 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res d,
     if (!current)
         return NULL;
 
+    wait_sub(current);
+
     MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
     for (int n = 0; n < current->count; n++)
         priv->outbitmaps[n] = current->inbitmaps[n];
@@ -602,7 +661,7 @@ static bool accepts_packet(struct sd *sd, double min_pts)
 
     int last_needed = -1;
     for (int n = 0; n < MAX_QUEUE; n++) {
-        struct sub *sub = &priv->subs[n];
+        struct sub *sub = priv->subs[n];
         if (!sub->valid)
             continue;
         if (pts == MP_NOPTS_VALUE ||
@@ -622,7 +681,7 @@ static void reset(struct sd *sd)
     struct sd_lavc_priv *priv = sd->priv;
 
     for (int n = 0; n < MAX_QUEUE; n++)
-        clear_sub(&priv->subs[n]);
+        clear_sub(priv->subs[n]);
     // lavc might not do this right for all codecs; may need close+reopen
     avcodec_flush_buffers(priv->avctx);
 
@@ -634,7 +693,10 @@ static void uninit(struct sd *sd)
     struct sd_lavc_priv *priv = sd->priv;
 
     for (int n = 0; n < MAX_QUEUE; n++)
-        clear_sub(&priv->subs[n]);
+        clear_sub(priv->subs[n]);
+    talloc_free(priv->pool);
+    mp_cond_destroy(&priv->wakeup);
+    mp_mutex_destroy(&priv->lock);
     avcodec_free_context(&priv->avctx);
     mp_free_av_packet(&priv->avpkt);
     talloc_free(priv);
@@ -31,7 +31,7 @@
 #endif
 
 struct ta_header {
-    size_t size;                // size of the user allocation
+    size_t size;                // size of the user allocation (and TA_F_*)
     // Invariant: parent!=NULL => prev==NULL
     struct ta_header *prev;     // siblings list (by destructor order)
     struct ta_header *next;
@@ -63,9 +63,43 @@ union aligned_header {
 #define PTR_TO_HEADER(ptr) (&((union aligned_header *)(ptr) - 1)->ta)
 #define PTR_FROM_HEADER(h) ((void *)((union aligned_header *)(h) + 1))
 
-#define MAX_ALLOC (((size_t)-1) - sizeof(union aligned_header))
+// The top bits of ta_header.size are used as flags.
+#define TA_F_ARENA      ((size_t)1 << (sizeof(size_t) * 8 - 1)) // ta_new_arena()
+#define TA_F_IN_ARENA   ((size_t)1 << (sizeof(size_t) * 8 - 2)) // arena child
+#define TA_F_MASK       (TA_F_ARENA | TA_F_IN_ARENA)
+
+#define MAX_ALLOC ((((size_t)-1) >> 2) - sizeof(union aligned_header))
+
+// Arena state, the user data of the ta_new_arena() allocation.
+struct ta_arena {
+    struct ta_arena_chunk *chunk; // current chunk (list linked via prev)
+    char *cur, *end;              // free space in the current chunk
+    // Set if freeing the arena has to walk the allocation tree: if arena
+    // allocations have destructors, or foreign allocations were moved in.
+    bool needs_walk;
+};
+
+union ta_arena_chunk_hdr {
+    struct ta_arena_chunk {
+        struct ta_arena_chunk *prev;
+    } c;
+    char align_min[(sizeof(struct ta_arena_chunk) + MIN_ALIGN - 1) & ~(MIN_ALIGN - 1)];
+};
+
+// Arena allocations are prefixed with a pointer to their arena.
+union ta_arena_prefix {
+    struct ta_arena *arena;
+    char align_min[(sizeof(struct ta_arena *) + MIN_ALIGN - 1) & ~(MIN_ALIGN - 1)];
+};
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN(s) (((s) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+#define ARENA_BLOCK_SIZE(s) \
+    (sizeof(union ta_arena_prefix) + sizeof(union aligned_header) + ARENA_ALIGN(s))
+#define ARENA_FROM_HEADER(h) (((union ta_arena_prefix *)(h) - 1)->arena)
 
 static void ta_dbg_add(struct ta_header *h);
+static void ta_dbg_add_arena(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
 
@@ -76,20 +110,18 @@ static struct ta_header *get_header(void *ptr)
     return h;
 }
 
-/* Set the parent allocation of ptr. If parent==NULL, remove the parent.
- * Setting parent==NULL (with ptr!=NULL) unsets the parent of ptr.
- * With ptr==NULL, the function does nothing.
- *
- * Warning: if ta_parent is a direct or indirect child of ptr, things will go
- *          wrong. The function will apparently succeed, but creates circular
- *          parent links, which are not allowed.
- */
-void ta_set_parent(void *ptr, void *ta_parent)
+// Return the arena new children of h are allocated from, or NULL.
+static struct ta_arena *get_arena(struct ta_header *h)
+{
+    if (!h || !(h->size & TA_F_MASK))
+        return NULL;
+    if (h->size & TA_F_ARENA)
+        return PTR_FROM_HEADER(h);
+    return ARENA_FROM_HEADER(h);
+}
+
+static void unlink_header(struct ta_header *ch)
 {
-    struct ta_header *ch = get_header(ptr);
-    if (!ch)
-        return;
-    struct ta_header *new_parent = get_header(ta_parent);
     // Unlink from previous parent
     if (ch->prev)
         ch->prev->next = ch->next;
@@ -105,6 +137,30 @@ void ta_set_parent(void *ptr, void *ta_parent)
         }
     }
     ch->next = ch->prev = ch->parent = NULL;
+}
+
+/* Set the parent allocation of ptr. If parent==NULL, remove the parent.
+ * Setting parent==NULL (with ptr!=NULL) unsets the parent of ptr.
+ * With ptr==NULL, the function does nothing.
+ *
+ * Warning: if ta_parent is a direct or indirect child of ptr, things will go
+ *          wrong. The function will apparently succeed, but creates circular
+ *          parent links, which are not allowed.
+ */
+void ta_set_parent(void *ptr, void *ta_parent)
+{
+    struct ta_header *ch = get_header(ptr);
+    if (!ch)
+        return;
+    struct ta_header *new_parent = get_header(ta_parent);
+    struct ta_arena *arena = get_arena(new_parent);
+    if (ch->size & TA_F_IN_ARENA) {
+        // The memory is owned by the arena, it can't be moved out of it.
+        assert(arena == ARENA_FROM_HEADER(ch));
+    } else if (arena) {
+        arena->needs_walk = true;
+    }
+    unlink_header(ch);
     // Link to new parent - insert at start of list (LIFO destructor order)
     if (new_parent) {
         ch->next = new_parent->child;
@@ -127,6 +183,91 @@ void *ta_get_parent(void *ptr)
     return ch ? ch->parent : NULL;
 }
 
+static void link_header(struct ta_header *ch, struct ta_header *new_parent)
+{
+    if (new_parent) {
+        ch->next = new_parent->child;
+        if (ch->next) {
+            ch->next->prev = ch;
+            ch->next->parent = NULL;
+        }
+        new_parent->child = ch;
+        ch->parent = new_parent;
+    }
+}
+
+static void free_arena_chunks(struct ta_arena *arena)
+{
+    while (arena->chunk) {
+        struct ta_arena_chunk *prev = arena->chunk->prev;
+        free(arena->chunk);
+        arena->chunk = prev;
+    }
+    arena->cur = arena->end = NULL;
+    arena->needs_walk = false;
+}
+
+// Bump-allocate a block with the given user size from the arena.
+static struct ta_header *arena_alloc(struct ta_arena *arena, size_t size)
+{
+    size_t block = ARENA_BLOCK_SIZE(size);
+    char *mem;
+    if (block <= (size_t)(arena->end - arena->cur)) {
+        mem = arena->cur;
+        arena->cur += block;
+    } else {
+        // Large allocations get their own chunk, and don't use up the
+        // current one.
+        bool own = block > ARENA_CHUNK_SIZE / 4;
+        size_t chunk_size = own ? block : ARENA_CHUNK_SIZE;
+        union ta_arena_chunk_hdr *c =
+            malloc(sizeof(union ta_arena_chunk_hdr) + chunk_size);
+        if (!c)
+            return NULL;
+        mem = (char *)(c + 1);
+        if (own && arena->chunk) {
+            c->c.prev = arena->chunk->prev;
+            arena->chunk->prev = &c->c;
+        } else {
+            c->c.prev = arena->chunk;
+            arena->chunk = &c->c;
+            arena->cur = mem + block;
+            arena->end = mem + chunk_size;
+        }
+    }
+    ((union ta_arena_prefix *)mem)->arena = arena;
+    struct ta_header *h = &((union aligned_header *)
+                            (mem + sizeof(union ta_arena_prefix)))->ta;
+    *h = (struct ta_header) {.size = size | TA_F_IN_ARENA};
+    return h;
+}
+
+/* Create an arena: a context whose (direct and indirect) children are
+ * allocated from large chunks of memory owned by the arena, instead of with
+ * one malloc() each. Freeing the arena (or calling ta_free_children() on it)
+ * releases all of its memory at once, without visiting each allocation -
+ * unless some of them have destructors, or allocations not made from the
+ * arena were moved into it, in which case the tree is walked as usual.
+ *
+ * Freeing or shrinking single arena allocations does not return memory to the
+ * arena until it is freed. Arena allocations can't be moved to a parent that
+ * is not in the same arena.
+ *
+ * Useful for larger trees of short-lived temporary allocations.
+ */
+void *ta_new_arena(void *ta_parent)
+{
+    void *ptr = ta_zalloc_size(ta_parent, sizeof(struct ta_arena));
+    if (!ptr)
+        return NULL;
+    struct ta_header *h = get_header(ptr);
+    // The outer arena has to visit this one to free its chunks.
+    if (h->size & TA_F_IN_ARENA)
+        ARENA_FROM_HEADER(h)->needs_walk = true;
+    h->size |= TA_F_ARENA;
+    return ptr;
+}
+
 /* Allocate size bytes of memory. If ta_parent is not NULL, this is used as
  * parent allocation (if ta_parent is freed, this allocation is automatically
  * freed as well). size==0 allocates a block of size 0 (i.e. returns non-NULL).
@@ -136,6 +277,16 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    struct ta_header *parent = get_header(ta_parent);
+    struct ta_arena *arena = get_arena(parent);
+    if (arena) {
+        struct ta_header *h = arena_alloc(arena, size);
+        if (!h)
+            return NULL;
+        ta_dbg_add_arena(h);
+        link_header(h, parent);
+        return PTR_FROM_HEADER(h);
+    }
     struct ta_header *h = malloc(sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -153,6 +304,12 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    if (get_arena(get_header(ta_parent))) {
+        void *ptr = ta_alloc_size(ta_parent, size);
+        if (ptr)
+            memset(ptr, 0, size);
+        return ptr;
+    }
     struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -163,6 +320,50 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
     return ptr;
 }
 
+// Fix the links pointing to h after it was moved in memory.
+static void relink_header(struct ta_header *h)
+{
+    // Relink parent
+    if (h->parent)
+        h->parent->child = h;
+    // Relink siblings
+    if (h->next)
+        h->next->prev = h;
+    if (h->prev)
+        h->prev->next = h;
+    // Relink children
+    if (h->child)
+        h->child->parent = h;
+}
+
+static void *arena_realloc(struct ta_header *h, size_t size)
+{
+    struct ta_arena *arena = ARENA_FROM_HEADER(h);
+    size_t old_size = h->size & ~TA_F_MASK;
+    char *ptr = PTR_FROM_HEADER(h);
+    // Resize in place if it fits, or if it's the last allocation.
+    if (ARENA_ALIGN(size) <= ARENA_ALIGN(old_size) ||
+        (ptr + ARENA_ALIGN(old_size) == arena->cur &&
+         ARENA_ALIGN(size) - ARENA_ALIGN(old_size) <=
+            (size_t)(arena->end - arena->cur)))
+    {
+        if (ptr + ARENA_ALIGN(old_size) == arena->cur)
+            arena->cur = ptr + ARENA_ALIGN(size);
+        h->size = size | TA_F_IN_ARENA;
+        return ptr;
+    }
+    struct ta_header *nh = arena_alloc(arena, size);
+    if (!nh)
+        return NULL;
+    ta_dbg_remove(h);
+    memcpy(nh, h, sizeof(*h));
+    nh->size = size | TA_F_IN_ARENA;
+    ta_dbg_add_arena(nh);
+    memcpy(PTR_FROM_HEADER(nh), ptr, old_size < size ? old_size : size);
+    relink_header(nh);
+    return PTR_FROM_HEADER(nh);
+}
+
 /* Reallocate the allocation given by ptr and return a new pointer. Much like
  * realloc(), the returned pointer can be different, and on OOM, NULL is
  * returned.
@@ -187,27 +388,18 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
         return ta_alloc_size(ta_parent, size);
     struct ta_header *h = get_header(ptr);
     struct ta_header *old_h = h;
-    if (h->size == size)
+    if ((h->size & ~TA_F_MASK) == size)
         return ptr;
+    if (h->size & TA_F_IN_ARENA)
+        return arena_realloc(h, size);
     ta_dbg_remove(h);
     h = realloc(h, sizeof(union aligned_header) + size);
     ta_dbg_add(h ? h : old_h);
     if (!h)
         return NULL;
-    h->size = size;
-    if (h != old_h) {
-        // Relink parent
-        if (h->parent)
-            h->parent->child = h;
-        // Relink siblings
-        if (h->next)
-            h->next->prev = h;
-        if (h->prev)
-            h->prev->next = h;
-        // Relink children
-        if (h->child)
-            h->child->parent = h;
-    }
+    h->size = size | (h->size & TA_F_MASK);
+    if (h != old_h)
+        relink_header(h);
     return PTR_FROM_HEADER(h);
 }
 
@@ -218,7 +410,24 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
 size_t ta_get_size(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
-    return h ? h->size : 0;
+    return h ? h->size & ~TA_F_MASK : 0;
+}
+
+/* Return the size of ptr and all allocations that (recursively) have it as
+ * parent, including the ta headers. Allocations in arenas are counted with
+ * their size only, not with the unused space of the arena chunks.
+ * This is not thread-safe: nothing may allocate, free or reparent anything in
+ * the tree at the same time.
+ */
+size_t ta_get_tree_size(void *ptr)
+{
+    struct ta_header *h = get_header(ptr);
+    if (!h)
+        return 0;
+    size_t size = (h->size & ~TA_F_MASK) + sizeof(union aligned_header);
+    for (struct ta_header *c = h->child; c; c = c->next)
+        size += ta_get_tree_size(PTR_FROM_HEADER(c));
+    return size;
 }
 
 /* Free all allocations that (recursively) have ptr as parent allocation, but
@@ -227,6 +436,16 @@ size_t ta_get_size(void *ptr)
 void ta_free_children(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
+    if (h && (h->size & TA_F_ARENA)) {
+        struct ta_arena *arena = ptr;
+        // Nothing in the tree needs to be visited.
+        if (!arena->needs_walk)
+            h->child = NULL;
+        while (h->child)
+            ta_free(PTR_FROM_HEADER(h->child));
+        free_arena_chunks(arena);
+        return;
+    }
     while (h && h->child)
         ta_free(PTR_FROM_HEADER(h->child));
 }
@@ -241,9 +460,11 @@ void ta_free(void *ptr)
     if (h->destructor)
         h->destructor(ptr);
     ta_free_children(ptr);
-    ta_set_parent(ptr, NULL);
+    unlink_header(h);
     ta_dbg_remove(h);
-    free(h);
+    // Arena allocations are released with the arena.
+    if (!(h->size & TA_F_IN_ARENA))
+        free(h);
 }
 
 /* Set a destructor that is to be called when the given allocation is freed.
@@ -259,8 +480,11 @@ void ta_free(void *ptr)
 void ta_set_destructor(void *ptr, void (*destructor)(void *))
 {
     struct ta_header *h = get_header(ptr);
-    if (h)
+    if (h) {
         h->destructor = destructor;
+        if (destructor && (h->size & TA_F_IN_ARENA))
+            ARENA_FROM_HEADER(h)->needs_walk = true;
+    }
 }
 
 #if TA_MEMORY_DEBUGGING
@@ -285,6 +509,13 @@ static void ta_dbg_add(struct ta_header *h)
     }
 }
 
+// Arena allocations are not on the leak list, because freeing the arena
+// doesn't visit them. They're accounted as part of the arena's chunks.
+static void ta_dbg_add_arena(struct ta_header *h)
+{
+    h->canary = CANARY;
+}
+
 static void ta_dbg_check_header(struct ta_header *h)
 {
     if (h) {
@@ -313,7 +544,7 @@ static size_t get_children_size(struct ta_header *h)
 {
     size_t size = 0;
     for (struct ta_header *s = h->child; s; s = s->next)
-        size += s->size + get_children_size(s);
+        size += (s->size & ~TA_F_MASK) + get_children_size(s);
     return size;
 }
 
@@ -334,18 +565,19 @@ static void print_leak_report(void)
                 char name[50] = {0};
                 if (cur->name)
                     snprintf(name, sizeof(name), "%s", cur->name);
+                size_t cur_size = cur->size & ~TA_F_MASK;
                 if (cur->name == &allocation_is_string) {
                     snprintf(name, sizeof(name), "'%.*s'",
-                             (int)cur->size, (char *)PTR_FROM_HEADER(cur));
+                             (int)cur_size, (char *)PTR_FROM_HEADER(cur));
                 }
                 for (int n = 0; n < sizeof(name); n++) {
                     if (name[n] && name[n] < 0x20)
                         name[n] = '.';
                 }
                 fprintf(stderr, "  %-20p %10zu %10zu  %s\n",
-                        cur, cur->size, c_size, name);
+                        cur, cur_size, c_size, name);
             }
-            size += cur->size;
+            size += cur->size & ~TA_F_MASK;
             num_blocks += 1;
             // Unlink, and don't confuse valgrind by leaving live pointers.
             cur->leak_next->leak_prev = cur->leak_prev;
@@ -394,6 +626,7 @@ void *ta_dbg_mark_as_string(void *ptr)
 #else
 
 static void ta_dbg_add(struct ta_header *h){}
+static void ta_dbg_add_arena(struct ta_header *h){}
 static void ta_dbg_check_header(struct ta_header *h){}
 static void ta_dbg_remove(struct ta_header *h){}
 
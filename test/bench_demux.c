@@ -0,0 +1,211 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+
+#include "common/common.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/packet_pool.h"
+#include "misc/random.h"
+#include "osdep/timer.h"
+#include "player/client.h"
+#include "stream/stream.h"
+
+// Microbenchmarks for the demuxer packet cache, on a synthetic rawvideo
+// stream (every packet is a keyframe). Each result is printed as one JSON
+// object per line:
+//  {"bench": "<name>", "ops": <count>, "ns_per_op": <time>}
+
+#define FRAME_W 16
+#define FRAME_H 16
+#define FRAME_SIZE (FRAME_W * FRAME_H * 3 / 2) // I420
+#define FPS 25
+#define NUM_FRAMES 30000
+
+#define POOL_OPS 1000000
+#define POOL_BATCH 1000
+#define NUM_SEEKS 100000
+#define NUM_JOINS 50
+
+static mpv_handle *mpv;
+static struct mpv_global *global;
+static void *stream_data;
+
+static void report(const char *name, int64_t ops, int64_t start)
+{
+    double ns = (mp_time_ns() - start) / (double)MPMAX(ops, 1);
+    printf("{\"bench\": \"%s\", \"ops\": %"PRId64", \"ns_per_op\": %.2f}\n",
+           name, ops, ns);
+    fflush(stdout);
+}
+
+static void set_option(const char *name, const char *value)
+{
+    if (mpv_set_property_string(mpv, name, value) < 0) {
+        fprintf(stderr, "Setting %s=%s failed.\n", name, value);
+        exit(1);
+    }
+}
+
+static void bench_pool(const char *name, struct demux_packet_pool *pool)
+{
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < POOL_OPS; n++)
+        free_demux_packet(new_demux_packet(pool, 256));
+    report(mp_tprintf(80, "packet-pool/%s/single", name), POOL_OPS, start);
+
+    struct demux_packet **pkts = talloc_array(NULL, struct demux_packet *,
+                                              POOL_BATCH);
+    start = mp_time_ns();
+    for (int n = 0; n < POOL_OPS / POOL_BATCH; n++) {
+        for (int i = 0; i < POOL_BATCH; i++)
+            pkts[i] = new_demux_packet(pool, 256);
+        for (int i = 0; i < POOL_BATCH; i++)
+            free_demux_packet(pkts[i]);
+    }
+    report(mp_tprintf(80, "packet-pool/%s/batch", name), POOL_OPS, start);
+    talloc_free(pkts);
+}
+
+static struct demuxer *open_stream(struct stream **s)
+{
+    *s = stream_memory_open(global, stream_data, FRAME_SIZE * NUM_FRAMES);
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .force_format = "rawvideo",
+        .external_stream = *s,
+    };
+    struct demuxer *d = demux_open_url("memory://", &params, NULL, global);
+    if (!d) {
+        fprintf(stderr, "Opening the synthetic stream failed.\n");
+        exit(1);
+    }
+    for (int n = 0; n < demux_get_num_stream(d); n++)
+        demuxer_select_track(d, demux_get_stream(d, n), MP_NOPTS_VALUE, true);
+    return d;
+}
+
+static void close_stream(struct demuxer *d, struct stream *s)
+{
+    demux_free(d);
+    free_stream(s);
+}
+
+// Read until a packet with pts >= until (or EOF). Returns the number of
+// packets read.
+static int read_until(struct demuxer *d, double until)
+{
+    int num = 0;
+    while (1) {
+        struct demux_packet *dp = demux_read_any_packet(d);
+        if (!dp)
+            break;
+        num++;
+        bool done = dp->pts != MP_NOPTS_VALUE && dp->pts >= until;
+        free_demux_packet(dp);
+        if (done)
+            break;
+    }
+    return num;
+}
+
+// Reading with a small back buffer: prune_old_packets() runs on every read.
+static void bench_prune(void)
+{
+    set_option("demuxer-max-back-bytes", "256KiB");
+
+    struct stream *s;
+    struct demuxer *d = open_stream(&s);
+    int64_t start = mp_time_ns();
+    int num = read_until(d, INFINITY);
+    report("demux-cache/read-prune", num, start);
+    close_stream(d, s);
+
+    set_option("demuxer-max-back-bytes", "1GiB");
+}
+
+// Cached seeks to random positions: find_cache_seek_range() and
+// find_seek_target() with the whole file in the cache.
+static void bench_seek(void)
+{
+    struct stream *s;
+    struct demuxer *d = open_stream(&s);
+    read_until(d, INFINITY);
+
+    mp_rand_state rnd = mp_rand_seed(0);
+    double duration = NUM_FRAMES / (double)FPS;
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        double pts = mp_rand_next_double(&rnd) * duration;
+        if (!demux_seek(d, pts, SEEK_CACHED | ((n & 1) ? SEEK_FORWARD : 0))) {
+            fprintf(stderr, "Cached seek to %f failed.\n", pts);
+            exit(1);
+        }
+    }
+    report("demux-cache/cached-seek", NUM_SEEKS, start);
+    close_stream(d, s);
+}
+
+// Create a second cache range with a low level seek, then go back and read
+// until the first range reaches it and both are merged.
+static void bench_join(void)
+{
+    struct stream *s;
+    struct demuxer *d = open_stream(&s);
+
+    double end = 10;
+    read_until(d, end);
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < NUM_JOINS; n++) {
+        demux_seek(d, end + 10, 0);
+        read_until(d, end + 20);
+        demux_seek(d, end - 1, SEEK_CACHED);
+        read_until(d, end + 20);
+        end += 20;
+    }
+    report("demux-cache/range-join", NUM_JOINS, start);
+
+    struct demux_reader_state rs;
+    demux_get_reader_state(d, &rs);
+    if (rs.num_seek_ranges != 1) {
+        fprintf(stderr, "Warning: ranges were not joined (%d ranges).\n",
+                rs.num_seek_ranges);
+    }
+    close_stream(d, s);
+}
+
+int main(int argc, char *argv[])
+{
+    mpv = mpv_create();
+    if (!mpv)
+        return 1;
+    mpv_set_option_string(mpv, "config", "no");
+    mpv_set_option_string(mpv, "cache", "yes");
+    mpv_set_option_string(mpv, "demuxer-max-bytes", "1GiB");
+    mpv_set_option_string(mpv, "demuxer-max-back-bytes", "1GiB");
+    mpv_set_option_string(mpv, "demuxer-rawvideo-w", mp_tprintf(16, "%d", FRAME_W));
+    mpv_set_option_string(mpv, "demuxer-rawvideo-h", mp_tprintf(16, "%d", FRAME_H));
+    mpv_set_option_string(mpv, "demuxer-rawvideo-fps", mp_tprintf(16, "%d", FPS));
+    if (mpv_initialize(mpv) < 0)
+        return 1;
+    global = mp_client_get_global(mpv);
+
+    stream_data = talloc_zero_size(NULL, FRAME_SIZE * NUM_FRAMES);
+
+    struct demux_packet_pool *pool = demux_packet_pool_get(global);
+    bench_pool("shared", pool);
+    struct demux_packet_pool *local = demux_packet_pool_create_local(NULL, pool);
+    bench_pool("local", local);
+    talloc_free(local);
+
+    bench_prune();
+    bench_seek();
+    bench_join();
+
+    talloc_free(stream_data);
+    mpv_destroy(mpv);
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <mpv/client.h>
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "common/common.h"
+#include "filters/f_async_queue.h"
+#include "filters/filter.h"
+#include "filters/filter_internal.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "player/client.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+// Fixed per-frame cost of the filter graph: chains of passthrough filters
+// between a source and a sink, optionally split into several graphs (each
+// running on its own thread) by async queues, with tiny audio and video
+// frames. Each result is printed as one JSON object per line:
+//  {"bench": "<name>", "frames": <count>, "ns_per_frame": <time>, ...}
+// ns_per_frame_per_filter and ns_per_handoff are relative to the chain with
+// no filters and no queues.
+
+#define NUM_FRAMES 100000
+#define MAX_SEGMENTS 8
+
+static const int num_filters[] = {0, 1, 4, 16, 64};
+static const int num_queues[] = {0, 1, 3};
+
+static struct mpv_global *global;
+
+// One filter graph, run on its own thread for all but the last segment.
+struct segment {
+    struct mp_filter *root;
+    mp_thread thread;
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool need_run;
+    bool terminate;
+};
+
+struct source_priv {
+    struct mp_frame frame;
+    int remaining;
+};
+
+struct sink_priv {
+    bool eof;
+};
+
+static void source_process(struct mp_filter *f)
+{
+    struct source_priv *p = f->priv;
+
+    if (!mp_pin_in_needs_data(f->ppins[0]))
+        return;
+
+    if (p->remaining > 0) {
+        mp_pin_in_write(f->ppins[0], mp_frame_ref(p->frame));
+    } else if (p->remaining == 0) {
+        mp_pin_in_write(f->ppins[0], MP_EOF_FRAME);
+    }
+    p->remaining--;
+}
+
+static const struct mp_filter_info source_filter = {
+    .name = "bench_source",
+    .priv_size = sizeof(struct source_priv),
+    .process = source_process,
+};
+
+static void sink_process(struct mp_filter *f)
+{
+    struct sink_priv *p = f->priv;
+
+    while (!p->eof && mp_pin_out_request_data(f->ppins[0])) {
+        struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+        p->eof = frame.type == MP_FRAME_EOF;
+        mp_frame_unref(&frame);
+    }
+}
+
+static const struct mp_filter_info sink_filter = {
+    .name = "bench_sink",
+    .priv_size = sizeof(struct sink_priv),
+    .process = sink_process,
+};
+
+static void passthrough_process(struct mp_filter *f)
+{
+    mp_pin_transfer_data(f->ppins[1], f->ppins[0]);
+}
+
+static const struct mp_filter_info passthrough_filter = {
+    .name = "bench_passthrough",
+    .process = passthrough_process,
+};
+
+static void wakeup_segment(void *ctx)
+{
+    struct segment *s = ctx;
+    mp_mutex_lock(&s->lock);
+    s->need_run = true;
+    mp_cond_signal(&s->wakeup);
+    mp_mutex_unlock(&s->lock);
+}
+
+// Returns false if the segment was terminated.
+static bool wait_segment(struct segment *s)
+{
+    mp_mutex_lock(&s->lock);
+    while (!s->need_run && !s->terminate)
+        mp_cond_wait(&s->wakeup, &s->lock);
+    s->need_run = false;
+    bool terminate = s->terminate;
+    mp_mutex_unlock(&s->lock);
+    return !terminate;
+}
+
+static MP_THREAD_VOID segment_thread(void *ctx)
+{
+    struct segment *s = ctx;
+    mp_thread_set_name("bench/filter");
+    while (wait_segment(s))
+        mp_filter_graph_run(s->root);
+    MP_THREAD_RETURN();
+}
+
+static struct mp_filter *create_filter(struct mp_filter *parent,
+                                       const struct mp_filter_info *info,
+                                       bool in, bool out)
+{
+    struct mp_filter *f = mp_filter_create(parent, info);
+    if (!f)
+        abort();
+    if (in)
+        mp_filter_add_pin(f, MP_PIN_IN, "in");
+    if (out)
+        mp_filter_add_pin(f, MP_PIN_OUT, "out");
+    return f;
+}
+
+// Push NUM_FRAMES copies of frame through filters passthrough filters, with
+// queues async queue boundaries evenly distributed between them. Returns the
+// time per frame in nanoseconds.
+static double run_chain(struct mp_frame frame, int filters, int queues)
+{
+    struct segment segs[MAX_SEGMENTS] = {0};
+    int num_segs = queues + 1;
+    mp_assert(num_segs <= MAX_SEGMENTS);
+
+    for (int n = 0; n < num_segs; n++) {
+        struct segment *s = &segs[n];
+        mp_mutex_init(&s->lock);
+        mp_cond_init(&s->wakeup);
+        s->need_run = true;
+        s->root = mp_filter_create_root(global);
+        mp_filter_graph_set_wakeup_cb(s->root, wakeup_segment, s);
+    }
+
+    struct mp_filter *source =
+        create_filter(segs[0].root, &source_filter, false, true);
+    struct source_priv *src = source->priv;
+    src->frame = frame;
+    src->remaining = NUM_FRAMES;
+
+    struct mp_pin *pin = source->pins[0];
+    for (int n = 0; n < num_segs; n++) {
+        struct mp_filter *root = segs[n].root;
+        int end = (n + 1) * filters / num_segs;
+        for (int i = n * filters / num_segs; i < end; i++) {
+            struct mp_filter *f =
+                create_filter(root, &passthrough_filter, true, true);
+            mp_pin_connect(f->pins[0], pin);
+            pin = f->pins[1];
+        }
+        if (n + 1 < num_segs) {
+            struct mp_async_queue *q = mp_async_queue_create();
+            mp_async_queue_set_config(q, (struct mp_async_queue_config){
+                .max_bytes = 1024 * 1024,
+                .max_samples = 16,
+            });
+            struct mp_filter *q_in =
+                mp_async_queue_create_filter(root, MP_PIN_IN, q);
+            struct mp_filter *q_out =
+                mp_async_queue_create_filter(segs[n + 1].root, MP_PIN_OUT, q);
+            mp_pin_connect(q_in->pins[0], pin);
+            pin = q_out->pins[0];
+            mp_async_queue_resume(q);
+            // The filters keep a reference.
+            talloc_free(q);
+        }
+    }
+
+    struct segment *last = &segs[num_segs - 1];
+    struct mp_filter *sink = create_filter(last->root, &sink_filter, true, false);
+    struct sink_priv *dst = sink->priv;
+    mp_pin_connect(sink->pins[0], pin);
+
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < num_segs - 1; n++) {
+        if (mp_thread_create(&segs[n].thread, segment_thread, &segs[n]))
+            abort();
+    }
+    while (wait_segment(last)) {
+        mp_filter_graph_run(last->root);
+        if (dst->eof)
+            break;
+    }
+    double ns = (mp_time_ns() - start) / (double)NUM_FRAMES;
+
+    for (int n = 0; n < num_segs - 1; n++) {
+        struct segment *s = &segs[n];
+        mp_mutex_lock(&s->lock);
+        s->terminate = true;
+        mp_cond_signal(&s->wakeup);
+        mp_mutex_unlock(&s->lock);
+        mp_thread_join(s->thread);
+    }
+    for (int n = 0; n < num_segs; n++) {
+        talloc_free(segs[n].root);
+        mp_cond_destroy(&segs[n].wakeup);
+        mp_mutex_destroy(&segs[n].lock);
+    }
+    return ns;
+}
+
+static void bench_frame(const char *type, struct mp_frame frame)
+{
+    double base = 0;
+    for (int q = 0; q < MP_ARRAY_SIZE(num_queues); q++) {
+        double no_filters = 0;
+        for (int f = 0; f < MP_ARRAY_SIZE(num_filters); f++) {
+            int filters = num_filters[f], queues = num_queues[q];
+            double ns = run_chain(frame, filters, queues);
+            if (!filters) {
+                no_filters = ns;
+                if (!queues)
+                    base = ns;
+            }
+            printf("{\"bench\": \"filter-chain/%s/filters=%d/queues=%d\", "
+                   "\"frames\": %d, \"ns_per_frame\": %.2f", type, filters,
+                   queues, NUM_FRAMES, ns);
+            if (filters) {
+                printf(", \"ns_per_frame_per_filter\": %.2f",
+                       (ns - no_filters) / filters);
+            } else if (queues) {
+                printf(", \"ns_per_handoff\": %.2f", (ns - base) / queues);
+            }
+            printf("}\n");
+            fflush(stdout);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    mpv_handle *mpv = mpv_create();
+    if (!mpv)
+        return 1;
+    mpv_set_option_string(mpv, "config", "no");
+    if (mpv_initialize(mpv) < 0)
+        return 1;
+    global = mp_client_get_global(mpv);
+
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, 2, 2);
+    if (!img)
+        return 1;
+    bench_frame("video", MAKE_FRAME(MP_FRAME_VIDEO, img));
+    talloc_free(img);
+
+    struct mp_aframe *aframe = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, 1);
+    if (!mp_aframe_set_format(aframe, AF_FORMAT_FLOAT) ||
+        !mp_aframe_set_chmap(aframe, &chmap) ||
+        !mp_aframe_set_rate(aframe, 48000) ||
+        !mp_aframe_alloc_data(aframe, 1))
+        return 1;
+    bench_frame("audio", MAKE_FRAME(MP_FRAME_AUDIO, aframe));
+    talloc_free(aframe);
+
+    mpv_destroy(mpv);
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mpv/client.h>
+
+#include "common/common.h"
+#include "demux/demux.h"
+#include "osdep/timer.h"
+#include "player/client.h"
+#include "player/core.h"
+#include "stream/stream.h"
+#include "sub/dec_sub.h"
+#include "sub/draw_bmp.h"
+#include "sub/osd.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+// Subtitle rendering cost on a generated corpus of heavy ASS scripts, played
+// at 25 fps on a 1920x1080 screen, in two modes:
+//  sw:  osd_render() and draw_bmp onto a yuv420p frame (VOs without GPU OSD,
+//       --vf=sub, encoding)
+//  gpu: osd_render() with the formats of the GPU OSD, and the number of bytes
+//       it needs to upload (full packed image on size changes, otherwise only
+//       the changed bands of rows, like video/out/gpu/osd.c)
+// Each result is printed as one JSON object per line:
+//  {"bench": "<name>", "frames": <count>, "render_ms": <time>, ...}
+// All values except frames are averages per frame.
+
+#define FPS 25
+#define DURATION 10
+#define NUM_FRAMES (FPS * DURATION)
+#define SCREEN_W 1920
+#define SCREEN_H 1080
+
+// Keep in sync with video/out/gpu/osd.c.
+#define OSD_BAND_H 16
+
+static struct mpv_global *global;
+
+static const char header[] =
+    "[Script Info]\n"
+    "ScriptType: v4.00+\n"
+    "PlayResX: 1920\n"
+    "PlayResY: 1080\n"
+    "WrapStyle: 0\n"
+    "\n"
+    "[V4+ Styles]\n"
+    "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, "
+    "OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, ScaleX, "
+    "ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, Alignment, "
+    "MarginL, MarginR, MarginV, Encoding\n"
+    "Style: Default,sans-serif,64,&H00FFFFFF,&H000000FF,&H00000000,"
+    "&H80000000,0,0,0,0,100,100,0,0,1,3,2,2,40,40,40,1\n"
+    "Style: Small,sans-serif,24,&H00FFFFFF,&H000000FF,&H00000000,"
+    "&H80000000,0,0,0,0,100,100,0,0,1,1,0,7,0,0,0,1\n"
+    "\n"
+    "[Events]\n"
+    "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, "
+    "Effect, Text\n";
+
+static void add_event(char **s, int layer, double start, double end,
+                      const char *style, const char *text)
+{
+    int a = start * 100 + 0.5, b = end * 100 + 0.5;
+    *s = talloc_asprintf_append(*s,
+        "Dialogue: %d,%d:%02d:%02d.%02d,%d:%02d:%02d.%02d,%s,,0,0,0,,%s\n",
+        layer, a / 360000, a / 6000 % 60, a / 100 % 60, a % 100,
+        b / 360000, b / 6000 % 60, b / 100 % 60, b % 100, style, text);
+}
+
+// Two lines at a time, each with per-syllable fill and scale effects.
+static char *gen_karaoke(void *ta_parent)
+{
+    char *s = talloc_strdup(ta_parent, header);
+    for (int t = 0; t < DURATION; t += 2) {
+        for (int line = 0; line < 2; line++) {
+            char *text = talloc_strdup(NULL, line ? "{\\an8\\blur2\\bord4}"
+                                                  : "{\\blur2\\bord4}");
+            for (int n = 0; n < 24; n++) {
+                int st = n * 80;
+                text = talloc_asprintf_append(text,
+                    "{\\kf8\\t(%d,%d,\\fscx120\\fscy120)"
+                    "\\t(%d,%d,\\fscx100\\fscy100)}ka%s",
+                    st, st + 40, st + 40, st + 80, n % 3 == 2 ? " " : "");
+            }
+            add_event(&s, line, t, t + 2, "Default", text);
+            talloc_free(text);
+        }
+    }
+    return s;
+}
+
+// Frame-by-frame typesetting (as produced by motion tracking): a new set of
+// rotated, blurred, clipped signs and vector drawings on every frame.
+static char *gen_typesetting(void *ta_parent)
+{
+    char *s = talloc_strdup(ta_parent, header);
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        double t = f / (double)FPS;
+        for (int n = 0; n < 10; n++) {
+            int x = 100 + n * 170 + f % 50, y = 150 + (n % 5) * 180 + f % 30;
+            char *text = talloc_asprintf(NULL,
+                "{\\pos(%d,%d)\\frz%d\\blur4\\bord6\\clip(%d,%d,%d,%d)}Sign %d"
+                "{\\p1\\c&H3080F0&}m 0 0 l 200 0 200 60 100 120 0 60{\\p0}",
+                x, y, (f * 3 + n * 20) % 360, x - 150, y - 100, x + 150,
+                y + 60, n);
+            add_event(&s, n, t, t + 1.0 / FPS, "Default", text);
+            talloc_free(text);
+        }
+    }
+    return s;
+}
+
+// A large number of small events on screen at the same time, all moving.
+static char *gen_many_events(void *ta_parent)
+{
+    char *s = talloc_strdup(ta_parent, header);
+    for (int n = 0; n < 1000; n++) {
+        int x = (n % 25) * 76, y = (n / 25) * 27;
+        char *text = talloc_asprintf(NULL, "{\\move(%d,%d,%d,%d)}event %d",
+                                     x, y, x + 40, y + 10, n);
+        add_event(&s, 0, 0, DURATION, "Small", text);
+        talloc_free(text);
+    }
+    return s;
+}
+
+static const struct corpus {
+    const char *name;
+    char *(*generate)(void *ta_parent);
+} corpora[] = {
+    {"karaoke", gen_karaoke},
+    {"typesetting", gen_typesetting},
+    {"many-events", gen_many_events},
+};
+
+struct stats {
+    double render, draw;
+    int64_t bitmaps, area, upload;
+};
+
+// Last uploaded state of each OSD part, as in video/out/gpu/osd.c.
+struct gpu_part {
+    int change_id;
+    struct mp_image *shadow;
+};
+
+static int64_t upload_bytes(struct gpu_part *part, struct sub_bitmaps *imgs)
+{
+    if (!imgs->packed || imgs->change_id == part->change_id)
+        return 0;
+    part->change_id = imgs->change_id;
+
+    struct mp_image *src = imgs->packed;
+    int w = imgs->packed_w, h = imgs->packed_h;
+    size_t row_bytes = (size_t)w * src->fmt.bpp[0] / 8;
+    struct mp_image *shadow = part->shadow;
+    int64_t bytes = 0;
+
+    if (shadow && shadow->imgfmt == src->imgfmt && shadow->w == w &&
+        shadow->h == h)
+    {
+        for (int y = 0; y < h; y += OSD_BAND_H) {
+            int band_h = MPMIN(OSD_BAND_H, h - y);
+            bool changed = false;
+            for (int r = y; r < y + band_h && !changed; r++) {
+                changed = memcmp(src->planes[0] + r * src->stride[0],
+                                 shadow->planes[0] + r * shadow->stride[0],
+                                 row_bytes);
+            }
+            if (changed)
+                bytes += row_bytes * band_h;
+        }
+    } else {
+        talloc_free(part->shadow);
+        part->shadow = shadow = mp_image_alloc(src->imgfmt, w, h);
+        bytes = row_bytes * h;
+    }
+    if (shadow) {
+        memcpy_pic(shadow->planes[0], src->planes[0], row_bytes, h,
+                   shadow->stride[0], src->stride[0]);
+    }
+    return bytes;
+}
+
+static void report(const char *corpus, const char *mode, struct stats *st)
+{
+    printf("{\"bench\": \"sub/%s/%s\", \"frames\": %d, \"render_ms\": %.3f",
+           corpus, mode, NUM_FRAMES, st->render / NUM_FRAMES * 1e3);
+    if (st->draw)
+        printf(", \"draw_ms\": %.3f", st->draw / NUM_FRAMES * 1e3);
+    printf(", \"bitmaps\": %.1f, \"area\": %"PRId64, st->bitmaps /
+           (double)NUM_FRAMES, st->area / NUM_FRAMES);
+    if (st->upload)
+        printf(", \"upload_bytes\": %"PRId64, st->upload / NUM_FRAMES);
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void bench_corpus(const struct corpus *c, bool gpu)
+{
+    void *ta_ctx = talloc_new(NULL);
+    char *data = c->generate(ta_ctx);
+
+    struct stream *s = stream_memory_open(global, data, strlen(data));
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .external_stream = s,
+    };
+    struct demuxer *d = demux_open_url("memory://", &params, NULL, global);
+    struct sh_stream *sh = d && demux_get_num_stream(d) ?
+                           demux_get_stream(d, 0) : NULL;
+    if (!sh || sh->type != STREAM_SUB) {
+        fprintf(stderr, "Opening the %s script failed.\n", c->name);
+        exit(1);
+    }
+    demuxer_select_track(d, sh, MP_NOPTS_VALUE, true);
+
+    struct track track = {.type = STREAM_SUB, .stream = sh, .demuxer = d};
+    struct dec_sub *dec = sub_create(global, &track, NULL, 0);
+    if (!dec) {
+        fprintf(stderr, "Creating the %s decoder failed.\n", c->name);
+        exit(1);
+    }
+    sub_select(dec, true);
+
+    struct osd_state *osd = osd_create(global);
+    osd_set_sub(osd, 0, dec);
+
+    struct mp_osd_res res = {.w = SCREEN_W, .h = SCREEN_H, .display_par = 1};
+    const bool gpu_formats[SUBBITMAP_COUNT] = {
+        [SUBBITMAP_LIBASS] = true,
+        [SUBBITMAP_BGRA] = true,
+    };
+    struct mp_image *frame = mp_image_alloc(IMGFMT_420P, SCREEN_W, SCREEN_H);
+    struct mp_draw_sub_cache *cache = mp_draw_sub_alloc(ta_ctx, global);
+    struct gpu_part parts[MAX_OSD_PARTS] = {0};
+    struct stats st = {0};
+
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        double pts = f / (double)FPS;
+        bool packets_read = false, updated;
+        while (!packets_read)
+            sub_read_packets(dec, pts, true, &packets_read, &updated);
+
+        int64_t start = mp_time_ns();
+        struct sub_bitmap_list *list =
+            osd_render(osd, res, pts, 0, gpu ? gpu_formats : mp_draw_sub_formats);
+        int64_t rendered = mp_time_ns();
+        st.render += MP_TIME_NS_TO_S(rendered - start);
+
+        if (gpu) {
+            for (int n = 0; n < list->num_items; n++) {
+                struct sub_bitmaps *imgs = list->items[n];
+                mp_assert(imgs->render_index < MAX_OSD_PARTS);
+                st.upload += upload_bytes(&parts[imgs->render_index], imgs);
+            }
+        } else if (list->num_items) {
+            mp_draw_sub_bitmaps(cache, frame, list);
+            st.draw += MP_TIME_NS_TO_S(mp_time_ns() - rendered);
+        }
+
+        for (int n = 0; n < list->num_items; n++) {
+            struct sub_bitmaps *imgs = list->items[n];
+            st.bitmaps += imgs->num_parts;
+            for (int i = 0; i < imgs->num_parts; i++)
+                st.area += (int64_t)imgs->parts[i].dw * imgs->parts[i].dh;
+        }
+        talloc_free(list);
+    }
+
+    report(c->name, gpu ? "gpu" : "sw", &st);
+
+    for (int n = 0; n < MAX_OSD_PARTS; n++)
+        talloc_free(parts[n].shadow);
+    talloc_free(frame);
+    osd_set_sub(osd, 0, NULL);
+    osd_free(osd);
+    sub_destroy(dec);
+    demux_free(d);
+    free_stream(s);
+    talloc_free(ta_ctx);
+}
+
+int main(int argc, char *argv[])
+{
+    mpv_handle *mpv = mpv_create();
+    if (!mpv)
+        return 1;
+    mpv_set_option_string(mpv, "config", "no");
+    if (mpv_initialize(mpv) < 0)
+        return 1;
+    global = mp_client_get_global(mpv);
+
+    for (int n = 0; n < MP_ARRAY_SIZE(corpora); n++) {
+        bench_corpus(&corpora[n], false);
+        bench_corpus(&corpora[n], true);
+    }
+
+    mpv_destroy(mpv);
+    return 0;
+}
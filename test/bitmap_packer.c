@@ -0,0 +1,126 @@
+#include "misc/random.h"
+#include "mpv_talloc.h"
+#include "test_utils.h"
+#include "video/out/bitmap_packer.h"
+
+#define MAX_RECTS 64
+
+static mp_rand_state rnd;
+
+// Check that all rectangles are inside the packer and the bounding box, and
+// that none of them overlap (including padding).
+static void check_layout(struct bitmap_packer *p, struct pos *sizes)
+{
+    struct pos bb[2];
+    packer_get_bb(p, bb);
+    assert_true(bb[1].x <= p->w && bb[1].y <= p->h);
+    int pad = p->padding;
+    for (int i = 0; i < p->count; i++) {
+        if (!sizes[i].x || !sizes[i].y)
+            continue;
+        int x0 = p->result[i].x - pad, y0 = p->result[i].y - pad;
+        int x1 = p->result[i].x + sizes[i].x + pad;
+        int y1 = p->result[i].y + sizes[i].y + pad;
+        assert_true(x0 >= 0 && y0 >= 0);
+        assert_true(x1 <= bb[1].x && y1 <= bb[1].y);
+        for (int j = 0; j < i; j++) {
+            if (!sizes[j].x || !sizes[j].y)
+                continue;
+            int u0 = p->result[j].x - pad, v0 = p->result[j].y - pad;
+            int u1 = p->result[j].x + sizes[j].x + pad;
+            int v1 = p->result[j].y + sizes[j].y + pad;
+            assert_true(x1 <= u0 || u1 <= x0 || y1 <= v0 || v1 <= y0);
+        }
+    }
+}
+
+static int pack(struct bitmap_packer *p, struct pos *sizes, uint64_t *keys,
+                int num)
+{
+    packer_set_size(p, num);
+    for (int i = 0; i < num; i++)
+        p->in[i] = sizes[i];
+    int r = keys ? packer_pack_stable(p, keys) : packer_pack(p);
+    assert_true(r >= 0);
+    check_layout(p, sizes);
+    return r;
+}
+
+static void random_rect(struct pos *size, uint64_t *key)
+{
+    *size = (struct pos){mp_rand_in_range32(&rnd, 1, 200),
+                         mp_rand_in_range32(&rnd, 0, 40)};
+    *key = mp_rand_next(&rnd);
+}
+
+int main(void)
+{
+    rnd = mp_rand_seed(0);
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    p->w_max = p->h_max = 4096;
+    p->padding = 1;
+
+    struct pos sizes[MAX_RECTS];
+    uint64_t keys[MAX_RECTS];
+    struct pos prev[MAX_RECTS];
+    int num = 0;
+
+    for (int n = 0; n < MAX_RECTS / 2; n++)
+        random_rect(&sizes[num], &keys[num]), num++;
+    pack(p, sizes, NULL, num);
+    pack(p, sizes, keys, num);
+
+    // Replace, add and remove a few rectangles each time, like subtitle
+    // lines changing. Rectangles that stay keep their position, unless the
+    // packer had to start over.
+    int repacks = 0;
+    for (int iter = 0; iter < 1000; iter++) {
+        int w = p->w, h = p->h;
+        memcpy(prev, p->result, sizeof(prev[0]) * num);
+        bool kept[MAX_RECTS] = {0};
+        for (int i = 0; i < num; i++)
+            kept[i] = mp_rand_next_double(&rnd) < 0.8;
+        for (int i = 0; i < num; i++) {
+            if (!kept[i])
+                random_rect(&sizes[i], &keys[i]);
+        }
+        if (num < MAX_RECTS && mp_rand_next_double(&rnd) < 0.3) {
+            random_rect(&sizes[num], &keys[num]);
+            kept[num++] = false;
+        }
+        if (num > 1 && mp_rand_next_double(&rnd) < 0.3) {
+            // Drop the last one; the others keep their index.
+            num--;
+        }
+
+        struct pos bb_old[2];
+        packer_get_bb(p, bb_old);
+        pack(p, sizes, keys, num);
+        struct pos bb[2];
+        packer_get_bb(p, bb);
+
+        bool repacked = false;
+        for (int i = 0; i < num; i++) {
+            if (kept[i] && sizes[i].x && sizes[i].y &&
+                (p->result[i].x != prev[i].x || p->result[i].y != prev[i].y))
+                repacked = true;
+        }
+        if (repacked) {
+            repacks++;
+        } else {
+            assert_int_equal(p->w, w);
+            assert_int_equal(p->h, h);
+            assert_true(bb[1].x >= bb_old[1].x && bb[1].y >= bb_old[1].y);
+        }
+    }
+    // Most packs should reuse the previous layout.
+    assert_true(repacks < 500);
+
+    // A rectangle larger than the packer forces a full repack.
+    sizes[0] = (struct pos){p->w + 1, 10};
+    pack(p, sizes, keys, num);
+    assert_true(p->w > sizes[0].x);
+
+    talloc_free(p);
+    return 0;
+}
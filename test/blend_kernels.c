@@ -0,0 +1,191 @@
+#include <libavutil/cpu.h>
+
+#include "misc/random.h"
+#include "osdep/timer.h"
+#include "sub/blend_kernels.h"
+#include "test_utils.h"
+
+#define MAX_PIXELS 1031
+#define BENCH_PIXELS (1 << 16)
+#define BENCH_RUNS 500
+
+// Flags to mask out from the detected CPU flags, selecting each code path.
+static const struct {
+    const char *name;
+    int mask;
+} levels[] = {
+    {"native", 0},
+    {"no-avx", AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2},
+    {"c", ~0},
+};
+
+static mp_rand_state rnd;
+
+static void fill_random(void *data, size_t size)
+{
+    uint8_t *ptr = data;
+    for (size_t n = 0; n < size; n++)
+        ptr[n] = mp_rand_next(&rnd);
+}
+
+// Premultiplied alpha: no component is larger than the alpha.
+static void fill_premul(uint8_t *color, uint8_t *alpha, int alpha_stride,
+                        int num)
+{
+    for (int n = 0; n < num; n++) {
+        unsigned a = alpha[n * alpha_stride];
+        color[n] = a ? color[n] % (a + 1) : 0;
+    }
+}
+
+static void test_f32(int num)
+{
+    float dst[MAX_PIXELS] = {0}, src[MAX_PIXELS] = {0}, src_a[MAX_PIXELS] = {0};
+    float ref[MAX_PIXELS];
+    for (int n = 0; n < num; n++) {
+        src_a[n] = mp_rand_next_double(&rnd);
+        src[n] = src_a[n] * mp_rand_next_double(&rnd);
+        dst[n] = mp_rand_next_double(&rnd);
+    }
+
+    for (int n = 0; n < num; n++)
+        ref[n] = src[n] + dst[n] * (1.0f - src_a[n]);
+    mp_blend_f32(dst, src, src_a, num);
+    for (int n = 0; n < num; n++)
+        assert_float_equal(dst[n], ref[n], 1e-6);
+}
+
+static void test_u8(int num)
+{
+    uint8_t dst[MAX_PIXELS], src[MAX_PIXELS], src_a[MAX_PIXELS], ref[MAX_PIXELS];
+    fill_random(dst, num);
+    fill_random(src, num);
+    fill_random(src_a, num);
+    // Include the extremes, and one pixel which isn't valid premultiplied
+    // alpha and overflows.
+    if (num > 3) {
+        src_a[0] = 0;
+        src_a[1] = 255;
+        src[2] = 255;
+        src_a[2] = 0;
+        dst[2] = 255;
+    }
+    fill_premul(src + 3, src_a + 3, 1, MPMAX(num - 3, 0));
+
+    for (int n = 0; n < num; n++)
+        ref[n] = src[n] + dst[n] * (255u - src_a[n]) / 255u;
+    mp_blend_u8(dst, src, src_a, num);
+    assert_memcmp(dst, ref, num);
+}
+
+static void test_bgra(int num)
+{
+    uint32_t dst[MAX_PIXELS], src[MAX_PIXELS], ref[MAX_PIXELS];
+    fill_random(dst, num * 4);
+    fill_random(src, num * 4);
+    for (int n = 0; n < num; n++) {
+        uint32_t a = src[n] >> 24;
+        uint32_t c = src[n];
+        uint32_t pix = a << 24;
+        for (int i = 0; i < 24; i += 8)
+            pix |= (a ? ((c >> i) & 0xFF) % (a + 1) : 0) << i;
+        src[n] = pix;
+    }
+
+    for (int n = 0; n < num; n++) {
+        unsigned sa = src[n] >> 24;
+        uint32_t pix = 0;
+        for (int i = 0; i < 32; i += 8) {
+            unsigned s = (src[n] >> i) & 0xFF;
+            unsigned d = (dst[n] >> i) & 0xFF;
+            pix |= (uint32_t)((s + d * (255 - sa) / 255) & 0xFF) << i;
+        }
+        ref[n] = pix;
+    }
+    mp_blend_bgra(dst, src, num);
+    assert_memcmp(dst, ref, num * 4);
+}
+
+static void test_ass(int num, uint32_t color)
+{
+    uint32_t dst[MAX_PIXELS], ref[MAX_PIXELS];
+    uint8_t src[MAX_PIXELS];
+    fill_random(dst, num * 4);
+    fill_random(src, num);
+    if (num > 1) {
+        src[0] = 0;
+        src[1] = 255;
+    }
+
+    unsigned a = 255 - (color & 0xFF);
+    unsigned c[4] = {(color >> 8) & 0xFF, (color >> 16) & 0xFF,
+                     (color >> 24) & 0xFF, 255};
+    for (int n = 0; n < num; n++) {
+        unsigned aa = a * src[n];
+        uint32_t pix = 0;
+        for (int i = 0; i < 4; i++) {
+            unsigned d = (dst[n] >> (i * 8)) & 0xFF;
+            pix |= (uint32_t)((src[n] * c[i] * a + d * (255 * 255 - aa)) /
+                              (255 * 255)) << (i * 8);
+        }
+        ref[n] = pix;
+    }
+    mp_blend_ass(dst, src, num, color);
+    assert_memcmp(dst, ref, num * 4);
+}
+
+static void run_tests(void)
+{
+    static const uint32_t colors[] = {0xFFFFFF00, 0x00000000, 0xFFFFFFFF,
+                                      0x12345678, 0xFF00FF80};
+    for (int num = 0; num < MAX_PIXELS; num = num < 40 ? num + 1 : num * 2 + 1) {
+        test_f32(num);
+        test_u8(num);
+        test_bgra(num);
+        for (int n = 0; n < MP_ARRAY_SIZE(colors); n++)
+            test_ass(num, colors[n]);
+        test_ass(num, mp_rand_next(&rnd));
+    }
+}
+
+static void bench(const char *level, const char *name, int type)
+{
+    static float f32[3][BENCH_PIXELS];
+    static uint8_t u8[3][BENCH_PIXELS * 4];
+
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        switch (type) {
+        case 0: mp_blend_f32(f32[0], f32[1], f32[2], BENCH_PIXELS); break;
+        case 1: mp_blend_u8(u8[0], u8[1], u8[2], BENCH_PIXELS * 4); break;
+        case 2: mp_blend_bgra((uint32_t *)u8[0], (uint32_t *)u8[1],
+                              BENCH_PIXELS); break;
+        case 3: mp_blend_ass((uint32_t *)u8[0], u8[1], BENCH_PIXELS,
+                             0xFFFFFF00); break;
+        }
+    }
+    double secs = (mp_time_ns() - start) / 1e9;
+    printf("%-7s %-5s %8.1f Mpixels/s\n", level, name,
+           BENCH_PIXELS * (double)BENCH_RUNS / secs / 1e6);
+}
+
+// Run with --bench to print the throughput of every code path.
+int main(int argc, char *argv[])
+{
+    bool benchmark = argc > 1 && !strcmp(argv[1], "--bench");
+    int flags = av_get_cpu_flags();
+    rnd = mp_rand_seed(0);
+
+    for (int n = 0; n < MP_ARRAY_SIZE(levels); n++) {
+        av_force_cpu_flags(flags & ~levels[n].mask);
+        run_tests();
+        if (benchmark) {
+            bench(levels[n].name, "f32", 0);
+            bench(levels[n].name, "u8", 1);
+            bench(levels[n].name, "bgra", 2);
+            bench(levels[n].name, "ass", 3);
+        }
+    }
+    av_force_cpu_flags(-1);
+    return 0;
+}
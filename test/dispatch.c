@@ -0,0 +1,83 @@
+#include "misc/dispatch.h"
+#include "mpv_talloc.h"
+#include "osdep/threads.h"
+#include "test_utils.h"
+
+#define NUM_SENDERS 4
+#define NUM_ITEMS 10000
+
+static char order[16];
+static int num_order;
+static int wakeups;
+static int run_count;
+
+static void record(void *ptr)
+{
+    order[num_order++] = *(char *)ptr;
+}
+
+static void count_wakeup(void *ptr)
+{
+    wakeups++;
+}
+
+static void count_item(void *ptr)
+{
+    run_count++;
+}
+
+static MP_THREAD_VOID sender(void *ptr)
+{
+    struct mp_dispatch_queue *queue = ptr;
+    for (int n = 0; n < NUM_ITEMS; n++) {
+        if (n % 100 == 0) {
+            mp_dispatch_run(queue, count_item, NULL);
+        } else {
+            mp_dispatch_enqueue(queue, count_item, NULL);
+        }
+    }
+    MP_THREAD_RETURN();
+}
+
+int main(void)
+{
+    struct mp_dispatch_queue *queue = mp_dispatch_create(NULL);
+    mp_dispatch_set_wakeup_fn(queue, count_wakeup, NULL);
+
+    // Urgent items run first; normal items keep their order, no matter which
+    // enqueue function was used.
+    static char a = 'a', b = 'b', c = 'c', u = 'u', v = 'v';
+    mp_dispatch_enqueue(queue, record, &a);
+    mp_dispatch_enqueue_notify(queue, record, &b);
+    mp_dispatch_enqueue_urgent(queue, record, &u);
+    mp_dispatch_enqueue(queue, record, &c);
+    mp_dispatch_enqueue_urgent(queue, record, &v);
+    mp_dispatch_enqueue_notify(queue, record, &b); // merged
+    assert_int_equal(wakeups, 1);
+    mp_dispatch_queue_process(queue, 0);
+    order[num_order] = '\0';
+    assert_string_equal(order, "uvabc");
+
+    // A new wakeup is sent only after the target looked at the queue.
+    for (int n = 0; n < 100; n++)
+        mp_dispatch_enqueue(queue, count_item, NULL);
+    assert_int_equal(wakeups, 2);
+    mp_dispatch_cancel_fn(queue, count_item, NULL);
+    mp_dispatch_queue_process(queue, 0);
+    assert_int_equal(run_count, 0);
+    talloc_free(queue);
+
+    // Many senders, without wakeup callback.
+    queue = mp_dispatch_create(NULL);
+    mp_thread threads[NUM_SENDERS];
+    for (int n = 0; n < NUM_SENDERS; n++)
+        assert_false(mp_thread_create(&threads[n], sender, queue));
+    while (run_count < NUM_SENDERS * NUM_ITEMS)
+        mp_dispatch_queue_process(queue, 1);
+    for (int n = 0; n < NUM_SENDERS; n++)
+        mp_thread_join(threads[n]);
+    mp_dispatch_queue_process(queue, 0);
+    assert_int_equal(run_count, NUM_SENDERS * NUM_ITEMS);
+    talloc_free(queue);
+    return 0;
+}
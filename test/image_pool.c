@@ -0,0 +1,56 @@
+#include "test_utils.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+
+static uint8_t *get_data(struct mp_image_pool *pool, struct mp_image **img)
+{
+    *img = mp_image_pool_get(pool, IMGFMT_420P, 64, 32);
+    assert_true(*img);
+    return (*img)->planes[0];
+}
+
+int main(void)
+{
+    struct mp_image_pool *pool = mp_image_pool_new(NULL);
+    struct mp_image *a, *b, *c;
+
+    // Free images are reused, most recently released first.
+    uint8_t *da = get_data(pool, &a);
+    uint8_t *db = get_data(pool, &b);
+    assert_true(da != db);
+    talloc_free(a);
+    talloc_free(b);
+    assert_true(get_data(pool, &c) == db);
+    assert_true(get_data(pool, &a) == da);
+    talloc_free(a);
+    talloc_free(c);
+
+    // A different size makes the pool drop all free images.
+    struct mp_image *big = mp_image_pool_get(pool, IMGFMT_420P, 128, 64);
+    assert_true(big);
+    assert_false(mp_image_pool_get_no_alloc(pool, IMGFMT_420P, 64, 32));
+    talloc_free(big);
+
+    // LRU mode takes the image released longest ago.
+    mp_image_pool_clear(pool);
+    mp_image_pool_set_lru(pool);
+    da = get_data(pool, &a);
+    db = get_data(pool, &b);
+    uint8_t *dc = get_data(pool, &c);
+    talloc_free(b);
+    talloc_free(c);
+    talloc_free(a);
+    assert_true(get_data(pool, &a) == db);
+    assert_true(get_data(pool, &b) == dc);
+    assert_true(get_data(pool, &c) == da);
+    talloc_free(b);
+
+    // Images can outlive the pool.
+    talloc_free(pool);
+    assert_true(a->planes[0] == db);
+    talloc_free(a);
+    talloc_free(c);
+
+    return 0;
+}
@@ -2,8 +2,12 @@
 
 #include "misc/json.h"
 #include "misc/node.h"
+#include "osdep/timer.h"
 #include "test_utils.h"
 
+#define BENCH_ENTRIES 2000
+#define BENCH_RUNS 100
+
 struct entry {
     const char *src;
     const char *out_txt;
@@ -46,6 +50,20 @@ static const struct entry entries[] = {
     { "abc", .expect_fail = true},
     { "  123  ", "123", NODE_INT64(123)},
     { "123.25", "123.250000", NODE_FLOAT(123.25)},
+    { "-12", "-12", NODE_INT64(-12)},
+    { "0", "0", NODE_INT64(0)},
+    { "-0", "0", NODE_INT64(0)},
+    { "123456789012345678", "123456789012345678",
+        NODE_INT64(123456789012345678)},
+    { "-9223372036854775808", "-9223372036854775808", NODE_INT64(INT64_MIN)},
+    { "9223372036854775807", "9223372036854775807", NODE_INT64(INT64_MAX)},
+    { "1e3", "1000.000000", NODE_FLOAT(1000)},
+    { "0.5", "0.500000", NODE_FLOAT(0.5)},
+    { "0x10", "16", NODE_INT64(16)},
+    { TEXT("a\tb\x01c\\"), "\"a\\tb\\u0001c\\\\\"",
+        NODE_STR("a\tb\001c\\")},
+    { "\"abc", .expect_fail = true},
+    { "\"abc\\", .expect_fail = true},
     { TEXT("a\n\\\/\\\""), TEXT("a\n\\/\\\""), NODE_STR("a\n\\/\\\"")},
     { TEXT("a\u2c29"), TEXT("aⰩ"), NODE_STR("a\342\260\251")},
     { "[1,2,3]", "[1,2,3]",
@@ -71,7 +89,74 @@ static const struct entry entries[] = {
         NODE_MAP(L("_a12"), L(NODE_STR("b")))},
 };
 
-int main(void)
+// Something like track-list with many entries.
+static void make_bench_node(struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < BENCH_ENTRIES; n++) {
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", n);
+        node_map_add_string(e, "type", "audio");
+        node_map_add_string(e, "title", "Some \"quoted\" track title");
+        node_map_add_string(e, "lang", "eng");
+        node_map_add_flag(e, "default", n == 0);
+        node_map_add_double(e, "demux-fps", 23.976);
+        node_map_add_int64(e, "ff-index", n * 3);
+        node_map_add_string(e, "codec", "opus");
+    }
+}
+
+static void check_roundtrip(void)
+{
+    void *tmp = talloc_new(NULL);
+    struct mpv_node node;
+    make_bench_node(&node);
+    char *d = talloc_strdup(tmp, "");
+    assert_true(json_write(&d, &node) >= 0);
+    char *s = d;
+    struct mpv_node res;
+    assert_true(json_parse(tmp, &res, &s, MAX_JSON_DEPTH) >= 0);
+    assert_true(!s[0]);
+    assert_true(equal_mpv_node(&node, &res));
+    talloc_free(node.u.list);
+    talloc_free(tmp);
+}
+
+static void bench(void)
+{
+    void *tmp = talloc_new(NULL);
+    struct mpv_node node;
+    make_bench_node(&node);
+    char *json = talloc_strdup(tmp, "");
+    json_write(&json, &node);
+    size_t len = strlen(json);
+
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        char *d = talloc_strdup(NULL, "");
+        json_write(&d, &node);
+        talloc_free(d);
+    }
+    double secs = (mp_time_ns() - start) / 1e9;
+    printf("write %8.1f MB/s\n", len * (double)BENCH_RUNS / secs / 1e6);
+
+    start = mp_time_ns();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        void *ctx = talloc_new(NULL);
+        char *s = talloc_strdup(ctx, json);
+        struct mpv_node res;
+        json_parse(ctx, &res, &s, MAX_JSON_DEPTH);
+        talloc_free(ctx);
+    }
+    secs = (mp_time_ns() - start) / 1e9;
+    printf("parse %8.1f MB/s\n", len * (double)BENCH_RUNS / secs / 1e6);
+
+    talloc_free(node.u.list);
+    talloc_free(tmp);
+}
+
+// Run with --bench to print the parse and write throughput.
+int main(int argc, char *argv[])
 {
     for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
         const struct entry *e = &entries[n];
@@ -91,5 +176,9 @@ int main(void)
         assert_true(equal_mpv_node(&e->out_data, &res));
         talloc_free(tmp);
     }
+
+    check_roundtrip();
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+        bench();
     return 0;
 }
@@ -0,0 +1,204 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libmpv_common.h"
+
+// CPU cost of the audio path: synthetic PCM is played in realtime through the
+// decoder, the audio filter chain and the AO buffer into ao_null, with a
+// number of filter setups. CPU time is the sum of the player's threads, as
+// reported by the perf-info property. Each result is printed as one JSON
+// object per line:
+//  {"bench": "<name>", "cpu_ms_per_s": <time>, "ao_cpu_ms_per_s": <time>,
+//   "wakeups_per_s": <rate>, "fill_min_ms": <time>, "fill_max_ms": <time>}
+// cpu_ms_per_s is per second of audio (media time, not wall time), the
+// wakeup rate is that of the AO buffer thread, per second of wall time.
+
+#define SOURCE "av://lavfi:aevalsrc=sin(440*2*PI*t)|sin(660*2*PI*t):s=44100"
+#define WARMUP 1.0
+#define MEASURE_TIME 5.0
+#define POLL_INTERVAL 0.25
+
+static const struct setup {
+    const char *name;
+    const char *af;
+    const char *speed;
+    const char *samplerate;
+    const char *volume;
+} setups[] = {
+    {"plain"},
+    {"volume",              .volume = "50"},
+    {"swresample",          .samplerate = "48000"},
+    {"scaletempo2/0.5",     .af = "scaletempo2", .speed = "0.5"},
+    {"scaletempo2/1.5",     .af = "scaletempo2", .speed = "1.5"},
+    {"scaletempo2/2",       .af = "scaletempo2", .speed = "2"},
+    {"scaletempo2/4",       .af = "scaletempo2", .speed = "4"},
+};
+
+#define NUM_SETUPS (sizeof(setups) / sizeof(setups[0]))
+
+struct perf {
+    double time_ms;
+    double cpu_ms;
+    double ao_cpu_ms;
+    double wakeups;
+    double fill_min, fill_max;
+};
+
+static void check_end_file(mpv_event *ev)
+{
+    if (ev->event_id == MPV_EVENT_END_FILE) {
+        mpv_event_end_file *ef = ev->data;
+        if (ef->reason == MPV_END_FILE_REASON_ERROR)
+            fail("playback failed: %s\n", mpv_error_string(ef->error));
+        fail("playback ended early\n");
+    }
+}
+
+static void wait_restart(void)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == MPV_EVENT_PLAYBACK_RESTART)
+            return;
+        check_end_file(ev);
+    }
+}
+
+static void stop(void)
+{
+    command_string("stop");
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+}
+
+// Add the perf-info values since the last query to acc (the first query only
+// resets them). perf-info resets everything if it isn't queried for a while,
+// so this must be called often.
+static void query_perf(struct perf *acc)
+{
+    mpv_node node;
+    get_property("perf-info", MPV_FORMAT_NODE, &node);
+    if (node.format != MPV_FORMAT_NODE_ARRAY)
+        fail("unexpected perf-info format\n");
+    for (int n = 0; n < node.u.list->num; n++) {
+        mpv_node *entry = &node.u.list->values[n];
+        if (entry->format != MPV_FORMAT_NODE_MAP)
+            continue;
+        const char *name = NULL;
+        double value = 0;
+        for (int i = 0; i < entry->u.list->num; i++) {
+            mpv_node *val = &entry->u.list->values[i];
+            const char *key = entry->u.list->keys[i];
+            if (strcmp(key, "name") == 0 && val->format == MPV_FORMAT_STRING)
+                name = val->u.string;
+            if (strcmp(key, "value") == 0 && val->format == MPV_FORMAT_DOUBLE)
+                value = val->u.double_;
+        }
+        if (!name || !acc)
+            continue;
+        size_t len = strlen(name);
+        if (strcmp(name, "poll-time") == 0) {
+            acc->time_ms += value;
+        } else if (strcmp(name, "ao/wakeup") == 0) {
+            acc->wakeups += value;
+        } else if (strcmp(name, "ao-null/fill-min") == 0) {
+            acc->fill_min = value;
+        } else if (strcmp(name, "ao-null/fill-max") == 0) {
+            acc->fill_max = value;
+        } else if (len > 7 && strcmp(name + len - 7, "/thread") == 0) {
+            acc->cpu_ms += value;
+            if (strcmp(name, "ao/thread") == 0)
+                acc->ao_cpu_ms += value;
+        }
+    }
+    mpv_free_node_contents(&node);
+}
+
+// Keep polling perf-info while playing for the given time.
+static void play_for(double secs, struct perf *acc)
+{
+    int64_t end = mpv_get_time_ns(ctx) + (int64_t)(secs * 1e9);
+    while (mpv_get_time_ns(ctx) < end) {
+        mpv_event *ev = mpv_wait_event(ctx, POLL_INTERVAL);
+        check_end_file(ev);
+        query_perf(acc);
+    }
+}
+
+static void set_or_reset(const char *name, const char *value, const char *def)
+{
+    set_property_string(name, value ? value : def);
+}
+
+static void bench_setup(const struct setup *s)
+{
+    set_or_reset("af", s->af, "");
+    set_or_reset("speed", s->speed, "1");
+    set_or_reset("audio-samplerate", s->samplerate, "0");
+    set_or_reset("volume", s->volume, "100");
+
+    const char *cmd[] = {"loadfile", SOURCE, NULL};
+    command(cmd);
+    wait_restart();
+
+    query_perf(NULL);
+    play_for(WARMUP, NULL);
+
+    struct perf perf = {0};
+    double start_pos, end_pos;
+    get_property("playback-time", MPV_FORMAT_DOUBLE, &start_pos);
+    play_for(MEASURE_TIME, &perf);
+    get_property("playback-time", MPV_FORMAT_DOUBLE, &end_pos);
+    stop();
+
+    double audio_secs = end_pos - start_pos;
+    double wall_secs = perf.time_ms / 1e3;
+    if (audio_secs <= 0 || wall_secs <= 0)
+        fail("no playback progress\n");
+
+    printf("{\"bench\": \"audio/%s\", \"cpu_ms_per_s\": %.3f, "
+           "\"ao_cpu_ms_per_s\": %.3f, \"wakeups_per_s\": %.1f, "
+           "\"fill_min_ms\": %.1f, \"fill_max_ms\": %.1f}\n", s->name,
+           perf.cpu_ms / audio_secs, perf.ao_cpu_ms / audio_secs,
+           perf.wakeups / wall_secs, perf.fill_min * 1e3, perf.fill_max * 1e3);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        return 1;
+
+    atexit(exit_cleanup);
+
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+    set_property_string("vo", "null");
+    set_property_string("ao", "null");
+    set_property_string("idle", "yes");
+    set_property_string("load-scripts", "no");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    for (int n = 0; n < NUM_SETUPS; n++)
+        bench_setup(&setups[n]);
+
+    command_string("quit");
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <mpv/preload.h>
+
+#include "libmpv_common.h"
+
+// End-to-end latency benchmarks: time to first frame on a cold open, seek to
+// display (keyframe and exact), playlist-next, and loading a preloaded file.
+// With no argument, a test file is encoded first. Each result is printed as
+// one JSON object per line, with the average total latency (as seen by the
+// client) and the average of each phase from the load-timing/seek-timing
+// properties, all in milliseconds:
+//  {"bench": "<name>", "runs": <count>, "ms": <time>, "<phase>": <time>, ...}
+
+#define TEST_DURATION "20"
+#define NUM_OPENS 10
+#define NUM_SEEKS 50
+#define NUM_PLAYLIST 10
+#define NUM_PRELOADS 10
+
+static const char *const phases[] = {
+    "open", "probe", "decoder-init", "first-decode", "first-present",
+};
+#define NUM_PHASES (sizeof(phases) / sizeof(phases[0]))
+
+struct result {
+    int runs;
+    double total;
+    double phase[NUM_PHASES];
+    int phase_runs[NUM_PHASES];
+};
+
+static char *tmp_path;
+
+static void cleanup(void)
+{
+    exit_cleanup();
+    mpv_preload_clear_all();
+    if (tmp_path)
+        unlink(tmp_path);
+}
+
+static void create_handle(void)
+{
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+}
+
+static void encode_test_file(void)
+{
+    static char path[] = "./benchfile.XXXXXX";
+#ifdef _WIN32
+    tmp_path = _mktemp(path);
+    if (!tmp_path || !*tmp_path)
+        fail("tmpfile failed\n");
+#else
+    int fd = mkstemp(path);
+    if (fd == -1)
+        fail("tmpfile failed\n");
+    close(fd);
+    tmp_path = path;
+#endif
+
+    create_handle();
+    set_property_string("o", tmp_path);
+    set_property_string("of", "matroska");
+    // A keyframe every 2 seconds, so exact seeks have to decode some frames.
+    set_property_string("ovcopts", "g=50");
+    set_property_string("end", TEST_DURATION);
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+    set_property_string("idle", "once");
+
+    const char *cmd[] = {"loadfile", "av://lavfi:testsrc=size=640x360:rate=25",
+                         NULL};
+    command(cmd);
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    exit_cleanup();
+}
+
+// Wait until the current load or seek is done and the first frame is shown.
+static void wait_restart(void)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == MPV_EVENT_PLAYBACK_RESTART)
+            return;
+        if (ev->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = ev->data;
+            if (ef->reason == MPV_END_FILE_REASON_ERROR)
+                fail("playback failed: %s\n", mpv_error_string(ef->error));
+        }
+    }
+}
+
+static void stop(void)
+{
+    command_string("stop");
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+}
+
+static void add_result(struct result *r, int64_t start, const char *prop)
+{
+    r->total += (mpv_get_time_ns(ctx) - start) / 1e6;
+    r->runs++;
+
+    mpv_node node;
+    get_property(prop, MPV_FORMAT_NODE, &node);
+    if (node.format != MPV_FORMAT_NODE_MAP)
+        fail("unexpected %s format\n", prop);
+    for (int n = 0; n < node.u.list->num; n++) {
+        mpv_node *val = &node.u.list->values[n];
+        for (int i = 0; i < NUM_PHASES; i++) {
+            if (strcmp(node.u.list->keys[n], phases[i]) == 0 &&
+                val->format == MPV_FORMAT_DOUBLE)
+            {
+                r->phase[i] += val->u.double_ * 1e3;
+                r->phase_runs[i]++;
+            }
+        }
+    }
+    mpv_free_node_contents(&node);
+}
+
+static void report(const char *name, struct result *r)
+{
+    printf("{\"bench\": \"%s\", \"runs\": %d, \"ms\": %.3f", name, r->runs,
+           r->total / (r->runs ? r->runs : 1));
+    for (int i = 0; i < NUM_PHASES; i++) {
+        if (r->phase_runs[i])
+            printf(", \"%s\": %.3f", phases[i], r->phase[i] / r->phase_runs[i]);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void loadfile(const char *file, const char *flags)
+{
+    const char *cmd[] = {"loadfile", file, flags, NULL};
+    command(cmd);
+}
+
+static void bench_open(const char *file)
+{
+    struct result r = {0};
+    for (int n = 0; n < NUM_OPENS; n++) {
+        int64_t start = mpv_get_time_ns(ctx);
+        loadfile(file, "replace");
+        wait_restart();
+        add_result(&r, start, "load-timing");
+        stop();
+    }
+    report("time-to-first-frame", &r);
+}
+
+static void bench_seek(const char *file, const char *name, const char *flags)
+{
+    loadfile(file, "replace");
+    wait_restart();
+
+    double duration;
+    get_property("duration", MPV_FORMAT_DOUBLE, &duration);
+
+    // Fixed pseudo-random sequence, so that runs are comparable.
+    uint32_t state = 1;
+    struct result r = {0};
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        state = state * 1664525 + 1013904223;
+        char pos[32];
+        snprintf(pos, sizeof(pos), "%f", (state >> 8) / (double)(1 << 24) *
+                 duration * 0.9);
+        const char *cmd[] = {"seek", pos, flags, NULL};
+        int64_t start = mpv_get_time_ns(ctx);
+        command(cmd);
+        wait_restart();
+        add_result(&r, start, "seek-timing");
+    }
+    report(name, &r);
+
+    stop();
+}
+
+static void bench_playlist_next(const char *file)
+{
+    for (int n = 0; n < NUM_PLAYLIST + 1; n++)
+        loadfile(file, n ? "append" : "replace");
+    wait_restart();
+
+    struct result r = {0};
+    for (int n = 0; n < NUM_PLAYLIST; n++) {
+        int64_t start = mpv_get_time_ns(ctx);
+        command_string("playlist-next");
+        wait_restart();
+        add_result(&r, start, "load-timing");
+    }
+    report("playlist-next", &r);
+
+    stop();
+}
+
+static void bench_preload(const char *file)
+{
+    struct result r = {0};
+    for (int n = 0; n < NUM_PRELOADS; n++) {
+        if (mpv_preload_start(file, NULL) < 0)
+            fail("mpv_preload_start failed\n");
+        while (1) {
+            mpv_preload_info info;
+            if (mpv_preload_get_info(file, &info) < 0)
+                fail("mpv_preload_get_info failed\n");
+            if (info.status == MPV_PRELOAD_STATUS_ERROR)
+                fail("preloading failed\n");
+            if (info.status == MPV_PRELOAD_STATUS_READY ||
+                info.status == MPV_PRELOAD_STATUS_CACHED)
+                break;
+            mpv_wait_event(ctx, 0.001);
+        }
+
+        int64_t start = mpv_get_time_ns(ctx);
+        loadfile(file, "replace");
+        wait_restart();
+        add_result(&r, start, "load-timing");
+        stop();
+        mpv_preload_cancel(file);
+    }
+    report("preload-handoff", &r);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+        return 1;
+
+    atexit(cleanup);
+
+    if (argc < 2)
+        encode_test_file();
+    const char *file = argc > 1 ? argv[1] : tmp_path;
+
+    create_handle();
+    set_property_string("vo", "null");
+    set_property_string("ao", "null");
+    set_property_string("idle", "yes");
+    set_property_string("pause", "yes");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    bench_open(file);
+    bench_seek(file, "seek-keyframe", "absolute+keyframes");
+    bench_seek(file, "seek-exact", "absolute+exact");
+    bench_playlist_next(file);
+    bench_preload(file);
+
+    command_string("quit");
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+
+    return 0;
+}
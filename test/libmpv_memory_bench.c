@@ -0,0 +1,230 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "libmpv_common.h"
+
+// Memory use per subsystem while playing: each file is played in realtime for
+// PLAY_TIME seconds, and the memory-usage property is sampled periodically.
+// With no arguments, a set of test files is encoded first. For each file, the
+// peak and the steady state (median of the second half of the samples) of
+// every subsystem is printed as one JSON object per line, in bytes:
+//  {"bench": "memory/<file>", "<subsystem>_peak": <bytes>,
+//   "<subsystem>_steady": <bytes>, ...}
+
+#define TEST_DURATION "10"
+#define PLAY_TIME 8.0
+#define SAMPLE_INTERVAL 0.1
+#define MAX_SAMPLES 1000
+
+static const struct {
+    const char *name;
+    const char *source;
+} test_files[] = {
+    {"video-720p", "av://lavfi:testsrc2=size=1280x720:rate=30"},
+    {"audio", "av://lavfi:sine=frequency=440:sample_rate=48000"},
+};
+
+#define NUM_TEST_FILES (sizeof(test_files) / sizeof(test_files[0]))
+
+// Keys of memory-usage; the "bytes" field of each is sampled.
+static const char *const subsystems[] = {
+    "demuxer-cache", "packet-pool", "image-pools", "playlist",
+};
+
+#define NUM_SUBSYSTEMS (sizeof(subsystems) / sizeof(subsystems[0]))
+
+static char tmp_paths[NUM_TEST_FILES][32];
+static int num_tmp_paths;
+
+static void cleanup(void)
+{
+    exit_cleanup();
+    for (int n = 0; n < num_tmp_paths; n++)
+        unlink(tmp_paths[n]);
+}
+
+static void create_handle(void)
+{
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+}
+
+static void encode_test_file(int index)
+{
+    char *path = tmp_paths[index];
+    snprintf(path, sizeof(tmp_paths[0]), "./benchfile.XXXXXX");
+#ifdef _WIN32
+    if (!_mktemp(path) || !*path)
+        fail("tmpfile failed\n");
+#else
+    int fd = mkstemp(path);
+    if (fd == -1)
+        fail("tmpfile failed\n");
+    close(fd);
+#endif
+    num_tmp_paths = index + 1;
+
+    create_handle();
+    set_property_string("o", path);
+    set_property_string("of", "matroska");
+    set_property_string("end", TEST_DURATION);
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+    set_property_string("idle", "once");
+
+    const char *cmd[] = {"loadfile", test_files[index].source, NULL};
+    command(cmd);
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    exit_cleanup();
+}
+
+static void check_end_file(mpv_event *ev)
+{
+    if (ev->event_id == MPV_EVENT_END_FILE) {
+        mpv_event_end_file *ef = ev->data;
+        if (ef->reason == MPV_END_FILE_REASON_ERROR)
+            fail("playback failed: %s\n", mpv_error_string(ef->error));
+        fail("playback ended early\n");
+    }
+}
+
+static void wait_restart(void)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == MPV_EVENT_PLAYBACK_RESTART)
+            return;
+        check_end_file(ev);
+    }
+}
+
+static void stop(void)
+{
+    command_string("stop");
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+}
+
+static void sample(int64_t out[NUM_SUBSYSTEMS])
+{
+    mpv_node node;
+    get_property("memory-usage", MPV_FORMAT_NODE, &node);
+    if (node.format != MPV_FORMAT_NODE_MAP)
+        fail("unexpected memory-usage format\n");
+    for (int n = 0; n < node.u.list->num; n++) {
+        mpv_node *entry = &node.u.list->values[n];
+        for (int i = 0; i < NUM_SUBSYSTEMS; i++) {
+            if (strcmp(node.u.list->keys[n], subsystems[i]) != 0 ||
+                entry->format != MPV_FORMAT_NODE_MAP)
+                continue;
+            for (int k = 0; k < entry->u.list->num; k++) {
+                mpv_node *val = &entry->u.list->values[k];
+                if (strcmp(entry->u.list->keys[k], "bytes") == 0 &&
+                    val->format == MPV_FORMAT_INT64)
+                    out[i] = val->u.int64;
+            }
+        }
+    }
+    mpv_free_node_contents(&node);
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *)a, vb = *(const int64_t *)b;
+    return va < vb ? -1 : va > vb;
+}
+
+static void bench_file(const char *name, const char *file)
+{
+    static int64_t samples[NUM_SUBSYSTEMS][MAX_SAMPLES];
+    int num = 0;
+
+    const char *cmd[] = {"loadfile", file, NULL};
+    command(cmd);
+    wait_restart();
+
+    int64_t end = mpv_get_time_ns(ctx) + (int64_t)(PLAY_TIME * 1e9);
+    int64_t next = 0;
+    while (num < MAX_SAMPLES) {
+        int64_t now = mpv_get_time_ns(ctx);
+        if (now >= end)
+            break;
+        if (now >= next) {
+            int64_t cur[NUM_SUBSYSTEMS] = {0};
+            sample(cur);
+            for (int i = 0; i < NUM_SUBSYSTEMS; i++)
+                samples[i][num] = cur[i];
+            num++;
+            next = now + (int64_t)(SAMPLE_INTERVAL * 1e9);
+        }
+        check_end_file(mpv_wait_event(ctx, SAMPLE_INTERVAL));
+    }
+    stop();
+    if (!num)
+        fail("no samples\n");
+
+    printf("{\"bench\": \"memory/%s\"", name);
+    for (int i = 0; i < NUM_SUBSYSTEMS; i++) {
+        int64_t peak = 0;
+        for (int n = 0; n < num; n++)
+            peak = samples[i][n] > peak ? samples[i][n] : peak;
+        int half = num / 2;
+        qsort(&samples[i][half], num - half, sizeof(samples[i][0]), cmp_int64);
+        int64_t steady = samples[i][half + (num - half) / 2];
+        printf(", \"%s_peak\": %"PRId64", \"%s_steady\": %"PRId64,
+               subsystems[i], peak, subsystems[i], steady);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    atexit(cleanup);
+
+    if (argc < 2) {
+        for (int n = 0; n < NUM_TEST_FILES; n++)
+            encode_test_file(n);
+    }
+
+    create_handle();
+    set_property_string("vo", "null");
+    set_property_string("ao", "null");
+    set_property_string("idle", "yes");
+    set_property_string("load-scripts", "no");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    if (argc < 2) {
+        for (int n = 0; n < NUM_TEST_FILES; n++)
+            bench_file(test_files[n].name, tmp_paths[n]);
+    } else {
+        for (int n = 1; n < argc; n++)
+            bench_file(argv[n], argv[n]);
+    }
+
+    command_string("quit");
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "libmpv_common.h"
+
+// Cache behaviour under simulated network conditions: the test file is played
+// through throttle:// with a number of fixed (seeded) network profiles, for
+// PLAY_TIME seconds each. With no argument, a test file is encoded first. The
+// bandwidth of each profile is relative to the average bitrate of the file.
+// Each result is printed as one JSON object per line:
+//  {"bench": "<profile>", "startup_ms": <time>, "rebuffers": <count>,
+//   "rebuffer_ms": <time>, "wasted_bytes": <bytes>, "url": "<url>"}
+// wasted_bytes is the data that was read ahead into the cache, but not played
+// when playback was stopped.
+
+#define TEST_DURATION "20"
+#define PLAY_TIME 10
+
+static const struct profile {
+    const char *name;
+    double rate;        // multiple of the file's bitrate
+    const char *params; // other throttle:// parameters
+} profiles[] = {
+    {"lan",         8.0, "latency=0.002"},
+    {"broadband",   3.0, "latency=0.03,jitter=0.01"},
+    {"mobile",      1.5, "latency=0.15,jitter=0.05,stalls=0.05,stall-time=1"},
+    {"congested",   1.1, "latency=0.3,jitter=0.1,stalls=0.1,stall-time=2"},
+    {"too-slow",    0.8, "latency=0.05"},
+};
+
+#define NUM_PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+static char *tmp_path;
+
+static void cleanup(void)
+{
+    exit_cleanup();
+    if (tmp_path)
+        unlink(tmp_path);
+}
+
+static void create_handle(void)
+{
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+}
+
+static void encode_test_file(void)
+{
+    static char path[] = "./benchfile.XXXXXX";
+#ifdef _WIN32
+    tmp_path = _mktemp(path);
+    if (!tmp_path || !*tmp_path)
+        fail("tmpfile failed\n");
+#else
+    int fd = mkstemp(path);
+    if (fd == -1)
+        fail("tmpfile failed\n");
+    close(fd);
+    tmp_path = path;
+#endif
+
+    create_handle();
+    set_property_string("o", tmp_path);
+    set_property_string("of", "matroska");
+    set_property_string("end", TEST_DURATION);
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+    set_property_string("idle", "once");
+
+    const char *cmd[] = {"loadfile", "av://lavfi:testsrc=size=640x360:rate=25",
+                         NULL};
+    command(cmd);
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    exit_cleanup();
+}
+
+static void check_end_file(mpv_event *ev)
+{
+    if (ev->event_id == MPV_EVENT_END_FILE) {
+        mpv_event_end_file *ef = ev->data;
+        if (ef->reason == MPV_END_FILE_REASON_ERROR)
+            fail("playback failed: %s\n", mpv_error_string(ef->error));
+        fail("playback ended early\n");
+    }
+}
+
+static void wait_restart(void)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == MPV_EVENT_PLAYBACK_RESTART)
+            return;
+        check_end_file(ev);
+    }
+}
+
+static void stop(void)
+{
+    command_string("stop");
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+}
+
+// Returns 0 if the cache state is not available.
+static int64_t get_fw_bytes(void)
+{
+    int64_t res = 0;
+    mpv_node node;
+    get_property("demuxer-cache-state", MPV_FORMAT_NODE, &node);
+    if (node.format == MPV_FORMAT_NODE_MAP) {
+        for (int n = 0; n < node.u.list->num; n++) {
+            mpv_node *val = &node.u.list->values[n];
+            if (strcmp(node.u.list->keys[n], "fw-bytes") == 0 &&
+                val->format == MPV_FORMAT_INT64)
+                res = val->u.int64;
+        }
+    }
+    mpv_free_node_contents(&node);
+    return res;
+}
+
+static void bench_profile(const struct profile *prof, const char *file,
+                          double bitrate)
+{
+    char url[512];
+    snprintf(url, sizeof(url), "throttle://rate=%.0f,seed=1,%s@%s",
+             prof->rate * bitrate, prof->params, file);
+
+    int64_t start = mpv_get_time_ns(ctx);
+    const char *cmd[] = {"loadfile", url, NULL};
+    command(cmd);
+    wait_restart();
+    double startup = (mpv_get_time_ns(ctx) - start) / 1e6;
+
+    mpv_observe_property(ctx, 1, "paused-for-cache", MPV_FORMAT_FLAG);
+    mpv_observe_property(ctx, 2, "time-pos", MPV_FORMAT_DOUBLE);
+
+    int rebuffers = 0;
+    int64_t rebuffer_start = 0, rebuffer_time = 0;
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        check_end_file(ev);
+        if (ev->event_id != MPV_EVENT_PROPERTY_CHANGE)
+            continue;
+        mpv_event_property *prop = ev->data;
+        if (prop->format == MPV_FORMAT_NONE)
+            continue;
+        if (ev->reply_userdata == 1) {
+            if (*(int *)prop->data) {
+                rebuffers++;
+                rebuffer_start = mpv_get_time_ns(ctx);
+            } else if (rebuffer_start) {
+                rebuffer_time += mpv_get_time_ns(ctx) - rebuffer_start;
+                rebuffer_start = 0;
+            }
+        } else if (*(double *)prop->data >= PLAY_TIME) {
+            break;
+        }
+    }
+
+    int64_t wasted = get_fw_bytes();
+    mpv_unobserve_property(ctx, 1);
+    mpv_unobserve_property(ctx, 2);
+    stop();
+
+    printf("{\"bench\": \"%s\", \"startup_ms\": %.3f, \"rebuffers\": %d, "
+           "\"rebuffer_ms\": %.3f, \"wasted_bytes\": %"PRId64", "
+           "\"url\": \"%s\"}\n", prof->name, startup, rebuffers,
+           rebuffer_time / 1e6, wasted, url);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+        return 1;
+
+    atexit(cleanup);
+
+    if (argc < 2)
+        encode_test_file();
+    const char *file = argc > 1 ? argv[1] : tmp_path;
+
+    create_handle();
+    set_property_string("vo", "null");
+    set_property_string("ao", "null");
+    set_property_string("idle", "yes");
+    set_property_string("cache", "yes");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    // Average bitrate of the file, in bytes per second.
+    const char *cmd[] = {"loadfile", file, NULL};
+    command(cmd);
+    wait_restart();
+    int64_t size;
+    double duration;
+    get_property("file-size", MPV_FORMAT_INT64, &size);
+    get_property("duration", MPV_FORMAT_DOUBLE, &duration);
+    stop();
+    if (duration < PLAY_TIME + 1)
+        fail("test file too short\n");
+    double bitrate = size / duration;
+
+    for (int n = 0; n < NUM_PROFILES; n++)
+        bench_profile(&profiles[n], file, bitrate);
+
+    command_string("quit");
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+
+    return 0;
+}
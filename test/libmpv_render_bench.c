@@ -0,0 +1,384 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <mpv/render_gl.h>
+
+#include "libmpv_common.h"
+#include "video/out/opengl/gl_headers.h"
+
+// Offscreen renderer benchmark: plays a synthetic HDR video through the render
+// API into an FBO of a surfaceless EGL context, for a matrix of scalers,
+// tone-mapping curves and target sizes. For each combination, one JSON object
+// is printed per line, with the GPU time of each render pass (from the
+// vo-passes property) and their sum, in nanoseconds:
+//  {"bench": "<scale>/<tone-mapping>/<w>x<h>", "gpu_ns": <time>,
+//   "passes": {"<pass>": <time>, ...}}
+//
+// With --baseline <file> (the output of a previous run), each result is
+// compared to the baseline, and the program fails if gpu_ns grew by more than
+// --threshold percent (default 10) for any combination.
+
+// Rendered before measuring a combination. At least as many as the vo-passes
+// sample window (VO_PERF_SAMPLE_COUNT), so the averages cover only frames
+// rendered with the current settings.
+#define NUM_FRAMES 300
+
+static const char *const scalers[] = {"bilinear", "spline36", "ewa_lanczossharp"};
+static const char *const tone_mappings[] = {"clip", "bt.2390", "st2094-40"};
+static const int sizes[][2] = {{960, 540}, {1920, 1080}, {3840, 2160}};
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+static EGLDisplay egl_display;
+static EGLContext egl_context;
+static mpv_render_context *render_ctx;
+
+static void (GLAPIENTRY *GenTextures)(GLsizei, GLuint *);
+static void (GLAPIENTRY *DeleteTextures)(GLsizei, const GLuint *);
+static void (GLAPIENTRY *BindTexture)(GLenum, GLuint);
+static void (GLAPIENTRY *TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei,
+                                     GLint, GLenum, GLenum, const GLvoid *);
+static void (GLAPIENTRY *GenFramebuffers)(GLsizei, GLuint *);
+static void (GLAPIENTRY *DeleteFramebuffers)(GLsizei, const GLuint *);
+static void (GLAPIENTRY *BindFramebuffer)(GLenum, GLuint);
+static void (GLAPIENTRY *FramebufferTexture2D)(GLenum, GLenum, GLenum, GLuint,
+                                               GLint);
+static GLenum (GLAPIENTRY *CheckFramebufferStatus)(GLenum);
+
+struct baseline {
+    char *name;
+    double gpu_ns;
+};
+
+static struct baseline *baselines;
+static int num_baselines;
+
+static void *get_proc_address(void *ctx, const char *name)
+{
+    return (void *)eglGetProcAddress(name);
+}
+
+static void *load_fn(const char *name)
+{
+    void *fn = get_proc_address(NULL, name);
+    if (!fn)
+        fail("missing GL function %s\n", name);
+    return fn;
+}
+
+static void init_egl(void)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay =
+        (void *)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    egl_display = GetPlatformDisplay
+        ? GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+        : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL))
+        fail("could not initialize EGL\n");
+    if (!eglBindAPI(EGL_OPENGL_API))
+        fail("could not bind OpenGL\n");
+
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs) ||
+        !num_configs)
+        fail("no EGL config\n");
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT,
+                                   context_attribs);
+    if (egl_context == EGL_NO_CONTEXT)
+        fail("could not create a GL 3.2 context\n");
+    if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+        fail("surfaceless contexts are not supported\n");
+
+    GenTextures = load_fn("glGenTextures");
+    DeleteTextures = load_fn("glDeleteTextures");
+    BindTexture = load_fn("glBindTexture");
+    TexImage2D = load_fn("glTexImage2D");
+    GenFramebuffers = load_fn("glGenFramebuffers");
+    DeleteFramebuffers = load_fn("glDeleteFramebuffers");
+    BindFramebuffer = load_fn("glBindFramebuffer");
+    FramebufferTexture2D = load_fn("glFramebufferTexture2D");
+    CheckFramebufferStatus = load_fn("glCheckFramebufferStatus");
+}
+
+static void uninit(void)
+{
+    mpv_render_context_free(render_ctx);
+    render_ctx = NULL;
+    exit_cleanup();
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        if (egl_context != EGL_NO_CONTEXT)
+            eglDestroyContext(egl_display, egl_context);
+        eglTerminate(egl_display);
+    }
+}
+
+static void load_baseline(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        fail("could not open %s\n", path);
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char name[256];
+        const char *gpu = strstr(line, "\"gpu_ns\": ");
+        struct baseline b = {0};
+        if (sscanf(line, "{\"bench\": \"%255[^\"]\"", name) != 1 || !gpu ||
+            sscanf(gpu, "\"gpu_ns\": %lf", &b.gpu_ns) != 1)
+            continue;
+        b.name = strdup(name);
+        baselines = realloc(baselines, (num_baselines + 1) * sizeof(b));
+        if (!b.name || !baselines)
+            fail("out of memory\n");
+        baselines[num_baselines++] = b;
+    }
+    fclose(f);
+}
+
+static struct baseline *find_baseline(const char *name)
+{
+    for (int n = 0; n < num_baselines; n++) {
+        if (strcmp(baselines[n].name, name) == 0)
+            return &baselines[n];
+    }
+    return NULL;
+}
+
+// Wait up to timeout for an event, then handle all pending ones.
+static void handle_events(double timeout)
+{
+    while (1) {
+        mpv_event *ev = mpv_wait_event(ctx, timeout);
+        timeout = 0;
+        if (ev->event_id == MPV_EVENT_NONE)
+            return;
+        if (ev->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = ev->data;
+            if (ef->reason == MPV_END_FILE_REASON_ERROR)
+                fail("playback failed: %s\n", mpv_error_string(ef->error));
+        }
+    }
+}
+
+static void render_frames(GLuint fbo, int w, int h, int num)
+{
+    mpv_opengl_fbo target = {.fbo = fbo, .w = w, .h = h,
+                             .internal_format = GL_RGBA8};
+    int block = 0;
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_OPENGL_FBO, &target},
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block},
+        {0},
+    };
+    int done = 0;
+    while (done < num) {
+        if (!(mpv_render_context_update(render_ctx) & MPV_RENDER_UPDATE_FRAME)) {
+            handle_events(0.001);
+            continue;
+        }
+        handle_events(0);
+        if (mpv_render_context_render(render_ctx, params) < 0)
+            fail("rendering failed\n");
+        mpv_render_context_report_swap(render_ctx);
+        done++;
+    }
+}
+
+// With advanced control, vo-passes is read on the render thread (this one),
+// so it has to be requested asynchronously while updating the render context.
+// The result is valid until the next mpv_wait_event() call.
+static mpv_node *get_passes(void)
+{
+    if (mpv_get_property_async(ctx, 1, "vo-passes", MPV_FORMAT_NODE) < 0)
+        fail("could not request vo-passes\n");
+    while (1) {
+        mpv_render_context_update(render_ctx);
+        mpv_event *ev = mpv_wait_event(ctx, 0.001);
+        if (ev->event_id != MPV_EVENT_GET_PROPERTY_REPLY)
+            continue;
+        mpv_event_property *prop = ev->data;
+        if (ev->error < 0 || prop->format != MPV_FORMAT_NODE)
+            fail("could not read vo-passes\n");
+        return prop->data;
+    }
+}
+
+static mpv_node *map_get(mpv_node *map, const char *key)
+{
+    if (map->format != MPV_FORMAT_NODE_MAP)
+        return NULL;
+    for (int n = 0; n < map->u.list->num; n++) {
+        if (strcmp(map->u.list->keys[n], key) == 0)
+            return &map->u.list->values[n];
+    }
+    return NULL;
+}
+
+// Returns whether the result is a regression.
+static bool report(const char *name, double threshold)
+{
+    mpv_node *node = get_passes();
+    mpv_node *fresh = map_get(node, "fresh");
+    if (!fresh || fresh->format != MPV_FORMAT_NODE_ARRAY)
+        fail("no render passes\n");
+
+    double total = 0;
+    int num = fresh->u.list->num;
+    for (int n = 0; n < num; n++) {
+        mpv_node *avg = map_get(&fresh->u.list->values[n], "avg");
+        if (avg && avg->format == MPV_FORMAT_INT64)
+            total += avg->u.int64;
+    }
+
+    printf("{\"bench\": \"%s\", \"gpu_ns\": %.0f, \"passes\": {", name, total);
+    for (int n = 0; n < num; n++) {
+        mpv_node *pass = &fresh->u.list->values[n];
+        mpv_node *desc = map_get(pass, "desc");
+        mpv_node *avg = map_get(pass, "avg");
+        if (!desc || desc->format != MPV_FORMAT_STRING ||
+            !avg || avg->format != MPV_FORMAT_INT64)
+            continue;
+        printf("%s\"", n ? ", " : "");
+        for (const char *c = desc->u.string; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                putchar('\\');
+            putchar(*c);
+        }
+        printf("\": %" PRId64, avg->u.int64);
+    }
+    printf("}");
+
+    bool regression = false;
+    struct baseline *b = find_baseline(name);
+    if (b && b->gpu_ns > 0) {
+        double change = (total - b->gpu_ns) / b->gpu_ns * 100;
+        regression = change > threshold;
+        printf(", \"baseline_ns\": %.0f, \"change_percent\": %.1f", b->gpu_ns,
+               change);
+        if (regression)
+            printf(", \"regression\": true");
+    }
+    printf("}\n");
+    fflush(stdout);
+
+    return regression;
+}
+
+int main(int argc, char *argv[])
+{
+    double threshold = 10;
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "--baseline") == 0 && n + 1 < argc) {
+            load_baseline(argv[++n]);
+        } else if (strcmp(argv[n], "--threshold") == 0 && n + 1 < argc) {
+            threshold = atof(argv[++n]);
+        } else {
+            fprintf(stderr, "usage: %s [--baseline file] [--threshold percent]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    atexit(uninit);
+
+    init_egl();
+
+    ctx = mpv_create();
+    if (!ctx)
+        return 1;
+    set_property_string("vo", "libmpv");
+    set_property_string("ao", "null");
+    set_property_string("untimed", "yes");
+    set_property_string("video-timing-offset", "0");
+    set_property_string("loop-file", "inf");
+    // Tag the video as HDR, so tone mapping is not skipped.
+    set_property_string("vf", "format=gamma=pq:primaries=bt.2020");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    int advanced = 1;
+    mpv_opengl_init_params gl_params = {.get_proc_address = get_proc_address};
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_OPENGL},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_params},
+        {MPV_RENDER_PARAM_ADVANCED_CONTROL, &advanced},
+        {0},
+    };
+    if (mpv_render_context_create(&render_ctx, ctx, params) < 0)
+        fail("could not create the render context\n");
+
+    command_string("loadfile av://lavfi:testsrc2=size=1280x720:rate=60");
+
+    bool regression = false;
+    for (int s = 0; s < ARRAY_LEN(sizes); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        GLuint tex, fbo;
+        GenTextures(1, &tex);
+        BindTexture(GL_TEXTURE_2D, tex);
+        TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, NULL);
+        BindTexture(GL_TEXTURE_2D, 0);
+        GenFramebuffers(1, &fbo);
+        BindFramebuffer(GL_FRAMEBUFFER, fbo);
+        FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, tex, 0);
+        if (CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fail("incomplete framebuffer\n");
+        BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (int i = 0; i < ARRAY_LEN(scalers); i++) {
+            set_property_string("scale", scalers[i]);
+            set_property_string("dscale", scalers[i]);
+            for (int t = 0; t < ARRAY_LEN(tone_mappings); t++) {
+                set_property_string("tone-mapping", tone_mappings[t]);
+                render_frames(fbo, w, h, NUM_FRAMES);
+                char name[128];
+                snprintf(name, sizeof(name), "%s/%s/%dx%d", scalers[i],
+                         tone_mappings[t], w, h);
+                regression |= report(name, threshold);
+            }
+        }
+
+        DeleteFramebuffers(1, &fbo);
+        DeleteTextures(1, &tex);
+    }
+
+    for (int n = 0; n < num_baselines; n++)
+        free(baselines[n].name);
+    free(baselines);
+
+    if (regression)
+        fail("performance regressions found\n");
+    return 0;
+}
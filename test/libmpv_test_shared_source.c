@@ -0,0 +1,164 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "libmpv_common.h"
+
+// Two players play the same URL with --shared-source. The helpers of
+// libmpv_common.h use ctx, which is switched between the handles. The URL is
+// a test file that is encoded first, opened through throttle:// (without
+// limits) to make it a network URL.
+
+#define NUM_PLAYERS 2
+
+static mpv_handle *players[NUM_PLAYERS];
+static char *tmp_path;
+
+static void use(int n)
+{
+    ctx = players[n];
+}
+
+static void cleanup(void)
+{
+    for (int n = 0; n < NUM_PLAYERS; n++) {
+        use(n);
+        exit_cleanup();
+    }
+    if (tmp_path)
+        unlink(tmp_path);
+}
+
+static void encode_test_file(void)
+{
+    static char path[] = "./testfile.XXXXXX";
+#ifdef _WIN32
+    tmp_path = _mktemp(path);
+    if (!tmp_path || !*tmp_path)
+        fail("tmpfile failed\n");
+#else
+    int fd = mkstemp(path);
+    if (fd == -1)
+        fail("tmpfile failed\n");
+    close(fd);
+    tmp_path = path;
+#endif
+
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+    set_property_string("o", tmp_path);
+    set_property_string("of", "matroska");
+    set_property_string("end", "10");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+    set_property_string("idle", "once");
+
+    const char *cmd[] = {"loadfile", "av://lavfi:testsrc=size=320x240:rate=25",
+                         NULL};
+    command(cmd);
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    exit_cleanup();
+}
+
+static void wait_for(mpv_event_id id)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == id)
+            return;
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            fail("playback ended unexpectedly\n");
+    }
+}
+
+static void check_demuxer(void)
+{
+    char *name = NULL;
+    get_property("current-demuxer", MPV_FORMAT_STRING, &name);
+    if (strcmp(name, "fanout") != 0)
+        fail("expected the shared source reader, got demuxer '%s'\n", name);
+    mpv_free(name);
+}
+
+int main(int argc, char *argv[])
+{
+    atexit(cleanup);
+
+    encode_test_file();
+    char url[64];
+    snprintf(url, sizeof(url), "throttle://@%s", tmp_path);
+
+    for (int n = 0; n < NUM_PLAYERS; n++) {
+        players[n] = mpv_create();
+        if (!players[n])
+            fail("mpv_create failed\n");
+        use(n);
+        set_property_string("vo", "null");
+        set_property_string("ao", "null");
+        set_property_string("idle", "yes");
+        set_property_string("shared-source", "yes");
+        if (mpv_initialize(ctx) < 0)
+            fail("mpv_initialize failed\n");
+        mpv_request_log_messages(ctx, "error");
+    }
+
+    const char *cmd[] = {"loadfile", url, NULL};
+    for (int n = 0; n < NUM_PLAYERS; n++) {
+        use(n);
+        command(cmd);
+    }
+    for (int n = 0; n < NUM_PLAYERS; n++) {
+        use(n);
+        wait_for(MPV_EVENT_PLAYBACK_RESTART);
+        check_demuxer();
+    }
+
+    // The first player stopping must not end the source for the second one.
+    use(0);
+    command_string("stop");
+    wait_for(MPV_EVENT_END_FILE);
+
+    use(1);
+    double start, pos;
+    get_property("time-pos", MPV_FORMAT_DOUBLE, &start);
+    do {
+        mpv_event *ev = mpv_wait_event(ctx, 0.1);
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            fail("playback ended with the other player\n");
+        get_property("time-pos", MPV_FORMAT_DOUBLE, &pos);
+    } while (pos < start + 1);
+
+    // A new reader joins the running source.
+    use(0);
+    command(cmd);
+    wait_for(MPV_EVENT_PLAYBACK_RESTART);
+    check_demuxer();
+
+    for (int n = 0; n < NUM_PLAYERS; n++) {
+        use(n);
+        command_string("quit");
+        while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#include "libmpv_common.h"
+
+// Resume state is saved and restored, both with separate files and with
+// --watch-later-database.
+
+#define SAVED_POS 4.0
+
+static char *tmp_path;
+static char wl_dir[64];
+static char db_path[80];
+
+static void cleanup(void)
+{
+    exit_cleanup();
+    if (db_path[0])
+        unlink(db_path);
+    if (wl_dir[0])
+        rmdir(wl_dir);
+    if (tmp_path)
+        unlink(tmp_path);
+}
+
+static void encode_test_file(void)
+{
+    static char path[] = "./testfile.XXXXXX";
+#ifdef _WIN32
+    tmp_path = _mktemp(path);
+    if (!tmp_path || !*tmp_path)
+        fail("tmpfile failed\n");
+#else
+    int fd = mkstemp(path);
+    if (fd == -1)
+        fail("tmpfile failed\n");
+    close(fd);
+    tmp_path = path;
+#endif
+
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+    set_property_string("o", tmp_path);
+    set_property_string("of", "matroska");
+    set_property_string("end", "10");
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+    set_property_string("idle", "once");
+
+    const char *cmd[] = {"loadfile", "av://lavfi:testsrc=size=320x240:rate=25",
+                         NULL};
+    command(cmd);
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+    exit_cleanup();
+}
+
+static void wait_for(mpv_event_id id)
+{
+    while (1) {
+        mpv_event *ev = wrap_wait_event();
+        if (ev->event_id == id)
+            return;
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            fail("playback ended unexpectedly\n");
+    }
+}
+
+static void load_file(void)
+{
+    const char *cmd[] = {"loadfile", tmp_path, NULL};
+    command(cmd);
+    wait_for(MPV_EVENT_PLAYBACK_RESTART);
+}
+
+static void stop(void)
+{
+    command_string("stop");
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+}
+
+static double get_pos(void)
+{
+    double pos;
+    get_property("time-pos", MPV_FORMAT_DOUBLE, &pos);
+    return pos;
+}
+
+static void test_resume(bool database)
+{
+    set_property_string("watch-later-database", database ? "yes" : "no");
+
+    load_file();
+    if (get_pos() >= SAVED_POS - 1)
+        fail("unexpected resume before saving\n");
+    char pos[16];
+    snprintf(pos, sizeof(pos), "%f", SAVED_POS);
+    const char *seek[] = {"seek", pos, "absolute+exact", NULL};
+    command(seek);
+    wait_for(MPV_EVENT_PLAYBACK_RESTART);
+    command_string("write-watch-later-config");
+    stop();
+
+    struct stat st;
+    if (database && stat(db_path, &st) != 0)
+        fail("database file was not written\n");
+
+    load_file();
+    double resumed = get_pos();
+    if (fabs(resumed - SAVED_POS) > 0.5)
+        fail("resumed at %f instead of %f\n", resumed, SAVED_POS);
+    stop();
+
+    // Loading the file deleted the state.
+    load_file();
+    if (get_pos() >= SAVED_POS - 1)
+        fail("state was not deleted after resuming\n");
+    stop();
+}
+
+int main(int argc, char *argv[])
+{
+    atexit(cleanup);
+
+    encode_test_file();
+
+    snprintf(wl_dir, sizeof(wl_dir), "%s.wl", tmp_path);
+    if (mkdir(wl_dir, 0700) != 0)
+        fail("mkdir failed\n");
+    snprintf(db_path, sizeof(db_path), "%s/resume.db", wl_dir);
+
+    ctx = mpv_create();
+    if (!ctx)
+        fail("mpv_create failed\n");
+    set_property_string("vo", "null");
+    set_property_string("ao", "null");
+    set_property_string("idle", "yes");
+    set_property_string("pause", "yes");
+    set_property_string("watch-later-dir", wl_dir);
+    if (mpv_initialize(ctx) < 0)
+        fail("mpv_initialize failed\n");
+
+    test_resume(false);
+    test_resume(true);
+
+    command_string("quit");
+    while (wrap_wait_event()->event_id != MPV_EVENT_SHUTDOWN) {}
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <mpv/client.h>
+
+#include "misc/bstr.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "misc/node_bin.h"
+#include "test_utils.h"
+
+static const char *const entries[] = {
+    "null",
+    "true",
+    "false",
+    "-123",
+    "123.25",
+    "\"a\\n\\u2c29\"",
+    "[]",
+    "{}",
+    "[1,2.5,\"a\",null,[true,{}]]",
+    "{\"event\":\"property-change\",\"id\":1,\"name\":\"time-pos\",\"data\":1.5}",
+    "{\"a\":{\"b\":{\"c\":[{\"d\":\"\"}]}}}",
+};
+
+static void test_roundtrip(const char *src)
+{
+    void *tmp = talloc_new(NULL);
+    char *s = talloc_strdup(tmp, src);
+    struct mpv_node node;
+    assert_true(json_parse(tmp, &node, &s, MAX_JSON_DEPTH) >= 0);
+
+    bstr data = {0};
+    assert_true(node_bin_write(&data, &node) >= 0);
+    talloc_steal(tmp, data.start);
+
+    bstr in = data;
+    struct mpv_node res;
+    assert_true(node_bin_parse(tmp, &res, &in, MAX_NODE_BIN_DEPTH) >= 0);
+    assert_int_equal(in.len, 0);
+    assert_true(equal_mpv_node(&node, &res));
+
+    // Every truncated encoding must be rejected.
+    for (size_t n = 0; n < data.len; n++) {
+        in = bstr_splice(data, 0, n);
+        assert_true(node_bin_parse(tmp, &res, &in, MAX_NODE_BIN_DEPTH) < 0);
+    }
+    talloc_free(tmp);
+}
+
+int main(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++)
+        test_roundtrip(entries[n]);
+
+    void *tmp = talloc_new(NULL);
+    struct mpv_node res;
+
+    // Byte arrays aren't representable in JSON.
+    struct mpv_byte_array ba = {.data = "a\0b", .size = 3};
+    struct mpv_node node = {.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = &ba};
+    bstr data = {0};
+    assert_true(node_bin_write(&data, &node) >= 0);
+    talloc_steal(tmp, data.start);
+    assert_true(node_bin_parse(tmp, &res, &data, MAX_NODE_BIN_DEPTH) >= 0);
+    assert_int_equal(res.format, MPV_FORMAT_BYTE_ARRAY);
+    assert_int_equal(res.u.ba->size, ba.size);
+    assert_memcmp(res.u.ba->data, ba.data, ba.size);
+
+    // Invalid input: unknown format, bad flag, 0 byte in a string, an array
+    // claiming more entries than there is data, and too deep nesting.
+    static const struct {
+        const char *data;
+        int len;
+    } invalid[] = {
+        {"\x63", 1},
+        {"\x03\x02", 2},
+        {"\x01\x03\x00\x00\x00" "a\0b", 8},
+        {"\x07\xff\xff\xff\x00" "\x00", 6},
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(invalid); n++) {
+        bstr in = {(unsigned char *)invalid[n].data, invalid[n].len};
+        assert_true(node_bin_parse(tmp, &res, &in, MAX_NODE_BIN_DEPTH) < 0);
+    }
+    bstr deep = {0};
+    for (int n = 0; n < MAX_NODE_BIN_DEPTH + 1; n++)
+        bstr_xappend(tmp, &deep, (bstr){(unsigned char *)"\x07\x01\0\0\0", 5});
+    bstr_xappend(tmp, &deep, (bstr){(unsigned char *)"\0", 1});
+    assert_true(node_bin_parse(tmp, &res, &deep, MAX_NODE_BIN_DEPTH) < 0);
+
+    talloc_free(tmp);
+    return 0;
+}
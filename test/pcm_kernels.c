@@ -0,0 +1,157 @@
+#include <libavutil/cpu.h>
+
+#include "audio/out/pcm_kernels.h"
+#include "misc/random.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+#define MAX_SAMPLES 4099
+#define BENCH_SAMPLES (1 << 16)
+#define BENCH_RUNS 500
+
+// Flags to mask out from the detected CPU flags, selecting each code path.
+static const struct {
+    const char *name;
+    int mask;
+} levels[] = {
+    {"native", 0},
+    {"no-avx", AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2},
+    {"c", ~0},
+};
+
+static mp_rand_state rnd;
+
+static void fill_random(void *data, size_t size)
+{
+    uint8_t *ptr = data;
+    for (size_t n = 0; n < size; n++)
+        ptr[n] = mp_rand_next(&rnd);
+}
+
+static void test_gain_float(int num)
+{
+    float src[MAX_SAMPLES], res[MAX_SAMPLES], ref[MAX_SAMPLES];
+    for (int n = 0; n < num; n++)
+        src[n] = mp_rand_next_double(&rnd) * 2 - 1;
+    float gain = mp_rand_next_double(&rnd) * 4;
+
+    for (int n = 0; n < num; n++)
+        ref[n] = src[n] * gain;
+    memcpy(res, src, num * sizeof(float));
+    mp_pcm_gain_float(res, num, gain);
+    assert_memcmp(res, ref, num * sizeof(float));
+}
+
+static void test_gain_float_clip(int num)
+{
+    float src[MAX_SAMPLES], res[MAX_SAMPLES], ref[MAX_SAMPLES];
+    for (int n = 0; n < num; n++)
+        src[n] = mp_rand_next_double(&rnd) * 6 - 3;
+    if (num > 1)
+        src[num / 2] = NAN;
+    float gain = mp_rand_next_double(&rnd) * 4;
+
+    for (int n = 0; n < num; n++) {
+        float v = src[n] * gain;
+        ref[n] = isnan(v) ? -1.0f : MPCLAMP(v, -1.0f, 1.0f);
+    }
+    memcpy(res, src, num * sizeof(float));
+    mp_pcm_gain_float_clip(res, num, gain);
+    assert_memcmp(res, ref, num * sizeof(float));
+}
+
+static void test_gain_s16(int num, int gi)
+{
+    int16_t src[MAX_SAMPLES], res[MAX_SAMPLES], ref[MAX_SAMPLES];
+    fill_random(src, num * sizeof(int16_t));
+    // Include the extremes, which are the interesting cases for clamping.
+    if (num > 1) {
+        src[0] = INT16_MIN;
+        src[num - 1] = INT16_MAX;
+    }
+
+    for (int n = 0; n < num; n++)
+        ref[n] = MPCLAMP(((int64_t)src[n] * gi + 128) >> 8, INT16_MIN, INT16_MAX);
+    memcpy(res, src, num * sizeof(int16_t));
+    mp_pcm_gain_s16(res, num, gi);
+    assert_memcmp(res, ref, num * sizeof(int16_t));
+}
+
+static void test_s32_to_s24(int num, bool pad)
+{
+    uint32_t src[MAX_SAMPLES], res[MAX_SAMPLES];
+    uint8_t ref[MAX_SAMPLES * 4];
+    fill_random(src, num * sizeof(uint32_t));
+
+    int bytes = pad ? 4 : 3;
+    for (int n = 0; n < num; n++) {
+        uint32_t v = src[n];
+        uint8_t *ptr = ref + n * bytes;
+        ptr[0] = v >> 8;
+        ptr[1] = v >> 16;
+        ptr[2] = v >> 24;
+        if (pad)
+            ptr[3] = 0;
+    }
+    memcpy(res, src, num * sizeof(uint32_t));
+    if (pad) {
+        mp_pcm_s32_to_s24_pad(res, num);
+    } else {
+        mp_pcm_s32_to_s24(res, num);
+    }
+    assert_memcmp(res, ref, num * bytes);
+}
+
+static void run_tests(void)
+{
+    static const int gains[] = {0, 1, 100, 255, 257, 1024, INT16_MAX,
+                                INT16_MAX + 1, 256000};
+    for (int num = 0; num < MAX_SAMPLES; num = num < 70 ? num + 1 : num * 2 + 1) {
+        test_gain_float(num);
+        test_gain_float_clip(num);
+        for (int n = 0; n < MP_ARRAY_SIZE(gains); n++)
+            test_gain_s16(num, gains[n]);
+        test_s32_to_s24(num, false);
+        test_s32_to_s24(num, true);
+    }
+}
+
+static void bench(const char *level, const char *name, int type)
+{
+    // Zero, so that the float gain never runs into denormals.
+    static uint32_t data[BENCH_SAMPLES];
+
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        switch (type) {
+        case 0: mp_pcm_gain_float((float *)data, BENCH_SAMPLES, 1); break;
+        case 1: mp_pcm_gain_s16((int16_t *)data, BENCH_SAMPLES * 2, 128); break;
+        case 2: mp_pcm_s32_to_s24(data, BENCH_SAMPLES); break;
+        case 3: mp_pcm_s32_to_s24_pad(data, BENCH_SAMPLES); break;
+        }
+    }
+    double secs = (mp_time_ns() - start) / 1e9;
+    printf("%-7s %-15s %8.1f MB/s\n", level, name,
+           sizeof(data) * (double)BENCH_RUNS / secs / 1e6);
+}
+
+// Run with --bench to print the throughput of every code path.
+int main(int argc, char *argv[])
+{
+    bool benchmark = argc > 1 && !strcmp(argv[1], "--bench");
+    int flags = av_get_cpu_flags();
+    rnd = mp_rand_seed(0);
+
+    for (int n = 0; n < MP_ARRAY_SIZE(levels); n++) {
+        av_force_cpu_flags(flags & ~levels[n].mask);
+        run_tests();
+        if (benchmark) {
+            bench(levels[n].name, "gain-float", 0);
+            bench(levels[n].name, "gain-s16", 1);
+            bench(levels[n].name, "s32-to-s24", 2);
+            bench(levels[n].name, "s32-to-s24-pad", 3);
+        }
+    }
+    av_force_cpu_flags(-1);
+    return 0;
+}
@@ -1,9 +1,12 @@
 #include <limits.h>
 
+#include <libavutil/cpu.h>
 #include <libavutil/pixfmt.h>
 
 #include "common/common.h"
 #include "img_utils.h"
+#include "misc/random.h"
+#include "osdep/timer.h"
 #include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "test_utils.h"
@@ -11,6 +14,7 @@
 #include "video/mp_image.h"
 #include "video/img_format.h"
 #include "video/repack.h"
+#include "video/repack_kernels.h"
 #include "video/sws_utils.h"
 #include "video/zimg.h"
 
@@ -483,6 +487,212 @@ done:
     return ok;
 }
 
+#define KERNEL_MAX_PIXELS 259
+
+static void kernel_bswap16(void *restrict src, void *restrict dst[], int w)
+{
+    mp_repack_bswap16(dst[0], src, w);
+}
+
+static void kernel_bswap32(void *restrict src, void *restrict dst[], int w)
+{
+    mp_repack_bswap32(dst[0], src, w);
+}
+
+static const struct {
+    const char *name;
+    void (*fn)(void *restrict a, void *restrict b[], int w);
+    bool pack;
+    int packed_size;    // bytes per packed pixel
+    int num_planes;
+    int plane_size;     // bytes per pixel on each plane
+} kernel_tests[] = {
+    {"un_cc8",      mp_repack_un_cc8,       false, 2, 2, 1},
+    {"pa_cc8",      mp_repack_pa_cc8,       true,  2, 2, 1},
+    {"un_cc16",     mp_repack_un_cc16,      false, 4, 2, 2},
+    {"pa_cc16",     mp_repack_pa_cc16,      true,  4, 2, 2},
+    {"un_ccc8",     mp_repack_un_ccc8,      false, 3, 3, 1},
+    {"pa_ccc8",     mp_repack_pa_ccc8,      true,  3, 3, 1},
+    {"un_cccc8",    mp_repack_un_cccc8,     false, 4, 4, 1},
+    {"pa_cccc8",    mp_repack_pa_cccc8,     true,  4, 4, 1},
+    {"un_ccc8x8",   mp_repack_un_ccc8x8,    false, 4, 3, 1},
+    {"pa_ccc8z8",   mp_repack_pa_ccc8z8,    true,  4, 3, 1},
+    {"un_x8ccc8",   mp_repack_un_x8ccc8,    false, 4, 3, 1},
+    {"pa_z8ccc8",   mp_repack_pa_z8ccc8,    true,  4, 3, 1},
+    {"bswap16",     kernel_bswap16,         false, 2, 1, 2},
+    {"bswap32",     kernel_bswap32,         false, 4, 1, 4},
+};
+
+// Check that the SIMD kernels write exactly the same data as the C code,
+// including not touching anything past the end.
+static void check_repack_kernels(void)
+{
+    mp_rand_state rnd = mp_rand_seed(0);
+    int cpu_flags = av_get_cpu_flags();
+
+    for (int t = 0; t < MP_ARRAY_SIZE(kernel_tests); t++) {
+        size_t packed_bytes = KERNEL_MAX_PIXELS * kernel_tests[t].packed_size;
+        size_t plane_bytes = KERNEL_MAX_PIXELS * kernel_tests[t].plane_size;
+        uint8_t *packed[2], *planes[2][4];
+        for (int i = 0; i < 2; i++) {
+            packed[i] = talloc_size(NULL, packed_bytes);
+            for (int p = 0; p < 4; p++)
+                planes[i][p] = talloc_size(packed[i], plane_bytes);
+        }
+
+        // Fill the input with random data, and the output with a pattern.
+        bool pack = kernel_tests[t].pack;
+        for (int w = 0; w <= KERNEL_MAX_PIXELS; w += w < 70 ? 1 : 63) {
+            for (size_t n = 0; n < packed_bytes; n++)
+                packed[0][n] = pack ? 0xAA : mp_rand_next(&rnd);
+            for (int p = 0; p < 4; p++) {
+                for (size_t n = 0; n < plane_bytes; n++)
+                    planes[0][p][n] = pack ? mp_rand_next(&rnd) : 0xAA;
+            }
+            memcpy(packed[1], packed[0], packed_bytes);
+            for (int p = 0; p < 4; p++)
+                memcpy(planes[1][p], planes[0][p], plane_bytes);
+
+            // [0] is the reference, [1] uses whatever the CPU supports.
+            for (int i = 0; i < 2; i++) {
+                av_force_cpu_flags(i ? cpu_flags : 0);
+                kernel_tests[t].fn(packed[i], (void **)planes[i], w);
+            }
+
+            assert_memcmp(packed[0], packed[1], packed_bytes);
+            for (int p = 0; p < kernel_tests[t].num_planes; p++)
+                assert_memcmp(planes[0][p], planes[1][p], plane_bytes);
+        }
+
+        for (int i = 0; i < 2; i++)
+            talloc_free(packed[i]);
+    }
+
+    av_force_cpu_flags(-1);
+}
+
+#define BENCH_W 1920
+#define BENCH_H 1080
+#define BENCH_TIME_NS MP_TIME_MS_TO_NS(500)
+
+static const char *const bench_repack_fmts[] = {
+    "nv12", "p010", "yuyv422", "rgb24", "bgr24", "rgba", "bgr0", "0rgb",
+    "rgba64", "rgb565",
+};
+
+static void bench_repack(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(bench_repack_fmts); n++) {
+        int imgfmt = mp_imgfmt_from_name(bstr0(bench_repack_fmts[n]));
+        for (int pack = 0; pack < 2; pack++) {
+            struct mp_repack *rp = mp_repack_create_planar(imgfmt, pack, 0);
+            if (!rp)
+                continue;
+            int src_fmt = mp_repack_get_format_src(rp);
+            int dst_fmt = mp_repack_get_format_dst(rp);
+            struct mp_image *src = mp_image_alloc(src_fmt, BENCH_W, BENCH_H);
+            struct mp_image *dst = mp_image_alloc(dst_fmt, BENCH_W, BENCH_H);
+            mp_require(src && dst);
+            mp_image_clear(src, 0, 0, src->w, src->h);
+            mp_require(repack_config_buffers(rp, 0, dst, 0, src, NULL));
+
+            int ay = mp_repack_get_align_y(rp);
+            int frames = 0;
+            int64_t start = mp_time_ns(), elapsed;
+            do {
+                for (int y = 0; y < BENCH_H; y += ay)
+                    repack_line(rp, 0, y, 0, y, BENCH_W);
+                frames++;
+                elapsed = mp_time_ns() - start;
+            } while (elapsed < BENCH_TIME_NS);
+
+            printf("repack      %-10s -> %-10s %8.1f Mpixels/s\n",
+                   mp_imgfmt_to_name(src_fmt), mp_imgfmt_to_name(dst_fmt),
+                   (double)BENCH_W * BENCH_H * frames / (elapsed / 1e3));
+
+            talloc_free(src);
+            talloc_free(dst);
+            talloc_free(rp);
+        }
+    }
+}
+
+static const char *const bench_draw_bmp_fmts[] = {
+    "yuv420p", "nv12", "p010", "yuv420p10", "bgr0",
+};
+
+static const int bench_threads[] = {1, 2, 4, 8};
+
+// Blend a 1600x300 subtitle-like overlay (semi-transparent gradient) onto a
+// video frame. Since the bitmaps don't change, this measures only blending.
+static void bench_draw_bmp(void)
+{
+    const int sw = 1600, sh = 300;
+    uint8_t *bitmap = talloc_size(NULL, sw * sh);
+    for (int y = 0; y < sh; y++) {
+        for (int x = 0; x < sw; x++)
+            bitmap[y * sw + x] = (x + y) & 0xFF;
+    }
+
+    struct sub_bitmap sb = {
+        .bitmap = bitmap,
+        .stride = sw,
+        .x = (BENCH_W - sw) / 2,
+        .y = BENCH_H - sh - 50,
+        .w = sw, .dw = sw,
+        .h = sh, .dh = sh,
+
+        .libass = { .color = 0xDEDEDE40 },
+    };
+    struct sub_bitmaps sbs = {
+        .format = SUBBITMAP_LIBASS,
+        .parts = &sb,
+        .num_parts = 1,
+        .change_id = 1,
+    };
+    struct sub_bitmap_list sbs_list = {
+        .change_id = 1,
+        .w = BENCH_W,
+        .h = BENCH_H,
+        .items = (struct sub_bitmaps *[]){&sbs},
+        .num_items = 1,
+    };
+
+    for (int n = 0; n < MP_ARRAY_SIZE(bench_draw_bmp_fmts); n++) {
+        int imgfmt = mp_imgfmt_from_name(bstr0(bench_draw_bmp_fmts[n]));
+        struct mp_image *dst = mp_image_alloc(imgfmt, BENCH_W, BENCH_H);
+        mp_require(dst);
+        mp_image_params_guess_csp(&dst->params);
+        mp_image_clear(dst, 0, 0, dst->w, dst->h);
+
+        struct mp_draw_sub_cache *c = mp_draw_sub_alloc_test(dst);
+        for (int t = 0; t < MP_ARRAY_SIZE(bench_threads); t++) {
+            mp_draw_sub_set_threads(c, bench_threads[t]);
+            // The first call renders the overlay and initializes the cache.
+            mp_require(mp_draw_sub_bitmaps(c, dst, &sbs_list));
+
+            int frames = 0;
+            int64_t start = mp_time_ns(), elapsed;
+            do {
+                mp_require(mp_draw_sub_bitmaps(c, dst, &sbs_list));
+                frames++;
+                elapsed = mp_time_ns() - start;
+            } while (elapsed < BENCH_TIME_NS);
+
+            printf("draw_bmp    %-10s %d threads %8.1f Mpixels/s\n",
+                   mp_imgfmt_to_name(imgfmt), bench_threads[t],
+                   (double)sw * sh * frames / (elapsed / 1e3));
+        }
+
+        talloc_free(c);
+        talloc_free(dst);
+    }
+
+    talloc_free(bitmap);
+}
+
+// Run with --bench as third argument to print the throughput of repack_line()
+// and mp_draw_sub_bitmaps() for some common formats.
 int main(int argc, char *argv[])
 {
     const char *refdir = argv[1];
@@ -514,6 +724,8 @@ int main(int argc, char *argv[])
     check_float_repack(-AV_PIX_FMT_YUVA444P16, PL_COLOR_SYSTEM_BT_709, PL_COLOR_LEVELS_FULL);
     check_float_repack(-AV_PIX_FMT_YUVA444P16, PL_COLOR_SYSTEM_BT_709, PL_COLOR_LEVELS_LIMITED);
 
+    check_repack_kernels();
+
     // Determine the list of possible draw_bmp input formats. Do this here
     // because it mostly depends on repack and imgformat stuff.
     f = test_open_out(outdir, "draw_bmp.txt");
@@ -529,5 +741,10 @@ int main(int argc, char *argv[])
 
     assert_text_files_equal(refdir, outdir, "draw_bmp.txt",
                             "This can fail if FFmpeg/libswscale adds or removes pixfmts.");
+
+    if (argc > 3 && !strcmp(argv[3], "--bench")) {
+        bench_repack();
+        bench_draw_bmp();
+    }
     return 0;
 }
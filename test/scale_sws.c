@@ -18,11 +18,20 @@ static bool supports_fmts(void *pctx, int imgfmt_dst, int imgfmt_src)
     return mp_sws_supports_formats(ctx, imgfmt_dst, imgfmt_src);
 }
 
+static void set_threads(void *pctx, int threads)
+{
+    struct mp_sws_context *ctx = pctx;
+    ctx->threads = threads;
+}
+
 static const struct scale_test_fns fns = {
     .scale = scale,
     .supports_fmts = supports_fmts,
+    .set_threads = set_threads,
 };
 
+// Run with --bench as third argument to print the throughput of some common
+// conversions.
 int main(int argc, char *argv[])
 {
     struct mp_sws_context *sws = mp_sws_alloc(NULL);
@@ -36,6 +45,9 @@ int main(int argc, char *argv[])
 
     repack_test_run(stest);
 
+    if (argc > 3 && !strcmp(argv[3], "--bench"))
+        scale_test_bench(stest);
+
     talloc_free(stest);
     talloc_free(sws);
     return 0;
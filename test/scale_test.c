@@ -1,9 +1,12 @@
 #include <libavcodec/avcodec.h>
 
+#include "osdep/timer.h"
 #include "scale_test.h"
 #include "video/image_writer.h"
 #include "video/sws_utils.h"
 
+#define BENCH_TIME_NS MP_TIME_MS_TO_NS(500)
+
 static struct mp_image *gen_repack_test_img(int w, int h, int bytes, bool rgb,
                                             bool alpha)
 {
@@ -191,3 +194,62 @@ void repack_test_run(struct scale_test *stest)
     assert_text_files_equal(stest->refdir, stest->outdir, logname,
                             "This can fail if FFmpeg adds or removes pixfmts.");
 }
+
+static const struct {
+    const char *src, *dst;
+    int src_w, src_h, dst_w, dst_h;
+} bench_convs[] = {
+    {"yuv420p",     "bgr0",      1920, 1080, 1920, 1080},
+    {"nv12",        "bgr0",      1920, 1080, 1920, 1080},
+    {"p010",        "rgba64",    1920, 1080, 1920, 1080},
+    {"yuv420p10",   "bgr0",      1920, 1080, 1920, 1080},
+    {"bgr0",        "yuv420p",   1920, 1080, 1920, 1080},
+    {"rgb24",       "yuv444p",   1920, 1080, 1920, 1080},
+    {"yuv420p",     "yuv420p",   1920, 1080, 1280,  720},
+    {"nv12",        "bgr0",      3840, 2160, 1920, 1080},
+};
+
+static const int bench_threads[] = {1, 2, 4, 8};
+
+void scale_test_bench(struct scale_test *stest)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(bench_convs); n++) {
+        int src_fmt = mp_imgfmt_from_name(bstr0(bench_convs[n].src));
+        int dst_fmt = mp_imgfmt_from_name(bstr0(bench_convs[n].dst));
+        if (!src_fmt || !dst_fmt ||
+            !stest->fns->supports_fmts(stest->fns_priv, dst_fmt, src_fmt))
+            continue;
+
+        struct mp_image *src = mp_image_alloc(src_fmt, bench_convs[n].src_w,
+                                              bench_convs[n].src_h);
+        struct mp_image *dst = mp_image_alloc(dst_fmt, bench_convs[n].dst_w,
+                                              bench_convs[n].dst_h);
+        mp_require(src && dst);
+        mp_image_params_guess_csp(&src->params);
+        mp_image_params_guess_csp(&dst->params);
+        mp_image_clear(src, 0, 0, src->w, src->h);
+
+        for (int t = 0; t < MP_ARRAY_SIZE(bench_threads); t++) {
+            stest->fns->set_threads(stest->fns_priv, bench_threads[t]);
+            // The first call (re)initializes the converter.
+            mp_require(stest->fns->scale(stest->fns_priv, dst, src));
+
+            int frames = 0;
+            int64_t start = mp_time_ns(), elapsed;
+            do {
+                mp_require(stest->fns->scale(stest->fns_priv, dst, src));
+                frames++;
+                elapsed = mp_time_ns() - start;
+            } while (elapsed < BENCH_TIME_NS);
+
+            printf("%-11s %-10s %4dx%-4d -> %-10s %4dx%-4d %d threads "
+                   "%8.1f Mpixels/s\n", stest->test_name, bench_convs[n].src,
+                   src->w, src->h, bench_convs[n].dst, dst->w, dst->h,
+                   bench_threads[t],
+                   (double)src->w * src->h * frames / (elapsed / 1e3));
+        }
+
+        talloc_free(src);
+        talloc_free(dst);
+    }
+}
@@ -7,6 +7,8 @@
 struct scale_test_fns {
     bool (*scale)(void *ctx, struct mp_image *dst, struct mp_image *src);
     bool (*supports_fmts)(void *ctx, int imgfmt_dst, int imgfmt_src);
+    // Set the number of threads used by scale() (for the benchmark).
+    void (*set_threads)(void *ctx, int threads);
 };
 
 struct scale_test {
@@ -28,3 +30,6 @@ struct scale_test {
 
 // Test color repacking between packed formats (typically RGB).
 void repack_test_run(struct scale_test *stest);
+
+// Print the throughput of some common conversions, for several thread counts.
+void scale_test_bench(struct scale_test *stest);
@@ -2,6 +2,7 @@
 
 #include "scale_test.h"
 #include "video/fmt-conversion.h"
+#include "video/sws_utils.h"
 #include "video/zimg.h"
 
 static bool scale(void *pctx, struct mp_image *dst, struct mp_image *src)
@@ -16,13 +17,65 @@ static bool supports_fmts(void *pctx, int imgfmt_dst, int imgfmt_src)
            mp_zimg_supports_out_format(imgfmt_dst);
 }
 
+static void set_threads(void *pctx, int threads)
+{
+    struct mp_zimg_context *ctx = pctx;
+    ctx->opts.threads = threads;
+    // mp_zimg_convert() doesn't check for option changes.
+    if (ctx->num_states)
+        mp_zimg_config(ctx);
+}
+
 static const struct scale_test_fns fns = {
     .scale = scale,
     .supports_fmts = supports_fmts,
+    .set_threads = set_threads,
 };
 
+static struct mp_zimg_context *alloc_configured(struct mp_image_params *p)
+{
+    struct mp_zimg_context *zimg = mp_zimg_alloc();
+    zimg->opts.threads = 1;
+    zimg->src = zimg->dst = *p;
+    zimg->dst.imgfmt = IMGFMT_BGR0;
+    mp_image_params_guess_csp(&zimg->dst);
+    assert_true(mp_zimg_config(zimg));
+    return zimg;
+}
+
+// A context configured like a freed one has to take over its states.
+static void test_plan_cache(void)
+{
+    struct mp_image_params p = {
+        .imgfmt = IMGFMT_420P, .w = 64, .h = 64, .p_w = 1, .p_h = 1,
+    };
+    mp_image_params_guess_csp(&p);
+
+    void *ref = mp_sws_plan_cache_ref(NULL);
+
+    struct mp_zimg_context *a = alloc_configured(&p);
+    struct mp_zimg_state *st = a->states[0];
+    talloc_free(a);
+
+    struct mp_zimg_context *b = alloc_configured(&p);
+    assert_true(b->states[0] == st);
+
+    // Different parameters must not match.
+    p.w = 32;
+    struct mp_zimg_context *c = alloc_configured(&p);
+    assert_true(c->states[0] != st);
+
+    talloc_free(b);
+    talloc_free(c);
+    talloc_free(ref);
+}
+
+// Run with --bench as third argument to print the throughput of some common
+// conversions.
 int main(int argc, char *argv[])
 {
+    test_plan_cache();
+
     struct mp_zimg_context *zimg = mp_zimg_alloc();
     zimg->opts.threads = 1;
 
@@ -35,6 +88,9 @@ int main(int argc, char *argv[])
 
     repack_test_run(stest);
 
+    if (argc > 3 && !strcmp(argv[3], "--bench"))
+        scale_test_bench(stest);
+
     FILE *f = test_open_out(stest->outdir, "zimg_formats.txt");
     for (int n = 0; n < num_imgfmts; n++) {
         int imgfmt = imgfmts[n];
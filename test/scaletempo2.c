@@ -0,0 +1,94 @@
+#include <libavutil/cpu.h>
+
+#include "audio/chmap.h"
+#include "audio/filter/af_scaletempo2_internals.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+#define RATE 48000
+#define SECONDS 4
+
+static const int channel_counts[] = {1, 2, 6, 8};
+static const double speeds[] = {0.5, 1.5, 2.0, 3.0};
+
+// Time-stretch SECONDS of a sine sweep per channel, and check that the output
+// has the expected length and stays within the input range. Returns how long
+// the processing took in nanoseconds.
+static int64_t run(int channels, double speed)
+{
+    struct mp_scaletempo2 *p = talloc_zero(NULL, struct mp_scaletempo2);
+    p->opts = talloc_ptrtype(p, p->opts);
+    *p->opts = (struct mp_scaletempo2_opts){
+        .min_playback_rate = 0.25,
+        .max_playback_rate = 8.0,
+        .ola_window_size_ms = 12,
+        .wsola_search_interval_ms = 40,
+    };
+    mp_scaletempo2_init(p, channels, RATE);
+
+    int in_frames = RATE * SECONDS;
+    float *in[MP_NUM_CHANNELS], *out[MP_NUM_CHANNELS];
+    for (int c = 0; c < channels; c++) {
+        in[c] = talloc_array(p, float, in_frames);
+        out[c] = talloc_array(p, float, p->ola_hop_size);
+        for (int n = 0; n < in_frames; n++) {
+            double t = n / (double)RATE;
+            in[c][n] = 0.5 * sin(2 * M_PI * (200 + 100 * c + 50 * t) * t);
+        }
+    }
+
+    int64_t start = mp_time_ns();
+    int pos = 0, out_frames = 0;
+    while (pos < in_frames) {
+        uint8_t *planes[MP_NUM_CHANNELS];
+        for (int c = 0; c < channels; c++)
+            planes[c] = (uint8_t *)(in[c] + pos);
+        int read = mp_scaletempo2_fill_input_buffer(p, planes,
+                                                    in_frames - pos, speed);
+        pos += read;
+
+        bool produced = false;
+        while (mp_scaletempo2_frames_available(p, speed)) {
+            int num = mp_scaletempo2_fill_buffer(p, out, p->ola_hop_size, speed);
+            for (int c = 0; c < channels; c++) {
+                for (int n = 0; n < num; n++)
+                    assert_true(isfinite(out[c][n]) && fabsf(out[c][n]) <= 1);
+            }
+            out_frames += num;
+            produced = true;
+        }
+        assert_true(read || produced);
+    }
+    int64_t time = mp_time_ns() - start;
+
+    // Only the frames still buffered by the filter are missing.
+    double expected = in_frames / speed;
+    assert_true(fabs(out_frames - expected) < 0.05 * expected);
+
+    talloc_free(p);
+    return time;
+}
+
+// Run with --bench to print the throughput for each channel count and speed.
+int main(int argc, char *argv[])
+{
+    bool benchmark = argc > 1 && !strcmp(argv[1], "--bench");
+    int flags = av_get_cpu_flags();
+
+    // With all flags and with no flags, to run each dot product version.
+    for (int level = 0; level < 2; level++) {
+        av_force_cpu_flags(level ? 0 : flags);
+        for (int c = 0; c < MP_ARRAY_SIZE(channel_counts); c++) {
+            for (int s = 0; s < MP_ARRAY_SIZE(speeds); s++) {
+                int64_t time = run(channel_counts[c], speeds[s]);
+                if (benchmark) {
+                    printf("%-7s %d ch %.1fx: %6.1fx realtime\n",
+                           level ? "generic" : "native", channel_counts[c],
+                           speeds[s], SECONDS / (time / 1e9));
+                }
+            }
+        }
+    }
+    av_force_cpu_flags(-1);
+    return 0;
+}
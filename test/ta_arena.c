@@ -0,0 +1,163 @@
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+#define BENCH_NODES 200000
+
+static int destroyed;
+
+static void destructor(void *ptr)
+{
+    destroyed++;
+}
+
+static void check_children(void *ctx, int num)
+{
+    char **list = talloc_array(ctx, char *, num);
+    for (int i = 0; i < num; i++)
+        list[i] = talloc_asprintf(ctx, "%d", i);
+    for (int i = 0; i < num; i++) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", i);
+        assert_string_equal(list[i], buf);
+    }
+}
+
+static void test_basic(void)
+{
+    void *arena = talloc_new_arena(NULL);
+
+    // Allocations are usable and aligned like normal allocations.
+    for (int n = 0; n < 1000; n++) {
+        double *d = talloc_zero_size(arena, 3 * n + 1);
+        assert_true(((uintptr_t)d & (sizeof(double) - 1)) == 0);
+        assert_int_equal(talloc_get_size(d), 3 * n + 1);
+        for (int i = 0; i < 3 * n + 1; i++)
+            assert_int_equal(((char *)d)[i], 0);
+        memset(d, 0xAA, 3 * n + 1);
+    }
+
+    // Nested trees, strings, arrays.
+    char *str = talloc_strdup(arena, "abc");
+    for (int n = 0; n < 100; n++)
+        str = talloc_asprintf_append(str, "%d", n);
+    assert_int_equal(strlen(str), 3 + 10 + 90 * 2);
+    int *arr = NULL;
+    int num = 0;
+    for (int n = 0; n < 10000; n++)
+        MP_TARRAY_APPEND(str, arr, num, n);
+    for (int n = 0; n < num; n++)
+        assert_int_equal(arr[n], n);
+
+    // Large allocations.
+    char *large = talloc_size(arena, 1 << 20);
+    memset(large, 1, 1 << 20);
+    large = talloc_realloc_size(arena, large, 2 << 20);
+    assert_int_equal(large[(1 << 20) - 1], 1);
+
+    // Freeing single allocations and children.
+    void *sub = talloc_new(arena);
+    check_children(sub, 100);
+    talloc_free_children(sub);
+    check_children(sub, 100);
+    talloc_free(sub);
+
+    // Reuse after talloc_free_children() on the arena.
+    talloc_free_children(arena);
+    check_children(arena, 10000);
+    talloc_free(arena);
+}
+
+static void test_walk(void)
+{
+    void *ctx = talloc_new(NULL);
+
+    // Destructors still run.
+    void *arena = talloc_new_arena(ctx);
+    destroyed = 0;
+    for (int n = 0; n < 10; n++) {
+        void *p = talloc_new(talloc_new(arena));
+        talloc_set_destructor(p, destructor);
+    }
+    talloc_free(arena);
+    assert_int_equal(destroyed, 10);
+
+    // Allocations moved into the arena are freed with it, allocations moved
+    // out of it survive.
+    arena = talloc_new_arena(ctx);
+    char *foreign = talloc_strdup(NULL, "foreign");
+    talloc_set_destructor(foreign, destructor);
+    talloc_steal(talloc_new(arena), foreign);
+    destroyed = 0;
+    talloc_free_children(arena);
+    assert_int_equal(destroyed, 1);
+    foreign = talloc_strdup(ctx, "out");
+    char *in = talloc_strdup(foreign, "x");
+    talloc_steal(arena, foreign);
+    talloc_steal(ctx, foreign);
+    assert_string_equal(in, "x");
+
+    // Moving within the arena is allowed.
+    void *a = talloc_new(arena), *b = talloc_new(arena);
+    char *s = talloc_strdup(a, "moved");
+    talloc_steal(b, s);
+    talloc_free(a);
+    assert_string_equal(s, "moved");
+
+    // Nested arenas.
+    void *inner = talloc_new_arena(b);
+    check_children(inner, 1000);
+    talloc_free(ctx);
+}
+
+static void test_tree_size(void)
+{
+    void *ctx = talloc_new(NULL);
+    size_t empty = talloc_get_tree_size(ctx);
+    char *a = talloc_size(ctx, 100);
+    talloc_size(a, 50);
+    size_t full = talloc_get_tree_size(ctx);
+    assert_true(full >= empty + 150);
+    assert_int_equal(talloc_get_tree_size(a), full - empty);
+    talloc_free(a);
+    assert_int_equal(talloc_get_tree_size(ctx), empty);
+    assert_int_equal(talloc_get_tree_size(NULL), 0);
+    talloc_free(ctx);
+}
+
+static void *build_tree(void *ctx, int num)
+{
+    void *root = talloc_new(ctx);
+    char **list = NULL;
+    int num_list = 0;
+    for (int n = 0; n < num; n++) {
+        MP_TARRAY_APPEND(root, list, num_list,
+                         talloc_asprintf(root, "track-list/%d/title", n));
+    }
+    return root;
+}
+
+static void bench(void)
+{
+    for (int arena = 0; arena < 2; arena++) {
+        int64_t start = mp_time_ns();
+        for (int n = 0; n < 20; n++) {
+            void *ctx = arena ? talloc_new_arena(NULL) : talloc_new(NULL);
+            build_tree(ctx, BENCH_NODES / 20);
+            talloc_free(ctx);
+        }
+        printf("%-8s %8.2f ms\n", arena ? "arena" : "malloc",
+               (mp_time_ns() - start) / 1e6);
+    }
+}
+
+// Run with --bench to compare against an equivalent normal talloc tree.
+int main(int argc, char *argv[])
+{
+    test_basic();
+    test_walk();
+    test_tree_size();
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+        bench();
+    return 0;
+}
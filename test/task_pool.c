@@ -0,0 +1,114 @@
+#include <stdatomic.h>
+
+#include "misc/thread_pool.h"
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+#define NUM_TASKS 100
+
+struct job {
+    struct mp_task_pool *pool;
+    atomic_int calls[NUM_TASKS];
+    atomic_int nested;
+};
+
+static void count_task(void *ptr, int index)
+{
+    struct job *j = ptr;
+    atomic_fetch_add(&j->calls[index], 1);
+}
+
+static void nested_inner(void *ptr, int index)
+{
+    struct job *j = ptr;
+    atomic_fetch_add(&j->nested, 1);
+}
+
+static void nested_task(void *ptr, int index)
+{
+    struct job *j = ptr;
+    atomic_fetch_add(&j->calls[index], 1);
+    // Must not deadlock, even if all workers are busy with outer tasks.
+    mp_task_pool_run_all(j->pool, MP_TASK_BACKGROUND, 8, nested_inner, j);
+}
+
+static atomic_bool blocker_release;
+static atomic_int pool_calls;
+
+static void blocker(void *ptr)
+{
+    while (!atomic_load(&blocker_release))
+        mp_sleep_ns(MP_TIME_MS_TO_NS(1));
+}
+
+static void pool_count(void *ptr)
+{
+    atomic_fetch_add(&pool_calls, 1);
+}
+
+// Raising the maximum starts threads for queued work; lowering it doesn't wait
+// for busy threads.
+static void test_thread_pool_max(void)
+{
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, 0, 0, 1);
+    assert_true(mp_thread_pool_queue(pool, blocker, NULL));
+    for (int n = 0; n < 3; n++)
+        assert_true(mp_thread_pool_queue(pool, pool_count, NULL));
+
+    mp_thread_pool_set_max_threads(pool, 4);
+    while (atomic_load(&pool_calls) < 3)
+        mp_sleep_ns(MP_TIME_MS_TO_NS(1));
+
+    mp_thread_pool_set_max_threads(pool, 1);
+    assert_true(mp_thread_pool_queue(pool, pool_count, NULL));
+    atomic_store(&blocker_release, true);
+    talloc_free(pool);
+    assert_int_equal(atomic_load(&pool_calls), 4);
+}
+
+static void check_calls(struct job *j, int count)
+{
+    for (int n = 0; n < NUM_TASKS; n++)
+        assert_int_equal(atomic_load(&j->calls[n]), n < count);
+}
+
+int main(void)
+{
+    // No pool: runs everything on the calling thread.
+    struct job j = {0};
+    mp_task_pool_run_all(NULL, MP_TASK_REALTIME, NUM_TASKS, count_task, &j);
+    check_calls(&j, NUM_TASKS);
+
+    void *ctx = talloc_new(NULL);
+    struct mp_task_pool *pool = mp_task_pool_get(ctx);
+    // A second reference shares the same workers.
+    struct mp_task_pool *pool2 = mp_task_pool_get(ctx);
+    assert_int_equal(mp_task_pool_threads(pool), mp_task_pool_threads(pool2));
+    assert_true(mp_task_pool_threads(pool) > 0);
+
+    for (int count = 0; count <= NUM_TASKS; count++) {
+        for (int prio = 0; prio < MP_TASK_PRIO_COUNT; prio++) {
+            j = (struct job){0};
+            mp_task_pool_run_all(count & 1 ? pool : pool2, prio, count,
+                                 count_task, &j);
+            check_calls(&j, count);
+        }
+    }
+
+    j = (struct job){.pool = pool};
+    mp_task_pool_run_all(pool, MP_TASK_REALTIME, NUM_TASKS, nested_task, &j);
+    check_calls(&j, NUM_TASKS);
+    assert_int_equal(atomic_load(&j.nested), NUM_TASKS * 8);
+
+    // Dropping the last reference stops the workers; a new one restarts them.
+    talloc_free(ctx);
+    pool = mp_task_pool_get(NULL);
+    j = (struct job){0};
+    mp_task_pool_run_all(pool, MP_TASK_REALTIME, NUM_TASKS, count_task, &j);
+    check_calls(&j, NUM_TASKS);
+    talloc_free(pool);
+
+    test_thread_pool_max();
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/waveform.h"
+#include "test_utils.h"
+
+#define RATE 48000
+#define INTERVAL 0.1
+
+static struct mp_aframe *make_frame(int format, int channels, double pts,
+                                    int samples, double amplitude, bool lfe)
+{
+    struct mp_aframe *frame = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, channels);
+    mp_aframe_set_format(frame, format);
+    mp_aframe_set_chmap(frame, &chmap);
+    mp_aframe_set_rate(frame, RATE);
+    mp_aframe_set_pts(frame, pts);
+    assert_true(mp_aframe_alloc_data(frame, samples));
+
+    uint8_t **planes = mp_aframe_get_data_rw(frame);
+    bool planar = af_fmt_is_planar(format);
+    for (int n = 0; n < samples; n++) {
+        double t = pts + n / (double)RATE;
+        double v = amplitude * sin(2 * M_PI * 997 * t);
+        for (int c = 0; c < channels; c++) {
+            // Only the first channel, or only the LFE channel, has signal.
+            bool on = lfe ? chmap.speaker[c] == MP_SPEAKER_ID_LFE : c == 0;
+            double s = on ? v : 0;
+            int idx = planar ? n : n * channels + c;
+            uint8_t *data = planes[planar ? c : 0];
+            if (af_fmt_from_planar(format) == AF_FORMAT_S16) {
+                ((int16_t *)data)[idx] = lrint(s * INT16_MAX);
+            } else {
+                ((float *)data)[idx] = s;
+            }
+        }
+    }
+    return frame;
+}
+
+// Feed seconds of a 997 Hz sine in chunks of frame_size samples.
+static void feed(struct mp_waveform *w, int format, int channels, double start,
+                 double seconds, int frame_size, double amplitude, bool lfe)
+{
+    int total = lrint(seconds * RATE);
+    for (int pos = 0; pos < total; pos += frame_size) {
+        int num = MPMIN(frame_size, total - pos);
+        struct mp_aframe *frame = make_frame(format, channels,
+                                             start + pos / (double)RATE, num,
+                                             amplitude, lfe);
+        mp_waveform_add(w, frame);
+        talloc_free(frame);
+    }
+}
+
+// Check bins where one of the channels contains a sine with amplitude amp.
+static void check_sine(struct mp_waveform *w, int first, int last, int channels,
+                       double amp, double loudness)
+{
+    // Skip the first bin, where the K-weighting filter settles.
+    for (int n = first + 1; n < last; n++) {
+        assert_float_equal(w->peak[n], amp, 1e-3);
+        assert_float_equal(w->rms[n], amp / M_SQRT2 / sqrt(channels), 1e-3);
+        assert_float_equal(w->loudness[n], loudness, 0.05);
+    }
+}
+
+int main(void)
+{
+    static const int formats[] = {AF_FORMAT_FLOAT, AF_FORMAT_FLOATP,
+                                  AF_FORMAT_S16, AF_FORMAT_S16P};
+    static const int frame_sizes[] = {1, 1024, 4801, RATE};
+
+    // A full scale 997 Hz sine in one channel is -3.01 LUFS per BS.1770.
+    for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+        for (int s = 0; s < MP_ARRAY_SIZE(frame_sizes); s++) {
+            struct mp_waveform *w = mp_waveform_create(NULL, INTERVAL);
+            feed(w, formats[f], 2, 0, 2, frame_sizes[s], 1, false);
+            assert_int_equal(w->num_bins, 19);
+            assert_int_equal(w->num_filled, 19);
+            mp_waveform_finish(w);
+            assert_int_equal(w->num_bins, 20);
+            check_sine(w, 0, 20, 2, 1, -3.01);
+            talloc_free(w);
+        }
+    }
+
+    // -20 dB, and 5.1 with all signal in the LFE channel.
+    struct mp_waveform *w = mp_waveform_create(NULL, INTERVAL);
+    feed(w, AF_FORMAT_FLOAT, 2, 0, 1, 1024, 0.1, false);
+    check_sine(w, 0, 9, 2, 0.1, -23.01);
+    talloc_free(w);
+
+    w = mp_waveform_create(NULL, INTERVAL);
+    feed(w, AF_FORMAT_FLOAT, 6, 0, 1, 1024, 1, true);
+    for (int n = 0; n < 9; n++)
+        assert_float_equal(w->loudness[n], MP_WAVEFORM_MIN_LOUDNESS, 1e-6);
+    talloc_free(w);
+
+    // After a seek, the bin the new position falls into is skipped, and bins
+    // that were already computed are kept.
+    w = mp_waveform_create(NULL, INTERVAL);
+    feed(w, AF_FORMAT_FLOAT, 1, 0, 1, 1024, 0.5, false);
+    mp_waveform_reset(w);
+    feed(w, AF_FORMAT_FLOAT, 1, 3.05, 1, 1024, 1, false);
+    mp_waveform_reset(w);
+    feed(w, AF_FORMAT_FLOAT, 1, 0.5, 1, 1024, 1, false);
+    assert_int_equal(w->num_bins, 40);
+    assert_int_equal(w->num_filled, 9 + 9 + 5);
+    check_sine(w, 0, 9, 1, 0.5, -9.03);
+    check_sine(w, 8, 14, 1, 1, -3.01);
+    for (int n = 14; n < 31; n++)
+        assert_true(isnan(w->peak[n]));
+    check_sine(w, 30, 40, 1, 1, -3.01);
+    talloc_free(w);
+
+    return 0;
+}
@@ -24,6 +24,7 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/version.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
 #include <libavutil/intreadwrite.h>
@@ -35,6 +36,7 @@
 #include "options/options.h"
 #include "osdep/threads.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
 
@@ -43,6 +45,7 @@
 #include "filters/f_decoder_wrapper.h"
 #include "filters/filter_internal.h"
 #include "video/hwdec.h"
+#include "video/hw_download.h"
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
@@ -58,6 +61,7 @@
 
 static void init_avctx(struct mp_filter *vd);
 static void uninit_avctx(struct mp_filter *vd);
+static void flush_all(struct mp_filter *vd);
 
 static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
@@ -84,6 +88,8 @@ struct vd_lavc_params {
     bool check_hw_profile;
     char **avopts;
     int dr;
+    bool reuse;
+    int gop_threads;
 };
 
 static const struct m_opt_choice_alternatives discard_names[] = {
@@ -115,6 +121,8 @@ const struct m_sub_options vd_lavc_conf = {
         {"vd-lavc-dr", OPT_CHOICE(dr,
             {"auto", -1}, {"no", 0}, {"yes", 1})},
         {"vd-apply-cropping", OPT_BOOL(apply_cropping)},
+        {"vd-lavc-reuse", OPT_BOOL(reuse)},
+        {"vd-lavc-gop-threads", OPT_INT(gop_threads), M_RANGE(0, 64)},
         {0}
     },
     .change_flags = UPDATE_VD,
@@ -141,6 +149,8 @@ struct hwdec_opts {
     int hwdec_image_format;
     int hwdec_extra_frames;
     int hwdec_threads;
+    bool hwdec_cache;
+    int hwdec_copy_threads;
 };
 
 const struct m_sub_options hwdec_conf = {
@@ -158,6 +168,8 @@ const struct m_sub_options hwdec_conf = {
             {"no", INT_MAX}, {"yes", 1}), M_RANGE(1, INT_MAX),
             .flags = UPDATE_HWDEC},
         {"hwdec-threads", OPT_INT(hwdec_threads), M_RANGE(0, DBL_MAX)},
+        {"hwdec-cache", OPT_BOOL(hwdec_cache)},
+        {"hwdec-copy-threads", OPT_INT(hwdec_copy_threads), M_RANGE(0, 16)},
         {"vd-lavc-software-fallback", OPT_REPLACED("hwdec-software-fallback")},
         {0}
     },
@@ -191,6 +203,15 @@ struct hwdec_info {
     int rank;
 };
 
+// Everything besides the codec parameters that affects how an AVCodecContext
+// is set up by init_avctx().
+struct avctx_key {
+    const AVCodec *codec;
+    AVRational timebase;
+    struct vd_lavc_params opts; // avopts is always NULL
+    bool vo_film_grain;
+};
+
 typedef struct lavc_ctx {
     struct mp_log *log;
     struct m_config_cache *opts_cache;
@@ -237,11 +258,24 @@ typedef struct lavc_ctx {
 
     bool hwdec_request_reinit;
     int hwdec_fail_count;
+    // hwdec_devices_get_reserved_frames() when the surface pool was created.
+    int hwdec_reserved_frames;
 
     struct mp_image_pool *hwdec_swpool;
+    struct mp_hw_download *hwdec_download; // for --hwdec-copy-threads
 
     AVBufferRef *cached_hw_frames_ctx;
 
+    // Settings avctx was opened with, for --vd-lavc-reuse.
+    struct avctx_key avctx_key;
+
+    // Set if decoding GOPs in parallel (--vd-lavc-gop-threads).
+    struct gop_ctx *gop;
+
+    // Share of the decoder thread budget held by avctx (--vd-lavc-threads=0).
+    int budget_threads;
+    int64_t budget_weight;
+
     // --- The following fields are protected by dr_lock.
     mp_mutex dr_lock;
     bool dr_failed;
@@ -335,7 +369,7 @@ static void add_hwdec_item(struct hwdec_info **infos, int *num_infos,
     MP_TARRAY_APPEND(NULL, *infos, *num_infos, info);
 }
 
-static void add_all_hwdec_methods(struct hwdec_info **infos, int *num_infos)
+static void build_hwdec_methods(struct hwdec_info **infos, int *num_infos)
 {
     const AVCodec *codec = NULL;
     void *iter = NULL;
@@ -440,6 +474,133 @@ static void add_all_hwdec_methods(struct hwdec_info **infos, int *num_infos)
     qsort(*infos, *num_infos, sizeof(struct hwdec_info), hwdec_compare);
 }
 
+// The list depends on libavcodec only, so it's built once per process.
+static struct hwdec_info *all_hwdecs;
+static int num_all_hwdecs;
+static mp_once all_hwdecs_once = MP_STATIC_ONCE_INITIALIZER;
+
+static void init_all_hwdecs(void)
+{
+    build_hwdec_methods(&all_hwdecs, &num_all_hwdecs);
+}
+
+static void add_all_hwdec_methods(struct hwdec_info **infos, int *num_infos)
+{
+    mp_exec_once(&all_hwdecs_once, init_all_hwdecs);
+    for (int n = 0; n < num_all_hwdecs; n++)
+        MP_TARRAY_APPEND(NULL, *infos, *num_infos, all_hwdecs[n]);
+}
+
+// Process-wide state for --hwdec-cache: devices created for copying hwdecs,
+// and which hwdecs worked or failed for a given kind of video.
+struct hwdec_memo {
+    char codec[32];
+    int profile, format, w, h;
+    char hwdec[64]; // hwdec_info.name
+    bool ok;
+};
+
+#define HWDEC_MEMO_MAX 64
+
+static mp_static_mutex hwdec_cache_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct {
+    enum AVHWDeviceType type;
+    AVBufferRef *dev;
+} hwdec_cached_devs[16];
+static struct hwdec_memo hwdec_memos[HWDEC_MEMO_MAX];
+static int num_hwdec_memos;
+
+static void hwdec_memo_key(struct mp_codec_params *c, struct hwdec_memo *key)
+{
+    *key = (struct hwdec_memo){
+        .profile = c->lav_codecpar ? c->lav_codecpar->profile : -1,
+        .format = c->lav_codecpar ? c->lav_codecpar->format : -1,
+        .w = c->disp_w,
+        .h = c->disp_h,
+    };
+    snprintf(key->codec, sizeof(key->codec), "%s", c->codec);
+}
+
+static bool hwdec_memo_equals(struct hwdec_memo *a, struct hwdec_memo *b)
+{
+    return strcmp(a->codec, b->codec) == 0 && a->profile == b->profile &&
+           a->format == b->format && a->w == b->w && a->h == b->h;
+}
+
+// Return 1 if the hwdec is known to work for c, -1 if it failed, 0 if unknown.
+static int hwdec_memo_lookup(struct mp_codec_params *c, const char *hwdec)
+{
+    struct hwdec_memo key;
+    hwdec_memo_key(c, &key);
+    int res = 0;
+    mp_mutex_lock(&hwdec_cache_lock);
+    for (int n = 0; n < num_hwdec_memos; n++) {
+        struct hwdec_memo *m = &hwdec_memos[n];
+        if (hwdec_memo_equals(m, &key) && strcmp(m->hwdec, hwdec) == 0) {
+            res = m->ok ? 1 : -1;
+            break;
+        }
+    }
+    mp_mutex_unlock(&hwdec_cache_lock);
+    return res;
+}
+
+static void hwdec_memo_set(struct mp_filter *vd, bool ok)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    if (!ctx->hwdec_opts->hwdec_cache || !ctx->use_hwdec)
+        return;
+    struct hwdec_memo key;
+    hwdec_memo_key(ctx->codec, &key);
+    snprintf(key.hwdec, sizeof(key.hwdec), "%s", ctx->hwdec.name);
+    key.ok = ok;
+    mp_mutex_lock(&hwdec_cache_lock);
+    int n = 0;
+    while (n < num_hwdec_memos && !(hwdec_memo_equals(&hwdec_memos[n], &key) &&
+                                    strcmp(hwdec_memos[n].hwdec, key.hwdec) == 0))
+        n++;
+    if (n == num_hwdec_memos) {
+        if (num_hwdec_memos == HWDEC_MEMO_MAX) {
+            // Forget the oldest entry.
+            memmove(&hwdec_memos[0], &hwdec_memos[1],
+                    (HWDEC_MEMO_MAX - 1) * sizeof(hwdec_memos[0]));
+            n -= 1;
+        } else {
+            num_hwdec_memos++;
+        }
+    }
+    hwdec_memos[n] = key;
+    mp_mutex_unlock(&hwdec_cache_lock);
+}
+
+// Return a new reference to a cached device of the given type, or NULL.
+static AVBufferRef *get_cached_dev(enum AVHWDeviceType type)
+{
+    AVBufferRef *ref = NULL;
+    mp_mutex_lock(&hwdec_cache_lock);
+    for (int n = 0; n < MP_ARRAY_SIZE(hwdec_cached_devs); n++) {
+        if (hwdec_cached_devs[n].dev && hwdec_cached_devs[n].type == type) {
+            ref = av_buffer_ref(hwdec_cached_devs[n].dev);
+            break;
+        }
+    }
+    mp_mutex_unlock(&hwdec_cache_lock);
+    return ref;
+}
+
+static void add_cached_dev(enum AVHWDeviceType type, AVBufferRef *dev)
+{
+    mp_mutex_lock(&hwdec_cache_lock);
+    for (int n = 0; n < MP_ARRAY_SIZE(hwdec_cached_devs); n++) {
+        if (!hwdec_cached_devs[n].dev) {
+            hwdec_cached_devs[n].type = type;
+            hwdec_cached_devs[n].dev = av_buffer_ref(dev);
+            break;
+        }
+    }
+    mp_mutex_unlock(&hwdec_cache_lock);
+}
+
 static bool hwdec_codec_allowed(struct mp_filter *vd, const char *codec)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -461,18 +622,25 @@ static AVBufferRef *hwdec_create_dev(struct mp_filter *vd,
     mp_assert(hwdec->lavc_device);
 
     if (hwdec->copying) {
+        bool cache = ctx->hwdec_opts->hwdec_cache;
+        AVBufferRef *ref = cache ? get_cached_dev(hwdec->lavc_device) : NULL;
+        if (ref) {
+            MP_VERBOSE(vd, "Reusing cached device.\n");
+            return ref;
+        }
         const struct hwcontext_fns *fns =
             hwdec_get_hwcontext_fns(hwdec->lavc_device);
         if (fns && fns->create_dev) {
             struct hwcontext_create_dev_params params = {
                 .probing = autoprobe,
             };
-            return fns->create_dev(vd->global, vd->log, &params);
+            ref = fns->create_dev(vd->global, vd->log, &params);
         } else {
-            AVBufferRef* ref = NULL;
             av_hwdevice_ctx_create(&ref, hwdec->lavc_device, NULL, NULL, 0);
-            return ref;
         }
+        if (ref && cache)
+            add_cached_dev(hwdec->lavc_device, ref);
+        return ref;
     } else if (ctx->hwdec_devs) {
         int imgfmt = pixfmt2imgfmt(hwdec->pix_fmt);
         struct hwdec_imgfmt_request params = {
@@ -504,6 +672,19 @@ static void select_and_set_hwdec(struct mp_filter *vd)
     int num_hwdecs = 0;
     add_all_hwdec_methods(&hwdecs, &num_hwdecs);
 
+    bool use_memo = ctx->hwdec_opts->hwdec_cache;
+    if (use_memo) {
+        // Try a hwdec that worked for this kind of video before first.
+        for (int n = 0; n < num_hwdecs; n++) {
+            if (hwdec_memo_lookup(ctx->codec, hwdecs[n].name) > 0) {
+                struct hwdec_info hwdec = hwdecs[n];
+                MP_TARRAY_REMOVE_AT(hwdecs, num_hwdecs, n);
+                MP_TARRAY_INSERT_AT(NULL, hwdecs, num_hwdecs, 0, hwdec);
+                break;
+            }
+        }
+    }
+
     char **hwdec_api = ctx->hwdec_opts->hwdec_api;
     for (int i = 0; hwdec_api && hwdec_api[i]; i++) {
         bstr opt = bstr0(hwdec_api[i]);
@@ -557,6 +738,14 @@ static void select_and_set_hwdec(struct mp_filter *vd)
                 if (hwdec_auto_safe && !(hwdec->flags & HWDEC_FLAG_WHITELIST))
                     continue;
 
+                if (hwdec_auto && use_memo &&
+                    hwdec_memo_lookup(ctx->codec, hwdec->name) < 0)
+                {
+                    MP_VERBOSE(vd, "Skipping hwdec %s, failed before.\n",
+                               hwdec->name);
+                    continue;
+                }
+
                 MP_VERBOSE(vd, "Looking at hwdec %s...\n", hwdec->name);
 
                 /*
@@ -696,11 +885,493 @@ static void reinit(struct mp_filter *vd)
     init_avctx(vd);
     if (!ctx->avctx && use_hwdec) {
         do {
+            hwdec_memo_set(vd, false);
             force_fallback(vd);
         } while (!ctx->avctx);
     }
 }
 
+// --vd-lavc-reuse: the software decoder context of the last destroyed decoder,
+// which the next decoder takes if it would open it with identical settings.
+static mp_static_mutex warm_lock = MP_STATIC_MUTEX_INITIALIZER;
+static AVCodecContext *warm_avctx;
+static AVCodecParameters *warm_par;
+static struct avctx_key warm_key;
+
+static bool avctx_key_equals(struct avctx_key *a, struct avctx_key *b)
+{
+    struct vd_lavc_params *o1 = &a->opts, *o2 = &b->opts;
+    return a->codec == b->codec &&
+           av_cmp_q(a->timebase, b->timebase) == 0 &&
+           a->vo_film_grain == b->vo_film_grain &&
+           o1->fast == o2->fast &&
+           o1->film_grain == o2->film_grain &&
+           o1->show_all == o2->show_all &&
+           o1->skip_loop_filter == o2->skip_loop_filter &&
+           o1->skip_idct == o2->skip_idct &&
+           o1->skip_frame == o2->skip_frame &&
+           o1->threads == o2->threads &&
+           o1->bitexact == o2->bitexact &&
+           o1->old_x264 == o2->old_x264 &&
+           o1->apply_cropping == o2->apply_cropping;
+}
+
+static bool codecpar_equals(AVCodecParameters *a, AVCodecParameters *b)
+{
+    return a->codec_id == b->codec_id &&
+           a->codec_tag == b->codec_tag &&
+           a->width == b->width &&
+           a->height == b->height &&
+           a->format == b->format &&
+           a->profile == b->profile &&
+           a->level == b->level &&
+           a->bits_per_coded_sample == b->bits_per_coded_sample &&
+           a->field_order == b->field_order &&
+           a->color_range == b->color_range &&
+           a->color_primaries == b->color_primaries &&
+           a->color_trc == b->color_trc &&
+           a->color_space == b->color_space &&
+           a->chroma_location == b->chroma_location &&
+           av_cmp_q(a->sample_aspect_ratio, b->sample_aspect_ratio) == 0 &&
+           a->extradata_size == b->extradata_size &&
+           (!a->extradata_size ||
+            memcmp(a->extradata, b->extradata, a->extradata_size) == 0);
+}
+
+static void free_warm_avctx(void)
+{
+    avcodec_free_context(&warm_avctx);
+    avcodec_parameters_free(&warm_par);
+}
+
+// Keep ctx->avctx for reuse by the next decoder. Only plain software decoding
+// contexts are kept, because hwdec devices and DR buffers are tied to the VO.
+static void park_avctx(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *avctx = ctx->avctx;
+    if (!ctx->opts->reuse || !avctx || ctx->use_hwdec || ctx->gop ||
+        avctx->get_buffer2 != avcodec_default_get_buffer2 ||
+        (ctx->opts->avopts && ctx->opts->avopts[0]))
+        return;
+
+    AVCodecParameters *par = mp_codec_params_to_av(ctx->codec);
+    if (!par)
+        return;
+
+    flush_all(vd);
+
+    mp_mutex_lock(&warm_lock);
+    free_warm_avctx();
+    warm_avctx = avctx;
+    warm_par = par;
+    warm_key = ctx->avctx_key;
+    mp_mutex_unlock(&warm_lock);
+
+    ctx->avctx = NULL;
+    MP_VERBOSE(vd, "Keeping decoder for reuse.\n");
+}
+
+// Take the parked context if it matches. Any other parked context is freed,
+// since the following files are likely to be like this one.
+static AVCodecContext *take_warm_avctx(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecParameters *par = mp_codec_params_to_av(ctx->codec);
+    if (!par)
+        return NULL;
+
+    AVCodecContext *avctx = NULL;
+    mp_mutex_lock(&warm_lock);
+    if (warm_avctx && avctx_key_equals(&warm_key, &ctx->avctx_key) &&
+        codecpar_equals(warm_par, par))
+    {
+        avctx = warm_avctx;
+        warm_avctx = NULL;
+    }
+    free_warm_avctx();
+    mp_mutex_unlock(&warm_lock);
+
+    avcodec_parameters_free(&par);
+    return avctx;
+}
+
+// --vd-lavc-gop-threads: packets are collected into GOPs, each starting with
+// a keyframe. Each GOP is decoded by a separate decoder on a thread pool, and
+// the frames are returned GOP by GOP. If non-keyframes are skipped anyway, each
+// keyframe is a GOP.
+struct gop_job {
+    struct gop_ctx *g;
+    struct demux_packet **pkts;
+    enum AVDiscard *skip_frame; // per packet (for hr-seek framedrop)
+    int num_pkts;
+    // Written by the worker; accessed by the filter only once done is set.
+    AVFrame **frames;
+    int num_frames;
+    int next_frame;
+    // Protected by gop_ctx.lock.
+    bool done;
+    bool cancel;
+};
+
+struct gop_ctx {
+    struct mp_filter *vd;
+    struct mp_thread_pool *pool;
+    AVRational timebase;
+    bool keyframes_only;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    AVCodecContext **avctxs;    // one per thread
+    bool *avctx_busy;           // protected by lock
+    int num_avctxs;
+
+    // Accessed by the filter only.
+    struct gop_job **jobs;      // queued or decoded GOPs, in decoding order
+    int num_jobs;
+    struct gop_job *cur;        // GOP being collected
+    bool eof;
+};
+
+static void gop_decode(void *ptr)
+{
+    struct gop_job *job = ptr;
+    struct gop_ctx *g = job->g;
+
+    mp_mutex_lock(&g->lock);
+    int idx = 0;
+    while (g->avctx_busy[idx])
+        idx++;
+    g->avctx_busy[idx] = true;
+    mp_mutex_unlock(&g->lock);
+
+    AVCodecContext *avctx = g->avctxs[idx];
+    AVPacket *avpkt = av_packet_alloc();
+
+    for (int n = 0; avpkt && n <= job->num_pkts; n++) {
+        mp_mutex_lock(&g->lock);
+        bool cancel = job->cancel;
+        mp_mutex_unlock(&g->lock);
+        if (cancel)
+            break;
+
+        struct demux_packet *pkt = n < job->num_pkts ? job->pkts[n] : NULL;
+        if (pkt)
+            avctx->skip_frame = job->skip_frame[n];
+        mp_set_av_packet(avpkt, pkt, &g->timebase);
+        avcodec_send_packet(avctx, pkt ? avpkt : NULL);
+        while (1) {
+            AVFrame *frame = av_frame_alloc();
+            if (!frame || avcodec_receive_frame(avctx, frame) < 0) {
+                av_frame_free(&frame);
+                break;
+            }
+            MP_TARRAY_APPEND(job, job->frames, job->num_frames, frame);
+        }
+    }
+
+    av_packet_free(&avpkt);
+    avcodec_flush_buffers(avctx);
+
+    mp_mutex_lock(&g->lock);
+    g->avctx_busy[idx] = false;
+    job->done = true;
+    mp_cond_broadcast(&g->wakeup);
+    // (Under the lock, so that the filter can't be destroyed before this.)
+    mp_filter_wakeup(g->vd);
+    mp_mutex_unlock(&g->lock);
+}
+
+static void gop_free_job(struct gop_job *job)
+{
+    if (!job)
+        return;
+    for (int n = 0; n < job->num_pkts; n++)
+        talloc_free(job->pkts[n]);
+    for (int n = 0; n < job->num_frames; n++)
+        av_frame_free(&job->frames[n]);
+    talloc_free(job);
+}
+
+static void gop_wait_job(struct gop_ctx *g, struct gop_job *job)
+{
+    mp_mutex_lock(&g->lock);
+    while (!job->done)
+        mp_cond_wait(&g->wakeup, &g->lock);
+    mp_mutex_unlock(&g->lock);
+}
+
+static void gop_reset(struct gop_ctx *g)
+{
+    mp_mutex_lock(&g->lock);
+    for (int n = 0; n < g->num_jobs; n++)
+        g->jobs[n]->cancel = true;
+    mp_mutex_unlock(&g->lock);
+
+    for (int n = 0; n < g->num_jobs; n++) {
+        gop_wait_job(g, g->jobs[n]);
+        gop_free_job(g->jobs[n]);
+    }
+    g->num_jobs = 0;
+    gop_free_job(g->cur);
+    g->cur = NULL;
+    g->eof = false;
+}
+
+static void gop_uninit(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct gop_ctx *g = ctx->gop;
+    if (!g)
+        return;
+
+    gop_reset(g);
+    talloc_free(g->pool);
+    for (int n = 0; n < g->num_avctxs; n++)
+        avcodec_free_context(&g->avctxs[n]);
+    mp_cond_destroy(&g->wakeup);
+    mp_mutex_destroy(&g->lock);
+    TA_FREEP(&ctx->gop);
+}
+
+// Open a decoder like ctx->avctx (without hwdec, DR, or frame threading).
+static AVCodecContext *gop_open_avctx(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *ref = ctx->avctx;
+    AVCodecContext *avctx = avcodec_alloc_context3(ref->codec);
+    if (!avctx)
+        return NULL;
+
+    avctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    avctx->codec_id = ref->codec_id;
+    avctx->pkt_timebase = ctx->codec_timebase;
+    avctx->thread_count = 1;
+    avctx->flags = ref->flags;
+    avctx->flags2 = ref->flags2;
+    avctx->skip_loop_filter = ref->skip_loop_filter;
+    avctx->skip_idct = ref->skip_idct;
+    avctx->skip_frame = ctx->skip_frame;
+    avctx->apply_cropping = ref->apply_cropping;
+    avctx->export_side_data = ref->export_side_data;
+    mp_set_avopts(vd->log, avctx, ctx->opts->avopts);
+
+    if (mp_set_avctx_codec_headers(avctx, ctx->codec) < 0 ||
+        avcodec_open2(avctx, ref->codec, NULL) < 0)
+        avcodec_free_context(&avctx);
+    return avctx;
+}
+
+static void gop_init(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    int num = ctx->opts->gop_threads;
+
+    struct gop_ctx *g = talloc_zero(NULL, struct gop_ctx);
+    g->vd = vd;
+    g->timebase = ctx->codec_timebase;
+    g->keyframes_only = ctx->skip_frame >= AVDISCARD_NONKEY;
+    g->avctxs = talloc_zero_array(g, AVCodecContext *, num);
+    g->avctx_busy = talloc_zero_array(g, bool, num);
+    mp_mutex_init(&g->lock);
+    mp_cond_init(&g->wakeup);
+    ctx->gop = g;
+
+    for (int n = 0; n < num; n++) {
+        g->avctxs[n] = gop_open_avctx(vd);
+        if (!g->avctxs[n])
+            break;
+        g->num_avctxs++;
+    }
+    g->pool = mp_thread_pool_create(g, 0, 0, g->num_avctxs);
+    if (g->num_avctxs < 2 || !g->pool) {
+        MP_WARN(vd, "Could not create GOP decoders.\n");
+        gop_uninit(vd);
+        return;
+    }
+
+    MP_VERBOSE(vd, "Decoding %s on %d threads.\n",
+               g->keyframes_only ? "keyframes" : "GOPs", g->num_avctxs);
+}
+
+static void gop_submit(struct gop_ctx *g)
+{
+    struct gop_job *job = g->cur;
+    g->cur = NULL;
+    if (!job)
+        return;
+    MP_TARRAY_APPEND(g, g->jobs, g->num_jobs, job);
+    if (!mp_thread_pool_queue(g->pool, gop_decode, job))
+        gop_decode(job);
+}
+
+static int gop_send_packet(struct mp_filter *vd, struct demux_packet *pkt)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct gop_ctx *g = ctx->gop;
+
+    if (!pkt) {
+        gop_submit(g);
+        g->eof = true;
+        return 0;
+    }
+
+    // hr-seek framedrop: if the next keyframe is still before the seek target,
+    // no frame of the current GOP is needed, so it's not decoded at all. In
+    // the GOP with the target, non-reference frames before it are skipped.
+    bool hr_drop = ctx->framedrop_flags == 2;
+
+    if (pkt->keyframe) {
+        if (hr_drop && !g->keyframes_only) {
+            gop_free_job(g->cur);
+            g->cur = NULL;
+        } else {
+            gop_submit(g);
+        }
+    }
+    if (!g->cur && !pkt->keyframe)
+        return 0; // can't decode this without the start of its GOP
+    if (g->keyframes_only && !pkt->keyframe)
+        return 0;
+
+    if (!g->cur) {
+        g->cur = talloc_zero(NULL, struct gop_job);
+        g->cur->g = g;
+    }
+    struct demux_packet *copy = demux_copy_packet(vd->packet_pool, pkt);
+    if (copy) {
+        struct gop_job *job = g->cur;
+        MP_TARRAY_GROW(job, job->skip_frame, job->num_pkts);
+        job->skip_frame[job->num_pkts] =
+            hr_drop ? AVDISCARD_NONREF : ctx->skip_frame;
+        MP_TARRAY_APPEND(job, job->pkts, job->num_pkts, copy);
+    }
+
+    if (g->keyframes_only)
+        gop_submit(g);
+    return 0;
+}
+
+static int gop_receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct gop_ctx *g = ctx->gop;
+
+    while (g->num_jobs) {
+        struct gop_job *job = g->jobs[0];
+
+        mp_mutex_lock(&g->lock);
+        bool done = job->done;
+        mp_mutex_unlock(&g->lock);
+
+        if (!done) {
+            // Keep all decoders busy before waiting for the oldest GOP.
+            if (!g->eof && g->num_jobs < g->num_avctxs * 2)
+                return AVERROR(EAGAIN);
+            gop_wait_job(g, job);
+        }
+
+        if (job->next_frame < job->num_frames) {
+            AVFrame *frame = job->frames[job->next_frame++];
+            struct mp_image *mpi = mp_image_from_av_frame(frame);
+            if (!mpi)
+                continue;
+            mpi->pts = mp_pts_from_av(frame->pts, &g->timebase);
+            mpi->dts = mp_pts_from_av(frame->pkt_dts, &g->timebase);
+            mpi->pkt_duration = mp_pts_from_av(frame->duration, &g->timebase);
+            if (!ctx->hwdec_notified) {
+                MP_VERBOSE(vd, "Using software decoding.\n");
+                ctx->hwdec_notified = true;
+            }
+            *out_frame = MAKE_FRAME(MP_FRAME_VIDEO, mpi);
+            return 0;
+        }
+
+        gop_free_job(job);
+        MP_TARRAY_REMOVE_AT(g->jobs, g->num_jobs, 0);
+    }
+
+    if (g->eof) {
+        g->eof = false;
+        return AVERROR_EOF;
+    }
+    return AVERROR(EAGAIN);
+}
+
+// --vd-lavc-threads=0: the CPU cores are shared by all software decoders of
+// the process (including preloading), weighted by how expensive their streams
+// are to decode. libavcodec can't change the thread count of an open decoder,
+// so decoders take their share when they are opened, and return it on close.
+static mp_static_mutex budget_lock = MP_STATIC_MUTEX_INITIALIZER;
+static int budget_used;         // threads held by open decoders
+static int64_t budget_weights;  // sum of budget_weight of open decoders
+static int budget_decoders;     // number of open decoders
+
+static int acquire_auto_threads(struct mp_filter *vd, const AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    int cores = av_cpu_count();
+    if (cores < 1) {
+        MP_WARN(vd, "Could not determine thread count to use, defaulting to 1.\n");
+        return 1;
+    }
+    MP_VERBOSE(vd, "Detected %d logical cores.\n", cores);
+    // Extra thread for better load balancing. Apparently some libavcodec
+    // versions have or had trouble with more than 16 threads, and/or print a
+    // warning when using > 16.
+    int budget = MPMIN(cores > 1 ? cores + 1 : 1, 16);
+
+    // Threads beyond about one per 640x360 area rarely help, since frame
+    // threads stall on each other's reference frames.
+    int64_t pixels = (int64_t)MPMAX(ctx->codec->disp_w, 1) *
+                     MPMAX(ctx->codec->disp_h, 1);
+    int max_threads = MPCLAMP(pixels / (640 * 360), 2, 16);
+
+    int64_t weight = pixels;
+    switch (codec->id) {
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_VP9:
+    case AV_CODEC_ID_AV1:
+        weight *= 2;
+        break;
+    default: ;
+    }
+
+    mp_mutex_lock(&budget_lock);
+    int share = (budget * weight + budget_weights + weight - 1) /
+                (budget_weights + weight);
+    int threads = MPMIN(share, budget - budget_used);
+    threads = MPCLAMP(threads, 1, max_threads);
+    budget_used += threads;
+    budget_weights += weight;
+    budget_decoders += 1;
+    int num = budget_decoders;
+    mp_mutex_unlock(&budget_lock);
+
+    ctx->budget_threads = threads;
+    ctx->budget_weight = weight;
+    MP_VERBOSE(vd, "Using %d of %d decoder threads (%d decoders active).\n",
+               threads, budget, num);
+    return threads;
+}
+
+static void release_auto_threads(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    if (!ctx->budget_threads)
+        return;
+
+    mp_mutex_lock(&budget_lock);
+    budget_used -= ctx->budget_threads;
+    budget_weights -= ctx->budget_weight;
+    budget_decoders -= 1;
+    mp_mutex_unlock(&budget_lock);
+
+    ctx->budget_threads = 0;
+    ctx->budget_weight = 0;
+}
+
 static void init_avctx(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -728,6 +1399,33 @@ static void init_avctx(struct mp_filter *vd)
 
     ctx->hwdec_failed = false;
     ctx->hwdec_request_reinit = false;
+
+    ctx->avctx_key = (struct avctx_key){
+        .codec = lavc_codec,
+        .timebase = ctx->codec_timebase,
+        .opts = *lavc_param,
+        .vo_film_grain = ctx->vo && (ctx->vo->driver->caps & VO_CAP_FILM_GRAIN),
+    };
+    ctx->avctx_key.opts.avopts = NULL;
+
+    bool dr = !ctx->use_hwdec && ctx->vo && lavc_param->dr;
+    if (lavc_param->reuse && !ctx->use_hwdec && !dr &&
+        !(lavc_param->avopts && lavc_param->avopts[0]))
+    {
+        ctx->avctx = take_warm_avctx(vd);
+        if (ctx->avctx) {
+            MP_VERBOSE(vd, "Reusing decoder of the previous file.\n");
+            ctx->pic = av_frame_alloc();
+            ctx->avpkt = av_packet_alloc();
+            if (!ctx->pic || !ctx->avpkt)
+                goto error;
+            // (framedrop may have changed it on the avctx)
+            ctx->skip_frame = lavc_param->skip_frame;
+            ctx->avctx->skip_frame = ctx->skip_frame;
+            return;
+        }
+    }
+
     ctx->avctx = avcodec_alloc_context3(lavc_codec);
     AVCodecContext *avctx = ctx->avctx;
     if (!ctx->avctx)
@@ -790,9 +1488,11 @@ static void init_avctx(struct mp_filter *vd)
 #endif
     }
 
+    if (threads == 0 && !ctx->use_hwdec)
+        threads = acquire_auto_threads(vd, lavc_codec);
     mp_set_avcodec_threads(vd->log, avctx, threads);
 
-    if (!ctx->use_hwdec && ctx->vo && lavc_param->dr) {
+    if (dr) {
         avctx->opaque = vd;
         avctx->get_buffer2 = get_buffer2_direct;
     }
@@ -867,6 +1567,9 @@ static void init_avctx(struct mp_filter *vd)
         avcodec_flush_buffers(ctx->avctx);
     }
 
+    if (lavc_param->gop_threads > 1 && !ctx->use_hwdec && !dr)
+        gop_init(vd);
+
     return;
 
 error:
@@ -900,6 +1603,9 @@ static void flush_all(struct mp_filter *vd)
         talloc_free(ctx->requeue_packets[n]);
     ctx->num_requeue_packets = 0;
 
+    if (ctx->gop)
+        gop_reset(ctx->gop);
+
     reset_avctx(vd);
 }
 
@@ -908,13 +1614,16 @@ static void uninit_avctx(struct mp_filter *vd)
     vd_ffmpeg_ctx *ctx = vd->priv;
 
     flush_all(vd);
+    gop_uninit(vd);
     av_frame_free(&ctx->pic);
     mp_free_av_packet(&ctx->avpkt);
     av_buffer_unref(&ctx->cached_hw_frames_ctx);
 
     avcodec_free_context(&ctx->avctx);
+    release_auto_threads(vd);
 
     av_buffer_unref(&ctx->hwdec_dev);
+    TA_FREEP(&ctx->hwdec_download);
 
     ctx->hwdec_failed = false;
     ctx->hwdec_fail_count = 0;
@@ -951,9 +1660,17 @@ static int init_generic_hwaccel(struct AVCodecContext *avctx, enum AVPixelFormat
         new_fctx->sw_format = imgfmt2pixfmt(ctx->hwdec_opts->hwdec_image_format);
 
     // 1 surface is already included by libavcodec. The field is 0 if the
-    // hwaccel supports dynamic surface allocation.
-    if (new_fctx->initial_pool_size)
-        new_fctx->initial_pool_size += ctx->hwdec_opts->hwdec_extra_frames - 1;
+    // hwaccel supports dynamic surface allocation. Filters holding reference
+    // frames (deinterlacers) reserve the surfaces they need on top.
+    ctx->hwdec_reserved_frames = 0;
+    if (new_fctx->initial_pool_size) {
+        if (ctx->hwdec_devs) {
+            ctx->hwdec_reserved_frames =
+                hwdec_devices_get_reserved_frames(ctx->hwdec_devs);
+        }
+        new_fctx->initial_pool_size += ctx->hwdec_opts->hwdec_extra_frames - 1 +
+                                       ctx->hwdec_reserved_frames;
+    }
 
     const struct hwcontext_fns *fns =
         hwdec_get_hwcontext_fns(new_fctx->device_ctx->type);
@@ -1169,6 +1886,9 @@ static int send_packet(struct mp_filter *vd, struct demux_packet *pkt)
     vd_ffmpeg_ctx *ctx = vd->priv;
     AVCodecContext *avctx = ctx->avctx;
 
+    if (ctx->gop)
+        return gop_send_packet(vd, pkt);
+
     if (ctx->num_requeue_packets && ctx->requeue_packets[0] != pkt)
         return AVERROR(EAGAIN); // cannot consume the packet
 
@@ -1276,10 +1996,30 @@ static int decode_frame(struct mp_filter *vd)
     return ret;
 }
 
+// Copy a frame for *-copy hwdecs to system memory.
+static struct mp_image *download_hw_frame(struct mp_filter *vd,
+                                          struct mp_image *img)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    int threads = ctx->hwdec_opts->hwdec_copy_threads;
+
+    if (!threads)
+        return mp_image_hw_download(img, ctx->hwdec_swpool);
+
+    if (!ctx->hwdec_download) {
+        ctx->hwdec_download = mp_hw_download_create(ctx, threads);
+        MP_VERBOSE(vd, "Copying back with %d threads.\n", threads);
+    }
+    return mp_hw_download(ctx->hwdec_download, img, ctx->hwdec_swpool);
+}
+
 static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
 
+    if (ctx->gop)
+        return gop_receive_frame(vd, out_frame);
+
     int ret = decode_frame(vd);
 
     if (ctx->hwdec_failed) {
@@ -1300,6 +2040,7 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
          * decoder will successfully init even if the hwaccel fails later.)
          */
         do {
+            hwdec_memo_set(vd, false);
             force_fallback(vd);
         } while (!ctx->avctx);
 
@@ -1326,7 +2067,7 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         return AVERROR_UNKNOWN;
 
     if (ctx->use_hwdec && ctx->hwdec.copying && res->hwctx) {
-        struct mp_image *sw = mp_image_hw_download(res, ctx->hwdec_swpool);
+        struct mp_image *sw = download_hw_frame(vd, res);
         mp_image_unrefp(&res);
         res = sw;
         if (!res) {
@@ -1341,6 +2082,7 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         if (ctx->use_hwdec) {
             MP_INFO(vd, "Using hardware decoding (%s).\n",
                     ctx->hwdec.method_name);
+            hwdec_memo_set(vd, true);
         } else {
             MP_VERBOSE(vd, "Using software decoding.\n");
         }
@@ -1408,6 +2150,19 @@ static void vd_lavc_reset(struct mp_filter *vd)
 
     flush_all(vd);
 
+    // Filters were added after the preallocated surface pool was created. The
+    // decoder has to restart after the reset anyway, so recreate it with a
+    // pool large enough for them.
+    if (ctx->use_hwdec && ctx->cached_hw_frames_ctx && ctx->hwdec_devs) {
+        AVHWFramesContext *fctx = (void *)ctx->cached_hw_frames_ctx->data;
+        int reserved = hwdec_devices_get_reserved_frames(ctx->hwdec_devs);
+        if (fctx->initial_pool_size && reserved > ctx->hwdec_reserved_frames) {
+            MP_VERBOSE(vd, "Filters reserved %d hardware frames, recreating "
+                       "decoder.\n", reserved);
+            reinit(vd);
+        }
+    }
+
     ctx->state = (struct lavc_state){0};
     ctx->framedrop_flags = 0;
 }
@@ -1416,6 +2171,7 @@ static void vd_lavc_destroy(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
 
+    park_avctx(vd);
     uninit_avctx(vd);
 
     mp_mutex_destroy(&ctx->dr_lock);
@@ -1477,6 +2233,15 @@ static struct mp_decoder *create(struct mp_filter *parent,
     return &ctx->public;
 }
 
+bool vd_lavc_hwdec_requested(struct mpv_global *global)
+{
+    struct hwdec_opts *opts = mp_get_config_group(NULL, global, &hwdec_conf);
+    char **api = opts->hwdec_api;
+    bool res = api && api[0] && strcmp(api[0], "no") != 0;
+    talloc_free(opts);
+    return res;
+}
+
 static void add_decoders(struct mp_decoder_list *list)
 {
     mp_add_lavc_decoders(list, AVMEDIA_TYPE_VIDEO);
@@ -18,10 +18,12 @@
 #include <assert.h>
 
 #include <libavutil/buffer.h>
+#include <libavutil/hwcontext.h>
 
 #include "common/common.h"
 #include "filters/f_autoconvert.h"
 #include "filters/filter_internal.h"
+#include "video/hwdec.h"
 #include "video/mp_image.h"
 
 #include "refqueue.h"
@@ -50,13 +52,28 @@ struct mp_refqueue {
     int num_queue;
     // queue[pos] is the current frame, unless pos is an invalid index.
     int pos;
+
+    // Number of frames registered with hwdec_devices_reserve_frames().
+    struct mp_hwdec_devices *hwdec_devs;
+    int reserved_frames;
 };
 
 static bool mp_refqueue_has_output(struct mp_refqueue *q);
 
+// Tell the decoder how many surfaces the queue can hold at most, so that
+// preallocated surface pools can be sized for it.
+static void update_reserved_frames(struct mp_refqueue *q, int num)
+{
+    if (!q->hwdec_devs || num == q->reserved_frames)
+        return;
+    hwdec_devices_reserve_frames(q->hwdec_devs, num - q->reserved_frames);
+    q->reserved_frames = num;
+}
+
 static void refqueue_dtor(void *p)
 {
     struct mp_refqueue *q = p;
+    update_reserved_frames(q, 0);
     mp_refqueue_flush(q);
     mp_image_unrefp(&q->in_format);
     talloc_free(q->conv->f);
@@ -75,6 +92,9 @@ struct mp_refqueue *mp_refqueue_alloc(struct mp_filter *f)
     mp_pin_connect(q->conv->f->pins[0], f->ppins[0]);
     q->out = f->ppins[1];
 
+    struct mp_stream_info *info = mp_filter_find_stream_info(f);
+    q->hwdec_devs = info ? info->hwdec_devs : NULL;
+
     mp_refqueue_flush(q);
     return q;
 }
@@ -90,6 +110,10 @@ void mp_refqueue_set_refs(struct mp_refqueue *q, int past, int future)
     mp_assert(past >= 0 && future >= 0);
     q->needed_past_frames = past;
     q->needed_future_frames = MPMAX(future, 1); // at least 1 for determining PTS
+
+    // Past, current, and future frames, plus the frame buffered on format
+    // changes.
+    update_reserved_frames(q, q->needed_past_frames + q->needed_future_frames + 2);
 }
 
 // MP_MODE_* flags
@@ -286,6 +310,22 @@ struct mp_image *mp_refqueue_execute_reinit(struct mp_refqueue *q)
     return cur;
 }
 
+// Whether frames from the hw frame pools a and b can be used as references of
+// each other. Decoders may recreate their pool with only a different number of
+// surfaces (e.g. after filters reserved more), and the old surfaces remain
+// valid, so this must not cause a reinit.
+static bool hw_frames_compatible(AVBufferRef *a, AVBufferRef *b)
+{
+    if (a->data == b->data)
+        return true;
+
+    AVHWFramesContext *fa = (void *)a->data;
+    AVHWFramesContext *fb = (void *)b->data;
+    return fa->device_ref->data == fb->device_ref->data &&
+           fa->format == fb->format && fa->sw_format == fb->sw_format &&
+           fa->width == fb->width && fa->height == fb->height;
+}
+
 // Main processing function. Call this in the filter process function.
 // Returns if enough input frames are available for filtering, and output pin
 // needs data; in other words, if this returns true, you render a frame and
@@ -332,7 +372,7 @@ bool mp_refqueue_can_output(struct mp_refqueue *q)
     struct mp_image *img = frame.data;
 
     if (!q->in_format || !!q->in_format->hwctx != !!img->hwctx ||
-        (img->hwctx && img->hwctx->data != q->in_format->hwctx->data) ||
+        (img->hwctx && !hw_frames_compatible(img->hwctx, q->in_format->hwctx)) ||
         !mp_image_params_static_equal(&q->in_format->params, &img->params))
     {
         q->next = img;
@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <inttypes.h>
 #include <math.h>
 
 #include "common/common.h"
@@ -22,8 +23,11 @@
 #include "filters/filter.h"
 #include "filters/filter_internal.h"
 #include "filters/user_filters.h"
+#include "misc/thread_pool.h"
 #include "options/m_option.h"
+#include "osdep/threads.h"
 #include "video/img_format.h"
+#include "video/mp_image_pool.h"
 #include "video/sws_utils.h"
 #include "video/zimg.h"
 
@@ -66,39 +70,66 @@ struct priv {
     struct mp_image *scaled;
     struct mp_sws_context *sws;
     struct mp_zimg_context *zimg;
+    bool fallback_warning;
+
+    // Hardware frames are passed through, and their fingerprints computed on
+    // the worker from a mapped or downloaded copy.
+    struct mp_thread_pool *worker;
+    struct mp_image_pool *download_pool;    // used by the worker only
+    bool download_warning;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    // --- protected by lock
     struct print_entry entries[PRINT_ENTRY_NUM];
     int num_entries;
-    bool fallback_warning;
+    bool busy;                  // worker owns job_image and the converter
+    struct mp_image *job_image;
+    uint64_t generation;        // incremented on reset
+    uint64_t job_generation;
+    int64_t skipped;            // hardware frames skipped while busy
 };
 
-// (Other code internal to this filter also calls this to reset the frame list.)
-static void f_reset(struct mp_filter *f)
+static void clear_entries(struct priv *p)
 {
-    struct priv *p = f->priv;
-
     for (int n = 0; n < p->num_entries; n++)
         talloc_free(p->entries[n].print);
     p->num_entries = 0;
 }
 
-static void f_process(struct mp_filter *f)
+// (Other code internal to this filter also calls this to reset the frame list.)
+static void f_reset(struct mp_filter *f)
 {
     struct priv *p = f->priv;
 
-    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
-        return;
+    mp_mutex_lock(&p->lock);
+    clear_entries(p);
+    p->generation++;
+    mp_mutex_unlock(&p->lock);
+}
 
-    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+// Must be called with p->lock held. Takes over print.
+static void add_entry(struct mp_filter *f, double pts, char *print)
+{
+    struct priv *p = f->priv;
 
-    if (mp_frame_is_signaling(frame)) {
-        mp_pin_in_write(f->ppins[1], frame);
-        return;
+    if (p->num_entries >= PRINT_ENTRY_NUM) {
+        talloc_free(p->entries[0].print);
+        MP_TARRAY_REMOVE_AT(p->entries, p->num_entries, 0);
     }
 
-    if (frame.type != MP_FRAME_VIDEO)
-        goto error;
+    p->entries[p->num_entries++] = (struct print_entry){pts, print};
 
-    struct mp_image *mpi = frame.data;
+    if (p->opts->print)
+        MP_INFO(f, "%f: %s\n", pts, print);
+}
+
+// Compute the fingerprint of mpi (a software frame). Requires ownership of the
+// converter state (p->scaled and the scalers). The result is not allocated
+// with a talloc parent, because this also runs on the worker.
+static char *compute_print(struct mp_filter *f, struct mp_image *mpi)
+{
+    struct priv *p = f->priv;
 
     // Try to achieve minimum conversion, even if it makes the fingerprints less
     // "portable" across source video.
@@ -113,30 +144,119 @@ static void f_process(struct mp_filter *f)
             p->fallback_warning = true;
         }
         if (mp_sws_scale(p->sws, p->scaled, mpi) < 0)
-            goto error;
-    }
-
-    if (p->num_entries >= PRINT_ENTRY_NUM) {
-        talloc_free(p->entries[0].print);
-        MP_TARRAY_REMOVE_AT(p->entries, p->num_entries, 0);
+            return NULL;
     }
 
     int size = p->scaled->w;
 
-    struct print_entry *e = &p->entries[p->num_entries++];
-    e->pts = mpi->pts;
-    e->print = talloc_array(p, char, size * size * 2 + 1);
+    char *print = talloc_array(NULL, char, size * size * 2 + 1);
 
     for (int y = 0; y < size; y++) {
         for (int x = 0; x < size; x++) {
-            char *offs = &e->print[(y * size + x) * 2];
+            char *offs = &print[(y * size + x) * 2];
             uint8_t v = p->scaled->planes[0][y * p->scaled->stride[0] + x];
             snprintf(offs, 3, "%02x", v);
         }
     }
 
-    if (p->opts->print)
-        MP_INFO(f, "%f: %s\n", e->pts, e->print);
+    return print;
+}
+
+static void hw_job(void *ctx)
+{
+    struct mp_filter *f = ctx;
+    struct priv *p = f->priv;
+
+    mp_mutex_lock(&p->lock);
+    struct mp_image *img = p->job_image;
+    p->job_image = NULL;
+    mp_mutex_unlock(&p->lock);
+
+    // Mapping avoids copying the whole frame, if the surface allows it.
+    struct mp_image *sw = mp_image_hw_map_sw(img);
+    if (!sw)
+        sw = mp_image_hw_download(img, p->download_pool);
+    double pts = img->pts;
+    // Don't hold the decoder surface longer than needed.
+    talloc_free(img);
+
+    char *print = NULL;
+    if (sw) {
+        print = compute_print(f, sw);
+        talloc_free(sw);
+    } else if (!p->download_warning) {
+        MP_WARN(f, "Could not download hardware frames.\n");
+        p->download_warning = true;
+    }
+
+    mp_mutex_lock(&p->lock);
+    if (print && p->job_generation == p->generation) {
+        add_entry(f, pts, print);
+    } else {
+        talloc_free(print);
+    }
+    p->busy = false;
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+static void queue_hw_frame(struct mp_filter *f, struct mp_image *mpi)
+{
+    struct priv *p = f->priv;
+
+    mp_mutex_lock(&p->lock);
+    if (p->busy) {
+        // Don't stall playback; this frame gets no fingerprint.
+        p->skipped++;
+    } else {
+        p->job_image = mp_image_new_ref(mpi);
+        if (p->job_image) {
+            p->busy = true;
+            p->job_generation = p->generation;
+            mp_thread_pool_queue(p->worker, hw_job, f);
+        }
+    }
+    mp_mutex_unlock(&p->lock);
+}
+
+static void f_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+
+    if (mp_frame_is_signaling(frame)) {
+        mp_pin_in_write(f->ppins[1], frame);
+        return;
+    }
+
+    if (frame.type != MP_FRAME_VIDEO)
+        goto error;
+
+    struct mp_image *mpi = frame.data;
+
+    if (mpi->hwctx) {
+        queue_hw_frame(f, mpi);
+        mp_pin_in_write(f->ppins[1], frame);
+        return;
+    }
+
+    // Wait until the worker is done with the converter.
+    mp_mutex_lock(&p->lock);
+    while (p->busy)
+        mp_cond_wait(&p->wakeup, &p->lock);
+    mp_mutex_unlock(&p->lock);
+
+    char *print = compute_print(f, mpi);
+    if (!print)
+        goto error;
+
+    mp_mutex_lock(&p->lock);
+    add_entry(f, mpi->pts, print);
+    mp_mutex_unlock(&p->lock);
 
     mp_pin_in_write(f->ppins[1], frame);
     return;
@@ -155,6 +275,7 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
     case MP_FILTER_COMMAND_GET_META: {
         struct mp_tags *t = talloc_zero(NULL, struct mp_tags);
 
+        mp_mutex_lock(&p->lock);
         for (int n = 0; n < p->num_entries; n++) {
             struct print_entry *e = &p->entries[n];
 
@@ -166,9 +287,12 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
         }
 
         mp_tags_set_str(t, "type", m_opt_choice_str(type_names, p->opts->type));
+        if (p->skipped)
+            mp_tags_set_str(t, "skipped", mp_tprintf(80, "%"PRId64, p->skipped));
 
         if (p->opts->clear)
-            f_reset(f);
+            clear_entries(p);
+        mp_mutex_unlock(&p->lock);
 
         *(struct mp_tags **)cmd->res = t;
         return true;
@@ -178,11 +302,23 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
     }
 }
 
+static void f_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    // Waits for the job to finish.
+    TA_FREEP(&p->worker);
+    clear_entries(p);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+}
+
 static const struct mp_filter_info filter = {
     .name = "fingerprint",
     .process = f_process,
     .command = f_command,
     .reset = f_reset,
+    .destroy = f_destroy,
     .priv_size = sizeof(struct priv),
 };
 
@@ -215,6 +351,10 @@ static struct mp_filter *f_create(struct mp_filter *parent, void *options)
         .dither = ZIMG_DITHER_NONE,
         .fast = true,
     };
+    p->worker = mp_thread_pool_create(p, 0, 0, 1);
+    p->download_pool = mp_image_pool_new(p);
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
     return f;
 }
 
@@ -21,6 +21,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include <VapourSynth4.h>
 #include <VSScript4.h>
@@ -30,6 +31,7 @@
 #include <libplacebo/utils/libav.h>
 
 #include "common/msg.h"
+#include "common/tags.h"
 #include "filters/f_autoconvert.h"
 #include "filters/f_utils.h"
 #include "filters/filter_internal.h"
@@ -38,6 +40,7 @@
 #include "options/m_option.h"
 #include "options/path.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
@@ -51,6 +54,15 @@ struct vapoursynth_opts {
     const struct script_driver *drv;
 };
 
+// The loaded script, which owns the VS core. Filtered frames are returned
+// without copying them, and must not outlive the core, so they keep a
+// reference to this.
+struct vs_instance {
+    atomic_int refs;
+    const VSSCRIPTAPI *api;
+    VSScript *script;
+};
+
 struct priv {
     struct mp_log *log;
     struct vapoursynth_opts *opts;
@@ -65,6 +77,7 @@ struct priv {
     // drv_vss
     const VSSCRIPTAPI *vs_script_api;
     VSScript *vs_script;
+    struct vs_instance *instance;
 
     struct mp_filter *f;
     struct mp_pin *in_pin;
@@ -84,6 +97,7 @@ struct priv {
     double out_pts;             // pts corresponding to first requested/ready frame
     struct mp_image **requested;// frame callback results (can point to dummy_img)
                                 // requested[0] is the frame to return first
+    int64_t *request_time;      // mp_time_ns() of each requested[] request
     int max_requests;           // upper bound for requested[] array
     bool failed;                // frame callback returned with an error
     bool shutdown;              // ask node to return
@@ -91,6 +105,11 @@ struct priv {
     int64_t frames_sent;        // total nr. of frames ever added to input queue
     bool initializing;          // filters are being built
     bool in_node_active;        // node might still be called
+    // statistics (vf-metadata)
+    int num_threads;            // VS core threads (0 if unknown)
+    int64_t stats_in;           // frames passed to VS
+    int64_t stats_out;          // frames returned by VS
+    int64_t stats_latency;      // sum of request latencies of stats_out
 };
 
 // priv->requested[n] points to this if a request for frame n is in-progress
@@ -239,6 +258,45 @@ static struct mp_image map_vs_frame(struct priv *p, const VSFrame *ref,
     return img;
 }
 
+static void vs_instance_unref(struct vs_instance *instance)
+{
+    if (atomic_fetch_add(&instance->refs, -1) == 1) {
+        instance->api->freeScript(instance->script);
+        talloc_free(instance);
+    }
+}
+
+struct vs_frame_ref {
+    const VSAPI *vsapi;
+    const VSFrame *frame;
+    struct vs_instance *instance;
+};
+
+static void free_vs_frame(void *arg)
+{
+    struct vs_frame_ref *ref = arg;
+    ref->vsapi->freeFrame(ref->frame);
+    vs_instance_unref(ref->instance);
+    talloc_free(ref);
+}
+
+// Return an mp_image referencing the data of f, taking over f.
+static struct mp_image *wrap_vs_frame(struct priv *p, const VSFrame *f,
+                                      struct mp_image *img)
+{
+    struct vs_frame_ref *ref = talloc_ptrtype(NULL, ref);
+    *ref = (struct vs_frame_ref){p->vsapi, f, p->instance};
+    atomic_fetch_add(&p->instance->refs, 1);
+
+    struct mp_image *res = mp_image_new_custom_ref(img, ref, free_vs_frame);
+    if (!res) {
+        free_vs_frame(ref);
+        return NULL;
+    }
+    mp_image_copy_attributes(res, img);
+    return res;
+}
+
 static void drain_oldest_buffered_frame(struct priv *p)
 {
     if (!p->num_buffered)
@@ -282,8 +340,8 @@ static void VS_CC vs_frame_done(void *userData, const VSFrame *f, int n,
         } else {
             img.nominal_fps = 1.0 / img.pkt_duration;
         }
-        res = mp_image_new_copy(&img);
-        p->vsapi->freeFrame(f);
+        // The script can't change the frame anymore, so pass it on directly.
+        res = wrap_vs_frame(p, f, &img);
     }
 
     mp_mutex_lock(&p->lock);
@@ -294,6 +352,11 @@ static void VS_CC vs_frame_done(void *userData, const VSFrame *f, int n,
     MP_TRACE(p, "filtered frame %d (%d)\n", n, index);
     mp_assert(p->requested[index] == &dummy_img);
 
+    if (res) {
+        p->stats_out++;
+        p->stats_latency += mp_time_ns() - p->request_time[index];
+    }
+
     if (!res && !p->shutdown) {
         if (p->eof) {
             res = (struct mp_image *)&dummy_img_eof;
@@ -374,6 +437,7 @@ static void vf_vapoursynth_process(struct mp_filter *f)
             if (p->out_pts == MP_NOPTS_VALUE)
                 p->out_pts = mpi->pts;
             p->frames_sent++;
+            p->stats_in++;
             p->buffered[p->num_buffered++] = mpi;
             mp_cond_broadcast(&p->wakeup);
         } else if (frame.type != MP_FRAME_NONE) {
@@ -398,8 +462,10 @@ static void vf_vapoursynth_process(struct mp_filter *f)
 
         mp_pin_in_write(f->ppins[1], MAKE_FRAME(MP_FRAME_VIDEO, out));
 
-        for (int n = 0; n < p->max_requests - 1; n++)
+        for (int n = 0; n < p->max_requests - 1; n++) {
             p->requested[n] = p->requested[n + 1];
+            p->request_time[n] = p->request_time[n + 1];
+        }
         p->requested[p->max_requests - 1] = NULL;
         p->out_frameno++;
     }
@@ -422,6 +488,7 @@ static void vf_vapoursynth_process(struct mp_filter *f)
                 // Note: this assumes getFrameAsync() will never call
                 //       infiltGetFrame (if it does, we would deadlock)
                 p->requested[n] = (struct mp_image *)&dummy_img;
+                p->request_time[n] = mp_time_ns();
                 p->failed = false;
                 MP_TRACE(p, "requesting frame %d (%d)\n", p->out_frameno + n, n);
                 p->vsapi->getFrameAsync(p->out_frameno + n, p->out_node,
@@ -541,6 +608,22 @@ static int num_requested(struct priv *p)
     return r;
 }
 
+// Set the size of the request window, and of the input buffer, which is
+// proportional to it. Must be called with no frames buffered or requested.
+static void set_max_requests(struct priv *p, int max_requests)
+{
+    if (max_requests == p->max_requests)
+        return;
+    p->max_requests = max_requests;
+    MP_VERBOSE(p, "using %d concurrent requests.\n", p->max_requests);
+    int maxbuffer = p->opts->maxbuffer * p->max_requests;
+    p->buffered = talloc_realloc(p, p->buffered, struct mp_image *, maxbuffer);
+    talloc_free(p->requested);
+    p->requested = talloc_zero_array(p, struct mp_image *, p->max_requests);
+    p->request_time = talloc_realloc(p, p->request_time, int64_t,
+                                     p->max_requests);
+}
+
 static void destroy_vs(struct priv *p)
 {
     if (!p->out_node && !p->initializing)
@@ -681,7 +764,15 @@ static int reinit_vs(struct priv *p, struct mp_image *input)
         goto error;
     }
 
+    // Keep all threads of the core (which the script may have configured)
+    // busy with frame requests.
+    VSCoreInfo core_info;
+    p->vsapi->getCoreInfo(p->vscore, &core_info);
+
     mp_mutex_lock(&p->lock);
+    p->num_threads = core_info.numThreads;
+    if (p->opts->maxrequests < 0 && p->num_threads > 0)
+        set_max_requests(p, p->num_threads);
     p->initializing = false;
     mp_mutex_unlock(&p->lock);
     MP_DBG(p, "initialized.\n");
@@ -702,6 +793,43 @@ static void vf_vapoursynth_reset(struct mp_filter *f)
     destroy_vs(p);
 }
 
+static bool vf_vapoursynth_command(struct mp_filter *f,
+                                   struct mp_filter_command *cmd)
+{
+    struct priv *p = f->priv;
+
+    switch (cmd->type) {
+    case MP_FILTER_COMMAND_GET_META: {
+        struct mp_tags *t = talloc_zero(NULL, struct mp_tags);
+
+        mp_mutex_lock(&p->lock);
+        int ready = 0;
+        for (int n = 0; n < p->max_requests; n++) {
+            ready += p->requested[n] && p->requested[n] != &dummy_img &&
+                     p->requested[n] != &dummy_img_eof;
+        }
+        mp_tags_set_str(t, "threads", mp_tprintf(20, "%d", p->num_threads));
+        mp_tags_set_str(t, "concurrent-frames",
+                        mp_tprintf(20, "%d", p->max_requests));
+        mp_tags_set_str(t, "in-flight", mp_tprintf(20, "%d", num_requested(p)));
+        mp_tags_set_str(t, "ready", mp_tprintf(20, "%d", ready));
+        mp_tags_set_str(t, "buffered", mp_tprintf(20, "%d", p->num_buffered));
+        mp_tags_set_str(t, "frames-in", mp_tprintf(20, "%"PRId64, p->stats_in));
+        mp_tags_set_str(t, "frames-out",
+                        mp_tprintf(20, "%"PRId64, p->stats_out));
+        double latency = p->stats_out ?
+            MP_TIME_NS_TO_MS(p->stats_latency) / p->stats_out : 0;
+        mp_tags_set_str(t, "latency", mp_tprintf(20, "%f", latency));
+        mp_mutex_unlock(&p->lock);
+
+        *(struct mp_tags **)cmd->res = t;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
 static void vf_vapoursynth_destroy(struct mp_filter *f)
 {
     struct priv *p = f->priv;
@@ -719,6 +847,7 @@ static const struct mp_filter_info vf_vapoursynth_filter = {
     .name = "vapoursynth",
     .process = vf_vapoursynth_process,
     .reset = vf_vapoursynth_reset,
+    .command = vf_vapoursynth_command,
     .destroy = vf_vapoursynth_destroy,
     .priv_size = sizeof(struct priv),
 };
@@ -752,13 +881,11 @@ static struct mp_filter *vf_vapoursynth_create(struct mp_filter *parent,
     }
     p->script_path = mp_get_user_path(p, f->global, p->opts->file);
 
-    p->max_requests = p->opts->maxrequests;
-    if (p->max_requests < 0)
-        p->max_requests = av_cpu_count();
-    MP_VERBOSE(p, "using %d concurrent requests.\n", p->max_requests);
-    int maxbuffer = p->opts->maxbuffer * p->max_requests;
-    p->buffered = talloc_array(p, struct mp_image *, maxbuffer);
-    p->requested = talloc_zero_array(p, struct mp_image *, p->max_requests);
+    // With "auto", this is adjusted to the VS core once the script is loaded.
+    int max_requests = p->opts->maxrequests;
+    if (max_requests < 0)
+        max_requests = av_cpu_count();
+    set_max_requests(p, max_requests);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
@@ -824,6 +951,12 @@ static int drv_vss_load_core(struct priv *p)
     p->vs_script = p->vs_script_api->createScript(NULL);
     if (!p->vs_script)
         return -1;
+    p->instance = talloc_ptrtype(NULL, p->instance);
+    *p->instance = (struct vs_instance){
+        .refs = 1,
+        .api = p->vs_script_api,
+        .script = p->vs_script,
+    };
     p->vsapi = p->vs_script_api->getVSAPI(VAPOURSYNTH_API_VERSION);
     p->vscore = p->vs_script_api->getCore(p->vs_script);
     return 0;
@@ -843,8 +976,10 @@ static int drv_vss_load(struct priv *p, VSMap *vars)
 
 static void drv_vss_unload(struct priv *p)
 {
-    if (p->vs_script)
-        p->vs_script_api->freeScript(p->vs_script);
+    // The script is freed once the last filtered frame is released.
+    if (p->instance)
+        vs_instance_unref(p->instance);
+    p->instance = NULL;
     p->vsapi = NULL;
     p->vscore = NULL;
     p->vs_script = NULL;
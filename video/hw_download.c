@@ -0,0 +1,201 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Copy-back of hardware surfaces for --hwdec-copy-threads. Instead of letting
+// av_hwframe_transfer_data() copy the whole surface on the calling thread, the
+// surface is mapped into system memory, and the planes are copied in
+// horizontal slices by worker threads. Mapped surfaces are often
+// write-combining (USWC) memory, which is very slow to read with normal loads.
+// With SSE4.1, the copy uses streaming loads (movntdqa), which are made for
+// reading such memory.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+
+#include "common/common.h"
+#include "misc/thread_pool.h"
+#include "mpv_talloc.h"
+#include "video/fmt-conversion.h"
+#include "video/hw_download.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_STREAM_LOAD 1
+#include <smmintrin.h>
+#else
+#define HAVE_STREAM_LOAD 0
+#endif
+
+#define MAX_THREADS 16
+
+struct mp_hw_download {
+    struct mp_task_pool *pool;
+    int threads;
+    bool use_stream_load;
+    bool map_failed;        // mapping failed once, always use the fallback
+};
+
+struct copy_job {
+    uint8_t *dst;
+    const uint8_t *src;
+    ptrdiff_t dst_stride, src_stride;
+    int bytes, rows;
+    bool stream_load;
+};
+
+#if HAVE_STREAM_LOAD
+__attribute__((target("sse4.1")))
+static void copy_rows_stream_load(struct copy_job *j)
+{
+    // Make sure earlier writes by the hardware are visible to streaming loads.
+    _mm_mfence();
+
+    for (int y = 0; y < j->rows; y++) {
+        const uint8_t *src = j->src + y * j->src_stride;
+        uint8_t *dst = j->dst + y * j->dst_stride;
+        int x = 0;
+        for (; x + 64 <= j->bytes; x += 64) {
+            __m128i a = _mm_stream_load_si128((__m128i *)(src + x));
+            __m128i b = _mm_stream_load_si128((__m128i *)(src + x + 16));
+            __m128i c = _mm_stream_load_si128((__m128i *)(src + x + 32));
+            __m128i e = _mm_stream_load_si128((__m128i *)(src + x + 48));
+            _mm_store_si128((__m128i *)(dst + x), a);
+            _mm_store_si128((__m128i *)(dst + x + 16), b);
+            _mm_store_si128((__m128i *)(dst + x + 32), c);
+            _mm_store_si128((__m128i *)(dst + x + 48), e);
+        }
+        memcpy(dst + x, src + x, j->bytes - x);
+    }
+}
+#endif
+
+static void copy_rows(struct copy_job *j)
+{
+#if HAVE_STREAM_LOAD
+    if (j->stream_load) {
+        copy_rows_stream_load(j);
+        return;
+    }
+#endif
+    memcpy_pic(j->dst, j->src, j->bytes, j->rows, j->dst_stride, j->src_stride);
+}
+
+static void copy_job_fn(void *ptr, int index)
+{
+    struct copy_job *jobs = ptr;
+
+    copy_rows(&jobs[index]);
+}
+
+static bool is_aligned(const void *ptr, ptrdiff_t stride)
+{
+    return !((uintptr_t)ptr % 16) && !(stride % 16);
+}
+
+struct mp_hw_download *mp_hw_download_create(void *ta_parent, int threads)
+{
+    struct mp_hw_download *d = talloc_zero(ta_parent, struct mp_hw_download);
+    d->threads = MPCLAMP(threads, 1, MAX_THREADS);
+    if (d->threads > 1)
+        d->pool = mp_task_pool_get(d);
+#if HAVE_STREAM_LOAD
+    d->use_stream_load = av_get_cpu_flags() & AV_CPU_FLAG_SSE4;
+#endif
+    return d;
+}
+
+// Map src into system memory for reading, with the format and size
+// mp_image_hw_download() would return.
+static struct mp_image *map_image(struct mp_image *src)
+{
+    int imgfmt = mp_image_hw_download_get_sw_format(src);
+    if (!imgfmt)
+        return NULL;
+
+    struct mp_image *res = NULL;
+    AVFrame *dstav = av_frame_alloc();
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    if (!dstav || !srcav)
+        goto done;
+
+    dstav->format = imgfmt2pixfmt(imgfmt);
+    if (av_hwframe_map(dstav, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    res = mp_image_from_av_frame(dstav);
+    if (res && (res->imgfmt != imgfmt || res->w < src->w || res->h < src->h))
+        mp_image_unrefp(&res);
+    if (res)
+        mp_image_set_size(res, src->w, src->h);
+
+done:
+    av_frame_free(&srcav);
+    av_frame_free(&dstav);
+    return res;
+}
+
+struct mp_image *mp_hw_download(struct mp_hw_download *d, struct mp_image *src,
+                                struct mp_image_pool *swpool)
+{
+    struct mp_image *mapped = d->map_failed ? NULL : map_image(src);
+    if (!mapped) {
+        d->map_failed = true;
+        return mp_image_hw_download(src, swpool);
+    }
+
+    struct mp_image *dst =
+        mp_image_pool_get(swpool, mapped->imgfmt, mapped->w, mapped->h);
+    if (!dst) {
+        talloc_free(mapped);
+        return NULL;
+    }
+
+    struct copy_job jobs[MP_MAX_PLANES * MAX_THREADS];
+    int num_jobs = 0;
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int plane_h = mp_image_plane_h(dst, n);
+        int slice_h = MPMAX((plane_h + d->threads - 1) / d->threads, 1);
+        bool stream_load = d->use_stream_load &&
+            is_aligned(mapped->planes[n], mapped->stride[n]) &&
+            is_aligned(dst->planes[n], dst->stride[n]);
+        for (int y = 0; y < plane_h; y += slice_h) {
+            jobs[num_jobs++] = (struct copy_job){
+                .dst = dst->planes[n] + y * dst->stride[n],
+                .src = mapped->planes[n] + y * mapped->stride[n],
+                .dst_stride = dst->stride[n],
+                .src_stride = mapped->stride[n],
+                .bytes = line_bytes,
+                .rows = MPMIN(slice_h, plane_h - y),
+                .stream_load = stream_load,
+            };
+        }
+    }
+
+    // Plane slices have different sizes, but are all queued at once, so the
+    // workers balance them out.
+    mp_task_pool_run_all(d->pool, MP_TASK_REALTIME, num_jobs, copy_job_fn, jobs);
+
+    mp_image_copy_attributes(dst, src);
+    talloc_free(mapped);
+    return dst;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+struct mp_image;
+struct mp_image_pool;
+
+struct mp_hw_download;
+
+// Create a copy-back engine using the given number of worker threads. Free it
+// with talloc_free(). threads must be >= 1.
+struct mp_hw_download *mp_hw_download_create(void *ta_parent, int threads);
+
+// Like mp_image_hw_download(), but maps the surface and copies the planes with
+// multiple threads. Falls back to mp_image_hw_download() if the surface can't
+// be mapped.
+struct mp_image *mp_hw_download(struct mp_hw_download *d, struct mp_image *src,
+                                struct mp_image_pool *swpool);
@@ -15,6 +15,8 @@ struct mp_hwdec_devices {
     void (*load_api)(void *ctx,
                      struct hwdec_imgfmt_request *params);
     void *load_api_ctx;
+
+    int reserved_frames;
 };
 
 struct mp_hwdec_devices *hwdec_devices_create(void)
@@ -101,6 +103,22 @@ void hwdec_devices_request_for_img_fmt(struct mp_hwdec_devices *devs,
         devs->load_api(devs->load_api_ctx, params);
 }
 
+void hwdec_devices_reserve_frames(struct mp_hwdec_devices *devs, int delta)
+{
+    mp_mutex_lock(&devs->lock);
+    devs->reserved_frames += delta;
+    mp_assert(devs->reserved_frames >= 0);
+    mp_mutex_unlock(&devs->lock);
+}
+
+int hwdec_devices_get_reserved_frames(struct mp_hwdec_devices *devs)
+{
+    mp_mutex_lock(&devs->lock);
+    int res = devs->reserved_frames;
+    mp_mutex_unlock(&devs->lock);
+    return res;
+}
+
 char *hwdec_devices_get_names(struct mp_hwdec_devices *devs)
 {
     char *res = NULL;
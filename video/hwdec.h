@@ -90,6 +90,12 @@ void hwdec_devices_request_for_img_fmt(struct mp_hwdec_devices *devs,
 // Return "," concatenated list (for introspection/debugging). Use talloc_free().
 char *hwdec_devices_get_names(struct mp_hwdec_devices *devs);
 
+// Add delta to the number of hardware frames held by video filters (such as
+// deinterlacer reference frames). Decoders add this to the size of surface
+// pools that must be preallocated. Thread-safe.
+void hwdec_devices_reserve_frames(struct mp_hwdec_devices *devs, int delta);
+int hwdec_devices_get_reserved_frames(struct mp_hwdec_devices *devs);
+
 struct mp_image;
 struct mpv_global;
 
@@ -22,6 +22,7 @@
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/intreadwrite.h>
 #include <libavutil/mem.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
@@ -35,8 +36,14 @@
 #include <jpeglib.h>
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "osdep/io.h"
+#include "misc/bstr.h"
 #include "misc/path_utils.h"
+#include "misc/thread_pool.h"
 
 #include "common/av_common.h"
 #include "common/msg.h"
@@ -89,6 +96,7 @@ const struct m_option image_writer_opts[] = {
     {"jpeg-source-chroma", OPT_BOOL(jpeg_source_chroma)},
     {"png-compression", OPT_INT(png_compression), M_RANGE(0, 9)},
     {"png-filter", OPT_INT(png_filter), M_RANGE(0, 5)},
+    {"png-fast", OPT_BOOL(png_fast)},
     {"webp-lossless", OPT_BOOL(webp_lossless)},
     {"webp-quality", OPT_INT(webp_quality), M_RANGE(0, 100)},
     {"webp-compression", OPT_INT(webp_compression), M_RANGE(0, 6)},
@@ -99,6 +107,7 @@ const struct m_option image_writer_opts[] = {
     {"avif-pixfmt", OPT_STRING(avif_pixfmt)},
     {"high-bit-depth", OPT_BOOL(high_bit_depth)},
     {"tag-colorspace", OPT_BOOL(tag_csp)},
+    {"parallel", OPT_BOOL(parallel)},
     {0},
 };
 
@@ -155,6 +164,15 @@ static void prepare_avframe(AVFrame *pic, AVCodecContext *avctx,
     );
 }
 
+// With png-fast, use a cheap filter and fast compression instead of the
+// png-filter/png-compression options.
+static void get_png_params(const struct image_writer_opts *opts,
+                           int *level, int *filter)
+{
+    *level = opts->png_fast ? 1 : opts->png_compression;
+    *filter = opts->png_fast ? 2 : opts->png_filter; // 2 = "up"
+}
+
 static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
 {
     bool success = false;
@@ -213,9 +231,10 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
         avctx->flags |= AV_CODEC_FLAG_QSCALE;
         // jpeg_quality is set below
     } else if (codec->id == AV_CODEC_ID_PNG) {
-        avctx->compression_level = ctx->opts->png_compression;
-        av_opt_set_int(avctx, "pred", ctx->opts->png_filter,
-                       AV_OPT_SEARCH_CHILDREN);
+        int level, filter;
+        get_png_params(ctx->opts, &level, &filter);
+        avctx->compression_level = level;
+        av_opt_set_int(avctx, "pred", filter, AV_OPT_SEARCH_CHILDREN);
     } else if (codec->id == AV_CODEC_ID_WEBP) {
         avctx->compression_level = ctx->opts->webp_compression;
         av_opt_set_int(avctx, "lossless", ctx->opts->webp_lossless,
@@ -266,6 +285,15 @@ error_exit:
     return success;
 }
 
+// Minimum number of rows per strip when encoding in parallel; smaller images
+// are not split.
+#define MIN_STRIP_ROWS 64
+
+static int get_num_strips(struct mp_task_pool *pool, int h)
+{
+    return MPCLAMP(h / MIN_STRIP_ROWS, 1, mp_task_pool_threads(pool) + 1);
+}
+
 #if HAVE_JPEG
 
 static void write_jpeg_error_exit(j_common_ptr cinfo)
@@ -277,6 +305,27 @@ static void write_jpeg_error_exit(j_common_ptr cinfo)
     longjmp(*(jmp_buf*)cinfo->client_data, 1);
 }
 
+static void setup_jpeg(struct image_writer_ctx *ctx,
+                       struct jpeg_compress_struct *cinfo, int w, int h)
+{
+    cinfo->image_width = w;
+    cinfo->image_height = h;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+
+    cinfo->write_JFIF_header = TRUE;
+    cinfo->JFIF_major_version = 1;
+    cinfo->JFIF_minor_version = 2;
+
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, ctx->opts->jpeg_quality, 0);
+
+    if (ctx->opts->jpeg_source_chroma) {
+        cinfo->comp_info[0].h_samp_factor = 1 << ctx->original_format.chroma_xs;
+        cinfo->comp_info[0].v_samp_factor = 1 << ctx->original_format.chroma_ys;
+    }
+}
+
 static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
 {
     struct jpeg_compress_struct cinfo;
@@ -295,29 +344,73 @@ static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
     jpeg_create_compress(&cinfo);
     jpeg_stdio_dest(&cinfo, fp);
 
-    cinfo.image_width = image->w;
-    cinfo.image_height = image->h;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
+    setup_jpeg(ctx, &cinfo, image->w, image->h);
 
-    cinfo.write_JFIF_header = TRUE;
-    cinfo.JFIF_major_version = 1;
-    cinfo.JFIF_minor_version = 2;
+    jpeg_start_compress(&cinfo, TRUE);
 
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, ctx->opts->jpeg_quality, 0);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row_pointer[1];
+        row_pointer[0] = image->planes[0] +
+                         (ptrdiff_t)cinfo.next_scanline * image->stride[0];
+        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    }
 
-    if (ctx->opts->jpeg_source_chroma) {
-        cinfo.comp_info[0].h_samp_factor = 1 << ctx->original_format.chroma_xs;
-        cinfo.comp_info[0].v_samp_factor = 1 << ctx->original_format.chroma_ys;
+    jpeg_finish_compress(&cinfo);
+
+    jpeg_destroy_compress(&cinfo);
+
+    return true;
+}
+
+// Parallel JPEG encoding: each strip of MCU rows is encoded as a separate
+// JPEG with a restart interval of exactly one strip. Since a restart resets
+// the entropy coder state, the entropy-coded data of the strips can be joined
+// with RSTn markers under the headers of the first strip.
+struct jpeg_strips {
+    struct image_writer_ctx *ctx;
+    struct mp_image *image;
+    int strip_rows;
+    unsigned int restart_interval;
+    struct jpeg_strip {
+        unsigned char *data;    // malloc'ed by libjpeg
+        unsigned long size;
+        bool ok;
+    } *strips;
+};
+
+static void encode_jpeg_strip(void *p, int index)
+{
+    struct jpeg_strips *js = p;
+    struct jpeg_strip *s = &js->strips[index];
+    struct mp_image *image = js->image;
+    int y0 = index * js->strip_rows;
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = write_jpeg_error_exit;
+
+    jmp_buf error_return_jmpbuf;
+    cinfo.client_data = &error_return_jmpbuf;
+    if (setjmp(cinfo.client_data)) {
+        jpeg_destroy_compress(&cinfo);
+        return;
     }
 
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &s->data, &s->size);
+
+    setup_jpeg(js->ctx, &cinfo, image->w,
+               MPMIN(js->strip_rows, image->h - y0));
+    cinfo.restart_interval = js->restart_interval;
+
     jpeg_start_compress(&cinfo, TRUE);
 
     while (cinfo.next_scanline < cinfo.image_height) {
         JSAMPROW row_pointer[1];
         row_pointer[0] = image->planes[0] +
-                         (ptrdiff_t)cinfo.next_scanline * image->stride[0];
+                         (ptrdiff_t)(y0 + cinfo.next_scanline) * image->stride[0];
         jpeg_write_scanlines(&cinfo, row_pointer, 1);
     }
 
@@ -325,7 +418,355 @@ static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
 
     jpeg_destroy_compress(&cinfo);
 
-    return true;
+    s->ok = true;
+}
+
+// Return the offset of the entropy-coded data following the SOS header, and
+// set *sof to the offset of the SOF marker. Returns 0 on failure.
+static size_t find_jpeg_scan(const uint8_t *d, size_t size, size_t *sof)
+{
+    size_t pos = 2; // skip SOI
+    while (pos + 4 <= size && d[pos] == 0xFF) {
+        int marker = d[pos + 1];
+        size_t len = AV_RB16(d + pos + 2);
+        if (marker == 0xC0 || marker == 0xC1)
+            *sof = pos;
+        if (marker == 0xDA)
+            return *sof && pos + 2 + len < size ? pos + 2 + len : 0;
+        pos += 2 + len;
+    }
+    return 0;
+}
+
+static bool write_jpeg_parallel(struct image_writer_ctx *ctx,
+                                mp_image_t *image, FILE *fp)
+{
+    struct mp_task_pool *pool = mp_task_pool_get(NULL);
+
+    // Strips must consist of whole MCU rows, and the restart interval is
+    // limited to 65535 MCUs.
+    int mcu_w = 16, mcu_h = 16; // libjpeg default is 4:2:0
+    if (ctx->opts->jpeg_source_chroma) {
+        mcu_w = 8 << ctx->original_format.chroma_xs;
+        mcu_h = 8 << ctx->original_format.chroma_ys;
+    }
+    int mcu_cols = (image->w + mcu_w - 1) / mcu_w;
+    int mcu_rows = (image->h + mcu_h - 1) / mcu_h;
+    int max_strips = get_num_strips(pool, image->h);
+    int strip_mcu_rows = (mcu_rows + max_strips - 1) / max_strips;
+    strip_mcu_rows = MPMIN(strip_mcu_rows, 65535 / mcu_cols);
+    int num_strips = strip_mcu_rows ? (mcu_rows + strip_mcu_rows - 1) /
+                                      strip_mcu_rows : 0;
+    if (num_strips < 2) {
+        talloc_free(pool);
+        return write_jpeg(ctx, image, fp);
+    }
+
+    struct jpeg_strips js = {
+        .ctx = ctx,
+        .image = image,
+        .strip_rows = strip_mcu_rows * mcu_h,
+        .restart_interval = strip_mcu_rows * mcu_cols,
+        .strips = talloc_zero_array(NULL, struct jpeg_strip, num_strips),
+    };
+    MP_DBG(ctx, "Encoding JPEG in %d strips.\n", num_strips);
+    mp_task_pool_run_all(pool, MP_TASK_BACKGROUND, num_strips,
+                         encode_jpeg_strip, &js);
+    talloc_free(pool);
+
+    bool success = true;
+    for (int n = 0; n < num_strips; n++) {
+        struct jpeg_strip *s = &js.strips[n];
+        size_t sof = 0;
+        size_t scan = s->ok ? find_jpeg_scan(s->data, s->size, &sof) : 0;
+        if (!scan || AV_RB16(s->data + s->size - 2) != 0xFFD9) {
+            success = false;
+            break;
+        }
+        if (n == 0) {
+            // The headers of the first strip describe the whole image,
+            // except for the height.
+            AV_WB16(s->data + sof + 5, image->h);
+            success &= fwrite(s->data, scan, 1, fp) == 1;
+        } else {
+            uint8_t rst[2] = {0xFF, 0xD0 + ((n - 1) & 7)};
+            success &= fwrite(rst, sizeof(rst), 1, fp) == 1;
+        }
+        // Entropy-coded data without the EOI marker.
+        success &= fwrite(s->data + scan, s->size - 2 - scan, 1, fp) == 1;
+    }
+    uint8_t eoi[2] = {0xFF, 0xD9};
+    success = success && fwrite(eoi, sizeof(eoi), 1, fp) == 1;
+
+    for (int n = 0; n < num_strips; n++)
+        free(js.strips[n].data);
+    talloc_free(js.strips);
+    return success;
+}
+
+#endif
+
+#if HAVE_ZLIB
+
+// Parallel PNG encoding: the rows are filtered in strips, and each strip is
+// deflated separately (with the end of the previous strip as dictionary), then
+// the raw deflate streams are joined into one zlib stream. This is the same
+// approach as pigz.
+struct png_strips {
+    struct mp_image *image;
+    int filter;             // PNG filter type, 5 = pick the best per row
+    int level, strategy;
+    int bpp;                // bytes per pixel
+    size_t row_size;        // bytes per row, without the filter type byte
+    int strip_rows;
+    int num_strips;
+    uint8_t *zero_row;
+    uint8_t *filtered;      // filter type byte + filtered row, for each row
+    struct png_strip {
+        uint8_t *data;
+        size_t size;
+        uint32_t adler;
+        bool ok;
+    } *strips;
+};
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+static void filter_png_row(uint8_t *dst, const uint8_t *cur,
+                           const uint8_t *prev, size_t len, int bpp, int type)
+{
+    *dst++ = type;
+    switch (type) {
+    case 0:
+        memcpy(dst, cur, len);
+        break;
+    case 1:
+        memcpy(dst, cur, bpp);
+        for (size_t i = bpp; i < len; i++)
+            dst[i] = cur[i] - cur[i - bpp];
+        break;
+    case 2:
+        for (size_t i = 0; i < len; i++)
+            dst[i] = cur[i] - prev[i];
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp; i++)
+            dst[i] = cur[i] - (prev[i] >> 1);
+        for (size_t i = bpp; i < len; i++)
+            dst[i] = cur[i] - ((cur[i - bpp] + prev[i]) >> 1);
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp; i++)
+            dst[i] = cur[i] - prev[i];
+        for (size_t i = bpp; i < len; i++)
+            dst[i] = cur[i] - paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    }
+}
+
+// Sum of absolute values of the filtered bytes as signed values; lower usually
+// compresses better (same heuristic as libavcodec's "mixed" mode).
+static uint64_t png_row_cost(const uint8_t *row, size_t len)
+{
+    uint64_t cost = 0;
+    for (size_t i = 0; i < len; i++)
+        cost += abs((int8_t)row[i]);
+    return cost;
+}
+
+static void filter_png_strip(void *p, int index)
+{
+    struct png_strips *ps = p;
+    struct mp_image *image = ps->image;
+    size_t stride = ps->row_size + 1;
+    int y0 = index * ps->strip_rows;
+    int y1 = MPMIN(y0 + ps->strip_rows, image->h);
+    uint8_t *tmp = ps->filter == 5 ? talloc_size(NULL, stride) : NULL;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *cur = image->planes[0] + (ptrdiff_t)y * image->stride[0];
+        const uint8_t *prev = y ? cur - image->stride[0] : ps->zero_row;
+        uint8_t *dst = ps->filtered + y * stride;
+        if (ps->filter < 5) {
+            filter_png_row(dst, cur, prev, ps->row_size, ps->bpp, ps->filter);
+            continue;
+        }
+        uint64_t best = UINT64_MAX;
+        for (int type = 0; type < 5; type++) {
+            filter_png_row(tmp, cur, prev, ps->row_size, ps->bpp, type);
+            uint64_t cost = png_row_cost(tmp + 1, ps->row_size);
+            if (cost < best) {
+                best = cost;
+                memcpy(dst, tmp, stride);
+            }
+        }
+    }
+
+    talloc_free(tmp);
+}
+
+static void deflate_png_strip(void *p, int index)
+{
+    struct png_strips *ps = p;
+    struct png_strip *s = &ps->strips[index];
+    size_t stride = ps->row_size + 1;
+    int y0 = index * ps->strip_rows;
+    int y1 = MPMIN(y0 + ps->strip_rows, ps->image->h);
+    uint8_t *src = ps->filtered + y0 * stride;
+    size_t src_size = (y1 - y0) * stride;
+    bool last = index == ps->num_strips - 1;
+
+    s->adler = adler32(adler32(0, NULL, 0), src, src_size);
+
+    z_stream zs = {0};
+    if (deflateInit2(&zs, ps->level, Z_DEFLATED, -15, 8, ps->strategy) != Z_OK)
+        return;
+    if (index > 0) {
+        size_t dict = MPMIN(y0 * stride, 32768);
+        deflateSetDictionary(&zs, src - dict, dict);
+    }
+    // Sync flush adds an empty stored block after the data.
+    size_t bound = deflateBound(&zs, src_size) + 16;
+    s->data = talloc_size(ps->strips, bound);
+    zs.next_in = src;
+    zs.avail_in = src_size;
+    zs.next_out = s->data;
+    zs.avail_out = bound;
+    int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    s->size = bound - zs.avail_out;
+    s->ok = !zs.avail_in && ret == (last ? Z_STREAM_END : Z_OK);
+    deflateEnd(&zs);
+}
+
+static bool write_png_chunk(FILE *fp, const char *type, struct bstr *parts,
+                            int num_parts)
+{
+    uint8_t head[8];
+    size_t size = 0;
+    for (int n = 0; n < num_parts; n++)
+        size += parts[n].len;
+    AV_WB32(head, size);
+    memcpy(head + 4, type, 4);
+    uLong crc = crc32(crc32(0, NULL, 0), head + 4, 4);
+    bool ok = fwrite(head, sizeof(head), 1, fp) == 1;
+    for (int n = 0; n < num_parts; n++) {
+        if (!parts[n].len)
+            continue;
+        ok &= fwrite(parts[n].start, parts[n].len, 1, fp) == 1;
+        crc = crc32(crc, parts[n].start, parts[n].len);
+    }
+    uint8_t tail[4];
+    AV_WB32(tail, crc);
+    return ok && fwrite(tail, sizeof(tail), 1, fp) == 1;
+}
+
+// Write the colorspace tags libavcodec's PNG encoder would write.
+static bool write_png_csp(struct image_writer_ctx *ctx, mp_image_t *image,
+                          FILE *fp)
+{
+    struct pl_color_space csp = image->params.color;
+    if (!ctx->opts->tag_csp)
+        return true;
+    if (csp.primaries == PL_COLOR_PRIM_BT_709 &&
+        csp.transfer == PL_COLOR_TRC_SRGB)
+    {
+        uint8_t intent = 0; // perceptual
+        return write_png_chunk(fp, "sRGB", &(struct bstr){&intent, 1}, 1);
+    }
+    enum AVColorPrimaries prim = pl_primaries_to_av(csp.primaries);
+    enum AVColorTransferCharacteristic trc = pl_transfer_to_av(csp.transfer);
+    if (prim == AVCOL_PRI_UNSPECIFIED || trc == AVCOL_TRC_UNSPECIFIED)
+        return true;
+    // cICP: primaries, transfer, matrix (RGB), full range
+    uint8_t cicp[4] = {prim, trc, 0, 1};
+    return write_png_chunk(fp, "cICP", &(struct bstr){cicp, 4}, 1);
+}
+
+static bool write_png_parallel(struct image_writer_ctx *ctx,
+                               mp_image_t *image, FILE *fp)
+{
+    int depth, type, components;
+    switch (imgfmt2pixfmt(image->imgfmt)) {
+    case AV_PIX_FMT_GRAY8:    depth = 8;  type = 0; components = 1; break;
+    case AV_PIX_FMT_GRAY16BE: depth = 16; type = 0; components = 1; break;
+    case AV_PIX_FMT_RGB24:    depth = 8;  type = 2; components = 3; break;
+    case AV_PIX_FMT_RGB48BE:  depth = 16; type = 2; components = 3; break;
+    case AV_PIX_FMT_YA8:      depth = 8;  type = 4; components = 2; break;
+    case AV_PIX_FMT_YA16BE:   depth = 16; type = 4; components = 2; break;
+    case AV_PIX_FMT_RGBA:     depth = 8;  type = 6; components = 4; break;
+    case AV_PIX_FMT_RGBA64BE: depth = 16; type = 6; components = 4; break;
+    default:
+        MP_DBG(ctx, "Format %s not supported by the parallel PNG writer.\n",
+               mp_imgfmt_to_name(image->imgfmt));
+        return write_lavc(ctx, image, fp);
+    }
+
+    struct mp_task_pool *pool = mp_task_pool_get(NULL);
+    int num_strips = get_num_strips(pool, image->h);
+
+    struct png_strips ps = {
+        .image = image,
+        .strategy = ctx->opts->png_fast ? Z_RLE : Z_DEFAULT_STRATEGY,
+        .bpp = components * depth / 8,
+        .row_size = (size_t)image->w * components * depth / 8,
+        .strip_rows = (image->h + num_strips - 1) / num_strips,
+    };
+    get_png_params(ctx->opts, &ps.level, &ps.filter);
+    ps.num_strips = (image->h + ps.strip_rows - 1) / ps.strip_rows;
+    void *tmp = talloc_new(NULL);
+    ps.zero_row = talloc_zero_size(tmp, ps.row_size);
+    ps.filtered = talloc_size(tmp, (ps.row_size + 1) * image->h);
+    ps.strips = talloc_zero_array(tmp, struct png_strip, ps.num_strips);
+
+    MP_DBG(ctx, "Encoding PNG in %d strips.\n", ps.num_strips);
+    // Filtering must finish first, because each strip's deflate dictionary
+    // is the filtered data of the previous strip.
+    mp_task_pool_run_all(pool, MP_TASK_BACKGROUND, ps.num_strips,
+                         filter_png_strip, &ps);
+    mp_task_pool_run_all(pool, MP_TASK_BACKGROUND, ps.num_strips,
+                         deflate_png_strip, &ps);
+    talloc_free(pool);
+
+    static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t ihdr[13] = {0};
+    AV_WB32(ihdr + 0, image->w);
+    AV_WB32(ihdr + 4, image->h);
+    ihdr[8] = depth;
+    ihdr[9] = type;
+
+    bool success = fwrite(sig, sizeof(sig), 1, fp) == 1 &&
+        write_png_chunk(fp, "IHDR", &(struct bstr){ihdr, sizeof(ihdr)}, 1) &&
+        write_png_csp(ctx, image, fp);
+
+    uint8_t zhead[2] = {0x78, 0x9C}; // zlib header: deflate, 32K window
+    uint8_t ztail[4];
+    uLong adler = ps.strips[0].adler;
+    for (int n = 1; n < ps.num_strips; n++) {
+        size_t size = MPMIN(ps.strip_rows, image->h - n * ps.strip_rows) *
+                      (ps.row_size + 1);
+        adler = adler32_combine(adler, ps.strips[n].adler, size);
+    }
+    AV_WB32(ztail, adler);
+
+    for (int n = 0; n < ps.num_strips && success; n++) {
+        struct png_strip *s = &ps.strips[n];
+        success = s->ok && write_png_chunk(fp, "IDAT", (struct bstr[]){
+            {zhead, n == 0 ? 2 : 0},
+            {s->data, s->size},
+            {ztail, n == ps.num_strips - 1 ? 4 : 0},
+        }, 3);
+    }
+    success = success && write_png_chunk(fp, "IEND", NULL, 0);
+
+    talloc_free(tmp);
+    return success;
 }
 
 #endif
@@ -657,6 +1098,7 @@ static struct mp_image *convert_image(struct mp_image *image, int destfmt,
     dst->params = p;
 
     struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->background = true;
     sws->log = log;
     if (global)
         mp_sws_enable_cmdline_opts(sws, global);
@@ -691,9 +1133,13 @@ bool write_image(struct mp_image *image, const struct image_writer_opts *opts,
 
 #if HAVE_JPEG
     if (opts->format == AV_CODEC_ID_MJPEG) {
-        write = write_jpeg;
+        write = opts->parallel ? write_jpeg_parallel : write_jpeg;
         destfmt = IMGFMT_RGB24;
     }
+#endif
+#if HAVE_ZLIB
+    if (opts->format == AV_CODEC_ID_PNG && opts->parallel)
+        write = write_png_parallel;
 #endif
     if (opts->format == AV_CODEC_ID_AV1) {
         write = write_avif;
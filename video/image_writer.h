@@ -25,6 +25,7 @@ struct image_writer_opts {
     bool high_bit_depth;
     int png_compression;
     int png_filter;
+    bool png_fast;
     int jpeg_quality;
     bool jpeg_source_chroma;
     bool webp_lossless;
@@ -36,6 +37,7 @@ struct image_writer_opts {
     char *avif_pixfmt;
     char **avif_opts;
     bool tag_csp;
+    bool parallel;
 };
 
 extern const struct image_writer_opts image_writer_opts_defaults;
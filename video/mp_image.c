@@ -878,6 +878,23 @@ bool mp_image_params_equal(const struct mp_image_params *p1,
            mp_rect_equals(&p1->crop, &p2->crop);
 }
 
+// Return whether converting p1 to p2 would change only metadata, and not the
+// pixel data. This considers what libswscale and zimg convert: it ignores HDR
+// metadata, aspect ratio, rotation, stereo mode etc.
+bool mp_image_params_pixels_equal(const struct mp_image_params *p1,
+                                  const struct mp_image_params *p2)
+{
+    return p1->imgfmt == p2->imgfmt &&
+           p1->hw_subfmt == p2->hw_subfmt &&
+           p1->w == p2->w && p1->h == p2->h &&
+           p1->repr.sys == p2->repr.sys &&
+           p1->repr.levels == p2->repr.levels &&
+           p1->repr.alpha == p2->repr.alpha &&
+           p1->color.primaries == p2->color.primaries &&
+           p1->color.transfer == p2->color.transfer &&
+           p1->chroma_location == p2->chroma_location;
+}
+
 bool mp_image_params_static_equal(const struct mp_image_params *p1,
                                   const struct mp_image_params *p2)
 {
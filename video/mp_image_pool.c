@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stddef.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -26,6 +27,7 @@
 #if HAVE_D3D11
 #include <libavutil/hwcontext_d3d11va.h>
 #endif
+#include <libavutil/hwcontext_drm.h>
 #if HAVE_VULKAN
 #include <libavutil/hwcontext_vulkan.h>
 #endif
@@ -35,46 +37,106 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "misc/linked_list.h"
 
 #include "fmt-conversion.h"
 #include "mp_image_pool.h"
 #include "mp_image.h"
 #include "osdep/threads.h"
 
-static mp_static_mutex pool_mutex = MP_STATIC_MUTEX_INITIALIZER;
-#define pool_lock() mp_mutex_lock(&pool_mutex)
-#define pool_unlock() mp_mutex_unlock(&pool_mutex)
-
 // Thread-safety: the pool itself is not thread-safe, but pool-allocated images
 // can be referenced and unreferenced from other threads. (As long as the image
 // destructors are thread-safe.)
 
+// State shared between a pool and its images. Since images can be unreferenced
+// after the pool was destroyed, this is refcounted, and lives until both the
+// pool and all of its images are gone.
+struct pool_shared {
+    mp_mutex lock;
+    int refs;                   // pool + number of not yet freed images
+
+    // Free (unreferenced) images, most recently released first. Protected by
+    // lock, because images are released from other threads.
+    struct {
+        struct image_flags *head, *tail;
+    } free_list;
+};
+
+// Memory statistics of all pools (mp_image_pool_get_usage()).
+static atomic_int_least64_t usage_images, usage_bytes;
+static atomic_int_least64_t usage_free_images, usage_free_bytes;
+
+// Incremented by mp_image_pool_trim_all().
+static atomic_uint trim_generation;
+
+static void update_usage(int64_t images, int64_t free_images, int64_t size)
+{
+    atomic_fetch_add_explicit(&usage_images, images, memory_order_relaxed);
+    atomic_fetch_add_explicit(&usage_bytes, images * size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&usage_free_images, free_images,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&usage_free_bytes, free_images * size,
+                              memory_order_relaxed);
+}
+
+void mp_image_pool_get_usage(struct mp_image_pool_usage *out)
+{
+    *out = (struct mp_image_pool_usage){
+        .images = atomic_load(&usage_images),
+        .bytes = atomic_load(&usage_bytes),
+        .free_images = atomic_load(&usage_free_images),
+        .free_bytes = atomic_load(&usage_free_bytes),
+    };
+}
+
 struct mp_image_pool {
     struct mp_image **images;
     int num_images;
 
+    struct pool_shared *shared;
+
     int fmt, w, h;
 
     mp_image_allocator allocator;
     void *allocator_ctx;
 
     bool use_lru;
-    unsigned int lru_counter;
+
+    unsigned trim_generation;   // last seen value of trim_generation
 };
 
 // Used to gracefully handle the case when the pool is freed while image
 // references allocated from the image pool are still held by someone.
+// All fields are protected by pool_shared.lock.
 struct image_flags {
+    struct pool_shared *shared;
+    struct mp_image *img;
+    int64_t size;               // allocated bytes, for memory statistics
     // If both of these are false, the image must be freed.
     bool referenced;            // outside mp_image reference exists
     bool pool_alive;            // the mp_image_pool references this
-    unsigned int order;         // for LRU allocation (basically a timestamp)
+    // Links in pool_shared.free_list (if !referenced && pool_alive).
+    struct {
+        struct image_flags *prev, *next;
+    } free_list;
 };
 
+static void shared_unref(struct pool_shared *s)
+{
+    mp_mutex_lock(&s->lock);
+    bool last = --s->refs == 0;
+    mp_mutex_unlock(&s->lock);
+    if (last) {
+        mp_mutex_destroy(&s->lock);
+        talloc_free(s);
+    }
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
     mp_image_pool_clear(pool);
+    shared_unref(pool->shared);
 }
 
 // If tparent!=NULL, set it as talloc parent for the pool.
@@ -83,22 +145,68 @@ struct mp_image_pool *mp_image_pool_new(void *tparent)
     struct mp_image_pool *pool = talloc_ptrtype(tparent, pool);
     talloc_set_destructor(pool, image_pool_destructor);
     *pool = (struct mp_image_pool) {0};
+    pool->shared = talloc_zero(NULL, struct pool_shared);
+    mp_mutex_init(&pool->shared->lock);
+    pool->shared->refs = 1;
+    pool->trim_generation = atomic_load(&trim_generation);
     return pool;
 }
 
+void mp_image_pool_trim_all(void)
+{
+    atomic_fetch_add(&trim_generation, 1);
+}
+
+// Free the unreferenced images if mp_image_pool_trim_all() was called since
+// the last time.
+static void trim_pool(struct mp_image_pool *pool)
+{
+    unsigned generation = atomic_load_explicit(&trim_generation,
+                                               memory_order_relaxed);
+    if (pool->trim_generation == generation)
+        return;
+    pool->trim_generation = generation;
+
+    struct pool_shared *s = pool->shared;
+    for (int n = pool->num_images - 1; n >= 0; n--) {
+        struct mp_image *img = pool->images[n];
+        struct image_flags *it = img->priv;
+        bool referenced;
+        mp_mutex_lock(&s->lock);
+        referenced = it->referenced;
+        if (!referenced) {
+            it->pool_alive = false;
+            LL_REMOVE(free_list, &s->free_list, it);
+        }
+        mp_mutex_unlock(&s->lock);
+        if (!referenced) {
+            update_usage(-1, -1, it->size);
+            talloc_free(img);
+            shared_unref(s);
+            MP_TARRAY_REMOVE_AT(pool->images, pool->num_images, n);
+        }
+    }
+}
+
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
+    struct pool_shared *s = pool->shared;
     for (int n = 0; n < pool->num_images; n++) {
         struct mp_image *img = pool->images[n];
         struct image_flags *it = img->priv;
         bool referenced;
-        pool_lock();
+        mp_mutex_lock(&s->lock);
         mp_assert(it->pool_alive);
         it->pool_alive = false;
         referenced = it->referenced;
-        pool_unlock();
         if (!referenced)
+            LL_REMOVE(free_list, &s->free_list, it);
+        mp_mutex_unlock(&s->lock);
+        if (!referenced) {
+            update_usage(-1, -1, it->size);
             talloc_free(img);
+            shared_unref(s);
+        }
     }
     pool->num_images = 0;
 }
@@ -109,14 +217,20 @@ static void unref_image(void *opaque, uint8_t *data)
 {
     struct mp_image *img = opaque;
     struct image_flags *it = img->priv;
+    struct pool_shared *s = it->shared;
     bool alive;
-    pool_lock();
+    mp_mutex_lock(&s->lock);
     mp_assert(it->referenced);
     it->referenced = false;
     alive = it->pool_alive;
-    pool_unlock();
-    if (!alive)
+    if (alive)
+        LL_PREPEND(free_list, &s->free_list, it);
+    mp_mutex_unlock(&s->lock);
+    update_usage(alive ? 0 : -1, alive ? 1 : 0, it->size);
+    if (!alive) {
         talloc_free(img);
+        shared_unref(s);
+    }
 }
 
 // Return a new image of given format/size. Unlike mp_image_pool_get(), this
@@ -124,28 +238,27 @@ static void unref_image(void *opaque, uint8_t *data)
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
-    struct mp_image *new = NULL;
-    pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *img_it = img->priv;
-        mp_assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
-                    new = img;
-                    break;
-                }
-            }
-        }
+    trim_pool(pool);
+    struct pool_shared *s = pool->shared;
+    mp_mutex_lock(&s->lock);
+    // Normally reuse the most recently released image, which is probably
+    // still in the CPU caches. In LRU mode, take the one released longest ago.
+    // Usually all free images match, so this takes the first one.
+    struct image_flags *it =
+        pool->use_lru ? s->free_list.tail : s->free_list.head;
+    while (it && !(it->img->imgfmt == fmt && it->img->w == w && it->img->h == h))
+        it = pool->use_lru ? it->free_list.prev : it->free_list.next;
+    if (it) {
+        mp_assert(!it->referenced && it->pool_alive);
+        LL_REMOVE(free_list, &s->free_list, it);
+        it->referenced = true;
     }
-    pool_unlock();
-    if (!new)
+    mp_mutex_unlock(&s->lock);
+    if (!it)
         return NULL;
+    update_usage(0, -1, it->size);
+
+    struct mp_image *new = it->img;
 
     // Reference the new image. Since mp_image_pool is not declared thread-safe,
     // and unreffing images from other threads does not allocate new images,
@@ -163,22 +276,35 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                     unref_image, new, flags);
     if (!ref->bufs[0]) {
         talloc_free(ref);
+        mp_mutex_lock(&s->lock);
+        it->referenced = false;
+        LL_PREPEND(free_list, &s->free_list, it);
+        mp_mutex_unlock(&s->lock);
+        update_usage(0, 1, it->size);
         return NULL;
     }
 
-    struct image_flags *it = new->priv;
-    mp_assert(!it->referenced && it->pool_alive);
-    it->referenced = true;
-    it->order = ++pool->lru_counter;
     return ref;
 }
 
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 {
+    struct pool_shared *s = pool->shared;
     struct image_flags *it = talloc_ptrtype(new, it);
-    *it = (struct image_flags) { .pool_alive = true };
+    *it = (struct image_flags) {
+        .shared = s,
+        .img = new,
+        .pool_alive = true,
+    };
+    for (int p = 0; p < MP_MAX_PLANES; p++)
+        it->size += new->bufs[p] ? new->bufs[p]->size : 0;
+    update_usage(1, 1, it->size);
     new->priv = it;
     MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+    mp_mutex_lock(&s->lock);
+    s->refs++;
+    LL_PREPEND(free_list, &s->free_list, it);
+    mp_mutex_unlock(&s->lock);
 }
 
 // Return a new image of given format/size. The only difference to
@@ -327,6 +453,60 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     return dst;
 }
 
+// Whether all planes of a DRM-PRIME frame use the linear layout, i.e. can be
+// read by the CPU after mmap().
+static bool drm_frame_is_linear(AVFrame *frame)
+{
+    const uint64_t mod_linear = 0; // DRM_FORMAT_MOD_LINEAR
+    AVDRMFrameDescriptor *desc = (void *)frame->data[0];
+    if (!desc || desc->nb_objects < 1)
+        return false;
+    for (int n = 0; n < desc->nb_objects; n++) {
+        if (desc->objects[n].format_modifier != mod_linear)
+            return false;
+    }
+    return true;
+}
+
+// Maps the HW surface src into system memory for reading, instead of copying
+// it like mp_image_hw_download(). This is supported for DRM-PRIME (dmabuf)
+// surfaces with a linear layout only. The returned image keeps a reference to
+// src and must not be written to. It has the format mp_image_hw_download()
+// would return.
+// Returns NULL on failure.
+struct mp_image *mp_image_hw_map_sw(struct mp_image *src)
+{
+    if (!src->hwctx || src->imgfmt != IMGFMT_DRMPRIME)
+        return NULL;
+
+    int imgfmt = mp_image_hw_download_get_sw_format(src);
+    if (!imgfmt)
+        return NULL;
+
+    struct mp_image *dst = NULL;
+    AVFrame *dstav = av_frame_alloc();
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    if (!dstav || !srcav || !drm_frame_is_linear(srcav))
+        goto done;
+
+    dstav->format = imgfmt2pixfmt(imgfmt);
+    if (av_hwframe_map(dstav, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    dst = mp_image_from_av_frame(dstav);
+    if (dst && dst->imgfmt != imgfmt)
+        mp_image_unrefp(&dst);
+    if (dst) {
+        mp_image_set_size(dst, src->w, src->h);
+        mp_image_copy_attributes(dst, src);
+    }
+
+done:
+    av_frame_free(&srcav);
+    av_frame_free(&dstav);
+    return dst;
+}
+
 bool mp_image_hw_upload(struct mp_image *hw_img, struct mp_image *src)
 {
     if (hw_img->w != src->w || hw_img->h != src->h)
@@ -14,6 +14,17 @@ void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
 
+// Totals over all image pools in the process.
+struct mp_image_pool_usage {
+    int64_t images, bytes;              // allocated by pools
+    int64_t free_images, free_bytes;    // of these, not referenced
+};
+void mp_image_pool_get_usage(struct mp_image_pool_usage *out);
+
+// Make all pools in the process free their unreferenced images. Since pools
+// are not thread-safe, each pool does this the next time it's used.
+void mp_image_pool_trim_all(void);
+
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
 
@@ -31,6 +42,8 @@ struct mp_image *mp_image_hw_download(struct mp_image *img,
 
 int mp_image_hw_download_get_sw_format(struct mp_image *img);
 
+struct mp_image *mp_image_hw_map_sw(struct mp_image *src);
+
 bool mp_image_hw_upload(struct mp_image *hw_img, struct mp_image *src);
 
 struct AVBufferRef;
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "mpv_talloc.h"
 #include "bitmap_packer.h"
@@ -124,11 +125,9 @@ static int pack_rectangles(struct pos *in, struct pos *out, int num_rects,
     return num_rects ? -1 : y;
 }
 
-int packer_pack(struct bitmap_packer *packer)
+// Add padding to the input sizes, and make sure the largest rectangle fits.
+static void prepare_input(struct bitmap_packer *packer)
 {
-    if (packer->count == 0)
-        return 0;
-    int w_orig = packer->w, h_orig = packer->h;
     struct pos *in = packer->in;
     int xmax = 0, ymax = 0;
     for (int i = 0; i < packer->count; i++) {
@@ -149,9 +148,13 @@ int packer_pack(struct bitmap_packer *packer)
         packer->w = 1 << (mp_log2(xmax - 1) + 1);
     if (ymax > packer->h)
         packer->h = 1 << (mp_log2(ymax - 1) + 1);
+}
+
+static int pack_full(struct bitmap_packer *packer, int w_orig, int h_orig)
+{
     while (1) {
         int used_width = 0;
-        int y = pack_rectangles(in, packer->result, packer->count,
+        int y = pack_rectangles(packer->in, packer->result, packer->count,
                                 packer->w, packer->h,
                                 packer->scratch, &used_width);
         if (y >= 0) {
@@ -181,6 +184,170 @@ int packer_pack(struct bitmap_packer *packer)
     }
 }
 
+int packer_pack(struct bitmap_packer *packer)
+{
+    packer->num_layout = 0;
+    if (packer->count == 0)
+        return 0;
+    int w_orig = packer->w, h_orig = packer->h;
+    prepare_input(packer);
+    return pack_full(packer, w_orig, h_orig);
+}
+
+struct packer_layout {
+    uint64_t key;
+    struct pos size;    // including padding
+    struct pos pos;     // of the padded rectangle
+};
+
+static int cmp_layout(const void *pa, const void *pb)
+{
+    const struct packer_layout *a = pa, *b = pb;
+    return a->key == b->key ? 0 : (a->key < b->key ? -1 : +1);
+}
+
+static void save_layout(struct bitmap_packer *packer, const uint64_t *keys)
+{
+    MP_TARRAY_GROW(packer, packer->layout, packer->count);
+    for (int i = 0; i < packer->count; i++) {
+        packer->layout[i] = (struct packer_layout){
+            .key = keys[i],
+            .size = packer->in[i],
+            .pos = {packer->result[i].x - packer->padding,
+                    packer->result[i].y - packer->padding},
+        };
+    }
+    packer->num_layout = packer->count;
+    qsort(packer->layout, packer->num_layout, sizeof(packer->layout[0]),
+          cmp_layout);
+}
+
+static struct packer_layout *find_layout(struct bitmap_packer *packer,
+                                         uint64_t key, struct pos size)
+{
+    int lo = 0, hi = packer->num_layout;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (packer->layout[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (int n = lo; n < packer->num_layout && packer->layout[n].key == key; n++) {
+        struct packer_layout *l = &packer->layout[n];
+        if (l->size.x == size.x && l->size.y == size.y && l->pos.x >= 0)
+            return l;
+    }
+    return NULL;
+}
+
+static int cmp_height(const void *pa, const void *pb)
+{
+    const struct pos *a = pa, *b = pb;
+    return b->y - a->y;
+}
+
+// Keep rectangles found in the previous layout in place, and put the others
+// on top of the kept rectangles in bottom-left order (skyline). Space freed
+// by removed rectangles is not reused, so eventually this fails and a full
+// repack is done. Doesn't change the packer size.
+static bool pack_stable(struct bitmap_packer *packer, const uint64_t *keys)
+{
+    struct pos *in = packer->in;
+    struct pos *out = packer->result;
+    int w = packer->w, h = packer->h;
+    bool ok = false;
+
+    int *sky = talloc_zero_array(NULL, int, w);
+    int *window = talloc_array(sky, int, w);
+    // (height, index) of the rectangles that need to be placed.
+    struct pos *todo = talloc_array(sky, struct pos, packer->count);
+    int num_todo = 0;
+
+    for (int i = 0; i < packer->count; i++) {
+        if (!in[i].x) {
+            out[i] = (struct pos){0, 0};
+            continue;
+        }
+        struct packer_layout *l = find_layout(packer, keys[i], in[i]);
+        if (!l) {
+            todo[num_todo++] = (struct pos){i, in[i].y};
+            continue;
+        }
+        out[i] = l->pos;
+        l->pos.x = -1; // claimed
+        for (int x = out[i].x; x < out[i].x + in[i].x; x++)
+            sky[x] = MPMAX(sky[x], out[i].y + in[i].y);
+    }
+
+    qsort(todo, num_todo, sizeof(todo[0]), cmp_height);
+
+    for (int n = 0; n < num_todo; n++) {
+        int i = todo[n].x;
+        int rw = in[i].x, rh = in[i].y;
+        // Find the x with the lowest maximum skyline height over [x, x + rw),
+        // using a sliding window maximum (window holds x indexes with
+        // decreasing sky values).
+        int head = 0, tail = 0;
+        int best_x = -1, best_y = INT_MAX;
+        for (int x = 0; x < w; x++) {
+            while (tail > head && sky[window[tail - 1]] <= sky[x])
+                tail--;
+            window[tail++] = x;
+            if (window[head] <= x - rw)
+                head++;
+            int start = x - rw + 1;
+            if (start >= 0 && sky[window[head]] < best_y) {
+                best_y = sky[window[head]];
+                best_x = start;
+            }
+        }
+        if (best_x < 0 || best_y + rh > h)
+            goto done;
+        out[i] = (struct pos){best_x, best_y};
+        for (int x = best_x; x < best_x + rw; x++)
+            sky[x] = best_y + rh;
+    }
+
+    // Keep the bounding box from growing and shrinking as rectangles come and
+    // go, so that consumers can compare it with what they uploaded last time.
+    for (int i = 0; i < packer->count; i++) {
+        if (!in[i].x)
+            continue;
+        packer->used_width = MPMAX(packer->used_width, out[i].x + in[i].x);
+        packer->used_height = MPMAX(packer->used_height, out[i].y + in[i].y);
+        out[i].x += packer->padding;
+        out[i].y += packer->padding;
+    }
+    ok = true;
+
+done:
+    talloc_free(sky);
+    return ok;
+}
+
+int packer_pack_stable(struct bitmap_packer *packer, const uint64_t *keys)
+{
+    if (packer->count == 0) {
+        packer->num_layout = 0;
+        return 0;
+    }
+    int w_orig = packer->w, h_orig = packer->h;
+    prepare_input(packer);
+    if (packer->num_layout && packer->w == w_orig && packer->h == h_orig &&
+        pack_stable(packer, keys))
+    {
+        save_layout(packer, keys);
+        return 0;
+    }
+    int r = pack_full(packer, w_orig, h_orig);
+    packer->num_layout = 0;
+    if (r >= 0)
+        save_layout(packer, keys);
+    return r;
+}
+
 void packer_set_size(struct bitmap_packer *packer, int size)
 {
     packer->count = size;
@@ -1,6 +1,8 @@
 #ifndef MPLAYER_PACK_RECTANGLES_H
 #define MPLAYER_PACK_RECTANGLES_H
 
+#include <stdint.h>
+
 struct pos {
     int x;
     int y;
@@ -21,6 +23,8 @@ struct bitmap_packer {
     // internal
     int *scratch;
     int asize;
+    struct packer_layout *layout; // for packer_pack_stable()
+    int num_layout;
 };
 
 struct sub_bitmaps;
@@ -48,4 +52,14 @@ void packer_set_size(struct bitmap_packer *packer, int size);
  */
 int packer_pack(struct bitmap_packer *packer);
 
+/* Like packer_pack(), but try to keep the positions from the previous call, so
+ * that only the parts of the packed image that changed need to be updated.
+ * keys[i] identifies rectangle i, e.g. by its screen position and size. A
+ * rectangle with the same key and size as one from the previous call keeps
+ * its position, and new rectangles are put into the remaining space. If they
+ * don't fit, everything is repacked like with packer_pack().
+ * The bounding box only grows while positions are kept.
+ */
+int packer_pack_stable(struct bitmap_packer *packer, const uint64_t *keys);
+
 #endif
@@ -157,6 +157,7 @@ struct mp_image *dr_helper_get_image(struct dr_helper *dr, int imgfmt,
         .stride_align = stride_align,
         .flags = flags,
     };
-    mp_dispatch_run(dr->dispatch, sync_get_image, &cmd);
+    // The decoder is blocked on this; don't queue it behind VO controls.
+    mp_dispatch_run_urgent(dr->dispatch, sync_get_image, &cmd);
     return cmd.res;
 }
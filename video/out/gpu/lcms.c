@@ -171,6 +171,13 @@ bool gl_lcms_has_changed(struct gl_lcms *p, enum pl_color_primaries prim,
     return !vid_profile_eq(p->vid_profile, vid_profile);
 }
 
+// Return whether the profile or config has changed, which invalidates all LUTs
+// previously returned by gl_lcms_get_lut3d() (for any prim/trc).
+bool gl_lcms_profile_changed(struct gl_lcms *p)
+{
+    return p->changed;
+}
+
 // Whether a profile is set. (gl_lcms_get_lut3d() is expected to return a lut,
 // but it could still fail due to runtime errors, such as invalid icc data.)
 bool gl_lcms_has_profile(struct gl_lcms *p)
@@ -485,6 +492,11 @@ bool gl_lcms_has_changed(struct gl_lcms *p, enum pl_color_primaries prim,
     return false;
 }
 
+bool gl_lcms_profile_changed(struct gl_lcms *p)
+{
+    return false;
+}
+
 bool gl_lcms_has_profile(struct gl_lcms *p)
 {
     return false;
@@ -41,6 +41,7 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **,
                        struct AVBufferRef *vid_profile);
 bool gl_lcms_has_changed(struct gl_lcms *p, enum pl_color_primaries prim,
                          enum pl_color_transfer trc, struct AVBufferRef *vid_profile);
+bool gl_lcms_profile_changed(struct gl_lcms *p);
 
 static inline bool gl_parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
 {
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -52,6 +53,7 @@ struct mpgl_osd_part {
     int change_id;
     struct ra_tex *texture;
     int w, h;
+    struct mp_image *shadow; // copy of the last data uploaded to texture
     int num_subparts;
     int prev_num_subparts;
     struct sub_bitmap *subparts;
@@ -105,6 +107,7 @@ void mpgl_osd_destroy(struct mpgl_osd *ctx)
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct mpgl_osd_part *p = ctx->parts[n];
         ra_tex_free(ctx->ra, &p->texture);
+        talloc_free(p->shadow);
     }
     talloc_free(ctx);
 }
@@ -118,6 +121,60 @@ static int next_pow2(int v)
     return INT_MAX;
 }
 
+// Number of rows compared and uploaded as a unit by upload_changed_rows().
+#define OSD_BAND_H 16
+
+static bool rows_equal(struct mp_image *a, struct mp_image *b, int y, int h,
+                       size_t row_bytes)
+{
+    for (int r = y; r < y + h; r++) {
+        if (memcmp(a->planes[0] + r * a->stride[0],
+                   b->planes[0] + r * b->stride[0], row_bytes))
+            return false;
+    }
+    return true;
+}
+
+// Upload only the bands of rows that differ from what was uploaded last time.
+// Subtitles that change every frame often keep most of the bitmaps (e.g.
+// karaoke, where libass only changes the color), so this skips most of the
+// upload. Requires osd->shadow to have the same size as the packed image.
+static bool upload_changed_rows(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                                struct sub_bitmaps *imgs, size_t row_bytes)
+{
+    struct ra *ra = ctx->ra;
+    struct mp_image *src = imgs->packed;
+    int h = imgs->packed_h;
+    int start = -1;
+
+    for (int y = 0; ; y += OSD_BAND_H) {
+        bool end = y >= h;
+        bool changed = !end &&
+            !rows_equal(src, osd->shadow, y, MPMIN(OSD_BAND_H, h - y), row_bytes);
+        if (changed && start < 0)
+            start = y;
+        if (!changed && start >= 0) {
+            int y1 = MPMIN(y, h);
+            struct ra_tex_upload_params params = {
+                .tex = osd->texture,
+                .src = src->planes[0] + start * src->stride[0],
+                .rc = &(struct mp_rect){0, start, imgs->packed_w, y1},
+                .stride = src->stride[0],
+            };
+            if (!ra->fns->tex_upload(ra, &params))
+                return false;
+            memcpy_pic(osd->shadow->planes[0] + start * osd->shadow->stride[0],
+                       params.src, row_bytes, y1 - start,
+                       osd->shadow->stride[0], src->stride[0]);
+            start = -1;
+        }
+        if (end)
+            break;
+    }
+
+    return true;
+}
+
 static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
                        struct sub_bitmaps *imgs)
 {
@@ -136,6 +193,7 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         osd->format != imgs->format)
     {
         ra_tex_free(ra, &osd->texture);
+        TA_FREEP(&osd->shadow);
 
         osd->format = imgs->format;
         osd->w = MPMAX(32, req_w);
@@ -165,16 +223,39 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
             goto done;
     }
 
+    struct mp_image *packed = imgs->packed;
+    size_t row_bytes = (size_t)imgs->packed_w * packed->fmt.bpp[0] / 8;
+
+    if (osd->shadow && osd->shadow->imgfmt == packed->imgfmt &&
+        osd->shadow->w == imgs->packed_w && osd->shadow->h == imgs->packed_h)
+    {
+        ok = upload_changed_rows(ctx, osd, imgs, row_bytes);
+        if (!ok)
+            TA_FREEP(&osd->shadow);
+        goto done;
+    }
+
     struct ra_tex_upload_params params = {
         .tex = osd->texture,
-        .src = imgs->packed->planes[0],
+        .src = packed->planes[0],
         .invalidate = true,
         .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
-        .stride = imgs->packed->stride[0],
+        .stride = packed->stride[0],
     };
 
     ok = ra->fns->tex_upload(ra, &params);
 
+    talloc_free(osd->shadow);
+    osd->shadow = NULL;
+    if (ok) {
+        osd->shadow = mp_image_alloc(packed->imgfmt, imgs->packed_w,
+                                     imgs->packed_h);
+        if (osd->shadow) {
+            memcpy_pic(osd->shadow->planes[0], packed->planes[0], row_bytes,
+                       imgs->packed_h, osd->shadow->stride[0], packed->stride[0]);
+        }
+    }
+
 done:
     return ok;
 }
@@ -361,3 +442,17 @@ bool mpgl_osd_check_change(struct mpgl_osd *ctx, struct mp_osd_res *res,
     mpgl_osd_generate(ctx, *res, pts, 0, 0);
     return ctx->change_flag;
 }
+
+// Return a value that changes whenever the OSD parts selected by draw_flags
+// change. Unlike mpgl_osd_generate(), this does not touch the textures.
+int64_t mpgl_osd_get_change_id(struct mpgl_osd *ctx, struct mp_osd_res res,
+                               double pts, int stereo_mode, int draw_flags)
+{
+    set_res(ctx, res, stereo_mode);
+
+    struct sub_bitmap_list *list =
+        osd_render(ctx->osd, ctx->osd_res, pts, draw_flags, ctx->formats);
+    int64_t change_id = list->change_id;
+    talloc_free(list);
+    return change_id;
+}
@@ -58,6 +58,7 @@ struct sc_entry {
     struct ra_buf *ubo;
     int ubo_index; // for ra_renderpass_input_val.index
     void *pushc;
+    uint64_t last_use; // gl_shader_cache.use_counter value at last use
 };
 
 struct gl_shader_cache {
@@ -82,6 +83,7 @@ struct gl_shader_cache {
 
     struct sc_entry **entries;
     int num_entries;
+    uint64_t use_counter;
 
     struct sc_entry *current_shader; // set by gl_sc_generate()
 
@@ -142,21 +144,38 @@ void gl_sc_reset(struct gl_shader_cache *sc)
     sc->needs_reset = false;
 }
 
+static void sc_free_entry(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    ra_buf_free(sc->ra, &e->ubo);
+    if (e->pass)
+        sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
+    timer_pool_destroy(e->timer);
+    talloc_free(e);
+}
+
 static void sc_flush_cache(struct gl_shader_cache *sc)
 {
     MP_DBG(sc, "flushing shader cache\n");
 
-    for (int n = 0; n < sc->num_entries; n++) {
-        struct sc_entry *e = sc->entries[n];
-        ra_buf_free(sc->ra, &e->ubo);
-        if (e->pass)
-            sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
-        timer_pool_destroy(e->timer);
-        talloc_free(e);
-    }
+    for (int n = 0; n < sc->num_entries; n++)
+        sc_free_entry(sc, sc->entries[n]);
     sc->num_entries = 0;
 }
 
+// Drop the least recently used entry. Flushing everything instead would make
+// all passes recompile at once, e.g. after toggling options a few times.
+static void sc_evict_entry(struct gl_shader_cache *sc)
+{
+    int oldest = 0;
+    for (int n = 1; n < sc->num_entries; n++) {
+        if (sc->entries[n]->last_use < sc->entries[oldest]->last_use)
+            oldest = n;
+    }
+    MP_DBG(sc, "evicting shader cache entry\n");
+    sc_free_entry(sc, sc->entries[oldest]);
+    MP_TARRAY_REMOVE_AT(sc->entries, sc->num_entries, oldest);
+}
+
 void gl_sc_destroy(struct gl_shader_cache *sc)
 {
     if (!sc)
@@ -928,7 +947,7 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
     }
     if (!entry) {
         if (sc->num_entries == SC_MAX_ENTRIES)
-            sc_flush_cache(sc);
+            sc_evict_entry(sc);
         entry = talloc_ptrtype(NULL, entry);
         *entry = (struct sc_entry){
             .total = bstrdup(entry, *hash_total),
@@ -963,6 +982,8 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
         MP_TARRAY_APPEND(sc, sc->entries, sc->num_entries, entry);
     }
 
+    entry->last_use = ++sc->use_counter;
+
     if (!entry->pass) {
         sc->current_shader = NULL;
         return;
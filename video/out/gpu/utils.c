@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "common/msg.h"
 #include "video/out/vo.h"
 #include "utils.h"
@@ -128,14 +130,31 @@ bool ra_tex_upload_pbo(struct ra *ra, struct ra_buf_pool *pbo,
     struct ra_buf_params bufparams = {
         .type = RA_BUF_TYPE_TEX_UPLOAD,
         .size = row_size * height * tex->params.d,
-        .host_mutable = true,
     };
 
-    struct ra_buf *buf = ra_buf_pool_get(ra, pbo, &bufparams);
-    if (!buf)
-        return false;
+    // Prefer copying into a mapped buffer directly, which avoids an extra
+    // copy and synchronization in buf_update.
+    struct ra_buf *buf = NULL;
+    if (!pbo->mapping_failed) {
+        bufparams.host_mapped = true;
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
+        if (buf) {
+            memcpy(buf->data, params->src, bufparams.size);
+        } else {
+            MP_VERBOSE(ra, "Mapped upload buffers not available.\n");
+            ra_buf_pool_uninit(ra, pbo);
+            pbo->mapping_failed = true;
+        }
+    }
 
-    ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    if (!buf) {
+        bufparams.host_mapped = false;
+        bufparams.host_mutable = true;
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
+        if (!buf)
+            return false;
+        ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    }
 
     struct ra_tex_upload_params newparams = *params;
     newparams.buf = buf;
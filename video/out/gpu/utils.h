@@ -74,6 +74,7 @@ struct ra_buf_pool {
     struct ra_buf **buffers;
     int num_buffers;
     int index;
+    bool mapping_failed; // for ra_tex_upload_pbo()
 };
 
 void ra_buf_pool_uninit(struct ra *ra, struct ra_buf_pool *pool);
@@ -84,6 +85,9 @@ struct ra_buf *ra_buf_pool_get(struct ra *ra, struct ra_buf_pool *pool,
 
 // Helper that wraps ra_tex_upload using texture upload buffers to ensure that
 // params->buf is always set. This is intended for RA-internal usage.
+// If possible, the buffers are persistently mapped, and a buffer is reused
+// only after the GPU is done with it. The upload of a frame then runs on the
+// GPU while the next frame is already being copied into another buffer.
 bool ra_tex_upload_pbo(struct ra *ra, struct ra_buf_pool *pbo,
                        const struct ra_tex_upload_params *params);
 
@@ -129,6 +129,16 @@ struct cached_file {
     struct bstr body;
 };
 
+#define LUT3D_CACHE_SIZE 4
+
+struct lut3d_cache_entry {
+    struct ra_tex *tex;
+    int size[3];
+    enum pl_color_primaries prim;
+    enum pl_color_transfer trc;
+    struct AVBufferRef *icc;    // embedded profile (or NULL)
+};
+
 struct pass_info {
     struct bstr desc;
     struct mp_pass_perf perf;
@@ -160,9 +170,13 @@ struct gl_video {
     struct mpgl_osd *osd;
     double osd_pts;
 
-    struct ra_tex *lut_3d_texture;
+    struct ra_tex *lut_3d_texture;  // points into lut_3d_cache
     bool use_lut_3d;
     int lut_3d_size[3];
+    // Most recently used first. Switching between files with different
+    // colorspaces does not require regenerating and uploading a 3D LUT.
+    struct lut3d_cache_entry lut_3d_cache[LUT3D_CACHE_SIZE];
+    int num_lut_3d_cache;
 
     struct ra_tex *dither_texture;
 
@@ -186,6 +200,7 @@ struct gl_video {
 
     bool dumb_mode;
     bool forced_dumb_mode;
+    bool single_pass;       // current frame is rendered like in dumb mode
 
     // Cached vertex array, to avoid re-allocation per frame. For simplicity,
     // our vertex format is simply a list of `vertex_pt`s, since this greatly
@@ -223,9 +238,21 @@ struct gl_video {
     bool is_interpolated;
     bool output_tex_valid;
 
+    // last subtitle blending pass, to check whether output_tex is outdated
+    bool blend_subs_drawn;
+    struct mp_osd_res blend_subs_rect;
+    double blend_subs_pts;
+    int blend_subs_flags;
+    int64_t blend_subs_id;
+
     // state for configured scalers
     struct scaler scaler[SCALER_COUNT];
 
+    // --gpu-auto-quality state
+    int quality_level;
+    int quality_slow_frames;
+    int quality_fast_frames;
+
     struct mp_csp_equalizer_state *video_eq;
 
     struct mp_rect src_rect;    // displayed part of the source video
@@ -401,6 +428,7 @@ static const struct gl_video_opts gl_video_opts_def = {
         .curve = TONE_MAPPING_AUTO,
         .curve_param = NAN,
         .max_boost = 1.0,
+        .peak_interval = 1,
         .decay_rate = 20.0,
         .scene_threshold_low = 1.0,
         .scene_threshold_high = 3.0,
@@ -437,6 +465,7 @@ const struct m_sub_options gl_video_conf = {
     .opts = (const m_option_t[]) {
         {"gpu-dumb-mode", OPT_CHOICE(dumb_mode,
             {"auto", 0}, {"yes", 1}, {"no", -1})},
+        {"gpu-auto-quality", OPT_BOOL(auto_quality)},
         {"gamma-factor", OPT_FLOAT(gamma), M_RANGE(0.1, 2.0)},
         {"gamma-auto", OPT_BOOL(gamma_auto),
             .deprecation_message = "replacement: gamma-auto.lua"},
@@ -488,6 +517,8 @@ const struct m_sub_options gl_video_conf = {
             {"no", -1})},
         {"hdr-peak-percentile", OPT_FLOAT(tone_map.peak_percentile),
             M_RANGE(0.0, 100.0)},
+        {"hdr-peak-detect-interval", OPT_INT(tone_map.peak_interval),
+            M_RANGE(1, 100)},
         {"hdr-peak-decay-rate", OPT_FLOAT(tone_map.decay_rate),
             M_RANGE(0.0, 1000.0)},
         {"hdr-scene-threshold-low", OPT_FLOAT(tone_map.scene_threshold_low),
@@ -575,6 +606,7 @@ static void reinit_from_options(struct gl_video *p);
 static void get_scale_factors(struct gl_video *p, bool transpose_rot, double xy[2]);
 static void gl_video_setup_hooks(struct gl_video *p);
 static void gl_video_update_options(struct gl_video *p);
+static void update_quality_level(struct gl_video *p, struct vo_frame *frame);
 
 #define GLSL(x) gl_sc_add(p->sc, #x "\n");
 #define GLSLF(...) gl_sc_addf(p->sc, __VA_ARGS__)
@@ -678,6 +710,7 @@ static void uninit_rendering(struct gl_video *p)
 
     gl_video_reset_surfaces(p);
     gl_video_reset_hooks(p);
+    p->single_pass = false;
 
     gl_sc_reset_error(p->sc);
 }
@@ -700,6 +733,34 @@ bool gl_video_icc_auto_enabled(struct gl_video *p)
     return p->opts.icc_opts ? p->opts.icc_opts->profile_auto : false;
 }
 
+static void lut3d_cache_flush(struct gl_video *p)
+{
+    for (int n = 0; n < p->num_lut_3d_cache; n++) {
+        ra_tex_free(p->ra, &p->lut_3d_cache[n].tex);
+        av_buffer_unref(&p->lut_3d_cache[n].icc);
+    }
+    p->num_lut_3d_cache = 0;
+    p->lut_3d_texture = NULL;
+}
+
+static bool icc_equal(struct AVBufferRef *a, struct AVBufferRef *b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->size == b->size && !memcmp(a->data, b->data, a->size);
+}
+
+// Make the entry at index n the current LUT, and move it to the front.
+static void lut3d_cache_use(struct gl_video *p, int n)
+{
+    struct lut3d_cache_entry e = p->lut_3d_cache[n];
+    memmove(&p->lut_3d_cache[1], &p->lut_3d_cache[0], n * sizeof(e));
+    p->lut_3d_cache[0] = e;
+    p->lut_3d_texture = e.tex;
+    for (int i = 0; i < 3; i++)
+        p->lut_3d_size[i] = e.size[i];
+}
+
 static bool gl_video_get_lut3d(struct gl_video *p, enum pl_color_primaries prim,
                                enum pl_color_transfer trc)
 {
@@ -710,8 +771,16 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum pl_color_primaries prim,
     if (p->image.mpi)
         icc = p->image.mpi->icc_profile;
 
-    if (p->lut_3d_texture && !gl_lcms_has_changed(p->cms, prim, trc, icc))
-        return true;
+    if (gl_lcms_profile_changed(p->cms))
+        lut3d_cache_flush(p);
+
+    for (int n = 0; n < p->num_lut_3d_cache; n++) {
+        struct lut3d_cache_entry *e = &p->lut_3d_cache[n];
+        if (e->prim == prim && e->trc == trc && icc_equal(e->icc, icc)) {
+            lut3d_cache_use(p, n);
+            return true;
+        }
+    }
 
     // GLES3 doesn't provide filtered 16 bit integer textures
     // GLES2 doesn't even provide 3D textures
@@ -728,8 +797,6 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum pl_color_primaries prim,
         return false;
     }
 
-    ra_tex_free(p->ra, &p->lut_3d_texture);
-
     struct ra_tex_params params = {
         .dimensions = 3,
         .w = lut3d->size[0],
@@ -740,20 +807,31 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum pl_color_primaries prim,
         .src_linear = true,
         .initial_data = lut3d->data,
     };
-    p->lut_3d_texture = ra_tex_create(p->ra, &params);
+    struct ra_tex *tex = ra_tex_create(p->ra, &params);
 
     debug_check_gl(p, "after 3d lut creation");
 
-    for (int i = 0; i < 3; i++)
-        p->lut_3d_size[i] = lut3d->size[i];
-
-    talloc_free(lut3d);
-
-    if (!p->lut_3d_texture) {
+    if (!tex) {
+        talloc_free(lut3d);
         p->use_lut_3d = false;
         return false;
     }
 
+    // Evict the least recently used entry.
+    if (p->num_lut_3d_cache == LUT3D_CACHE_SIZE) {
+        struct lut3d_cache_entry *e = &p->lut_3d_cache[--p->num_lut_3d_cache];
+        ra_tex_free(p->ra, &e->tex);
+        av_buffer_unref(&e->icc);
+    }
+    p->lut_3d_cache[p->num_lut_3d_cache++] = (struct lut3d_cache_entry){
+        .tex = tex,
+        .size = {lut3d->size[0], lut3d->size[1], lut3d->size[2]},
+        .prim = prim,
+        .trc = trc,
+        .icc = icc ? av_buffer_ref(icc) : NULL,
+    };
+    talloc_free(lut3d);
+    lut3d_cache_use(p, p->num_lut_3d_cache - 1);
     return true;
 }
 
@@ -2785,6 +2863,10 @@ static void pass_colormanage(struct gl_video *p, struct pl_color_space src,
     }
 
     if (detect_peak) {
+        // On frames in between, the shader only applies the last result,
+        // without the per-pixel atomics.
+        if (p->frames_rendered % tone_map.peak_interval)
+            tone_map.peak_interval = 0;
         pass_describe(p, "detect HDR peak");
         pass_is_compute(p, 8, 8, true); // 8x8 is good for performance
         gl_sc_ssbo(p->sc, "PeakDetect", p->hdr_peak_ssbo,
@@ -3064,6 +3146,91 @@ static void pass_render_frame_dumb(struct gl_video *p)
     pass_convert_yuv(p);
 }
 
+static int blend_subs_osd_flags(int flags)
+{
+    int osd_flags = OSD_DRAW_SUB_ONLY;
+    if (flags & RENDER_FRAME_VF_SUBS)
+        osd_flags |= OSD_DRAW_SUB_FILTER;
+    return osd_flags;
+}
+
+// Draw subtitles into the video, and remember the parameters, so that a
+// redraw of the cached frame can check whether they changed in the meantime.
+static void pass_draw_blend_subs(struct gl_video *p, int flags, double pts,
+                                 struct mp_osd_res rect, const struct ra_fbo *fbo)
+{
+    pass_draw_osd(p, OSD_DRAW_SUB_ONLY, flags, pts, rect, fbo, false);
+
+    p->blend_subs_drawn = true;
+    p->blend_subs_rect = rect;
+    p->blend_subs_pts = pts;
+    p->blend_subs_flags = flags;
+}
+
+static int64_t get_blend_subs_id(struct gl_video *p)
+{
+    return mpgl_osd_get_change_id(p->osd, p->blend_subs_rect, p->blend_subs_pts,
+                                  p->image_params.stereo3d,
+                                  blend_subs_osd_flags(p->blend_subs_flags));
+}
+
+// Whether the subtitles blended into output_tex are outdated.
+static bool blend_subs_changed(struct gl_video *p, int flags)
+{
+    if (!p->opts.blend_subs || !p->osd)
+        return false;
+    int sub_flags = RENDER_FRAME_SUBS | RENDER_FRAME_VF_SUBS;
+    if (!p->blend_subs_drawn)
+        return flags & RENDER_FRAME_SUBS;
+    if ((flags & sub_flags) != (p->blend_subs_flags & sub_flags))
+        return true;
+    return get_blend_subs_id(p) != p->blend_subs_id;
+}
+
+static int effective_scaler(struct gl_video *p, int scaler_id)
+{
+    int function = p->opts.scaler[scaler_id].kernel.function;
+    if (function == SCALER_INHERIT)
+        function = p->opts.scaler[SCALER_SCALE].kernel.function;
+    return function;
+}
+
+// Whether the current frame can be rendered with a single pass, by sampling
+// the source planes at the output coordinates, like pass_render_frame_dumb()
+// does. This skips the intermediate textures, and is possible if all scalers
+// involved are bilinear (or no scaling happens), and nothing hooks into the
+// rendering chain.
+static bool check_single_pass(struct gl_video *p, int flags)
+{
+    struct gl_video_opts *o = &p->opts;
+    if (p->use_integer_conversion || o->interpolation || p->num_tex_hooks)
+        return false;
+    if (p->osd && o->blend_subs && (flags & RENDER_FRAME_SUBS))
+        return false;
+    if ((p->ra_format.chroma_w > 1 || p->ra_format.chroma_h > 1) &&
+        effective_scaler(p, SCALER_CSCALE) != SCALER_BILINEAR)
+        return false;
+
+    // Same as in pass_scale_main().
+    double xy[2];
+    get_scale_factors(p, true, xy);
+    bool downscaling = xy[0] < 1.0 - FLT_EPSILON || xy[1] < 1.0 - FLT_EPSILON;
+    bool upscaling = !downscaling && (xy[0] > 1.0 + FLT_EPSILON ||
+                                      xy[1] > 1.0 + FLT_EPSILON);
+    if (downscaling) {
+        if (o->correct_downscaling || o->linear_downscaling)
+            return false;
+        return effective_scaler(p, SCALER_DSCALE) == SCALER_BILINEAR;
+    }
+    if (upscaling) {
+        if (o->linear_upscaling || o->sigmoid_upscaling)
+            return false;
+        return effective_scaler(p, SCALER_SCALE) == SCALER_BILINEAR;
+    }
+    return o->scaler_resizes_only ||
+           effective_scaler(p, SCALER_SCALE) == SCALER_BILINEAR;
+}
+
 // The main rendering function, takes care of everything up to and including
 // upscaling. p->image is rendered.
 // flags: bit set of RENDER_FRAME_* flags
@@ -3078,6 +3245,7 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
     p->num_saved_imgs = 0;
     p->idx_hook_textures = 0;
     p->use_linear = false;
+    p->blend_subs_drawn = false;
 
     // try uploading the frame
     if (!pass_upload_image(p, mpi, id))
@@ -3086,7 +3254,8 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
     if (p->image_params.rotate % 180 == 90)
         MPSWAP(int, p->texture_w, p->texture_h);
 
-    if (p->dumb_mode)
+    p->single_pass = !p->dumb_mode && check_single_pass(p, flags);
+    if (p->dumb_mode || p->single_pass)
         return true;
 
     pass_read_video(p);
@@ -3110,7 +3279,7 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
         };
         finish_pass_tex(p, &p->blend_subs_tex, rect.w, rect.h);
         struct ra_fbo fbo = { p->blend_subs_tex };
-        pass_draw_osd(p, OSD_DRAW_SUB_ONLY, flags, vpts, rect, &fbo, false);
+        pass_draw_blend_subs(p, flags, vpts, rect, &fbo);
         pass_read_tex(p, p->blend_subs_tex);
         pass_describe(p, "blend subs video");
     }
@@ -3142,7 +3311,7 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
         }
         finish_pass_tex(p, &p->blend_subs_tex, p->texture_w, p->texture_h);
         struct ra_fbo fbo = { p->blend_subs_tex };
-        pass_draw_osd(p, OSD_DRAW_SUB_ONLY, flags, vpts, rect, &fbo, false);
+        pass_draw_blend_subs(p, flags, vpts, rect, &fbo);
         pass_read_tex(p, p->blend_subs_tex);
         pass_describe(p, "blend subs");
     }
@@ -3154,7 +3323,7 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
 
 static void pass_draw_to_screen(struct gl_video *p, const struct ra_fbo *fbo, int flags)
 {
-    if (p->dumb_mode)
+    if (p->dumb_mode || p->single_pass)
         pass_render_frame_dumb(p);
 
     // Adjust the overall gamma before drawing to screen
@@ -3242,11 +3411,25 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
 {
     bool is_new = false;
 
-    // Reset the queue completely if this is a still image, to avoid any
-    // interpolation artifacts from surrounding frames when unpausing or
-    // framestepping
-    if (t->still)
-        gl_video_reset_surfaces(p);
+    // Reset the queue if this is a still image, to avoid any interpolation
+    // artifacts from surrounding frames when unpausing or framestepping. If
+    // the current frame is already rendered, keep it, so that redraws while
+    // paused don't render it again. (Unless subtitles are blended into it.)
+    if (t->still) {
+        struct surface *now = &p->surfaces[p->surface_now];
+        if (now->id && now->id == t->frame_id && !p->opts.blend_subs) {
+            for (int i = 0; i < SURFACES_MAX; i++) {
+                if (i == p->surface_now)
+                    continue;
+                p->surfaces[i].id = 0;
+                p->surfaces[i].pts = MP_NOPTS_VALUE;
+            }
+            p->surface_idx = p->surface_now;
+            p->frames_drawn = 0;
+        } else {
+            gl_video_reset_surfaces(p);
+        }
+    }
 
     // First of all, figure out if we have a frame available at all, and draw
     // it manually + reset the queue if not
@@ -3458,8 +3641,9 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
         } else {
             bool is_new = frame->frame_id != p->image.id;
 
-            // Redrawing a frame might update subtitles.
-            if (frame->still && p->opts.blend_subs)
+            // Redrawing a frame might update subtitles. Only OSD changes
+            // (which are drawn on top anyway) keep the cached frame usable.
+            if (frame->still && blend_subs_changed(p, flags))
                 is_new = true;
 
             if (is_new || !p->output_tex_valid) {
@@ -3490,6 +3674,9 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                     r ? &(struct ra_fbo) { .tex = p->output_tex, .color_space = fbo->color_space } : fbo;
                 p->output_tex_valid = r;
                 pass_draw_to_screen(p, dest_fbo, flags);
+
+                if (r && p->blend_subs_drawn)
+                    p->blend_subs_id = get_blend_subs_id(p);
             }
 
             // "output tex valid" and "output tex needed" are equivalent
@@ -3542,6 +3729,7 @@ done:
 
     p->frames_rendered++;
     pass_report_performance(p);
+    update_quality_level(p, frame);
 }
 
 void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
@@ -3565,6 +3753,8 @@ void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
     nframe->pts = 0;
     nframe->duration = -1;
 
+    struct mp_rect src = p->src_rect, dst = p->dst_rect;
+    struct mp_osd_res osd = p->osd_rect;
     if (!args->scaled) {
         int w, h;
         mp_image_params_get_dsize(&p->image_params, &w, &h);
@@ -3573,8 +3763,8 @@ void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
 
         int src_w = p->image_params.w;
         int src_h = p->image_params.h;
-        struct mp_rect src = {0, 0, src_w, src_h};
-        struct mp_rect dst = {0, 0, w, h};
+        src = (struct mp_rect){0, 0, src_w, src_h};
+        dst = (struct mp_rect){0, 0, w, h};
 
         if (mp_image_crop_valid(&p->image_params))
             src = p->image_params.crop;
@@ -3586,14 +3776,16 @@ void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
         mp_rect_rotate(&src, src_w, src_h, p->image_params.rotate);
         mp_rect_rotate(&dst, w, h, p->image_params.rotate);
 
-        struct mp_osd_res osd = {
+        osd = (struct mp_osd_res){
             .display_par = 1.0,
             .w = mp_rect_w(dst),
             .h = mp_rect_h(dst),
         };
-        gl_video_resize(p, &src, &dst, &osd);
     }
 
+    // Downscaling while rendering keeps the readback small.
+    vo_screenshot_fit(args, &dst, &osd);
+    gl_video_resize(p, &src, &dst, &osd);
     gl_video_reset_surfaces(p);
 
     struct ra_tex_params params = {
@@ -3683,12 +3875,14 @@ void gl_video_resize(struct gl_video *p,
         osd_res_equals(p->osd_rect, *osd))
         return;
 
+    // The rendered frames don't depend on the OSD size.
+    if (!mp_rect_equals(&p->src_rect, src) || !mp_rect_equals(&p->dst_rect, dst))
+        gl_video_reset_surfaces(p);
+
     p->src_rect = *src;
     p->dst_rect = *dst;
     p->osd_rect = *osd;
 
-    gl_video_reset_surfaces(p);
-
     if (p->osd)
         mpgl_osd_resize(p->osd, p->osd_rect, p->image_params.stereo3d);
 }
@@ -4063,6 +4257,96 @@ static void check_gl_features(struct gl_video *p)
     }
 }
 
+// Steps taken by --gpu-auto-quality, from cheapest to most visible. Each level
+// includes the ones before it.
+enum {
+    QUALITY_FULL = 0,
+    QUALITY_NO_DEBAND,      // disable debanding and sharpening
+    QUALITY_NO_POLAR,       // replace polar (EWA) scalers with spline36
+    QUALITY_MINIMAL,        // bilinear scalers, no user shaders
+    QUALITY_LEVELS,
+};
+
+// Frames in a row needed to lower or raise the level.
+#define QUALITY_SLOW_FRAMES 10
+#define QUALITY_FAST_FRAMES 300
+
+static void apply_quality_level(struct gl_video *p)
+{
+    if (!p->opts.auto_quality)
+        p->quality_level = QUALITY_FULL;
+
+    if (p->quality_level >= QUALITY_NO_DEBAND) {
+        p->opts.deband = false;
+        p->opts.unsharp = 0;
+    }
+
+    for (int n = 0; n < SCALER_COUNT; n++) {
+        if (n == SCALER_TSCALE)
+            continue;
+        struct scaler_fun *kernel = &p->opts.scaler[n].kernel;
+        const struct filter_kernel *k = mp_find_filter_kernel(kernel->function);
+        if (!k)
+            continue;
+        if (p->quality_level >= QUALITY_MINIMAL) {
+            kernel->function = SCALER_BILINEAR;
+        } else if (p->quality_level >= QUALITY_NO_POLAR && k->polar) {
+            kernel->function = SCALER_SPLINE36;
+        }
+    }
+
+    if (p->quality_level >= QUALITY_MINIMAL)
+        p->opts.user_shaders = NULL;
+}
+
+// Adjust the quality level to the GPU time the last fresh frame needed,
+// compared to the time available per vsync.
+static void update_quality_level(struct gl_video *p, struct vo_frame *frame)
+{
+    if (!p->opts.auto_quality || p->pass != p->pass_fresh)
+        return;
+
+    double budget = frame->vsync_interval > 1 ? frame->vsync_interval
+                                              : frame->duration;
+    if (budget <= 0)
+        return;
+
+    uint64_t total = 0;
+    for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
+        if (!p->pass_fresh[i].desc.len)
+            break;
+        total += p->pass_fresh[i].perf.last;
+    }
+    // No timer queries, or no data yet.
+    if (!total)
+        return;
+
+    int level = p->quality_level;
+    if (total > budget * 0.85) {
+        p->quality_fast_frames = 0;
+        if (++p->quality_slow_frames >= QUALITY_SLOW_FRAMES)
+            level = MPMIN(level + 1, QUALITY_LEVELS - 1);
+    } else if (total < budget * 0.4) {
+        p->quality_slow_frames = 0;
+        if (++p->quality_fast_frames >= QUALITY_FAST_FRAMES)
+            level = MPMAX(level - 1, QUALITY_FULL);
+    } else {
+        p->quality_slow_frames = 0;
+        p->quality_fast_frames = 0;
+    }
+
+    if (level == p->quality_level)
+        return;
+
+    MP_VERBOSE(p, "Frame took %.2f ms of %.2f ms, %s quality to level %d.\n",
+               total / 1e6, budget / 1e6,
+               level > p->quality_level ? "lowering" : "raising", level);
+    p->quality_level = level;
+    p->quality_slow_frames = 0;
+    p->quality_fast_frames = 0;
+    reinit_from_options(p);
+}
+
 static void init_gl(struct gl_video *p)
 {
     debug_check_gl(p, "before init_gl");
@@ -4086,7 +4370,7 @@ void gl_video_uninit(struct gl_video *p)
     ra_hwdec_ctx_uninit(&p->hwdec_ctx);
     gl_sc_destroy(p->sc);
 
-    ra_tex_free(p->ra, &p->lut_3d_texture);
+    lut3d_cache_flush(p);
     ra_buf_free(p->ra, &p->hdr_peak_ssbo);
 
     timer_pool_destroy(p->upload_timer);
@@ -4207,7 +4491,7 @@ static void gl_video_update_options(struct gl_video *p)
     }
 
     if (mp_csp_equalizer_state_changed(p->video_eq))
-        p->output_tex_valid = false;
+        gl_video_reset_surfaces(p);
 }
 
 static void reinit_from_options(struct gl_video *p)
@@ -4223,6 +4507,8 @@ static void reinit_from_options(struct gl_video *p)
         p->clear_color = p->opts.background_color;
 
     check_gl_features(p);
+    if (!p->dumb_mode)
+        apply_quality_level(p);
     uninit_rendering(p);
     if (p->opts.shader_cache)
         gl_sc_set_cache_dir(p->sc, p->opts.shader_cache_dir);
@@ -120,6 +120,7 @@ struct gl_tone_map_opts {
     float max_boost;
     bool inverse;
     int compute_peak;
+    int peak_interval;  // 0 while rendering: only use the previous result
     float decay_rate;
     float scene_threshold_low;
     float scene_threshold_high;
@@ -132,6 +133,7 @@ struct gl_tone_map_opts {
 
 struct gl_video_opts {
     int dumb_mode;
+    bool auto_quality;
     struct scaler_config scaler[4];
     float gamma;
     bool gamma_auto;
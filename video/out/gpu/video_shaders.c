@@ -610,6 +610,9 @@ static void hdr_update_peak(struct gl_shader_cache *sc,
     GLSL(    sig_peak = max(1.00, average.y);)
     GLSL(})
 
+    if (!opts->peak_interval)
+        return;
+
     // Chosen to avoid overflowing on an 8K buffer
     const float log_min = 1e-3, log_scale = 400.0, sig_scale = 10000.0;
 
@@ -647,7 +650,7 @@ static void hdr_update_peak(struct gl_shader_cache *sc,
     // Use an IIR low-pass filter to smooth out the detected values, with a
     // configurable decay rate based on the desired time constant (tau)
     if (opts->decay_rate) {
-        float decay = 1.0f - expf(-1.0f / opts->decay_rate);
+        float decay = 1.0f - expf(-opts->peak_interval / opts->decay_rate);
         GLSLF("  average += %f * (cur - average);\n", decay);
     } else {
         GLSLF("  average = cur;\n");
@@ -0,0 +1,132 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "dmabuf_interop.h"
+
+// The key is compared with memcmp(), so it's cleared first, and copied with
+// memcpy() (padding is not preserved by assignments).
+static bool get_key(struct dmabuf_interop_key *key,
+                    const AVDRMFrameDescriptor *desc)
+{
+    memset(key, 0, sizeof(*key));
+
+    key->nb_objects = desc->nb_objects;
+    for (int i = 0; i < desc->nb_objects; i++) {
+        struct stat st;
+        if (fstat(desc->objects[i].fd, &st))
+            return false;
+        key->objects[i].dev = st.st_dev;
+        key->objects[i].ino = st.st_ino;
+        key->objects[i].format_modifier = desc->objects[i].format_modifier;
+    }
+
+    key->nb_layers = desc->nb_layers;
+    for (int i = 0; i < desc->nb_layers; i++) {
+        key->layers[i].format = desc->layers[i].format;
+        key->layers[i].nb_planes = desc->layers[i].nb_planes;
+        for (int j = 0; j < desc->layers[i].nb_planes; j++) {
+            const AVDRMPlaneDescriptor *plane = &desc->layers[i].planes[j];
+            key->layers[i].planes[j].object_index = plane->object_index;
+            key->layers[i].planes[j].offset = plane->offset;
+            key->layers[i].planes[j].pitch = plane->pitch;
+        }
+    }
+
+    return true;
+}
+
+static void release_import(const struct ra_hwdec_mapper *mapper,
+                           struct dmabuf_interop_import *imp,
+                           dmabuf_interop_free_import free_import)
+{
+    free_import(mapper, imp);
+    *imp = (struct dmabuf_interop_import){0};
+}
+
+struct dmabuf_interop_import *dmabuf_interop_get_import(
+    struct ra_hwdec_mapper *mapper, dmabuf_interop_free_import free_import)
+{
+    struct dmabuf_interop_priv *p = mapper->priv;
+
+    struct dmabuf_interop_key key;
+    if (!get_key(&key, &p->desc)) {
+        release_import(mapper, &p->uncached, free_import);
+        p->import = &p->uncached;
+        return p->import;
+    }
+
+    struct dmabuf_interop_import *imp = NULL, *oldest = NULL;
+    for (int n = 0; n < DMABUF_INTEROP_MAX_IMPORTS; n++) {
+        struct dmabuf_interop_import *cur = &p->imports[n];
+        if (cur->last_use && memcmp(&cur->key, &key, sizeof(key)) == 0) {
+            imp = cur;
+            break;
+        }
+        if (!oldest || cur->last_use < oldest->last_use)
+            oldest = cur;
+    }
+
+    if (!imp) {
+        imp = oldest;
+        if (imp->last_use)
+            MP_TRACE(mapper, "evicting imported surface\n");
+        release_import(mapper, imp, free_import);
+        memcpy(&imp->key, &key, sizeof(key));
+    }
+
+    imp->last_use = ++p->import_counter;
+    p->import = imp;
+    return imp;
+}
+
+void dmabuf_interop_drop_import(struct ra_hwdec_mapper *mapper,
+                                dmabuf_interop_free_import free_import)
+{
+    struct dmabuf_interop_priv *p = mapper->priv;
+
+    if (p->import)
+        release_import(mapper, p->import, free_import);
+    p->import = NULL;
+}
+
+void dmabuf_interop_unmap_import(struct ra_hwdec_mapper *mapper,
+                                 dmabuf_interop_free_import free_import)
+{
+    struct dmabuf_interop_priv *p = mapper->priv;
+
+    for (int n = 0; n < MP_ARRAY_SIZE(mapper->tex); n++)
+        mapper->tex[n] = NULL;
+    if (p->import == &p->uncached)
+        release_import(mapper, &p->uncached, free_import);
+    p->import = NULL;
+}
+
+void dmabuf_interop_clear_imports(const struct ra_hwdec_mapper *mapper,
+                                  dmabuf_interop_free_import free_import)
+{
+    struct dmabuf_interop_priv *p = mapper->priv;
+
+    for (int n = 0; n < DMABUF_INTEROP_MAX_IMPORTS; n++)
+        release_import(mapper, &p->imports[n], free_import);
+    release_import(mapper, &p->uncached, free_import);
+    p->import = NULL;
+}
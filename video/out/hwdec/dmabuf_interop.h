@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <libavutil/hwcontext_drm.h>
 
 #include "video/out/gpu/hwdec.h"
@@ -35,17 +38,73 @@ struct dmabuf_interop {
     void (*interop_unmap)(struct ra_hwdec_mapper *mapper);
 };
 
+// Identity of a surface: its dmabuf objects (by inode, which is the same for
+// every exported fd of a buffer) and the plane layout.
+struct dmabuf_interop_key {
+    int nb_objects, nb_layers;
+    struct {
+        uint64_t dev, ino;
+        uint64_t format_modifier;
+    } objects[AV_DRM_MAX_PLANES];
+    struct {
+        uint32_t format;
+        int nb_planes;
+        struct {
+            int object_index;
+            ptrdiff_t offset, pitch;
+        } planes[AV_DRM_MAX_PLANES];
+    } layers[AV_DRM_MAX_PLANES];
+};
+
+// A surface imported by an interop. Decoders reuse a small pool of surfaces,
+// so the imports are kept by the mapper, and reused when the same surface is
+// mapped again.
+struct dmabuf_interop_import {
+    struct dmabuf_interop_key key;
+    uint64_t last_use;          // 0 if the entry is unused
+    struct ra_tex *tex[AV_DRM_MAX_PLANES];
+    void *priv;                 // interop specific
+};
+
+#define DMABUF_INTEROP_MAX_IMPORTS 32
+
 struct dmabuf_interop_priv {
     int num_planes;
     struct mp_image layout;
-    struct ra_tex *tex[AV_DRM_MAX_PLANES];
 
     AVDRMFrameDescriptor desc;
     bool surface_acquired;
 
     void *interop_mapper_priv;
+
+    struct dmabuf_interop_import imports[DMABUF_INTEROP_MAX_IMPORTS];
+    struct dmabuf_interop_import uncached; // if the surface can't be identified
+    struct dmabuf_interop_import *import;  // the currently mapped one
+    uint64_t import_counter;
 };
 
+// Free the tex[] and priv fields of the import (which may be partially set).
+typedef void (*dmabuf_interop_free_import)(const struct ra_hwdec_mapper *mapper,
+                                           struct dmabuf_interop_import *imp);
+
+// Return the import for the surface in desc, and make it the current one. If
+// tex[0] is NULL, it was not imported yet, and the caller must do it. If the
+// cache is full, the least recently used entry is freed with free_import.
+struct dmabuf_interop_import *dmabuf_interop_get_import(
+    struct ra_hwdec_mapper *mapper, dmabuf_interop_free_import free_import);
+
+// Free the current import, after importing it failed.
+void dmabuf_interop_drop_import(struct ra_hwdec_mapper *mapper,
+                                dmabuf_interop_free_import free_import);
+
+// Clear mapper->tex[], and release the current import. (Cached imports are
+// kept until dmabuf_interop_clear_imports().)
+void dmabuf_interop_unmap_import(struct ra_hwdec_mapper *mapper,
+                                 dmabuf_interop_free_import free_import);
+
+void dmabuf_interop_clear_imports(const struct ra_hwdec_mapper *mapper,
+                                  dmabuf_interop_free_import free_import);
+
 typedef bool (*dmabuf_interop_init)(const struct ra_hwdec *hw,
                                     struct dmabuf_interop *dmabuf_interop);
 
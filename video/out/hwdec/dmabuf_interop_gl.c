@@ -52,9 +52,6 @@ typedef void *EGLImageKHR;
 #define EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT 0x344A
 
 struct vaapi_gl_mapper_priv {
-    GLuint gl_textures[AV_DRM_MAX_PLANES];
-    EGLImageKHR images[AV_DRM_MAX_PLANES];
-
     const struct ra_format *planes[AV_DRM_MAX_PLANES];
 
     EGLImageKHR (EGLAPIENTRY *CreateImageKHR)(EGLDisplay, EGLContext,
@@ -66,15 +63,23 @@ struct vaapi_gl_mapper_priv {
                                                     const GLint *);
 };
 
-static bool gl_create_textures(struct ra_hwdec_mapper *mapper)
+// Per imported surface (dmabuf_interop_import.priv).
+struct vaapi_gl_import {
+    GLuint gl_textures[AV_DRM_MAX_PLANES];
+    EGLImageKHR images[AV_DRM_MAX_PLANES];
+};
+
+static bool gl_create_textures(struct ra_hwdec_mapper *mapper,
+                               struct dmabuf_interop_import *imp)
 {
     struct dmabuf_interop_priv *p_mapper = mapper->priv;
     struct vaapi_gl_mapper_priv *p = p_mapper->interop_mapper_priv;
+    struct vaapi_gl_import *gi = imp->priv;
 
     GL *gl = ra_gl_get(mapper->ra);
-    gl->GenTextures(AV_DRM_MAX_PLANES, p->gl_textures);
+    gl->GenTextures(AV_DRM_MAX_PLANES, gi->gl_textures);
     for (int n = 0; n < p_mapper->num_planes; n++) {
-        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
+        gl->BindTexture(GL_TEXTURE_2D, gi->gl_textures[n]);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -94,26 +99,33 @@ static bool gl_create_textures(struct ra_hwdec_mapper *mapper)
         if (params.format->ctype != RA_CTYPE_UNORM)
             return false;
 
-        p_mapper->tex[n] = ra_create_wrapped_tex(mapper->ra, &params,
-                                                 p->gl_textures[n]);
-        if (!p_mapper->tex[n])
+        imp->tex[n] = ra_create_wrapped_tex(mapper->ra, &params,
+                                            gi->gl_textures[n]);
+        if (!imp->tex[n])
             return false;
     }
 
     return true;
 }
 
-static void gl_delete_textures(const struct ra_hwdec_mapper *mapper)
+static void vaapi_gl_free_import(const struct ra_hwdec_mapper *mapper,
+                                 struct dmabuf_interop_import *imp)
 {
     struct dmabuf_interop_priv *p_mapper = mapper->priv;
     struct vaapi_gl_mapper_priv *p = p_mapper->interop_mapper_priv;
+    struct vaapi_gl_import *gi = imp->priv;
+
+    if (!gi)
+        return;
 
     GL *gl = ra_gl_get(mapper->ra);
-    gl->DeleteTextures(AV_DRM_MAX_PLANES, p->gl_textures);
+    gl->DeleteTextures(AV_DRM_MAX_PLANES, gi->gl_textures);
     for (int n = 0; n < AV_DRM_MAX_PLANES; n++) {
-        p->gl_textures[n] = 0;
-        ra_tex_free(mapper->ra, &p_mapper->tex[n]);
+        ra_tex_free(mapper->ra, &imp->tex[n]);
+        if (gi->images[n])
+            p->DestroyImageKHR(eglGetCurrentDisplay(), gi->images[n]);
     }
+    TA_FREEP(&imp->priv);
 }
 
 static bool vaapi_gl_mapper_init(struct ra_hwdec_mapper *mapper,
@@ -146,15 +158,10 @@ static bool vaapi_gl_mapper_init(struct ra_hwdec_mapper *mapper,
     static_assert(MP_ARRAY_SIZE(desc->planes) == AV_DRM_MAX_PLANES, "");
     static_assert(MP_ARRAY_SIZE(mapper->tex) == AV_DRM_MAX_PLANES, "");
 
-    // remember format to allow texture recreation
+    // remember format for texture creation
     for (int n = 0; n < desc->num_planes; n++) {
         p->planes[n] = desc->planes[n];
     }
-    if (p->EGLImageTargetTexture2DOES) {
-        // created only once
-        if (!gl_create_textures(mapper))
-            return false;
-    }
 
     return true;
 }
@@ -165,7 +172,7 @@ static void vaapi_gl_mapper_uninit(const struct ra_hwdec_mapper *mapper)
     struct vaapi_gl_mapper_priv *p = p_mapper->interop_mapper_priv;
 
     if (p) {
-        gl_delete_textures(mapper);
+        dmabuf_interop_clear_imports(mapper, vaapi_gl_free_import);
         talloc_free(p);
         p_mapper->interop_mapper_priv = NULL;
     }
@@ -197,19 +204,19 @@ static void vaapi_gl_mapper_uninit(const struct ra_hwdec_mapper *mapper)
     } \
     } while (0)
 
-static bool vaapi_gl_map(struct ra_hwdec_mapper *mapper,
-                         struct dmabuf_interop *dmabuf_interop,
-                         bool probing)
+static bool vaapi_gl_import(struct ra_hwdec_mapper *mapper,
+                            struct dmabuf_interop *dmabuf_interop,
+                            struct dmabuf_interop_import *imp, bool probing)
 {
     struct dmabuf_interop_priv *p_mapper = mapper->priv;
     struct vaapi_gl_mapper_priv *p = p_mapper->interop_mapper_priv;
 
     GL *gl = ra_gl_get(mapper->ra);
 
-    if (p->EGLImageTargetTexStorageEXT) {
-        if (!gl_create_textures(mapper))
-            return false;
-    }
+    struct vaapi_gl_import *gi = talloc_zero(NULL, struct vaapi_gl_import);
+    imp->priv = gi;
+    if (!gl_create_textures(mapper, imp))
+        return false;
 
     for (int i = 0, n = 0; i < p_mapper->desc.nb_layers; i++) {
         /*
@@ -288,26 +295,26 @@ static bool vaapi_gl_map(struct ra_hwdec_mapper *mapper,
             int num_attribs = 0;
 
             ADD_ATTRIB(EGL_LINUX_DRM_FOURCC_EXT, format[j]);
-            ADD_ATTRIB(EGL_WIDTH,  p_mapper->tex[n]->params.w);
-            ADD_ATTRIB(EGL_HEIGHT, p_mapper->tex[n]->params.h);
+            ADD_ATTRIB(EGL_WIDTH,  imp->tex[n]->params.w);
+            ADD_ATTRIB(EGL_HEIGHT, imp->tex[n]->params.h);
             ADD_PLANE_ATTRIBS(0);
 
-            p->images[n] = p->CreateImageKHR(eglGetCurrentDisplay(),
+            gi->images[n] = p->CreateImageKHR(eglGetCurrentDisplay(),
                 EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
-            if (!p->images[n]) {
+            if (!gi->images[n]) {
                 mp_msg(mapper->log, probing ? MSGL_DEBUG : MSGL_ERR,
                     "Failed to import surface in EGL: %u\n", eglGetError());
                 return false;
             }
 
-            gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
+            // The texture stays bound to the image for the lifetime of the
+            // import, and shows the current contents of the surface.
+            gl->BindTexture(GL_TEXTURE_2D, gi->gl_textures[n]);
             if (p->EGLImageTargetTexStorageEXT) {
-                p->EGLImageTargetTexStorageEXT(GL_TEXTURE_2D, p->images[n], NULL);
+                p->EGLImageTargetTexStorageEXT(GL_TEXTURE_2D, gi->images[n], NULL);
             } else {
-                p->EGLImageTargetTexture2DOES(GL_TEXTURE_2D, p->images[n]);
+                p->EGLImageTargetTexture2DOES(GL_TEXTURE_2D, gi->images[n]);
             }
-
-            mapper->tex[n] = p_mapper->tex[n];
         }
     }
 
@@ -315,24 +322,33 @@ static bool vaapi_gl_map(struct ra_hwdec_mapper *mapper,
     return true;
 }
 
+static bool vaapi_gl_map(struct ra_hwdec_mapper *mapper,
+                         struct dmabuf_interop *dmabuf_interop,
+                         bool probing)
+{
+    struct dmabuf_interop_priv *p_mapper = mapper->priv;
+
+    struct dmabuf_interop_import *imp =
+        dmabuf_interop_get_import(mapper, vaapi_gl_free_import);
+    if (!imp->tex[0] && !vaapi_gl_import(mapper, dmabuf_interop, imp, probing)) {
+        ra_gl_get(mapper->ra)->BindTexture(GL_TEXTURE_2D, 0);
+        dmabuf_interop_drop_import(mapper, vaapi_gl_free_import);
+        return false;
+    }
+
+    for (int n = 0; n < p_mapper->num_planes; n++)
+        mapper->tex[n] = imp->tex[n];
+    return true;
+}
+
 static void vaapi_gl_unmap(struct ra_hwdec_mapper *mapper)
 {
     struct dmabuf_interop_priv *p_mapper = mapper->priv;
-    struct vaapi_gl_mapper_priv *p = p_mapper->interop_mapper_priv;
 
-    if (!p)
+    if (!p_mapper->interop_mapper_priv)
         return;
 
-    if (p->EGLImageTargetTexStorageEXT) {
-        // textures are immutable, can't reuse
-        gl_delete_textures(mapper);
-    }
-
-    for (int n = 0; n < AV_DRM_MAX_PLANES; n++) {
-        if (p->images[n])
-            p->DestroyImageKHR(eglGetCurrentDisplay(), p->images[n]);
-        p->images[n] = 0;
-    }
+    dmabuf_interop_unmap_import(mapper, vaapi_gl_free_import);
 }
 
 bool dmabuf_interop_gl_init(const struct ra_hwdec *hw,
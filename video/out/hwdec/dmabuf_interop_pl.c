@@ -22,9 +22,15 @@
 #include "video/out/placebo/ra_pl.h"
 #include "video/out/placebo/utils.h"
 
-static bool vaapi_pl_map(struct ra_hwdec_mapper *mapper,
-                         struct dmabuf_interop *dmabuf_interop,
-                         bool probing)
+static void vaapi_pl_free_import(const struct ra_hwdec_mapper *mapper,
+                                 struct dmabuf_interop_import *imp)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(imp->tex); n++)
+        ra_tex_free(mapper->ra, &imp->tex[n]);
+}
+
+static bool vaapi_pl_import(struct ra_hwdec_mapper *mapper,
+                            struct dmabuf_interop_import *imp, bool probing)
 {
     struct dmabuf_interop_priv *p = mapper->priv;
     pl_gpu gpu = ra_pl_get(mapper->ra);
@@ -94,7 +100,7 @@ static bool vaapi_pl_map(struct ra_hwdec_mapper *mapper,
             talloc_free(ratex);
             return false;
         }
-        mapper->tex[n] = ratex;
+        imp->tex[n] = ratex;
 
         MP_TRACE(mapper, "Object %d with fd %d imported as %p\n",
                 id, fd, ratex);
@@ -108,10 +114,32 @@ static bool vaapi_pl_map(struct ra_hwdec_mapper *mapper,
     return true;
 }
 
+static bool vaapi_pl_map(struct ra_hwdec_mapper *mapper,
+                         struct dmabuf_interop *dmabuf_interop,
+                         bool probing)
+{
+    struct dmabuf_interop_priv *p = mapper->priv;
+
+    struct dmabuf_interop_import *imp =
+        dmabuf_interop_get_import(mapper, vaapi_pl_free_import);
+    if (!imp->tex[0] && !vaapi_pl_import(mapper, imp, probing)) {
+        dmabuf_interop_drop_import(mapper, vaapi_pl_free_import);
+        return false;
+    }
+
+    for (int n = 0; n < p->num_planes; n++)
+        mapper->tex[n] = imp->tex[n];
+    return true;
+}
+
 static void vaapi_pl_unmap(struct ra_hwdec_mapper *mapper)
 {
-    for (int n = 0; n < MP_ARRAY_SIZE(mapper->tex); n++)
-        ra_tex_free(mapper->ra, &mapper->tex[n]);
+    dmabuf_interop_unmap_import(mapper, vaapi_pl_free_import);
+}
+
+static void vaapi_pl_mapper_uninit(const struct ra_hwdec_mapper *mapper)
+{
+    dmabuf_interop_clear_imports(mapper, vaapi_pl_free_import);
 }
 
 bool dmabuf_interop_pl_init(const struct ra_hwdec *hw,
@@ -131,6 +159,7 @@ bool dmabuf_interop_pl_init(const struct ra_hwdec *hw,
 
     MP_VERBOSE(hw, "using libplacebo dmabuf interop\n");
 
+    dmabuf_interop->interop_uninit = vaapi_pl_mapper_uninit;
     dmabuf_interop->interop_map = vaapi_pl_map;
     dmabuf_interop->interop_unmap = vaapi_pl_unmap;
 
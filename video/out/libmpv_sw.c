@@ -1,5 +1,7 @@
+#include "common/msg.h"
 #include "mpv/render_gl.h"
 #include "libmpv.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/sws_utils.h"
 
@@ -8,6 +10,7 @@ struct priv {
 
     struct mp_sws_context *sws;
     struct osd_state *osd;
+    struct mp_draw_sub_cache *osd_cache;
 
     struct mp_image_params src_params, dst_params;
     struct mp_rect src_rc, dst_rc;
@@ -30,6 +33,10 @@ static int init(struct render_backend *ctx, mpv_render_param *params)
     p->sws = mp_sws_alloc(p);
     mp_sws_enable_cmdline_opts(p->sws, ctx->global);
 
+    // Own cache instead of osd_draw_on_image(), so OSD blending can use the
+    // same number of threads as the conversion.
+    p->osd_cache = mp_draw_sub_alloc(p, ctx->global);
+
     p->anything_changed = true;
 
     return 0;
@@ -147,6 +154,8 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
                 return MPV_ERROR_UNSUPPORTED; // probably
         }
 
+        mp_draw_sub_set_threads(p->osd_cache, p->sws->threads);
+
         p->anything_changed = false;
     }
 
@@ -183,8 +192,14 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
         mp_image_clear(&wrap_img, 0, 0, wrap_img.w, wrap_img.h);
     }
 
-    if (p->osd)
-        osd_draw_on_image(p->osd, p->osd_rc, img ? img->pts : 0, 0, &wrap_img);
+    if (p->osd) {
+        struct sub_bitmap_list *list = osd_render(p->osd, p->osd_rc,
+                                                  img ? img->pts : 0, 0,
+                                                  mp_draw_sub_formats);
+        if (list->num_items && !mp_draw_sub_bitmaps(p->osd_cache, &wrap_img, list))
+            MP_WARN(ctx, "Failed rendering OSD.\n");
+        talloc_free(list);
+    }
 
     return 0;
 }
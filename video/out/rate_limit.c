@@ -0,0 +1,38 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "rate_limit.h"
+
+// Let short bursts through, so that e.g. a single large frame after mostly
+// static content doesn't stall the VO.
+#define BURST_NS MP_TIME_MS_TO_NS(100)
+
+void mp_rate_limit_wait(struct mp_rate_limit *rl, int64_t rate, size_t bytes)
+{
+    if (rate <= 0)
+        return;
+
+    int64_t now = mp_time_ns();
+    int64_t start = MPMAX(rl->idle_ns, now);
+    rl->idle_ns = start + (int64_t)(bytes * 1e9 / rate);
+
+    int64_t wait = rl->idle_ns - now - BURST_NS;
+    if (wait > 0)
+        mp_sleep_ns(MPMIN(wait, MP_TIME_S_TO_NS(1)));
+}
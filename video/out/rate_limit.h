@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pacing for VOs which write frames over a byte stream of limited bandwidth
+// (terminals, possibly over SSH). Instead of queuing up data faster than the
+// link can take it, presentation is slowed down, which makes the player drop
+// frames and thus lowers the effective frame rate.
+struct mp_rate_limit {
+    int64_t idle_ns;    // estimated time at which the link is idle again
+};
+
+// Account for bytes written to the output, and sleep until the average rate is
+// within the limit again. rate is in bytes per second, and 0 disables it.
+void mp_rate_limit_wait(struct mp_rate_limit *rl, int64_t rate, size_t bytes);
@@ -0,0 +1,246 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mpv_talloc.h"
+#include "sub/draw_bmp.h"
+#include "sub/osd.h"
+#include "sw_render.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+#include "vo.h"
+
+struct mp_sw_render {
+    struct vo *vo;
+    struct mp_sws_context *sws;
+    struct mp_draw_sub_cache *osd_cache;
+    uint64_t gen;
+
+    // Converted video of clean_frame_id without OSD, for clean_rc. Only the
+    // parts of the video which were covered by OSD at some point are saved.
+    struct mp_image *clean;
+    uint64_t clean_frame_id;
+    struct mp_rect clean_rc;
+
+    // State of the buffer rendered by the last call.
+    struct mp_sw_buffer_state shown;
+};
+
+static bool rect_empty(struct mp_rect rc)
+{
+    return mp_rect_w(rc) <= 0 || mp_rect_h(rc) <= 0;
+}
+
+static void add_rect(struct mp_rect *rc, struct mp_rect add)
+{
+    if (rect_empty(add))
+        return;
+    if (rect_empty(*rc)) {
+        *rc = add;
+    } else {
+        mp_rect_union(rc, &add);
+    }
+}
+
+static bool rect_contains(struct mp_rect outer, struct mp_rect inner)
+{
+    return rect_empty(inner) ||
+           (outer.x0 <= inner.x0 && outer.y0 <= inner.y0 &&
+            outer.x1 >= inner.x1 && outer.y1 >= inner.y1);
+}
+
+static struct mp_rect osd_bounds(struct sub_bitmap_list *list, int w, int h)
+{
+    struct mp_rect rc = {0};
+    for (int n = 0; n < list->num_items; n++) {
+        struct sub_bitmaps *sb = list->items[n];
+        for (int i = 0; i < sb->num_parts; i++) {
+            struct sub_bitmap *b = &sb->parts[i];
+            add_rect(&rc, (struct mp_rect){b->x, b->y, b->x + b->dw, b->y + b->dh});
+        }
+    }
+    if (!mp_rect_intersection(&rc, &(struct mp_rect){0, 0, w, h}))
+        rc = (struct mp_rect){0};
+    return rc;
+}
+
+static void copy_rect(struct mp_image *dst, struct mp_image *src,
+                      struct mp_rect rc)
+{
+    struct mp_image d = *dst, s = *src;
+    mp_image_crop_rc(&d, rc);
+    mp_image_crop_rc(&s, rc);
+    mp_image_copy(&d, &s);
+}
+
+// Clear the parts of rc outside of the video rect.
+static void clear_borders(struct mp_image *img, struct mp_rect rc,
+                          struct mp_rect dst)
+{
+    struct mp_rect clr[4];
+    struct mp_rect vid = rc;
+    if (!mp_rect_intersection(&vid, &dst)) {
+        if (!rect_empty(rc))
+            mp_image_clear_rc(img, rc);
+        return;
+    }
+    int cnt = mp_rect_subtract(&rc, &vid, clr);
+    for (int n = 0; n < cnt; n++)
+        mp_image_clear_rc(img, clr[n]);
+}
+
+static bool clean_has(struct mp_sw_render *r, uint64_t frame_id,
+                      struct mp_rect rc)
+{
+    return r->clean && r->clean_frame_id == frame_id &&
+           rect_contains(r->clean_rc, rc);
+}
+
+// Save the OSD-free video in rc (which must not contain OSD in img).
+static void save_clean(struct mp_sw_render *r, struct mp_image *img,
+                       uint64_t frame_id, struct mp_rect rc)
+{
+    if (!r->clean || r->clean->imgfmt != img->imgfmt ||
+        r->clean->w != img->w || r->clean->h != img->h)
+    {
+        talloc_free(r->clean);
+        r->clean = mp_image_alloc(img->imgfmt, img->w, img->h);
+        if (!r->clean)
+            return;
+        r->clean_rc = (struct mp_rect){0};
+    }
+    if (r->clean_frame_id != frame_id)
+        r->clean_rc = (struct mp_rect){0};
+    // Nothing under the previous area has been drawn over since then.
+    add_rect(&r->clean_rc, rc);
+    copy_rect(r->clean, img, r->clean_rc);
+    r->clean_frame_id = frame_id;
+}
+
+static void destroy(void *ptr)
+{
+    struct mp_sw_render *r = ptr;
+    talloc_free(r->clean);
+}
+
+struct mp_sw_render *mp_sw_render_create(struct vo *vo,
+                                         struct mp_sws_context *sws)
+{
+    struct mp_sw_render *r = talloc_zero(vo, struct mp_sw_render);
+    talloc_set_destructor(r, destroy);
+    r->vo = vo;
+    r->sws = sws;
+    r->osd_cache = mp_draw_sub_alloc(r, vo->global);
+    r->gen = 1;
+    return r;
+}
+
+void mp_sw_render_reset(struct mp_sw_render *r)
+{
+    r->gen += 1;
+    r->clean_rc = (struct mp_rect){0};
+    r->shown = (struct mp_sw_buffer_state){0};
+    mp_draw_sub_set_threads(r->osd_cache, r->sws->threads);
+}
+
+struct mp_rect mp_sw_render_frame(struct mp_sw_render *r,
+                                  struct mp_sw_buffer_state *st,
+                                  struct mp_image *img, struct mp_image *src,
+                                  uint64_t frame_id, struct mp_rect dst,
+                                  struct mp_osd_res osd, double pts)
+{
+    struct mp_rect full = {0, 0, img->w, img->h};
+    if (st->gen != r->gen)
+        *st = (struct mp_sw_buffer_state){.gen = r->gen};
+
+    bool have_frame = !!src;
+    if (!have_frame)
+        frame_id = 0;
+
+    struct sub_bitmap_list *list =
+        osd_render(r->vo->osd, osd, pts, 0, mp_draw_sub_formats);
+    struct mp_rect osd_rc = osd_bounds(list, img->w, img->h);
+    struct mp_rect osd_vid = osd_rc;
+    if (!mp_rect_intersection(&osd_vid, &dst))
+        osd_vid = (struct mp_rect){0};
+
+    bool video_ok = st->valid && st->have_frame == have_frame &&
+                    st->frame_id == frame_id;
+    bool osd_ok = st->valid && st->osd_change_id == list->change_id &&
+                  mp_rect_equals(&st->osd_rc, &osd_rc);
+
+    if (!st->valid) {
+        mp_image_clear_rc_inv(img, dst);
+    } else if (!video_ok || !osd_ok) {
+        // Remove the old OSD. Within the video rect, this is not needed if the
+        // video is replaced anyway.
+        clear_borders(img, st->osd_rc, dst);
+        struct mp_rect rc = st->osd_rc;
+        if (video_ok && mp_rect_intersection(&rc, &dst)) {
+            if (!have_frame) {
+                mp_image_clear_rc(img, rc);
+            } else if (clean_has(r, frame_id, rc)) {
+                copy_rect(img, r->clean, rc);
+            } else {
+                video_ok = false;
+            }
+        }
+    }
+
+    if (!video_ok) {
+        if (!have_frame) {
+            mp_image_clear_rc(img, dst);
+        } else if (clean_has(r, frame_id, dst)) {
+            copy_rect(img, r->clean, dst);
+        } else {
+            struct mp_image dst_img = *img;
+            mp_image_crop_rc(&dst_img, dst);
+            mp_sws_scale(r->sws, &dst_img, src);
+        }
+    }
+
+    if ((!video_ok || !osd_ok) && list->num_items) {
+        if (have_frame && !clean_has(r, frame_id, osd_vid))
+            save_clean(r, img, frame_id, osd_vid);
+        mp_draw_sub_bitmaps(r->osd_cache, img, list);
+    }
+
+    // Compare with what the previous call left on screen.
+    struct mp_sw_buffer_state *prev = &r->shown;
+    struct mp_rect damage = {0};
+    if (!prev->valid || prev->gen != r->gen) {
+        damage = full;
+    } else {
+        if (prev->have_frame != have_frame || prev->frame_id != frame_id)
+            add_rect(&damage, dst);
+        if (prev->osd_change_id != list->change_id ||
+            !mp_rect_equals(&prev->osd_rc, &osd_rc))
+        {
+            add_rect(&damage, prev->osd_rc);
+            add_rect(&damage, osd_rc);
+        }
+    }
+
+    st->valid = true;
+    st->have_frame = have_frame;
+    st->frame_id = frame_id;
+    st->osd_change_id = list->change_id;
+    st->osd_rc = osd_rc;
+    r->shown = *st;
+
+    talloc_free(list);
+    return damage;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/common.h"
+
+struct mp_image;
+struct mp_osd_res;
+struct mp_sws_context;
+struct vo;
+
+// Damage tracking for VOs which convert video into CPU-visible buffers (shm
+// and similar), and hand these to a display server.
+//
+// The VO keeps one mp_sw_buffer_state per buffer. Regions of a buffer which
+// already contain the right content are not touched again: letterbox borders
+// are cleared once, the video is only converted when the frame changes, and
+// if only the OSD changes, just the area under the old OSD is restored from a
+// saved copy of the converted video.
+
+struct mp_sw_buffer_state {
+    uint64_t gen;           // mp_sw_render generation the state belongs to
+    bool valid;             // false: buffer contents are undefined
+    bool have_frame;        // video rect contains frame_id (or black if not)
+    uint64_t frame_id;
+    int64_t osd_change_id;
+    struct mp_rect osd_rc;  // OSD blended into the buffer
+};
+
+struct mp_sw_render;
+
+struct mp_sw_render *mp_sw_render_create(struct vo *vo,
+                                         struct mp_sws_context *sws);
+
+// Invalidate all buffer contents. Call this whenever the buffers, the video
+// rect, the OSD resolution or the sws parameters change, or the display server
+// lost the previously presented content (expose events and similar).
+void mp_sw_render_reset(struct mp_sw_render *r);
+
+// Render the video frame src (NULL if there is none) and the OSD into img.
+// src must already be cropped to the source rect, and is scaled to the dst rect
+// in img with r's sws context. frame_id identifies src (vo_frame.frame_id).
+// Returns the region of img which differs from what the previous call rendered
+// (empty if nothing changed); it's assumed that every call is presented.
+struct mp_rect mp_sw_render_frame(struct mp_sw_render *r,
+                                  struct mp_sw_buffer_state *st,
+                                  struct mp_image *img, struct mp_image *src,
+                                  uint64_t frame_id, struct mp_rect dst,
+                                  struct mp_osd_res osd, double pts);
@@ -157,8 +157,17 @@ struct vo_internal {
     bool expecting_vsync;
     int64_t num_successive_vsyncs;
 
+    // With real presentation feedback, base_vsync is driven by a PLL, which
+    // tracks the phase and rate of the actual present timestamps.
+    bool present_feedback;          // last swap had real feedback
+    double pll_freq;                // correction added to vsync_interval
+    double phase_error;             // smoothed actual - predicted present time
+    bool have_phase_error;
+
     int64_t flip_queue_offset; // queue flip events at most this much in advance
     int64_t timing_offset;     // same (but from options; not VO configured)
+    bool late_latching;        // from options
+    double render_time;        // average time from draw_frame to flip done
 
     int64_t delayed_count;
     int64_t drop_count;
@@ -172,11 +181,18 @@ struct vo_internal {
     struct vo_frame *frame_queued;  // should be drawn next
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
+    int64_t frame_queued_time;      // when frame_queued was queued
+    int64_t current_frame_time;     // same for current_frame
+
+    // Ring buffer of the last rendered frames
+    struct vo_frame_timing timings[VO_FRAME_TIMINGS];
+    uint64_t num_timings;           // total number of entries ever added
 
     double display_fps;
     double reported_display_fps;
 
     struct stats_ctx *stats;
+    struct stats_handle *stats_draw, *stats_flip, *stats_iterations;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -232,6 +248,7 @@ static void read_opts(struct vo *vo)
 
     mp_mutex_lock(&in->lock);
     in->timing_offset = (uint64_t)(MP_TIME_S_TO_NS(vo->opts->timing_offset));
+    in->late_latching = vo->opts->late_latching;
     mp_mutex_unlock(&in->lock);
 }
 
@@ -297,6 +314,9 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
         .estimated_vsync_jitter = -1,
         .stats = stats_ctx_create(vo, global, "vo"),
     };
+    vo->in->stats_draw = stats_handle_create(vo->in->stats, "video-draw");
+    vo->in->stats_flip = stats_handle_create(vo->in->stats, "video-flip");
+    vo->in->stats_iterations = stats_handle_create(vo->in->stats, "iterations");
     mp_dispatch_set_wakeup_fn(vo->in->dispatch, dispatch_wakeup_cb, vo);
     mp_mutex_init(&vo->in->lock);
     mp_cond_init(&vo->in->wakeup);
@@ -390,6 +410,16 @@ static void reset_vsync_timings(struct vo *vo)
     in->base_vsync = 0;
     in->expecting_vsync = false;
     in->num_successive_vsyncs = 0;
+    in->have_phase_error = false;
+    in->phase_error = 0;
+}
+
+// Vsync interval used for predicting present times: corrected by the PLL if
+// there is presentation feedback.
+static double get_vsync_interval(struct vo_internal *in)
+{
+    return in->present_feedback ? in->vsync_interval + in->pll_freq
+                                : in->vsync_interval;
 }
 
 static double vsync_stddef(struct vo *vo, double ref_vsync)
@@ -406,6 +436,13 @@ static double vsync_stddef(struct vo *vo, double ref_vsync)
 #define MAX_VSYNC_SAMPLES 1000
 #define DELAY_VSYNC_SAMPLES 10
 
+// Gains of the vsync PLL. These are low enough that timestamp jitter is
+// filtered, while a phase offset is corrected within a few dozen vsyncs.
+#define PLL_KP 0.1
+#define PLL_KI 0.005
+// Maximum relative rate correction.
+#define PLL_MAX_FREQ 0.01
+
 // Check if we should switch to measured average display FPS if it seems
 // "better" then the system-reported one. (Note that small differences are
 // handled as drift instead.)
@@ -438,8 +475,13 @@ static void check_estimated_display_fps(struct vo *vo)
                        1e9 / in->nominal_vsync_interval);
         }
     }
+    double prev_interval = in->vsync_interval;
     in->vsync_interval = use_estimated ? in->estimated_vsync_interval
                                        : in->nominal_vsync_interval;
+    // Keep the corrected rate the PLL has locked to.
+    in->pll_freq -= in->vsync_interval - prev_interval;
+    in->pll_freq = MPCLAMP(in->pll_freq, -in->vsync_interval * PLL_MAX_FREQ,
+                           in->vsync_interval * PLL_MAX_FREQ);
 }
 
 // Attempt to detect vsyncs delayed/skipped by the driver. This tries to deal
@@ -473,6 +515,36 @@ static void vsync_skip_detection(struct vo *vo)
         in->base_vsync += desync / 10;  // smooth out drift
 }
 
+// Correct base_vsync with the measured present time of the last frame. Unlike
+// vsync_skip_detection(), each sample is used directly: a phase error nudges
+// the prediction (proportional term), and a persistent error adjusts the
+// rate (integral term). Only errors too large to be jitter count as delays,
+// which avoids resetting the phase (and subsequent drop/repeat bursts) on
+// displays with irregular timing such as VRR.
+static void vsync_pll_update(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+
+    double err = in->prev_vsync - in->base_vsync;
+    if (fabs(err) >= in->vsync_interval * 3 / 4) {
+        in->base_vsync = in->prev_vsync;
+        in->delayed_count += 1;
+        in->drop_point = 0;
+        MP_STATS(vo, "vo-delayed");
+        return;
+    }
+
+    in->base_vsync += PLL_KP * err;
+    in->pll_freq += PLL_KI * err;
+    in->pll_freq = MPCLAMP(in->pll_freq, -in->vsync_interval * PLL_MAX_FREQ,
+                           in->vsync_interval * PLL_MAX_FREQ);
+
+    in->phase_error = in->have_phase_error ?
+                      in->phase_error * 0.9 + err * 0.1 : err;
+    in->have_phase_error = true;
+    MP_STATS(vo, "value %f phase-error", MP_TIME_NS_TO_S(err));
+}
+
 // Always called locked.
 static void update_vsync_timing_after_swap(struct vo *vo,
                                            struct vo_vsync_info *vsync)
@@ -510,7 +582,7 @@ static void update_vsync_timing_after_swap(struct vo *vo,
     in->drop_point = MPMIN(in->drop_point + 1, in->num_vsync_samples);
     in->num_total_vsync_samples += 1;
     if (in->base_vsync) {
-        in->base_vsync += in->vsync_interval;
+        in->base_vsync += get_vsync_interval(in);
     } else {
         in->base_vsync = vsync_time;
     }
@@ -525,7 +597,12 @@ static void update_vsync_timing_after_swap(struct vo *vo,
         vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
 
     check_estimated_display_fps(vo);
-    vsync_skip_detection(vo);
+    if (in->present_feedback) {
+        vsync_pll_update(vo);
+    } else {
+        in->pll_freq = 0;
+        vsync_skip_detection(vo);
+    }
 
     MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
     MP_STATS(vo, "value %f vsync-diff", MP_TIME_NS_TO_S(in->vsync_samples[0]));
@@ -556,6 +633,7 @@ static void update_display_fps(struct vo *vo)
     if (in->display_fps != display_fps) {
         in->nominal_vsync_interval =  display_fps > 0 ? 1e9 / display_fps : 0;
         in->vsync_interval = MPMAX(in->nominal_vsync_interval, 1);
+        in->pll_freq = 0;
         in->display_fps = display_fps;
 
         MP_VERBOSE(vo, "Assuming %f FPS for display sync.\n", display_fps);
@@ -774,7 +852,7 @@ static int64_t get_display_synced_frame_end(struct vo *vo)
     if (in->base_vsync && in->vsync_interval > 1 && in->current_frame) {
         res = in->base_vsync;
         int extra = !!in->rendering;
-        res += (in->current_frame->num_vsyncs + extra) * in->vsync_interval;
+        res += (in->current_frame->num_vsyncs + extra) * get_vsync_interval(in);
         if (!in->current_frame->display_synced)
             res = 0;
     }
@@ -825,6 +903,14 @@ void vo_request_wakeup_on_done(struct vo *vo)
     mp_mutex_unlock(&vo->in->lock);
 }
 
+// With late latching, a queued frame which the VO has not picked up yet can be
+// replaced by a newer one.
+static bool can_replace_queued(struct vo_internal *in)
+{
+    return in->late_latching && in->frame_queued &&
+           !in->frame_queued->display_synced;
+}
+
 // Whether vo_queue_frame() can be called. If the VO is not ready yet, the
 // function will return false, and the VO will call the wakeup callback once
 // it's ready.
@@ -837,7 +923,8 @@ bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
 {
     struct vo_internal *in = vo->in;
     mp_mutex_lock(&in->lock);
-    bool r = vo->config_ok && !in->wait_on_vo && !in->frame_queued &&
+    bool r = vo->config_ok && !in->wait_on_vo &&
+             (!in->frame_queued || can_replace_queued(in)) &&
              (!in->current_frame || in->current_frame->num_vsyncs < 1);
     if (r && next_pts >= 0) {
         // Don't show the frame too early - it would basically freeze the
@@ -877,11 +964,18 @@ void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct vo_internal *in = vo->in;
     mp_mutex_lock(&in->lock);
-    mp_assert(vo->config_ok && !in->frame_queued &&
+    mp_assert(vo->config_ok && (!in->frame_queued || can_replace_queued(in)) &&
            (!in->current_frame || in->current_frame->num_vsyncs < 1));
+    if (in->frame_queued) {
+        // Stale; it was never rendered.
+        talloc_free(in->frame_queued);
+        in->drop_count += 1;
+        MP_STATS(vo, "drop-vo");
+    }
     in->hasframe = true;
     frame->frame_id = ++(in->current_frame_id);
     in->frame_queued = frame;
+    in->frame_queued_time = mp_time_ns();
     in->wakeup_pts = frame->display_synced
                    ? 0 : frame->pts + MPMAX(frame->duration, 0);
     wakeup_locked(vo);
@@ -922,6 +1016,25 @@ static void wait_until(struct vo *vo, int64_t target)
     mp_mutex_unlock(&in->lock);
 }
 
+// Time at which the newest queued frame should be picked up, so that rendering
+// it finishes just before the next vsync. Returns 0 if this is unknown.
+static int64_t get_late_latch_time(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+
+    if (!can_replace_queued(in) || in->prev_vsync <= 0 ||
+        in->vsync_interval <= 1 || in->paused)
+        return 0;
+
+    double interval = get_vsync_interval(in);
+    // Some safety margin for scheduling latencies.
+    double budget = in->render_time * 1.5 + MP_TIME_MS_TO_NS(1);
+    int64_t now = mp_time_ns();
+    double n = ceil((now + budget - in->prev_vsync) / interval);
+    int64_t latch = in->prev_vsync + MPMAX(n, 1) * interval - budget;
+    return MPMIN(latch, now + (int64_t)interval);
+}
+
 static bool render_frame(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -932,9 +1045,19 @@ static bool render_frame(struct vo *vo)
 
     mp_mutex_lock(&in->lock);
 
+    // Wait until just before the next vsync, while the core can still replace
+    // the queued frame with a newer one.
+    int64_t latch = get_late_latch_time(vo);
+    if (latch > mp_time_ns()) {
+        mp_mutex_unlock(&in->lock);
+        wait_until(vo, latch);
+        mp_mutex_lock(&in->lock);
+    }
+
     if (in->frame_queued) {
         talloc_free(in->current_frame);
         in->current_frame = in->frame_queued;
+        in->current_frame_time = in->frame_queued_time;
         in->frame_queued = NULL;
     } else if (in->paused || !in->current_frame || !in->hasframe ||
                (in->current_frame->display_synced && in->current_frame->num_vsyncs < 1) ||
@@ -1013,18 +1136,31 @@ static bool render_frame(struct vo *vo)
         if (can_queue)
             wakeup_core(vo);
 
-        stats_time_start(in->stats, "video-draw");
+        struct vo_frame_timing timing = {
+            .frame_id = frame->frame_id,
+            .target = frame->display_synced ? 0 : pts,
+            .queued = in->current_frame_time,
+            .redraw = frame->repeat,
+            .display_synced = frame->display_synced,
+            .render_start = mp_time_ns(),
+        };
+
+        stats_handle_time_start(in->stats_draw);
 
         in->visible = vo->driver->draw_frame(vo, frame);
 
-        stats_time_end(in->stats, "video-draw");
+        stats_handle_time_end(in->stats_draw);
+
+        timing.render_end = mp_time_ns();
 
         wait_until(vo, target);
 
-        stats_time_start(in->stats, "video-flip");
+        stats_handle_time_start(in->stats_flip);
 
         vo->driver->flip_page(vo);
 
+        timing.flip = mp_time_ns();
+
         struct vo_vsync_info vsync = {
             .last_queue_display_time = -1,
             .skipped_vsyncs = -1,
@@ -1033,14 +1169,24 @@ static bool render_frame(struct vo *vo)
             vo->driver->get_vsync(vo, &vsync);
 
         // Make up some crap if presentation feedback is missing.
-        if (vsync.last_queue_display_time <= 0)
+        bool present_feedback = vsync.last_queue_display_time > 0;
+        if (!present_feedback)
             vsync.last_queue_display_time = mp_time_ns();
 
-        stats_time_end(in->stats, "video-flip");
+        stats_handle_time_end(in->stats_flip);
 
         mp_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
+        in->present_feedback = present_feedback;
+
+        double render_time = timing.flip - timing.render_start;
+        in->render_time = in->render_time > 0 ?
+                          in->render_time * 0.9 + render_time * 0.1 : render_time;
+
+        timing.id = in->num_timings;
+        timing.display = vsync.last_queue_display_time;
+        in->timings[in->num_timings++ % VO_FRAME_TIMINGS] = timing;
 
         update_vsync_timing_after_swap(vo, &vsync);
     }
@@ -1149,7 +1295,7 @@ static MP_THREAD_VOID vo_thread(void *ptr)
         mp_dispatch_queue_process(vo->in->dispatch, 0);
         if (in->terminate)
             break;
-        stats_event(in->stats, "iterations");
+        stats_handle_event(in->stats_iterations);
         vo->driver->control(vo, VOCTRL_CHECK_EVENTS, NULL);
         bool working = render_frame(vo);
         int64_t now = mp_time_ns();
@@ -1363,7 +1509,8 @@ double vo_get_vsync_interval(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
     mp_mutex_lock(&in->lock);
-    double res = vo->in->vsync_interval > 1 ? vo->in->vsync_interval : -1;
+    double interval = get_vsync_interval(in);
+    double res = interval > 1 ? interval : -1;
     mp_mutex_unlock(&in->lock);
     return res;
 }
@@ -1386,6 +1533,36 @@ double vo_get_estimated_vsync_jitter(struct vo *vo)
     return res;
 }
 
+// Smoothed difference between actual and predicted present times in seconds,
+// as measured by the vsync PLL. Returns false if no presentation feedback is
+// available.
+bool vo_get_vsync_phase_error(struct vo *vo, double *out_error)
+{
+    struct vo_internal *in = vo->in;
+    mp_mutex_lock(&in->lock);
+    bool ok = in->present_feedback && in->have_phase_error;
+    if (ok)
+        *out_error = MP_TIME_NS_TO_S(in->phase_error);
+    mp_mutex_unlock(&in->lock);
+    return ok;
+}
+
+// Copy the timings of the last rendered frames with an id >= since_id to out,
+// oldest first. Returns the number of entries written (at most max).
+int vo_get_frame_timings(struct vo *vo, uint64_t since_id,
+                         struct vo_frame_timing *out, int max)
+{
+    struct vo_internal *in = vo->in;
+    mp_mutex_lock(&in->lock);
+    uint64_t first = in->num_timings - MPMIN(in->num_timings, VO_FRAME_TIMINGS);
+    first = MPMAX(first, since_id);
+    int num = 0;
+    for (uint64_t id = first; id < in->num_timings && num < max; id++)
+        out[num++] = in->timings[id % VO_FRAME_TIMINGS];
+    mp_mutex_unlock(&in->lock);
+    return num;
+}
+
 // Get the time in seconds at after which the currently rendering frame will
 // end. Returns positive values if the frame is yet to be finished, negative
 // values if it already finished.
@@ -1513,6 +1690,95 @@ struct vo_frame *vo_frame_ref(struct vo_frame *frame)
     return new;
 }
 
+struct vo_screenshot_async {
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool done, ok;
+};
+
+static void destroy_screenshot_async(void *ptr)
+{
+    struct vo_screenshot_async *a = ptr;
+    mp_cond_destroy(&a->wakeup);
+    mp_mutex_destroy(&a->lock);
+}
+
+// For VOs which read back VOCTRL_SCREENSHOT results asynchronously. The VO
+// must call vo_screenshot_async_done() exactly once, from any thread, and at
+// the latest when handling VOCTRL_SCREENSHOT_FINISH.
+struct vo_screenshot_async *vo_screenshot_async_create(void)
+{
+    struct vo_screenshot_async *a = talloc_zero(NULL, struct vo_screenshot_async);
+    talloc_set_destructor(a, destroy_screenshot_async);
+    mp_mutex_init(&a->lock);
+    mp_cond_init(&a->wakeup);
+    return a;
+}
+
+void vo_screenshot_async_done(struct vo_screenshot_async *a, bool ok)
+{
+    mp_mutex_lock(&a->lock);
+    a->done = true;
+    a->ok = ok;
+    mp_cond_broadcast(&a->wakeup);
+    mp_mutex_unlock(&a->lock);
+}
+
+// Wait until a VOCTRL_SCREENSHOT result is complete. On failure, args->res is
+// freed and set to NULL.
+void vo_screenshot_wait(struct vo *vo, struct voctrl_screenshot *args)
+{
+    struct vo_screenshot_async *a = args->async;
+    if (!a)
+        return;
+
+    // Normally, the VO completes the readback while it renders the next
+    // frames. If it's idle (e.g. paused), tell it to finish explicitly.
+    int64_t timeout = mp_time_ns() + MP_TIME_MS_TO_NS(50);
+    bool finish_sent = false;
+    mp_mutex_lock(&a->lock);
+    while (!a->done) {
+        if (finish_sent) {
+            mp_cond_wait(&a->wakeup, &a->lock);
+        } else if (mp_cond_timedwait_until(&a->wakeup, &a->lock, timeout)) {
+            mp_mutex_unlock(&a->lock);
+            vo_control(vo, VOCTRL_SCREENSHOT_FINISH, NULL);
+            mp_mutex_lock(&a->lock);
+            finish_sent = true;
+        }
+    }
+    bool ok = a->ok;
+    mp_mutex_unlock(&a->lock);
+
+    talloc_free(a);
+    args->async = NULL;
+    if (!ok)
+        TA_FREEP(&args->res);
+}
+
+// Shrink the target rect and OSD size of a screenshot to args->max_w/max_h,
+// keeping the aspect ratio.
+void vo_screenshot_fit(struct voctrl_screenshot *args, struct mp_rect *dst,
+                       struct mp_osd_res *osd)
+{
+    double f = 1.0;
+    if (args->max_w > 0 && osd->w > args->max_w)
+        f = MPMIN(f, args->max_w / (double)osd->w);
+    if (args->max_h > 0 && osd->h > args->max_h)
+        f = MPMIN(f, args->max_h / (double)osd->h);
+    if (f >= 1.0)
+        return;
+
+    *dst = (struct mp_rect){lrint(dst->x0 * f), lrint(dst->y0 * f),
+                            lrint(dst->x1 * f), lrint(dst->y1 * f)};
+    osd->w = MPMAX(lrint(osd->w * f), 1);
+    osd->h = MPMAX(lrint(osd->h * f), 1);
+    osd->ml = lrint(osd->ml * f);
+    osd->mr = lrint(osd->mr * f);
+    osd->mt = lrint(osd->mt * f);
+    osd->mb = lrint(osd->mb * f);
+}
+
 /*
  * lookup an integer in a table, table must have 0 as the last key
  * param: key key to search for
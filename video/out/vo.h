@@ -110,6 +110,8 @@ enum mp_voctrl {
     // A normal screenshot - VOs can react to this if vo_get_current_frame() is
     // not sufficient.
     VOCTRL_SCREENSHOT,                  // struct voctrl_screenshot*
+    // Complete pending asynchronous screenshot readbacks (if any) now.
+    VOCTRL_SCREENSHOT_FINISH,
 
     VOCTRL_UPDATE_RENDER_OPTS,
 
@@ -133,6 +135,9 @@ enum mp_voctrl {
     // Clipboard
     VOCTRL_GET_CLIPBOARD,               // struct voctrl_clipboard*
     VOCTRL_SET_CLIPBOARD,
+
+    // Free caches and textures that can be recreated.
+    VOCTRL_TRIM_MEMORY,
 };
 
 // Helper to expose what kind of content is currently playing to the VO.
@@ -181,7 +186,11 @@ struct voctrl_performance_data {
 
 struct voctrl_screenshot {
     bool scaled, subs, osd, high_bit_depth, native_csp;
+    int max_w, max_h;   // if >0, render at a smaller size fitting into this
     struct mp_image *res;
+    // If set by the VO, res is still being read back from the GPU, and must
+    // not be accessed before vo_screenshot_wait() returns.
+    struct vo_screenshot_async *async;
 };
 
 struct voctrl_clipboard {
@@ -228,6 +237,22 @@ struct vo_extra {
     void *wakeup_ctx;
 };
 
+// Timestamps of a rendered frame, in mp_time_ns() units. 0 if unknown.
+struct vo_frame_timing {
+    uint64_t id;            // increases by 1 for each entry
+    uint64_t frame_id;      // vo_frame.frame_id
+    int64_t target;         // time at which the frame should be displayed
+    int64_t queued;         // vo_queue_frame() was called
+    int64_t render_start;   // draw_frame() was called
+    int64_t render_end;     // draw_frame() returned
+    int64_t flip;           // flip_page() returned
+    int64_t display;        // time the frame is (estimated to be) displayed
+    bool redraw;            // frame was drawn before
+    bool display_synced;
+};
+
+#define VO_FRAME_TIMINGS 128
+
 struct vo_frame {
     // If > 0, realtime when frame should be shown, in mp_time_ns() units.
     // If 0, present immediately.
@@ -554,6 +579,9 @@ int vo_get_num_req_frames(struct vo *vo);
 double vo_get_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_jitter(struct vo *vo);
+bool vo_get_vsync_phase_error(struct vo *vo, double *out_error);
+int vo_get_frame_timings(struct vo *vo, uint64_t since_id,
+                         struct vo_frame_timing *out, int max);
 double vo_get_display_fps(struct vo *vo);
 void * vo_get_display_swapchain(struct vo *vo);
 double vo_get_delay(struct vo *vo);
@@ -577,6 +605,12 @@ void vo_get_src_dst_rects(struct vo *vo, struct mp_rect *out_src,
 
 struct vo_frame *vo_frame_ref(struct vo_frame *frame);
 
+struct vo_screenshot_async *vo_screenshot_async_create(void);
+void vo_screenshot_async_done(struct vo_screenshot_async *a, bool ok);
+void vo_screenshot_wait(struct vo *vo, struct voctrl_screenshot *args);
+void vo_screenshot_fit(struct voctrl_screenshot *args, struct mp_rect *dst,
+                       struct mp_osd_res *osd);
+
 struct mp_image_params vo_get_current_params(struct vo *vo);
 struct mp_image_params vo_get_target_params(struct vo *vo);
 
@@ -24,13 +24,17 @@
 #include <unistd.h>
 
 #include <drm_fourcc.h>
+#include <libavutil/hwcontext.h>
 
 #include "common/msg.h"
 #include "drm_atomic.h"
 #include "drm_common.h"
+#include "drm_prime.h"
 #include "osdep/timer.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/fmt-conversion.h"
+#include "video/hwdec.h"
 #include "video/mp_image.h"
 #include "video/out/present_sync.h"
 #include "video/sws_utils.h"
@@ -49,6 +53,9 @@
 
 struct drm_frame {
     struct framebuffer *fb;
+    // Only in overlay mode: the hwdec frame scanned out on the video plane.
+    struct mp_image *image;
+    struct drm_prime_framebuffer video_fb;
 };
 
 struct priv {
@@ -66,9 +73,18 @@ struct priv {
     struct mp_osd_res osd;
     struct mp_sws_context *sws;
 
-    struct framebuffer **bufs;
+    struct framebuffer **bufs;      // sw_bufs or osd_bufs
+    struct framebuffer **sw_bufs;
     int front_buf;
     int buf_count;
+
+    // DRM-PRIME frames are put on the drmprime video plane as they are, and
+    // only the OSD is drawn (into osd_bufs, on the draw plane).
+    bool overlay;
+    struct mp_hwdec_ctx hwctx;
+    struct drm_prime_handle_refs handle_refs;
+    struct framebuffer **osd_bufs;
+    struct mp_draw_sub_cache *osd_cache;
 };
 
 static void destroy_framebuffer(int fd, struct framebuffer *fb)
@@ -90,34 +106,11 @@ static void destroy_framebuffer(int fd, struct framebuffer *fb)
     }
 }
 
-static struct framebuffer *setup_framebuffer(struct vo *vo)
+static void select_format(struct vo *vo)
 {
     struct priv *p = vo->priv;
     struct vo_drm_state *drm = vo->drm;
 
-    struct framebuffer *fb = talloc_zero(drm, struct framebuffer);
-    fb->width = drm->mode.mode.hdisplay;
-    fb->height = drm->mode.mode.vdisplay;
-    fb->fd = drm->fd;
-    fb->handle = 0;
-
-    // create dumb buffer
-    struct drm_mode_create_dumb creq = {
-        .width = fb->width,
-        .height = fb->height,
-        .bpp = BITS_PER_PIXEL,
-    };
-
-    if (drmIoctl(drm->fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
-        MP_ERR(vo, "Cannot create dumb buffer: %s\n", mp_strerror(errno));
-        goto err;
-    }
-
-    fb->stride = creq.pitch;
-    fb->size = creq.size;
-    fb->handle = creq.handle;
-
-    // select format
     switch (drm->opts->drm_format) {
     case DRM_OPTS_FORMAT_XRGB2101010:
         p->drm_format = DRM_FORMAT_XRGB2101010;
@@ -144,10 +137,37 @@ static struct framebuffer *setup_framebuffer(struct vo *vo)
         p->imgfmt = IMGFMT_XRGB8888;
         break;
     }
+}
+
+static struct framebuffer *setup_framebuffer(struct vo *vo, uint32_t drm_format)
+{
+    struct vo_drm_state *drm = vo->drm;
+
+    struct framebuffer *fb = talloc_zero(drm, struct framebuffer);
+    fb->width = drm->mode.mode.hdisplay;
+    fb->height = drm->mode.mode.vdisplay;
+    fb->fd = drm->fd;
+    fb->handle = 0;
+
+    // create dumb buffer
+    struct drm_mode_create_dumb creq = {
+        .width = fb->width,
+        .height = fb->height,
+        .bpp = BITS_PER_PIXEL,
+    };
+
+    if (drmIoctl(drm->fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+        MP_ERR(vo, "Cannot create dumb buffer: %s\n", mp_strerror(errno));
+        goto err;
+    }
+
+    fb->stride = creq.pitch;
+    fb->size = creq.size;
+    fb->handle = creq.handle;
 
     // create framebuffer object for the dumb-buffer
     int ret = drmModeAddFB2(fb->fd, fb->width, fb->height,
-                            p->drm_format,
+                            drm_format,
                             (uint32_t[4]){fb->handle, 0, 0, 0},
                             (uint32_t[4]){fb->stride, 0, 0, 0},
                             (uint32_t[4]){0, 0, 0, 0},
@@ -182,6 +202,42 @@ err:
     return NULL;
 }
 
+static void disable_video_plane(struct vo *vo)
+{
+    struct drm_atomic_context *ctx = vo->drm->atomic_context;
+
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request)
+        return;
+    drm_object_set_property(request, ctx->drmprime_video_plane, "FB_ID", 0);
+    drm_object_set_property(request, ctx->drmprime_video_plane, "CRTC_ID", 0);
+    if (drmModeAtomicCommit(ctx->fd, request, 0, NULL))
+        MP_WARN(vo, "Failed to disable video plane: %s\n", mp_strerror(errno));
+    drmModeAtomicFree(request);
+}
+
+static bool init_osd_bufs(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    if (p->osd_bufs)
+        return true;
+
+    // Premultiplied alpha, so the video plane shows through.
+    p->osd_bufs = talloc_zero_array(p, struct framebuffer *, p->buf_count);
+    for (int i = 0; i < p->buf_count; i++) {
+        p->osd_bufs[i] = setup_framebuffer(vo, DRM_FORMAT_ARGB8888);
+        if (!p->osd_bufs[i]) {
+            for (int n = 0; n < i; n++)
+                destroy_framebuffer(vo->drm->fd, p->osd_bufs[n]);
+            TA_FREEP(&p->osd_bufs);
+            return false;
+        }
+    }
+    p->osd_cache = mp_draw_sub_alloc(p, vo->global);
+    return true;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *p = vo->priv;
@@ -191,6 +247,33 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     vo->dheight = drm->fb->height;
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
+    bool overlay = params->imgfmt == IMGFMT_DRMPRIME;
+    if (p->overlay && !overlay)
+        disable_video_plane(vo);
+    p->overlay = overlay;
+
+    talloc_free(p->last_input);
+    p->last_input = NULL;
+
+    if (p->overlay) {
+        if (!init_osd_bufs(vo))
+            return -1;
+        p->bufs = p->osd_bufs;
+
+        // Planes are positioned in units of 2 pixels on some hardware.
+        p->dst.x0 = MP_ALIGN_DOWN(p->dst.x0, 2);
+        p->dst.y0 = MP_ALIGN_DOWN(p->dst.y0, 2);
+        p->dst.x1 = p->dst.x0 + MP_ALIGN_UP(mp_rect_w(p->dst), 2);
+        p->dst.y1 = p->dst.y0 + MP_ALIGN_UP(mp_rect_h(p->dst), 2);
+
+        mp_mutex_lock(&vo->params_mutex);
+        vo->target_params = NULL;
+        mp_mutex_unlock(&vo->params_mutex);
+        vo->want_redraw = true;
+        return 0;
+    }
+    p->bufs = p->sw_bufs;
+
     struct mp_imgfmt_desc fmt = mp_imgfmt_get_desc(p->imgfmt);
     p->dst.x0 = MP_ALIGN_DOWN(p->dst.x0, fmt.align_x);
     p->dst.y0 = MP_ALIGN_DOWN(p->dst.y0, fmt.align_y);
@@ -214,9 +297,6 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->cur_frame_cropped = mp_image_new_dummy_ref(p->cur_frame);
     mp_image_crop_rc(p->cur_frame_cropped, p->dst);
 
-    talloc_free(p->last_input);
-    p->last_input = NULL;
-
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
@@ -274,20 +354,63 @@ static void draw_image(struct vo *vo, mp_image_t *mpi, struct framebuffer *buf)
     }
 }
 
-static void enqueue_frame(struct vo *vo, struct framebuffer *fb)
+// Draw only the OSD into a transparent buffer for the draw plane.
+static void draw_osd(struct vo *vo, double pts, struct framebuffer *buf)
+{
+    struct priv *p = vo->priv;
+
+    struct sub_bitmap_list *list =
+        osd_render(vo->osd, p->osd, pts, 0, mp_draw_sub_formats);
+    struct mp_rect act_rc[1], mod_rc[1];
+    int num_act_rc = 0, num_mod_rc = 0;
+    struct mp_image *osd = mp_draw_sub_overlay(p->osd_cache, list,
+                                               act_rc, 1, &num_act_rc,
+                                               mod_rc, 1, &num_mod_rc);
+    if (osd) {
+        memcpy_pic(buf->map, osd->planes[0],
+                   MPMIN(osd->w, buf->width) * BYTES_PER_PIXEL,
+                   MPMIN(osd->h, buf->height), buf->stride, osd->stride[0]);
+    } else {
+        memset(buf->map, 0, buf->size);
+    }
+    talloc_free(list);
+}
+
+static void enqueue_frame(struct vo *vo, struct framebuffer *fb,
+                          struct mp_image *mpi)
 {
     struct priv *p = vo->priv;
+    struct vo_drm_state *drm = vo->drm;
 
-    struct drm_frame *new_frame = talloc(p, struct drm_frame);
+    struct drm_frame *new_frame = talloc_zero(p, struct drm_frame);
     new_frame->fb = fb;
+
+    if (p->overlay && mpi) {
+        AVDRMFrameDescriptor *desc = (AVDRMFrameDescriptor *)mpi->planes[0];
+        if (desc && !drm_prime_create_framebuffer(vo->log, drm->fd, desc,
+                                                  mpi->w, mpi->h,
+                                                  &new_frame->video_fb,
+                                                  &p->handle_refs))
+        {
+            new_frame->image = mp_image_new_ref(mpi);
+        }
+    }
+
     MP_TARRAY_APPEND(p, p->fb_queue, p->fb_queue_len, new_frame);
 }
 
 static void dequeue_frame(struct vo *vo)
 {
     struct priv *p = vo->priv;
+    struct drm_frame *frame = p->fb_queue[0];
 
-    talloc_free(p->fb_queue[0]);
+    // The frame is not on screen anymore, so its video buffer can be released.
+    if (frame->video_fb.fb_id) {
+        drm_prime_destroy_framebuffer(vo->log, vo->drm->fd, &frame->video_fb,
+                                      &p->handle_refs);
+    }
+    talloc_free(frame->image);
+    talloc_free(frame);
     MP_TARRAY_REMOVE_AT(p->fb_queue, p->fb_queue_len, 0);
 }
 
@@ -313,19 +436,77 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     const bool repeat = frame->repeat && !frame->redraw;
     if (!repeat) {
         fb = get_new_fb(vo);
-        draw_image(vo, mp_image_new_ref(frame->current), fb);
+        if (p->overlay) {
+            draw_osd(vo, frame->current ? frame->current->pts : 0, fb);
+        } else {
+            draw_image(vo, mp_image_new_ref(frame->current), fb);
+        }
     }
 
-    enqueue_frame(vo, fb);
+    enqueue_frame(vo, fb, frame->current);
 
 done:
     return VO_TRUE;
 }
 
+// Present the OSD buffer and the video frame in a single atomic commit.
+static void queue_flip_overlay(struct vo *vo, struct drm_frame *frame)
+{
+    struct priv *p = vo->priv;
+    struct vo_drm_state *drm = vo->drm;
+    struct drm_atomic_context *ctx = drm->atomic_context;
+    struct drm_object *plane = ctx->drmprime_video_plane;
+
+    drmModeAtomicReq *request = drmModeAtomicAlloc();
+    if (!request) {
+        drm->waiting_for_flip = false;
+        return;
+    }
+
+    drm_object_set_property(request, ctx->draw_plane, "FB_ID", frame->fb->id);
+    drm_object_set_property(request, ctx->draw_plane, "CRTC_ID", ctx->crtc->id);
+    drm_object_set_property(request, ctx->draw_plane, "ZPOS", 1);
+
+    if (frame->video_fb.fb_id) {
+        drm_object_set_property(request, plane, "FB_ID", frame->video_fb.fb_id);
+        drm_object_set_property(request, plane, "CRTC_ID", ctx->crtc->id);
+        drm_object_set_property(request, plane, "SRC_X", (uint64_t)p->src.x0 << 16);
+        drm_object_set_property(request, plane, "SRC_Y", (uint64_t)p->src.y0 << 16);
+        drm_object_set_property(request, plane, "SRC_W",
+                                (uint64_t)mp_rect_w(p->src) << 16);
+        drm_object_set_property(request, plane, "SRC_H",
+                                (uint64_t)mp_rect_h(p->src) << 16);
+        drm_object_set_property(request, plane, "CRTC_X", p->dst.x0);
+        drm_object_set_property(request, plane, "CRTC_Y", p->dst.y0);
+        drm_object_set_property(request, plane, "CRTC_W", mp_rect_w(p->dst));
+        drm_object_set_property(request, plane, "CRTC_H", mp_rect_h(p->dst));
+        drm_object_set_property(request, plane, "ZPOS", 0);
+    } else {
+        drm_object_set_property(request, plane, "FB_ID", 0);
+        drm_object_set_property(request, plane, "CRTC_ID", 0);
+    }
+
+    drm->fb = frame->fb;
+
+    int flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+    int ret = drmModeAtomicCommit(drm->fd, request, flags, drm);
+    if (ret)
+        MP_WARN(vo, "Failed to commit atomic request: %s\n", mp_strerror(errno));
+    drm->waiting_for_flip = !ret;
+
+    drmModeAtomicFree(request);
+}
+
 static void queue_flip(struct vo *vo, struct drm_frame *frame)
 {
+    struct priv *p = vo->priv;
     struct vo_drm_state *drm = vo->drm;
 
+    if (p->overlay) {
+        queue_flip_overlay(vo, frame);
+        return;
+    }
+
     drm->fb = frame->fb;
 
     int ret = drmModePageFlip(drm->fd, drm->crtc_id,
@@ -370,17 +551,64 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    vo_drm_uninit(vo);
-
+    // Video framebuffers must be released while the DRM fd is still open.
+    if (p->overlay && vo->drm)
+        disable_video_plane(vo);
     while (p->fb_queue_len > 0) {
         swapchain_step(vo);
     }
 
+    if (vo->hwdec_devs) {
+        hwdec_devices_remove(vo->hwdec_devs, &p->hwctx);
+        hwdec_devices_destroy(vo->hwdec_devs);
+        vo->hwdec_devs = NULL;
+    }
+    av_buffer_unref(&p->hwctx.av_device_ref);
+
+    vo_drm_uninit(vo);
+
     talloc_free(p->last_input);
     talloc_free(p->cur_frame);
     talloc_free(p->cur_frame_cropped);
 }
 
+// Provide a DRM hwdec device, so DRM-PRIME frames from the decoder can be
+// scanned out directly on the drmprime video plane.
+static void init_hwdec(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    struct vo_drm_state *drm = vo->drm;
+
+    if (!drm->atomic_context->drmprime_video_plane) {
+        MP_VERBOSE(vo, "No drmprime video plane, hwdec overlay disabled.\n");
+        return;
+    }
+
+    uint64_t has_prime = 0;
+    if (drmGetCap(drm->fd, DRM_CAP_PRIME, &has_prime) < 0 || !has_prime) {
+        MP_VERBOSE(vo, "Card does not support prime handles.\n");
+        return;
+    }
+
+    p->hwctx = (struct mp_hwdec_ctx) {
+        .driver_name = "drm",
+        .hw_imgfmt = IMGFMT_DRMPRIME,
+    };
+
+    char *device = drmGetDeviceNameFromFd2(drm->fd);
+    int ret = av_hwdevice_ctx_create(&p->hwctx.av_device_ref,
+                                     AV_HWDEVICE_TYPE_DRM, device, NULL, 0);
+    free(device);
+    if (ret < 0) {
+        MP_VERBOSE(vo, "Failed to create hwdevice_ctx: %s\n", av_err2str(ret));
+        return;
+    }
+
+    drm_prime_init_handle_ref_count(p, &p->handle_refs);
+    vo->hwdec_devs = hwdec_devices_create();
+    hwdec_devices_add(vo->hwdec_devs, &p->hwctx);
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -390,11 +618,13 @@ static int preinit(struct vo *vo)
 
     struct vo_drm_state *drm = vo->drm;
     p->buf_count = vo->opts->swapchain_depth + 1;
-    p->bufs = talloc_zero_array(p, struct framebuffer *, p->buf_count);
+    p->sw_bufs = talloc_zero_array(p, struct framebuffer *, p->buf_count);
+    p->bufs = p->sw_bufs;
 
+    select_format(vo);
     p->front_buf = 0;
     for (int i = 0; i < p->buf_count; i++) {
-        p->bufs[i] = setup_framebuffer(vo);
+        p->bufs[i] = setup_framebuffer(vo, p->drm_format);
         if (!p->bufs[i])
             goto err;
     }
@@ -410,6 +640,7 @@ static int preinit(struct vo *vo)
     }
 
     vo_drm_set_monitor_par(vo);
+    init_hwdec(vo);
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
@@ -423,6 +654,8 @@ err:
 static int query_format(struct vo *vo, int format)
 {
     struct priv *p = vo->priv;
+    if (format == IMGFMT_DRMPRIME)
+        return !!p->hwctx.av_device_ref;
     return mp_sws_supports_formats(p->sws, p->imgfmt, format) ? 1 : 0;
 }
 
@@ -443,7 +676,7 @@ static int control(struct vo *vo, uint32_t request, void *arg)
 
 const struct vo_driver video_out_drm = {
     .name = "drm",
-    .description = "Direct Rendering Manager (software scaling)",
+    .description = "Direct Rendering Manager (software scaling, hwdec overlay)",
     .preinit = preinit,
     .query_format = query_format,
     .reconfig = reconfig,
@@ -31,6 +31,7 @@
 #include "config.h"
 #include "common/common.h"
 #include "misc/io_utils.h"
+#include "misc/thread_pool.h"
 #include "options/m_config.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -100,6 +101,7 @@ struct cache {
     const char *name;
     size_t size_limit;
     pl_cache cache;
+    struct mp_thread_pool *pool; // for file I/O, may be NULL
 };
 
 struct priv {
@@ -140,6 +142,7 @@ struct priv {
     struct m_config_cache *next_opts_cache;
     struct gl_next_opts *next_opts;
     struct cache shader_cache, icc_cache;
+    struct mp_thread_pool *cache_pool;
     struct mp_csp_equalizer_state *video_eq;
     struct scaler_params scalers[SCALER_COUNT];
     const struct pl_hook **hooks; // storage for `params.hooks`
@@ -147,6 +150,7 @@ struct priv {
 
     struct pl_icc_params icc_params;
     char *icc_path;
+    bool icc_pending; // icc_path not loaded yet
     pl_icc_object icc_profile;
 
     // Cached shaders, preserved across options updates
@@ -162,6 +166,7 @@ struct priv {
 
 static void update_render_options(struct vo *vo);
 static void update_lut(struct priv *p, struct user_lut *lut);
+static void load_pending_icc(struct priv *p);
 
 struct gl_next_opts {
     bool delayed_peak;
@@ -1004,6 +1009,7 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     pl_options pars = p->pars;
     pl_gpu gpu = p->gpu;
     update_options(vo);
+    load_pending_icc(p);
 
     struct pl_render_params params = pars->params;
     const struct gl_video_opts *opts = p->opts_cache->opts;
@@ -1524,6 +1530,19 @@ static bool update_icc(struct priv *p, struct bstr icc)
     return ok;
 }
 
+static void load_pending_icc(struct priv *p)
+{
+    if (!p->icc_pending)
+        return;
+    p->icc_pending = false;
+
+    char *fname = mp_get_user_path(NULL, p->global, p->icc_path);
+    MP_VERBOSE(p, "Opening ICC profile '%s'\n", fname);
+    struct bstr icc = stream_read_file(fname, p, p->global, 100000000); // 100 MB
+    talloc_free(fname);
+    update_icc(p, icc);
+}
+
 // Returns whether the ICC profile was updated (even on failure)
 static bool update_auto_profile(struct priv *p, int *events)
 {
@@ -1549,6 +1568,11 @@ static bool update_auto_profile(struct priv *p, int *events)
     return false;
 }
 
+static void screenshot_done(void *priv)
+{
+    vo_screenshot_async_done(priv, true);
+}
+
 static void video_screenshot(struct vo *vo, struct voctrl_screenshot *args)
 {
     struct priv *p = vo->priv;
@@ -1625,6 +1649,9 @@ static void video_screenshot(struct vo *vo, struct voctrl_screenshot *args)
         };
     }
 
+    // Downscaling while rendering keeps the readback small.
+    vo_screenshot_fit(args, &dst, &osd);
+
     // Create target FBO, try high bit depth first
     int mpfmt;
     for (int depth = args->high_bit_depth ? 16 : 8; depth; depth -= 8) {
@@ -1669,6 +1696,7 @@ static void video_screenshot(struct vo *vo, struct voctrl_screenshot *args)
     const struct gl_video_opts *opts = p->opts_cache->opts;
     if (args->scaled) {
         // Apply target LUT, ICC profile and CSP override only in window mode
+        load_pending_icc(p);
         apply_target_options(p, &target, 0, false);
     } else if (args->native_csp) {
         target.color = image.color;
@@ -1739,14 +1767,25 @@ static void video_screenshot(struct vo *vo, struct voctrl_screenshot *args)
     if (args->scaled)
         args->res->params.p_w = args->res->params.p_h = 1;
 
+    // Don't stall the render loop on the readback. The download completes in
+    // the background, and the callback runs during one of the following
+    // frames (or on VOCTRL_SCREENSHOT_FINISH).
+    struct vo_screenshot_async *async = vo_screenshot_async_create();
     bool ok = pl_tex_download(gpu, pl_tex_transfer_params(
         .tex = fbo,
         .ptr = args->res->planes[0],
         .row_pitch = args->res->stride[0],
+        .callback = screenshot_done,
+        .priv = async,
     ));
 
-    if (!ok)
+    if (ok) {
+        args->async = async;
+        pl_gpu_flush(gpu);
+    } else {
+        talloc_free(async);
         TA_FREEP(&args->res);
+    }
 
     // fall through
 done:
@@ -1790,6 +1829,40 @@ static void update_ra_ctx_options(struct vo *vo, struct ra_ctx_opts *ctx_opts)
                             border_alpha;
 }
 
+static pl_cache_obj cache_load_obj(void *p, uint64_t key);
+static void cache_save_obj(void *p, pl_cache_obj obj);
+
+// Free GPU memory and RAM that is recreated on the next redraw.
+static void trim_memory(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    for (int i = 0; i < MP_ARRAY_SIZE(p->osd_state.entries); i++)
+        pl_tex_destroy(p->gpu, &p->osd_state.entries[i].tex);
+    for (int i = 0; i < p->num_sub_tex; i++)
+        pl_tex_destroy(p->gpu, &p->sub_tex[i]);
+    p->num_sub_tex = 0;
+    pl_renderer_flush_cache(p->rr);
+
+    // The shader cache objects are saved to files, from which they are loaded
+    // again on demand, so the in-memory copies can be dropped. (The ICC cache
+    // can't be replaced, because the ICC profile object references it.)
+    struct cache *cache = &p->shader_cache;
+    if (cache->cache) {
+        pl_gpu_set_cache(p->gpu, NULL);
+        pl_cache_destroy(&cache->cache);
+        cache->cache = pl_cache_create(pl_cache_params(
+            .log = p->pllog,
+            .get = cache_load_obj,
+            .set = cache_save_obj,
+            .priv = cache
+        ));
+        pl_gpu_set_cache(p->gpu, cache->cache);
+    }
+
+    vo->want_redraw = true;
+}
+
 static int control(struct vo *vo, uint32_t request, void *data)
 {
     struct priv *p = vo->priv;
@@ -1842,6 +1915,10 @@ static int control(struct vo *vo, uint32_t request, void *data)
         video_screenshot(vo, data);
         return true;
 
+    case VOCTRL_SCREENSHOT_FINISH:
+        pl_gpu_finish(p->gpu);
+        return true;
+
     case VOCTRL_EXTERNAL_RESIZE:
         reconfig(vo, NULL);
         return true;
@@ -1849,6 +1926,10 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_LOAD_HWDEC_API:
         ra_hwdec_ctx_load_fmt(&p->hwdec_ctx, vo->hwdec_devs, data);
         return true;
+
+    case VOCTRL_TRIM_MEMORY:
+        trim_memory(vo);
+        return true;
     }
 
     int events = 0;
@@ -1925,39 +2006,69 @@ done:
     return obj;
 }
 
-static void cache_save_obj(void *p, pl_cache_obj obj)
-{
-    const struct cache *c = p;
-    void *ta_ctx = talloc_new(NULL);
-
-    if (!c->dir)
-        goto done;
+struct cache_save_job {
+    const struct cache *c;
+    char *filepath;
+    uint64_t key;
+    void *data;
+    size_t size;
+};
 
-    char *filepath = cache_filepath(ta_ctx, c->dir, c->name, obj.key);
-    if (!filepath)
-        goto done;
+static void cache_save_job_fn(void *ptr)
+{
+    struct cache_save_job *job = ptr;
+    const struct cache *c = job->c;
 
-    if (!obj.data || !obj.size) {
-        unlink(filepath);
+    if (!job->data || !job->size) {
+        unlink(job->filepath);
         goto done;
     }
 
     // Don't save if already exists
     struct stat st;
-    if (!stat(filepath, &st) && st.st_size == obj.size) {
-        MP_DBG(c, "%s: key(%"PRIx64"), size(%zu)\n", __func__, obj.key, obj.size);
+    if (!stat(job->filepath, &st) && st.st_size == job->size) {
+        MP_DBG(c, "%s: key(%"PRIx64"), size(%zu)\n", __func__, job->key, job->size);
         goto done;
     }
 
     int64_t save_start = mp_time_ns();
-    mp_save_to_file(filepath, obj.data, obj.size);
+    mp_save_to_file(job->filepath, job->data, job->size);
     int64_t save_end = mp_time_ns();
     MP_DBG(c, "%s: key(%" PRIx64 "), size(%zu), save time(%.3f ms)\n",
-           __func__, obj.key, obj.size,
+           __func__, job->key, job->size,
            MP_TIME_NS_TO_MS(save_end - save_start));
 
 done:
-    talloc_free(ta_ctx);
+    talloc_free(job);
+}
+
+// Called by libplacebo on the render thread. Copy the data, and write it out
+// on the cache thread. The thread runs jobs in order, so a later removal of
+// the same key can't be overtaken by an earlier write.
+static void cache_save_obj(void *p, pl_cache_obj obj)
+{
+    const struct cache *c = p;
+
+    if (!c->dir)
+        return;
+
+    struct cache_save_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct cache_save_job){
+        .c = c,
+        .filepath = cache_filepath(job, c->dir, c->name, obj.key),
+        .key = obj.key,
+    };
+    if (!job->filepath) {
+        talloc_free(job);
+        return;
+    }
+    if (obj.data && obj.size) {
+        job->data = talloc_memdup(job, obj.data, obj.size);
+        job->size = obj.size;
+    }
+
+    if (!c->pool || !mp_thread_pool_queue(c->pool, cache_save_job_fn, job))
+        cache_save_job_fn(job);
 }
 
 static void cache_init(struct vo *vo, struct cache *cache, size_t max_size,
@@ -1983,6 +2094,7 @@ static void cache_init(struct vo *vo, struct cache *cache, size_t max_size,
         .dir        = dir,
         .name       = name,
         .size_limit = limit,
+        .pool       = p->cache_pool,
         .cache = pl_cache_create(pl_cache_params(
             .log = p->pllog,
             .get = cache_load_obj,
@@ -1990,6 +2102,9 @@ static void cache_init(struct vo *vo, struct cache *cache, size_t max_size,
             .priv = cache
         )),
     };
+
+    if (!cache->pool || !mp_thread_pool_queue(cache->pool, cache_clean, cache))
+        cache_clean(cache);
 }
 
 struct file_entry {
@@ -2003,11 +2118,11 @@ static int compare_atime(const void *a, const void *b)
     return (((struct file_entry *)b)->atime - ((struct file_entry *)a)->atime);
 }
 
-static void cache_uninit(struct priv *p, struct cache *cache)
+// Remove old files if the cache directory exceeds the size limit. This runs
+// on the cache thread, started at init, so that it doesn't delay exiting.
+static void cache_clean(void *ptr)
 {
-    if (!cache->cache)
-        return;
-
+    struct cache *cache = ptr;
     void *ta_ctx = talloc_new(NULL);
     struct file_entry *files = NULL;
     size_t num_files = 0;
@@ -2062,7 +2177,7 @@ static void cache_uninit(struct priv *p, struct cache *cache)
         cache_size += files[i].size;
         double rel_use = difftime(t, files[i].atime);
         if (cache_size > cache_limit && rel_use > 60 * 60 * 24) {
-            MP_VERBOSE(p, "Removing %s | size: %9zu bytes | last used: %9d seconds ago\n",
+            MP_VERBOSE(cache, "Removing %s | size: %9zu bytes | last used: %9d seconds ago\n",
                        files[i].filepath, files[i].size, (int)rel_use);
             unlink(files[i].filepath);
         }
@@ -2070,7 +2185,6 @@ static void cache_uninit(struct priv *p, struct cache *cache)
 
 done:
     talloc_free(ta_ctx);
-    pl_cache_destroy(&cache->cache);
 }
 
 static void uninit(struct vo *vo)
@@ -2094,8 +2208,10 @@ static void uninit(struct vo *vo)
     mp_assert(p->num_dr_buffers == 0);
     mp_mutex_destroy(&p->dr_lock);
 
-    cache_uninit(p, &p->shader_cache);
-    cache_uninit(p, &p->icc_cache);
+    pl_cache_destroy(&p->shader_cache.cache);
+    pl_cache_destroy(&p->icc_cache.cache);
+    // Wait for pending cache writes.
+    TA_FREEP(&p->cache_pool);
 
     pl_lut_free(&p->next_opts->image_lut.lut);
     pl_lut_free(&p->next_opts->lut.lut);
@@ -2156,6 +2272,8 @@ static int preinit(struct vo *vo)
     ra_hwdec_ctx_init(&p->hwdec_ctx, vo->hwdec_devs, gl_opts->hwdec_interop, false);
     mp_mutex_init(&p->dr_lock);
 
+    if (gl_opts->shader_cache || gl_opts->icc_opts->cache)
+        p->cache_pool = mp_thread_pool_create(NULL, 0, 0, 1);
     if (gl_opts->shader_cache)
         cache_init(vo, &p->shader_cache, 10 << 20, gl_opts->shader_cache_dir);
     if (gl_opts->icc_opts->cache)
@@ -2310,20 +2428,16 @@ static void update_icc_opts(struct priv *p, const struct mp_icc_opts *opts)
         // No profile enabled, un-load any existing profiles
         update_icc(p, (bstr) {0});
         TA_FREEP(&p->icc_path);
+        p->icc_pending = false;
         return;
     }
 
     if (p->icc_path && strcmp(opts->profile, p->icc_path) == 0)
         return; // ICC profile hasn't changed
 
-    char *fname = mp_get_user_path(NULL, p->global, opts->profile);
-    MP_VERBOSE(p, "Opening ICC profile '%s'\n", fname);
-    struct bstr icc = stream_read_file(fname, p, p->global, 100000000); // 100 MB
-    talloc_free(fname);
-    update_icc(p, icc);
-
-    // Update cached path
+    // Update cached path; the file is read when the first frame needs it.
     talloc_replace(p, p->icc_path, opts->profile);
+    p->icc_pending = true;
 }
 
 static void update_lut(struct priv *p, struct user_lut *lut)
@@ -20,11 +20,22 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 
+#include <libavutil/pixfmt.h>
 #include <libswscale/swscale.h>
 
+#include "config.h"
+
+#if HAVE_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
@@ -46,9 +57,18 @@ static const struct m_sub_options image_writer_conf = {
     .defaults = &image_writer_opts_defaults,
 };
 
+enum {
+    MODE_FILES,     // one image file per frame
+    MODE_RAW,       // planes of all frames concatenated into one file
+    MODE_Y4M,       // YUV4MPEG2 stream
+};
+
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int mode;
+    int ring;
+    int queue;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -57,19 +77,101 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         {"vo-image", OPT_SUBSTRUCT(opts, image_writer_conf)},
         {"vo-image-outdir", OPT_STRING(outdir), .flags = M_OPT_FILE},
+        {"vo-image-mode", OPT_CHOICE(mode,
+            {"files", MODE_FILES}, {"raw", MODE_RAW}, {"y4m", MODE_Y4M})},
+        {"vo-image-ring", OPT_INT(ring), M_RANGE(0, 1000)},
+        {"vo-image-queue", OPT_INT(queue), M_RANGE(0, 1000)},
         {0},
     },
     .size = sizeof(struct vo_image_opts),
 };
 
+// Maximum number of frames encoded at the same time in files mode. The stream
+// modes always use a single writer to keep the frames in order.
+#define MAX_WRITERS 4
+
+// Layout of the --vo-image-ring file; see DOCS/man/vo.rst.
+#define RING_MAGIC "mpvring1"
+#define RING_HEADER_SIZE 4096
+#define RING_SLOT_DATA 64       // offset of the frame data within a slot
+
+struct ring_header {
+    char magic[8];
+    uint32_t header_size;       // offset of the first slot
+    uint32_t num_slots;
+    uint64_t slot_size;         // distance between slots
+    uint64_t frame_size;        // bytes of frame data per slot
+    uint32_t w, h;
+    char format[32];            // mpv image format name
+    _Atomic uint32_t frames_written;
+    _Atomic uint32_t last_slot; // slot of the most recently written frame
+};
+
+struct ring_slot {
+    _Atomic uint32_t seq;       // odd while the slot is being written
+    uint32_t frame;             // frame number, counting from 0
+    double pts;
+};
+
 struct priv {
     struct vo_image_opts *opts;
 
     struct mp_image *current;
     char *dir;
     int frame;
+
+    // For the stream modes. Only accessed by the writer.
+    struct mp_image_params stream_params;
+    int segment;
+    FILE *stream;
+    struct ring_header *ring;
+    size_t ring_map_size;
+    uint32_t ring_frames;
+    bool write_error;
+
+    // For --vo-image-queue.
+    struct mp_thread_pool *writers;
+    mp_mutex lock;
+    mp_cond wakeup;
+    int queued;                 // guarded by lock
 };
 
+struct write_job {
+    struct vo *vo;
+    struct mp_image *img;
+    char *filename;
+};
+
+static const struct {
+    enum AVPixelFormat pixfmt;
+    const char *tag;
+} y4m_formats[] = {
+    {AV_PIX_FMT_YUV420P,        "420jpeg"},
+    {AV_PIX_FMT_YUV422P,        "422"},
+    {AV_PIX_FMT_YUV444P,        "444"},
+    {AV_PIX_FMT_GRAY8,          "mono"},
+    {AV_PIX_FMT_YUV420P10LE,    "420p10"},
+    {AV_PIX_FMT_YUV422P10LE,    "422p10"},
+    {AV_PIX_FMT_YUV444P10LE,    "444p10"},
+    {AV_PIX_FMT_YUV420P12LE,    "420p12"},
+    {AV_PIX_FMT_YUV422P12LE,    "422p12"},
+    {AV_PIX_FMT_YUV444P12LE,    "444p12"},
+    {AV_PIX_FMT_YUV420P16LE,    "420p16"},
+    {AV_PIX_FMT_YUV422P16LE,    "422p16"},
+    {AV_PIX_FMT_YUV444P16LE,    "444p16"},
+    {AV_PIX_FMT_GRAY16LE,       "mono16"},
+};
+
+static const char *get_y4m_tag(int imgfmt)
+{
+    enum AVPixelFormat pixfmt = imgfmt2pixfmt(imgfmt);
+    for (int n = 0; n < MP_ARRAY_SIZE(y4m_formats); n++) {
+        if (y4m_formats[n].pixfmt == pixfmt)
+            return y4m_formats[n].tag;
+    }
+    return NULL;
+}
+
 static bool checked_mkdir(struct vo *vo, const char *buf)
 {
     struct priv *p = vo->priv;
@@ -108,6 +210,202 @@ done:
     return VO_TRUE;
 }
 
+static size_t line_size(struct mp_image *img, int plane)
+{
+    return ((size_t)mp_image_plane_w(img, plane) * img->fmt.bpp[plane] + 7) / 8;
+}
+
+static size_t frame_size(struct mp_image *img)
+{
+    size_t size = 0;
+    for (int n = 0; n < img->num_planes; n++)
+        size += line_size(img, n) * mp_image_plane_h(img, n);
+    return size;
+}
+
+static bool write_planes(struct mp_image *img, FILE *fp)
+{
+    for (int n = 0; n < img->num_planes; n++) {
+        size_t line = line_size(img, n);
+        for (int y = 0; y < mp_image_plane_h(img, n); y++) {
+            if (fwrite(img->planes[n] + (ptrdiff_t)y * img->stride[n],
+                       line, 1, fp) != 1)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void close_stream(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    if (p->stream && fclose(p->stream))
+        MP_ERR(vo, "Error writing output file!\n");
+    p->stream = NULL;
+#if HAVE_POSIX
+    if (p->ring)
+        munmap(p->ring, p->ring_map_size);
+#endif
+    p->ring = NULL;
+}
+
+static bool open_ring(struct vo *vo, const char *filename, struct mp_image *img)
+{
+#if HAVE_POSIX
+    struct priv *p = vo->priv;
+    uint64_t size = frame_size(img);
+    uint64_t slot_size = MP_ALIGN_UP(RING_SLOT_DATA + size, 4096);
+    uint64_t num_slots = p->opts->ring;
+    uint64_t map_size = RING_HEADER_SIZE + num_slots * slot_size;
+    if (map_size > SIZE_MAX)
+        return false;
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, map_size) == 0)
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    p->ring = map;
+    p->ring_map_size = map_size;
+    p->ring_frames = 0;
+    memcpy(p->ring->magic, RING_MAGIC, sizeof(p->ring->magic));
+    p->ring->header_size = RING_HEADER_SIZE;
+    p->ring->num_slots = num_slots;
+    p->ring->slot_size = slot_size;
+    p->ring->frame_size = size;
+    p->ring->w = img->w;
+    p->ring->h = img->h;
+    snprintf(p->ring->format, sizeof(p->ring->format), "%s",
+             mp_imgfmt_to_name(img->imgfmt));
+    return true;
+#else
+    MP_ERR(vo, "--vo-image-ring is not supported on this platform.\n");
+    return false;
+#endif
+}
+
+static void write_ring_slot(struct vo *vo, struct mp_image *img)
+{
+    struct priv *p = vo->priv;
+    struct ring_header *hdr = p->ring;
+    uint32_t index = p->ring_frames % hdr->num_slots;
+    uint8_t *slot_ptr = (uint8_t *)hdr + hdr->header_size +
+                        (size_t)index * hdr->slot_size;
+    struct ring_slot *slot = (struct ring_slot *)slot_ptr;
+
+    // Readers retry if seq was odd or changed while they copied the frame.
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame = p->ring_frames;
+    slot->pts = img->pts;
+    uint8_t *dst = slot_ptr + RING_SLOT_DATA;
+    for (int n = 0; n < img->num_planes; n++) {
+        size_t line = line_size(img, n);
+        for (int y = 0; y < mp_image_plane_h(img, n); y++) {
+            memcpy(dst, img->planes[n] + (ptrdiff_t)y * img->stride[n], line);
+            dst += line;
+        }
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&hdr->last_slot, index, memory_order_relaxed);
+    atomic_store_explicit(&hdr->frames_written, ++p->ring_frames,
+                          memory_order_release);
+}
+
+// Start a new output file if this is the first frame, or if the format
+// changed (neither raw files nor Y4M can change it mid-stream).
+static bool open_stream(struct vo *vo, struct mp_image *img)
+{
+    struct priv *p = vo->priv;
+    bool y4m = p->opts->mode == MODE_Y4M;
+
+    if ((p->stream || p->ring) &&
+        mp_image_params_equal(&p->stream_params, &img->params))
+        return true;
+    close_stream(vo);
+
+    void *t = talloc_new(NULL);
+    const char *ext = y4m ? "y4m" : p->opts->ring ? "ring" : "raw";
+    char *filename = p->segment ?
+        talloc_asprintf(t, "frames-%d.%s", p->segment + 1, ext) :
+        talloc_asprintf(t, "frames.%s", ext);
+    if (p->dir && strlen(p->dir))
+        filename = mp_path_join(t, p->dir, filename);
+    p->segment++;
+    p->stream_params = img->params;
+
+    MP_INFO(vo, "Writing %dx%d %s frames to %s\n", img->w, img->h,
+            mp_imgfmt_to_name(img->imgfmt), filename);
+
+    bool ok;
+    if (!y4m && p->opts->ring) {
+        ok = open_ring(vo, filename, img);
+    } else {
+        p->stream = fopen(filename, "wb");
+        ok = !!p->stream;
+    }
+    if (ok && y4m) {
+        struct mp_image_params *par = &img->params;
+        ok = fprintf(p->stream, "YUV4MPEG2 W%d H%d Ip A%d:%d C%s "
+                     "XCOLORRANGE=%s\n", img->w, img->h,
+                     par->p_w, par->p_h, get_y4m_tag(img->imgfmt),
+                     par->repr.levels == PL_COLOR_LEVELS_FULL ?
+                        "FULL" : "LIMITED") > 0;
+    }
+    if (!ok)
+        MP_ERR(vo, "Error creating '%s': %s\n", filename, mp_strerror(errno));
+
+    talloc_free(t);
+    return ok;
+}
+
+// Called on the VO thread, or on a writer thread with --vo-image-queue.
+static void write_frame(struct vo *vo, struct mp_image *img,
+                        const char *filename)
+{
+    struct priv *p = vo->priv;
+
+    if (p->opts->mode == MODE_FILES) {
+        MP_INFO(vo, "Saving %s\n", filename);
+        write_image(img, p->opts->opts, filename, vo->global, vo->log, true);
+        return;
+    }
+
+    bool ok = open_stream(vo, img);
+    if (ok && p->ring) {
+        write_ring_slot(vo, img);
+    } else if (ok) {
+        if (p->opts->mode == MODE_Y4M)
+            ok = fputs("FRAME\n", p->stream) >= 0;
+        ok = ok && write_planes(img, p->stream);
+    }
+    if (!ok && !p->write_error)
+        MP_ERR(vo, "Error writing frames.\n");
+    p->write_error |= !ok;
+}
+
+static void run_job(void *ptr)
+{
+    struct write_job *job = ptr;
+    struct priv *p = job->vo->priv;
+
+    write_frame(job->vo, job->img, job->filename);
+    talloc_free(job);
+
+    mp_mutex_lock(&p->lock);
+    p->queued--;
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -116,21 +414,39 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
-                                     image_writer_file_ext(p->opts->opts));
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){ .vo = vo };
 
-    if (p->dir && strlen(p->dir))
-        filename = mp_path_join(t, p->dir, filename);
+    if (p->opts->mode == MODE_FILES) {
+        job->filename = talloc_asprintf(job, "%08d.%s", p->frame,
+                                        image_writer_file_ext(p->opts->opts));
+        if (p->dir && strlen(p->dir))
+            job->filename = mp_path_join(job, p->dir, job->filename);
+    }
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->global, vo->log, true);
+    if (p->writers) {
+        job->img = mp_image_new_ref(p->current);
+        if (job->img) {
+            talloc_steal(job, job->img);
+            mp_mutex_lock(&p->lock);
+            while (p->queued >= p->opts->queue)
+                mp_cond_wait(&p->wakeup, &p->lock);
+            p->queued++;
+            mp_mutex_unlock(&p->lock);
+            mp_thread_pool_queue(p->writers, run_job, job);
+            return;
+        }
+    }
 
-    talloc_free(t);
+    write_frame(vo, p->current, job->filename);
+    talloc_free(job);
 }
 
 static int query_format(struct vo *vo, int fmt)
 {
+    struct priv *p = vo->priv;
+    if (p->opts->mode == MODE_Y4M)
+        return !!get_y4m_tag(fmt);
     if (mp_sws_supported_format(fmt))
         return 1;
     return 0;
@@ -138,14 +454,29 @@ static int query_format(struct vo *vo, int fmt)
 
 static void uninit(struct vo *vo)
 {
+    struct priv *p = vo->priv;
+
+    // Blocks until all queued frames are written.
+    TA_FREEP(&p->writers);
+    close_stream(vo);
+    mp_mutex_destroy(&p->lock);
+    mp_cond_destroy(&p->wakeup);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+    if (p->opts->queue) {
+        int writers = p->opts->mode == MODE_FILES ? MAX_WRITERS : 1;
+        p->writers = mp_thread_pool_create(vo, 1, 1, writers);
+        if (!p->writers)
+            return -1;
+    }
     return 0;
 }
 
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 
 #include "config.h"
@@ -36,6 +37,7 @@
 
 #include "options/m_config.h"
 #include "osdep/terminal.h"
+#include "rate_limit.h"
 #include "sub/osd.h"
 #include "vo.h"
 #include "video/sws_utils.h"
@@ -92,6 +94,7 @@ struct vo_kitty_opts {
     bool config_clear, alt_screen;
     bool use_shm;
     bool auto_multiplexer_passthrough;
+    int64_t bandwidth;
 };
 
 struct priv {
@@ -113,6 +116,10 @@ struct priv {
     struct mp_rect dst;
     struct mp_osd_res osd;
     struct mp_image *frame;
+    struct mp_image *last;  // last image sent to the terminal, if last_valid
+    bool last_valid;
+    bool skip_output;
+    struct mp_rate_limit rate;
     struct mp_sws_context *sws;
 };
 
@@ -163,11 +170,24 @@ static void close_shm(struct priv *p)
 #endif
 }
 
+static bool image_equal(struct mp_image *a, struct mp_image *b)
+{
+    for (int y = 0; y < a->h; y++) {
+        if (memcmp(a->planes[0] + y * a->stride[0],
+                   b->planes[0] + y * b->stride[0], a->w * BYTES_PER_PX))
+            return false;
+    }
+    return true;
+}
+
 static void free_bufs(struct vo* vo)
 {
     struct priv* p = vo->priv;
 
     talloc_free(p->frame);
+    talloc_free(p->last);
+    p->last = NULL;
+    p->last_valid = false;
     talloc_free(p->output);
 
     if (p->opts.use_shm) {
@@ -244,7 +264,8 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     };
 
     p->frame = mp_image_alloc(IMGFMT, p->width, p->height);
-    if (!p->frame)
+    p->last = mp_image_alloc(IMGFMT, p->width, p->height);
+    if (!p->frame || !p->last)
         return -1;
 
     if (mp_sws_reinit(p->sws) < 0)
@@ -307,6 +328,11 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
 
     resized = false;
 
+    // Frame is repeated, and no need to update OSD either
+    p->skip_output = frame->repeat && !frame->redraw && p->last_valid;
+    if (p->skip_output)
+        return VO_TRUE;
+
     if (frame->current) {
         mpi = mp_image_new_ref(frame->current);
         struct mp_rect src_rc = p->src;
@@ -322,6 +348,13 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     struct mp_osd_res res = { .w = p->width, .h = p->height, .display_par = p->display_par };
     osd_draw_on_image(vo->osd, res, mpi ? mpi->pts : 0, 0, p->frame);
 
+    // Don't send the same image again, e.g. on OSD redraws which didn't change
+    // anything visible.
+    p->skip_output = p->last_valid && image_equal(p->frame, p->last);
+    if (p->skip_output)
+        goto done;
+    mp_image_copy(p->last, p->frame);
+    p->last_valid = true;
 
     if (p->opts.use_shm && !create_shm(vo))
         goto done;
@@ -340,7 +373,7 @@ done:
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (!p->buffer)
+    if (!p->buffer || p->skip_output)
         return;
 
     p->cmd.len = 0;
@@ -387,6 +420,7 @@ static void flip_page(struct vo *vo)
     }
 
     write_bstr(p->cmd);
+    mp_rate_limit_wait(&p->rate, p->opts.bandwidth, p->cmd.len);
 
 #if HAVE_POSIX
     if (p->opts.use_shm)
@@ -515,6 +549,7 @@ const struct vo_driver video_out_kitty = {
         {"alt-screen", OPT_BOOL(opts.alt_screen), },
         {"use-shm", OPT_BOOL(opts.use_shm), },
         {"auto-multiplexer-passthrough", OPT_BOOL(opts.auto_multiplexer_passthrough), },
+        {"bandwidth", OPT_BYTE_SIZE(opts.bandwidth), M_RANGE(0, M_MAX_MEM_BYTES)},
         {0}
     },
     .options_prefix = "vo-kitty",
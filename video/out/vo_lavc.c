@@ -23,12 +23,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <libavutil/pixdesc.h>
 #include <libplacebo/utils/libav.h>
 
 #include "common/common.h"
 #include "options/options.h"
 #include "misc/lavc_compat.h"
 #include "video/fmt-conversion.h"
+#include "video/hwdec.h"
 #include "video/mp_image.h"
 #include "mpv_talloc.h"
 #include "vo.h"
@@ -40,9 +42,66 @@
 struct priv {
     struct encoder_context *enc;
 
+    // Devices for the hardware frame formats the encoder accepts, so that
+    // hardware decoded frames can be encoded without copying them to system
+    // memory and back.
+    struct mp_hwdec_ctx hwctx[4];
+    int num_hwctx;
+
     bool shutdown;
 };
 
+// Called by the decoder or hwupload filter to request a device for the given
+// hardware format.
+static void load_hwdec_api(void *ctx, struct hwdec_imgfmt_request *params)
+{
+    struct vo *vo = ctx;
+    struct priv *vc = vo->priv;
+    const AVCodec *codec = vc->enc->encoder->codec;
+
+    for (int n = 0; codec; n++) {
+        const AVCodecHWConfig *cfg = avcodec_get_hw_config(codec, n);
+        if (!cfg)
+            break;
+        int imgfmt = pixfmt2imgfmt(cfg->pix_fmt);
+        if (!(cfg->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) ||
+            !imgfmt || (params->imgfmt && params->imgfmt != imgfmt) ||
+            hwdec_devices_get_by_imgfmt_and_type(vo->hwdec_devs, imgfmt,
+                                                 cfg->device_type))
+            continue;
+        if (vc->num_hwctx == MP_ARRAY_SIZE(vc->hwctx))
+            break;
+
+        AVBufferRef *ref = NULL;
+        const struct hwcontext_fns *fns =
+            hwdec_get_hwcontext_fns(cfg->device_type);
+        if (fns && fns->create_dev) {
+            struct hwcontext_create_dev_params dev_params = {
+                .probing = params->probing,
+            };
+            ref = fns->create_dev(vo->global, vo->log, &dev_params);
+        } else {
+            av_hwdevice_ctx_create(&ref, cfg->device_type, NULL, NULL, 0);
+        }
+        const char *name = av_hwdevice_get_type_name(cfg->device_type);
+        if (!ref) {
+            MP_MSG(vo, params->probing ? MSGL_V : MSGL_ERR,
+                   "Could not create %s device for the encoder.\n", name);
+            continue;
+        }
+
+        MP_VERBOSE(vo, "Created %s device for encoding from %s frames.\n",
+                   name, mp_imgfmt_to_name(imgfmt));
+        struct mp_hwdec_ctx *hwctx = &vc->hwctx[vc->num_hwctx++];
+        *hwctx = (struct mp_hwdec_ctx){
+            .driver_name = name,
+            .av_device_ref = ref,
+            .hw_imgfmt = imgfmt,
+        };
+        hwdec_devices_add(vo->hwdec_devs, hwctx);
+    }
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
@@ -50,6 +109,9 @@ static int preinit(struct vo *vo)
     if (!vc->enc)
         return -1;
     talloc_steal(vc, vc->enc);
+
+    vo->hwdec_devs = hwdec_devices_create();
+    hwdec_devices_set_loader(vo->hwdec_devs, load_hwdec_api, vo);
     return 0;
 }
 
@@ -60,6 +122,15 @@ static void uninit(struct vo *vo)
 
     if (!vc->shutdown)
         encoder_encode(enc, NULL); // finish encoding
+
+    if (vo->hwdec_devs) {
+        hwdec_devices_set_loader(vo->hwdec_devs, NULL, NULL);
+        for (int n = 0; n < vc->num_hwctx; n++) {
+            hwdec_devices_remove(vo->hwdec_devs, &vc->hwctx[n]);
+            av_buffer_unref(&vc->hwctx[n].av_device_ref);
+        }
+        hwdec_devices_destroy(vo->hwdec_devs);
+    }
 }
 
 static int reconfig2(struct vo *vo, struct mp_image *img)
@@ -111,6 +182,21 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
     encoder->colorspace = pl_system_to_av(params->repr.sys);
     encoder->color_range = pl_levels_to_av(params->repr.levels);
 
+    if (IMGFMT_IS_HWACCEL(params->imgfmt)) {
+        // The frames go to the encoder as they are; it needs their pool.
+        if (!img->hwctx) {
+            MP_FATAL(vo, "Hardware frames without frames context.\n");
+            goto error;
+        }
+        AVHWFramesContext *fctx = (void *)img->hwctx->data;
+        encoder->hw_frames_ctx = av_buffer_ref(img->hwctx);
+        MP_HANDLE_OOM(encoder->hw_frames_ctx);
+        encoder->sw_pix_fmt = fctx->sw_format;
+        MP_VERBOSE(vo, "Encoding %s frames (%s) without copying.\n",
+                   mp_imgfmt_to_name(params->imgfmt),
+                   av_get_pix_fmt_name(fctx->sw_format));
+    }
+
     AVRational tb;
 
     // we want to handle:
@@ -187,8 +273,11 @@ static bool draw_frame(struct vo *vo, struct vo_frame *voframe)
 
     struct mp_image *mpi = voframe->frames[0];
 
-    struct mp_osd_res dim = osd_res_from_image_params(vo->params);
-    osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, mpi);
+    // Subtitles can't be burned into hardware frames without a download.
+    if (!IMGFMT_IS_HWACCEL(mpi->imgfmt)) {
+        struct mp_osd_res dim = osd_res_from_image_params(vo->params);
+        osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, mpi);
+    }
 
     if (vc->shutdown)
         goto done;
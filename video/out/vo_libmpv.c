@@ -68,6 +68,7 @@ struct mpv_render_context {
     struct mp_dispatch_queue *dispatch;
     bool advanced_control;
     struct dr_helper *dr;           // NULL if advanced_control disabled
+    struct mpv_render_context *source; // set if this is a mirror
 
     mp_mutex control_lock;
     // --- Protected by control_lock
@@ -100,6 +101,8 @@ struct mpv_render_context {
     bool need_reset;
     bool need_update_external;
     struct vo *vo;
+    struct mpv_render_context **mirrors;
+    int num_mirrors;
 
     // --- Mostly immutable after init.
     struct mp_hwdec_devices *hwdec_devs;
@@ -146,6 +149,65 @@ static void forget_frames(struct mpv_render_context *ctx, bool all)
     }
 }
 
+static bool imgfmt_ok(struct mpv_render_context *ctx, int imgfmt)
+{
+    return imgfmt >= IMGFMT_START && imgfmt < IMGFMT_END &&
+           ctx->imgfmt_supported[imgfmt - IMGFMT_START];
+}
+
+// Copy the VO state of ctx to m. Called with both locks held. If the mirror
+// can't render the video format, it acts as if there was no video.
+static void copy_mirror_state(struct mpv_render_context *m,
+                              struct mpv_render_context *ctx, bool reconfig)
+{
+    m->vo = ctx->vo;
+    m->img_params = (struct mp_image_params){0};
+    if (imgfmt_ok(m, ctx->img_params.imgfmt)) {
+        m->img_params = ctx->img_params;
+    } else if (reconfig && ctx->img_params.imgfmt) {
+        MP_WARN(m, "Video format %s not supported by mirror.\n",
+                mp_imgfmt_to_name(ctx->img_params.imgfmt));
+    }
+}
+
+// Pass a change of the VO state of ctx on to its mirrors. Called with
+// ctx->lock held, right after the need_* flags were set. If forget_all is set,
+// the mirrors drop all frames they hold.
+static void update_mirrors(struct mpv_render_context *ctx, bool forget_all)
+{
+    for (int n = 0; n < ctx->num_mirrors; n++) {
+        struct mpv_render_context *m = ctx->mirrors[n];
+        mp_mutex_lock(&m->lock);
+        copy_mirror_state(m, ctx, forget_all);
+        m->need_reconfig |= ctx->need_reconfig;
+        m->need_resize |= ctx->need_resize;
+        m->need_reset |= ctx->need_reset;
+        m->need_update_external |= ctx->need_update_external;
+        if (forget_all)
+            TA_FREEP(&m->next_frame);
+        forget_frames(m, forget_all);
+        mp_mutex_unlock(&m->lock);
+        update(m);
+    }
+}
+
+// Queue frame on all mirrors of ctx. Mirrors never hold up the VO, so a frame
+// they did not render yet is replaced. Called with ctx->lock held.
+static void queue_mirror_frames(struct mpv_render_context *ctx,
+                                struct vo_frame *frame)
+{
+    for (int n = 0; n < ctx->num_mirrors; n++) {
+        struct mpv_render_context *m = ctx->mirrors[n];
+        mp_mutex_lock(&m->lock);
+        if (m->img_params.imgfmt) {
+            talloc_free(m->next_frame);
+            m->next_frame = vo_frame_ref(frame);
+        }
+        mp_mutex_unlock(&m->lock);
+        update(m);
+    }
+}
+
 static void dispatch_wakeup(void *ptr)
 {
     struct mpv_render_context *ctx = ptr;
@@ -181,8 +243,17 @@ int mpv_render_context_create(mpv_render_context **res, mpv_handle *mpv,
     ctx->dispatch = mp_dispatch_create(ctx);
     mp_dispatch_set_wakeup_fn(ctx->dispatch, dispatch_wakeup, ctx);
 
+    ctx->source = get_mpv_render_param(params, MPV_RENDER_PARAM_SOURCE_CONTEXT,
+                                       NULL);
+    if (ctx->source && ctx->source->source) {
+        MP_ERR(ctx, "Can't mirror a mirror render context.\n");
+        ctx->source = NULL;
+        mpv_render_context_free(ctx);
+        return MPV_ERROR_INVALID_PARAMETER;
+    }
+
     if (GET_MPV_RENDER_PARAM(params, MPV_RENDER_PARAM_ADVANCED_CONTROL, int, 0))
-        ctx->advanced_control = true;
+        ctx->advanced_control = !ctx->source;
 
     int err = MPV_ERROR_NOT_IMPLEMENTED;
     for (int n = 0; render_backends[n]; n++) {
@@ -217,7 +288,19 @@ int mpv_render_context_create(mpv_render_context **res, mpv_handle *mpv,
     if (ctx->renderer->fns->get_image && ctx->advanced_control)
         ctx->dr = dr_helper_create(ctx->dispatch, render_get_image, ctx);
 
-    if (!mp_set_main_render_context(ctx->client_api, ctx, true)) {
+    if (ctx->source) {
+        struct mpv_render_context *src = ctx->source;
+        mp_mutex_lock(&src->lock);
+        mp_mutex_lock(&ctx->lock);
+        copy_mirror_state(ctx, src, true);
+        ctx->need_reconfig = ctx->need_resize = true;
+        ctx->need_update_external = true;
+        if (ctx->img_params.imgfmt)
+            ctx->cur_frame = vo_frame_ref(src->cur_frame);
+        mp_mutex_unlock(&ctx->lock);
+        MP_TARRAY_APPEND(src, src->mirrors, src->num_mirrors, ctx);
+        mp_mutex_unlock(&src->lock);
+    } else if (!mp_set_main_render_context(ctx->client_api, ctx, true)) {
         MP_ERR(ctx, "There is already a mpv_render_context set.\n");
         mpv_render_context_free(ctx);
         return MPV_ERROR_GENERIC;
@@ -254,9 +337,23 @@ void mpv_render_context_free(mpv_render_context *ctx)
     if (!ctx)
         return;
 
-    // From here on, ctx becomes invisible and cannot be newly acquired. Only
-    // a VO could still hold a reference.
-    mp_set_main_render_context(ctx->client_api, ctx, false);
+    if (ctx->source) {
+        struct mpv_render_context *src = ctx->source;
+        mp_mutex_lock(&src->lock);
+        for (int n = 0; n < src->num_mirrors; n++) {
+            if (src->mirrors[n] == ctx) {
+                MP_TARRAY_REMOVE_AT(src->mirrors, src->num_mirrors, n);
+                break;
+            }
+        }
+        mp_mutex_unlock(&src->lock);
+        TA_FREEP(&ctx->next_frame);
+        ctx->vo = NULL;
+    } else {
+        // From here on, ctx becomes invisible and cannot be newly acquired.
+        // Only a VO could still hold a reference.
+        mp_set_main_render_context(ctx->client_api, ctx, false);
+    }
 
     if (atomic_load(&ctx->in_use)) {
         // Start destroy the VO, and also bring down the decoder etc., which
@@ -296,6 +393,7 @@ void mpv_render_context_free(mpv_render_context *ctx)
 
     mp_assert(!atomic_load(&ctx->in_use));
     mp_assert(!ctx->vo);
+    mp_assert(!ctx->num_mirrors); // must be freed before the source
 
     // With the dispatch queue not being served anymore, allow frame free
     // requests from this thread to be served directly.
@@ -387,7 +485,7 @@ int mpv_render_context_render(mpv_render_context *ctx, mpv_render_param *params)
     int64_t wait_present_count = ctx->present_count;
     if (frame) {
         ctx->next_frame = NULL;
-        if (!(frame->redraw || !frame->current))
+        if (!ctx->source && !(frame->redraw || !frame->current))
             wait_present_count += 1;
         mp_cond_broadcast(&ctx->video_wait);
         talloc_free(ctx->cur_frame);
@@ -495,6 +593,7 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     ctx->next_frame = vo_frame_ref(frame);
     ctx->expected_flip_count = ctx->flip_count + 1;
     ctx->redrawing = frame->redraw || !frame->current;
+    queue_mirror_frames(ctx, frame);
     mp_mutex_unlock(&ctx->lock);
 
     update(ctx);
@@ -559,10 +658,8 @@ static int query_format(struct vo *vo, int format)
     struct vo_priv *p = vo->priv;
     struct mpv_render_context *ctx = p->ctx;
 
-    bool ok = false;
     mp_mutex_lock(&ctx->lock);
-    if (format >= IMGFMT_START && format < IMGFMT_END)
-        ok = ctx->imgfmt_supported[format - IMGFMT_START];
+    bool ok = imgfmt_ok(ctx, format);
     mp_mutex_unlock(&ctx->lock);
     return ok;
 }
@@ -607,6 +704,7 @@ static int control(struct vo *vo, uint32_t request, void *data)
         mp_mutex_lock(&ctx->lock);
         forget_frames(ctx, false);
         ctx->need_reset = true;
+        update_mirrors(ctx, false);
         mp_mutex_unlock(&ctx->lock);
         vo->want_redraw = true;
         return VO_TRUE;
@@ -616,12 +714,14 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_SET_PANSCAN:
         mp_mutex_lock(&ctx->lock);
         ctx->need_resize = true;
+        update_mirrors(ctx, false);
         mp_mutex_unlock(&ctx->lock);
         vo->want_redraw = true;
         return VO_TRUE;
     case VOCTRL_UPDATE_RENDER_OPTS:
         mp_mutex_lock(&ctx->lock);
         ctx->need_update_external = true;
+        update_mirrors(ctx, false);
         mp_mutex_unlock(&ctx->lock);
         vo->want_redraw = true;
         return VO_TRUE;
@@ -675,6 +775,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     ctx->img_params = *params;
     ctx->need_reconfig = true;
     ctx->need_resize = true;
+    update_mirrors(ctx, true);
     mp_mutex_unlock(&ctx->lock);
 
     control(vo, VOCTRL_RECONFIG, NULL);
@@ -698,6 +799,7 @@ static void uninit(struct vo *vo)
     ctx->need_update_external = true;
     ctx->need_reset = true;
     ctx->vo = NULL;
+    update_mirrors(ctx, true);
 
     // The following do not normally need ctx->lock, however, ctx itself may
     // become invalid once we release ctx->lock.
@@ -733,6 +835,7 @@ static int preinit(struct vo *vo)
     ctx->vo = vo;
     ctx->need_resize = true;
     ctx->need_update_external = true;
+    update_mirrors(ctx, false);
     mp_mutex_unlock(&ctx->lock);
 
     vo->hwdec_devs = ctx->hwdec_devs;
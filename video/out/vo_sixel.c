@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <libswscale/swscale.h>
 #include <sixel.h>
@@ -30,6 +31,7 @@
 #include "config.h"
 #include "options/m_config.h"
 #include "osdep/terminal.h"
+#include "rate_limit.h"
 #include "sub/osd.h"
 #include "vo.h"
 #include "video/sws_utils.h"
@@ -54,6 +56,7 @@ struct vo_sixel_opts {
     int rows, cols;
     bool config_clear, alt_screen;
     bool buffered;
+    int64_t bandwidth;
 };
 
 struct priv {
@@ -67,6 +70,9 @@ struct priv {
     uint8_t        *buffer;
     char           *sixel_output_buf;
     bool            skip_frame_draw;
+    bool            buffer_valid;  // buffer is what the terminal shows
+    size_t          written;
+    struct mp_rate_limit rate;
 
     int left, top;  // image origin cell (1 based)
     int width, height;  // actual image px size - always reflects dst_rect.
@@ -318,6 +324,7 @@ static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
 
     priv->buffer =
         talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
+    priv->buffer_valid = false;
 
     return 0;
 }
@@ -361,6 +368,24 @@ static inline void sixel_strwrite(char *s)
     sixel_write(s, strlen(s), stdout);
 }
 
+static int sixel_write_counted(char *data, int size, void *ctx)
+{
+    struct priv *priv = ctx;
+    priv->written += size;
+    return sixel_write(data, size, stdout);
+}
+
+static bool buffer_equal(struct priv *priv)
+{
+    int line = priv->width * depth;
+    for (int y = 0; y < priv->height; y++) {
+        if (memcmp(priv->buffer + y * line,
+                   priv->frame->planes[0] + y * priv->frame->stride[0], line))
+            return false;
+    }
+    return true;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *priv = vo->priv;
@@ -436,6 +461,12 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     };
     osd_draw_on_image(vo->osd, dim, mpi ? mpi->pts : 0, 0, priv->frame);
 
+    // Don't encode and send the same image again.
+    if (priv->buffer_valid && buffer_equal(priv)) {
+        priv->skip_frame_draw = true;
+        goto done;
+    }
+
     // Copy from mpv to RGB format as required by libsixel
     memcpy_pic(priv->buffer, priv->frame->planes[0], priv->width * depth,
                priv->height, priv->width * depth, priv->frame->stride[0]);
@@ -455,10 +486,8 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
                 sixel_helper_format_error(status));
     }
 
-    if (mpi)
-        talloc_free(mpi);
-
 done:
+    talloc_free(mpi);
     return VO_TRUE;
 }
 
@@ -477,19 +506,25 @@ static void flip_page(struct vo *vo)
         return;
 
     // Go to the offset row and column, then display the image
+    priv->written = 0;
     priv->sixel_output_buf = talloc_asprintf(NULL, TERM_ESC_GOTO_YX,
                                              priv->top, priv->left);
     if (!priv->opts.buffered)
-        sixel_strwrite(priv->sixel_output_buf);
+        sixel_write_counted(priv->sixel_output_buf,
+                            strlen(priv->sixel_output_buf), priv);
 
     sixel_encode(priv->buffer, priv->width, priv->height,
                  depth, priv->dither, priv->output);
+    priv->buffer_valid = true;
 
-    if (priv->opts.buffered)
-        sixel_write(priv->sixel_output_buf,
-                    ta_get_size(priv->sixel_output_buf), stdout);
+    if (priv->opts.buffered) {
+        priv->written = ta_get_size(priv->sixel_output_buf);
+        sixel_write(priv->sixel_output_buf, priv->written, stdout);
+    }
 
     talloc_free(priv->sixel_output_buf);
+
+    mp_rate_limit_wait(&priv->rate, priv->opts.bandwidth, priv->written);
 }
 
 static int preinit(struct vo *vo)
@@ -506,7 +541,7 @@ static int preinit(struct vo *vo)
         status = sixel_output_new(&priv->output, sixel_buffer,
                                   &priv->sixel_output_buf, NULL);
     else
-        status = sixel_output_new(&priv->output, sixel_write, stdout, NULL);
+        status = sixel_output_new(&priv->output, sixel_write_counted, priv, NULL);
     if (SIXEL_FAILED(status)) {
         MP_ERR(vo, "preinit: Failed to create output file: %s\n",
                sixel_helper_format_error(status));
@@ -621,6 +656,7 @@ const struct vo_driver video_out_sixel = {
         {"config-clear", OPT_BOOL(opts.config_clear), },
         {"alt-screen", OPT_BOOL(opts.alt_screen), },
         {"buffered", OPT_BOOL(opts.buffered), },
+        {"bandwidth", OPT_BYTE_SIZE(opts.bandwidth), M_RANGE(0, M_MAX_MEM_BYTES)},
         {0}
     },
     .options_prefix = "vo-sixel",
@@ -16,6 +16,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <config.h>
 
 #if HAVE_POSIX
@@ -29,6 +30,7 @@
 #include "osdep/terminal.h"
 #include "osdep/io.h"
 #include "vo.h"
+#include "rate_limit.h"
 #include "sub/osd.h"
 #include "video/sws_utils.h"
 #include "video/mp_image.h"
@@ -62,6 +64,7 @@ struct vo_tct_opts {
     int width;   // 0 -> default
     int height;  // 0 -> default
     bool term256;  // 0 -> true color
+    int64_t bandwidth;  // 0 -> unlimited
 };
 
 struct lut_item {
@@ -75,10 +78,14 @@ struct priv {
     int swidth;
     int sheight;
     struct mp_image *frame;
+    struct mp_image *prev;  // what is on the terminal, if prev_valid
+    bool prev_valid;
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
     bstr frame_buf;
+    size_t written;
+    struct mp_rate_limit rate;
     struct lut_item lut[256];
 };
 
@@ -128,16 +135,39 @@ static void print_seq1(bstr *frame, struct lut_item *lut, bstr prefix, uint8_t c
     bstr_xappend0(NULL, frame, "m");
 }
 
-static void print_buffer(bstr *frame)
+// Print a color, unless the terminal already uses it. *cur is the current
+// color (-1 if unknown).
+static void print_color(bstr *frame, struct lut_item *lut, bool term256,
+                        bool fg, int64_t *cur, const unsigned char *bgr)
+{
+    uint8_t b = bgr[0], g = bgr[1], r = bgr[2];
+    int64_t c = term256 ? rgb_to_x256(r, g, b) : (r << 16) | (g << 8) | b;
+    if (c == *cur)
+        return;
+    *cur = c;
+    if (term256) {
+        print_seq1(frame, lut, fg ? TERM_ESC_COLOR256_FG : TERM_ESC_COLOR256_BG,
+                   (uint8_t)c);
+    } else {
+        print_seq3(frame, lut, fg ? TERM_ESC_COLOR24BIT_FG : TERM_ESC_COLOR24BIT_BG,
+                   r, g, b);
+    }
+}
+
+static void print_buffer(bstr *frame, size_t *written)
 {
     fwrite(frame->start, frame->len, 1, stdout);
+    *written += frame->len;
     frame->len = 0;
 }
 
-static void write_plain(bstr *frame,
+// If prev is not NULL, it contains what the terminal currently shows, and only
+// the cells which differ from it are written.
+static void write_plain(bstr *frame, size_t *written,
     const int dwidth, const int dheight,
     const int swidth, const int sheight,
     const unsigned char *source, const int source_stride,
+    const unsigned char *prev, const int prev_stride,
     bool term256, struct lut_item *lut, enum vo_tct_buffering buffering)
 {
     mp_assert(source);
@@ -145,30 +175,36 @@ static void write_plain(bstr *frame,
     const int ty = (dheight - sheight) / 2;
     for (int y = 0; y < sheight; y++) {
         const unsigned char *row = source + y * source_stride;
-        bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y, tx);
+        const unsigned char *prev_row = prev ? prev + y * prev_stride : NULL;
+        bool moved = true; // cursor is not at the current cell
+        bool dirty = false;
+        int64_t bg = -1;
         for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                print_seq1(frame, lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_BG, r, g, b);
+            if (prev_row && !memcmp(row + x * 3, prev_row + x * 3, 3)) {
+                moved = true;
+                continue;
             }
+            if (moved)
+                bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y, tx + x);
+            moved = false;
+            dirty = true;
+            print_color(frame, lut, term256, false, &bg, row + x * 3);
             bstr_xappend0(NULL, frame, " ");
             if (buffering <= VO_TCT_BUFFER_PIXEL)
-                print_buffer(frame);
+                print_buffer(frame, written);
         }
-        bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
+        if (dirty)
+            bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
         if (buffering <= VO_TCT_BUFFER_LINE)
-            print_buffer(frame);
+            print_buffer(frame, written);
     }
 }
 
-static void write_half_blocks(bstr *frame,
+static void write_half_blocks(bstr *frame, size_t *written,
     const int dwidth, const int dheight,
     const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
+    const unsigned char *source, const int source_stride,
+    const unsigned char *prev, const int prev_stride,
     bool term256, struct lut_item *lut, enum vo_tct_buffering buffering)
 {
     mp_assert(source);
@@ -177,28 +213,32 @@ static void write_half_blocks(bstr *frame,
     for (int y = 0; y < sheight * 2; y += 2) {
         const unsigned char *row_up = source + y * source_stride;
         const unsigned char *row_down = source + (y + 1) * source_stride;
-        bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y / 2, tx);
+        const unsigned char *prev_up = prev ? prev + y * prev_stride : NULL;
+        const unsigned char *prev_down = prev ? prev + (y + 1) * prev_stride : NULL;
+        bool moved = true;
+        bool dirty = false;
+        int64_t bg = -1, fg = -1;
         for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                print_seq1(frame, lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                print_seq1(frame, lut, TERM_ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_BG, r_up, g_up, b_up);
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_FG, r_down, g_down, b_down);
+            if (prev && !memcmp(row_up + x * 3, prev_up + x * 3, 3) &&
+                !memcmp(row_down + x * 3, prev_down + x * 3, 3))
+            {
+                moved = true;
+                continue;
             }
+            if (moved)
+                bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y / 2, tx + x);
+            moved = false;
+            dirty = true;
+            print_color(frame, lut, term256, false, &bg, row_up + x * 3);
+            print_color(frame, lut, term256, true, &fg, row_down + x * 3);
             bstr_xappend(NULL, frame, UNICODE_LOWER_HALF_BLOCK);
             if (buffering <= VO_TCT_BUFFER_PIXEL)
-                print_buffer(frame);
+                print_buffer(frame, written);
         }
-        bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
+        if (dirty)
+            bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
         if (buffering <= VO_TCT_BUFFER_LINE)
-            print_buffer(frame);
+            print_buffer(frame, written);
     }
 }
 
@@ -238,8 +278,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     const int mul = (p->opts.algo == ALGO_PLAIN ? 1 : 2);
     if (p->frame)
         talloc_free(p->frame);
+    talloc_free(p->prev);
+    p->prev_valid = false;
     p->frame = mp_image_alloc(IMGFMT, p->swidth, p->sheight * mul);
-    if (!p->frame)
+    p->prev = mp_image_alloc(IMGFMT, p->swidth, p->sheight * mul);
+    if (!p->frame || !p->prev)
         return -1;
 
     mp_image_clear(p->frame, 0, 0, p->frame->w, p->frame->h);
@@ -278,25 +321,34 @@ static void flip_page(struct vo *vo)
 
     WRITE_STR(TERM_ESC_SYNC_UPDATE_BEGIN);
 
+    // Only cells which changed since the last output are written.
+    const unsigned char *prev = p->prev_valid ? p->prev->planes[0] : NULL;
     p->frame_buf.len = 0;
+    p->written = 0;
     if (p->opts.algo == ALGO_PLAIN) {
-        write_plain(&p->frame_buf,
+        write_plain(&p->frame_buf, &p->written,
             vo->dwidth, vo->dheight, p->swidth, p->sheight,
             p->frame->planes[0], p->frame->stride[0],
+            prev, p->prev->stride[0],
             p->opts.term256, p->lut, p->opts.buffering);
     } else {
-        write_half_blocks(&p->frame_buf,
+        write_half_blocks(&p->frame_buf, &p->written,
             vo->dwidth, vo->dheight, p->swidth, p->sheight,
             p->frame->planes[0], p->frame->stride[0],
+            prev, p->prev->stride[0],
             p->opts.term256, p->lut, p->opts.buffering);
     }
+    mp_image_copy(p->prev, p->frame);
+    p->prev_valid = true;
 
     bstr_xappend0(NULL, &p->frame_buf, "\n");
     if (p->opts.buffering <= VO_TCT_BUFFER_FRAME)
-        print_buffer(&p->frame_buf);
+        print_buffer(&p->frame_buf, &p->written);
 
     WRITE_STR(TERM_ESC_SYNC_UPDATE_END);
     fflush(stdout);
+
+    mp_rate_limit_wait(&p->rate, p->opts.bandwidth, p->written);
 }
 
 static void uninit(struct vo *vo)
@@ -306,6 +358,7 @@ static void uninit(struct vo *vo)
     WRITE_STR(TERM_ESC_NORMAL_SCREEN);
     struct priv *p = vo->priv;
     talloc_free(p->frame);
+    talloc_free(p->prev);
     talloc_free(p->frame_buf.start);
 }
 
@@ -372,6 +425,7 @@ const struct vo_driver video_out_tct = {
         {"width", OPT_INT(opts.width)},
         {"height", OPT_INT(opts.height)},
         {"256", OPT_BOOL(opts.term256)},
+        {"bandwidth", OPT_BYTE_SIZE(opts.bandwidth), M_RANGE(0, M_MAX_MEM_BYTES)},
         {"buffering", OPT_CHOICE(opts.buffering,
             {"pixel", VO_TCT_BUFFER_PIXEL},
             {"line", VO_TCT_BUFFER_LINE},
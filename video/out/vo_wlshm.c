@@ -24,6 +24,7 @@
 #include "osdep/endian.h"
 #include "present_sync.h"
 #include "sub/osd.h"
+#include "sw_render.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
@@ -38,11 +39,14 @@ struct buffer {
     struct wl_shm_pool *pool;
     struct wl_buffer *buffer;
     struct mp_image mpi;
+    struct mp_sw_buffer_state state;
     struct buffer *next;
 };
 
 struct priv {
     struct mp_sws_context *sws;
+    struct mp_sw_render *render;
+    struct mp_rect damage;
     struct buffer *free_buffers;
     struct mp_rect src;
     struct mp_rect dst;
@@ -155,6 +159,7 @@ static int preinit(struct vo *vo)
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
+    p->render = mp_sw_render_create(vo, p->sws);
 
     return 0;
 err:
@@ -217,11 +222,15 @@ static int resize(struct vo *vo)
 
     vo_wayland_handle_scale(wl);
 
-    return mp_sws_reinit(p->sws);
+    int ret = mp_sws_reinit(p->sws);
+    mp_sw_render_reset(p->render);
+    return ret;
 }
 
 static int control(struct vo *vo, uint32_t request, void *data)
 {
+    struct priv *p = vo->priv;
+
     switch (request) {
     case VOCTRL_SET_PANSCAN:
         resize(vo);
@@ -233,8 +242,10 @@ static int control(struct vo *vo, uint32_t request, void *data)
 
     if (events & VO_EVENT_RESIZE)
         ret = resize(vo);
-    if (events & VO_EVENT_EXPOSE)
+    if (events & VO_EVENT_EXPOSE) {
+        mp_sw_render_reset(p->render);
         vo->want_redraw = true;
+    }
     vo_event(vo, events);
     return ret;
 }
@@ -257,38 +268,29 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
         buf = buffer_create(vo, vo->dwidth, vo->dheight);
         if (!buf) {
             wl_surface_attach(wl->surface, NULL, 0, 0);
+            mp_sw_render_reset(p->render);
             goto done;
         }
     }
+    struct mp_rect dst_rc = p->dst;
     if (src) {
         vo_wayland_handle_color(wl);
-        struct mp_image dst = buf->mpi;
         struct mp_rect src_rc;
-        struct mp_rect dst_rc;
         src_rc.x0 = MP_ALIGN_DOWN(p->src.x0, src->fmt.align_x);
         src_rc.y0 = MP_ALIGN_DOWN(p->src.y0, src->fmt.align_y);
         src_rc.x1 = p->src.x1 - (p->src.x0 - src_rc.x0);
         src_rc.y1 = p->src.y1 - (p->src.y0 - src_rc.y0);
-        dst_rc.x0 = MP_ALIGN_DOWN(p->dst.x0, dst.fmt.align_x);
-        dst_rc.y0 = MP_ALIGN_DOWN(p->dst.y0, dst.fmt.align_y);
+        dst_rc.x0 = MP_ALIGN_DOWN(p->dst.x0, buf->mpi.fmt.align_x);
+        dst_rc.y0 = MP_ALIGN_DOWN(p->dst.y0, buf->mpi.fmt.align_y);
         dst_rc.x1 = p->dst.x1 - (p->dst.x0 - dst_rc.x0);
         dst_rc.y1 = p->dst.y1 - (p->dst.y0 - dst_rc.y0);
         mp_image_crop_rc(src, src_rc);
-        mp_image_crop_rc(&dst, dst_rc);
-        mp_sws_scale(p->sws, &dst, src);
-        if (dst_rc.y0 > 0)
-            mp_image_clear(&buf->mpi, 0, 0, buf->mpi.w, dst_rc.y0);
-        if (buf->mpi.h > dst_rc.y1)
-            mp_image_clear(&buf->mpi, 0, dst_rc.y1, buf->mpi.w, buf->mpi.h);
-        if (dst_rc.x0 > 0)
-            mp_image_clear(&buf->mpi, 0, dst_rc.y0, dst_rc.x0, dst_rc.y1);
-        if (buf->mpi.w > dst_rc.x1)
-            mp_image_clear(&buf->mpi, dst_rc.x1, dst_rc.y0, buf->mpi.w, dst_rc.y1);
-        osd_draw_on_image(vo->osd, p->osd, src->pts, 0, &buf->mpi);
-    } else {
-        mp_image_clear(&buf->mpi, 0, 0, buf->mpi.w, buf->mpi.h);
-        osd_draw_on_image(vo->osd, p->osd, 0, 0, &buf->mpi);
     }
+    // Only the parts which changed since the last frame are redrawn, and
+    // reported as damage.
+    p->damage = mp_sw_render_frame(p->render, &buf->state, &buf->mpi, src,
+                                   frame->frame_id, dst_rc, p->osd,
+                                   src ? src->pts : 0);
     wl_surface_attach(wl->surface, buf->buffer, 0, 0);
 
 done:
@@ -297,10 +299,15 @@ done:
 
 static void flip_page(struct vo *vo)
 {
+    struct priv *p = vo->priv;
     struct vo_wayland_state *wl = vo->wl;
 
-    wl_surface_damage_buffer(wl->surface, 0, 0, vo->dwidth,
-                             vo->dheight);
+    // The commit is still needed for frame callbacks if nothing changed.
+    if (mp_rect_w(p->damage) > 0 && mp_rect_h(p->damage) > 0) {
+        wl_surface_damage_buffer(wl->surface, p->damage.x0, p->damage.y0,
+                                 mp_rect_w(p->damage), mp_rect_h(p->damage));
+    }
+    p->damage = (struct mp_rect){0};
     wl_surface_commit(wl->surface);
 
     if (wl->opts->wl_internal_vsync)
@@ -42,6 +42,7 @@
 
 #include "sub/osd.h"
 #include "sub/draw_bmp.h"
+#include "sw_render.h"
 
 #include "video/sws_utils.h"
 #include "video/fmt-conversion.h"
@@ -58,6 +59,7 @@ struct priv {
 
     XImage *myximage[2];
     struct mp_image mp_ximages[2];
+    struct mp_sw_buffer_state buf_state[2];
     int depth;
     GC gc;
 
@@ -69,6 +71,8 @@ struct priv {
     struct mp_osd_res osd;
 
     struct mp_sws_context *sws;
+    struct mp_sw_render *render;
+    struct mp_rect damage;
 
     XVisualInfo vinfo;
 
@@ -272,6 +276,8 @@ static bool resize(struct vo *vo)
         mp_mutex_unlock(&vo->params_mutex);
     }
 
+    // Also called on expose events, so the window content is lost.
+    mp_sw_render_reset(p->render);
     vo->want_redraw = true;
     return true;
 }
@@ -281,14 +287,20 @@ static void Display_Image(struct priv *p, XImage *myximage)
     struct vo *vo = p->vo;
 
     XImage *x_image = p->myximage[p->current_buf];
+    struct mp_rect rc = p->damage;
+
+    // The window keeps its content, so only changed pixels are sent.
+    if (mp_rect_w(rc) <= 0 || mp_rect_h(rc) <= 0)
+        return;
 
     if (p->Shmem_Flag) {
         XShmPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                     0, 0, 0, 0, vo->dwidth, vo->dheight, True);
+                     rc.x0, rc.y0, rc.x0, rc.y0, mp_rect_w(rc), mp_rect_h(rc),
+                     True);
         vo->x11->ShmCompletionWaitCount++;
     } else {
         XPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                  0, 0, 0, 0, vo->dwidth, vo->dheight);
+                  rc.x0, rc.y0, rc.x0, rc.y0, mp_rect_w(rc), mp_rect_h(rc));
     }
 }
 
@@ -336,26 +348,21 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     if (!render)
         return VO_FALSE;
 
-    struct mp_image *img = &p->mp_ximages[p->current_buf];
-
-    if (frame->current) {
-        mp_image_clear_rc_inv(img, p->dst);
+    // The XImage can be larger than the window.
+    struct mp_image img = p->mp_ximages[p->current_buf];
+    mp_image_set_size(&img, vo->dwidth, vo->dheight);
 
-        struct mp_image *src = frame->current;
+    struct mp_image *src = frame->current;
+    if (src) {
         struct mp_rect src_rc = p->src;
         src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, src->fmt.align_x);
         src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src->fmt.align_y);
         mp_image_crop_rc(src, src_rc);
-
-        struct mp_image dst = *img;
-        mp_image_crop_rc(&dst, p->dst);
-
-        mp_sws_scale(p->sws, &dst, src);
-    } else {
-        mp_image_clear(img, 0, 0, img->w, img->h);
     }
 
-    osd_draw_on_image(vo->osd, p->osd, frame->current ? frame->current->pts : 0, 0, img);
+    p->damage = mp_sw_render_frame(p->render, &p->buf_state[p->current_buf],
+                                   &img, src, frame->frame_id, p->dst, p->osd,
+                                   src ? src->pts : 0);
 
     if (frame->current != p->original_image)
         p->original_image = frame->current;
@@ -391,6 +398,7 @@ static int preinit(struct vo *vo)
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
+    p->render = mp_sw_render_create(vo, p->sws);
 
     if (!vo_x11_init(vo))
         goto error;
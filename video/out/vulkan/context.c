@@ -427,6 +427,11 @@ bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
         .swapchain_depth = ctx->vo->opts->swapchain_depth,
     };
 
+    // Mailbox lets the latest rendered image replace one waiting for vsync.
+    // libplacebo falls back to FIFO if it's not supported.
+    if (ctx->vo->opts->late_latching)
+        pl_params.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+
     if (p->opts->swap_mode >= 0) // user override
         pl_params.present_mode = p->opts->swap_mode;
 
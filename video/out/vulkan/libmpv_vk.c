@@ -0,0 +1,196 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libplacebo/vulkan.h>
+
+#include "mpv/render_vk.h"
+#include "options/m_config.h"
+#include "video/out/gpu/context.h"
+#include "video/out/gpu/libmpv_gpu.h"
+#include "video/out/gpu/ra.h"
+#include "video/out/placebo/ra_pl.h"
+#include "video/out/placebo/utils.h"
+
+struct priv {
+    pl_log pllog;
+    pl_vulkan vulkan;
+    struct ra_ctx *ra_ctx;
+
+    // The image passed to the current mpv_render_context_render() call.
+    pl_tex tex;
+    struct ra_tex wrapped;
+    mpv_vulkan_image target;
+};
+
+static int init(struct libmpv_gpu_context *ctx, mpv_render_param *params)
+{
+    ctx->priv = talloc_zero(NULL, struct priv);
+    struct priv *p = ctx->priv;
+
+    mpv_vulkan_init_params *init_params =
+        get_mpv_render_param(params, MPV_RENDER_PARAM_VULKAN_INIT_PARAMS, NULL);
+    if (!init_params || !init_params->instance || !init_params->get_proc_addr ||
+        !init_params->phys_device || !init_params->device ||
+        !init_params->queue_count)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    p->pllog = mppl_log_create(p, ctx->log);
+    if (!p->pllog)
+        return MPV_ERROR_GENERIC;
+
+    struct pl_vulkan_queue queue = {
+        .index = init_params->queue_family,
+        .count = init_params->queue_count,
+    };
+    p->vulkan = pl_vulkan_import(p->pllog, pl_vulkan_import_params(
+        .instance = init_params->instance,
+        .get_proc_addr = init_params->get_proc_addr,
+        .phys_device = init_params->phys_device,
+        .device = init_params->device,
+        .extensions = init_params->extensions,
+        .num_extensions = init_params->num_extensions,
+        .features = init_params->features,
+        .queue_graphics = queue,
+        .queue_compute = queue,
+        .queue_transfer = queue,
+        .max_api_version = init_params->max_api_version ?
+                           init_params->max_api_version : VK_API_VERSION_1_2,
+        .lock_queue = init_params->lock_queue,
+        .unlock_queue = init_params->unlock_queue,
+        .queue_ctx = init_params->queue_ctx,
+    ));
+    if (!p->vulkan) {
+        MP_FATAL(ctx, "Failed to import Vulkan device.\n");
+        return MPV_ERROR_UNSUPPORTED;
+    }
+
+    // Like libmpv_gl.c, use a blank ra_ctx without swapchain; the API user is
+    // in charge of presentation.
+    p->ra_ctx = talloc_zero(p, struct ra_ctx);
+    p->ra_ctx->log = ctx->log;
+    p->ra_ctx->global = ctx->global;
+    struct ra_ctx_opts *ctx_opts = mp_get_config_group(ctx, ctx->global, &ra_ctx_conf);
+    p->ra_ctx->opts.debug = ctx_opts->debug;
+    talloc_free(ctx_opts);
+
+    p->ra_ctx->ra = ra_create_pl(p->vulkan->gpu, ctx->log);
+    if (!p->ra_ctx->ra)
+        return MPV_ERROR_UNSUPPORTED;
+
+    ctx->ra_ctx = p->ra_ctx;
+    return 0;
+}
+
+static void drop_tex(struct priv *p)
+{
+    if (p->tex)
+        pl_tex_destroy(p->vulkan->gpu, &p->tex);
+}
+
+static int wrap_fbo(struct libmpv_gpu_context *ctx, mpv_render_param *params,
+                    struct ra_tex **out)
+{
+    struct priv *p = ctx->priv;
+    pl_gpu gpu = p->vulkan->gpu;
+
+    mpv_vulkan_image *img =
+        get_mpv_render_param(params, MPV_RENDER_PARAM_VULKAN_IMAGE, NULL);
+    if (!img || !img->image || !img->signal_semaphore ||
+        img->w <= 0 || img->h <= 0)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    // A previous wrap_fbo() (e.g. from get_target_size) was not followed by
+    // done_frame(). The wrapper does not own the VkImage, so just drop it.
+    drop_tex(p);
+
+    p->tex = pl_vulkan_wrap(gpu, pl_vulkan_wrap_params(
+        .image = img->image,
+        .width = img->w,
+        .height = img->h,
+        .format = img->format,
+        .usage = img->usage,
+    ));
+    if (!p->tex) {
+        MP_ERR(ctx, "Failed to wrap VkImage.\n");
+        return MPV_ERROR_UNSUPPORTED;
+    }
+
+    if (!mppl_wrap_tex(p->ra_ctx->ra, p->tex, &p->wrapped)) {
+        MP_ERR(ctx, "Unsupported VkImage format.\n");
+        drop_tex(p);
+        return MPV_ERROR_UNSUPPORTED;
+    }
+
+    pl_vulkan_release_ex(gpu, pl_vulkan_release_params(
+        .tex = p->tex,
+        .layout = img->layout,
+        .qf = VK_QUEUE_FAMILY_IGNORED,
+        .semaphore = {
+            .sem = img->wait_semaphore,
+            .value = img->wait_value,
+        },
+    ));
+
+    p->target = *img;
+    *out = &p->wrapped;
+    return 0;
+}
+
+static void done_frame(struct libmpv_gpu_context *ctx, bool ds)
+{
+    struct priv *p = ctx->priv;
+    if (!p->tex)
+        return;
+
+    bool ok = pl_vulkan_hold_ex(p->vulkan->gpu, pl_vulkan_hold_params(
+        .tex = p->tex,
+        .layout = p->target.final_layout,
+        .qf = VK_QUEUE_FAMILY_IGNORED,
+        .semaphore = {
+            .sem = p->target.signal_semaphore,
+            .value = p->target.signal_value,
+        },
+    ));
+    if (!ok)
+        MP_ERR(ctx, "Failed to hand VkImage back to the API user.\n");
+
+    drop_tex(p);
+}
+
+static void destroy(struct libmpv_gpu_context *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    if (p->vulkan) {
+        drop_tex(p);
+        pl_gpu_finish(p->vulkan->gpu);
+        if (p->ra_ctx && p->ra_ctx->ra) {
+            p->ra_ctx->ra->fns->destroy(p->ra_ctx->ra);
+            p->ra_ctx->ra = NULL;
+        }
+        pl_vulkan_destroy(&p->vulkan);
+    }
+    pl_log_destroy(&p->pllog);
+}
+
+const struct libmpv_gpu_context_fns libmpv_gpu_context_vk = {
+    .api_name = MPV_RENDER_API_TYPE_VULKAN,
+    .init = init,
+    .wrap_fbo = wrap_fbo,
+    .done_frame = done_frame,
+    .destroy = destroy,
+};
@@ -17,11 +17,11 @@
 
 #include <math.h>
 
-#include <libavutil/bswap.h>
 #include <libavutil/pixfmt.h>
 
 #include "common/common.h"
 #include "repack.h"
+#include "repack_kernels.h"
 #include "video/csputils.h"
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
@@ -161,12 +161,10 @@ static void swap_endian(struct mp_image *dst, int dst_x, int dst_y,
             void *restrict d = mp_image_pixel_ptr_ny(dst, p, dst_x, dst_y + y);
             switch (endian_size) {
             case 2:
-                for (int x = 0; x < num_words; x++)
-                    ((uint16_t *)d)[x] = av_bswap16(((uint16_t *)s)[x]);
+                mp_repack_bswap16(d, s, num_words);
                 break;
             case 4:
-                for (int x = 0; x < num_words; x++)
-                    ((uint32_t *)d)[x] = av_bswap32(((uint32_t *)s)[x]);
+                mp_repack_bswap32(d, s, num_words);
                 break;
             default:
                 MP_ASSERT_UNREACHABLE();
@@ -223,8 +221,6 @@ static void swap_endian(struct mp_image *dst, int dst_x, int dst_y,
         }                                                                   \
     }
 
-UN_WORD_4(un_cccc8,  uint32_t, uint8_t,  0, 8,  16, 24, 0xFFu)
-PA_WORD_4(pa_cccc8,  uint32_t, uint8_t,  0, 8,  16, 24)
 // Not sure if this is a good idea; there may be no alignment guarantee.
 UN_WORD_4(un_cccc16,  uint64_t, uint16_t,  0, 16,  32, 48, 0xFFFFu)
 PA_WORD_4(pa_cccc16,  uint64_t, uint16_t,  0, 16,  32, 48)
@@ -239,38 +235,11 @@ PA_WORD_4(pa_cccc16,  uint64_t, uint16_t,  0, 16,  32, 48)
         }                                                                   \
     }
 
-UN_WORD_3(un_ccc8x8,  uint32_t, uint8_t,  0, 8,  16, 0xFFu)
-PA_WORD_3(pa_ccc8z8,  uint32_t, uint8_t,  0, 8,  16, 0)
-UN_WORD_3(un_x8ccc8,  uint32_t, uint8_t,  8, 16, 24, 0xFFu)
-PA_WORD_3(pa_z8ccc8,  uint32_t, uint8_t,  8, 16, 24, 0)
 UN_WORD_3(un_ccc10x2, uint32_t, uint16_t, 0, 10, 20, 0x3FFu)
 PA_WORD_3(pa_ccc10z2, uint32_t, uint16_t, 0, 10, 20, 0)
 UN_WORD_3(un_ccc16x16, uint64_t, uint16_t, 0, 16, 32, 0xFFFFu)
 PA_WORD_3(pa_ccc16z16, uint64_t, uint16_t, 0, 16, 32, 0)
 
-#define PA_WORD_2(name, packed_t, plane_t, sh_c0, sh_c1, pad)               \
-    static void name(void *restrict dst, void *restrict src[], int w) {     \
-        for (int x = 0; x < w; x++) {                                       \
-            ((packed_t *)dst)[x] = (pad) |                                  \
-                ((packed_t)((plane_t *)src[0])[x] << (sh_c0)) |             \
-                ((packed_t)((plane_t *)src[1])[x] << (sh_c1));              \
-        }                                                                   \
-    }
-
-#define UN_WORD_2(name, packed_t, plane_t, sh_c0, sh_c1, mask)              \
-    static void name(void *restrict src, void *restrict dst[], int w) {     \
-        for (int x = 0; x < w; x++) {                                       \
-            packed_t c = ((packed_t *)src)[x];                              \
-            ((plane_t *)dst[0])[x] = (c >> (sh_c0)) & (mask);               \
-            ((plane_t *)dst[1])[x] = (c >> (sh_c1)) & (mask);               \
-        }                                                                   \
-    }
-
-UN_WORD_2(un_cc8,  uint16_t, uint8_t,  0, 8,  0xFFu)
-PA_WORD_2(pa_cc8,  uint16_t, uint8_t,  0, 8,  0)
-UN_WORD_2(un_cc16, uint32_t, uint16_t, 0, 16, 0xFFFFu)
-PA_WORD_2(pa_cc16, uint32_t, uint16_t, 0, 16, 0)
-
 #define PA_SEQ_3(name, comp_t)                                              \
     static void name(void *restrict dst, void *restrict src[], int w) {     \
         comp_t *r = dst;                                                    \
@@ -291,8 +260,6 @@ PA_WORD_2(pa_cc16, uint32_t, uint16_t, 0, 16, 0)
         }                                                                   \
     }
 
-UN_SEQ_3(un_ccc8,  uint8_t)
-PA_SEQ_3(pa_ccc8,  uint8_t)
 UN_SEQ_3(un_ccc16, uint16_t)
 PA_SEQ_3(pa_ccc16, uint16_t)
 
@@ -306,16 +273,17 @@ struct regular_repacker {
     void (*un_scanline)(void *restrict a, void *restrict b[], int w);
 };
 
+// The most common formats use the SIMD kernels from repack_kernels.c.
 static const struct regular_repacker regular_repackers[] = {
-    {32, 8,  0, 3, pa_ccc8z8,   un_ccc8x8},
-    {32, 8,  8, 3, pa_z8ccc8,   un_x8ccc8},
-    {32, 8,  0, 4, pa_cccc8,    un_cccc8},
-    {64, 16, 0, 4, pa_cccc16,   un_cccc16},
-    {64, 16, 0, 3, pa_ccc16z16, un_ccc16x16},
-    {24, 8,  0, 3, pa_ccc8,     un_ccc8},
-    {48, 16, 0, 3, pa_ccc16,    un_ccc16},
-    {16, 8,  0, 2, pa_cc8,      un_cc8},
-    {32, 16, 0, 2, pa_cc16,     un_cc16},
+    {32, 8,  0, 3, mp_repack_pa_ccc8z8, mp_repack_un_ccc8x8},
+    {32, 8,  8, 3, mp_repack_pa_z8ccc8, mp_repack_un_x8ccc8},
+    {32, 8,  0, 4, mp_repack_pa_cccc8,  mp_repack_un_cccc8},
+    {64, 16, 0, 4, pa_cccc16,           un_cccc16},
+    {64, 16, 0, 3, pa_ccc16z16,         un_ccc16x16},
+    {24, 8,  0, 3, mp_repack_pa_ccc8,   mp_repack_un_ccc8},
+    {48, 16, 0, 3, pa_ccc16,            un_ccc16},
+    {16, 8,  0, 2, mp_repack_pa_cc8,    mp_repack_un_cc8},
+    {32, 16, 0, 2, mp_repack_pa_cc16,   mp_repack_un_cc16},
     {32, 10, 0, 3, pa_ccc10z2,  un_ccc10x2},
 };
 
@@ -0,0 +1,628 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+
+#include "repack_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(__AARCH64EB__)
+#define HAVE_NEON_SIMD 1
+#include <arm_neon.h>
+#else
+#define HAVE_NEON_SIMD 0
+#endif
+
+// The SIMD functions process a prefix of the data, and return the number of
+// pixels they handled. The rest is done by the C code. Like repack.c, the C
+// code uses word access for formats with 16 or 32 bit pixels. The SIMD code
+// assumes little endian, which is why there is none for big endian ARM.
+
+#if HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static int un_cc8_avx2(const uint8_t *src, uint8_t *d0, uint8_t *d1, int w)
+{
+    __m256i mask = _mm256_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i a = _mm256_loadu_si256((__m256i *)(src + x * 2));
+        __m256i b = _mm256_loadu_si256((__m256i *)(src + x * 2 + 32));
+        __m256i c0 = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                         _mm256_srli_epi16(b, 8));
+        // Packing works within 128 bit lanes; restore the pixel order.
+        c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(3, 1, 2, 0));
+        c1 = _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(d0 + x), c0);
+        _mm256_storeu_si256((__m256i *)(d1 + x), c1);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int pa_cc8_avx2(uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                       int w)
+{
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i c0 = _mm256_loadu_si256((__m256i *)(s0 + x));
+        __m256i c1 = _mm256_loadu_si256((__m256i *)(s1 + x));
+        __m256i lo = _mm256_unpacklo_epi8(c0, c1); // pixels 0-7, 16-23
+        __m256i hi = _mm256_unpackhi_epi8(c0, c1); // pixels 8-15, 24-31
+        _mm256_storeu_si256((__m256i *)(dst + x * 2),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + x * 2 + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int un_cc16_avx2(const uint16_t *src, uint16_t *d0, uint16_t *d1, int w)
+{
+    __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i a = _mm256_loadu_si256((__m256i *)(src + x * 2));
+        __m256i b = _mm256_loadu_si256((__m256i *)(src + x * 2 + 16));
+        __m256i c0 = _mm256_packus_epi32(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi32(_mm256_srli_epi32(a, 16),
+                                         _mm256_srli_epi32(b, 16));
+        c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(3, 1, 2, 0));
+        c1 = _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(d0 + x), c0);
+        _mm256_storeu_si256((__m256i *)(d1 + x), c1);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int pa_cc16_avx2(uint16_t *dst, const uint16_t *s0, const uint16_t *s1,
+                        int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i c0 = _mm256_loadu_si256((__m256i *)(s0 + x));
+        __m256i c1 = _mm256_loadu_si256((__m256i *)(s1 + x));
+        __m256i lo = _mm256_unpacklo_epi16(c0, c1); // pixels 0-3, 8-11
+        __m256i hi = _mm256_unpackhi_epi16(c0, c1); // pixels 4-7, 12-15
+        _mm256_storeu_si256((__m256i *)(dst + x * 2),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + x * 2 + 16),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return x;
+}
+
+// Unpack 8 pixels to one 64 bit word per component (in order).
+__attribute__((target("avx2")))
+static inline __m256i un_8888_x8_avx2(const uint8_t *src)
+{
+    __m256i shuf = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                    2, 6, 10, 14, 3, 7, 11, 15,
+                                    0, 4, 8, 12, 1, 5, 9, 13,
+                                    2, 6, 10, 14, 3, 7, 11, 15);
+    __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *)src), shuf);
+    return _mm256_permutevar8x32_epi32(v, perm);
+}
+
+// Components with d[n]==NULL are skipped.
+__attribute__((target("avx2")))
+static int un_8888_avx2(const uint8_t *src, uint8_t *d[4], int w)
+{
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i v0 = un_8888_x8_avx2(src + x * 4);
+        __m256i v1 = un_8888_x8_avx2(src + x * 4 + 32);
+        __m256i v2 = un_8888_x8_avx2(src + x * 4 + 64);
+        __m256i v3 = un_8888_x8_avx2(src + x * 4 + 96);
+        __m256i t0 = _mm256_unpacklo_epi64(v0, v1); // c0 0-15, c2 0-15
+        __m256i t1 = _mm256_unpackhi_epi64(v0, v1); // c1 0-15, c3 0-15
+        __m256i t2 = _mm256_unpacklo_epi64(v2, v3); // c0 16-31, c2 16-31
+        __m256i t3 = _mm256_unpackhi_epi64(v2, v3); // c1 16-31, c3 16-31
+        __m256i c[4] = {
+            _mm256_permute2x128_si256(t0, t2, 0x20),
+            _mm256_permute2x128_si256(t1, t3, 0x20),
+            _mm256_permute2x128_si256(t0, t2, 0x31),
+            _mm256_permute2x128_si256(t1, t3, 0x31),
+        };
+        for (int n = 0; n < 4; n++) {
+            if (d[n])
+                _mm256_storeu_si256((__m256i *)(d[n] + x), c[n]);
+        }
+    }
+    return x;
+}
+
+// Components with s[n]==NULL are written as 0.
+__attribute__((target("avx2")))
+static int pa_8888_avx2(uint8_t *dst, const uint8_t *s[4], int w)
+{
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i c[4];
+        for (int n = 0; n < 4; n++) {
+            c[n] = s[n] ? _mm256_loadu_si256((__m256i *)(s[n] + x))
+                        : _mm256_setzero_si256();
+        }
+        __m256i lo01 = _mm256_unpacklo_epi8(c[0], c[1]); // 0-7, 16-23
+        __m256i hi01 = _mm256_unpackhi_epi8(c[0], c[1]); // 8-15, 24-31
+        __m256i lo23 = _mm256_unpacklo_epi8(c[2], c[3]);
+        __m256i hi23 = _mm256_unpackhi_epi8(c[2], c[3]);
+        __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23); // 0-3, 16-19
+        __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23); // 4-7, 20-23
+        __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23); // 8-11, 24-27
+        __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23); // 12-15, 28-31
+        uint8_t *p = dst + x * 4;
+        _mm256_storeu_si256((__m256i *)(p + 0),
+                            _mm256_permute2x128_si256(q0, q1, 0x20));
+        _mm256_storeu_si256((__m256i *)(p + 32),
+                            _mm256_permute2x128_si256(q2, q3, 0x20));
+        _mm256_storeu_si256((__m256i *)(p + 64),
+                            _mm256_permute2x128_si256(q0, q1, 0x31));
+        _mm256_storeu_si256((__m256i *)(p + 96),
+                            _mm256_permute2x128_si256(q2, q3, 0x31));
+    }
+    return x;
+}
+
+// 3 byte pixels don't fit the 128 bit lanes of AVX2, so this uses SSSE3. For
+// 16 pixels, un_ccc8_shuf[v][c] gathers the bytes of component c from the
+// v-th 16 byte block of the packed data, and pa_ccc8_shuf[v][c] scatters the
+// bytes of component c to the v-th block. 0x80 means "write 0".
+static const uint8_t un_ccc8_shuf[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {2, 5, 8, 11, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80}},
+    {{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8, 11, 14, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80}},
+    {{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7, 10, 13},
+     {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8, 11, 14},
+     {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9, 12, 15}},
+};
+
+static const uint8_t pa_ccc8_shuf[3][3][16] = {
+    {{0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80, 5},
+     {0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80},
+     {0x80, 0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80}},
+    {{0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10, 0x80},
+     {5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10},
+     {0x80, 5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80}},
+    {{0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80, 0x80},
+     {0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80},
+     {10, 0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15}},
+};
+
+__attribute__((target("ssse3")))
+static int un_ccc8_ssse3(const uint8_t *src, uint8_t *d[3], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i v[3];
+        for (int n = 0; n < 3; n++)
+            v[n] = _mm_loadu_si128((__m128i *)(src + x * 3 + n * 16));
+        for (int c = 0; c < 3; c++) {
+            __m128i r = _mm_setzero_si128();
+            for (int n = 0; n < 3; n++) {
+                __m128i m = _mm_loadu_si128((__m128i *)un_ccc8_shuf[n][c]);
+                r = _mm_or_si128(r, _mm_shuffle_epi8(v[n], m));
+            }
+            _mm_storeu_si128((__m128i *)(d[c] + x), r);
+        }
+    }
+    return x;
+}
+
+__attribute__((target("ssse3")))
+static int pa_ccc8_ssse3(uint8_t *dst, const uint8_t *s[3], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i c[3];
+        for (int n = 0; n < 3; n++)
+            c[n] = _mm_loadu_si128((__m128i *)(s[n] + x));
+        for (int v = 0; v < 3; v++) {
+            __m128i r = _mm_setzero_si128();
+            for (int n = 0; n < 3; n++) {
+                __m128i m = _mm_loadu_si128((__m128i *)pa_ccc8_shuf[v][n]);
+                r = _mm_or_si128(r, _mm_shuffle_epi8(c[n], m));
+            }
+            _mm_storeu_si128((__m128i *)(dst + x * 3 + v * 16), r);
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int bswap16_avx2(uint16_t *dst, const uint16_t *src, int num)
+{
+    __m256i shuf = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                    9, 8, 11, 10, 13, 12, 15, 14,
+                                    1, 0, 3, 2, 5, 4, 7, 6,
+                                    9, 8, 11, 10, 13, 12, 15, 14);
+    int x = 0;
+    for (; x + 16 <= num; x += 16) {
+        __m256i v = _mm256_loadu_si256((__m256i *)(src + x));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_shuffle_epi8(v, shuf));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int bswap32_avx2(uint32_t *dst, const uint32_t *src, int num)
+{
+    __m256i shuf = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                    11, 10, 9, 8, 15, 14, 13, 12,
+                                    3, 2, 1, 0, 7, 6, 5, 4,
+                                    11, 10, 9, 8, 15, 14, 13, 12);
+    int x = 0;
+    for (; x + 8 <= num; x += 8) {
+        __m256i v = _mm256_loadu_si256((__m256i *)(src + x));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_shuffle_epi8(v, shuf));
+    }
+    return x;
+}
+#endif
+
+#if HAVE_NEON_SIMD
+static int un_cc8_neon(const uint8_t *src, uint8_t *d0, uint8_t *d1, int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x2_t v = vld2q_u8(src + x * 2);
+        vst1q_u8(d0 + x, v.val[0]);
+        vst1q_u8(d1 + x, v.val[1]);
+    }
+    return x;
+}
+
+static int pa_cc8_neon(uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                       int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x2_t v = {{vld1q_u8(s0 + x), vld1q_u8(s1 + x)}};
+        vst2q_u8(dst + x * 2, v);
+    }
+    return x;
+}
+
+static int un_cc16_neon(const uint16_t *src, uint16_t *d0, uint16_t *d1, int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8x2_t v = vld2q_u16(src + x * 2);
+        vst1q_u16(d0 + x, v.val[0]);
+        vst1q_u16(d1 + x, v.val[1]);
+    }
+    return x;
+}
+
+static int pa_cc16_neon(uint16_t *dst, const uint16_t *s0, const uint16_t *s1,
+                        int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8x2_t v = {{vld1q_u16(s0 + x), vld1q_u16(s1 + x)}};
+        vst2q_u16(dst + x * 2, v);
+    }
+    return x;
+}
+
+static int un_8888_neon(const uint8_t *src, uint8_t *d[4], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x4_t v = vld4q_u8(src + x * 4);
+        for (int n = 0; n < 4; n++) {
+            if (d[n])
+                vst1q_u8(d[n] + x, v.val[n]);
+        }
+    }
+    return x;
+}
+
+static int pa_8888_neon(uint8_t *dst, const uint8_t *s[4], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x4_t v;
+        for (int n = 0; n < 4; n++)
+            v.val[n] = s[n] ? vld1q_u8(s[n] + x) : vdupq_n_u8(0);
+        vst4q_u8(dst + x * 4, v);
+    }
+    return x;
+}
+
+static int un_ccc8_neon(const uint8_t *src, uint8_t *d[3], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x3_t v = vld3q_u8(src + x * 3);
+        for (int n = 0; n < 3; n++)
+            vst1q_u8(d[n] + x, v.val[n]);
+    }
+    return x;
+}
+
+static int pa_ccc8_neon(uint8_t *dst, const uint8_t *s[3], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x3_t v;
+        for (int n = 0; n < 3; n++)
+            v.val[n] = vld1q_u8(s[n] + x);
+        vst3q_u8(dst + x * 3, v);
+    }
+    return x;
+}
+
+static int bswap16_neon(uint16_t *dst, const uint16_t *src, int num)
+{
+    int x = 0;
+    for (; x + 8 <= num; x += 8) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(src + x));
+        vst1q_u8((uint8_t *)(dst + x), vrev16q_u8(v));
+    }
+    return x;
+}
+
+static int bswap32_neon(uint32_t *dst, const uint32_t *src, int num)
+{
+    int x = 0;
+    for (; x + 4 <= num; x += 4) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(src + x));
+        vst1q_u8((uint8_t *)(dst + x), vrev32q_u8(v));
+    }
+    return x;
+}
+#endif
+
+static int un_8888_simd(const uint8_t *src, uint8_t *d[4], int w)
+{
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return un_8888_avx2(src, d, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        return un_8888_neon(src, d, w);
+#endif
+    return 0;
+}
+
+static int pa_8888_simd(uint8_t *dst, const uint8_t *s[4], int w)
+{
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return pa_8888_avx2(dst, s, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        return pa_8888_neon(dst, s, w);
+#endif
+    return 0;
+}
+
+void mp_repack_un_cc8(void *restrict src, void *restrict dst[], int w)
+{
+    uint8_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = un_cc8_avx2(s, d0, d1, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = un_cc8_neon(s, d0, d1, w);
+#endif
+    for (; x < w; x++) {
+        uint16_t c = ((uint16_t *)s)[x];
+        d0[x] = c & 0xFFu;
+        d1[x] = c >> 8;
+    }
+}
+
+void mp_repack_pa_cc8(void *restrict dst, void *restrict src[], int w)
+{
+    uint8_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = pa_cc8_avx2(d, s0, s1, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = pa_cc8_neon(d, s0, s1, w);
+#endif
+    for (; x < w; x++)
+        ((uint16_t *)d)[x] = s0[x] | (s1[x] << 8);
+}
+
+void mp_repack_un_cc16(void *restrict src, void *restrict dst[], int w)
+{
+    uint16_t *d0 = dst[0], *d1 = dst[1];
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = un_cc16_avx2(src, d0, d1, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = un_cc16_neon(src, d0, d1, w);
+#endif
+    for (; x < w; x++) {
+        uint32_t c = ((uint32_t *)src)[x];
+        d0[x] = c & 0xFFFFu;
+        d1[x] = c >> 16;
+    }
+}
+
+void mp_repack_pa_cc16(void *restrict dst, void *restrict src[], int w)
+{
+    uint16_t *s0 = src[0], *s1 = src[1];
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = pa_cc16_avx2(dst, s0, s1, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = pa_cc16_neon(dst, s0, s1, w);
+#endif
+    for (; x < w; x++)
+        ((uint32_t *)dst)[x] = s0[x] | ((uint32_t)s1[x] << 16);
+}
+
+void mp_repack_un_ccc8(void *restrict src, void *restrict dst[], int w)
+{
+    uint8_t *s = src;
+    uint8_t *d[3] = {dst[0], dst[1], dst[2]};
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3)
+        x = un_ccc8_ssse3(s, d, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = un_ccc8_neon(s, d, w);
+#endif
+    for (; x < w; x++) {
+        d[0][x] = s[x * 3 + 0];
+        d[1][x] = s[x * 3 + 1];
+        d[2][x] = s[x * 3 + 2];
+    }
+}
+
+void mp_repack_pa_ccc8(void *restrict dst, void *restrict src[], int w)
+{
+    uint8_t *d = dst;
+    const uint8_t *s[3] = {src[0], src[1], src[2]};
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3)
+        x = pa_ccc8_ssse3(d, s, w);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = pa_ccc8_neon(d, s, w);
+#endif
+    for (; x < w; x++) {
+        d[x * 3 + 0] = s[0][x];
+        d[x * 3 + 1] = s[1][x];
+        d[x * 3 + 2] = s[2][x];
+    }
+}
+
+void mp_repack_un_cccc8(void *restrict src, void *restrict dst[], int w)
+{
+    uint8_t *d[4] = {dst[0], dst[1], dst[2], dst[3]};
+    for (int x = un_8888_simd(src, d, w); x < w; x++) {
+        uint32_t c = ((uint32_t *)src)[x];
+        d[0][x] = c & 0xFFu;
+        d[1][x] = (c >> 8) & 0xFFu;
+        d[2][x] = (c >> 16) & 0xFFu;
+        d[3][x] = c >> 24;
+    }
+}
+
+void mp_repack_pa_cccc8(void *restrict dst, void *restrict src[], int w)
+{
+    const uint8_t *s[4] = {src[0], src[1], src[2], src[3]};
+    for (int x = pa_8888_simd(dst, s, w); x < w; x++) {
+        ((uint32_t *)dst)[x] = s[0][x] | ((uint32_t)s[1][x] << 8) |
+                               ((uint32_t)s[2][x] << 16) |
+                               ((uint32_t)s[3][x] << 24);
+    }
+}
+
+void mp_repack_un_ccc8x8(void *restrict src, void *restrict dst[], int w)
+{
+    uint8_t *d[4] = {dst[0], dst[1], dst[2], NULL};
+    for (int x = un_8888_simd(src, d, w); x < w; x++) {
+        uint32_t c = ((uint32_t *)src)[x];
+        d[0][x] = c & 0xFFu;
+        d[1][x] = (c >> 8) & 0xFFu;
+        d[2][x] = (c >> 16) & 0xFFu;
+    }
+}
+
+void mp_repack_pa_ccc8z8(void *restrict dst, void *restrict src[], int w)
+{
+    const uint8_t *s[4] = {src[0], src[1], src[2], NULL};
+    for (int x = pa_8888_simd(dst, s, w); x < w; x++) {
+        ((uint32_t *)dst)[x] = s[0][x] | ((uint32_t)s[1][x] << 8) |
+                               ((uint32_t)s[2][x] << 16);
+    }
+}
+
+void mp_repack_un_x8ccc8(void *restrict src, void *restrict dst[], int w)
+{
+    uint8_t *d[4] = {NULL, dst[0], dst[1], dst[2]};
+    for (int x = un_8888_simd(src, d, w); x < w; x++) {
+        uint32_t c = ((uint32_t *)src)[x];
+        d[1][x] = (c >> 8) & 0xFFu;
+        d[2][x] = (c >> 16) & 0xFFu;
+        d[3][x] = c >> 24;
+    }
+}
+
+void mp_repack_pa_z8ccc8(void *restrict dst, void *restrict src[], int w)
+{
+    const uint8_t *s[4] = {NULL, src[0], src[1], src[2]};
+    for (int x = pa_8888_simd(dst, s, w); x < w; x++) {
+        ((uint32_t *)dst)[x] = ((uint32_t)s[1][x] << 8) |
+                               ((uint32_t)s[2][x] << 16) |
+                               ((uint32_t)s[3][x] << 24);
+    }
+}
+
+void mp_repack_bswap16(uint16_t *restrict dst, const uint16_t *restrict src,
+                       int num)
+{
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = bswap16_avx2(dst, src, num);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = bswap16_neon(dst, src, num);
+#endif
+    for (; x < num; x++)
+        dst[x] = av_bswap16(src[x]);
+}
+
+void mp_repack_bswap32(uint32_t *restrict dst, const uint32_t *restrict src,
+                       int num)
+{
+    int x = 0;
+#if HAVE_X86_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        x = bswap32_avx2(dst, src, num);
+#elif HAVE_NEON_SIMD
+    if (av_get_cpu_flags() & AV_CPU_FLAG_NEON)
+        x = bswap32_neon(dst, src, num);
+#endif
+    for (; x < num; x++)
+        dst[x] = av_bswap32(src[x]);
+}
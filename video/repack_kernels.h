@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scanline kernels for the most common repack.c conversions. These use SIMD
+// where the CPU supports it (checked with av_get_cpu_flags() on every call, so
+// av_force_cpu_flags() can be used to select the C versions), and produce the
+// same results on all code paths.
+//
+// The naming and the parameters follow the pa_/un_ scanline functions in
+// repack.c: unpackers take (packed src, planar dst[], w), packers take
+// (packed dst, planar src[], w), w is the number of packed pixels.
+
+// 2x8 bit (e.g. NV12 chroma).
+void mp_repack_un_cc8(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_cc8(void *restrict dst, void *restrict src[], int w);
+
+// 2x16 bit (e.g. P010/P016 chroma).
+void mp_repack_un_cc16(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_cc16(void *restrict dst, void *restrict src[], int w);
+
+// 3x8 bit (RGB24, BGR24).
+void mp_repack_un_ccc8(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_ccc8(void *restrict dst, void *restrict src[], int w);
+
+// 4x8 bit in 32 bit words, optionally with padding (RGBA, RGB0, 0RGB etc.).
+void mp_repack_un_cccc8(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_cccc8(void *restrict dst, void *restrict src[], int w);
+void mp_repack_un_ccc8x8(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_ccc8z8(void *restrict dst, void *restrict src[], int w);
+void mp_repack_un_x8ccc8(void *restrict src, void *restrict dst[], int w);
+void mp_repack_pa_z8ccc8(void *restrict dst, void *restrict src[], int w);
+
+// Byte swap num 16/32 bit words.
+void mp_repack_bswap16(uint16_t *restrict dst, const uint16_t *restrict src,
+                       int num);
+void mp_repack_bswap32(uint32_t *restrict dst, const uint32_t *restrict src,
+                       int num);
@@ -20,6 +20,8 @@
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+#include <libavutil/frame.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
 #include <libplacebo/utils/libav.h>
@@ -37,6 +39,7 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "osdep/endian.h"
+#include "osdep/threads.h"
 
 #if HAVE_ZIMG
 #include "zimg.h"
@@ -54,6 +57,7 @@ struct sws_opts {
     bool fast;
     bool bitexact;
     bool zimg;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -80,6 +84,7 @@ const struct m_sub_options sws_conf = {
         {"fast", OPT_BOOL(fast)},
         {"bitexact", OPT_BOOL(bitexact)},
         {"allow-zimg", OPT_BOOL(zimg)},
+        {"threads", OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct sws_opts),
@@ -96,17 +101,176 @@ static const int mp_sws_hq_flags = SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP |
 // Fast, lossy.
 const int mp_sws_fast_flags = SWS_BILINEAR;
 
+// Parameters an initialized SwsContext depends on.
+struct sws_plan_key {
+    struct mp_image_params src, dst;
+    int flags;
+    int threads;
+    double params[2];
+    float filter[6]; // sws_getDefaultFilter() arguments for src_filter
+};
+
+// An initialized SwsContext, kept in the plan cache while no context uses it.
+struct sws_plan {
+    struct sws_plan_key key;
+    struct SwsContext *sws;
+    bool supports_csp;
+    bool slice_threads;
+};
+
+#define MAX_PLANS 8
+
+// Plan cache shared by all contexts; most recently used plan first. Only used
+// while at least one mp_sws_plan_cache_ref() reference exists.
+static mp_static_mutex plan_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct sws_plan *plans[MAX_PLANS];
+static int num_plans;
+static int plan_refs;
+
+static void free_plan(struct sws_plan *plan)
+{
+    sws_freeContext(plan->sws);
+    talloc_free(plan);
+}
+
+static void plan_cache_unref(void *p)
+{
+    mp_mutex_lock(&plan_lock);
+    mp_assert(plan_refs > 0);
+    if (--plan_refs == 0) {
+        for (int n = 0; n < num_plans; n++)
+            free_plan(plans[n]);
+        num_plans = 0;
+#if HAVE_ZIMG
+        mp_zimg_plan_cache_enable(false);
+#endif
+    }
+    mp_mutex_unlock(&plan_lock);
+}
+
+void *mp_sws_plan_cache_ref(void *ta_parent)
+{
+    void *ref = talloc_new(ta_parent);
+    talloc_set_destructor(ref, plan_cache_unref);
+
+    mp_mutex_lock(&plan_lock);
+    if (plan_refs++ == 0) {
+#if HAVE_ZIMG
+        mp_zimg_plan_cache_enable(true);
+#endif
+    }
+    mp_mutex_unlock(&plan_lock);
+
+    return ref;
+}
+
+static bool plan_key_equal(struct sws_plan_key *a, struct sws_plan_key *b)
+{
+    return mp_image_params_equal(&a->src, &b->src) &&
+           mp_image_params_equal(&a->dst, &b->dst) &&
+           a->flags == b->flags &&
+           a->threads == b->threads &&
+           !memcmp(a->params, b->params, sizeof(a->params)) &&
+           !memcmp(a->filter, b->filter, sizeof(a->filter));
+}
+
+// Set the src_filter to sws_getDefaultFilter(filter[0], ..., filter[5], 0),
+// and remember the arguments, so that the SwsContext can be cached.
+static void set_default_filter(struct mp_sws_context *ctx, float filter[6])
+{
+    sws_freeFilter(ctx->src_filter);
+    ctx->src_filter = sws_getDefaultFilter(filter[0], filter[1], filter[2],
+                                           filter[3], filter[4], filter[5], 0);
+    ctx->keyed_filter = ctx->src_filter;
+    memcpy(ctx->filter_key, ctx->keyed_filter ? filter : (float[6]){0},
+           sizeof(ctx->filter_key));
+    ctx->force_reload = true;
+}
+
+// Set the key of the SwsContext ctx is about to create. Returns false if the
+// context can't be cached, because it uses custom filters.
+static bool get_plan_key(struct mp_sws_context *ctx, int threads,
+                         struct sws_plan_key *key)
+{
+    if (ctx->dst_filter || ctx->src_filter != ctx->keyed_filter)
+        return false;
+
+    *key = (struct sws_plan_key){
+        .src = ctx->src,
+        .dst = ctx->dst,
+        .flags = ctx->flags,
+        .threads = threads,
+        .params = {ctx->params[0], ctx->params[1]},
+    };
+    if (ctx->src_filter)
+        memcpy(key->filter, ctx->filter_key, sizeof(key->filter));
+    return true;
+}
+
+// Use the cached SwsContext matching key, if there is any.
+static bool take_plan(struct mp_sws_context *ctx, struct sws_plan_key *key)
+{
+    struct sws_plan *plan = NULL;
+
+    mp_mutex_lock(&plan_lock);
+    for (int n = 0; n < num_plans; n++) {
+        if (plan_key_equal(&plans[n]->key, key)) {
+            plan = plans[n];
+            MP_TARRAY_REMOVE_AT(plans, num_plans, n);
+            break;
+        }
+    }
+    mp_mutex_unlock(&plan_lock);
+
+    if (!plan)
+        return false;
+
+    ctx->sws = plan->sws;
+    ctx->supports_csp = plan->supports_csp;
+    ctx->slice_threads = plan->slice_threads;
+    ctx->plan = plan;
+    return true;
+}
+
+// Free ctx->sws, or hand it to the plan cache if it was fully initialized.
+static void release_sws(struct mp_sws_context *ctx)
+{
+    struct sws_plan *plan = ctx->plan;
+    ctx->plan = NULL;
+
+    if (!plan) {
+        sws_freeContext(ctx->sws);
+        ctx->sws = NULL;
+        return;
+    }
+
+    mp_assert(plan->sws == ctx->sws);
+    ctx->sws = NULL;
+
+    mp_mutex_lock(&plan_lock);
+    if (plan_refs) {
+        if (num_plans == MAX_PLANS)
+            free_plan(plans[--num_plans]);
+        memmove(&plans[1], &plans[0], num_plans * sizeof(plans[0]));
+        plans[0] = plan;
+        num_plans++;
+        plan = NULL;
+    }
+    mp_mutex_unlock(&plan_lock);
+
+    if (plan)
+        free_plan(plan);
+}
+
 // Set ctx parameters to global command line flags.
 static void mp_sws_update_from_cmdline(struct mp_sws_context *ctx)
 {
     m_config_cache_update(ctx->opts_cache);
     struct sws_opts *opts = ctx->opts_cache->opts;
 
-    sws_freeFilter(ctx->src_filter);
-    ctx->src_filter = sws_getDefaultFilter(opts->lum_gblur, opts->chr_gblur,
-                                           opts->lum_sharpen, opts->chr_sharpen,
-                                           opts->chr_hshift, opts->chr_vshift, 0);
-    ctx->force_reload = true;
+    set_default_filter(ctx, (float[6]){opts->lum_gblur, opts->chr_gblur,
+                                       opts->lum_sharpen, opts->chr_sharpen,
+                                       opts->chr_hshift, opts->chr_vshift});
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
@@ -116,6 +280,7 @@ static void mp_sws_update_from_cmdline(struct mp_sws_context *ctx)
         ctx->flags |= SWS_BITEXACT;
 
     ctx->allow_zimg = opts->zimg;
+    ctx->threads = opts->threads;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -171,6 +336,7 @@ static bool cache_valid(struct mp_sws_context *ctx)
            mp_image_params_equal(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
            ctx->allow_zimg == old->allow_zimg &&
+           ctx->threads == old->threads &&
            ctx->force_scaler == old->force_scaler &&
            (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache));
 }
@@ -178,7 +344,7 @@ static bool cache_valid(struct mp_sws_context *ctx)
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
-    sws_freeContext(ctx->sws);
+    release_sws(ctx);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
     TA_FREEP(&ctx->aligned_src);
@@ -193,6 +359,7 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
     *ctx = (struct mp_sws_context) {
         .log = mp_null_log,
         .flags = SWS_BILINEAR,
+        .threads = 1,
         .force_reload = true,
         .params = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT},
         .cached = talloc_zero(ctx, struct mp_sws_context),
@@ -227,6 +394,16 @@ void mp_sws_enable_cmdline_opts(struct mp_sws_context *ctx, struct mpv_global *g
 #endif
 }
 
+// Return the --sws-threads value (0 means auto), for code which does its own
+// slice threading along with libswscale.
+int mp_sws_get_cmdline_threads(struct mpv_global *g)
+{
+    struct sws_opts *opts = mp_get_config_group(NULL, g, &sws_conf);
+    int threads = opts->threads;
+    talloc_free(opts);
+    return threads;
+}
+
 // Reinitialize (if needed) - return error code.
 // Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
 int mp_sws_reinit(struct mp_sws_context *ctx)
@@ -240,9 +417,9 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (ctx->opts_cache)
         mp_sws_update_from_cmdline(ctx);
 
-    sws_freeContext(ctx->sws);
-    ctx->sws = NULL;
+    release_sws(ctx);
     ctx->zimg_ok = false;
+    ctx->slice_threads = false;
     TA_FREEP(&ctx->aligned_src);
     TA_FREEP(&ctx->aligned_dst);
 
@@ -267,6 +444,18 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
     }
 
+    int threads = ctx->threads;
+    if (threads < 1)
+        threads = av_cpu_count();
+    threads = MPCLAMP(threads, 1, 64);
+
+    struct sws_plan_key key;
+    bool cacheable = get_plan_key(ctx, threads, &key);
+    if (cacheable && take_plan(ctx, &key)) {
+        MP_DBG(ctx, "Reusing cached libswscale context.\n");
+        goto success;
+    }
+
     ctx->sws = sws_alloc_context();
     if (!ctx->sws)
         return -1;
@@ -304,6 +493,8 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     av_opt_set_int(ctx->sws, "dsth", dst.h, 0);
     av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
 
+    av_opt_set_int(ctx->sws, "threads", threads, 0);
+
     av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
     av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
 
@@ -330,9 +521,27 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
         return -1;
 
-#if HAVE_ZIMG
+    // The per-slice contexts are created by sws_init_context(), and don't
+    // inherit the colorspace tables set before. Setting them again after init
+    // applies them to all slices.
+    ctx->slice_threads = threads > 1;
+    if (ctx->slice_threads && ctx->supports_csp) {
+        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
+                                 sws_getCoefficients(d_csp), d_range,
+                                 0, 1 << 16, 1 << 16);
+    }
+
+    if (cacheable) {
+        ctx->plan = talloc_ptrtype(NULL, ctx->plan);
+        *ctx->plan = (struct sws_plan){
+            .key = key,
+            .sws = ctx->sws,
+            .supports_csp = ctx->supports_csp,
+            .slice_threads = ctx->slice_threads,
+        };
+    }
+
 success:
-#endif
 
     ctx->force_reload = false;
     *ctx->cached = *ctx;
@@ -375,6 +584,44 @@ static struct mp_image *check_alignment(struct mp_log *log,
     return *alloc;
 }
 
+static void dummy_free(void *opaque, uint8_t *data)
+{
+}
+
+// Wrap img in an AVFrame without copying or referencing it. The frame must not
+// outlive img. (sws_scale_frame() would copy or allocate non-refcounted frames.)
+static AVFrame *wrap_frame(struct mp_image *img)
+{
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+    frame->format = imgfmt2pixfmt(img->imgfmt);
+    frame->width = img->w;
+    frame->height = img->h;
+    for (int n = 0; n < 4; n++) {
+        frame->data[n] = img->planes[n];
+        frame->linesize[n] = img->stride[n];
+    }
+    frame->buf[0] = av_buffer_create(img->planes[0], 1, dummy_free, NULL, 0);
+    if (!frame->buf[0])
+        av_frame_free(&frame);
+    return frame;
+}
+
+// Run the conversion with libswscale's slice threads.
+static int scale_threaded(struct mp_sws_context *ctx, struct mp_image *dst,
+                          struct mp_image *src)
+{
+    int r = -1;
+    AVFrame *avsrc = wrap_frame(src);
+    AVFrame *avdst = wrap_frame(dst);
+    if (avsrc && avdst)
+        r = sws_scale_frame(ctx->sws, avdst, avsrc);
+    av_frame_free(&avsrc);
+    av_frame_free(&avdst);
+    return r < 0 ? -1 : 0;
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -391,8 +638,10 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     }
 
 #if HAVE_ZIMG
-    if (ctx->zimg_ok)
+    if (ctx->zimg_ok) {
+        ctx->zimg->background = ctx->background;
         return mp_zimg_convert(ctx->zimg, dst, src) ? 0 : -1;
+    }
 #endif
 
     if (src->params.repr.sys == PL_COLOR_SYSTEM_XYZ && dst->params.repr.sys != PL_COLOR_SYSTEM_XYZ) {
@@ -415,8 +664,16 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     if (a_src != src)
         mp_image_copy(a_src, src);
 
-    sws_scale(ctx->sws, (const uint8_t *const *) a_src->planes, a_src->stride,
-              0, a_src->h, a_dst->planes, a_dst->stride);
+    if (ctx->slice_threads) {
+        r = scale_threaded(ctx, a_dst, a_src);
+        if (r < 0) {
+            MP_ERR(ctx, "libswscale conversion failed.\n");
+            return r;
+        }
+    } else {
+        sws_scale(ctx->sws, (const uint8_t *const *) a_src->planes, a_src->stride,
+                  0, a_src->h, a_dst->planes, a_dst->stride);
+    }
 
     if (a_dst != dst)
         mp_image_copy(dst, a_dst);
@@ -429,8 +686,7 @@ int mp_image_sw_blur_scale(struct mp_image *dst, struct mp_image *src,
 {
     struct mp_sws_context *ctx = mp_sws_alloc(NULL);
     ctx->flags = SWS_LANCZOS | mp_sws_hq_flags;
-    ctx->src_filter = sws_getDefaultFilter(gblur, gblur, 0, 0, 0, 0, 0);
-    ctx->force_reload = true;
+    set_default_filter(ctx, (float[6]){gblur, gblur});
     int res = mp_sws_scale(ctx, dst, src);
     talloc_free(ctx);
     return res;
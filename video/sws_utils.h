@@ -33,7 +33,9 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     bool allow_zimg; // use zimg if available (ignores filters and all)
+    int threads; // libswscale slice threads (0 = auto, default: 1)
     bool force_reload;
+    bool background; // zimg: run at background priority (see mp_zimg_context)
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -54,6 +56,7 @@ struct mp_sws_context {
     // Cached context (if any)
     struct SwsContext *sws;
     bool supports_csp;
+    bool slice_threads;
 
     // Private.
     struct m_config_cache *opts_cache;
@@ -61,14 +64,26 @@ struct mp_sws_context {
     struct mp_zimg_context *zimg;
     bool zimg_ok;
     struct mp_image *aligned_src, *aligned_dst;
+    struct sws_plan *plan; // set if sws can be handed to the plan cache
+    struct SwsFilter *keyed_filter; // src_filter created from filter_key
+    float filter_key[6];
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
 void mp_sws_enable_cmdline_opts(struct mp_sws_context *ctx, struct mpv_global *g);
+int mp_sws_get_cmdline_threads(struct mpv_global *g);
 int mp_sws_reinit(struct mp_sws_context *ctx);
 int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
                  struct mp_image *src);
 
+// Keep the conversion plans (libswscale and zimg contexts) of freed or
+// reconfigured scaler contexts in a small process-wide LRU cache, so that other
+// contexts with the same parameters (screenshots, image writing, OSD drawing,
+// VOs) can take them over instead of building them again. The cache is active
+// while at least one reference exists, and is flushed when the last one is
+// freed with talloc_free().
+void *mp_sws_plan_cache_ref(void *ta_parent);
+
 bool mp_sws_supports_formats(struct mp_sws_context *ctx,
                              int imgfmt_out, int imgfmt_in);
 
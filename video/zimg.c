@@ -23,9 +23,9 @@
 #include "common/msg.h"
 #include "csputils.h"
 #include "misc/thread_pool.h"
-#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "osdep/threads.h"
 #include "repack.h"
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
@@ -87,7 +87,6 @@ struct mp_zimg_state {
     struct mp_zimg_repack *dst;
     int slice_y, slice_h; // y start position, height of target slice
     double scale_y;
-    struct mp_waiter thread_waiter;
 };
 
 struct mp_zimg_repack {
@@ -198,24 +197,139 @@ static zimg_color_primaries_e mp_to_z_prim(enum pl_color_primaries prim)
     }
 }
 
-static void destroy_zimg(struct mp_zimg_context *ctx)
+// A complete set of slice states, kept in the plan cache while no context
+// uses it.
+struct zimg_plan {
+    struct mp_image_params src, dst;
+    struct zimg_opts opts;
+    struct mp_zimg_state **states;
+    int num_states;
+};
+
+#define MAX_PLANS 8
+
+// Plan cache shared by all contexts; most recently used plan first. Only used
+// while enabled with mp_zimg_plan_cache_enable().
+static mp_static_mutex plan_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct zimg_plan *plans[MAX_PLANS];
+static int num_plans;
+static bool plans_enabled;
+
+static void free_states(struct mp_zimg_state **states, int num_states)
 {
-    for (int n = 0; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
+    for (int n = 0; n < num_states; n++) {
+        struct mp_zimg_state *st = states[n];
         talloc_free(st->tmp_alloc);
         zimg_filter_graph_free(st->graph);
         TA_FREEP(&st->src);
         TA_FREEP(&st->dst);
         talloc_free(st);
     }
+}
+
+static void free_plan(struct zimg_plan *plan)
+{
+    free_states(plan->states, plan->num_states);
+    talloc_free(plan);
+}
+
+#define PARAM_EQ(a, b) ((a) == (b) || (isnan(a) && isnan(b)))
+
+static bool opts_equal(struct zimg_opts *a, struct zimg_opts *b)
+{
+    return a->scaler == b->scaler &&
+           PARAM_EQ(a->scaler_params[0], b->scaler_params[0]) &&
+           PARAM_EQ(a->scaler_params[1], b->scaler_params[1]) &&
+           a->scaler_chroma == b->scaler_chroma &&
+           PARAM_EQ(a->scaler_chroma_params[0], b->scaler_chroma_params[0]) &&
+           PARAM_EQ(a->scaler_chroma_params[1], b->scaler_chroma_params[1]) &&
+           a->dither == b->dither &&
+           a->fast == b->fast;
+}
+
+void mp_zimg_plan_cache_enable(bool enable)
+{
+    mp_mutex_lock(&plan_lock);
+    plans_enabled = enable;
+    if (!enable) {
+        for (int n = 0; n < num_plans; n++)
+            free_plan(plans[n]);
+        num_plans = 0;
+    }
+    mp_mutex_unlock(&plan_lock);
+}
+
+// Move the states of the cached plan matching the ctx parameters into ctx.
+static bool take_plan(struct mp_zimg_context *ctx, int slices)
+{
+    struct zimg_plan *plan = NULL;
+
+    mp_mutex_lock(&plan_lock);
+    for (int n = 0; n < num_plans; n++) {
+        struct zimg_plan *p = plans[n];
+        if (p->num_states == slices &&
+            mp_image_params_equal(&p->src, &ctx->src) &&
+            mp_image_params_equal(&p->dst, &ctx->dst) &&
+            opts_equal(&p->opts, &ctx->opts))
+        {
+            plan = p;
+            MP_TARRAY_REMOVE_AT(plans, num_plans, n);
+            break;
+        }
+    }
+    mp_mutex_unlock(&plan_lock);
+
+    if (!plan)
+        return false;
+
+    for (int n = 0; n < plan->num_states; n++)
+        MP_TARRAY_APPEND(ctx, ctx->states, ctx->num_states, plan->states[n]);
+    talloc_free(plan);
+    return true;
+}
+
+// Release the states of ctx. If keep is set (the states are complete), hand
+// them to the plan cache instead of freeing them.
+static void destroy_zimg(struct mp_zimg_context *ctx, bool keep)
+{
+    if (!ctx->num_states)
+        return;
+
+    if (!keep) {
+        free_states(ctx->states, ctx->num_states);
+        ctx->num_states = 0;
+        return;
+    }
+
+    struct zimg_plan *plan = talloc_zero(NULL, struct zimg_plan);
+    plan->src = ctx->states[0]->src->fmt;
+    plan->dst = ctx->states[0]->dst->fmt;
+    plan->opts = ctx->plan_opts;
+    plan->states = talloc_memdup(plan, ctx->states,
+                                 ctx->num_states * sizeof(ctx->states[0]));
+    plan->num_states = ctx->num_states;
     ctx->num_states = 0;
+
+    mp_mutex_lock(&plan_lock);
+    if (plans_enabled) {
+        if (num_plans == MAX_PLANS)
+            free_plan(plans[--num_plans]);
+        memmove(&plans[1], &plans[0], num_plans * sizeof(plans[0]));
+        plans[0] = plan;
+        num_plans++;
+        plan = NULL;
+    }
+    mp_mutex_unlock(&plan_lock);
+
+    if (plan)
+        free_plan(plan);
 }
 
 static void free_mp_zimg(void *p)
 {
     struct mp_zimg_context *ctx = p;
 
-    destroy_zimg(ctx);
+    destroy_zimg(ctx, true);
     TA_FREEP(&ctx->tp);
 }
 
@@ -237,7 +351,7 @@ void mp_zimg_enable_cmdline_opts(struct mp_zimg_context *ctx,
         return;
 
     ctx->opts_cache = m_config_cache_alloc(ctx, g, &zimg_conf);
-    destroy_zimg(ctx); // force update
+    destroy_zimg(ctx, true); // force update
     mp_zimg_update_from_cmdline(ctx); // first update
 }
 
@@ -581,7 +695,7 @@ static bool mp_zimg_state_init(struct mp_zimg_context *ctx,
 
 bool mp_zimg_config(struct mp_zimg_context *ctx)
 {
-    destroy_zimg(ctx);
+    destroy_zimg(ctx, true);
 
     if (ctx->opts_cache)
         mp_zimg_update_from_cmdline(ctx);
@@ -600,20 +714,17 @@ bool mp_zimg_config(struct mp_zimg_context *ctx)
     slice_h = MP_ALIGN_UP(slice_h, 64); // for dithering and minimum slice size
     slices = (full_h + slice_h - 1) / slice_h;
 
-    int threads = slices - 1;
-    if (threads != ctx->current_thread_count) {
-        // Just destroy and recreate all - dumb and costly, but rarely happens.
-        TA_FREEP(&ctx->tp);
-        ctx->current_thread_count = 0;
-        if (threads) {
-            MP_VERBOSE(ctx, "using %d threads for scaling\n", threads);
-            ctx->tp = mp_thread_pool_create(NULL, threads, threads, threads);
-            if (!ctx->tp)
-                goto fail;
-            ctx->current_thread_count = threads;
-        }
+    if (slices > 1 && !ctx->tp) {
+        ctx->tp = mp_task_pool_get(NULL);
+        MP_VERBOSE(ctx, "using %d slices on %d threads for scaling\n", slices,
+                   mp_task_pool_threads(ctx->tp));
     }
 
+    ctx->plan_opts = ctx->opts;
+
+    if (take_plan(ctx, slices))
+        return true;
+
     for (int n = 0; n < slices; n++) {
         struct mp_zimg_state *st = talloc_zero(NULL, struct mp_zimg_state);
         MP_TARRAY_APPEND(ctx, ctx->states, ctx->num_states, st);
@@ -627,7 +738,7 @@ bool mp_zimg_config(struct mp_zimg_context *ctx)
     return true;
 
 fail:
-    destroy_zimg(ctx);
+    destroy_zimg(ctx, false);
     return false;
 }
 
@@ -665,12 +776,11 @@ static void do_convert(struct mp_zimg_state *st)
                               repack_entrypoint, st->dst);
 }
 
-static void do_convert_thread(void *ptr)
+static void do_convert_slice(void *ptr, int index)
 {
-    struct mp_zimg_state *st = ptr;
+    struct mp_zimg_context *ctx = ptr;
 
-    do_convert(st);
-    mp_waiter_wakeup(&st->thread_waiter, 0);
+    do_convert(ctx->states[index]);
 }
 
 bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
@@ -693,23 +803,9 @@ bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
         }
     }
 
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
-
-        st->thread_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
-
-        bool r = mp_thread_pool_run(ctx->tp, do_convert_thread, st);
-        // This is guaranteed by the API; and unrolling would be inconvenient.
-        mp_assert(r);
-    }
-
-    do_convert(ctx->states[0]);
-
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
-
-        mp_waiter_wait(&st->thread_waiter);
-    }
+    mp_task_pool_run_all(ctx->tp, ctx->background ? MP_TASK_BACKGROUND
+                                                   : MP_TASK_REALTIME,
+                         ctx->num_states, do_convert_slice, ctx);
 
     return true;
 }
@@ -39,12 +39,16 @@ struct mp_zimg_context {
     // automatically.
     struct mp_image_params src, dst;
 
+    // Run the slices at background priority in the shared worker pool (for
+    // work that does not hold up playback). Can be changed at any time.
+    bool background;
+
     // Cached zimg state (if any). Private, do not touch.
     struct m_config_cache *opts_cache;
     struct mp_zimg_state **states;
     int num_states;
-    struct mp_thread_pool *tp;
-    int current_thread_count;
+    struct zimg_opts plan_opts; // opts the states were built with
+    struct mp_task_pool *tp;
 };
 
 // Allocate a zimg context. Always succeeds. Returns a talloc pointer (use
@@ -68,6 +72,10 @@ bool mp_zimg_config(struct mp_zimg_context *ctx);
 // changed, and if so, calls mp_zimg_config().
 bool mp_zimg_config_image_params(struct mp_zimg_context *ctx);
 
+// Enable or disable (and flush) the cache of conversion plans shared by all
+// contexts. Used by mp_sws_plan_cache_ref().
+void mp_zimg_plan_cache_enable(bool enable);
+
 // Convert/scale src to dst. On failure, the data in dst is not touched.
 bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
                      struct mp_image *src);